@@ -413,7 +413,9 @@ static int call_engine(char * name, int argc, char ** argv)
 		return -1 ;
 	}
 	/* Execute engine */
+	TRACE_BEGIN(engine_table[found].name) ;
 	status = engine_table[found].func(d);
+	TRACE_END(engine_table[found].name) ;
 	/* Discard dictionary and exit */
 	dictionary_del(d);
 	return status ;
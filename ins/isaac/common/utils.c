@@ -222,3 +222,31 @@ int isaac_is_xenon_lamp_active(char * filename)
     return 0 ;
 }
 
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Declare a recipe input to the product cache.
+  @param    pc          Computation description (see prodcache.h).
+  @param    filename    Name of a FITS file or of an ASCII frame list.
+  @return   0 if Ok, -1 in error case
+
+  If the input is an ASCII frame list, the list itself and all frames
+  it refers to are declared.
+ */
+/*----------------------------------------------------------------------------*/
+int isaac_cache_add_input(prodcache * pc, char * filename)
+{
+    framelist   *   flist ;
+    int             err ;
+    int             i ;
+
+    if (pc == NULL) return 0 ;
+    if (prodcache_add_file(pc, filename) != 0) return -1 ;
+    if (is_ascii_list(filename) != 1) return 0 ;
+    if ((flist = framelist_load(filename)) == NULL) return -1 ;
+    err = 0 ;
+    for (i=0 ; i<flist->n ; i++) {
+        if (prodcache_add_file(pc, flist->name[i]) != 0) err = -1 ;
+    }
+    framelist_del(flist) ;
+    return err ;
+}
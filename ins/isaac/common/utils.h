@@ -79,4 +79,17 @@ int isaac_is_argon_lamp_active(char * filename) ;
 /*----------------------------------------------------------------------------*/
 int isaac_is_xenon_lamp_active(char * filename) ;
 
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Declare a recipe input to the product cache.
+  @param    pc          Computation description (see prodcache.h).
+  @param    filename    Name of a FITS file or of an ASCII frame list.
+  @return   0 if Ok, -1 in error case
+
+  If the input is an ASCII frame list, the list itself and all frames
+  it refers to are declared.
+ */
+/*----------------------------------------------------------------------------*/
+int isaac_cache_add_input(prodcache * pc, char * filename) ;
+
 #endif
@@ -32,6 +32,9 @@
 #define	ISAAC_DARK_HSIZE_SW_DEF		6
 #define	ISAAC_DARK_HSIZE_LW_DEF		2
 
+/* Products are recomputed whenever this file changes */
+static char isaac_dark_cache_version[] = "$Revision: 1.24 $" ;
+
 /*-----------------------------------------------------------------------------
                             Private functions
  -----------------------------------------------------------------------------*/
@@ -136,7 +139,9 @@ static int isaac_dark_engine(
     framelist   *   lnames ;
     int             nsettings ;
     framelist   *   sublist ;
+    prodcache   *   pc ;
     char            outname[FILENAMESZ] ;
+    int             failed ;
     int             i, j ;
 
     /* Test inputs */
@@ -169,10 +174,33 @@ static int isaac_dark_engine(
             e_comment(2, "%s", sublist->name[j]) ;
         }
 
+        /* Products of this setting may already be in the cache */
+        pc = prodcache_new("isaac_dark", rcs_value(isaac_dark_cache_version)) ;
+        for (j=0 ; j<sublist->n ; j++) {
+            prodcache_add_file(pc, sublist->name[j]) ;
+        }
+        prodcache_add_param(pc, "output", "%s", name_o) ;
+        prodcache_add_param(pc, "setting", "%d", i+1) ;
+        prodcache_add_param(pc, "average", "%d", !only_ron) ;
+        prodcache_add_param(pc, "ron", "%d", !only_avg) ;
+        prodcache_add_param(pc, "hsize", "%d", ron_hsize) ;
+        prodcache_add_param(pc, "nsamples", "%d", ron_nsamp) ;
+        if (prodcache_fetch(pc) == 0) {
+            prodcache_del(pc) ;
+            framelist_del(sublist) ;
+            continue ;
+        }
+
+        /* QC values must not come from a previous setting */
+        dark_config.dark_med    = -1.0 ;
+        dark_config.dark_stdev  = -1.0 ;
+
         /* Compute AVG if required */
+        failed = 0 ;
         if (!only_ron) {
             sprintf(outname, "%s_%02d.fits", name_o, i+1) ;
-            isaac_dark_avg_engine(sublist, outname) ;
+            failed += isaac_dark_avg_engine(sublist, outname) ;
+            prodcache_add_product(pc, outname) ;
         }
 
         /* Compute RON if required */
@@ -180,10 +208,15 @@ static int isaac_dark_engine(
             for (j=0 ; j<sublist->n-1 ; j++) {
 				sprintf(outname, "%s_set%02d_pair%02d_ron.paf", name_o, i+1,
 						j+1) ;
-            	isaac_dark_ron_engine(sublist->name[j], sublist->name[j+1], 
-						outname, ron_hsize, ron_nsamp) ;
+            	failed += isaac_dark_ron_engine(sublist->name[j],
+						sublist->name[j+1], outname, ron_hsize, ron_nsamp) ;
+                prodcache_add_product(pc, outname) ;
 			}
         }
+
+        /* Only complete results are cached */
+        if (failed == 0) prodcache_save(pc) ;
+        prodcache_del(pc) ;
 		framelist_del(sublist) ;
     }
 
@@ -69,6 +69,14 @@
 
 #define NPARTS			6	
 
+/* Products are recomputed whenever this file changes */
+static char isaac_detlin_cache_version[] = "$Revision: 1.10 $" ;
+
+/* Suffixes of the product file names */
+static char * isaac_detlin_products[] = {
+	"_A.fits", "_B.fits", "_C.fits", "_Q.fits", "_QC.paf", NULL
+} ;
+
 /*-----------------------------------------------------------------------------
                             Private functions
  -----------------------------------------------------------------------------*/
@@ -119,12 +127,26 @@ static int isaac_detlin_engine(
 	cube_t	*	detlin ;
 	double	*	ditval ;
 	cube_t	*	fitres ;
+	prodcache *	pc ;
+	char		outname[FILENAMESZ] ;
 	int			datancom ;
 	int			sta ;
+	int			i ;
+
+	/* Products may already be in the cache */
+	pc = prodcache_new("isaac_detlin", rcs_value(isaac_detlin_cache_version));
+	isaac_cache_add_input(pc, name_i);
+	prodcache_add_param(pc, "output", "%s", name_o);
+	prodcache_add_param(pc, "force", "%d", force);
+	if (prodcache_fetch(pc)==0) {
+		prodcache_del(pc);
+		return 0 ;
+	}
 
 	/* Load inputs */
 	detlin = isaac_detlin_load(name_i, &ditval, force) ;
 	if (detlin==NULL) {
+		prodcache_del(pc);
 		return -1 ;
 	}
 	datancom = detlin->np ;
@@ -137,12 +159,21 @@ static int isaac_detlin_engine(
 
 	if (fitres==NULL) {
 		e_error("fitting function to planes: aborting");
+		prodcache_del(pc);
 		return -1 ;
 	}
 
 	/* Save results */
 	sta = isaac_detlin_save(fitres, name_i, name_o, datancom);
 	cube_del(fitres);
+	if (sta==0) {
+		for (i=0 ; isaac_detlin_products[i]!=NULL ; i++) {
+			sprintf(outname, "%s%s", name_o, isaac_detlin_products[i]);
+			prodcache_add_product(pc, outname);
+		}
+		prodcache_save(pc);
+	}
+	prodcache_del(pc);
 
 	e_comment(0, "done");
 	return sta ;
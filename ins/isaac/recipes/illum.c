@@ -35,6 +35,9 @@
 #define SEARCH_DOMAIN_HX    50
 #define SEARCH_DOMAIN_HY    50
 
+/* Products are recomputed whenever this file changes */
+static char isaac_illum_cache_version[] = "$Revision: 1.30 $" ;
+
 static instrument_t INSID ;
 
 /*-----------------------------------------------------------------------------
@@ -44,6 +47,8 @@ static instrument_t INSID ;
 static int isaac_illum_calibration(cube_t *, char *, char *, char *) ;
 static int isaac_illumination_frame_process(char *, char *, char *, char *, 
 		char *, double *, int *, char *) ;
+static prodcache * isaac_illum_cache(char *, char *, char *, char *, char *,
+		double *, int *, char *) ;
 
 /*-----------------------------------------------------------------------------
                                 Main
@@ -63,10 +68,13 @@ int  isaac_illum_main(void * dict)
 	int             nfiles ; 
 	char		*	name_i ;
 	char		*	name_o ;
+	prodcache	*	pc ;
+	char			outname[FILENAMESZ] ;
 	
 	char        *   tmp_string ;
 	int				items ;
     int             errors ;
+    int             sta ;
     int             i ;
 	
     INSID = pfits_identify_insstr("isaac");
@@ -142,8 +150,17 @@ int  isaac_illum_main(void * dict)
 				2 * search[0] + 1, 2 * search[1] + 1,
 				radii[0], radii[1], radii[2],
 				fluxfile ? fluxfile : "none") ;
+
+		/* Products may already be in the cache */
+		pc = isaac_illum_cache(name_i, name_o, dark, flat, badpix, radii,
+				search, fluxfile) ;
+		if (prodcache_fetch(pc) == 0) {
+			prodcache_del(pc) ;
+			free(name_o) ;
+			continue ;
+		}
 				
-		errors += isaac_illumination_frame_process(name_i,
+		sta = isaac_illumination_frame_process(name_i,
 													name_o,
 													dark,
 													flat,
@@ -151,6 +168,18 @@ int  isaac_illum_main(void * dict)
 													radii,
 													search,
 													fluxfile) ;
+		if (sta == 0) {
+			sprintf(outname, "%s.fits", name_o) ;
+			prodcache_add_product(pc, outname) ;
+			sprintf(outname, "%s.paf", name_o) ;
+			prodcache_add_product(pc, outname) ;
+			if (fluxfile != NULL && fluxfile[0] != (char)0) {
+				prodcache_add_product(pc, fluxfile) ;
+			}
+			prodcache_save(pc) ;
+		}
+		prodcache_del(pc) ;
+		errors += sta ;
 		free(name_o) ;
 	}
 	return errors ;
@@ -449,6 +478,31 @@ static int isaac_illumination_frame_process(
 	return 0 ;
 }
 
+static prodcache * isaac_illum_cache(
+		char 	*	name_in,
+		char 	* 	name_out,
+		char 	* 	dark_in,
+		char 	* 	ff_in,
+		char 	* 	badpix_in,
+		double	* 	radii,
+		int	 	* 	search_d,
+		char 	* 	fluxes_out)
+{
+	prodcache	*	pc ;
+
+	pc = prodcache_new("isaac_illum", rcs_value(isaac_illum_cache_version)) ;
+	isaac_cache_add_input(pc, name_in) ;
+	if (dark_in != NULL) prodcache_add_file(pc, dark_in) ;
+	if (ff_in != NULL) prodcache_add_file(pc, ff_in) ;
+	if (badpix_in != NULL) prodcache_add_file(pc, badpix_in) ;
+	prodcache_add_param(pc, "output", "%s", name_out) ;
+	prodcache_add_param(pc, "flux", "%s", fluxes_out ? fluxes_out : "") ;
+	prodcache_add_param(pc, "search", "%d %d", search_d[0], search_d[1]) ;
+	prodcache_add_param(pc, "radius", "%.17g %.17g %.17g",
+			radii[0], radii[1], radii[2]) ;
+	return pc ;
+}
+
 static int isaac_illum_calibration(
         cube_t          *   in,
         char            *   ff_name,
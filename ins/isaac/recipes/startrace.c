@@ -840,6 +840,7 @@ static int sttr_correct_distortion(
 	poly2d			*	correct_arc ;	
 	poly2d			*	correct_sttr ;	
 	cube_t			*	corrected ;
+	warp_map		*	map ;
 
 	int					i ;
 	
@@ -882,18 +883,19 @@ static int sttr_correct_distortion(
 	/* Polynomial f(x,y) = y */
 	correct_sttr = poly2d_build_from_string("0 1 1.0") ;
 
-	/* Correct the images */
+	/* Correct the images: the distortion is the same for all planes */
+	map = warp_map_new((*in_cube)->lx, (*in_cube)->ly, "default",
+					   correct_arc, correct_sttr) ;
 	corrected = cube_new((*in_cube)->lx, (*in_cube)->ly, (*in_cube)->np) ;
 	for (i=0 ; i<corrected->np ; i++) {
 		compute_status("Warping images", i, corrected->np, 1) ;
-		if ((corrected->plane[i] = image_warp_generic((*in_cube)->plane[i],
-												"default",
-                                        	    correct_arc,
-                                        	    correct_sttr)) == NULL) {
+		if ((corrected->plane[i] = warp_map_apply(map,
+                                        	(*in_cube)->plane[i])) == NULL) {
 			e_warning("cannot warp image") ;
 			corrected->plane[i] = image_copy((*in_cube)->plane[i]) ;
 		}
 	}
+	warp_map_del(map) ;
 	poly2d_free(correct_sttr) ;
 	poly2d_free(correct_arc) ;
 	cube_del(*in_cube) ;
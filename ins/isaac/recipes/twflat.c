@@ -31,6 +31,9 @@
 #define LO_THRESH_BADPIX	0.5
 #define HI_THRESH_BADPIX	2.0
 
+/* Products are recomputed whenever this file changes */
+static char isaac_twflat_cache_version[] = "$Revision: 1.43 $" ;
+
 /*-----------------------------------------------------------------------------
                             Static variables
  -----------------------------------------------------------------------------*/
@@ -52,6 +55,7 @@ static struct {
     char    *   name_o ;
     int         nbframes ;
     int         set_rank ;
+    prodcache * cache ;
 } tw_config ;
 
 static instrument_t INSID ;
@@ -63,6 +67,7 @@ static instrument_t INSID ;
 static int isaac_twflat_process(framelist * set);
 static int isaac_twilight_save(framelist*, image_t **);
 static int isaac_twflat_engine(char *);
+static prodcache * isaac_twflat_cache(framelist *);
 
 /*-----------------------------------------------------------------------------
 							        Main
@@ -115,6 +120,7 @@ int isaac_twflat_main(void * dict)
 
     /* Initialize set_rank */
     tw_config.set_rank = 0 ;
+    tw_config.cache = NULL ;
 
     INSID = pfits_identify_insstr("isaac");
     /*
@@ -157,6 +163,7 @@ static int isaac_twflat_engine(char * name_i)
     framelist   *   f_one ;
     int             i ;
     int             nsets ;
+    int             sta ;
     int             err ;
 
 	/* Sort input list of frames */
@@ -202,7 +209,17 @@ static int isaac_twflat_engine(char * name_i)
             e_error("classifying batch %d", i+1);
             err++ ;
         } else {
-            err += isaac_twflat_process(f_one);
+            /* Products of this set may already be in the cache */
+            tw_config.cache = isaac_twflat_cache(f_one);
+            if (prodcache_fetch(tw_config.cache)==0) {
+                tw_config.set_rank ++ ;
+            } else if ((sta=isaac_twflat_process(f_one))==0) {
+                prodcache_save(tw_config.cache);
+            } else {
+                err += sta ;
+            }
+            prodcache_del(tw_config.cache);
+            tw_config.cache = NULL ;
             framelist_del(f_one);
         }
     }
@@ -215,6 +232,29 @@ static int isaac_twflat_engine(char * name_i)
     return err ;
 }
 
+static prodcache * isaac_twflat_cache(framelist * set)
+{
+    prodcache   *   pc ;
+    int             i ;
+
+    pc = prodcache_new("isaac_twflat", rcs_value(isaac_twflat_cache_version));
+    for (i=0 ; i<set->n ; i++) {
+        prodcache_add_file(pc, set->name[i]);
+    }
+    if (tw_config.dark_name!=NULL) {
+        prodcache_add_file(pc, tw_config.dark_name);
+    }
+    prodcache_add_param(pc, "output", "%s", tw_config.name_o);
+    prodcache_add_param(pc, "set", "%d", tw_config.set_rank+1);
+    prodcache_add_param(pc, "threshold", "%.17g %.17g",
+            tw_config.lo_thresh, tw_config.hi_thresh);
+    prodcache_add_param(pc, "intercepts", "%d", tw_config.intercepts_flag);
+    prodcache_add_param(pc, "errmap", "%d", tw_config.error_map_flag);
+    prodcache_add_param(pc, "pixmap", "%d", tw_config.pixmap_flag);
+    prodcache_add_param(pc, "prop", "%d", tw_config.proportional_flag);
+    return pc ;
+}
+
 static int isaac_twflat_process(framelist * set)
 {
     char        *   filt_name ;
@@ -248,6 +288,7 @@ static int isaac_twflat_process(framelist * set)
 
     /* Set nbframes */
     tw_config.nbframes = set->n ;
+    tw_config.nb_badpix = -1 ;
     
     /* Allocate median array */
     med_list = malloc(in->np * sizeof(double)) ; 
@@ -392,6 +433,7 @@ static int isaac_twilight_save(
 	qfits_header_add(fh, "COMMENT", "list of input files", NULL, NULL);
     isaac_add_files_history(fh, ilist) ;
 	image_save_fits_hdrdump(results[0], full_name, fh, BPP_DEFAULT);
+	prodcache_add_product(tw_config.cache, full_name);
 	qfits_header_destroy(fh);
 
 	/* Create and save badpixel map if requested */
@@ -425,6 +467,7 @@ static int isaac_twilight_save(
 						ilist,
 						NULL);
 				image_save_fits_hdrdump(promoted,full_name,fh,BPP_8_UNSIGNED);
+				prodcache_add_product(tw_config.cache, full_name);
 				image_del(promoted) ;
 				qfits_header_destroy(fh) ;
 			}
@@ -456,6 +499,7 @@ static int isaac_twilight_save(
 						ilist,
 						NULL);
 				image_save_fits_hdrdump(results[1], full_name, fh, BPP_DEFAULT);
+				prodcache_add_product(tw_config.cache, full_name);
 				qfits_header_destroy(fh) ;
 			} else {
 				e_error("null intercept map: cannot save");
@@ -481,6 +525,7 @@ static int isaac_twilight_save(
 						ilist,
 						NULL);
 				image_save_fits_hdrdump(results[2], full_name, fh, BPP_DEFAULT);
+				prodcache_add_product(tw_config.cache, full_name);
 				qfits_header_destroy(fh) ;
 			} else {
 				e_error("null error map: cannot save");
@@ -512,6 +557,7 @@ static int isaac_twilight_save(
 						ilist,
 						NULL);
                 image_save_fits_hdrdump(results[1], full_name, fh, BPP_DEFAULT);
+                prodcache_add_product(tw_config.cache, full_name);
                 qfits_header_destroy(fh) ;
 			} else {
 				e_error("null error map: cannot save");
@@ -598,5 +644,6 @@ static int isaac_twilight_save(
         fprintf(paf, "QC.TWFLAT.NBADPIX  %d\n", tw_config.nb_badpix) ;
   
     fclose(paf) ;
+    prodcache_add_product(tw_config.cache, full_name);
 	return 0 ;
 }
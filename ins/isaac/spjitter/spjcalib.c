@@ -348,6 +348,7 @@ int spjitter_distortion(spjitter_config_t * spjc)
     poly2d          *   correct_arc ;
     poly2d          *   correct_sttr ;
     image_t         *   tmp_image ;
+    warp_map        *   map ;
     int                 i, j ;
         
     /* First test if the distortion is requested */
@@ -359,6 +360,7 @@ int spjitter_distortion(spjitter_config_t * spjc)
     
     /* Initialize */
     correct_arc = correct_sttr = NULL ;
+    map = NULL ;
  
     /* FIND THE COEFFICIENTS OF THE DISTORTION */
     
@@ -428,12 +430,22 @@ int spjitter_distortion(spjitter_config_t * spjc)
     for (i=0 ; i<spjc->nframes ; i++) {
         if (spjc->frame[i].type == type_obj) {
             compute_status("warping images", j, spjc->nobjframes, 1) ;
+            /* The distortion map is computed once for all frames */
+            if ((map == NULL) ||
+                (map->lx != spjc->frame[j].image->lx) ||
+                (map->ly != spjc->frame[j].image->ly)) {
+                warp_map_del(map) ;
+                map = warp_map_new(spjc->frame[j].image->lx,
+                                   spjc->frame[j].image->ly,
+                                   "default",
+                                   correct_arc,
+                                   correct_sttr) ;
+            }
             /* Apply the transformation on the images of the current cube */
-            if ((tmp_image = image_warp_generic(spjc->frame[j].image,
-                            "default",
-                            correct_arc,
-                            correct_sttr)) == NULL) {
+            if ((tmp_image = warp_map_apply(map,
+                            spjc->frame[j].image)) == NULL) {
                 e_error("in the distortion correction") ;
+                warp_map_del(map) ;
                 poly2d_free(correct_arc) ;
                 poly2d_free(correct_sttr) ;
                 if (spjc->status_disto_slit_curv == OK)
@@ -451,6 +463,7 @@ int spjitter_distortion(spjitter_config_t * spjc)
     }
 
     /* Free and return  */
+    warp_map_del(map) ;
     poly2d_free(correct_arc) ;
     poly2d_free(correct_sttr) ;
     return 0 ;
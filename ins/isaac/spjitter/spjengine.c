@@ -61,95 +61,136 @@ long spjitter_engine(char * ininame)
 	time(&local_t) ;
 	e_comment(0, "%s", ctime(&local_t)) ;
 	e_comment(0, "pid is %ld", (long)getpid());
+	TRACE_BEGIN("spjitter") ;
 
 	/* Load data */
 	p++ ;
 	e_comment(0, "---> part %d of %d: loading data", p, NPARTS) ;
+    TRACE_BEGIN("spjitter/load") ;
     spjc = spjitter_load(ininame);
-    if (spjc==NULL) return -1 ;
+    TRACE_END("spjitter/load") ;
+    if (spjc==NULL) {
+        TRACE_END("spjitter") ;
+        return -1 ;
+    }
     total_pixin = spjc->total_pixin ;
 
     /* Data classification */
     p++ ;
     e_comment(0, "---> part %d of %d: data classification", p, NPARTS) ;
+    TRACE_BEGIN("spjitter/classif") ;
     if (spjitter_classif(spjc) != 0) {
         e_error("applying classification: aborting");
         spjitter_config_del(spjc);
+        TRACE_END("spjitter/classif") ;
+        TRACE_END("spjitter") ;
         return -1 ;
     }
+    TRACE_END("spjitter/classif") ;
 
     /* Flatfield correction */
     p++ ;
     e_comment(0, "---> part %d of %d: flatfielding", p, NPARTS) ;
+    TRACE_BEGIN("spjitter/flatfield") ;
     if (spjitter_flatfield(spjc) != 0) {
         e_error("applying flatfielding: aborting") ;
         spjitter_config_del(spjc);
+        TRACE_END("spjitter/flatfield") ;
+        TRACE_END("spjitter") ;
         return -1 ;
     }
+    TRACE_END("spjitter/flatfield") ;
 
     /* Shift and average classified cubes */
     p++ ;
     e_comment(0, "---> part %d of %d: average cubes", p, NPARTS) ;
+    TRACE_BEGIN("spjitter/averaging") ;
     if (spjitter_averaging(spjc) != 0) {
         e_error("averaging cubes - aborting") ;
         spjitter_config_del(spjc);
+        TRACE_END("spjitter/averaging") ;
+        TRACE_END("spjitter") ;
         return -1 ;
     }
+    TRACE_END("spjitter/averaging") ;
     
     /* Wavelength calibration */
     p++ ;
     e_comment(0, "---> part %d of %d: wavelength calibration", p, NPARTS) ;
+    TRACE_BEGIN("spjitter/wlcalib") ;
     if (spjitter_wlcalib(spjc) != 0) {
         e_error("wavelength calibration - aborting") ;
         spjitter_config_del(spjc);
+        TRACE_END("spjitter/wlcalib") ;
+        TRACE_END("spjitter") ;
         return -1 ;
     }
+    TRACE_END("spjitter/wlcalib") ;
     
     /* Compute differences */
     p++ ;
     e_comment(0, "---> part %d of %d: differences computation", p, NPARTS) ;
+    TRACE_BEGIN("spjitter/differences") ;
     if (spjitter_differences(spjc) != 0) {
         e_error("differences computation - aborting") ;
         spjitter_config_del(spjc);
+        TRACE_END("spjitter/differences") ;
+        TRACE_END("spjitter") ;
         return -1 ;
     }
+    TRACE_END("spjitter/differences") ;
     
     /* Distortion correction */
     p++ ;
     e_comment(0, "---> part %d of %d: distortion correction", p, NPARTS) ;
+    TRACE_BEGIN("spjitter/distortion") ;
     if (spjitter_distortion(spjc) != 0) {
         e_error("distortion correction - aborting") ;
         spjitter_config_del(spjc);
+        TRACE_END("spjitter/distortion") ;
+        TRACE_END("spjitter") ;
         return -1 ;
     }
+    TRACE_END("spjitter/distortion") ;
 
     /* Frames combination */
     p++ ;
     e_comment(0, "---> part %d of %d: frames combination", p, NPARTS) ;
+    TRACE_BEGIN("spjitter/combine") ;
     if (spjitter_combine(spjc) != 0) {
         e_error("frames combination - aborting") ;
         spjitter_config_del(spjc);
+        TRACE_END("spjitter/combine") ;
+        TRACE_END("spjitter") ;
         return -1 ;
     }
+    TRACE_END("spjitter/combine") ;
 
     /* Spectrum extraction */
     p++ ;
     e_comment(0, "---> part %d of %d: spectrum extraction", p, NPARTS) ;
+    TRACE_BEGIN("spjitter/extract") ;
     if (spjitter_extract(spjc) != 0) {
         e_warning("spectrum extraction failed") ;
     }
+    TRACE_END("spjitter/extract") ;
 
     /* Save products */
     p++ ;
     e_comment(0, "---> part %d of %d: save products", p, NPARTS) ;
+    TRACE_BEGIN("spjitter/save") ;
     if (spjitter_save(spjc) != 0) {
         e_error("saving products - aborting") ;
         spjitter_config_del(spjc);
+        TRACE_END("spjitter/save") ;
+        TRACE_END("spjitter") ;
         return -1 ;
     }
+    TRACE_END("spjitter/save") ;
     
     /* Free data */
     spjitter_config_del(spjc);
+    TRACE_END("spjitter") ;
 
 	e_comment(0, "---> STOPPING SPJITTER ENGINE") ;
 	time(&local_t) ;
@@ -26,20 +26,98 @@
   							Function codes
  ---------------------------------------------------------------------------*/
 
+/* Size of the buffer used to copy extension data */
+#define WFI_COPYBUFSZ	(1024*1024)
+
+/* Shared state for wfi_split() workers */
+typedef struct _wfi_split_job_ {
+	mosaic_t	*	m ;
+	int			*	xts ;
+	char		**	names ;
+	int			*	status ;
+} wfi_split_job ;
+
+/*
+ * Copy the data section of one extension to the end of its output file,
+ * then zero-pad the output. Runs in a worker thread: no messages here.
+ */
+static void wfi_split_task(void * p, int task, int worker)
+{
+	wfi_split_job	*	job ;
+	mosaic_chip		*	c ;
+	FILE			*	in ;
+	FILE			*	out ;
+	char			*	buf ;
+	long				left ;
+	long				nbytes ;
+	size_t				chunk ;
+
+	job = (wfi_split_job*)p ;
+	job->status[task] = -1 ;
+	c = job->m->chip + job->xts[task] - 1 ;
+	nbytes = (long)c->lx * (long)c->ly * (long)BYTESPERPIXEL(c->bitpix);
+	if (nbytes<1) return ;
+
+	if ((in=fopen(job->m->filename, "r"))==NULL) return ;
+	if ((out=fopen(job->names[task], "a"))==NULL) {
+		fclose(in);
+		return ;
+	}
+	buf = malloc(WFI_COPYBUFSZ);
+	left = nbytes ;
+	if (fseek(in, c->data_beg, SEEK_SET)==0) {
+		while (left>0) {
+			chunk = left>WFI_COPYBUFSZ ? WFI_COPYBUFSZ : (size_t)left ;
+			if (fread(buf, 1, chunk, in)!=chunk) break ;
+			if (fwrite(buf, 1, chunk, out)!=chunk) break ;
+			left -= (long)chunk ;
+		}
+	}
+	/* zero-padding */
+	if (left==0 && (nbytes%2880)!=0) {
+		memset(buf, 0, 2880);
+		fwrite(buf, 1, 2880-(nbytes%2880), out);
+	}
+	free(buf);
+	fclose(in);
+	if (fclose(out)==0 && left==0) {
+		job->status[task] = 0 ;
+	}
+	return ;
+}
+
+/* Shared state for wfi_cube_load() workers */
+typedef struct _wfi_load_job_ {
+	mosaic_t	**	m ;
+	int				xtnum ;
+	cube_t		*	loaded ;
+} wfi_load_job ;
+
+/*
+ * Load the requested chip of one indexed WFI frame into its plane.
+ * Runs in a worker thread: no messages here.
+ */
+static void wfi_load_task(void * p, int task, int worker)
+{
+	wfi_load_job	*	job ;
+
+	job = (wfi_load_job*)p ;
+	job->loaded->plane[task] = mosaic_load_chip(job->m[task], job->xtnum);
+	return ;
+}
+
 int wfi_split(char * name_i, char * name_o, int xtnum)
 {
 	qfits_header*	h_main ;
 	qfits_header*	h_ext ;
+	mosaic_t	*	m ;
+	wfi_split_job	job ;
 	int				i ;
-	int				n_ext ;
 	char			ext_name_o[FILENAMESZ];
 	FILE		*	extension ;
-	int				data_beg, data_size ;
-	int				naxis1, naxis2, bitpix ;
 	int			*	xts ;
 	int				nxts ;
-	char		*	fdata ;
-	size_t			fsize ;
+	int				njobs ;
 
 	/* Sanity checks */
 	if (is_fits_file(name_i)!=1) {
@@ -55,80 +133,80 @@ int wfi_split(char * name_i, char * name_o, int xtnum)
 		return -1 ;
 	}
 
-	/* Find out how many extensions are in the file */
-	e_comment(0, "finding number of extensions");
-	n_ext = qfits_query_n_ext(name_i);
-	if (n_ext<1) {
+	/* Index all extensions in the file once */
+	e_comment(0, "indexing extensions");
+	m = mosaic_open(name_i);
+	if (m==NULL) {
 		e_error("no extension found in [%s]", name_i);
+		qfits_header_destroy(h_main);
 		return -1 ;
 	}
-	e_comment(0, "[%d] extensions found in file", n_ext);
+	e_comment(0, "[%d] extensions found in file", m->n_ext);
 
 	if (xtnum<1) {
-		nxts = n_ext ;
+		nxts = m->n_ext ;
 		xts = malloc(nxts * sizeof(int)) ;
 		for (i=0 ; i<nxts ; i++) {
 			xts[i]=i+1 ;
 		}
 	} else {
+		if (xtnum>m->n_ext) {
+			e_error("extension %d not found in [%s]", xtnum, name_i);
+			mosaic_close(m);
+			qfits_header_destroy(h_main);
+			return -1 ;
+		}
 		nxts = 1 ;
 		xts = malloc(nxts * sizeof(int)) ;
 		xts[0] = xtnum ;
 	}
 
-	/* Go extension after extension */
+	/* Write all output headers */
+	job.m      = m ;
+	job.xts    = malloc(nxts * sizeof(int));
+	job.names  = malloc(nxts * sizeof(char*));
+	job.status = malloc(nxts * sizeof(int));
+	njobs = 0 ;
 	for (i=0 ; i<nxts ; i++) {
-		/* Read extension header */
 		e_comment(1, "reading extension [%d]", xts[i]);
+		if (m->chip[xts[i]-1].lx<1) {
+			e_error("cannot determine data size in bytes in ext[%d]",xts[i]);
+			continue ;
+		}
 		h_ext = qfits_header_readext(name_i, xts[i]);
 		if (h_ext==NULL) {
 			e_error("reading extension header #%d", xts[i]);
 			continue;
 		}
-		/* Compute data size in bytes */
-		naxis1 = qfits_header_getint(h_ext, "NAXIS1", 0);
-		naxis2 = qfits_header_getint(h_ext, "NAXIS2", 0);
-		bitpix = qfits_header_getint(h_ext, "BITPIX", 0);
-
-		data_size = naxis1 * naxis2 * BYTESPERPIXEL(bitpix);
-		if (data_size<1) {
-			e_error("cannot determine data size in bytes in ext[%d]",xts[i]);
-			qfits_header_destroy(h_ext);
-			continue ;
-		}
-
-		/* Output new header to file */
 		sprintf(ext_name_o, "%s_%02d.fits", name_o, xts[i]);
 		if ((extension=fopen(ext_name_o, "w"))==NULL) {
 			e_error("cannot output to file [%s]", ext_name_o);
+			qfits_header_destroy(h_ext);
 			continue ;
 		}
 		qfits_header_dump(h_main, extension);
 		qfits_header_dump(h_ext, extension);
 		qfits_header_destroy(h_ext);
-
-		/* Find out pixels in main belonging to this extension */
-		if (qfits_get_datinfo(name_i, xts[i], &data_beg, NULL)!=0) {
-			e_error("getting offset to extension %d", xts[i]);
-			continue ;
-		}
-		/* Map input file */
-		fdata = falloc(name_i, 0, &fsize);
-		if (fdata==NULL) {
-			e_error("mapping input file [%s]", name_i);
-			continue ;
-		}
-		/* Dump pixels from one file to the other */
-		e_comment(1, "copying extension [%d]", xts[i]);
-		fwrite(fdata+data_beg, 1, data_size, extension);
-
-		/* Close file pointers */
-		free(fdata);
 		fclose(extension);
+		job.xts[njobs]   = xts[i] ;
+		job.names[njobs] = strdup(ext_name_o);
+		njobs++ ;
+	}
 
-		/* zero-padding */
-		qfits_zeropad(ext_name_o);
+	/* Copy all data sections concurrently */
+	e_comment(1, "copying %d extensions", njobs);
+	eclipse_parallel_run(wfi_split_task, &job, njobs);
+	for (i=0 ; i<njobs ; i++) {
+		if (job.status[i]!=0) {
+			e_error("copying extension [%d] to [%s]",
+					job.xts[i], job.names[i]);
+		}
+		free(job.names[i]);
 	}
+	free(job.names);
+	free(job.xts);
+	free(job.status);
+	mosaic_close(m);
 	qfits_header_destroy(h_main);
 	free(xts);
 	return 0 ;
@@ -147,6 +225,7 @@ cube_t * wfi_cube_load(char * filename, int xtnum)
 	int		  *	exts ;
 	int			err ;
 	int			single_frames ;
+	wfi_load_job	job ;
 
 	/* Check entries */
 	if (filename==NULL) return NULL ;
@@ -206,22 +285,43 @@ cube_t * wfi_cube_load(char * filename, int xtnum)
 		}
 	} else {
 	/* A list of whole WFI frames */
-		/* Load first image */
-		wfi_frame = wfi_load_ext(flist->name[i], xtnum) ;
-		if (wfi_frame==NULL) {
-			e_error("cannot load frame [%s][%d]", flist->name[i], xtnum);
-			err++ ;
-		}
-		loaded = cube_new(wfi_frame->lx, wfi_frame->ly, flist->n);
-		loaded->plane[0] = wfi_frame ;
-		for (i=1 ; i<flist->n ; i++) {
-			wfi_frame = wfi_load_ext(flist->name[i], xtnum);
-			if (wfi_frame == NULL) {
-				e_error("cannot load frame [%s][%d]", flist->name[i], xtnum);
+		/* Index all frames, then load their chips concurrently */
+		job.m     = calloc(flist->n, sizeof(mosaic_t*));
+		job.xtnum = xtnum ;
+		for (i=0 ; i<flist->n ; i++) {
+			if ((job.m[i] = mosaic_open(flist->name[i]))==NULL) {
+				e_error("cannot open frame [%s]", flist->name[i]);
+				err++ ;
+			} else if (xtnum>job.m[i]->n_ext) {
+				e_error("extension %d not found in [%s]",
+						xtnum, flist->name[i]);
 				err++ ;
 			}
-			loaded->plane[i] = wfi_frame ;
 		}
+		loaded = NULL ;
+		if (!err) {
+			loaded = cube_new(job.m[0]->chip[xtnum-1].lx,
+							  job.m[0]->chip[xtnum-1].ly,
+							  flist->n);
+			if (loaded==NULL) err++ ;
+		}
+		if (!err) {
+			job.loaded = loaded ;
+			eclipse_parallel_run(wfi_load_task, &job, flist->n);
+			for (i=0 ; i<flist->n ; i++) {
+				wfi_frame = loaded->plane[i] ;
+				if (wfi_frame==NULL ||
+					wfi_frame->lx!=loaded->lx || wfi_frame->ly!=loaded->ly) {
+					e_error("cannot load frame [%s][%d]",
+							flist->name[i], xtnum);
+					err++ ;
+				}
+			}
+		}
+		for (i=0 ; i<flist->n ; i++) {
+			mosaic_close(job.m[i]);
+		}
+		free(job.m);
 	}
 	/* Process errors */
 	if (err) {
@@ -290,6 +390,7 @@ image_t * wfi_overscan_correction(
 	int				scan_width ;
 	int				i, j, k ;
 	pixelvalue	*	pix ;
+	int				pre[2], ovr[2] ;
 
     /* Sanity tests with input parameters */
     scan_width = (prescan_x[1]-prescan_x[0]+1) +
@@ -306,8 +407,13 @@ image_t * wfi_overscan_correction(
     }
 
  
-    /* Bring coordinates back to C convention */
-    prescan_x[0]-- ; prescan_x[1]-- ; overscan_x[0]-- ; overscan_x[1]-- ;
+    /*
+     * Bring coordinates back to C convention. Local copies are used
+     * so that several chips can be corrected concurrently with the
+     * same parameters.
+     */
+    pre[0] = prescan_x[0]-1 ; pre[1] = prescan_x[1]-1 ;
+    ovr[0] = overscan_x[0]-1 ; ovr[1] = overscan_x[1]-1 ;
  
     /* Make out bias column */
     bias_lin = malloc(scan_width * sizeof(pixelvalue));
@@ -316,10 +422,10 @@ image_t * wfi_overscan_correction(
     for (j=0 ; j<wfi_frame->ly ; j++) {
         pix = wfi_frame->data + j*wfi_frame->lx ;
         k=0 ;
-        for (i=prescan_x[0] ; i<=prescan_x[1] ; i++) {
+        for (i=pre[0] ; i<=pre[1] ; i++) {
             bias_lin[k++] = pix[i];
         }
-        for (i=overscan_x[0] ; i<=overscan_x[1] ; i++) {
+        for (i=ovr[0] ; i<=ovr[1] ; i++) {
             bias_lin[k++] = pix[i] ;
         }
         filtered =
@@ -333,9 +439,6 @@ image_t * wfi_overscan_correction(
     }
     free(bias_lin);
 
-    /* Bring coordinates back to FITS convention */
-    prescan_x[0]++ ; prescan_x[1]++ ; overscan_x[0]++ ; overscan_x[1]++ ;
-
     /* Extract cropped region */
     cropped_frame = image_getvig(wfi_frame,
                                             crop_reg[0],
@@ -266,10 +266,36 @@ void wfiff_bb_dump(wfiff_bb * bb, FILE * out)
 	);
 }
 
+/* Shared state for the overscan correction of all frames */
+typedef struct _wfiff_scan_job_ {
+	wfiff_bb	*	bb ;
+	cube_t		*	i_cube ;
+} wfiff_scan_job ;
+
+/*
+ * Overscan/prescan/trimming correction of one frame, in place in the
+ * cube. Runs in a worker thread: a failure leaves a NULL plane.
+ */
+static void wfiff_scan_task(void * p, int task, int worker)
+{
+	wfiff_scan_job	*	job ;
+	image_t			*	scancorr ;
+
+	job = (wfiff_scan_job*)p ;
+	scancorr = wfi_overscan_correction(job->i_cube->plane[task],
+									   job->bb->prescan_x,
+									   job->bb->overscan_x,
+									   job->bb->scanrej,
+									   job->bb->trimreg);
+	image_del(job->i_cube->plane[task]);
+	job->i_cube->plane[task] = scancorr ;
+	return ;
+}
+
 image_t * wfiff_buildflat(wfiff_bb * bb, char * what)
 {
 	cube_t	 *	i_cube ;
-	image_t *	scancorr ;
+	wfiff_scan_job	job ;
 	image_t *  bias ;
 	image_t *  cur_p ;
 	image_t *  flat ;
@@ -363,20 +389,15 @@ image_t * wfiff_buildflat(wfiff_bb * bb, char * what)
 	
 	/* Apply prescan/overscan/trimming correction */
 	e_comment(1, "applying overscan/prescan/trimming correction");
+	job.bb     = bb ;
+	job.i_cube = i_cube ;
+	eclipse_parallel_run(wfiff_scan_task, &job, i_cube->np);
 	for (i=0 ; i<i_cube->np ; i++) {
-		compute_status("correcting", i, i_cube->np, 1);
-		scancorr = wfi_overscan_correction(i_cube->plane[i],
-										   bb->prescan_x,
-										   bb->overscan_x,
-										   bb->scanrej,
-										   bb->trimreg);
-		if (scancorr == NULL) {
+		if (i_cube->plane[i] == NULL) {
 			e_error("during overscan correction in plane %d", i+1);
 			cube_del(i_cube);
 			return NULL ;
 		}
-		image_del(i_cube->plane[i]);
-		i_cube->plane[i] = scancorr ;
 	}
 	/* Cube size has changed, recompute sizes */
 	i_cube->lx = i_cube->plane[0]->lx;
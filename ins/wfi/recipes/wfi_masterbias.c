@@ -59,6 +59,18 @@ static int wfi_create_master_bias(
 	int		*	crop_reg
 );
 
+static prodcache * wfi_masterbias_cache(
+	char	*	name_i,
+	char	*	name_o,
+	int			xtnum,
+	double		kappa1,
+	int			minvalid1,
+	int		*	prescan_x,
+	int		*	overscan_x,
+	int		*	rej_int,
+	int		*	crop_reg
+);
+
 /*---------------------------------------------------------------------------
 									Main	
  ---------------------------------------------------------------------------*/
@@ -70,6 +82,7 @@ int main(int argc, char *argv[])
 	int		check ;
 	char	name_i[FILENAMESZ];
 	char	name_o[FILENAMESZ];
+	prodcache	*	pc ;
 
 	double	kappa1 ;
 	int		minvalid1 ;
@@ -240,15 +253,24 @@ int main(int argc, char *argv[])
 		strcpy(name_o, argv[optind]);
 	}
 
-	wfi_create_master_bias(	name_i,
-						  	name_o,
-						  	xtnum,
-						  	kappa1,
-						 	minvalid1,
-						  	prescan_x,
-							overscan_x,
-							rej_int,
-							crop_reg);
+	/* The master bias may already be in the cache */
+	pc = wfi_masterbias_cache(name_i, name_o, xtnum, kappa1, minvalid1,
+							  prescan_x, overscan_x, rej_int, crop_reg);
+	if (prodcache_fetch(pc)!=0) {
+		if (wfi_create_master_bias(	name_i,
+						  			name_o,
+						  			xtnum,
+						  			kappa1,
+						 			minvalid1,
+						  			prescan_x,
+									overscan_x,
+									rej_int,
+									crop_reg)==0) {
+			prodcache_add_product(pc, name_o);
+			prodcache_save(pc);
+		}
+	}
+	prodcache_del(pc);
 
     if (debug_active())
 		xmemory_status() ;
@@ -284,6 +306,50 @@ usage(char *pname)
 } 
 
 
+/*
+ * Describe a master bias computation for the product cache: the input
+ * list and all frames it refers to, and all parameters.
+ */
+static prodcache * wfi_masterbias_cache(
+	char	*	name_i,
+	char	*	name_o,
+	int			xtnum,
+	double		kappa1,
+	int			minvalid1,
+	int		*	prescan_x,
+	int		*	overscan_x,
+	int		*	rej_int,
+	int		*	crop_reg
+)
+{
+	prodcache	*	pc ;
+	framelist	*	flist ;
+	int				i ;
+
+	pc = prodcache_new("wfi_masterbias", rcs_value(recipe_version));
+	if (pc==NULL) return NULL ;
+	prodcache_add_file(pc, name_i);
+	if (is_ascii_list(name_i)==1) {
+		if ((flist=framelist_load(name_i))!=NULL) {
+			for (i=0 ; i<flist->n ; i++) {
+				prodcache_add_file(pc, flist->name[i]);
+			}
+			framelist_del(flist);
+		}
+	}
+	prodcache_add_param(pc, "output", "%s", name_o);
+	prodcache_add_param(pc, "xtnum", "%d", xtnum);
+	prodcache_add_param(pc, "kappa1", "%.17g", kappa1);
+	prodcache_add_param(pc, "min1", "%d", minvalid1);
+	prodcache_add_param(pc, "x-prescan", "%d %d", prescan_x[0], prescan_x[1]);
+	prodcache_add_param(pc, "x-overscan", "%d %d",
+						overscan_x[0], overscan_x[1]);
+	prodcache_add_param(pc, "reject", "%d %d", rej_int[0], rej_int[1]);
+	prodcache_add_param(pc, "crop", "%d %d %d %d",
+						crop_reg[0], crop_reg[1], crop_reg[2], crop_reg[3]);
+	return pc ;
+}
+
 #define WFI_MIN_NUM_FRAMES		3
 
 static int wfi_create_master_bias(
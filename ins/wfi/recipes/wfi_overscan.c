@@ -49,6 +49,18 @@ wfi_overscan_correct(
 	int		*	crop_reg
 );
 
+/* Parameters passed to the per-chip correction */
+typedef struct _wfi_overscan_par_ {
+	int		*	prescan_x ;
+	int		*	overscan_x ;
+	int		*	rej_int ;
+	int		*	crop_reg ;
+} wfi_overscan_par ;
+
+static image_t * wfi_overscan_chip(image_t * chip, int xtnum, void * arg) ;
+static int wfi_overscan_mosaic(char *, char *, qfits_header *,
+							   int *, int *, int *, int *) ;
+
 /*---------------------------------------------------------------------------
 									Main	
  ---------------------------------------------------------------------------*/
@@ -252,7 +264,7 @@ static void
 usage(char *pname)
 {
     hello_world(pname, prog_desc) ;
-    printf("use : %s [options] <WFI extension file>\n", pname) ;
+    printf("use : %s [options] <WFI frame or extension file>\n", pname) ;
     printf("options are:\n");
     printf("\t--x-prescan  'beg end'              sets x prescan region\n");
     printf("\t--x-overscan 'beg end'              sets x overscan region\n");
@@ -277,24 +289,29 @@ wfi_overscan_correct(
 	image_t		*	cropped_frame ;
 	qfits_header*	fh ;
 	char			sval[80] ;
-
-	/* Load input image */
-	e_comment(0, "loading input [%s]", name_i);
-	if ((wfi_frame = image_load(name_i))==NULL) {
-		e_error("cannot load frame [%s]", name_i);
-		return -1 ;
-	}
-
-	e_comment(0, "overscan correction");
-	cropped_frame = wfi_overscan_correction(wfi_frame,
-											prescan_x,
-											overscan_x,
-											rej_int,
-											crop_reg);
-	image_del(wfi_frame);
-	if (cropped_frame==NULL) {
-		e_error("correcting overscan for frame [%s]", name_i);
-		return -1 ;
+	int				mef ;
+
+	cropped_frame = NULL ;
+	mef = (qfits_query_n_ext(name_i)>0) ;
+	if (!mef) {
+		/* Load input image */
+		e_comment(0, "loading input [%s]", name_i);
+		if ((wfi_frame = image_load(name_i))==NULL) {
+			e_error("cannot load frame [%s]", name_i);
+			return -1 ;
+		}
+
+		e_comment(0, "overscan correction");
+		cropped_frame = wfi_overscan_correction(wfi_frame,
+												prescan_x,
+												overscan_x,
+												rej_int,
+												crop_reg);
+		image_del(wfi_frame);
+		if (cropped_frame==NULL) {
+			e_error("correcting overscan for frame [%s]", name_i);
+			return -1 ;
+		}
 	}
 
 	/* Build FITS header for output */
@@ -349,6 +366,17 @@ wfi_overscan_correct(
 					"xmin xmax ymin ymax",
 					NULL);
 
+	if (mef) {
+		if (wfi_overscan_mosaic(name_i, name_o, fh, prescan_x, overscan_x,
+								rej_int, crop_reg)!=0) {
+			e_error("correcting overscan for frame [%s]", name_i);
+			qfits_header_destroy(fh);
+			return -1 ;
+		}
+		qfits_header_destroy(fh);
+		return 0 ;
+	}
+
 	e_comment(0, "saving output [%s]", name_o);
 	image_save_fits_hdrdump(cropped_frame,
 								name_o,
@@ -358,3 +386,67 @@ wfi_overscan_correct(
 	image_del(cropped_frame);
 	return 0 ;
 }
+
+
+/*
+ * Overscan correction of a single chip, called from worker threads
+ */
+static image_t * wfi_overscan_chip(image_t * chip, int xtnum, void * arg)
+{
+	wfi_overscan_par	*	par ;
+
+	par = (wfi_overscan_par*)arg ;
+	return wfi_overscan_correction(chip,
+								   par->prescan_x,
+								   par->overscan_x,
+								   par->rej_int,
+								   par->crop_reg);
+}
+
+
+/*
+ * Overscan correction of all chips in a multi-extension WFI frame.
+ * Chips are corrected in parallel and written to the extensions of a
+ * single output file.
+ */
+static int
+wfi_overscan_mosaic(
+	char			*	name_i,
+	char			*	name_o,
+	qfits_header	*	fh,
+	int				*	prescan_x,
+	int				*	overscan_x,
+	int				*	rej_int,
+	int				*	crop_reg
+)
+{
+	mosaic_t			*	m ;
+	mosaic_out			*	out ;
+	wfi_overscan_par		par ;
+	int						nfail ;
+
+	e_comment(0, "indexing input [%s]", name_i);
+	if ((m = mosaic_open(name_i))==NULL) {
+		e_error("cannot open mosaic [%s]", name_i);
+		return -1 ;
+	}
+	e_comment(0, "creating output [%s]", name_o);
+	out = mosaic_out_create_like(m, name_o, fh, BPP_DEFAULT,
+								 crop_reg[1]-crop_reg[0]+1,
+								 crop_reg[3]-crop_reg[2]+1);
+	if (out==NULL) {
+		e_error("cannot create output [%s]", name_o);
+		mosaic_close(m);
+		return -1 ;
+	}
+	par.prescan_x  = prescan_x ;
+	par.overscan_x = overscan_x ;
+	par.rej_int    = rej_int ;
+	par.crop_reg   = crop_reg ;
+
+	e_comment(0, "overscan correction on %d chips", m->n_ext);
+	nfail = mosaic_process(m, out, wfi_overscan_chip, &par);
+	mosaic_out_close(out);
+	mosaic_close(m);
+	return (nfail==0) ? 0 : -1 ;
+}
@@ -205,13 +205,99 @@ int wfiprep_saturation(cube_t * prep, wfiprep_bb * bb)
 	return 0 ;
 }
 
+/*
+ * Build the output header for an input frame: its main header with the
+ * reduction parameters added.
+ */
+qfits_header * wfiprep_header(wfiprep_bb * bb, char * name_i)
+{
+	qfits_header*	fh ;
+	char			sval[80];
+
+	/* Read FITS header from input file */
+	fh = qfits_header_read(name_i);
+	if (fh==NULL) {
+		e_error("reading FITS header from [%s]", name_i);
+		return NULL ;
+	}
+	/* Add eclipse version */
+	qfits_header_add(fh,
+					"ECLIPSE",
+					get_eclipse_version(),
+					"Eclipse version",
+					NULL);
+	/* Add recipe version */
+	qfits_header_add(fh,
+					"HIERARCH ESO REC PRERED RECVERS",
+					recipe_version,
+					"Recipe version",
+					NULL);
+	/* Add REC.PRERED.THRSAT */
+	sprintf(sval, "%g", bb->sat_level);
+	qfits_header_add(fh,
+					"HIERARCH ESO REC PRERED THRSAT",
+					sval,
+					"saturation threshold",
+					NULL);
+	/* Add REC.PRERED MAXSATPIX */
+	sprintf(sval, "%g", bb->sat_max);
+	qfits_header_add(fh,
+					"HIERARCH ESO REC PRERED MAXSATPIX",
+					sval,
+					"max % of sat pix",
+					NULL);
+	/* Add REC.PRERED.PRSCX */
+	sprintf(sval, "'%d %d'", bb->prescan_x[0], bb->prescan_x[1]);
+	qfits_header_add(fh,
+					"HIERARCH ESO REC PRERED PRSCX",
+					sval,
+					"Prescan xmin xmax",
+					NULL);
+	/* Add REC.PRERED.OVSCX */
+	sprintf(sval, "'%d %d'", bb->overscan_x[0], bb->overscan_x[1]);
+	qfits_header_add(fh,
+					"HIERARCH ESO REC PRERED OVSCX",
+					sval,
+					"Overscan xmin xmax",
+					NULL);
+	/* Add REC.PRERED.RJOVSC */
+	sprintf(sval, "'%d %d'", bb->scanrej[0], bb->scanrej[1]);
+	qfits_header_add(fh,
+					"HIERARCH ESO REC PRERED RJOVSC",
+					sval,
+					"Rejection min max",
+					NULL);
+	/* Add REC.PRERED.TRIM */
+	sprintf(sval, "'%d %d %d %d'",
+			bb->trimreg[0],
+			bb->trimreg[1],
+			bb->trimreg[2],
+			bb->trimreg[3]) ;
+	qfits_header_add(fh,
+					"HIERARCH ESO REC PRERED TRIM",
+					sval,
+					"xmin xmax ymin ymax",
+					NULL);		
+	/* Add REC.PRERED.MBIAS */
+	qfits_header_add(fh,
+					"HIERARCH ESO REC PRERED MBIAS",
+					get_basename(bb->name_bias),
+					"Bias used",
+					NULL);
+	/* Add REC.PRERED.MFLAT */
+	qfits_header_add(fh,
+					"HIERARCH ESO REC PRERED MFLAT",
+					get_basename(bb->name_ff),
+					"Flatfield used",
+					NULL);
+	return fh ;
+}
+
 int wfiprep_save(cube_t * prep, wfiprep_bb * bb)
 {
 	char			name_o[FILENAMESZ];
 	int				p ;
 	qfits_header*	fh ;
-	char			sval[80];
-
 
 	/* Loop over planes in the input cube */
 	for (p=0 ; p<prep->np ; p++) {
@@ -220,83 +306,10 @@ int wfiprep_save(cube_t * prep, wfiprep_bb * bb)
 				get_rootname(get_basename(bb->frame_name[p])));
 		e_comment(1, "saving [%s]", name_o);
 
-		/* Read FITS header from input file */
-		fh = qfits_header_read(bb->frame_name[p]);
+		fh = wfiprep_header(bb, bb->frame_name[p]);
 		if (fh==NULL) {
-			e_error("reading FITS header from [%s]", bb->frame_name[p]);
 			return -1 ;
 		}
-		/* Add eclipse version */
-		qfits_header_add(fh,
-						"ECLIPSE",
-						get_eclipse_version(),
-						"Eclipse version",
-						NULL);
-		/* Add recipe version */
-		qfits_header_add(fh,
-						"HIERARCH ESO REC PRERED RECVERS",
-						recipe_version,
-						"Recipe version",
-						NULL);
-		/* Add REC.PRERED.THRSAT */
-		sprintf(sval, "%g", bb->sat_level);
-		qfits_header_add(fh,
-						"HIERARCH ESO REC PRERED THRSAT",
-						sval,
-						"saturation threshold",
-						NULL);
-		/* Add REC.PRERED MAXSATPIX */
-		sprintf(sval, "%g", bb->sat_max);
-		qfits_header_add(fh,
-						"HIERARCH ESO REC PRERED MAXSATPIX",
-						sval,
-						"max % of sat pix",
-						NULL);
-		/* Add REC.PRERED.PRSCX */
-		sprintf(sval, "'%d %d'", bb->prescan_x[0], bb->prescan_x[1]);
-		qfits_header_add(fh,
-						"HIERARCH ESO REC PRERED PRSCX",
-						sval,
-						"Prescan xmin xmax",
-						NULL);
-		/* Add REC.PRERED.OVSCX */
-		sprintf(sval, "'%d %d'", bb->overscan_x[0], bb->overscan_x[1]);
-		qfits_header_add(fh,
-						"HIERARCH ESO REC PRERED OVSCX",
-						sval,
-						"Overscan xmin xmax",
-						NULL);
-		/* Add REC.PRERED.RJOVSC */
-		sprintf(sval, "'%d %d'", bb->scanrej[0], bb->scanrej[1]);
-		qfits_header_add(fh,
-						"HIERARCH ESO REC PRERED RJOVSC",
-						sval,
-						"Rejection min max",
-						NULL);
-		/* Add REC.PRERED.TRIM */
-		sprintf(sval, "'%d %d %d %d'",
-				bb->trimreg[0],
-				bb->trimreg[1],
-				bb->trimreg[2],
-				bb->trimreg[3]) ;
-		qfits_header_add(fh,
-						"HIERARCH ESO REC PRERED TRIM",
-						sval,
-						"xmin xmax ymin ymax",
-						NULL);		
-		/* Add REC.PRERED.MBIAS */
-		qfits_header_add(fh,
-						"HIERARCH ESO REC PRERED MBIAS",
-						get_basename(bb->name_bias),
-						"Bias used",
-						NULL);
-		/* Add REC.PRERED.MFLAT */
-		qfits_header_add(fh,
-						"HIERARCH ESO REC PRERED MFLAT",
-						get_basename(bb->name_ff),
-						"Flatfield used",
-						NULL);
-
 		image_save_fits_hdrdump(prep->plane[p],
 									name_o,
 									fh,
@@ -306,6 +319,193 @@ int wfiprep_save(cube_t * prep, wfiprep_bb * bb)
 	return 0 ;
 }
 
+/* Calibration frames passed to the per-chip correction */
+typedef struct _wfiprep_chip_par_ {
+	wfiprep_bb	*	bb ;
+	/* Bias and flat-field: one chip per extension, or a single frame */
+	mosaic_t	*	bias_m ;
+	image_t		*	bias ;
+	mosaic_t	*	ff_m ;
+	image_t		*	ff ;
+	/* Number of saturated pixels found in every chip */
+	int			*	nsat ;
+} wfiprep_chip_par ;
+
+/*
+ * Load a calibration frame: whole WFI frames are indexed to be read
+ * chip by chip, single frames are loaded once for all chips.
+ */
+int wfiprep_calib_open(char * name, mosaic_t ** m, image_t ** im)
+{
+	*m  = NULL ;
+	*im = NULL ;
+	if (name==NULL) return -1 ;
+	if (qfits_query_n_ext(name)>0) {
+		*m = mosaic_open(name);
+	} else {
+		*im = image_load(name);
+	}
+	return (*m==NULL && *im==NULL) ? -1 : 0 ;
+}
+
+/*
+ * Get the calibration chip for an extension, to be released with
+ * wfiprep_calib_release(). Runs in worker threads: no messages here.
+ */
+static image_t * wfiprep_calib_chip(mosaic_t * m, image_t * im, int xtnum)
+{
+	if (m!=NULL) return mosaic_load_chip(m, xtnum);
+	return im ;
+}
+
+static void wfiprep_calib_release(mosaic_t * m, image_t * calib)
+{
+	if (m!=NULL && calib!=NULL) image_del(calib);
+}
+
+/*
+ * Pre-processing of a single chip, called from worker threads:
+ * saturation check, overscan/prescan/trimming, bias subtraction and
+ * flat-field division.
+ */
+static image_t * wfiprep_chip(image_t * chip, int xtnum, void * arg)
+{
+	wfiprep_chip_par	*	par ;
+	wfiprep_bb			*	bb ;
+	image_t				*	corr ;
+	image_t				*	bias ;
+	image_t				*	ff ;
+	int						npix ;
+	int						i ;
+
+	par = (wfiprep_chip_par*)arg ;
+	bb  = par->bb ;
+	if (bb->sat_check) {
+		npix = 0 ;
+		for (i=0 ; i<(chip->lx * chip->ly) ; i++) {
+			if (chip->data[i] > (pixelvalue)bb->sat_level) {
+				npix++ ;
+			}
+		}
+		par->nsat[xtnum-1] = npix ;
+		if (npix > (int)(bb->sat_max * (chip->lx * chip->ly))) {
+			return NULL ;
+		}
+	}
+	corr = wfi_overscan_correction(chip,
+								   bb->prescan_x,
+								   bb->overscan_x,
+								   bb->scanrej,
+								   bb->trimreg);
+	if (corr==NULL) return NULL ;
+
+	bias = wfiprep_calib_chip(par->bias_m, par->bias, xtnum);
+	ff   = wfiprep_calib_chip(par->ff_m, par->ff, xtnum);
+	if (bias==NULL || ff==NULL ||
+		bias->lx!=corr->lx || bias->ly!=corr->ly ||
+		ff->lx!=corr->lx || ff->ly!=corr->ly) {
+		wfiprep_calib_release(par->bias_m, bias);
+		wfiprep_calib_release(par->ff_m, ff);
+		image_del(corr);
+		return NULL ;
+	}
+	image_sub_local(corr, bias);
+	image_div_local(corr, ff);
+	wfiprep_calib_release(par->bias_m, bias);
+	wfiprep_calib_release(par->ff_m, ff);
+	return corr ;
+}
+
+/*
+ * Pre-processing of whole WFI frames. Frames are handled one after the
+ * other, the chips of a frame are corrected in parallel and written to
+ * the extensions of a single output file.
+ */
+int wfiprep_mosaic_engine(wfiprep_bb * bb)
+{
+	wfiprep_chip_par	par ;
+	mosaic_t		*	m ;
+	mosaic_out		*	out ;
+	qfits_header	*	fh ;
+	char				name_o[FILENAMESZ];
+	int					p, i ;
+	int					nfail ;
+	int					err ;
+
+	e_comment(0, "--> START WFI preprocessing engine");
+	par.bb = bb ;
+	e_comment(0, "-> loading calibration frames");
+	if (wfiprep_calib_open(bb->name_bias, &par.bias_m, &par.bias)!=0) {
+		e_error("cannot load bias frame [%s]", bb->name_bias);
+		return -1 ;
+	}
+	if (wfiprep_calib_open(bb->name_ff, &par.ff_m, &par.ff)!=0) {
+		e_error("cannot load flat-field frame [%s]", bb->name_ff);
+		mosaic_close(par.bias_m);
+		if (par.bias!=NULL) image_del(par.bias);
+		return -1 ;
+	}
+
+	err = 0 ;
+	for (p=0 ; p<bb->np ; p++) {
+		e_comment(0, "-> processing [%s]", bb->frame_name[p]);
+		if ((m = mosaic_open(bb->frame_name[p]))==NULL) {
+			e_error("cannot open mosaic [%s]", bb->frame_name[p]);
+			err++ ;
+			continue ;
+		}
+		if ((par.bias_m!=NULL && par.bias_m->n_ext!=m->n_ext) ||
+			(par.ff_m!=NULL && par.ff_m->n_ext!=m->n_ext)) {
+			e_error("calibration frames do not have %d extensions",
+					m->n_ext);
+			mosaic_close(m);
+			err++ ;
+			continue ;
+		}
+		sprintf(name_o, "%s_pre.fits",
+				get_rootname(get_basename(bb->frame_name[p])));
+		if ((fh = wfiprep_header(bb, bb->frame_name[p]))==NULL) {
+			mosaic_close(m);
+			err++ ;
+			continue ;
+		}
+		out = mosaic_out_create_like(m, name_o, fh, BPP_DEFAULT,
+									 bb->trimreg[1]-bb->trimreg[0]+1,
+									 bb->trimreg[3]-bb->trimreg[2]+1);
+		qfits_header_destroy(fh);
+		if (out==NULL) {
+			e_error("cannot create output [%s]", name_o);
+			mosaic_close(m);
+			err++ ;
+			continue ;
+		}
+		par.nsat = calloc(m->n_ext, sizeof(int));
+		nfail = mosaic_process(m, out, wfiprep_chip, &par);
+		for (i=0 ; i<m->n_ext ; i++) {
+			if (par.nsat[i] > (int)(bb->sat_max *
+									(m->chip[i].lx * m->chip[i].ly))) {
+				e_error("chip %d of %s has %d pixels above saturation (%g)",
+						i+1, bb->frame_name[p], par.nsat[i], bb->sat_level);
+			}
+		}
+		free(par.nsat);
+		mosaic_out_close(out);
+		mosaic_close(m);
+		if (nfail!=0) {
+			e_error("pre-processing [%s]", bb->frame_name[p]);
+			err++ ;
+		} else {
+			e_comment(1, "saved [%s]", name_o);
+		}
+	}
+	mosaic_close(par.bias_m);
+	mosaic_close(par.ff_m);
+	if (par.bias!=NULL) image_del(par.bias);
+	if (par.ff!=NULL) image_del(par.ff);
+	e_comment(0, "--> STOP WFI preprocessing engine");
+	return (err==0) ? 0 : -1 ;
+}
+
 #define ALGPARTS 6
 
 int wfiprep_engine(wfiprep_bb * bb)
@@ -316,18 +516,6 @@ int wfiprep_engine(wfiprep_bb * bb)
 	int				i ;
 	int				part ;
 
-	e_comment(0, "--> START WFI preprocessing engine");
-	part=0 ;
-
-	/* Load input cube */
-	part++ ;
-	e_comment(0, "-> Part %d of %d: loading input data", part, ALGPARTS);
-	prep = cube_load(bb->name_i);
-	if (prep==NULL) {
-		e_error("loading input data [%s]", bb->name_i);
-		return -1 ;
-	}
-
 	/* Load frame names for error messages */
 	if (is_fits_file(bb->name_i)==1) {
 		bb->np = 1 ;
@@ -335,6 +523,10 @@ int wfiprep_engine(wfiprep_bb * bb)
 		bb->frame_name[0] = strdup(bb->name_i);
 	} else {
 		flist = framelist_load(bb->name_i);
+		if (flist==NULL) {
+			e_error("cannot load frame list [%s]", bb->name_i);
+			return -1 ;
+		}
 		bb->np = flist->n ;
 		bb->frame_name = malloc(flist->n * sizeof(char*));
 		for (i=0 ; i<flist->n ; i++) {
@@ -343,6 +535,23 @@ int wfiprep_engine(wfiprep_bb * bb)
 		framelist_del(flist);
 	}
 
+	/* Whole WFI frames are processed chip by chip */
+	if (qfits_query_n_ext(bb->frame_name[0])>0) {
+		return wfiprep_mosaic_engine(bb);
+	}
+
+	e_comment(0, "--> START WFI preprocessing engine");
+	part=0 ;
+
+	/* Load input cube */
+	part++ ;
+	e_comment(0, "-> Part %d of %d: loading input data", part, ALGPARTS);
+	prep = cube_load(bb->name_i);
+	if (prep==NULL) {
+		e_error("loading input data [%s]", bb->name_i);
+		return -1 ;
+	}
+
 	part++;
 	e_comment(0, "-> Part %d of %d: checking saturation level", part, ALGPARTS);
 	/* Saturation check if requested */
@@ -608,6 +817,7 @@ usage(char *pname)
 {
     hello_world(pname, prog_desc) ;
     printf("use : %s [options] <input>\n", pname) ;
+    printf("input is a WFI frame, an extension file or a list of them\n") ;
     printf(
 "options are:\n"
 "\n"
@@ -58,6 +58,7 @@ static int LUA_TPIXMAP ;
 
 #include "src/cube.c"
 #include "src/arith.c"
+#include "src/expr.c"
 #include "src/filter.c"
 #include "src/merge.c"
 #include "src/collapse.c"
@@ -101,6 +102,7 @@ void lua_eclipselibopen(lua_State * L)
 	lua_register(L, "sub",		wrap_cube_sub);
 	lua_register(L, "mul",		wrap_cube_mul);
 	lua_register(L, "div",		wrap_cube_div);
+	lua_register(L, "expr",		wrap_cube_expr);
 	
 	lua_register(L, "filter", 	wrap_cube_filter);
 	lua_register(L, "merge", 	wrap_cube_merge);
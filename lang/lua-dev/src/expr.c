@@ -0,0 +1,60 @@
+
+/*-------------------------------------------------------------------------*/
+/**
+    expr -- Evaluate an arithmetic expression on cubes in one pass.
+
+    Usage:
+    % c = expr("($1 - $2) / $3", raw, dark, flat)
+    % c = expr("($1 - $2) / $3 * $4 + 100", raw, dark, flat, 2.5)
+
+    The first argument is an arithmetic expression in standard notation,
+    the following arguments are cubes or numbers referred to in the
+    expression as $1, $2, etc. Supported operators are + - * / and ^
+    (power), with unary minus and brackets.
+
+    The whole expression is evaluated in a single pass over the pixels,
+    without creating intermediate cubes. Input cubes are not modified, a
+    new cube is returned (or nil in case of error). Cubes with a single
+    plane are applied to all planes of the result. Divisions by zero
+    yield zero.
+ */
+/*--------------------------------------------------------------------------*/
+
+int wrap_cube_expr(lua_State * L)
+{
+    arith_expr  *   e ;
+    cube_t      *   res ;
+    int             nargs ;
+    int             i ;
+
+    nargs = lua_gettop(L);
+    if (nargs<2 || !lua_isstring(L,1)) {
+        e_error("in arguments to expr()\n");
+        return 0 ;
+    }
+    e = arith_expr_new();
+    for (i=2 ; i<=nargs ; i++) {
+        if (lua_iscube(L,i)) {
+            arith_expr_add_cube(e, (cube_t*)lua_touserdata(L,i));
+        } else if (lua_isnumber(L,i)) {
+            arith_expr_add_const(e, lua_tonumber(L,i));
+        } else {
+            e_error("expr(): argument %d is neither a cube nor a number", i);
+            arith_expr_del(e);
+            return 0 ;
+        }
+    }
+    res = NULL ;
+    if (arith_expr_parse(e, (char*)lua_tostring(L,1))==0) {
+        res = arith_expr_eval_cube(e, NULL);
+    }
+    arith_expr_del(e);
+    if (res==NULL) {
+        lua_pushnil(L);
+        return 1 ;
+    }
+    lua_pushusertag(L, (void*)res, LUA_TCUBE);
+    lua_userdatasize(L, cube_get_bytesize(res));
+    return 1 ;
+}
+
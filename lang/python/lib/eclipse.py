@@ -649,6 +649,37 @@ class cube:
             raise EclipseError, 'Empty slice'
 	return self.cube_copy_planes(planelist)	
 
+def expr(formula, *operands):
+    '''Evaluate an arithmetic expression on cubes in a single pass
+
+    Arguments:
+    formula -- expression in standard notation, e.g. '($1-$2)/$3*$4'
+    operands -- cubes or numbers, referred to as $1, $2, ... in formula
+
+    Supported operators are + - * / and ** or ^ (power), with unary
+    minus and brackets. The whole expression is computed pixel by pixel
+    without intermediate cubes, and a new cube is returned. Single-plane
+    cubes are applied to all planes of the result. Divisions by zero
+    yield zero.
+    '''
+    e = c_eclipse.arith_expr_new()
+    try:
+        for op in operands:
+            if type(op) in _number_types:
+                c_eclipse.arith_expr_add_const(e, op)
+            else:
+                op.load_cube()
+                c_eclipse.arith_expr_add_cube(e, op.p_cube)
+        if c_eclipse.arith_expr_parse(e, formula.replace('**', '^')) == _FAILURE:
+            raise EclipseError, 'Error parsing expression %s' % `formula`
+        result = cube()
+        result.p_cube = c_eclipse.arith_expr_eval_cube(e, None)
+        if result.p_cube is None:
+            raise EclipseError, 'Error evaluating expression %s' % `formula`
+    finally:
+        c_eclipse.arith_expr_del(e)
+    return result
+
 class CubeGenerator:
     '''Provides object capable of producing artificially generated data
     with various properties. Generated sibngle-plane cubes only'''
@@ -1,4 +1,4 @@
-import eclipse, unittest, os
+import eclipse, unittest, os, struct, zlib, random
     
 def build_test_data():
     '''This function builds fits files to be used in testing
@@ -228,6 +228,30 @@ class cube_arithmetic_tests(unittest.TestCase):
                               eval,
                               "2**self.c1")
 
+class cube_expr_tests(unittest.TestCase):
+    '''Fused expressions against the equivalent chain of cube operations'''
+    def setUp(self):
+        self.c1 = eclipse.cube('IM01.fits')
+        self.c2 = eclipse.cube('IM02.fits')
+        self.c3 = eclipse.cube('IM03.fits')
+    def tearDown(self):
+        self.c1 = None
+        self.c2 = None
+        self.c3 = None
+
+    def test_expr(self):
+        res = eclipse.expr('($1-$2)/7*$3+2.5', self.c1, self.c2, self.c3)
+        ref = (eclipse.cube('IM01.fits') - eclipse.cube('IM02.fits')) / 7
+        ref = ref * eclipse.cube('IM03.fits') + 2.5
+        s = (res - ref).stat()
+        self.failUnlessEqual(s.min_pix, 0.0)
+        self.failUnlessEqual(s.max_pix, 0.0)
+        self.failUnless(self.c1.p_cube)
+
+    def test_expr_bad(self):
+        self.failUnlessRaises(eclipse.EclipseError,
+                              eclipse.expr, '($1-', self.c1)
+
 class cube_inplace_tests(unittest.TestCase):
     '''Test procedures that modify the cube in place''' 
     def setUp(self):
@@ -337,6 +361,7 @@ cube_test_suite = unittest.TestSuite()
 cube_test_suite.addTest(unittest.makeSuite(cube_tests))
 cube_test_suite.addTest(unittest.makeSuite(cube_statistics_tests))
 cube_test_suite.addTest(unittest.makeSuite(cube_arithmetic_tests))
+cube_test_suite.addTest(unittest.makeSuite(cube_expr_tests))
 cube_test_suite.addTest(unittest.makeSuite(cube_inplace_tests))
 cube_test_suite.addTest(unittest.makeSuite(cube_to_cube_tests))
 
@@ -370,6 +395,532 @@ class header_write_tests(unittest.TestCase):
 header_test_suite = unittest.TestSuite()
 header_test_suite.addTest(unittest.makeSuite(header_write_tests))
 
+# Command-line tools are taken from ECLIPSE_BIN, by default the bin
+# directory of the source tree
+bindir = os.environ.get('ECLIPSE_BIN', os.path.join('..', '..', '..', 'bin'))
+
+def run_tool(command, directory=None):
+    '''Run an eclipse command-line tool
+
+    Returns the exit status (None on success) and the standard output.
+    '''
+    if directory is None:
+        directory = bindir
+    pipe = os.popen(os.path.join(directory, command) + ' 2>/dev/null')
+    output = pipe.read()
+    return pipe.close(), output
+
+def table_rows(output):
+    '''Split the non-comment lines of a tool output into fields'''
+    rows = []
+    for line in output.split('\n'):
+        if line.strip() and line[0] != '#':
+            rows.append(line.split())
+    return rows
+
+def fits_block(cards):
+    '''Format header cards (key, value) into FITS blocks'''
+    header = ''
+    for key, value in cards + [('END', None)]:
+        if value is None:
+            card = key
+        elif value is True:
+            card = '%-8s= %20s' % (key, 'T')
+        elif isinstance(value, str):
+            card = "%-8s= '%-8s'" % (key, value)
+        else:
+            card = '%-8s= %20d' % (key, value)
+        header = header + card.ljust(80)
+    return header + ' ' * (-len(header) % 2880)
+
+# Kernels of a build configured with --float32 (in ECLIPSE_BIN) are
+# compared to those of a default build, in ECLIPSE_REF_BIN
+refbindir = os.environ.get('ECLIPSE_REF_BIN')
+
+def write_fits_cube(filename, planes, lx, ly):
+    '''Write planes of lx*ly values as a BITPIX=-32 FITS cube'''
+    f = open(filename, 'wb')
+    f.write(fits_block([('SIMPLE', True), ('BITPIX', -32), ('NAXIS', 3),
+                        ('NAXIS1', lx), ('NAXIS2', ly),
+                        ('NAXIS3', len(planes))]))
+    data = ''
+    for plane in planes:
+        data = data + struct.pack('>%df' % len(plane), *plane)
+    f.write(data + '\0' * (-len(data) % 2880))
+    f.close()
+
+def read_fits_pixels(filename):
+    '''Read the pixels of a BITPIX=-32 FITS image or cube'''
+    f = open(filename, 'rb')
+    cards = {}
+    header = ''
+    while 'END' not in cards:
+        block = f.read(2880)
+        header = header + block
+        for i in range(0, 2880, 80):
+            card = block[i:i+80]
+            key = card[:8].strip()
+            cards[key] = card[10:].split('/')[0].strip()
+            if key == 'END':
+                break
+    npix = int(cards['NAXIS1']) * int(cards['NAXIS2'])
+    if int(cards['NAXIS']) > 2:
+        npix = npix * int(cards['NAXIS3'])
+    data = f.read(4 * npix)
+    f.close()
+    if int(cards['BITPIX']) != -32:
+        raise ValueError('%s: BITPIX is not -32' % filename)
+    return struct.unpack('>%df' % npix, data)
+
+def star_field(lx, ly, dx, dy, seed):
+    '''Stars on a 1e4 background with gaussian noise, shifted by dx,dy'''
+    stars = [(30.3, 40.7, 5000.0), (90.1, 20.4, 3000.0),
+             (60.6, 100.2, 8000.0), (100.8, 90.5, 2000.0)]
+    noise = random.Random(seed)
+    plane = []
+    for j in range(ly):
+        for i in range(lx):
+            value = 1e4 + noise.gauss(0.0, 10.0)
+            for x, y, flux in stars:
+                r2 = (i - x - dx) ** 2 + (j - y - dy) ** 2
+                if r2 < 100.0:
+                    value = value + flux * (2.0 ** (-r2 / 4.5))
+            plane.append(value)
+    return plane
+
+def relative_difference(a, b):
+    return abs(a - b) / max(abs(a), abs(b), 1e-30)
+
+def lower_median(values):
+    '''Median as eclipse selects it: the lower one for an even count'''
+    values = list(values)
+    values.sort()
+    return values[(len(values) - 1) / 2]
+
+def star_image(lx, ly, stars, seed):
+    '''Stars at integer positions on a 100 background with unit noise'''
+    noise = random.Random(seed)
+    plane = [100.0 + noise.gauss(0.0, 1.0) for i in range(lx * ly)]
+    for x, y in stars:
+        for j in range(y - 6, y + 7):
+            for i in range(x - 6, x + 7):
+                r2 = (i - x) ** 2 + (j - y) ** 2
+                plane[i + j * lx] = plane[i + j * lx] + \
+                                    5000.0 * (2.0 ** (-r2 / 4.5))
+    return plane
+
+class float32_tests(unittest.TestCase):
+    '''Accuracy bounds of the single-precision kernels'''
+    def setUp(self):
+        self.planes = [star_field(128, 128, 0.0, 0.0, 1),
+                       star_field(128, 128, 2.3, -1.6, 2),
+                       star_field(128, 128, -3.1, 0.8, 3)]
+        write_fits_cube('f32.fits', self.planes, 128, 128)
+        write_fits_cube('f32_1.fits', self.planes[:1], 128, 128)
+    def tearDown(self):
+        for name in ['f32.fits', 'f32_1.fits', 'f32_warp.fits',
+                     'f32_ref.fits']:
+            if os.path.exists(name):
+                os.remove(name)
+
+    def _both(self, command):
+        '''Run a command with both builds, return both outputs'''
+        status, output = run_tool(command)
+        self.failIf(status)
+        status, refoutput = run_tool(command, refbindir)
+        self.failIf(status)
+        return output, refoutput
+
+    def test_stats(self):
+        '''image_getstats: flux, mean and stdev within 1e-5'''
+        output, refoutput = self._both('stcube f32.fits')
+        rows = table_rows(output)
+        refrows = table_rows(refoutput)
+        self.failUnlessEqual(len(rows), 3)
+        self.failUnlessEqual(len(rows), len(refrows))
+        for row, refrow in zip(rows, refrows):
+            # min max mean median stdev flux, printed with 6 digits
+            for col in [3, 5, 6]:
+                self.failUnless(relative_difference(float(row[col]),
+                                float(refrow[col])) < 1e-5 + 1e-5)
+
+    def test_warp(self):
+        '''Resampling: within 1e-6 of the pixel dynamic range'''
+        command = ("warping -u '0 0 0.3 1 0 1.002 0 1 0.001 2 0 1e-5' "
+                   "-v '0 0 -0.2 0 1 0.998 1 0 -0.002 0 2 4e-6' f32_1.fits")
+        status, output = run_tool(command + ' f32_warp.fits')
+        self.failIf(status)
+        status, output = run_tool(command + ' f32_ref.fits', refbindir)
+        self.failIf(status)
+        warped = read_fits_pixels('f32_warp.fits')
+        reference = read_fits_pixels('f32_ref.fits')
+        self.failUnlessEqual(len(warped), len(reference))
+        bound = 1e-6 * (max(self.planes[0]) - min(self.planes[0]))
+        for a, b in zip(warped, reference):
+            self.failUnless(abs(a - b) <= bound)
+
+    def test_xcorrelation(self):
+        '''Cross-correlation: same offsets to the printed 0.01 pixel'''
+        output, refoutput = self._both('xcorr2d f32.fits')
+        # plane NN: dx dy, after a title line
+        rows = table_rows(output)[1:]
+        refrows = table_rows(refoutput)[1:]
+        self.failUnless(len(rows) > 0)
+        self.failUnlessEqual(len(rows), len(refrows))
+        for row, refrow in zip(rows, refrows):
+            self.failUnless(abs(float(row[-2]) - float(refrow[-2])) < 0.011)
+            self.failUnless(abs(float(row[-1]) - float(refrow[-1])) < 0.011)
+
+float32_test_suite = unittest.TestSuite()
+float32_test_suite.addTest(unittest.makeSuite(float32_tests))
+
+class peak_tests(unittest.TestCase):
+    def setUp(self):
+        run_tool("imgen -x 128 -y 128 -g '40 50 2' -o peak.fits")
+    def tearDown(self):
+        os.remove('peak.fits')
+
+    def test_photometry(self):
+        status, output = run_tool("peak -P '5 8 12' peak.fits")
+        self.failIf(status)
+        rows = table_rows(output)
+        self.failUnlessEqual(len(rows), 1)
+        self.failUnless(float(rows[0][-1]) > 0.0)
+
+def gzip_string(data):
+    '''Compress a string in gzip format'''
+    deflate = zlib.compressobj(9, zlib.DEFLATED, -zlib.MAX_WBITS)
+    body = deflate.compress(data) + deflate.flush()
+    return ('\x1f\x8b\x08\0\0\0\0\0\0\xff' + body +
+            struct.pack('<II', zlib.crc32(data) & 0xffffffffL, len(data)))
+
+def write_lossless_zimage(filename, values, lx, ly):
+    '''Write float pixels as a GZIP_2 tile-compressed image, one tile per
+    line, without quantization (as written for quantize_level=0)'''
+    heap = ''
+    table = ''
+    for j in range(ly):
+        line = values[j*lx:(j+1)*lx]
+        raw = ''.join([struct.pack('>f', v) for v in line])
+        # GZIP_2 shuffles bytes: all first bytes, then all second bytes...
+        shuffled = ''.join([raw[k::4] for k in range(4)])
+        tile = gzip_string(shuffled)
+        table = table + struct.pack('>ii', len(tile), len(heap))
+        heap = heap + tile
+    data = table + heap
+    f = open(filename, 'wb')
+    f.write(fits_block([('SIMPLE', True), ('BITPIX', 8), ('NAXIS', 0),
+                        ('EXTEND', True)]))
+    f.write(fits_block([('XTENSION', 'BINTABLE'), ('BITPIX', 8),
+                        ('NAXIS', 2), ('NAXIS1', 8), ('NAXIS2', ly),
+                        ('PCOUNT', len(heap)), ('GCOUNT', 1),
+                        ('TFIELDS', 1), ('TTYPE1', 'COMPRESSED_DATA'),
+                        ('TFORM1', '1PB'), ('ZIMAGE', True),
+                        ('ZBITPIX', -32), ('ZNAXIS', 2),
+                        ('ZNAXIS1', lx), ('ZNAXIS2', ly),
+                        ('ZTILE1', lx), ('ZTILE2', 1),
+                        ('ZCMPTYPE', 'GZIP_2'), ('ZQUANTIZ', 'NO_DITHER')]))
+    f.write(data + '\0' * (-len(data) % 2880))
+    f.close()
+
+class zimage_tests(unittest.TestCase):
+    def setUp(self):
+        self.values = [0.25 * i - 7.5 for i in range(20 * 10)]
+        write_lossless_zimage('zimage.fits', self.values, 20, 10)
+    def tearDown(self):
+        os.remove('zimage.fits')
+
+    def test_lossless_float(self):
+        '''ZQUANTIZ without ZSCALE: pixels are stored as they are'''
+        status, output = run_tool('dumppix zimage.fits')
+        self.failIf(status)
+        rows = table_rows(output)
+        self.failUnlessEqual(len(rows), len(self.values))
+        for x, y, value in rows:
+            expected = self.values[int(x) - 1 + (int(y) - 1) * 20]
+            self.failUnlessAlmostEqual(float(value), expected, 5)
+
+    def test_rice_roundtrip(self):
+        '''Rice-compressed output reads back as the uncompressed file'''
+        command = "imgen -x 100 -y 60 -b 16 --poly2 '0.5 -0.7 0.3 -20 15 -300'"
+        try:
+            status, output = run_tool(command + ' -o zimage16.fz')
+            self.failIf(status)
+            status, output = run_tool(command + ' -o zimage16.fits')
+            self.failIf(status)
+            self.failUnless('ZIMAGE' in open('zimage16.fz', 'rb').read())
+            # Whole image, then windows covering one line or one column
+            for option in ['', '-y 37 ', '-x 61 ']:
+                status, output = run_tool('dumppix ' + option + 'zimage16.fz')
+                self.failIf(status)
+                status, refoutput = run_tool('dumppix ' + option +
+                                             'zimage16.fits')
+                self.failIf(status)
+                self.failUnless(len(table_rows(output)) > 0)
+                self.failUnlessEqual(output, refoutput)
+        finally:
+            for name in ['zimage16.fz', 'zimage16.fits']:
+                if os.path.exists(name):
+                    os.remove(name)
+
+class stack_tests(unittest.TestCase):
+    def setUp(self):
+        noise = random.Random(7)
+        self.planes = []
+        for k in range(9):
+            plane = [100.0 + noise.gauss(0.0, 5.0) for i in range(32 * 24)]
+            for n in range(20):
+                plane[noise.randrange(32 * 24)] = 5000.0
+            self.planes.append(plane)
+        write_fits_cube('stack.fits', self.planes, 32, 24)
+    def tearDown(self):
+        for name in ['stack.fits', 'stack_lin.fits', 'stack_out.fits']:
+            if os.path.exists(name):
+                os.remove(name)
+
+    def test_unclipped(self):
+        '''Weighted and clipped averages without rejection: linear average'''
+        status, output = run_tool('average -i stack.fits -o stack_lin.fits')
+        self.failIf(status)
+        linear = read_fits_pixels('stack_lin.fits')
+        for method in ['weighted',
+                       'ksigma --kappa-low 1e6 --kappa-high 1e6',
+                       'mad --kappa-low 1e6 --kappa-high 1e6']:
+            status, output = run_tool('average -i stack.fits '
+                                      '-o stack_out.fits --method ' + method)
+            self.failIf(status)
+            stacked = read_fits_pixels('stack_out.fits')
+            self.failUnlessEqual(len(stacked), len(linear))
+            for a, b in zip(stacked, linear):
+                self.failUnless(relative_difference(a, b) < 1e-5)
+
+    def test_filtered(self):
+        '''Filtered average: mean of the sorted time line, ends removed'''
+        status, output = run_tool('average -i stack.fits -o stack_out.fits '
+                                  '--method filtered --filt-low 2 '
+                                  '--filt-high 3')
+        self.failIf(status)
+        stacked = read_fits_pixels('stack_out.fits')
+        for i in range(len(stacked)):
+            line = [plane[i] for plane in self.planes]
+            line.sort()
+            expected = sum(line[2:-3]) / 4.0
+            self.failUnless(relative_difference(stacked[i], expected) < 1e-5)
+
+class histogram_tests(unittest.TestCase):
+    def setUp(self):
+        # Integer pixels, exact in float, spanning exactly 0..1e6
+        noise = random.Random(11)
+        self.images = {}
+        for lx, ly in [(300, 250), (301, 251)]:
+            values = [float(noise.randrange(1000001))
+                      for i in range(lx * ly)]
+            values[5] = 0.0
+            values[7] = 1e6
+            self.images['histo%d.fits' % lx] = values
+            write_fits_cube('histo%d.fits' % lx, [values], lx, ly)
+    def tearDown(self):
+        for name in self.images.keys():
+            os.remove(name)
+
+    def test_median(self):
+        '''Median by histogram selection: same rank as a full sort'''
+        for name, values in self.images.items():
+            status, output = run_tool('stcube ' + name)
+            self.failIf(status)
+            rows = table_rows(output)
+            self.failUnlessEqual(len(rows), 1)
+            # plane min max mean median stdev flux
+            self.failUnlessEqual(float(rows[0][4]), lower_median(values))
+
+    def test_bins(self):
+        '''Binning with fused min/max: same counts as an explicit range'''
+        for name, values in self.images.items():
+            counts = [0] * 100
+            for value in values:
+                counts[min(int(value / 1e4), 99)] += 1
+            status, output = run_tool('histog -b 100 ' + name)
+            self.failIf(status)
+            rows = table_rows(output)
+            self.failUnlessEqual([int(row[1]) for row in rows], counts)
+            status, refoutput = run_tool("histog -b 100 -i '0 1e6' " + name)
+            self.failIf(status)
+            self.failUnlessEqual(table_rows(refoutput), rows)
+            status, output = run_tool('histog -c -b 100 ' + name)
+            self.failIf(status)
+            rows = table_rows(output)
+            self.failUnlessEqual(int(rows[-1][1]), len(values))
+
+class photometry_tests(unittest.TestCase):
+    def setUp(self):
+        self.stars = [(20 + 40 * i, 20 + 40 * j)
+                      for j in range(4) for i in range(5)]
+        self.plane = star_image(200, 160, self.stars, 5)
+        write_fits_cube('phot.fits', [self.plane], 200, 160)
+    def tearDown(self):
+        os.remove('phot.fits')
+
+    def _disk(self, x, y, r_int, r_ext):
+        '''Pixels of a hard-edged annulus (a disk if r_int is 0)'''
+        pixels = []
+        for j in range(y - r_ext - 1, y + r_ext + 2):
+            for i in range(x - r_ext - 1, x + r_ext + 2):
+                r2 = (i - x) ** 2 + (j - y) ** 2
+                if r_int * r_int <= r2 <= r_ext * r_ext:
+                    pixels.append(self.plane[i + j * 200])
+        return pixels
+
+    def test_apertures(self):
+        '''Objects measured in parallel: hard-edged disk and median ring'''
+        status, output = run_tool("peak -P '5 8 12' phot.fits")
+        self.failIf(status)
+        rows = table_rows(output)
+        self.failUnlessEqual(len(rows), len(self.stars))
+        for row in rows:
+            x = int(float(row[1]))
+            y = int(float(row[2]))
+            self.failUnless((x, y) in self.stars)
+            background = max(lower_median(self._disk(x, y, 8, 12)), 0.0)
+            flux = 0.0
+            for value in self._disk(x, y, 0, 5):
+                flux = flux + (value - background)
+            self.failUnless(abs(float(row[-1]) - flux) < 0.01)
+
+class detection_tests(unittest.TestCase):
+    '''Detection by 256x256 tiles: objects on the seams are merged'''
+    def setUp(self):
+        self.lx = 320
+        self.ly = 300
+        self.plane = star_image(self.lx, self.ly, [(40, 40), (256, 100),
+                                (100, 255), (255, 256), (180, 180)], 9)
+        # A bar across the vertical seam
+        for j in range(199, 202):
+            for i in range(230, 280):
+                self.plane[i + j * self.lx] = \
+                    self.plane[i + j * self.lx] + 300.0
+        write_fits_cube('detect.fits', [self.plane], self.lx, self.ly)
+    def tearDown(self):
+        for name in ['detect.fits', 'detect_roll.fits']:
+            if os.path.exists(name):
+                os.remove(name)
+
+    def _objects(self, command, dx=0, dy=0):
+        '''Sorted objects: position shifted back by dx,dy, then stats'''
+        status, output = run_tool(command)
+        self.failIf(status)
+        objects = []
+        for row in table_rows(output):
+            objects.append([(float(row[1]) - dx) % self.lx,
+                            (float(row[2]) - dy) % self.ly] + row[3:9])
+        objects.sort()
+        return objects
+
+    def test_seams(self):
+        '''Same objects when the image is rolled away from the seams'''
+        dx, dy = 97, 61
+        rolled = [0.0] * (self.lx * self.ly)
+        for j in range(self.ly):
+            for i in range(self.lx):
+                rolled[(i + dx) % self.lx + ((j + dy) % self.ly) * self.lx] = \
+                    self.plane[i + j * self.lx]
+        write_fits_cube('detect_roll.fits', [rolled], self.lx, self.ly)
+        objects = self._objects('peak detect.fits')
+        self.failUnlessEqual(len(objects), 6)
+        self.failUnlessEqual(self._objects('peak detect_roll.fits', dx, dy),
+                             objects)
+
+    def test_mesh(self):
+        '''Flat background: the mesh finds the objects of a global level'''
+        objects = self._objects('peak detect.fits')
+        for mesh in [32, 64]:
+            meshed = self._objects('peak -M %d detect.fits' % mesh)
+            self.failUnlessEqual(len(meshed), len(objects))
+            for a, b in zip(meshed, objects):
+                self.failUnless(abs(a[0] - b[0]) <= 0.5)
+                self.failUnless(abs(a[1] - b[1]) <= 0.5)
+
+class cube_tiles_tests(unittest.TestCase):
+    '''Cubes over the E_CUBEMEM budget are paged in by tiles'''
+    def setUp(self):
+        # 100 planes of 64x48 floats: 1.2 Mb
+        noise = random.Random(3)
+        planes = [[noise.gauss(100.0, 10.0) for i in range(64 * 48)]
+                  for k in range(100)]
+        write_fits_cube('tiles.fits', planes, 64, 48)
+    def tearDown(self):
+        for name in ['tiles.fits', 'tiles_mem.fits', 'tiles_out.fits']:
+            if os.path.exists(name):
+                os.remove(name)
+
+    def test_budget(self):
+        '''Same outputs with and without a memory budget'''
+        for command in ['average -i tiles.fits -o %s',
+                        'average -i tiles.fits -o %s --method median',
+                        'average -i tiles.fits -o %s --cut running '
+                        '--halfwidth 2',
+                        'filt -f median tiles.fits %s',
+                        'filt -f mean3 tiles.fits %s']:
+            status, output = run_tool(command % 'tiles_mem.fits')
+            self.failIf(status)
+            os.environ['E_CUBEMEM'] = '0.5'
+            try:
+                status, output = run_tool(command % 'tiles_out.fits')
+            finally:
+                del os.environ['E_CUBEMEM']
+            self.failIf(status)
+            self.failUnlessEqual(read_fits_pixels('tiles_out.fits'),
+                                 read_fits_pixels('tiles_mem.fits'))
+
+class zlines_tests(unittest.TestCase):
+    '''Time lines gathered by chunks: 17 planes, 19500 pixels'''
+    def setUp(self):
+        noise = random.Random(13)
+        planes = [[noise.gauss(100.0 + k, 10.0) for i in range(150 * 130)]
+                  for k in range(17)]
+        write_fits_cube('zlines.fits', planes, 150, 130)
+        # Pixels as stored, in single precision
+        pixels = read_fits_pixels('zlines.fits')
+        self.planes = [pixels[k*150*130:(k+1)*150*130] for k in range(17)]
+    def tearDown(self):
+        for name in ['zlines.fits', 'zlines_out.fits']:
+            if os.path.exists(name):
+                os.remove(name)
+
+    def test_stdev(self):
+        '''Time variance: mean first, then the sum of squared deviations'''
+        status, output = run_tool('stcube -s zlines_out.fits zlines.fits')
+        self.failIf(status)
+        variance = read_fits_pixels('zlines_out.fits')
+        self.failUnlessEqual(len(variance), 150 * 130)
+        for i in range(len(variance)):
+            line = [plane[i] for plane in self.planes]
+            mean = sum(line) / 17.0
+            expected = 0.0
+            for value in line:
+                expected = expected + (value - mean) ** 2
+            expected = expected / 17.0
+            self.failUnless(relative_difference(variance[i], expected) < 1e-5)
+
+    def test_median(self):
+        '''Median collapse of each time line'''
+        status, output = run_tool('average -i zlines.fits -o zlines_out.fits '
+                                  '--method median')
+        self.failIf(status)
+        median = read_fits_pixels('zlines_out.fits')
+        for i in range(len(median)):
+            line = [plane[i] for plane in self.planes]
+            self.failUnlessEqual(median[i], lower_median(line))
+
+tool_test_suite = unittest.TestSuite()
+tool_test_suite.addTest(unittest.makeSuite(peak_tests))
+tool_test_suite.addTest(unittest.makeSuite(zimage_tests))
+tool_test_suite.addTest(unittest.makeSuite(stack_tests))
+tool_test_suite.addTest(unittest.makeSuite(histogram_tests))
+tool_test_suite.addTest(unittest.makeSuite(photometry_tests))
+tool_test_suite.addTest(unittest.makeSuite(detection_tests))
+tool_test_suite.addTest(unittest.makeSuite(cube_tiles_tests))
+tool_test_suite.addTest(unittest.makeSuite(zlines_tests))
+
 if __name__ == '__main__':
     build_test_data()
 
@@ -379,5 +930,10 @@ if __name__ == '__main__':
     test_runner.run(cube_test_suite)
     print 'Testing headers...'
     test_runner.run(header_test_suite)
+    print 'Testing tools...'
+    test_runner.run(tool_test_suite)
+    if refbindir is not None:
+        print 'Comparing float32 kernels...'
+        test_runner.run(float32_test_suite)
     
     delete_test_data()
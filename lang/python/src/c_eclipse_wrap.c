@@ -508,7 +508,8 @@ SWIG_InstallConstants(PyObject *d, swig_const_info constants[]) {
 #define  SWIGTYPE_p_p_cube_t swig_types[11] 
 #define  SWIGTYPE_p_cube_t swig_types[12] 
 #define  SWIGTYPE_p_pixelmap swig_types[13] 
-static swig_type_info *swig_types[15];
+#define  SWIGTYPE_p_arith_expr swig_types[14] 
+static swig_type_info *swig_types[16];
 
 /* -------- TYPES TABLE (END) -------- */
 
@@ -1081,6 +1082,95 @@ static PyObject *_wrap_plot_signal(PyObject *self, PyObject *args) {
 }
 
 
+static PyObject *_wrap_arith_expr_new(PyObject *self, PyObject *args) {
+    PyObject *resultobj;
+    arith_expr *result ;
+    
+    if(!PyArg_ParseTuple(args,":arith_expr_new")) return NULL;
+    result = (arith_expr *)arith_expr_new();
+    resultobj = SWIG_NewPointerObj((void *) result, SWIGTYPE_p_arith_expr);
+    return resultobj;
+}
+
+
+static PyObject *_wrap_arith_expr_del(PyObject *self, PyObject *args) {
+    PyObject *resultobj;
+    arith_expr *arg0 ;
+    PyObject * argo0 =0 ;
+    
+    if(!PyArg_ParseTuple(args,"O:arith_expr_del",&argo0)) return NULL;
+    if ((SWIG_ConvertPtr(argo0,(void **) &arg0,SWIGTYPE_p_arith_expr,1)) == -1) return NULL;
+    arith_expr_del(arg0);
+    Py_INCREF(Py_None);
+    resultobj = Py_None;
+    return resultobj;
+}
+
+
+static PyObject *_wrap_arith_expr_add_cube(PyObject *self, PyObject *args) {
+    PyObject *resultobj;
+    arith_expr *arg0 ;
+    cube_t *arg1 ;
+    PyObject * argo0 =0 ;
+    PyObject * argo1 =0 ;
+    int result ;
+    
+    if(!PyArg_ParseTuple(args,"OO:arith_expr_add_cube",&argo0,&argo1)) return NULL;
+    if ((SWIG_ConvertPtr(argo0,(void **) &arg0,SWIGTYPE_p_arith_expr,1)) == -1) return NULL;
+    if ((SWIG_ConvertPtr(argo1,(void **) &arg1,SWIGTYPE_p_cube_t,1)) == -1) return NULL;
+    result = (int )arith_expr_add_cube(arg0,arg1);
+    resultobj = PyInt_FromLong((long)result);
+    return resultobj;
+}
+
+
+static PyObject *_wrap_arith_expr_add_const(PyObject *self, PyObject *args) {
+    PyObject *resultobj;
+    arith_expr *arg0 ;
+    double arg1 ;
+    PyObject * argo0 =0 ;
+    int result ;
+    
+    if(!PyArg_ParseTuple(args,"Od:arith_expr_add_const",&argo0,&arg1)) return NULL;
+    if ((SWIG_ConvertPtr(argo0,(void **) &arg0,SWIGTYPE_p_arith_expr,1)) == -1) return NULL;
+    result = (int )arith_expr_add_const(arg0,arg1);
+    resultobj = PyInt_FromLong((long)result);
+    return resultobj;
+}
+
+
+static PyObject *_wrap_arith_expr_parse(PyObject *self, PyObject *args) {
+    PyObject *resultobj;
+    arith_expr *arg0 ;
+    char *arg1 ;
+    PyObject * argo0 =0 ;
+    int result ;
+    
+    if(!PyArg_ParseTuple(args,"Os:arith_expr_parse",&argo0,&arg1)) return NULL;
+    if ((SWIG_ConvertPtr(argo0,(void **) &arg0,SWIGTYPE_p_arith_expr,1)) == -1) return NULL;
+    result = (int )arith_expr_parse(arg0,arg1);
+    resultobj = PyInt_FromLong((long)result);
+    return resultobj;
+}
+
+
+static PyObject *_wrap_arith_expr_eval_cube(PyObject *self, PyObject *args) {
+    PyObject *resultobj;
+    arith_expr *arg0 ;
+    cube_t *arg1 ;
+    PyObject * argo0 =0 ;
+    PyObject * argo1 =0 ;
+    cube_t *result ;
+    
+    if(!PyArg_ParseTuple(args,"OO:arith_expr_eval_cube",&argo0,&argo1)) return NULL;
+    if ((SWIG_ConvertPtr(argo0,(void **) &arg0,SWIGTYPE_p_arith_expr,1)) == -1) return NULL;
+    if ((SWIG_ConvertPtr(argo1,(void **) &arg1,SWIGTYPE_p_cube_t,1)) == -1) return NULL;
+    result = (cube_t *)arith_expr_eval_cube(arg0,arg1);
+    resultobj = SWIG_NewPointerObj((void *) result, SWIGTYPE_p_cube_t);
+    return resultobj;
+}
+
+
 static PyObject *_wrap_average_engine(PyObject *self, PyObject *args) {
     PyObject *resultobj;
     char *arg0 ;
@@ -3496,6 +3586,12 @@ static PyMethodDef c_eclipseMethods[] = {
 	 { "eclipse_display_license", _wrap_eclipse_display_license, METH_VARARGS },
 	 { "show_image", _wrap_show_image, METH_VARARGS },
 	 { "plot_signal", _wrap_plot_signal, METH_VARARGS },
+	 { "arith_expr_new", _wrap_arith_expr_new, METH_VARARGS },
+	 { "arith_expr_del", _wrap_arith_expr_del, METH_VARARGS },
+	 { "arith_expr_add_cube", _wrap_arith_expr_add_cube, METH_VARARGS },
+	 { "arith_expr_add_const", _wrap_arith_expr_add_const, METH_VARARGS },
+	 { "arith_expr_parse", _wrap_arith_expr_parse, METH_VARARGS },
+	 { "arith_expr_eval_cube", _wrap_arith_expr_eval_cube, METH_VARARGS },
 	 { "average_engine", _wrap_average_engine, METH_VARARGS },
 	 { "cube_average", _wrap_cube_average, METH_VARARGS },
 	 { "cube_avg_linear", _wrap_cube_avg_linear, METH_VARARGS },
@@ -3632,6 +3728,7 @@ static swig_type_info _swigt__p_cube_info[] = {{"_p_cube_info", 0, "cube_info *"
 static swig_type_info _swigt__p_p_cube_t[] = {{"_p_p_cube_t", 0, "cube_t **"},{"_p_p_cube_t"},{0}};
 static swig_type_info _swigt__p_cube_t[] = {{"_p_cube_t", 0, "cube_t *"},{"_p_cube_t"},{0}};
 static swig_type_info _swigt__p_pixelmap[] = {{"_p_pixelmap", 0, "pixelmap *"},{"_p_pixelmap"},{0}};
+static swig_type_info _swigt__p_arith_expr[] = {{"_p_arith_expr", 0, "arith_expr *"},{"_p_arith_expr"},{0}};
 
 static swig_type_info *swig_types_initial[] = {
 _swigt__p_double3, 
@@ -3648,6 +3745,7 @@ _swigt__p_cube_info,
 _swigt__p_p_cube_t, 
 _swigt__p_cube_t, 
 _swigt__p_pixelmap, 
+_swigt__p_arith_expr, 
 0
 };
 
@@ -75,5 +75,6 @@ char *	xmemory_falloc(char *, size_t, size_t *, const char *, int) ;
 void    xmemory_fdealloc(void *, size_t, size_t, const char *, int) ;
 
 void xmemory_status_(const char * filename, int lineno) ;
+long xmemory_nalloc(void) ;
 
 #endif
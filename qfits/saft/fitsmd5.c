@@ -7,6 +7,11 @@
    @brief   Display/Add/Update the DATAMD5 keyword/value
    This is a stand-alone utility. Compile it with any ANSI C compiler:
    % cc -o fitsmd5 fitsmd5.c  [optional optimization options]
+
+   When compiled with -DHAVE_CONFIG_H against the qfits config.h, files
+   are processed concurrently on a pool of threads if HAS_PTHREADS is
+   defined there, i.e. if qfits was configured with --mt. Otherwise -j
+   is ignored with a warning.
 */
 /*----------------------------------------------------------------------------*/
 
@@ -21,14 +26,22 @@
                                 Includes
  -----------------------------------------------------------------------------*/
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <sys/mman.h>
+
+#ifdef HAS_PTHREADS
+#include <pthread.h>
+#endif
 
 /*-----------------------------------------------------------------------------
                 Support for gzipped files if linked against zlib.
@@ -75,12 +88,34 @@ static is_gzipped(char * filename)
 #define FITSCARDS		36	/* 36 cards per block		*/
 #define FITSBLOCKSZ		(FITSLINESZ*FITSCARDS)	/* FITS block size=2880 */
 
+/* Number of FITS blocks read at once: about 1 Mb per read */
+#define SCANBLOCKS		364
+#define SCANBUFSZ		(SCANBLOCKS*FITSBLOCKSZ)
+
 /* Definitions related to MD5 */
 #define MD5HASHSZ		32 /* an MD5 key length is 32 bytes = 128 bits */
 
 /* FITS keyword used to store MD5 key */
 #define FITSMD5KEY		"DATAMD5 "
- 
+
+/* FITS keywords used to store the standard checksums */
+#define FITSDATASUMKEY	"DATASUM "
+#define FITSCHECKSUMKEY	"CHECKSUM"
+#define FITSSUMKEYSZ	8
+#define CHECKSUMSZ		16	/* an encoded checksum is 16 chars */
+
+/* Hash functions */
+#define HASH_MD5		0	/* MD5, 128 bits				*/
+#define HASH_FAST		1	/* xxHash XXH32, 32 bits		*/
+
+/* Processing modes */
+#define MODE_HASH		0	/* hash data sections			*/
+#define MODE_CHECK		1	/* verify DATASUM/CHECKSUM		*/
+#define MODE_WRITE		2	/* write DATASUM/CHECKSUM		*/
+
+/* Maximal size of a report line */
+#define REPORTLINESZ	(FILENAME_MAX+512)
+
 /*-----------------------------------------------------------------------------
 								New types
  -----------------------------------------------------------------------------*/
@@ -94,6 +129,52 @@ struct MD5Context {
 	unsigned char in[64];
 };
 
+/* Streaming state of the XXH32 hash function */
+struct XXH32Context {
+	word32	total_len ;
+	int		large_len ;
+	word32	v[4] ;
+	unsigned char mem[16] ;
+	int		memsize ;
+};
+
+/* Either hash function */
+typedef struct _hash_ctx_ {
+	int					type ;
+	struct MD5Context	md5 ;
+	struct XXH32Context	xxh ;
+} hash_ctx ;
+
+/* Position and checksum-related contents of a FITS header/data unit */
+typedef struct _fits_hdu_ {
+	long	hdr_start ;		/* offset of the header in the file		*/
+	int		hdr_blocks ;	/* number of header blocks				*/
+	char *	hdr ;			/* header contents, in MODE_WRITE only	*/
+	int		end_card ;		/* index of the END card in the header	*/
+	int		datasum_card ;	/* index of the DATASUM card or -1		*/
+	int		checksum_card ;	/* index of the CHECKSUM card or -1		*/
+	char	datasum[FITSLINESZ+1] ;		/* DATASUM value in header	*/
+	char	checksum[FITSLINESZ+1] ;	/* CHECKSUM value in header	*/
+	word32	hdr_sum ;		/* 32-bit ones' complement header sum	*/
+	word32	data_sum ;		/* 32-bit ones' complement data sum		*/
+} fits_hdu ;
+
+/* Text output of the processing of one file */
+typedef struct _report_ {
+	char *	text ;
+	int		size ;
+	int		alloc ;
+} report ;
+
+/* One input file and its results */
+typedef struct _file_job_ {
+	char *	filename ;
+	report	out ;		/* to be printed on stdout	*/
+	report	err ;		/* to be printed on stderr	*/
+	int		nerr ;		/* number of errors			*/
+	int		done ;		/* set when processed		*/
+} file_job ;
+
 /*-----------------------------------------------------------------------------
 						Private function prototypes
  -----------------------------------------------------------------------------*/
@@ -104,9 +185,23 @@ static void MD5Final(unsigned char *, struct MD5Context *);
 static void MD5Transform(word32 *, word32 *);
 static void byteReverse(unsigned char *, unsigned);
 
-static int    fits_md5_check(char *, int);
-static char * fits_pretty_string(char *);
-static char * fits_getvalue(char *);
+static void XXH32Init(struct XXH32Context *);
+static void XXH32Update(struct XXH32Context *, unsigned char *, unsigned);
+static word32 XXH32Final(struct XXH32Context *);
+
+static void hash_init(hash_ctx *, int);
+static void hash_update(hash_ctx *, unsigned char *, unsigned);
+static void hash_final(hash_ctx *, char *);
+
+static word32 fits_sum_update(word32, unsigned char *, int);
+static word32 fits_sum_add(word32, word32);
+static void   fits_sum_encode(word32, char *);
+
+static char * fits_pretty_string(char *, char *);
+static char * fits_getvalue(char *, char *);
+
+static void report_printf(report *, char *, ...);
+static void process_file(file_job *);
 
 static void usage(void);
 
@@ -118,6 +213,12 @@ static char * pname = NULL ;
 static char prog_desc[] = "Compute/Update the DATAMD5 keyword/value" ;
 static int silent_process=0 ;
 
+/* Processing options, set once before processing starts */
+static int update_header=0 ;
+static int total_md5=0 ;
+static int hash_type=HASH_MD5 ;
+static int mode=MODE_HASH ;
+
 /*-----------------------------------------------------------------------------
 							MD5 function code
  -----------------------------------------------------------------------------*/
@@ -328,15 +429,261 @@ static void MD5Transform(word32 buf[4], word32 in[16])
     buf[3] += d;
 }
 
+/*-----------------------------------------------------------------------------
+							XXH32 function code
+ -----------------------------------------------------------------------------*/
+
+/*
+ * xxHash XXH32, seed 0. Much faster than MD5 and good enough to tell
+ * files apart, but not a cryptographic hash. Only 32-bit arithmetic is
+ * needed, so this works with any ANSI C compiler.
+ */
+#define XXH_PRIME1	2654435761U
+#define XXH_PRIME2	2246822519U
+#define XXH_PRIME3	3266489917U
+#define XXH_PRIME4	668265263U
+#define XXH_PRIME5	374761393U
+
+#define XXH_ROTL(x,r)	(((x) << (r)) | ((x) >> (32 - (r))))
+
+/* Read a little-endian 32-bit word */
+static word32 XXH32Read(unsigned char * p)
+{
+	return (word32)p[0] | ((word32)p[1]<<8) |
+		   ((word32)p[2]<<16) | ((word32)p[3]<<24) ;
+}
+
+static word32 XXH32Round(word32 acc, word32 in)
+{
+	acc += in * XXH_PRIME2 ;
+	acc  = XXH_ROTL(acc, 13) ;
+	acc *= XXH_PRIME1 ;
+	return acc ;
+}
+
+static void XXH32Init(struct XXH32Context * ctx)
+{
+	ctx->total_len = 0 ;
+	ctx->large_len = 0 ;
+	ctx->v[0] = XXH_PRIME1 + XXH_PRIME2 ;
+	ctx->v[1] = XXH_PRIME2 ;
+	ctx->v[2] = 0 ;
+	ctx->v[3] = 0 - XXH_PRIME1 ;
+	ctx->memsize = 0 ;
+}
+
+static void XXH32Update(struct XXH32Context * ctx, unsigned char * buf,
+		unsigned len)
+{
+	unsigned	fill ;
+
+	ctx->total_len += (word32)len ;
+	if (len>=16 || ctx->total_len>=16) ctx->large_len = 1 ;
+
+	/* Not enough for a full stripe: keep for later */
+	if (ctx->memsize + len < 16) {
+		memcpy(ctx->mem + ctx->memsize, buf, len);
+		ctx->memsize += len ;
+		return ;
+	}
+	/* Complete the pending stripe */
+	if (ctx->memsize>0) {
+		fill = 16 - ctx->memsize ;
+		memcpy(ctx->mem + ctx->memsize, buf, fill);
+		ctx->v[0] = XXH32Round(ctx->v[0], XXH32Read(ctx->mem));
+		ctx->v[1] = XXH32Round(ctx->v[1], XXH32Read(ctx->mem+4));
+		ctx->v[2] = XXH32Round(ctx->v[2], XXH32Read(ctx->mem+8));
+		ctx->v[3] = XXH32Round(ctx->v[3], XXH32Read(ctx->mem+12));
+		buf += fill ;
+		len -= fill ;
+		ctx->memsize = 0 ;
+	}
+	/* Process data in 16-byte stripes */
+	while (len>=16) {
+		ctx->v[0] = XXH32Round(ctx->v[0], XXH32Read(buf));
+		ctx->v[1] = XXH32Round(ctx->v[1], XXH32Read(buf+4));
+		ctx->v[2] = XXH32Round(ctx->v[2], XXH32Read(buf+8));
+		ctx->v[3] = XXH32Round(ctx->v[3], XXH32Read(buf+12));
+		buf += 16 ;
+		len -= 16 ;
+	}
+	/* Keep remaining bytes */
+	if (len>0) {
+		memcpy(ctx->mem, buf, len);
+		ctx->memsize = (int)len ;
+	}
+}
+
+static word32 XXH32Final(struct XXH32Context * ctx)
+{
+	unsigned char	*	p ;
+	int					n ;
+	word32				h ;
+
+	if (ctx->large_len) {
+		h = XXH_ROTL(ctx->v[0], 1)  + XXH_ROTL(ctx->v[1], 7) +
+			XXH_ROTL(ctx->v[2], 12) + XXH_ROTL(ctx->v[3], 18) ;
+	} else {
+		h = ctx->v[2] + XXH_PRIME5 ;
+	}
+	h += ctx->total_len ;
+
+	p = ctx->mem ;
+	n = ctx->memsize ;
+	while (n>=4) {
+		h += XXH32Read(p) * XXH_PRIME3 ;
+		h  = XXH_ROTL(h, 17) * XXH_PRIME4 ;
+		p += 4 ;
+		n -= 4 ;
+	}
+	while (n>0) {
+		h += (word32)(*p) * XXH_PRIME5 ;
+		h  = XXH_ROTL(h, 11) * XXH_PRIME1 ;
+		p++ ;
+		n-- ;
+	}
+	h ^= h >> 15 ;
+	h *= XXH_PRIME2 ;
+	h ^= h >> 13 ;
+	h *= XXH_PRIME3 ;
+	h ^= h >> 16 ;
+	return h ;
+}
+
+/*-----------------------------------------------------------------------------
+							Generic hash functions
+ -----------------------------------------------------------------------------*/
+
+static void hash_init(hash_ctx * ctx, int type)
+{
+	ctx->type = type ;
+	if (type==HASH_FAST) {
+		XXH32Init(&ctx->xxh);
+	} else {
+		MD5Init(&ctx->md5);
+	}
+}
+
+static void hash_update(hash_ctx * ctx, unsigned char * buf, unsigned len)
+{
+	if (ctx->type==HASH_FAST) {
+		XXH32Update(&ctx->xxh, buf, len);
+	} else {
+		MD5Update(&ctx->md5, buf, len);
+	}
+}
+
+/* Write the hash into a string of at least MD5HASHSZ+1 chars */
+static void hash_final(hash_ctx * ctx, char * out)
+{
+	unsigned char	digest[16] ;
+
+	if (ctx->type==HASH_FAST) {
+		sprintf(out, "%08x", XXH32Final(&ctx->xxh));
+		return ;
+	}
+	MD5Final(digest, &ctx->md5);
+    sprintf(out,
+    "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
+    digest[ 0], digest[ 1], digest[ 2], digest[ 3], digest[ 4],
+    digest[ 5], digest[ 6], digest[ 7], digest[ 8], digest[ 9],
+    digest[10], digest[11], digest[12], digest[13], digest[14],
+    digest[15]);
+}
+
+/*-----------------------------------------------------------------------------
+							FITS checksum functions
+ -----------------------------------------------------------------------------*/
+
+/*
+ * 32-bit ones' complement sum of big-endian words, as defined for the
+ * DATASUM and CHECKSUM keywords. Both 16-bit halves are accumulated
+ * separately and carries are folded back at the end: size must be a
+ * multiple of 4 and small enough for the halves not to overflow (a
+ * FITS block is fine).
+ */
+static word32 fits_sum_update(word32 sum, unsigned char * buf, int size)
+{
+	word32	hi, lo ;
+	word32	hicarry, locarry ;
+	int		i ;
+
+	hi = sum >> 16 ;
+	lo = sum & 0xffff ;
+	for (i=0 ; i<size ; i+=4) {
+		hi += ((word32)buf[i]   << 8) | (word32)buf[i+1] ;
+		lo += ((word32)buf[i+2] << 8) | (word32)buf[i+3] ;
+	}
+	hicarry = hi >> 16 ;
+	locarry = lo >> 16 ;
+	while (hicarry || locarry) {
+		hi = (hi & 0xffff) + locarry ;
+		lo = (lo & 0xffff) + hicarry ;
+		hicarry = hi >> 16 ;
+		locarry = lo >> 16 ;
+	}
+	return (hi << 16) + lo ;
+}
+
+/* Ones' complement addition of two 32-bit sums */
+static word32 fits_sum_add(word32 a, word32 b)
+{
+	word32	s ;
+
+	s = a + b ;
+	if (s<a) s++ ;
+	return s ;
+}
+
+/*
+ * Encode a 32-bit sum into 16 ASCII characters, avoiding punctuation
+ * characters (standard FITS checksum encoding).
+ */
+static void fits_sum_encode(word32 value, char * ascii)
+{
+	static int	exclude[] = { 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f, 0x40,
+							  0x5b, 0x5c, 0x5d, 0x5e, 0x5f, 0x60 } ;
+	int			nexclude = (int)(sizeof(exclude)/sizeof(exclude[0])) ;
+	char		asc[CHECKSUMSZ] ;
+	int			ch[4] ;
+	int			byte, quotient, remainder ;
+	int			check ;
+	int			i, j, k ;
+
+	for (i=0 ; i<4 ; i++) {
+		byte = (int)((value >> (24-8*i)) & 0xff) ;
+		quotient  = byte / 4 + 0x30 ;
+		remainder = byte % 4 ;
+		for (j=0 ; j<4 ; j++) ch[j] = quotient ;
+		ch[0] += remainder ;
+		do {
+			check = 0 ;
+			for (k=0 ; k<nexclude ; k++) {
+				for (j=0 ; j<4 ; j+=2) {
+					if (ch[j]==exclude[k] || ch[j+1]==exclude[k]) {
+						ch[j]++ ;
+						ch[j+1]-- ;
+						check++ ;
+					}
+				}
+			}
+		} while (check) ;
+		for (j=0 ; j<4 ; j++) asc[4*j+i] = (char)ch[j] ;
+	}
+	/* Rotate right by one character */
+	for (i=0 ; i<CHECKSUMSZ ; i++) {
+		ascii[i] = asc[(i+CHECKSUMSZ-1)%CHECKSUMSZ] ;
+	}
+	ascii[CHECKSUMSZ] = (char)0 ;
+}
 
 /*-----------------------------------------------------------------------------
 							FITS-related functions
  -----------------------------------------------------------------------------*/
 
-/* Pretty-print a FITS string value */
-static char * fits_pretty_string(char * s)
+/* Pretty-print a FITS string value into pretty (FITSLINESZ+1 chars) */
+static char * fits_pretty_string(char * s, char * pretty)
 {
-    static char     pretty[FITSLINESZ+1] ;
     int             i,j ;
 
     if (s==NULL) return NULL ;
@@ -369,16 +716,17 @@ static char * fits_pretty_string(char * s)
     return pretty;
 }
 
-/* Get the FITS value in a FITS card */
-static char * fits_getvalue(char * line)
+/* Get the FITS value in a FITS card into value (FITSLINESZ+1 chars) */
+static char * fits_getvalue(char * line, char * value)
 {
-    static char value[FITSLINESZ+1] ;
+    char        pretty[FITSLINESZ+1] ;
     int         from, to ;
     int         inq ;
     int         i ;
 
     if (line==NULL) return NULL ;
     memset(value, 0, FITSLINESZ+1);
+    memset(pretty, 0, FITSLINESZ+1);
     /* Get past the keyword */
     i=0 ;
     while (line[i]!='=' && i<FITSLINESZ) i++ ;
@@ -409,293 +757,545 @@ static char * fits_getvalue(char * line)
      * Make it pretty: remove head and tail quote, change double
      * quotes to simple ones.
      */
-    strcpy(value, fits_pretty_string(value));
+    if (value[0]=='\'') strcpy(value, fits_pretty_string(value, pretty));
     return value ;
 }
 
-/* Replace the MD5 card in the input header */
-static int fits_replace_card(char * filename, int off_md5, char * datamd5)
+/* Build a FITS card holding a string value, blank-padded to 80 chars */
+static void fits_make_card(char * card, char * key, char * value,
+		char * comment)
 {
-	char	*	buf ;
-	int			fd ;
-	struct stat	sta ;
-	char		card[FITSLINESZ];
-	int			i ;
-	int			err ;
+	char	line[FITSLINESZ*2] ;
+	int		i ;
 
-	/* Get file size */
-	if (stat(filename, &sta)==-1) {
-		fprintf(stderr, "%s: cannot stat file [%s]: no update done\n",
-				pname,
-				filename);
-		return 1 ;
-	}
-	/* Open file */
-	fd = open(filename, O_RDWR);
+	sprintf(line, "%-8.8s= '%s' / %s", key, value, comment);
+	for (i=(int)strlen(line) ; i<FITSLINESZ ; i++) line[i]=' ';
+	memcpy(card, line, FITSLINESZ);
+}
+
+/* Write a memory area at a given offset in a file. Returns 0 if Ok. */
+static int fits_write_at(file_job * job, long off, char * buf, int size)
+{
+	int		fd ;
+	int		err ;
+
+	fd = open(job->filename, O_RDWR);
 	if (fd==-1) {
-		fprintf(stderr,
+		report_printf(&job->err,
 				"%s: cannot open file [%s] for modification: no update done\n",
 				pname,
-				filename);
-		return 1 ;
-	}
-	/* Memory-map the file */
-	buf = (char*)mmap(0,
-					  sta.st_size,
-					  PROT_READ | PROT_WRITE,
-					  MAP_SHARED,
-					  fd,
-					  0);
-	if (buf==(char*)-1 || buf==NULL) {
-		perror("mmap");
-		close(fd);
+				job->filename);
 		return 1 ;
 	}
-	/* sprintf should be safe, the MD5 signature size is 32 chars */
-	sprintf(card, "%s= '%s' / data MD5 signature", FITSMD5KEY, datamd5);
-	i=FITSLINESZ-1 ;
-	while (card[i]!='e') {
-		card[i]=' ';
-		i-- ;
-	}
-	/* Copy card into file */
-	memcpy(buf+off_md5, card, FITSLINESZ);
-	/* flush output, unmap buffer, close file and quit */
 	err=0 ;
-	sync();
-	if (close(fd)==-1) {
-		fprintf(stderr, "%s: error closing modified file [%s]",
+	if (lseek(fd, (off_t)off, SEEK_SET)==(off_t)-1 ||
+		write(fd, buf, size)!=size) {
+		report_printf(&job->err, "%s: error writing to file [%s]\n",
 				pname,
-				filename);
+				job->filename);
 		err++ ;
 	}
-	if (munmap(buf, sta.st_size)==-1) {
-		perror("munmap");
+	/* Only flush this file, not the whole system */
+	if (fsync(fd)==-1) err++ ;
+	if (close(fd)==-1) {
+		report_printf(&job->err, "%s: error closing modified file [%s]\n",
+				pname,
+				job->filename);
 		err++ ;
 	}
-	return err;
+	return err ;
+}
+
+/* Replace the MD5 card in the input header */
+static int fits_replace_card(file_job * job, long off_md5, char * datamd5)
+{
+	char		card[FITSLINESZ];
+
+	fits_make_card(card, FITSMD5KEY, datamd5, "data MD5 signature");
+	return fits_write_at(job, off_md5, card, FITSLINESZ);
+}
+
+/* Set a string-valued card in a header, inserting it before END if needed */
+static int fits_hdu_setcard(fits_hdu * hdu, int * card_index, char * key,
+		char * value, char * comment)
+{
+	char	*	end ;
+
+	if (*card_index<0) {
+		/* Need a blank card after END in the last header block */
+		if (hdu->end_card+1 >= hdu->hdr_blocks*FITSCARDS) return 1 ;
+		end = hdu->hdr + hdu->end_card*FITSLINESZ ;
+		memcpy(end+FITSLINESZ, end, FITSLINESZ);
+		*card_index = hdu->end_card ;
+		hdu->end_card++ ;
+	}
+	fits_make_card(hdu->hdr + (*card_index)*FITSLINESZ, key, value, comment);
+	return 0 ;
+}
+
+/* Examine a header block, returns 1 if it contains the END card */
+static int fits_scan_header(fits_hdu * hdu, char * blk, int nblock,
+		char * hdrmd5, long * off_md5)
+{
+	char	*	card ;
+	int			i ;
+
+	for (i=0 ; i<FITSCARDS ; i++) {
+		card = blk + i*FITSLINESZ ;
+		/* Try to locate MD5 keyword if not located already */
+		if (mode==MODE_HASH) {
+			if (hdrmd5[0]==(char)0 &&
+				!strncmp(card, FITSMD5KEY, FITSSUMKEYSZ)) {
+				if (fits_getvalue(card, hdrmd5)==NULL) hdrmd5[0]=(char)0 ;
+				*off_md5 = hdu->hdr_start + (long)(nblock*FITSBLOCKSZ) +
+						   (long)(i*FITSLINESZ) ;
+			}
+		} else if (!strncmp(card, FITSDATASUMKEY, FITSSUMKEYSZ)) {
+			hdu->datasum_card = nblock*FITSCARDS + i ;
+			fits_getvalue(card, hdu->datasum);
+		} else if (!strncmp(card, FITSCHECKSUMKEY, FITSSUMKEYSZ)) {
+			hdu->checksum_card = nblock*FITSCARDS + i ;
+			fits_getvalue(card, hdu->checksum);
+		}
+		/* Try to locate an END key */
+		if (card[0]=='E' &&
+			card[1]=='N' &&
+			card[2]=='D' &&
+			card[3]==' ') {
+			hdu->end_card = nblock*FITSCARDS + i ;
+			return 1 ;
+		}
+	}
+	return 0 ;
+}
+
+/* Report or update the DATASUM/CHECKSUM values. Returns the number of errors */
+static int fits_checksums(file_job * job, fits_hdu * hdus, int nhdu)
+{
+	fits_hdu	*	hdu ;
+	char			datasum[FITSLINESZ+1] ;
+	char			checksum[CHECKSUMSZ+1] ;
+	char		*	datasum_status ;
+	char		*	checksum_status ;
+	word32			sum ;
+	int				err ;
+	int				i, j ;
+
+	err=0 ;
+	for (i=0 ; i<nhdu ; i++) {
+		hdu = hdus+i ;
+		sprintf(datasum, "%u", hdu->data_sum);
+		if (mode==MODE_CHECK) {
+			sum = fits_sum_add(hdu->hdr_sum, hdu->data_sum) ;
+			if (hdu->checksum_card<0) {
+				checksum_status = "missing" ;
+			} else if (sum==0xffffffff || sum==0) {
+				/* Both are zero in ones' complement arithmetic */
+				checksum_status = "ok" ;
+			} else {
+				checksum_status = "wrong" ;
+				err++ ;
+			}
+			if (hdu->datasum_card<0) {
+				datasum_status = "missing" ;
+			} else if ((word32)strtoul(hdu->datasum, NULL, 10) ==
+					   hdu->data_sum) {
+				datasum_status = "ok" ;
+			} else {
+				datasum_status = "wrong" ;
+				err++ ;
+			}
+			if (!silent_process) {
+				report_printf(&job->out, "%s  HDU %d  CHECKSUM %s  DATASUM %s\n",
+						job->filename, i, checksum_status, datasum_status);
+			}
+			continue ;
+		}
+		/*
+		 * MODE_WRITE: CHECKSUM is computed with a zero-valued CHECKSUM
+		 * card in the header, then replaced by the encoded complement of
+		 * the HDU sum so that the sum of the final HDU is -0.
+		 */
+		strcpy(checksum, "0000000000000000");
+		if (fits_hdu_setcard(hdu, &hdu->checksum_card, FITSCHECKSUMKEY,
+					checksum, "HDU checksum") ||
+			fits_hdu_setcard(hdu, &hdu->datasum_card, FITSDATASUMKEY,
+					datasum, "data unit checksum")) {
+			report_printf(&job->err,
+					"%s: no room for checksums in HDU %d of [%s]\n",
+					pname, i, job->filename);
+			err++ ;
+			continue ;
+		}
+		sum = 0 ;
+		for (j=0 ; j<hdu->hdr_blocks ; j++) {
+			sum = fits_sum_update(sum,
+					(unsigned char*)hdu->hdr + j*FITSBLOCKSZ, FITSBLOCKSZ);
+		}
+		sum = fits_sum_add(sum, hdu->data_sum) ;
+		fits_sum_encode(~sum, checksum);
+		fits_hdu_setcard(hdu, &hdu->checksum_card, FITSCHECKSUMKEY,
+				checksum, "HDU checksum");
+		if (fits_write_at(job, hdu->hdr_start, hdu->hdr,
+					hdu->hdr_blocks*FITSBLOCKSZ)) {
+			err++ ;
+			continue ;
+		}
+		if (!silent_process) {
+			report_printf(&job->out,
+					"%s  HDU %d  CHECKSUM %s  DATASUM %s  (updated)\n",
+					job->filename, i, checksum, datasum);
+		}
+	}
+	return err ;
 }
 
 /* Display or modify the DATAMD5 value. Returns the number of errors. */
-static int fits_md5_check(char * filename, int update_header)
+static int fits_md5_check(file_job * job)
 {
 	FILE		*	in ;
-	char			buf[FITSBLOCKSZ];
-	char	*		buf_c ;
-	int				i ;
+	unsigned char *	buf ;
+	char		*	blk ;
+	fits_hdu	*	hdus ;
+	fits_hdu	*	hdu ;
+	int				nhdu ;
+	int				nalloc ;
+	int				nblocks ;
 	int				in_header ;
-	char		*	hdrmd5 ;
-	struct MD5Context	ctx ;
-	unsigned char	digest[16] ;
-	static char		datamd5[MD5HASHSZ+1];
-	int				off_md5 ;
-	int				cur_off ;
-	int				md5keysz ;
+	char			hdrmd5[FITSLINESZ+1] ;
+	hash_ctx		ctx ;
+	char			datamd5[MD5HASHSZ+1];
+	long			off_md5 ;
+	long			cur_off ;
 	int				err ;
 	int				check_fits ;
+	int				i ;
 	struct stat		sta ;
 
-	if (filename==NULL) return 1 ;
-
 	/* Try to stat file */
-	if (stat(filename, &sta)!=0) {
-		fprintf(stderr, "%s: cannot stat file %s\n", pname, filename);
+	if (stat(job->filename, &sta)!=0) {
+		report_printf(&job->err, "%s: cannot stat file %s\n",
+				pname, job->filename);
 		return 1 ;
 	}
 	/* See if this is a regular file */
 	if (!S_ISREG(sta.st_mode)) {
-		fprintf(stderr, "%s: not a regular file: %s\n", pname, filename);
+		report_printf(&job->err, "%s: not a regular file: %s\n",
+				pname, job->filename);
 		return 1 ;
 	}
 	/* Open input file */
-	if ((in=fopen(filename, "r"))==NULL) {
-		fprintf(stderr, "%s: cannot open file [%s]\n", pname, filename);
+	if ((in=fopen(job->filename, "r"))==NULL) {
+		report_printf(&job->err, "%s: cannot open file [%s]\n",
+				pname, job->filename);
+		return 1 ;
+	}
+	if ((buf=malloc(SCANBUFSZ))==NULL) {
+		report_printf(&job->err, "%s: out of memory\n", pname);
+		fclose(in);
 		return 1 ;
 	}
 	/* Initialize all variables */
-	MD5Init(&ctx);
-	in_header=1 ;
-	hdrmd5=NULL ;
+	hash_init(&ctx, hash_type);
+	hdus = NULL ;
+	hdu = NULL ;
+	nhdu = 0 ;
+	nalloc = 0 ;
+	in_header=0 ;
+	hdrmd5[0]=(char)0 ;
 	off_md5=0;
 	cur_off=0;
-	md5keysz = (int)strlen(FITSMD5KEY) ;
 	check_fits=0 ;
-	/* Loop over input file */
-	while (fread(buf, 1, FITSBLOCKSZ, in)==FITSBLOCKSZ) {
-		/* First time in the loop: check the file is FITS */
-		if (check_fits==0) {
-			/* Examine first characters in block */
-			if (buf[0]!='S' ||
-				buf[1]!='I' ||
-				buf[2]!='M' ||
-				buf[3]!='P' ||
-				buf[4]!='L' ||
-				buf[5]!='E' ||
-				buf[6]!=' ' ||
-				buf[7]!=' ' ||
-				buf[8]!='=') {
-				fprintf(stderr, "%s: file [%s] is not FITS\n",
-						pname,
-						filename);
-				fclose(in);
-				return 1 ;
-			} else {
+	err=0 ;
+	/* Loop over input file, many blocks at a time */
+	while (err==0 &&
+		   (nblocks=(int)fread(buf, 1, SCANBUFSZ, in)/FITSBLOCKSZ)>0) {
+		for (i=0 ; i<nblocks && err==0 ; i++, cur_off+=FITSBLOCKSZ) {
+			blk = (char*)buf + i*FITSBLOCKSZ ;
+			/* First block: check the file is FITS */
+			if (check_fits==0) {
+				if (strncmp(blk, "SIMPLE  =", 9)) {
+					report_printf(&job->err, "%s: file [%s] is not FITS\n",
+							pname,
+							job->filename);
+					err++ ;
+					break ;
+				}
 				check_fits=1 ;
 			}
-		}
-		/* If current block is a header block */
-		if (in_header) {
-			buf_c = buf ;
-			for (i=0 ; i<FITSCARDS ; i++) {
-				/* Try to locate MD5 keyword if not located already */
-				if (hdrmd5==NULL) {
-					if (!strncmp(buf_c, FITSMD5KEY, md5keysz)) {
-						hdrmd5 = fits_getvalue(buf_c) ;
-						off_md5 = cur_off ;
+			/*
+			 * A new HDU starts with the main header or with a data
+			 * block beginning with XTENSION
+			 */
+			if (cur_off==0 ||
+				(!in_header && !strncmp(blk, "XTENSION=", 9))) {
+				if (nhdu==nalloc) {
+					nalloc = nalloc ? 2*nalloc : 4 ;
+					hdus = realloc(hdus, nalloc*sizeof(fits_hdu));
+					if (hdus==NULL) {
+						report_printf(&job->err, "%s: out of memory\n", pname);
+						err++ ;
+						nhdu = 0 ;
+						break ;
 					}
 				}
-				/* Try to locate an END key */
-                if (buf_c[0]=='E' &&
-                    buf_c[1]=='N' &&
-                    buf_c[2]=='D' &&
-                    buf_c[3]==' ') {
+				hdu = hdus + nhdu ;
+				nhdu++ ;
+				memset(hdu, 0, sizeof(fits_hdu));
+				hdu->hdr_start = cur_off ;
+				hdu->datasum_card = -1 ;
+				hdu->checksum_card = -1 ;
+				in_header=1 ;
+			}
+			if (in_header) {
+				if (fits_scan_header(hdu, blk, hdu->hdr_blocks, hdrmd5,
+							&off_md5)) {
 					in_header=0 ;
-					break ;
 				}
-				buf_c += FITSLINESZ ;
-				cur_off += FITSLINESZ ;
-			}
-		} else {
-			/* If current block is a data block */
-			/* Try to locate an extension header */
-            if (buf[0]=='X' &&
-                buf[1]=='T' &&
-                buf[2]=='E' &&
-                buf[3]=='N' &&
-                buf[4]=='S' &&
-                buf[5]=='I' &&
-                buf[6]=='O' &&
-                buf[7]=='N' &&
-                buf[8]=='=') {
-				in_header=1 ;
-				buf_c = buf ;
-				for (i=0 ; i<FITSCARDS ; i++) {
-					/* Try to find an END marker in this block */
-					if (buf_c[0]=='E' &&
-						buf_c[1]=='N' &&
-						buf_c[2]=='D' &&
-						buf_c[3]==' ') {
-						/* Found END marker in same block as XTENSION */
-						in_header=0 ;
+				if (mode!=MODE_HASH) {
+					hdu->hdr_sum = fits_sum_update(hdu->hdr_sum,
+							(unsigned char*)blk, FITSBLOCKSZ);
+				}
+				if (mode==MODE_WRITE) {
+					hdu->hdr = realloc(hdu->hdr,
+							(hdu->hdr_blocks+1)*FITSBLOCKSZ);
+					if (hdu->hdr==NULL) {
+						report_printf(&job->err, "%s: out of memory\n", pname);
+						err++ ;
 						break ;
 					}
-					buf_c += FITSLINESZ ;
+					memcpy(hdu->hdr + hdu->hdr_blocks*FITSBLOCKSZ, blk,
+							FITSBLOCKSZ);
 				}
+				hdu->hdr_blocks++ ;
+			} else if (mode==MODE_HASH) {
+				/* Data block: accumulate for hash */
+				hash_update(&ctx, (unsigned char *)blk, FITSBLOCKSZ);
 			} else {
-				/* Data block: accumulate for MD5 */
-				MD5Update(&ctx, (unsigned char *)buf, FITSBLOCKSZ);
+				hdu->data_sum = fits_sum_update(hdu->data_sum,
+						(unsigned char*)blk, FITSBLOCKSZ);
 			}
 		}
 	}
 	fclose(in);
-	if (check_fits==0) {
+	free(buf);
+	if (err==0 && check_fits==0) {
 		/* Never went through the read loop: file is not FITS */
-		fprintf(stderr, "%s: file [%s] is not FITS\n",
+		report_printf(&job->err, "%s: file [%s] is not FITS\n",
 				pname,
-				filename);
-		return 1 ;
+				job->filename);
+		err++ ;
 	}
-	/* Got to the end of file: summarize */
-	MD5Final(digest, &ctx);
+	if (err==0 && mode!=MODE_HASH) {
+#if HAVE_ZLIB
+		if (mode==MODE_WRITE && is_gzipped(job->filename)) {
+			report_printf(&job->err,
+					"%s: cannot update header in gzipped file\n", pname);
+			err++ ;
+		} else
+#endif
+		err = fits_checksums(job, hdus, nhdu);
+	}
+	for (i=0 ; i<nhdu ; i++) {
+		if (hdus[i].hdr!=NULL) free(hdus[i].hdr);
+	}
+	if (hdus!=NULL) free(hdus);
+	if (err || mode!=MODE_HASH) return err ;
 
-    /* Write digest into a string */
-    sprintf(datamd5,
-    "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
-    digest[ 0], digest[ 1], digest[ 2], digest[ 3], digest[ 4],
-    digest[ 5], digest[ 6], digest[ 7], digest[ 8], digest[ 9],
-    digest[10], digest[11], digest[12], digest[13], digest[14],
-    digest[15]);
+	/* Got to the end of file: summarize */
+	hash_final(&ctx, datamd5);
 	if (!silent_process) {
-        printf("%s  %s", datamd5, filename);
-        if (hdrmd5) {
-            if (!strcmp(hdrmd5, datamd5)) {
-                printf(" (header Ok)");
-            } else {
-                printf(" (header is wrong)");
-            }
-        }
-        printf("\n");
+		report_printf(&job->out, "%s  %s", datamd5, job->filename);
+		/* Only an MD5 can be compared to DATAMD5 */
+		if (hdrmd5[0]!=(char)0 && hash_type==HASH_MD5) {
+			if (!strcmp(hdrmd5, datamd5)) {
+				report_printf(&job->out, " (header Ok)");
+			} else {
+				report_printf(&job->out, " (header is wrong)");
+			}
+		}
+		report_printf(&job->out, "\n");
 	}
 	/* Update header if requested */
-	err=0 ;
 	if (update_header) {
-		if (hdrmd5==NULL) {
-			fprintf(stderr, "%s: cannot update header: missing %s\n",
+		if (hdrmd5[0]==(char)0) {
+			report_printf(&job->err, "%s: cannot update header: missing %s\n",
 					pname,
 					FITSMD5KEY);
 			return 1 ;
 		}
 #if HAVE_ZLIB
-        if (is_gzipped(filename)) {
-            fprintf(stderr, "%s: cannot update header in gzipped file\n");
+        if (is_gzipped(job->filename)) {
+            report_printf(&job->err,
+					"%s: cannot update header in gzipped file\n", pname);
             return 1 ;
         }
 #endif
-		err = fits_replace_card(filename, off_md5, datamd5);
+		err = fits_replace_card(job, off_md5, datamd5);
 	}
 	return err ;
 }
 
 
-/* Compute MD5 sum on the whole file and print out results on stdout */
-static int compute_md5(char * filename)
+/* Compute the hash of the whole file */
+static int compute_md5(file_job * job)
 {
-	struct MD5Context	ctx ;
-	unsigned char		digest[16] ;
+	hash_ctx			ctx ;
+	char				hash[MD5HASHSZ+1] ;
 	struct stat			sta ;
-	int					fd ;
+	FILE			*	in ;
 	unsigned char	*	buf ;
+	int					nread ;
 
 	/* Try to stat file */
-	if (stat(filename, &sta)!=0) {
-		fprintf(stderr, "%s: cannot stat file %s\n", pname, filename);
+	if (stat(job->filename, &sta)!=0) {
+		report_printf(&job->err, "%s: cannot stat file %s\n",
+				pname, job->filename);
 		return 1 ;
 	}
 	/* See if this is a regular file */
 	if (!S_ISREG(sta.st_mode)) {
-		fprintf(stderr, "%s: not a regular file: %s\n", pname, filename);
+		report_printf(&job->err, "%s: not a regular file: %s\n",
+				pname, job->filename);
 		return 1 ;
 	}
 	/* Open file */
-	if ((fd = open(filename, O_RDONLY))==-1) {
-		fprintf(stderr, "%s: cannot open file %s\n", pname, filename);
+	if ((in=fopen(job->filename, "r"))==NULL) {
+		report_printf(&job->err, "%s: cannot open file %s\n",
+				pname, job->filename);
 		return 1 ;
 	}
-	/* Memory-map the file */
-	buf = (unsigned char*)mmap(0, sta.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-	if (buf==(unsigned char*)-1 || buf==NULL) {
-		perror("mmap");
-		close(fd);
+	if ((buf=malloc(SCANBUFSZ))==NULL) {
+		report_printf(&job->err, "%s: out of memory\n", pname);
+		fclose(in);
 		return 1 ;
 	}
-	/* Initialize MD5 context */
-	MD5Init(&ctx);
-	/* Compute MD5 on all bits in the file */
-	MD5Update(&ctx, buf, sta.st_size);
+	/* Hash all bits in the file, one buffer at a time */
+	hash_init(&ctx, hash_type);
+	while ((nread=(int)fread(buf, 1, SCANBUFSZ, in))>0) {
+		hash_update(&ctx, buf, (unsigned)nread);
+	}
+	fclose(in);
+	free(buf);
 	/* Finalize and print results */
-	close(fd);
-	munmap((char*)buf, sta.st_size);
-	MD5Final(digest, &ctx);
-    printf(
-    "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x  %s\n",
-    digest[ 0], digest[ 1], digest[ 2], digest[ 3], digest[ 4],
-    digest[ 5], digest[ 6], digest[ 7], digest[ 8], digest[ 9],
-    digest[10], digest[11], digest[12], digest[13], digest[14],
-    digest[15],
-	filename);
+	hash_final(&ctx, hash);
+	report_printf(&job->out, "%s  %s\n", hash, job->filename);
 	return 0 ;
 }
 
+/*-----------------------------------------------------------------------------
+							Parallel processing
+ -----------------------------------------------------------------------------*/
+
+/* Append formatted text to a report */
+static void report_printf(report * rep, char * fmt, ...)
+{
+	char		line[REPORTLINESZ] ;
+	va_list		ap ;
+	int			len ;
+
+	va_start(ap, fmt);
+	vsprintf(line, fmt, ap);
+	va_end(ap);
+	len = (int)strlen(line) ;
+	if (rep->size+len+1 > rep->alloc) {
+		rep->alloc = 2*(rep->size+len+1) ;
+		rep->text = realloc(rep->text, rep->alloc);
+		if (rep->text==NULL) {
+			rep->size = rep->alloc = 0 ;
+			return ;
+		}
+	}
+	strcpy(rep->text+rep->size, line);
+	rep->size += len ;
+}
+
+static void process_file(file_job * job)
+{
+	if (total_md5) {
+		job->nerr = compute_md5(job);
+	} else {
+		job->nerr = fits_md5_check(job);
+	}
+}
+
+/* Print out the results of a job in the order of the command line */
+static int flush_job(file_job * job)
+{
+	if (job->err.text!=NULL) {
+		fputs(job->err.text, stderr);
+		free(job->err.text);
+	}
+	if (job->out.text!=NULL) {
+		fputs(job->out.text, stdout);
+		free(job->out.text);
+	}
+	fflush(stdout);
+	return job->nerr ;
+}
+
+#ifdef HAS_PTHREADS
+static pthread_mutex_t	jobs_mutex = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t	jobs_cond  = PTHREAD_COND_INITIALIZER ;
+static file_job		*	jobs_list ;
+static int				jobs_count ;
+static int				jobs_next ;
+
+/* Worker thread: process files until there are none left */
+static void * jobs_worker(void * arg)
+{
+	int		i ;
+
+	while (1) {
+		pthread_mutex_lock(&jobs_mutex);
+		i = jobs_next++ ;
+		pthread_mutex_unlock(&jobs_mutex);
+		if (i>=jobs_count) break ;
+		process_file(jobs_list+i);
+		pthread_mutex_lock(&jobs_mutex);
+		jobs_list[i].done = 1 ;
+		pthread_cond_broadcast(&jobs_cond);
+		pthread_mutex_unlock(&jobs_mutex);
+	}
+	return NULL ;
+}
+
+/* Process all files on nthreads threads. Returns the number of errors. */
+static int process_parallel(file_job * jobs, int njobs, int nthreads)
+{
+	pthread_t	*	tids ;
+	int				nstarted ;
+	int				err ;
+	int				i ;
+
+	jobs_list = jobs ;
+	jobs_count = njobs ;
+	jobs_next = 0 ;
+	if ((tids=malloc(nthreads*sizeof(pthread_t)))==NULL) return -1 ;
+	nstarted=0 ;
+	for (i=0 ; i<nthreads ; i++) {
+		if (pthread_create(tids+nstarted, NULL, jobs_worker, NULL)==0) {
+			nstarted++ ;
+		}
+	}
+	if (nstarted==0) {
+		free(tids);
+		return -1 ;
+	}
+	/* Print out results as soon as they are available, in order */
+	err=0 ;
+	for (i=0 ; i<njobs ; i++) {
+		pthread_mutex_lock(&jobs_mutex);
+		while (!jobs[i].done) pthread_cond_wait(&jobs_cond, &jobs_mutex);
+		pthread_mutex_unlock(&jobs_mutex);
+		err += flush_job(jobs+i);
+	}
+	for (i=0 ; i<nstarted ; i++) pthread_join(tids[i], NULL);
+	free(tids);
+	return err ;
+}
+#endif
+
 static void usage(void)
 {
 	printf(
@@ -705,25 +1305,51 @@ static void usage(void)
 		prog_desc);
     printf(
 		"\n"
-		"use : %s [-u] [-s] [-a] <FITS files...>\n"
+		"use : %s [-u] [-s] [-a] [-x] [-c] [-C] [-j n] <FITS files...>\n"
 		"options are:\n"
 		"\t-u   update MD5 keyword in the file: %s\n"
 		"\t-s   silent mode\n"
+		"\t-x   use the fast XXH32 hash instead of MD5\n"
+		"\t-j n process n files at the same time\n"
 		"\n"
 		"\t-a   compute MD5 sum of the complete file (incl.header)\n"
 		"\n"
+		"\t-c   verify DATASUM and CHECKSUM in all HDUs\n"
+		"\t-C   compute and write DATASUM and CHECKSUM in all HDUs\n"
+		"\n", pname, FITSMD5KEY) ;
+    printf(
 		"This utility computes the MD5 checksum of all data sections\n"
 		"in a given FITS file, and compares it against the value\n"
 		"declared in DATAMD5 if present. It can also update the value\n"
 		"of this keyword (if present) with its own computed MD5 sum.\n"
-		"\n", pname, FITSMD5KEY) ;
+		"\n") ;
     printf(
 		"You can also use it with the -a option to compute the MD5 sum\n"
 		"on the complete file (all bits). In this case, the file needs\n"
 		"not be FITS. This option is only provided to check this program\n"
 		"against other MD5 computation tools.\n"
-		"NB: Other options cannot be used together with -a.\n"
+		"NB: -u, -c and -C cannot be used together with -a.\n"
+		"\n");
+    printf(
+		"With -x, a much faster 32-bit non-cryptographic hash is used\n"
+		"to identify files. It cannot be stored in %s.\n"
+		"\n"
+		"The -c and -C options handle the standard FITS checksum keywords\n"
+		"instead of %s. With -C, the keywords are replaced if present,\n"
+		"or added before END if there is room left in the header.\n"
+		"\n", FITSMD5KEY, FITSMD5KEY);
+#ifdef HAS_PTHREADS
+    printf(
+		"By default, as many files as there are processors are processed\n"
+		"at the same time. Results are output in command-line order.\n"
+		"\n");
+#else
+    printf(
+		"This program was compiled without thread support (configure\n"
+		"qfits with --mt): files are processed one at a time and -j is\n"
+		"ignored.\n"
 		"\n");
+#endif
 
 #if HAVE_ZLIB
     printf(
@@ -742,23 +1368,28 @@ static void usage(void)
 }
 
 /*-----------------------------------------------------------------------------
-                                    Main 
+                                    Main
  -----------------------------------------------------------------------------*/
 int main(int argc, char *argv[])
 {
-	int			i ;
-	int			update_header ;
-	int			total_md5 ;
-	int			err ;
+	file_job	*	jobs ;
+	int				njobs ;
+	int				nthreads ;
+	int				i ;
+	int				err ;
 
     /* Initialize */
 	pname=argv[0];
-	update_header = 0 ;
-	total_md5 = 0 ;
+	nthreads = 0 ;
 
 	if (argc<2) usage();
-	
-    /* Parse arguments for options */
+
+	if ((jobs=calloc(argc, sizeof(file_job)))==NULL) {
+		fprintf(stderr, "%s: out of memory\n", pname);
+		return 1 ;
+	}
+    /* Parse arguments for options, anything else is an input file */
+	njobs=0 ;
 	for (i=1 ; i<argc ; i++) {
 		if (!strcmp(argv[i], "-u")) {
 			update_header=1 ;
@@ -766,23 +1397,65 @@ int main(int argc, char *argv[])
 			silent_process=1;
 		} else if (!strcmp(argv[i], "-a")) {
 			total_md5=1 ;
+		} else if (!strcmp(argv[i], "-x")) {
+			hash_type=HASH_FAST ;
+		} else if (!strcmp(argv[i], "-c")) {
+			mode=MODE_CHECK ;
+		} else if (!strcmp(argv[i], "-C")) {
+			mode=MODE_WRITE ;
+		} else if (!strcmp(argv[i], "-j") && i<argc-1) {
+			nthreads = atoi(argv[++i]) ;
+		} else if (strlen(argv[i])>FILENAME_MAX) {
+			fprintf(stderr, "%s: file name too long: %s\n", pname, argv[i]);
+			free(jobs);
+			return 1 ;
+		} else {
+			jobs[njobs++].filename = argv[i] ;
 		}
 	}
+	if ((total_md5 || update_header) && mode!=MODE_HASH) {
+		fprintf(stderr, "%s: -c and -C cannot be used with -a or -u\n",
+				pname);
+		free(jobs);
+		return 1 ;
+	}
+	if (update_header && hash_type!=HASH_MD5) {
+		fprintf(stderr, "%s: -u cannot be used with -x\n", pname);
+		free(jobs);
+		return 1 ;
+	}
+#ifndef HAS_PTHREADS
+	if (nthreads>1) {
+		fprintf(stderr, "%s: compiled without thread support, -j ignored\n",
+				pname);
+	}
+#endif
+	/* Default: one thread per processor */
+	if (nthreads<1) {
+		nthreads = 1 ;
+#if defined(HAS_PTHREADS) && defined(_SC_NPROCESSORS_ONLN)
+		nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN) ;
+		if (nthreads<1) nthreads = 1 ;
+#endif
+	}
+	if (nthreads>njobs) nthreads = njobs ;
+
 	/* Loop on input file names */
-	err=0 ;
-	for (i=1 ; i<argc ; i++) {
-		/* If not a command-line option */
-		if (strcmp(argv[i], "-u") &&
-			strcmp(argv[i], "-s") &&
-			strcmp(argv[i], "-a")) {
-			/* Launch MD5 process on this file */
-			if (total_md5) {
-				err+=compute_md5(argv[i]);
-			} else {
-				err += fits_md5_check(argv[i], update_header);
-			}
+	err=-1 ;
+#ifdef HAS_PTHREADS
+	if (nthreads>1) {
+		err = process_parallel(jobs, njobs, nthreads);
+	}
+#endif
+	if (err<0) {
+		/* Sequential processing */
+		err=0 ;
+		for (i=0 ; i<njobs ; i++) {
+			process_file(jobs+i);
+			err += flush_job(jobs+i);
 		}
 	}
+	free(jobs);
 	if (err>0) {
 		fprintf(stderr, "%s: %d error(s) during process\n", pname, err);
 	}
@@ -29,6 +29,13 @@
    would litterally print out (\t stands for tab, \n for linefeed):
    file1.fits\t200\t100\n
    file2.fits\t\t20\n
+
+   In batch mode (-F), fitsort reads the main headers itself from a list of
+   files, several files at a time when compiled with thread support (qfits
+   configured with --mt, otherwise -j is ignored with a warning), and can
+   keep them in a header index (-i) for later queries:
+
+   ls *.fits | fitsort -i archive.idx -F - NAXIS1 DPR.CATG
 */
 /*----------------------------------------------------------------------------*/
 
@@ -43,35 +50,70 @@
                                 Include
  -----------------------------------------------------------------------------*/
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#ifdef HAS_PTHREADS
+#include <pthread.h>
+#endif
 
 /*-----------------------------------------------------------------------------
                                 Define
  -----------------------------------------------------------------------------*/
 
-#define MAX_STRING  128        
-#define MAX_KEY     512       
+#define MAX_STRING  128
+#define MAX_KEY     512
 #define FMT_STRING  "%%-%ds\t"
 
+#define BLOCK_SIZE  2880
+#define LGTH        80
+#define MAGIC       "SIMPLE  ="
+
+/* First line of a header index file */
+#define INDEX_MAGIC "fitsort index 1\n"
+
 /*-----------------------------------------------------------------------------
-                                New types   
+                                New types
  -----------------------------------------------------------------------------*/
 
-/* This holds a keyword value and a flag to indicate its presence   */
-typedef struct _KEYWORD_ {
-    char    value[MAX_STRING] ;
-    int     present ;
-} keyword ;
-
 /* Each detected file in input has such an associated structure */
 typedef struct _RECORD_ {
-    char            filename[MAX_STRING] ;
-    keyword         listkw[MAX_KEY] ;
+    char        *   filename ;
+    /* Keyword values, NULL for keywords absent from the header */
+    char        **  listkw ;
 } record ;
 
+/* A header stored in the index, text is in the mapped index file */
+typedef struct _INDEX_ENTRY_ {
+    char    *   filename ;
+    long        size ;
+    long        mtime ;
+    char    *   text ;
+    int         len ;
+    int         used ;
+} index_entry ;
+
+/* A header index: the index file is mapped, new contents go to a copy */
+typedef struct _HDR_INDEX_ {
+    char        *   name ;
+    char        *   map ;
+    long            mapsize ;
+    index_entry *   entries ;
+    int             nentries ;
+    FILE        *   out ;
+} hdr_index ;
+
 /*-----------------------------------------------------------------------------
                             Function prototypes
  -----------------------------------------------------------------------------*/
@@ -81,6 +123,9 @@ static void getfilename(char *line, char *word) ;
 static char * expand_hierarch_keyword(char *, char *) ;
 static int isdetectedkeyword(char *line, char *keywords[], int nkeys) ;
 static void getkeywordvalue(char *line, char *word) ;
+static void setkeywordvalue(record *, int, char *) ;
+
+static int  batch_scan(char *, char **, int, int, char *, record **) ;
 
 /*-----------------------------------------------------------------------------
                                 Main
@@ -96,14 +141,23 @@ int main(int argc, char *argv[])
 	int		len ;
 	int		max_width[MAX_KEY] ;
 	int		max_filnam ;
-	char	fmt[8] ;
+	char	fmt[16] ;
 	int		flag ;
 	int		printnames ;
 	int		print_hdr ;
+	int		nthreads ;
+	int		nkeys ;
+	char *	listname ;
+	char *	indexname ;
+	char *	cardkeys[MAX_KEY] ;
+	char	cardkey[MAX_STRING] ;
 
     if (argc<2) {
         printf("\n\nuse : %s [-d] KEY1 KEY2 ... KEYn\n", argv[0]) ;
         printf("Input data is received from stdin\n") ;
+        printf("\nuse : %s [-d] [-j n] [-i index] -F list KEY1 ... KEYn\n",
+               argv[0]) ;
+        printf("Headers are read from the files named in list (- for stdin)\n");
         printf("See man page for more details and examples\n\n") ;
         return 0 ;
     }
@@ -111,59 +165,116 @@ int main(int argc, char *argv[])
     /* Initialize */
 	printnames = 0 ;
 	print_hdr  = 1 ;
+	nthreads   = 0 ;
+	listname   = NULL ;
+	indexname  = NULL ;
     nfiles = 0 ;
-    allrecords = (record*)calloc(1, sizeof(record));
-	if (!strcmp(argv[1], "-d")) {
-		print_hdr = 0;
+    allrecords = NULL ;
+	/* Parse options, all remaining arguments are keywords */
+	argv++ ;
+	argc-- ;
+	while (argc>0 && argv[0][0]=='-' && argv[0][1]!=(char)0) {
+		if (!strcmp(argv[0], "-d")) {
+			print_hdr = 0;
+		} else if (!strcmp(argv[0], "-j") && argc>1) {
+			nthreads = atoi(argv[1]) ;
+			argv++ ;
+			argc-- ;
+		} else if (!strcmp(argv[0], "-F") && argc>1) {
+			listname = argv[1] ;
+			argv++ ;
+			argc-- ;
+		} else if (!strcmp(argv[0], "-i") && argc>1) {
+			indexname = argv[1] ;
+			argv++ ;
+			argc-- ;
+		} else {
+			break ;
+		}
 		argv++ ;
 		argc-- ;
 	}
-    argv++ ;
+#ifndef HAS_PTHREADS
+	if (nthreads>1) {
+		fprintf(stderr,
+				"*** warning: compiled without thread support, -j ignored\n");
+	}
+#endif
+	nkeys = argc ;
+	if (nkeys>MAX_KEY) {
+		fprintf(stderr, "*** error: at most %d keywords\n", MAX_KEY);
+		return -1 ;
+	}
 
-	/* Uppercase all inputs */
-	for (i=0 ; i<(argc-1) ; i++) {
+	/*
+	 * Uppercase all inputs and translate them once to keywords as they
+	 * appear in FITS cards
+	 */
+	for (i=0 ; i<nkeys ; i++) {
 		j=0 ;
 		while (argv[i][j]!=0) {
 			argv[i][j] = toupper(argv[i][j]);
 			j++ ;
 		}
+		if (strlen(argv[i])>=MAX_STRING/2) {
+			fprintf(stderr, "*** error: keyword too long: %s\n", argv[i]);
+			return -1 ;
+		}
+		if (strstr(argv[i], ".")!=NULL) {
+			/*
+			 * keyword contains a dot, it is a hierarchical keyword that
+			 * must be expanded. Pattern is:
+			 * A.B.C... becomes HIERARCH ESO A B C ...
+			 */
+			expand_hierarch_keyword(argv[i], cardkey) ;
+			cardkeys[i] = malloc(strlen(cardkey)+1) ;
+			strcpy(cardkeys[i], cardkey) ;
+		} else {
+			cardkeys[i] = argv[i] ;
+		}
 	}
 
-    while (fgets(curline, MAX_STRING, stdin) != (char*)NULL) {
+	if (listname!=NULL) {
+		/* Batch mode: read the headers ourselves */
+		nfiles = batch_scan(listname, cardkeys, nkeys, nthreads, indexname,
+							&allrecords) ;
+		if (nfiles<0) return -1 ;
+		printnames = 1 ;
+	} else while (fgets(curline, MAX_STRING, stdin) != (char*)NULL) {
         flag=isfilename(curline) ;
         if (flag == 1) {
             /* New file name is detected, get the new file name */
             printnames = 1 ;
-            getfilename(curline, allrecords[nfiles].filename) ;
-            nfiles++ ;
-			
             /* Initialize a new record structure to store data for this file. */
             allrecords = (record*)realloc(allrecords,(nfiles+1)*sizeof(record));
-            for (i=0 ; i<MAX_KEY ; i++) allrecords[nfiles].listkw[i].present=0;
+            getfilename(curline, word) ;
+            allrecords[nfiles].filename = malloc(strlen(word)+1) ;
+            strcpy(allrecords[nfiles].filename, word) ;
+            allrecords[nfiles].listkw = calloc(nkeys+1, sizeof(char*)) ;
+            nfiles++ ;
 		} else if (flag==0) {
 			/* Is not a file name, is it a searched keyword?    */
-            if ((kwnum = isdetectedkeyword(	curline, argv, argc-1)) != -1) {
+            if ((kwnum = isdetectedkeyword(	curline, cardkeys, nkeys)) != -1) {
 				/* Is there anything allocated yet to store this? */
 				if (nfiles>0) {
 					/* It has been detected as a searched keyword.  */
 					/* Get its value, store it, present flag up     */
 					getkeywordvalue(curline, word) ;
-					strcpy(allrecords[nfiles-1].listkw[kwnum].value, word) ;
-					allrecords[nfiles-1].listkw[kwnum].present ++ ;
+					setkeywordvalue(allrecords+nfiles-1, kwnum, word) ;
 				}
             }
         }
     }
-	for (i=0 ; i<argc-1 ; i++) max_width[i] = (int)strlen(argv[i]) ;
+	for (i=0 ; i<nkeys ; i++) max_width[i] = (int)strlen(argv[i]) ;
 
 	/* Record the maximum width for each column */
 	max_filnam = 0 ;
 	for (i=0 ; i<nfiles ; i++) {
 		len = (int)strlen(allrecords[i].filename) ;
 		if (len>max_filnam) max_filnam=len ;
-		for (kwnum=0 ; kwnum<argc-1 ; kwnum++) {
-			if (allrecords[i].listkw[kwnum].present) {
-				len = (int)strlen(allrecords[i].listkw[kwnum].value) ;
+		for (kwnum=0 ; kwnum<nkeys ; kwnum++) {
+			if (allrecords[i].listkw[kwnum]!=NULL) {
+				len = (int)strlen(allrecords[i].listkw[kwnum]) ;
 			} else {
 				len = 0 ;
 			}
@@ -175,7 +286,7 @@ int main(int argc, char *argv[])
 	if (print_hdr) {
 		sprintf(fmt, FMT_STRING, max_filnam) ;
 		if (printnames) printf(fmt, "FILE");
-		for (i=0 ; i<argc-1 ; i++) {
+		for (i=0 ; i<nkeys ; i++) {
 			sprintf(fmt, FMT_STRING, max_width[i]) ;
 			printf(fmt, argv[i]) ;
 		}
@@ -192,15 +303,21 @@ int main(int argc, char *argv[])
 			sprintf(fmt, FMT_STRING, max_filnam) ;
 			printf(fmt, allrecords[i].filename) ;
 		}
-        for (kwnum=0 ; kwnum<argc-1 ; kwnum++) {
+        for (kwnum=0 ; kwnum<nkeys ; kwnum++) {
 			sprintf(fmt, FMT_STRING, max_width[kwnum]);
-            if (allrecords[i].listkw[kwnum].present)
-				printf(fmt, allrecords[i].listkw[kwnum].value) ;
-            else printf(fmt, " ");
+            if (allrecords[i].listkw[kwnum]!=NULL) {
+				printf(fmt, allrecords[i].listkw[kwnum]) ;
+				free(allrecords[i].listkw[kwnum]) ;
+            } else printf(fmt, " ");
         }
         printf("\n") ;
+		free(allrecords[i].filename) ;
+		free(allrecords[i].listkw) ;
     }
     free(allrecords) ;
+	for (i=0 ; i<nkeys ; i++) {
+		if (cardkeys[i]!=argv[i]) free(cardkeys[i]) ;
+	}
     return 0 ;
 }
 
@@ -252,6 +369,8 @@ static void getfilename(char * line, char * word)
   (*keywords[]). If the provided line appears to contain one of the keywords
   registered in the list, the rank of the keyword in the list is returned, 
   otherwise, -1 is returned.
+  Keywords must be given as they appear in FITS cards, i.e. HIERARCH
+  keywords already expanded by expand_hierarch_keyword().
  */
 /*----------------------------------------------------------------------------*/
 static int isdetectedkeyword(
@@ -260,7 +379,6 @@ static int isdetectedkeyword(
         int         nkeys)
 {
     char    kw[MAX_STRING] ;
-    char    esokw[MAX_STRING] ;
     int     i ;
 
     /* The keyword is up to the equal character, with trailing blanks removed */
@@ -273,17 +391,7 @@ static int isdetectedkeyword(
     
     /* Now compare what we got with what's available */
     for (i=0 ; i<nkeys ; i++) {
-		if (strstr(keywords[i], ".")!=NULL) {
-			/*
-			 * keyword contains a dot, it is a hierarchical keyword that
-			 * must be expanded. Pattern is:
-			 * A.B.C... becomes HIERARCH ESO A B C ...
-			 */
-			expand_hierarch_keyword(keywords[i], esokw) ;
-			if (!strcmp(kw, esokw)) {
-					return i ;
-			}
-		} else if (!strcmp(kw, keywords[i])) {
+        if (kw[0]==keywords[i][0] && !strcmp(kw, keywords[i])) {
             return i ;
         }
     }
@@ -342,12 +450,16 @@ static void getkeywordvalue(
     c = w = 0;
 
     /* Parse the line till the equal '=' sign is found  */
-    while (line[c] != '=') c++ ;
+    while (line[c] != '=') {
+        if (line[c] == (char)0) return ;
+        c++ ;
+    }
     c++ ;
 
     /* Copy the line till the slash '/' sign or the end of data is found.  */
     while (search == 1) {
         if (c>=80) search = 0 ;
+        else if (line[c] == (char)0) search = 0 ;
         else if ((line[c] == '/') && (quote == 0)) search = 0 ;
         if (line[c] == '\'') quote = !quote ;
         tmp[w++] = line[c++] ;
@@ -371,3 +483,505 @@ static void getkeywordvalue(
     return ;
 }
 
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Store a keyword value in a record
+  @param    rec     Record to modify
+  @param    kwnum   Keyword rank
+  @param    word    Keyword value
+  @return   void
+  The last value found for a keyword in a header is kept.
+ */
+/*----------------------------------------------------------------------------*/
+static void setkeywordvalue(
+        record  *   rec,
+        int         kwnum,
+        char    *   word)
+{
+    if (rec->listkw[kwnum]!=NULL) free(rec->listkw[kwnum]) ;
+    rec->listkw[kwnum] = malloc(strlen(word)+1) ;
+    if (rec->listkw[kwnum]!=NULL) strcpy(rec->listkw[kwnum], word) ;
+    return ;
+}
+
+/*-----------------------------------------------------------------------------
+                                Batch mode
+ -----------------------------------------------------------------------------*/
+
+/* A file to scan in batch mode */
+typedef struct _SCAN_JOB_ {
+    char    *   filename ;
+    char    **  listkw ;
+    char    *   errmsg ;
+} scan_job ;
+
+#ifdef HAS_PTHREADS
+static pthread_mutex_t scan_mutex = PTHREAD_MUTEX_INITIALIZER ;
+#define scan_lock()     pthread_mutex_lock(&scan_mutex)
+#define scan_unlock()   pthread_mutex_unlock(&scan_mutex)
+#else
+#define scan_lock()
+#define scan_unlock()
+#endif
+
+/* Shared by all workers, set before scanning starts */
+static scan_job     *   scan_jobs ;
+static int              scan_njobs ;
+static int              scan_next ;
+static char         **  scan_keywords ;
+static int              scan_nkeys ;
+static hdr_index    *   scan_index ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Extract the requested keywords from a header text
+  @param    text        Header text, one card per line
+  @param    len         Text length
+  @param    keywords    Keywords as they appear in FITS cards
+  @param    nkeys       Number of keywords
+  @param    listkw      Keyword values to fill
+  @return   void
+  The text is parsed in one pass, each card being compared to all keywords
+  at once. The text needs not be null-terminated.
+ */
+/*----------------------------------------------------------------------------*/
+static void parse_header(
+        char    *   text,
+        int         len,
+        char    **  keywords,
+        int         nkeys,
+        char    **  listkw)
+{
+    char    line[MAX_STRING] ;
+    char    word[MAX_STRING] ;
+    record  rec ;
+    int     kwnum ;
+    int     i, n ;
+
+    rec.listkw = listkw ;
+    i = 0 ;
+    while (i<len) {
+        n = 0 ;
+        while (i<len && text[i]!='\n') {
+            if (n<LGTH) line[n++] = text[i] ;
+            i++ ;
+        }
+        i++ ;
+        line[n] = (char)0 ;
+        if ((kwnum = isdetectedkeyword(line, keywords, nkeys)) != -1) {
+            getkeywordvalue(line, word) ;
+            setkeywordvalue(&rec, kwnum, word) ;
+        }
+    }
+    return ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Read the main header of a FITS file
+  @param    filename    File to read
+  @param    len         Returned text length
+  @param    errmsg      Returned error message
+  @return   Newly allocated header text, NULL in case of error
+  Only the header blocks are read. The text is what dfits would print: one
+  card per line, with trailing blanks removed, up to the END card.
+ */
+/*----------------------------------------------------------------------------*/
+static char * read_header(
+        char    *   filename,
+        int     *   len,
+        char    *   errmsg)
+{
+    char    block[BLOCK_SIZE] ;
+    char    *   text ;
+    char    *   card ;
+    int     alloc ;
+    int     fd ;
+    int     nr, r ;
+    int     end ;
+    int     i, l ;
+
+    if ((fd=open(filename, O_RDONLY))==-1) {
+        sprintf(errmsg, "cannot open file [%s]", filename) ;
+        return NULL ;
+    }
+    text = NULL ;
+    alloc = 0 ;
+    *len = 0 ;
+    end = 0 ;
+    while (!end) {
+        /* Read a complete block */
+        nr = 0 ;
+        while (nr<BLOCK_SIZE && (r=read(fd, block+nr, BLOCK_SIZE-nr))>0) {
+            nr += r ;
+        }
+        if (nr<BLOCK_SIZE) break ;
+        if (*len==0 && strncmp(block, MAGIC, strlen(MAGIC))) break ;
+        /* Make room for a complete block */
+        if (*len+BLOCK_SIZE+BLOCK_SIZE/LGTH > alloc) {
+            alloc = 2*alloc + BLOCK_SIZE + BLOCK_SIZE/LGTH ;
+            if ((card=realloc(text, alloc))==NULL) break ;
+            text = card ;
+        }
+        for (i=0 ; i<BLOCK_SIZE/LGTH && !end ; i++) {
+            card = block + i*LGTH ;
+            l = LGTH ;
+            while (l>0 && card[l-1]==' ') l-- ;
+            memcpy(text+*len, card, l) ;
+            *len += l ;
+            text[(*len)++] = '\n' ;
+            if (card[0]=='E' && card[1]=='N' && card[2]=='D' && card[3]==' ') {
+                end = 1 ;
+            }
+        }
+    }
+    close(fd) ;
+    if (!end) {
+        if (*len==0) {
+            sprintf(errmsg, "not a FITS file: %s", filename) ;
+        } else {
+            sprintf(errmsg, "incomplete FITS header: %s", filename) ;
+        }
+        if (text!=NULL) free(text) ;
+        return NULL ;
+    }
+    return text ;
+}
+
+/* Compare two index entries by file name, for qsort and bsearch */
+static int index_compare(const void * a, const void * b)
+{
+    return strcmp(((index_entry*)a)->filename, ((index_entry*)b)->filename) ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Open a header index
+  @param    idx     Index to initialize
+  @param    name    Index file name
+  @return   0 if Ok, -1 otherwise
+  The index file is mapped in memory and its entries sorted by file name.
+  A missing index file is not an error: it will be created. Updated
+  contents are written to a temporary file, which replaces the index in
+  index_close().
+
+  The index is a text file starting with INDEX_MAGIC. Each entry is a line
+  giving the file size, modification time, header text length and file
+  name, followed by the header text itself.
+ */
+/*----------------------------------------------------------------------------*/
+static int index_open(hdr_index * idx, char * name)
+{
+    struct stat     sta ;
+    char            line[FILENAME_MAX+64] ;
+    char            tmpname[FILENAME_MAX+32] ;
+    char        *   p ;
+    char        *   eol ;
+    index_entry *   e ;
+    int             nalloc ;
+    int             fd ;
+    int             n, pos ;
+
+    memset(idx, 0, sizeof(hdr_index)) ;
+    if (strlen(name)>FILENAME_MAX) return -1 ;
+    idx->name = name ;
+    fd = open(name, O_RDONLY) ;
+    if (fd!=-1 && fstat(fd, &sta)==0 && sta.st_size>0) {
+        idx->mapsize = (long)sta.st_size ;
+        idx->map = mmap(0, sta.st_size, PROT_READ, MAP_SHARED, fd, 0) ;
+        if (idx->map==(char*)-1) {
+            idx->map = NULL ;
+            idx->mapsize = 0 ;
+        }
+    }
+    if (fd!=-1) close(fd) ;
+    /* Parse the index entries */
+    if (idx->map!=NULL) {
+        if (idx->mapsize<(long)strlen(INDEX_MAGIC) ||
+            strncmp(idx->map, INDEX_MAGIC, strlen(INDEX_MAGIC))) {
+            fprintf(stderr, "*** error: not a fitsort index: %s\n", name) ;
+            munmap(idx->map, idx->mapsize) ;
+            return -1 ;
+        }
+        p = idx->map + strlen(INDEX_MAGIC) ;
+        nalloc = 0 ;
+        while (p < idx->map + idx->mapsize) {
+            eol = memchr(p, '\n', idx->map + idx->mapsize - p) ;
+            if (eol==NULL || eol-p >= (long)sizeof(line)) break ;
+            memcpy(line, p, eol-p) ;
+            line[eol-p] = (char)0 ;
+            if (idx->nentries==nalloc) {
+                nalloc = nalloc ? 2*nalloc : 1024 ;
+                e = realloc(idx->entries, nalloc*sizeof(index_entry)) ;
+                if (e==NULL) break ;
+                idx->entries = e ;
+            }
+            e = idx->entries + idx->nentries ;
+            pos = 0 ;
+            if (sscanf(line, "%ld %ld %d %n", &e->size, &e->mtime, &n,
+                       &pos)<3 || pos==0 || n<0 ||
+                n > idx->map + idx->mapsize - (eol+1)) break ;
+            e->filename = malloc(strlen(line+pos)+1) ;
+            strcpy(e->filename, line+pos) ;
+            e->text = eol+1 ;
+            e->len = n ;
+            e->used = 0 ;
+            idx->nentries++ ;
+            p = eol + 1 + n ;
+        }
+        qsort(idx->entries, idx->nentries, sizeof(index_entry),
+              index_compare) ;
+    }
+    /* Prepare the updated index */
+    sprintf(tmpname, "%s.%ld", name, (long)getpid()) ;
+    if ((idx->out=fopen(tmpname, "w"))==NULL) {
+        fprintf(stderr, "*** error: cannot create index %s\n", tmpname) ;
+        return -1 ;
+    }
+    fputs(INDEX_MAGIC, idx->out) ;
+    return 0 ;
+}
+
+/* Look for a file in the index */
+static index_entry * index_find(hdr_index * idx, char * filename)
+{
+    index_entry key ;
+
+    if (idx->nentries<1) return NULL ;
+    key.filename = filename ;
+    return bsearch(&key, idx->entries, idx->nentries, sizeof(index_entry),
+                   index_compare) ;
+}
+
+/* Write an entry to the updated index */
+static void index_add(
+        hdr_index   *   idx,
+        char        *   filename,
+        long            size,
+        long            mtime,
+        char        *   text,
+        int             len)
+{
+    fprintf(idx->out, "%ld %ld %d %s\n", size, mtime, len, filename) ;
+    fwrite(text, 1, len, idx->out) ;
+    return ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Close a header index
+  @param    idx     Index to close
+  @return   0 if Ok, -1 otherwise
+  Entries of the previous index which were not used are kept, then the
+  updated index replaces the previous one.
+ */
+/*----------------------------------------------------------------------------*/
+static int index_close(hdr_index * idx)
+{
+    char    tmpname[FILENAME_MAX+32] ;
+    int     err ;
+    int     i ;
+
+    for (i=0 ; i<idx->nentries ; i++) {
+        if (!idx->entries[i].used) {
+            index_add(idx, idx->entries[i].filename, idx->entries[i].size,
+                      idx->entries[i].mtime, idx->entries[i].text,
+                      idx->entries[i].len) ;
+        }
+        free(idx->entries[i].filename) ;
+    }
+    if (idx->entries!=NULL) free(idx->entries) ;
+    if (idx->map!=NULL) munmap(idx->map, idx->mapsize) ;
+    err = fclose(idx->out) ;
+    sprintf(tmpname, "%s.%ld", idx->name, (long)getpid()) ;
+    if (err!=0 || rename(tmpname, idx->name)!=0) {
+        fprintf(stderr, "*** error: cannot update index %s\n", idx->name) ;
+        remove(tmpname) ;
+        return -1 ;
+    }
+    return 0 ;
+}
+
+/* Scan one file: get its header from the index or the file itself */
+static void scan_file(scan_job * job)
+{
+    struct stat     sta ;
+    index_entry *   e ;
+    char            errmsg[FILENAME_MAX+64] ;
+    char        *   text ;
+    int             len ;
+
+    if (stat(job->filename, &sta)!=0) {
+        sprintf(errmsg, "cannot stat file [%s]", job->filename) ;
+        job->errmsg = malloc(strlen(errmsg)+1) ;
+        strcpy(job->errmsg, errmsg) ;
+        return ;
+    }
+    e = NULL ;
+    if (scan_index!=NULL) e = index_find(scan_index, job->filename) ;
+    if (e!=NULL && e->size==(long)sta.st_size &&
+        e->mtime==(long)sta.st_mtime) {
+        /* Up to date in the index */
+        text = e->text ;
+        len = e->len ;
+    } else {
+        text = read_header(job->filename, &len, errmsg) ;
+        if (text==NULL) {
+            job->errmsg = malloc(strlen(errmsg)+1) ;
+            strcpy(job->errmsg, errmsg) ;
+            return ;
+        }
+    }
+    parse_header(text, len, scan_keywords, scan_nkeys, job->listkw) ;
+    if (scan_index!=NULL) {
+        scan_lock() ;
+        /* An outdated entry is replaced by the new one */
+        if (e!=NULL) e->used = 1 ;
+        index_add(scan_index, job->filename, (long)sta.st_size,
+                  (long)sta.st_mtime, text, len) ;
+        scan_unlock() ;
+    }
+    if (e==NULL || text!=e->text) free(text) ;
+    return ;
+}
+
+/* Worker: scan files until there are none left */
+static void * scan_worker(void * arg)
+{
+    int     i ;
+
+    while (1) {
+        scan_lock() ;
+        i = scan_next++ ;
+        scan_unlock() ;
+        if (i>=scan_njobs) break ;
+        scan_file(scan_jobs+i) ;
+    }
+    return NULL ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Scan a list of FITS files
+  @param    listname    Name of a file listing FITS files, - for stdin
+  @param    keywords    Keywords as they appear in FITS cards
+  @param    nkeys       Number of keywords
+  @param    nthreads    Number of threads, 0 for one per processor
+  @param    indexname   Name of the header index, or NULL
+  @param    records     Returned records, in list order
+  @return   Number of records, -1 in case of error
+  Main headers are read directly from the files, without going through
+  dfits. Files which cannot be read are reported on stderr and skipped.
+  Several files are scanned at the same time when compiled with thread
+  support. If a header index is given, headers of files which did not
+  change since the index was written are taken from it.
+ */
+/*----------------------------------------------------------------------------*/
+static int batch_scan(
+        char    *   listname,
+        char    **  keywords,
+        int         nkeys,
+        int         nthreads,
+        char    *   indexname,
+        record  **  records)
+{
+    FILE        *   list ;
+    char            line[FILENAME_MAX+2] ;
+    hdr_index       idx ;
+    int             nalloc ;
+    int             nrec ;
+    int             len ;
+    int             i ;
+#ifdef HAS_PTHREADS
+    pthread_t   *   tids ;
+    int             nstarted ;
+#endif
+
+    /* Read the list of files */
+    if (!strcmp(listname, "-")) {
+        list = stdin ;
+    } else if ((list=fopen(listname, "r"))==NULL) {
+        fprintf(stderr, "*** error: cannot open list %s\n", listname) ;
+        return -1 ;
+    }
+    scan_jobs = NULL ;
+    scan_njobs = 0 ;
+    nalloc = 0 ;
+    while (fgets(line, sizeof(line), list)!=NULL) {
+        len = (int)strlen(line) ;
+        while (len>0 && (line[len-1]=='\n' || line[len-1]=='\r')) len-- ;
+        line[len] = (char)0 ;
+        if (len==0) continue ;
+        if (scan_njobs==nalloc) {
+            nalloc = nalloc ? 2*nalloc : 1024 ;
+            scan_jobs = realloc(scan_jobs, nalloc*sizeof(scan_job)) ;
+            if (scan_jobs==NULL) {
+                fprintf(stderr, "*** error: out of memory\n") ;
+                return -1 ;
+            }
+        }
+        scan_jobs[scan_njobs].filename = malloc(len+1) ;
+        strcpy(scan_jobs[scan_njobs].filename, line) ;
+        scan_jobs[scan_njobs].listkw = calloc(nkeys+1, sizeof(char*)) ;
+        scan_jobs[scan_njobs].errmsg = NULL ;
+        scan_njobs++ ;
+    }
+    if (list!=stdin) fclose(list) ;
+
+    scan_next = 0 ;
+    scan_keywords = keywords ;
+    scan_nkeys = nkeys ;
+    scan_index = NULL ;
+    if (indexname!=NULL) {
+        if (index_open(&idx, indexname)!=0) return -1 ;
+        scan_index = &idx ;
+    }
+
+    /* Scan all files */
+    if (nthreads<1) {
+        nthreads = 1 ;
+#if defined(HAS_PTHREADS) && defined(_SC_NPROCESSORS_ONLN)
+        nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN) ;
+        if (nthreads<1) nthreads = 1 ;
+#endif
+    }
+    if (nthreads>scan_njobs) nthreads = scan_njobs ;
+#ifdef HAS_PTHREADS
+    tids = NULL ;
+    nstarted = 0 ;
+    if (nthreads>1) tids = malloc((nthreads-1)*sizeof(pthread_t)) ;
+    if (tids!=NULL) {
+        for (i=0 ; i<nthreads-1 ; i++) {
+            if (pthread_create(tids+nstarted, NULL, scan_worker, NULL)==0) {
+                nstarted++ ;
+            }
+        }
+    }
+    /* The main thread works too, and finishes the job if threads failed */
+    scan_worker(NULL) ;
+    for (i=0 ; i<nstarted ; i++) pthread_join(tids[i], NULL) ;
+    if (tids!=NULL) free(tids) ;
+#else
+    scan_worker(NULL) ;
+#endif
+    if (scan_index!=NULL) index_close(scan_index) ;
+
+    /* Collect results in list order */
+    *records = malloc((scan_njobs+1)*sizeof(record)) ;
+    nrec = 0 ;
+    for (i=0 ; i<scan_njobs ; i++) {
+        if (scan_jobs[i].errmsg!=NULL) {
+            fprintf(stderr, "*** error: %s\n", scan_jobs[i].errmsg) ;
+            free(scan_jobs[i].errmsg) ;
+            free(scan_jobs[i].filename) ;
+            free(scan_jobs[i].listkw) ;
+            continue ;
+        }
+        (*records)[nrec].filename = scan_jobs[i].filename ;
+        (*records)[nrec].listkw = scan_jobs[i].listkw ;
+        nrec++ ;
+    }
+    if (scan_jobs!=NULL) free(scan_jobs) ;
+    return nrec ;
+}
@@ -6,7 +6,8 @@
    @version	$Revision: 1.8 $
    @brief	FITS data block MD5 computation routine.
 
-   This module offers MD5 computation over all data areas of a FITS file.
+   This module offers MD5 computation over all data areas of a FITS file,
+   over complete files and over memory blocks.
 */
 /*----------------------------------------------------------------------------*/
 
@@ -38,6 +39,21 @@
 /** Size of an MD5 hash in bytes (32 bytes are 128 bits) */
 #define MD5HASHSZ	32
 
+/*-----------------------------------------------------------------------------
+  							Private functions
+ -----------------------------------------------------------------------------*/
+
+/* Write an MD5 digest as a string of MD5HASHSZ hexadecimal digits */
+static void qfits_md5_string(unsigned char digest[16], char * out)
+{
+	int		i ;
+
+	for (i=0 ; i<16 ; i++) {
+		sprintf(out+2*i, "%02x", digest[i]);
+	}
+	out[MD5HASHSZ] = (char)0 ;
+}
+
 /*-----------------------------------------------------------------------------
   							Function code
  -----------------------------------------------------------------------------*/
@@ -64,8 +80,11 @@ char * qfits_datamd5(char * filename)
 	struct MD5Context	ctx ;
 	unsigned char 		digest[16] ;
 	FILE     		*	in ;
-	char 				buf[FITS_BLOCK_SIZE];
+	char			*	chunk ;
+	char			*	buf ;
 	char			*	buf_c ;
+	int					nblocks ;
+	int					b ;
 	int					i ;
 	int					in_header ;
 	int					check_fits ;
@@ -77,12 +96,20 @@ char * qfits_datamd5(char * filename)
         qfits_error("cannot open file %s", filename);
         return NULL ;
     }
+	/* Read by large chunks, blocks are examined one by one */
+	if ((chunk=malloc(FITS_BLOCK_SIZE*64))==NULL) {
+		fclose(in);
+		return NULL ;
+	}
     /* Initialize all variables */
     MD5Init(&ctx);
     in_header=1 ;
 	check_fits=0 ;
-    /* Loop over input file */
-    while (fread(buf, 1, FITS_BLOCK_SIZE, in)==FITS_BLOCK_SIZE) {
+    /* Loop over input file, ignoring a trailing incomplete block */
+    while ((nblocks=(int)(fread(chunk, 1, FITS_BLOCK_SIZE*64, in) /
+						  FITS_BLOCK_SIZE))>0) {
+	for (b=0 ; b<nblocks ; b++) {
+		buf = chunk + b*FITS_BLOCK_SIZE ;
 		/* First time in the loop: check the file is FITS */
 		if (check_fits==0) {
 			/* Examine first characters in block */
@@ -97,6 +124,7 @@ char * qfits_datamd5(char * filename)
 				buf[8]!='=') {
 				qfits_error("file [%s] is not FITS\n", filename);
 				fclose(in);
+				free(chunk);
 				return NULL ;
 			} else {
 				check_fits=1 ;
@@ -144,7 +172,9 @@ char * qfits_datamd5(char * filename)
                 MD5Update(&ctx, (unsigned char *)buf, FITS_BLOCK_SIZE);
             }
         }
+	}
     }
+    free(chunk);
     fclose(in);
 	if (check_fits==0) {
 		/* Never went through the read loop: file is not FITS */
@@ -154,25 +184,87 @@ char * qfits_datamd5(char * filename)
     /* Got to the end of file: summarize */
     MD5Final(digest, &ctx);
     /* Write digest into a string */
-    sprintf(datamd5,
-    "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
-    digest[ 0],
-    digest[ 1],
-    digest[ 2],
-    digest[ 3],
-    digest[ 4],
-    digest[ 5],
-    digest[ 6],
-    digest[ 7],
-    digest[ 8],
-    digest[ 9],
-    digest[10],
-    digest[11],
-    digest[12],
-    digest[13],
-    digest[14],
-    digest[15]);
+    qfits_md5_string(digest, datamd5);
 	return datamd5 ;
 }
 
+/*----------------------------------------------------------------------------*/
+/**
+  @brief	Compute the MD5 hash of a complete file.
+  @param	filename	Name of the file to examine.
+  @return	1 statically allocated character string, or NULL.
+
+  Unlike qfits_datamd5(), this function hashes all bytes of the file,
+  headers included, and accepts any kind of file. Two files with the
+  same hash can be considered identical.
+
+  The returned string is statically allocated inside this function,
+  so do not free it or modify it. This function returns NULL in case
+  of error.
+ */
+/*----------------------------------------------------------------------------*/
+char * qfits_filemd5(char * filename)
+{
+	static char 		filemd5[MD5HASHSZ+1] ;
+	struct MD5Context	ctx ;
+	unsigned char 		digest[16] ;
+	FILE     		*	in ;
+	char 			*	buf ;
+	size_t				nr ;
+	int					err ;
+
+	/* Check entries */
+	if (filename==NULL) return NULL ;
+    /* Open input file */
+    if ((in=fopen(filename, "r"))==NULL) {
+        qfits_error("cannot open file %s", filename);
+        return NULL ;
+    }
+	/* Read by large chunks: the file is not parsed */
+	if ((buf=malloc(FITS_BLOCK_SIZE*64))==NULL) {
+		fclose(in);
+		return NULL ;
+	}
+    MD5Init(&ctx);
+	while ((nr=fread(buf, 1, FITS_BLOCK_SIZE*64, in))>0) {
+		MD5Update(&ctx, (unsigned char *)buf, (unsigned)nr);
+	}
+	err = ferror(in) ;
+	fclose(in);
+	free(buf);
+	if (err) {
+		qfits_error("cannot read file %s", filename);
+		return NULL ;
+	}
+    MD5Final(digest, &ctx);
+    qfits_md5_string(digest, filemd5);
+	return filemd5 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief	Compute the MD5 hash of a memory block.
+  @param	buf		Memory block.
+  @param	size	Size of the block in bytes.
+  @return	1 statically allocated character string, or NULL.
+
+  The returned string is statically allocated inside this function,
+  so do not free it or modify it. This function returns NULL in case
+  of error.
+ */
+/*----------------------------------------------------------------------------*/
+char * qfits_memmd5(const void * buf, int size)
+{
+	static char 		memmd5[MD5HASHSZ+1] ;
+	struct MD5Context	ctx ;
+	unsigned char 		digest[16] ;
+
+	if (buf==NULL || size<0) return NULL ;
+    MD5Init(&ctx);
+	MD5Update(&ctx, (unsigned char const *)buf, (unsigned)size);
+    MD5Final(digest, &ctx);
+    qfits_md5_string(digest, memmd5);
+	return memmd5 ;
+}
+
 /* vim: set ts=4 et sw=4 tw=75 */
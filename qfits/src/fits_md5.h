@@ -6,7 +6,8 @@
    @version $Revision: 1.5 $
    @brief   FITS data block MD5 computation routine.
 
-   This module offers MD5 computation over all data areas of a FITS file.
+   This module offers MD5 computation over all data areas of a FITS file,
+   over complete files and over memory blocks.
 */
 /*----------------------------------------------------------------------------*/
 
@@ -50,6 +51,37 @@
  */
 /*----------------------------------------------------------------------------*/
 char * qfits_datamd5(char * filename);
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Compute the MD5 hash of a complete file.
+  @param    filename    Name of the file to examine.
+  @return   1 statically allocated character string, or NULL.
+
+  Unlike qfits_datamd5(), this function hashes all bytes of the file,
+  headers included, and accepts any kind of file. Two files with the
+  same hash can be considered identical.
+
+  The returned string is statically allocated inside this function,
+  so do not free it or modify it. This function returns NULL in case
+  of error.
+ */
+/*----------------------------------------------------------------------------*/
+char * qfits_filemd5(char * filename);
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Compute the MD5 hash of a memory block.
+  @param    buf     Memory block.
+  @param    size    Size of the block in bytes.
+  @return   1 statically allocated character string, or NULL.
+
+  The returned string is statically allocated inside this function,
+  so do not free it or modify it. This function returns NULL in case
+  of error.
+ */
+/*----------------------------------------------------------------------------*/
+char * qfits_memmd5(const void * buf, int size);
 /* </dox> */
 
 #endif
@@ -0,0 +1,1470 @@
+/*----------------------------------------------------------------------------*/
+/**
+   @file    fits_zimage.c
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Tile-compressed FITS images.
+
+   This module reads and writes images stored with the FITS tiled image
+   compression convention: the image is cut into rectangular tiles,
+   each tile is compressed separately and stored as one row of a binary
+   table extension (ZIMAGE=T), the compressed bytes living in the table
+   heap. Rice (RICE_1) and GZIP (GZIP_1, GZIP_2) compressed tiles can be
+   read, including quantized floating-point images. Rice compression is
+   offered for writing integer images.
+
+   The GZIP decoder is a plain implementation of the inflate algorithm
+   (RFC 1951), so that no external library is needed.
+*/
+/*----------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+/*-----------------------------------------------------------------------------
+   								Includes
+ -----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "fits_zimage.h"
+#include "fits_std.h"
+#include "fits_rw.h"
+#include "simple.h"
+#include "qerror.h"
+#include "xmemory.h"
+
+/*-----------------------------------------------------------------------------
+   								Defines
+ -----------------------------------------------------------------------------*/
+
+/* Number of values in the dithering random sequence */
+#define ZIMAGE_NRANDOM		10000
+
+/* Quantization modes */
+#define ZQUANT_NONE			0
+#define ZQUANT_NODITHER		1
+#define ZQUANT_DITHER1		2
+#define ZQUANT_DITHER2		3
+
+/* Value of a zero pixel with SUBTRACTIVE_DITHER_2 */
+#define ZQUANT_ZEROVALUE	(-2147483646)
+
+/* Mask of the n lowest bits, n from 0 to 32 */
+#define ZMASK(n)	((n)>=32 ? 0xffffffffUL : ((1UL<<(n))-1UL))
+
+/* Inflate limits */
+#define INF_MAXBITS		15
+#define INF_MAXLCODES	286
+#define INF_MAXDCODES	30
+#define INF_MAXCODES	(INF_MAXLCODES+INF_MAXDCODES)
+#define INF_FIXLCODES	288
+
+/*-----------------------------------------------------------------------------
+   								Private types
+ -----------------------------------------------------------------------------*/
+
+/* A binary table column: byte offset in a row, -1 if absent */
+typedef struct _zcolumn_ {
+	int			offset ;
+	/* Type letter, element type letter for descriptors (P or Q) */
+	int			type ;
+	int			etype ;
+} zcolumn ;
+
+/* Private part of a qfits_zimage */
+typedef struct _zimage_priv_ {
+	/* Mapped file */
+	char			*	map ;
+	size_t				mapsize ;
+	/* Binary table: rows and heap */
+	unsigned char	*	table ;
+	unsigned char	*	heap ;
+	long				heapsize ;
+	int					rowlen ;
+	int					nrows ;
+	/* Columns */
+	zcolumn				cdata ;
+	zcolumn				gdata ;
+	zcolumn				udata ;
+	zcolumn				zscale ;
+	zcolumn				zzero ;
+	zcolumn				zblank ;
+	/* Rice parameters */
+	int					blocksize ;
+	int					bytepix ;
+	/* Quantization */
+	int					quantiz ;
+	int					dither0 ;
+	int					has_kscale ;
+	double				kscale ;
+	double				kzero ;
+	int					has_kblank ;
+	int					kblank ;
+} zimage_priv ;
+
+/* Bit reader for Rice decompression */
+typedef struct _rice_in_ {
+	unsigned char	*	p ;
+	unsigned char	*	end ;
+	unsigned long		acc ;
+	int					n ;
+	int					err ;
+} rice_in ;
+
+/* Bit writer for Rice compression */
+typedef struct _rice_out_ {
+	unsigned char	*	p ;
+	unsigned char	*	end ;
+	unsigned long		acc ;
+	int					n ;
+	int					err ;
+} rice_out ;
+
+/* Inflate state */
+typedef struct _inf_state_ {
+	unsigned char	*	out ;
+	long				outlen ;
+	long				outcnt ;
+	unsigned char	*	in ;
+	long				inlen ;
+	long				incnt ;
+	unsigned long		bitbuf ;
+	int					bitcnt ;
+	int					err ;
+} inf_state ;
+
+/* Canonical Huffman code for inflate */
+typedef struct _inf_huffman_ {
+	short			*	count ;
+	short			*	symbol ;
+} inf_huffman ;
+
+/*-----------------------------------------------------------------------------
+   								Static variables
+ -----------------------------------------------------------------------------*/
+
+/* Random sequence used for subtractive dithering */
+static float	zimage_rand[ZIMAGE_NRANDOM] ;
+static int		zimage_rand_init = 0 ;
+
+/*-----------------------------------------------------------------------------
+   								Private functions
+ -----------------------------------------------------------------------------*/
+
+/* Big-endian readers */
+static unsigned long zimage_be32(unsigned char * p)
+{
+	return ((unsigned long)p[0]<<24) | ((unsigned long)p[1]<<16) |
+		   ((unsigned long)p[2]<<8)  |  (unsigned long)p[3] ;
+}
+
+static int zimage_int32(unsigned char * p)
+{
+	unsigned long	v ;
+
+	v = zimage_be32(p) ;
+	if (v & 0x80000000UL) return -(int)((~v & 0x7fffffffUL)) - 1 ;
+	return (int)v ;
+}
+
+static double zimage_float(unsigned char * p, int sz)
+{
+	unsigned char	b[8] ;
+	float			f ;
+	double			d ;
+	int				i ;
+
+	for (i=0 ; i<sz ; i++) {
+#ifdef WORDS_BIGENDIAN
+		b[i] = p[i] ;
+#else
+		b[i] = p[sz-1-i] ;
+#endif
+	}
+	if (sz==4) {
+		memcpy(&f, b, 4);
+		return (double)f ;
+	}
+	memcpy(&d, b, 8);
+	return d ;
+}
+
+static double zimage_nan(void)
+{
+	double	zero ;
+	zero = 0.0 ;
+	return zero/zero ;
+}
+
+/* Initialize the random sequence used for dithering */
+static void zimage_init_random(void)
+{
+	double	a, m, seed, temp ;
+	int		i ;
+
+	if (zimage_rand_init) return ;
+	a = 16807.0 ;
+	m = 2147483647.0 ;
+	seed = 1.0 ;
+	for (i=0 ; i<ZIMAGE_NRANDOM ; i++) {
+		temp = a * seed ;
+		seed = temp - m * (double)((int)(temp/m)) ;
+		zimage_rand[i] = (float)(seed/m) ;
+	}
+	zimage_rand_init = 1 ;
+	return ;
+}
+
+/* Width in bytes of a binary table field, -1 if unsupported */
+static int zimage_parse_tform(char * tform, int * type, int * etype)
+{
+	int		r ;
+	char *	s ;
+
+	s = tform ;
+	r = 0 ;
+	if (*s<'0' || *s>'9') r=1 ;
+	while (*s>='0' && *s<='9') {
+		r = 10*r + (*s-'0') ;
+		s++ ;
+	}
+	*type  = *s ;
+	*etype = 0 ;
+	switch (*s) {
+		case 'L': case 'B': case 'A': return r ;
+		case 'X': return (r+7)/8 ;
+		case 'I': return 2*r ;
+		case 'J': case 'E': return 4*r ;
+		case 'K': case 'D': case 'C': return 8*r ;
+		case 'M': return 16*r ;
+		case 'P': *etype = s[1] ; return 8*r ;
+		case 'Q': *etype = s[1] ; return 16*r ;
+	}
+	return -1 ;
+}
+
+/* Size in bytes of a descriptor element */
+static int zimage_elemsize(int etype)
+{
+	switch (etype) {
+		case 'B': return 1 ;
+		case 'I': return 2 ;
+		case 'J': case 'E': return 4 ;
+		case 'K': case 'D': return 8 ;
+	}
+	return 0 ;
+}
+
+/* Get the heap zone pointed to by a descriptor, NULL if empty or bad */
+static unsigned char * zimage_get_desc(
+		zimage_priv	*	p,
+		zcolumn		*	c,
+		int				tile,
+		long		*	nbytes,
+		long		*	nelem)
+{
+	unsigned char	*	row ;
+	unsigned long		n, offs ;
+
+	*nbytes = 0 ;
+	*nelem  = 0 ;
+	if (c->offset<0) return NULL ;
+	row = p->table + (long)tile * p->rowlen + c->offset ;
+	if (c->type=='P') {
+		n    = zimage_be32(row) ;
+		offs = zimage_be32(row+4) ;
+	} else if (c->type=='Q') {
+		if (zimage_be32(row)!=0 || zimage_be32(row+8)!=0) return NULL ;
+		n    = zimage_be32(row+4) ;
+		offs = zimage_be32(row+12) ;
+	} else {
+		return NULL ;
+	}
+	if (n==0) return NULL ;
+	*nelem  = (long)n ;
+	*nbytes = (long)n * zimage_elemsize(c->etype) ;
+	if ((long)offs + *nbytes > p->heapsize) return NULL ;
+	return p->heap + offs ;
+}
+
+/* Read a scalar numeric column value */
+static double zimage_get_value(zimage_priv * p, zcolumn * c, int tile)
+{
+	unsigned char	*	v ;
+
+	v = p->table + (long)tile * p->rowlen + c->offset ;
+	switch (c->type) {
+		case 'D': return zimage_float(v, 8);
+		case 'E': return zimage_float(v, 4);
+		case 'J': return (double)zimage_int32(v);
+		case 'I': return (double)(short)((v[0]<<8) | v[1]);
+		case 'B': return (double)v[0] ;
+	}
+	return 0.0 ;
+}
+
+/* Get a bit field from a Rice stream, nbits up to 32 */
+static unsigned long rice_get(rice_in * r, int nbits)
+{
+	unsigned long	v ;
+
+	if (nbits>24) {
+		v = rice_get(r, nbits-16) << 16 ;
+		return v | rice_get(r, 16) ;
+	}
+	while (r->n < nbits) {
+		if (r->p < r->end) {
+			r->acc = (r->acc << 8) | *(r->p)++ ;
+		} else {
+			r->acc <<= 8 ;
+			r->err = 1 ;
+		}
+		r->n += 8 ;
+	}
+	r->n -= nbits ;
+	v = (r->acc >> r->n) & ZMASK(nbits) ;
+	r->acc &= ZMASK(r->n) ;
+	return v ;
+}
+
+/* Count zero bits up to the next 1 in a Rice stream, skip the 1 */
+static unsigned long rice_get_unary(rice_in * r)
+{
+	unsigned long	nzero ;
+	int				hb ;
+
+	nzero = 0 ;
+	while (r->acc==0) {
+		nzero += r->n ;
+		r->n = 0 ;
+		if (r->p >= r->end) {
+			r->err = 1 ;
+			return 0 ;
+		}
+		r->acc = *(r->p)++ ;
+		r->n = 8 ;
+	}
+	hb = r->n-1 ;
+	while (!((r->acc >> hb) & 1)) hb-- ;
+	nzero += r->n-1-hb ;
+	r->n = hb ;
+	r->acc &= ZMASK(hb) ;
+	return nzero ;
+}
+
+/* Put a bit field into a Rice stream, nbits up to 32 */
+static void rice_put(rice_out * o, unsigned long v, int nbits)
+{
+	if (nbits>24) {
+		rice_put(o, v>>16, nbits-16) ;
+		rice_put(o, v & 0xffffUL, 16) ;
+		return ;
+	}
+	o->acc = (o->acc << nbits) | (v & ZMASK(nbits)) ;
+	o->n  += nbits ;
+	while (o->n >= 8) {
+		o->n -= 8 ;
+		if (o->p < o->end) {
+			*(o->p)++ = (unsigned char)((o->acc >> o->n) & 0xff) ;
+		} else {
+			o->err = 1 ;
+		}
+	}
+	o->acc &= ZMASK(o->n) ;
+	return ;
+}
+
+/* Rice parameters for a pixel size */
+static int rice_params(int bytepix, int * fsbits, int * fsmax)
+{
+	switch (bytepix) {
+		case 1: *fsbits = 3 ; *fsmax = 6  ; return 0 ;
+		case 2: *fsbits = 4 ; *fsmax = 14 ; return 0 ;
+		case 4: *fsbits = 5 ; *fsmax = 25 ; return 0 ;
+	}
+	return -1 ;
+}
+
+/*
+ * Inflate (RFC 1951). The decoder works on a complete input buffer and
+ * writes to an output buffer of known size.
+ */
+static int inf_bits(inf_state * s, int need)
+{
+	unsigned long	val ;
+
+	val = s->bitbuf ;
+	while (s->bitcnt < need) {
+		if (s->incnt == s->inlen) {
+			s->err = 1 ;
+			return 0 ;
+		}
+		val |= (unsigned long)(s->in[s->incnt++]) << s->bitcnt ;
+		s->bitcnt += 8 ;
+	}
+	s->bitbuf = val >> need ;
+	s->bitcnt -= need ;
+	return (int)(val & ((1UL << need) - 1)) ;
+}
+
+static int inf_stored(inf_state * s)
+{
+	unsigned	len ;
+
+	s->bitbuf = 0 ;
+	s->bitcnt = 0 ;
+	if (s->incnt + 4 > s->inlen) return -1 ;
+	len  = s->in[s->incnt++] ;
+	len |= s->in[s->incnt++] << 8 ;
+	if (s->in[s->incnt++] != (~len & 0xff) ||
+		s->in[s->incnt++] != ((~len >> 8) & 0xff)) return -1 ;
+	if (s->incnt + (long)len > s->inlen) return -1 ;
+	if (s->outcnt + (long)len > s->outlen) return -1 ;
+	memcpy(s->out + s->outcnt, s->in + s->incnt, len);
+	s->outcnt += len ;
+	s->incnt  += len ;
+	return 0 ;
+}
+
+static int inf_decode(inf_state * s, inf_huffman * h)
+{
+	int		len, code, first, count, index ;
+
+	code = first = index = 0 ;
+	for (len=1 ; len<=INF_MAXBITS ; len++) {
+		code |= inf_bits(s, 1) ;
+		if (s->err) return -1 ;
+		count = h->count[len] ;
+		if (code - count < first) return h->symbol[index + (code - first)] ;
+		index += count ;
+		first += count ;
+		first <<= 1 ;
+		code  <<= 1 ;
+	}
+	return -1 ;
+}
+
+static int inf_construct(inf_huffman * h, short * length, int n)
+{
+	short	offs[INF_MAXBITS+1] ;
+	int		symbol, len, left ;
+
+	for (len=0 ; len<=INF_MAXBITS ; len++) h->count[len] = 0 ;
+	for (symbol=0 ; symbol<n ; symbol++) h->count[length[symbol]]++ ;
+	if (h->count[0]==n) return 0 ;
+	left = 1 ;
+	for (len=1 ; len<=INF_MAXBITS ; len++) {
+		left <<= 1 ;
+		left -= h->count[len] ;
+		if (left<0) return left ;
+	}
+	offs[1] = 0 ;
+	for (len=1 ; len<INF_MAXBITS ; len++) {
+		offs[len+1] = offs[len] + h->count[len] ;
+	}
+	for (symbol=0 ; symbol<n ; symbol++) {
+		if (length[symbol]!=0) h->symbol[offs[length[symbol]]++] = symbol ;
+	}
+	return left ;
+}
+
+static int inf_codes(
+		inf_state		*	s,
+		inf_huffman		*	lencode,
+		inf_huffman		*	distcode)
+{
+	static const short lens[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 } ;
+	static const short lext[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 } ;
+	static const short dists[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+		8193, 12289, 16385, 24577 } ;
+	static const short dext[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 } ;
+	int		symbol, len ;
+	long	dist ;
+
+	do {
+		symbol = inf_decode(s, lencode) ;
+		if (symbol<0) return -1 ;
+		if (symbol<256) {
+			if (s->outcnt==s->outlen) return -1 ;
+			s->out[s->outcnt++] = (unsigned char)symbol ;
+		} else if (symbol>256) {
+			symbol -= 257 ;
+			if (symbol>=29) return -1 ;
+			len = lens[symbol] + inf_bits(s, lext[symbol]) ;
+			symbol = inf_decode(s, distcode) ;
+			if (symbol<0 || symbol>=30) return -1 ;
+			dist = dists[symbol] + inf_bits(s, dext[symbol]) ;
+			if (s->err) return -1 ;
+			if (dist > s->outcnt) return -1 ;
+			if (s->outcnt + len > s->outlen) return -1 ;
+			while (len--) {
+				s->out[s->outcnt] = s->out[s->outcnt - dist] ;
+				s->outcnt++ ;
+			}
+		}
+	} while (symbol!=256) ;
+	return 0 ;
+}
+
+static int inf_fixed(inf_state * s)
+{
+	short			lencnt[INF_MAXBITS+1], lensym[INF_FIXLCODES] ;
+	short			distcnt[INF_MAXBITS+1], distsym[INF_MAXDCODES] ;
+	short			lengths[INF_FIXLCODES] ;
+	inf_huffman		lencode, distcode ;
+	int				symbol ;
+
+	lencode.count  = lencnt ;
+	lencode.symbol = lensym ;
+	distcode.count  = distcnt ;
+	distcode.symbol = distsym ;
+	for (symbol=0 ; symbol<144 ; symbol++) lengths[symbol] = 8 ;
+	for ( ; symbol<256 ; symbol++) lengths[symbol] = 9 ;
+	for ( ; symbol<280 ; symbol++) lengths[symbol] = 7 ;
+	for ( ; symbol<INF_FIXLCODES ; symbol++) lengths[symbol] = 8 ;
+	inf_construct(&lencode, lengths, INF_FIXLCODES) ;
+	for (symbol=0 ; symbol<INF_MAXDCODES ; symbol++) lengths[symbol] = 5 ;
+	inf_construct(&distcode, lengths, INF_MAXDCODES) ;
+	return inf_codes(s, &lencode, &distcode) ;
+}
+
+static int inf_dynamic(inf_state * s)
+{
+	static const short order[19] = {
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 } ;
+	short			lengths[INF_MAXCODES] ;
+	short			lencnt[INF_MAXBITS+1], lensym[INF_MAXLCODES] ;
+	short			distcnt[INF_MAXBITS+1], distsym[INF_MAXDCODES] ;
+	inf_huffman		lencode, distcode ;
+	int				nlen, ndist, ncode ;
+	int				index, symbol, len, err ;
+
+	lencode.count  = lencnt ;
+	lencode.symbol = lensym ;
+	distcode.count  = distcnt ;
+	distcode.symbol = distsym ;
+
+	nlen  = inf_bits(s, 5) + 257 ;
+	ndist = inf_bits(s, 5) + 1 ;
+	ncode = inf_bits(s, 4) + 4 ;
+	if (s->err || nlen>INF_MAXLCODES || ndist>INF_MAXDCODES) return -1 ;
+
+	for (index=0 ; index<ncode ; index++) {
+		lengths[order[index]] = (short)inf_bits(s, 3) ;
+	}
+	for ( ; index<19 ; index++) lengths[order[index]] = 0 ;
+	if (s->err) return -1 ;
+	if (inf_construct(&lencode, lengths, 19)!=0) return -1 ;
+
+	index = 0 ;
+	while (index < nlen+ndist) {
+		symbol = inf_decode(s, &lencode) ;
+		if (symbol<0) return -1 ;
+		if (symbol<16) {
+			lengths[index++] = (short)symbol ;
+		} else {
+			len = 0 ;
+			if (symbol==16) {
+				if (index==0) return -1 ;
+				len = lengths[index-1] ;
+				symbol = 3 + inf_bits(s, 2) ;
+			} else if (symbol==17) {
+				symbol = 3 + inf_bits(s, 3) ;
+			} else {
+				symbol = 11 + inf_bits(s, 7) ;
+			}
+			if (s->err || index+symbol > nlen+ndist) return -1 ;
+			while (symbol--) lengths[index++] = (short)len ;
+		}
+	}
+	if (lengths[256]==0) return -1 ;
+	err = inf_construct(&lencode, lengths, nlen) ;
+	if (err && (err<0 || nlen != lencode.count[0]+lencode.count[1])) return -1 ;
+	err = inf_construct(&distcode, lengths+nlen, ndist) ;
+	if (err && (err<0 || ndist != distcode.count[0]+distcode.count[1])) return -1 ;
+	return inf_codes(s, &lencode, &distcode) ;
+}
+
+/* Inflate a gzip (or zlib) stream into exactly outlen bytes */
+static int zimage_gunzip(
+		unsigned char	*	in,
+		long				inlen,
+		unsigned char	*	out,
+		long				outlen)
+{
+	inf_state	s ;
+	int			flags ;
+	int			last, type, err ;
+
+	s.in     = in ;
+	s.inlen  = inlen ;
+	s.incnt  = 0 ;
+	s.out    = out ;
+	s.outlen = outlen ;
+	s.outcnt = 0 ;
+	s.bitbuf = 0 ;
+	s.bitcnt = 0 ;
+	s.err    = 0 ;
+
+	/* Skip gzip or zlib wrapper */
+	if (inlen>=10 && in[0]==0x1f && in[1]==0x8b) {
+		if (in[2]!=8) return -1 ;
+		flags = in[3] ;
+		s.incnt = 10 ;
+		if (flags & 4) {
+			if (s.incnt+2 > inlen) return -1 ;
+			s.incnt += 2 + (in[s.incnt] | (in[s.incnt+1]<<8)) ;
+		}
+		if (flags & 8) {
+			while (s.incnt<inlen && in[s.incnt]!=0) s.incnt++ ;
+			s.incnt++ ;
+		}
+		if (flags & 16) {
+			while (s.incnt<inlen && in[s.incnt]!=0) s.incnt++ ;
+			s.incnt++ ;
+		}
+		if (flags & 2) s.incnt += 2 ;
+		if (s.incnt >= inlen) return -1 ;
+	} else if (inlen>=2 && (in[0] & 0x0f)==8 && ((in[0]<<8)|in[1])%31==0) {
+		s.incnt = 2 ;
+	}
+
+	do {
+		last = inf_bits(&s, 1) ;
+		type = inf_bits(&s, 2) ;
+		if (s.err) return -1 ;
+		switch (type) {
+			case 0: err = inf_stored(&s) ; break ;
+			case 1: err = inf_fixed(&s) ; break ;
+			case 2: err = inf_dynamic(&s) ; break ;
+			default: err = -1 ; break ;
+		}
+		if (err!=0) return -1 ;
+	} while (!last) ;
+	return (s.outcnt==outlen) ? 0 : -1 ;
+}
+
+/*-----------------------------------------------------------------------------
+  							Function codes
+ -----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Rice-compress a buffer of integers.
+  @param    in          Input pixels.
+  @param    npix        Number of input pixels.
+  @param    bytepix     Size in bytes of the pixels (1, 2 or 4).
+  @param    blocksize   Number of pixels per Rice block.
+  @param    out         Output buffer.
+  @param    outsize     Size of the output buffer in bytes.
+  @return   int number of bytes written to out, -1 in case of error.
+
+  Input values must fit in the requested number of bytes. An output
+  buffer of QFITS_RICE_MAXSIZE(npix, bytepix) bytes is always large
+  enough.
+ */
+/*----------------------------------------------------------------------------*/
+int qfits_rice_compress(
+        int         *   in,
+        int             npix,
+        int             bytepix,
+        int             blocksize,
+        unsigned char * out,
+        int             outsize)
+{
+	rice_out			o ;
+	unsigned long	*	diff ;
+	unsigned long		mask, last, next, pdiff, v ;
+	double				psum, dpsum ;
+	int					fsbits, fsmax, bbits ;
+	int					i, j, nb, fs ;
+	unsigned long		top ;
+
+	if (in==NULL || out==NULL || npix<1 || blocksize<1) return -1 ;
+	if (rice_params(bytepix, &fsbits, &fsmax)!=0) return -1 ;
+	bbits = 8*bytepix ;
+	mask  = ZMASK(bbits) ;
+
+	o.p   = out ;
+	o.end = out + outsize ;
+	o.acc = 0 ;
+	o.n   = 0 ;
+	o.err = 0 ;
+
+	diff = malloc(blocksize * sizeof(unsigned long)) ;
+	last = (unsigned long)in[0] & mask ;
+	rice_put(&o, last, bbits) ;
+
+	for (i=0 ; i<npix ; i+=blocksize) {
+		nb = npix-i ;
+		if (nb>blocksize) nb=blocksize ;
+		/* Map differences to non-negative values */
+		psum = 0.0 ;
+		for (j=0 ; j<nb ; j++) {
+			next  = (unsigned long)in[i+j] & mask ;
+			pdiff = (next - last) & mask ;
+			if ((pdiff >> (bbits-1)) & 1) {
+				diff[j] = ~(pdiff<<1) & mask ;
+			} else {
+				diff[j] = (pdiff<<1) & mask ;
+			}
+			psum += (double)diff[j] ;
+			last  = next ;
+		}
+		/* Pick the number of split bits */
+		dpsum = (psum - (nb/2) - 1) / nb ;
+		if (dpsum<0) dpsum = 0.0 ;
+		v = ((unsigned long)dpsum) >> 1 ;
+		for (fs=0 ; v>0 ; fs++) v >>= 1 ;
+
+		if (fs>=fsmax) {
+			/* High entropy: raw differences */
+			rice_put(&o, (unsigned long)(fsmax+1), fsbits) ;
+			for (j=0 ; j<nb ; j++) rice_put(&o, diff[j], bbits) ;
+		} else if (fs==0 && psum==0.0) {
+			/* Low entropy: all differences are zero */
+			rice_put(&o, 0, fsbits) ;
+		} else {
+			rice_put(&o, (unsigned long)(fs+1), fsbits) ;
+			for (j=0 ; j<nb ; j++) {
+				/* Unary coded top bits, then fs low bits */
+				top = diff[j] >> fs ;
+				while (top>=24) {
+					rice_put(&o, 0, 24) ;
+					top -= 24 ;
+				}
+				rice_put(&o, 1, (int)top+1) ;
+				if (fs>0) rice_put(&o, diff[j], fs) ;
+			}
+		}
+		if (o.err) break ;
+	}
+	/* Flush remaining bits */
+	if (o.n>0) rice_put(&o, 0, 8-o.n) ;
+	free(diff) ;
+	if (o.err) return -1 ;
+	return (int)(o.p - out) ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Decompress a Rice-compressed buffer of integers.
+  @param    in          Compressed bytes.
+  @param    insize      Number of compressed bytes.
+  @param    bytepix     Size in bytes of the pixels (1, 2 or 4).
+  @param    blocksize   Number of pixels per Rice block.
+  @param    out         Output pixels.
+  @param    npix        Number of pixels to decompress.
+  @return   int 0 if Ok, -1 in case of error.
+ */
+/*----------------------------------------------------------------------------*/
+int qfits_rice_decompress(
+        unsigned char * in,
+        int             insize,
+        int             bytepix,
+        int             blocksize,
+        int         *   out,
+        int             npix)
+{
+	rice_in			r ;
+	unsigned long	mask, sign, last, diff ;
+	int				fsbits, fsmax, bbits ;
+	int				i, imax, fs ;
+
+	if (in==NULL || out==NULL || npix<1 || blocksize<1) return -1 ;
+	if (rice_params(bytepix, &fsbits, &fsmax)!=0) return -1 ;
+	bbits = 8*bytepix ;
+	mask  = ZMASK(bbits) ;
+	sign  = 1UL << (bbits-1) ;
+
+	r.p   = in ;
+	r.end = in + insize ;
+	r.acc = 0 ;
+	r.n   = 0 ;
+	r.err = 0 ;
+
+	last = rice_get(&r, bbits) ;
+	for (i=0 ; i<npix ; ) {
+		fs = (int)rice_get(&r, fsbits) - 1 ;
+		imax = i + blocksize ;
+		if (imax>npix) imax=npix ;
+		for ( ; i<imax ; i++) {
+			if (fs<0) {
+				diff = 0 ;
+			} else if (fs==fsmax) {
+				diff = rice_get(&r, bbits) ;
+			} else {
+				diff = rice_get_unary(&r) << fs ;
+				if (fs>0) diff |= rice_get(&r, fs) ;
+			}
+			/* Undo mapping and differencing */
+			if (diff & 1) diff = ~(diff>>1) ;
+			else          diff = diff>>1 ;
+			last = (last + diff) & mask ;
+			/* BITPIX=8 is unsigned, others are signed */
+			if (bytepix>1 && (last & sign)) {
+				out[i] = -(int)((~last & mask)) - 1 ;
+			} else {
+				out[i] = (int)last ;
+			}
+		}
+		if (r.err) return -1 ;
+	}
+	return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Find out if an extension holds a tile-compressed image.
+  @param    filename    Name of the FITS file.
+  @param    xtnum       Extension number (starting from 1).
+  @return   int 1 if the extension has ZIMAGE=T, 0 otherwise.
+ */
+/*----------------------------------------------------------------------------*/
+int qfits_is_zimage(char * filename, int xtnum)
+{
+	char	*	sval ;
+
+	if (filename==NULL || xtnum<1) return 0 ;
+	sval = qfits_query_ext(filename, "ZIMAGE", xtnum) ;
+	if (sval==NULL) return 0 ;
+	return (sval[0]=='T') ? 1 : 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Open a tile-compressed image for reading.
+  @param    filename    Name of the FITS file.
+  @param    xtnum       Extension number (starting from 1).
+  @return   1 newly allocated qfits_zimage, or NULL in case of error.
+
+  The file is mapped into memory until qfits_zimage_close() is called.
+  Images with more than 3 axes, or compressed with an unsupported
+  algorithm (PLIO_1, HCOMPRESS_1), are rejected.
+ */
+/*----------------------------------------------------------------------------*/
+qfits_zimage * qfits_zimage_open(char * filename, int xtnum)
+{
+	qfits_zimage	*	z ;
+	zimage_priv		*	p ;
+	qfits_header	*	fh ;
+	char				key[FITS_LINESZ+1] ;
+	char				name[FITS_LINESZ+1] ;
+	char			*	sval ;
+	zcolumn			*	col ;
+	int					naxis, size[3], tile[3] ;
+	int					tfields, offset, width ;
+	int					type, etype ;
+	int					seg_start, seg_size ;
+	long				theap ;
+	int					i ;
+
+	if (!qfits_is_zimage(filename, xtnum)) {
+		qfits_error("not a tile-compressed image: ext %d in %s",
+					xtnum, filename);
+		return NULL ;
+	}
+	fh = qfits_header_readext(filename, xtnum) ;
+	if (fh==NULL) {
+		qfits_error("cannot read header of ext %d in %s", xtnum, filename);
+		return NULL ;
+	}
+	z = calloc(1, sizeof(qfits_zimage)) ;
+	p = calloc(1, sizeof(zimage_priv)) ;
+	z->_priv = p ;
+	p->cdata.offset  = p->gdata.offset = p->udata.offset = -1 ;
+	p->zscale.offset = p->zzero.offset = p->zblank.offset = -1 ;
+
+	/* Image description */
+	z->bitpix = qfits_header_getint(fh, "ZBITPIX", 0) ;
+	naxis     = qfits_header_getint(fh, "ZNAXIS", 0) ;
+	if (naxis<1 || naxis>3) {
+		qfits_error("unsupported ZNAXIS=%d in %s", naxis, filename);
+		goto fail ;
+	}
+	for (i=0 ; i<3 ; i++) {
+		size[i] = 1 ;
+		tile[i] = 1 ;
+		if (i<naxis) {
+			sprintf(key, "ZNAXIS%d", i+1) ;
+			size[i] = qfits_header_getint(fh, key, 0) ;
+			sprintf(key, "ZTILE%d", i+1) ;
+			tile[i] = qfits_header_getint(fh, key, i==0 ? size[0] : 1) ;
+		}
+		if (size[i]<1 || tile[i]<1) {
+			qfits_error("invalid image or tile size in %s", filename);
+			goto fail ;
+		}
+	}
+	z->lx = size[0] ; z->tx = tile[0] ; z->ntx = (size[0]+tile[0]-1)/tile[0] ;
+	z->ly = size[1] ; z->ty = tile[1] ; z->nty = (size[1]+tile[1]-1)/tile[1] ;
+	z->np = size[2] ; z->tz = tile[2] ; z->ntz = (size[2]+tile[2]-1)/tile[2] ;
+	z->ntiles = z->ntx * z->nty * z->ntz ;
+	z->bscale = qfits_header_getdouble(fh, "BSCALE", 1.0) ;
+	z->bzero  = qfits_header_getdouble(fh, "BZERO",  0.0) ;
+
+	/* Compression algorithm and parameters */
+	sval = qfits_pretty_string(qfits_header_getstr(fh, "ZCMPTYPE")) ;
+	z->cmptype = QFITS_ZCMP_NONE ;
+	if (sval!=NULL) {
+		if (!strcmp(sval, "RICE_1") || !strcmp(sval, "RICE_ONE")) {
+			z->cmptype = QFITS_ZCMP_RICE ;
+		} else if (!strcmp(sval, "GZIP_1")) {
+			z->cmptype = QFITS_ZCMP_GZIP1 ;
+		} else if (!strcmp(sval, "GZIP_2")) {
+			z->cmptype = QFITS_ZCMP_GZIP2 ;
+		}
+	}
+	if (z->cmptype==QFITS_ZCMP_NONE) {
+		qfits_error("unsupported compression [%s] in %s",
+					sval==NULL ? "none" : sval, filename);
+		goto fail ;
+	}
+	p->blocksize = QFITS_RICE_BLOCKSIZE ;
+	p->bytepix   = 4 ;
+	for (i=1 ; ; i++) {
+		sprintf(key, "ZNAME%d", i) ;
+		sval = qfits_pretty_string(qfits_header_getstr(fh, key)) ;
+		if (sval==NULL) break ;
+		strcpy(name, sval) ;
+		sprintf(key, "ZVAL%d", i) ;
+		if (!strcmp(name, "BLOCKSIZE")) {
+			p->blocksize = qfits_header_getint(fh, key, QFITS_RICE_BLOCKSIZE) ;
+		} else if (!strcmp(name, "BYTEPIX")) {
+			p->bytepix = qfits_header_getint(fh, key, 4) ;
+		}
+	}
+	if (z->bitpix==8 || z->bitpix==16) p->bytepix = z->bitpix/8 ;
+
+	/* Quantization of floating-point images */
+	if (qfits_header_getstr(fh, "ZSCALE")!=NULL) {
+		p->has_kscale = 1 ;
+		p->kscale = qfits_header_getdouble(fh, "ZSCALE", 0.0) ;
+	}
+	p->kzero  = qfits_header_getdouble(fh, "ZZERO",  0.0) ;
+	if (qfits_header_getstr(fh, "ZBLANK")!=NULL) {
+		p->has_kblank = 1 ;
+		p->kblank = qfits_header_getint(fh, "ZBLANK", 0) ;
+	}
+	p->dither0 = qfits_header_getint(fh, "ZDITHER0", 1) ;
+	p->quantiz = ZQUANT_NONE ;
+	sval = qfits_pretty_string(qfits_header_getstr(fh, "ZQUANTIZ")) ;
+	if (z->bitpix<0 && sval!=NULL) {
+		if (!strcmp(sval, "SUBTRACTIVE_DITHER_1")) {
+			p->quantiz = ZQUANT_DITHER1 ;
+		} else if (!strcmp(sval, "SUBTRACTIVE_DITHER_2")) {
+			p->quantiz = ZQUANT_DITHER2 ;
+		} else if (!strcmp(sval, "NO_DITHER")) {
+			p->quantiz = ZQUANT_NODITHER ;
+		}
+	}
+
+	/* Binary table layout */
+	p->rowlen = qfits_header_getint(fh, "NAXIS1", 0) ;
+	p->nrows  = qfits_header_getint(fh, "NAXIS2", 0) ;
+	p->heapsize = (long)qfits_header_getdouble(fh, "PCOUNT", 0.0) ;
+	theap = (long)qfits_header_getdouble(fh, "THEAP",
+										 (double)p->rowlen * p->nrows) ;
+	tfields = qfits_header_getint(fh, "TFIELDS", 0) ;
+	offset = 0 ;
+	for (i=1 ; i<=tfields ; i++) {
+		sprintf(key, "TFORM%d", i) ;
+		sval = qfits_pretty_string(qfits_header_getstr(fh, key)) ;
+		if (sval==NULL) {
+			qfits_error("missing %s in %s", key, filename);
+			goto fail ;
+		}
+		width = zimage_parse_tform(sval, &type, &etype) ;
+		if (width<0) {
+			qfits_error("unsupported %s [%s] in %s", key, sval, filename);
+			goto fail ;
+		}
+		sprintf(key, "TTYPE%d", i) ;
+		sval = qfits_pretty_string(qfits_header_getstr(fh, key)) ;
+		col = NULL ;
+		if (sval!=NULL) {
+			if (!strcmp(sval, "COMPRESSED_DATA"))			col = &p->cdata ;
+			else if (!strcmp(sval, "GZIP_COMPRESSED_DATA"))	col = &p->gdata ;
+			else if (!strcmp(sval, "UNCOMPRESSED_DATA"))	col = &p->udata ;
+			else if (!strcmp(sval, "ZSCALE"))				col = &p->zscale ;
+			else if (!strcmp(sval, "ZZERO"))				col = &p->zzero ;
+			else if (!strcmp(sval, "ZBLANK"))				col = &p->zblank ;
+		}
+		if (col!=NULL) {
+			col->offset = offset ;
+			col->type   = type ;
+			col->etype  = etype ;
+		}
+		offset += width ;
+	}
+	qfits_header_destroy(fh) ;
+	fh = NULL ;
+	if (p->cdata.offset<0 || offset>p->rowlen || p->nrows<z->ntiles) {
+		qfits_error("invalid compressed image table in %s", filename);
+		goto fail ;
+	}
+	/*
+	 * Floating-point tiles are quantized if and only if a scale factor is
+	 * given: without one, they are stored losslessly whatever ZQUANTIZ
+	 * says (e.g. NO_DITHER written for quantize_level=0).
+	 */
+	if (z->bitpix<0) {
+		if (p->zscale.offset<0 && !p->has_kscale) {
+			p->quantiz = ZQUANT_NONE ;
+		} else if (p->quantiz==ZQUANT_NONE) {
+			p->quantiz = ZQUANT_NODITHER ;
+		}
+	}
+
+	/* Map the file */
+	if (qfits_get_datinfo(filename, xtnum, &seg_start, &seg_size)!=0) {
+		qfits_error("cannot get data segment of ext %d in %s",
+					xtnum, filename);
+		goto fail ;
+	}
+	p->map = falloc(filename, 0, &(p->mapsize)) ;
+	if (p->map==NULL) {
+		qfits_error("cannot map %s", filename);
+		goto fail ;
+	}
+	if ((size_t)(seg_start + theap + p->heapsize) > p->mapsize) {
+		qfits_error("truncated compressed image in %s", filename);
+		goto fail ;
+	}
+	p->table = (unsigned char*)p->map + seg_start ;
+	p->heap  = p->table + theap ;
+	if (p->quantiz==ZQUANT_DITHER1 || p->quantiz==ZQUANT_DITHER2) {
+		zimage_init_random() ;
+	}
+	return z ;
+
+fail:
+	if (fh!=NULL) qfits_header_destroy(fh) ;
+	qfits_zimage_close(z) ;
+	return NULL ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Close a tile-compressed image.
+  @param    z   Image to close.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+void qfits_zimage_close(qfits_zimage * z)
+{
+	zimage_priv	*	p ;
+
+	if (z==NULL) return ;
+	p = (zimage_priv*)z->_priv ;
+	if (p!=NULL) {
+		if (p->map!=NULL) fdealloc(p->map, 0, p->mapsize) ;
+		free(p) ;
+	}
+	free(z) ;
+	return ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get the position and size of a tile.
+  @param    z       Opened image.
+  @param    tile    Tile number.
+  @param    pos     Returned position of the first tile pixel (x,y,z from 0).
+  @param    size    Returned size of the tile in x, y and z.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Tiles on the upper edges of the image may be smaller than the
+  nominal tile size.
+ */
+/*----------------------------------------------------------------------------*/
+int qfits_zimage_tile_box(qfits_zimage * z, int tile, int * pos, int * size)
+{
+	if (z==NULL || pos==NULL || size==NULL) return -1 ;
+	if (tile<0 || tile>=z->ntiles) return -1 ;
+	pos[0] = (tile % z->ntx) * z->tx ;
+	pos[1] = ((tile / z->ntx) % z->nty) * z->ty ;
+	pos[2] = (tile / (z->ntx * z->nty)) * z->tz ;
+	size[0] = (pos[0]+z->tx > z->lx) ? z->lx-pos[0] : z->tx ;
+	size[1] = (pos[1]+z->ty > z->ly) ? z->ly-pos[1] : z->ty ;
+	size[2] = (pos[2]+z->tz > z->np) ? z->np-pos[2] : z->tz ;
+	return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Decompress one tile.
+  @param    z       Opened image.
+  @param    tile    Tile number.
+  @param    buf     Output buffer, large enough for the tile.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The tile pixels are written to buf in FITS order (see
+  qfits_zimage_tile_box() for the tile size), as physical values: BSCALE
+  and BZERO are applied, quantized floating-point pixels are restored
+  (including subtractive dithering), and null pixels are set to NaN.
+
+  This function only reads the mapped file and may be called from
+  several threads at the same time.
+ */
+/*----------------------------------------------------------------------------*/
+int qfits_zimage_read_tile(qfits_zimage * z, int tile, double * buf)
+{
+	zimage_priv		*	p ;
+	unsigned char	*	data ;
+	unsigned char	*	raw ;
+	unsigned char	*	b ;
+	int				*	ival ;
+	long				nbytes, nelem ;
+	int					pos[3], size[3] ;
+	int					npix, esize, status ;
+	int					has_blank, blank ;
+	double				scale, zero, nan ;
+	int					iseed, nextrand ;
+	int					i, k ;
+
+	if (qfits_zimage_tile_box(z, tile, pos, size)!=0) return -1 ;
+	if (buf==NULL) return -1 ;
+	p = (zimage_priv*)z->_priv ;
+	npix = size[0] * size[1] * size[2] ;
+	ival = NULL ;
+	raw  = NULL ;
+	status = -1 ;
+
+	data = zimage_get_desc(p, &p->cdata, tile, &nbytes, &nelem) ;
+	if (data!=NULL) {
+		/* Size of an uncompressed element: integers if quantized */
+		esize = (p->quantiz!=ZQUANT_NONE) ? 4 : BYTESPERPIXEL(z->bitpix) ;
+		ival = malloc(npix * sizeof(int)) ;
+		if (z->cmptype==QFITS_ZCMP_RICE) {
+			if (qfits_rice_decompress(data, (int)nbytes, p->bytepix,
+									  p->blocksize, ival, npix)!=0) {
+				qfits_error("corrupted Rice tile %d", tile+1);
+				goto done ;
+			}
+		} else {
+			raw = malloc((size_t)npix * esize) ;
+			if (zimage_gunzip(data, nbytes, raw, (long)npix*esize)!=0) {
+				qfits_error("corrupted GZIP tile %d", tile+1);
+				goto done ;
+			}
+			if (z->cmptype==QFITS_ZCMP_GZIP2) {
+				/* Undo byte shuffling */
+				b = malloc((size_t)npix * esize) ;
+				for (k=0 ; k<esize ; k++) {
+					for (i=0 ; i<npix ; i++) {
+						b[i*esize+k] = raw[k*npix+i] ;
+					}
+				}
+				free(raw) ;
+				raw = b ;
+			}
+			if (z->bitpix<0 && p->quantiz==ZQUANT_NONE) {
+				/* Lossless floating-point tile */
+				for (i=0 ; i<npix ; i++) {
+					buf[i] = zimage_float(raw+i*esize, esize) * z->bscale
+							 + z->bzero ;
+				}
+				status = 0 ;
+				goto done ;
+			}
+			for (i=0 ; i<npix ; i++) {
+				switch (esize) {
+					case 1: ival[i] = raw[i] ; break ;
+					case 2: ival[i] = (short)((raw[2*i]<<8) | raw[2*i+1]) ;
+							break ;
+					default: ival[i] = zimage_int32(raw+4*i) ; break ;
+				}
+			}
+		}
+	} else {
+		/* Tile stored without quantization */
+		data = zimage_get_desc(p, &p->gdata, tile, &nbytes, &nelem) ;
+		if (data!=NULL && z->bitpix<0) {
+			esize = BYTESPERPIXEL(z->bitpix) ;
+			raw = malloc((size_t)npix * esize) ;
+			if (zimage_gunzip(data, nbytes, raw, (long)npix*esize)!=0) {
+				qfits_error("corrupted GZIP tile %d", tile+1);
+				goto done ;
+			}
+			for (i=0 ; i<npix ; i++) {
+				buf[i] = zimage_float(raw+i*esize, esize) ;
+			}
+			status = 0 ;
+			goto done ;
+		}
+		data = zimage_get_desc(p, &p->udata, tile, &nbytes, &nelem) ;
+		if (data==NULL || nelem<npix) {
+			qfits_error("missing data for tile %d", tile+1);
+			goto done ;
+		}
+		for (i=0 ; i<npix ; i++) {
+			switch (p->udata.etype) {
+				case 'D': buf[i] = zimage_float(data+8*i, 8) ; break ;
+				case 'E': buf[i] = zimage_float(data+4*i, 4) ; break ;
+				case 'J': buf[i] = zimage_int32(data+4*i) ; break ;
+				case 'I': buf[i] = (short)((data[2*i]<<8) | data[2*i+1]) ;
+						  break ;
+				default:  buf[i] = data[i] ; break ;
+			}
+			if (z->bitpix>0) buf[i] = buf[i] * z->bscale + z->bzero ;
+		}
+		status = 0 ;
+		goto done ;
+	}
+
+	/* Integer image */
+	if (p->quantiz==ZQUANT_NONE) {
+		for (i=0 ; i<npix ; i++) {
+			buf[i] = (double)ival[i] * z->bscale + z->bzero ;
+		}
+		status = 0 ;
+		goto done ;
+	}
+
+	/* Quantized floating-point image */
+	scale = (p->zscale.offset>=0) ? zimage_get_value(p, &p->zscale, tile)
+								  : p->kscale ;
+	zero  = (p->zzero.offset>=0)  ? zimage_get_value(p, &p->zzero, tile)
+								  : p->kzero ;
+	has_blank = p->has_kblank ;
+	blank     = p->kblank ;
+	if (p->zblank.offset>=0) {
+		has_blank = 1 ;
+		blank = (int)zimage_get_value(p, &p->zblank, tile) ;
+	}
+	nan = zimage_nan() ;
+	if (p->quantiz==ZQUANT_NODITHER) {
+		for (i=0 ; i<npix ; i++) {
+			if (has_blank && ival[i]==blank) buf[i] = nan ;
+			else buf[i] = (double)ival[i] * scale + zero ;
+		}
+	} else {
+		iseed = (tile + p->dither0 - 1) % ZIMAGE_NRANDOM ;
+		nextrand = (int)(zimage_rand[iseed] * 500.0) ;
+		for (i=0 ; i<npix ; i++) {
+			if (has_blank && ival[i]==blank) {
+				buf[i] = nan ;
+			} else if (p->quantiz==ZQUANT_DITHER2 &&
+					   ival[i]==ZQUANT_ZEROVALUE) {
+				buf[i] = 0.0 ;
+			} else {
+				buf[i] = ((double)ival[i] - zimage_rand[nextrand] + 0.5)
+						 * scale + zero ;
+			}
+			nextrand++ ;
+			if (nextrand==ZIMAGE_NRANDOM) {
+				iseed++ ;
+				if (iseed==ZIMAGE_NRANDOM) iseed=0 ;
+				nextrand = (int)(zimage_rand[iseed] * 500.0) ;
+			}
+		}
+	}
+	for (i=0 ; i<npix ; i++) {
+		if (buf[i]==buf[i]) buf[i] = buf[i] * z->bscale + z->bzero ;
+	}
+	status = 0 ;
+
+done:
+	if (ival!=NULL) free(ival) ;
+	if (raw!=NULL) free(raw) ;
+	return status ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Decompress a window of an image plane.
+  @param    z       Opened image.
+  @param    pnum    Plane number (from 0).
+  @param    llx     Lower left corner in x (from 1).
+  @param    lly     Lower left corner in y (from 1).
+  @param    urx     Upper right corner in x.
+  @param    ury     Upper right corner in y.
+  @param    buf     Output buffer of (urx-llx+1)*(ury-lly+1) pixels.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Only the tiles intersecting the requested window are decompressed.
+ */
+/*----------------------------------------------------------------------------*/
+int qfits_zimage_read_window(
+        qfits_zimage    *   z,
+        int                 pnum,
+        int                 llx,
+        int                 lly,
+        int                 urx,
+        int                 ury,
+        double          *   buf)
+{
+	double	*	tbuf ;
+	int			pos[3], size[3] ;
+	int			nx ;
+	int			tx0, tx1, ty0, ty1, tz ;
+	int			ix, iy, tile ;
+	int			x0, x1, y0, y1, x, y ;
+	double	*	src ;
+
+	if (z==NULL || buf==NULL) return -1 ;
+	if (pnum<0 || pnum>=z->np || llx<1 || lly<1 || urx>z->lx ||
+		ury>z->ly || llx>urx || lly>ury) {
+		qfits_error("invalid window for compressed image");
+		return -1 ;
+	}
+	nx  = urx-llx+1 ;
+	tx0 = (llx-1)/z->tx ;
+	tx1 = (urx-1)/z->tx ;
+	ty0 = (lly-1)/z->ty ;
+	ty1 = (ury-1)/z->ty ;
+	tz  = pnum / z->tz ;
+
+	tbuf = malloc((size_t)z->tx * z->ty * z->tz * sizeof(double)) ;
+	for (iy=ty0 ; iy<=ty1 ; iy++) {
+		for (ix=tx0 ; ix<=tx1 ; ix++) {
+			tile = ix + z->ntx * (iy + z->nty * tz) ;
+			if (qfits_zimage_read_tile(z, tile, tbuf)!=0) {
+				free(tbuf) ;
+				return -1 ;
+			}
+			qfits_zimage_tile_box(z, tile, pos, size) ;
+			/* Intersection with the window, 0-based */
+			x0 = (pos[0] > llx-1) ? pos[0] : llx-1 ;
+			x1 = (pos[0]+size[0]-1 < urx-1) ? pos[0]+size[0]-1 : urx-1 ;
+			y0 = (pos[1] > lly-1) ? pos[1] : lly-1 ;
+			y1 = (pos[1]+size[1]-1 < ury-1) ? pos[1]+size[1]-1 : ury-1 ;
+			for (y=y0 ; y<=y1 ; y++) {
+				src = tbuf + (x0-pos[0]) + size[0] *
+					  ((y-pos[1]) + size[1] * (pnum-pos[2])) ;
+				for (x=x0 ; x<=x1 ; x++) {
+					buf[(x-llx+1) + (y-lly+1)*nx] = *src++ ;
+				}
+			}
+		}
+	}
+	free(tbuf) ;
+	return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Make the header of a Rice tile-compressed image extension.
+  @param    fh      Header of the uncompressed image, or NULL.
+  @param    lx      Image size in x.
+  @param    ly      Image size in y.
+  @param    np      Image size in z (1 for a 2d image).
+  @param    bitpix  Image BITPIX: 8, 16 or 32.
+  @return   1 newly allocated qfits_header, NULL in case of error.
+
+  The image is described as compressed with RICE_1, one tile per image
+  row. The returned header describes a binary table with one row per
+  tile and a single column COMPRESSED_DATA (1PB). Cards of fh which do
+  not describe the data structure are copied after the compression
+  cards.
+
+  Cards are in a fixed order: PCOUNT, which must be updated with the
+  final heap size once all tiles have been written, is always the sixth
+  card of the header.
+ */
+/*----------------------------------------------------------------------------*/
+qfits_header * qfits_zimage_header(
+        qfits_header    *   fh,
+        int                 lx,
+        int                 ly,
+        int                 np,
+        int                 bitpix)
+{
+	static const char * skip[] = {
+		"SIMPLE", "XTENSION", "BITPIX", "NAXIS", "EXTEND", "PCOUNT",
+		"GCOUNT", "END", "DATAMD5", "CHECKSUM", "DATASUM", "TFIELDS",
+		"ZIMAGE", "ZCMPTYPE", "ZBITPIX", "ZNAXIS", "ZTILE", "ZNAME",
+		"ZVAL", "ZQUANTIZ", "ZDITHER0", "ZSIMPLE", "ZEXTEND", "ZBLANK",
+		"ZSCALE", "ZZERO", "ZPCOUNT", "ZGCOUNT", "ZHECKSUM", "ZDATASUM",
+		"TTYPE", "TFORM", NULL } ;
+	qfits_header	*	h ;
+	char				key[FITS_LINESZ+1] ;
+	char				val[FITS_LINESZ+1] ;
+	char				com[FITS_LINESZ+1] ;
+	char				lin[FITS_LINESZ+1] ;
+	int					i, j, skipit ;
+
+	if (lx<1 || ly<1 || np<1) return NULL ;
+	if (bitpix!=8 && bitpix!=16 && bitpix!=32) return NULL ;
+
+	h = qfits_header_new() ;
+	qfits_header_append(h, "XTENSION", "'BINTABLE'", "binary table", NULL);
+	qfits_header_append(h, "BITPIX", "8", "bytes", NULL);
+	qfits_header_append(h, "NAXIS", "2", "table", NULL);
+	qfits_header_append(h, "NAXIS1", "8", "bytes per row", NULL);
+	sprintf(val, "%d", ly*np) ;
+	qfits_header_append(h, "NAXIS2", val, "number of tiles", NULL);
+	qfits_header_append(h, "PCOUNT", "0", "heap size", NULL);
+	qfits_header_append(h, "GCOUNT", "1", "one group", NULL);
+	qfits_header_append(h, "TFIELDS", "1", "one column", NULL);
+	qfits_header_append(h, "TTYPE1", "'COMPRESSED_DATA'",
+						"compressed tiles", NULL);
+	qfits_header_append(h, "TFORM1", "'1PB'", "variable-length bytes", NULL);
+	qfits_header_append(h, "ZIMAGE", "T", "tile-compressed image", NULL);
+	sprintf(val, "%d", bitpix) ;
+	qfits_header_append(h, "ZBITPIX", val, "bits per pixel", NULL);
+	qfits_header_append(h, "ZNAXIS", np>1 ? "3" : "2", "image axes", NULL);
+	sprintf(val, "%d", lx) ;
+	qfits_header_append(h, "ZNAXIS1", val, "x size", NULL);
+	sprintf(val, "%d", ly) ;
+	qfits_header_append(h, "ZNAXIS2", val, "y size", NULL);
+	if (np>1) {
+		sprintf(val, "%d", np) ;
+		qfits_header_append(h, "ZNAXIS3", val, "z size", NULL);
+	}
+	sprintf(val, "%d", lx) ;
+	qfits_header_append(h, "ZTILE1", val, "tile size in x", NULL);
+	qfits_header_append(h, "ZTILE2", "1", "tile size in y", NULL);
+	if (np>1) {
+		qfits_header_append(h, "ZTILE3", "1", "tile size in z", NULL);
+	}
+	qfits_header_append(h, "ZCMPTYPE", "'RICE_1'", "compression", NULL);
+	qfits_header_append(h, "ZNAME1", "'BLOCKSIZE'", "parameter name", NULL);
+	sprintf(val, "%d", QFITS_RICE_BLOCKSIZE) ;
+	qfits_header_append(h, "ZVAL1", val, "pixels per block", NULL);
+	qfits_header_append(h, "ZNAME2", "'BYTEPIX'", "parameter name", NULL);
+	sprintf(val, "%d", bitpix/8) ;
+	qfits_header_append(h, "ZVAL2", val, "bytes per pixel", NULL);
+
+	/* Copy user cards */
+	if (fh!=NULL) {
+		for (i=0 ; i<fh->n ; i++) {
+			if (qfits_header_getitem(fh, i, key, val, com, lin)!=0) break ;
+			skipit = 0 ;
+			for (j=0 ; skip[j]!=NULL ; j++) {
+				if (!strncmp(key, skip[j], strlen(skip[j]))) {
+					/* Prefixes are only skipped when followed by digits */
+					if (key[strlen(skip[j])]==0 ||
+						(key[strlen(skip[j])]>='0' &&
+						 key[strlen(skip[j])]<='9')) {
+						skipit = 1 ;
+						break ;
+					}
+				}
+			}
+			if (skipit) continue ;
+			qfits_header_append(h, key, val, com, lin[0] ? lin : NULL);
+		}
+	}
+	qfits_header_append(h, "END", NULL, NULL, NULL);
+	return h ;
+}
+/* vim: set ts=4 et sw=4 tw=75 */
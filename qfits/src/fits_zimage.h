@@ -0,0 +1,263 @@
+/*----------------------------------------------------------------------------*/
+/**
+   @file    fits_zimage.h
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Tile-compressed FITS images.
+
+   This module reads and writes images stored with the FITS tiled image
+   compression convention: the image is cut into rectangular tiles,
+   each tile is compressed separately and stored as one row of a binary
+   table extension (ZIMAGE=T), the compressed bytes living in the table
+   heap. Rice (RICE_1) and GZIP (GZIP_1, GZIP_2) compressed tiles can be
+   read, including quantized floating-point images. Rice compression is
+   offered for writing integer images.
+
+   Tiles are independent: once an image has been opened, any number of
+   threads may decode tiles concurrently with qfits_zimage_read_tile().
+*/
+/*----------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+#ifndef FITS_ZIMAGE_H
+#define FITS_ZIMAGE_H
+
+/*-----------------------------------------------------------------------------
+   								Includes
+ -----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fits_h.h"
+
+/* <dox> */
+/*-----------------------------------------------------------------------------
+   								Defines
+ -----------------------------------------------------------------------------*/
+
+/** Tile compression algorithm: unknown or unsupported */
+#define QFITS_ZCMP_NONE		0
+/** Tile compression algorithm: Rice (RICE_1) */
+#define QFITS_ZCMP_RICE		1
+/** Tile compression algorithm: GZIP (GZIP_1) */
+#define QFITS_ZCMP_GZIP1	2
+/** Tile compression algorithm: GZIP with byte shuffling (GZIP_2) */
+#define QFITS_ZCMP_GZIP2	3
+
+/** Default number of pixels per Rice block */
+#define QFITS_RICE_BLOCKSIZE	32
+
+/** Maximal size in bytes of npix pixels of bytepix bytes, Rice-compressed */
+#define QFITS_RICE_MAXSIZE(npix,bytepix) \
+	((npix)*(bytepix) + (npix)/QFITS_RICE_BLOCKSIZE + (bytepix) + 8)
+
+/*-----------------------------------------------------------------------------
+   								New types
+ -----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief	Tile-compressed image opened for reading.
+
+  All public fields are read-only. Tiles are numbered from 0, in FITS
+  order: x varies fastest, then y, then z.
+ */
+/*----------------------------------------------------------------------------*/
+typedef struct qfits_zimage {
+	/** Image size in x, y and z (1 for missing axes) */
+	int			lx, ly, np ;
+	/** BITPIX of the uncompressed image (ZBITPIX) */
+	int			bitpix ;
+	/** Compression algorithm (QFITS_ZCMP_*) */
+	int			cmptype ;
+	/** Tile size in x, y and z */
+	int			tx, ty, tz ;
+	/** Number of tiles in x, y, z and in total */
+	int			ntx, nty, ntz ;
+	int			ntiles ;
+	/** BSCALE and BZERO applied to the uncompressed pixels */
+	double		bscale ;
+	double		bzero ;
+	/** Private data */
+	void	*	_priv ;
+} qfits_zimage ;
+
+/*-----------------------------------------------------------------------------
+						Function ANSI prototypes
+ -----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Find out if an extension holds a tile-compressed image.
+  @param    filename    Name of the FITS file.
+  @param    xtnum       Extension number (starting from 1).
+  @return   int 1 if the extension has ZIMAGE=T, 0 otherwise.
+ */
+/*----------------------------------------------------------------------------*/
+int qfits_is_zimage(char * filename, int xtnum) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Open a tile-compressed image for reading.
+  @param    filename    Name of the FITS file.
+  @param    xtnum       Extension number (starting from 1).
+  @return   1 newly allocated qfits_zimage, or NULL in case of error.
+
+  The file is mapped into memory until qfits_zimage_close() is called.
+  Images with more than 3 axes, or compressed with an unsupported
+  algorithm (PLIO_1, HCOMPRESS_1), are rejected.
+ */
+/*----------------------------------------------------------------------------*/
+qfits_zimage * qfits_zimage_open(char * filename, int xtnum) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Close a tile-compressed image.
+  @param    z   Image to close.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+void qfits_zimage_close(qfits_zimage * z) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get the position and size of a tile.
+  @param    z       Opened image.
+  @param    tile    Tile number.
+  @param    pos     Returned position of the first tile pixel (x,y,z from 0).
+  @param    size    Returned size of the tile in x, y and z.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Tiles on the upper edges of the image may be smaller than the
+  nominal tile size.
+ */
+/*----------------------------------------------------------------------------*/
+int qfits_zimage_tile_box(qfits_zimage * z, int tile, int * pos, int * size) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Decompress one tile.
+  @param    z       Opened image.
+  @param    tile    Tile number.
+  @param    buf     Output buffer, large enough for the tile.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The tile pixels are written to buf in FITS order (see
+  qfits_zimage_tile_box() for the tile size), as physical values: BSCALE
+  and BZERO are applied, quantized floating-point pixels are restored
+  (including subtractive dithering), and null pixels are set to NaN.
+
+  This function only reads the mapped file and may be called from
+  several threads at the same time.
+ */
+/*----------------------------------------------------------------------------*/
+int qfits_zimage_read_tile(qfits_zimage * z, int tile, double * buf) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Decompress a window of an image plane.
+  @param    z       Opened image.
+  @param    pnum    Plane number (from 0).
+  @param    llx     Lower left corner in x (from 1).
+  @param    lly     Lower left corner in y (from 1).
+  @param    urx     Upper right corner in x.
+  @param    ury     Upper right corner in y.
+  @param    buf     Output buffer of (urx-llx+1)*(ury-lly+1) pixels.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Only the tiles intersecting the requested window are decompressed.
+ */
+/*----------------------------------------------------------------------------*/
+int qfits_zimage_read_window(
+        qfits_zimage    *   z,
+        int                 pnum,
+        int                 llx,
+        int                 lly,
+        int                 urx,
+        int                 ury,
+        double          *   buf) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Rice-compress a buffer of integers.
+  @param    in          Input pixels.
+  @param    npix        Number of input pixels.
+  @param    bytepix     Size in bytes of the pixels (1, 2 or 4).
+  @param    blocksize   Number of pixels per Rice block.
+  @param    out         Output buffer.
+  @param    outsize     Size of the output buffer in bytes.
+  @return   int number of bytes written to out, -1 in case of error.
+
+  Input values must fit in the requested number of bytes. An output
+  buffer of QFITS_RICE_MAXSIZE(npix, bytepix) bytes is always large
+  enough.
+ */
+/*----------------------------------------------------------------------------*/
+int qfits_rice_compress(
+        int         *   in,
+        int             npix,
+        int             bytepix,
+        int             blocksize,
+        unsigned char * out,
+        int             outsize) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Decompress a Rice-compressed buffer of integers.
+  @param    in          Compressed bytes.
+  @param    insize      Number of compressed bytes.
+  @param    bytepix     Size in bytes of the pixels (1, 2 or 4).
+  @param    blocksize   Number of pixels per Rice block.
+  @param    out         Output pixels.
+  @param    npix        Number of pixels to decompress.
+  @return   int 0 if Ok, -1 in case of error.
+ */
+/*----------------------------------------------------------------------------*/
+int qfits_rice_decompress(
+        unsigned char * in,
+        int             insize,
+        int             bytepix,
+        int             blocksize,
+        int         *   out,
+        int             npix) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Make the header of a Rice tile-compressed image extension.
+  @param    fh      Header of the uncompressed image, or NULL.
+  @param    lx      Image size in x.
+  @param    ly      Image size in y.
+  @param    np      Image size in z (1 for a 2d image).
+  @param    bitpix  Image BITPIX: 8, 16 or 32.
+  @return   1 newly allocated qfits_header, NULL in case of error.
+
+  The image is described as compressed with RICE_1, one tile per image
+  row. The returned header describes a binary table with one row per
+  tile and a single column COMPRESSED_DATA (1PB). Cards of fh which do
+  not describe the data structure are copied after the compression
+  cards.
+
+  Cards are in a fixed order: PCOUNT, which must be updated with the
+  final heap size once all tiles have been written, is always the sixth
+  card of the header.
+ */
+/*----------------------------------------------------------------------------*/
+qfits_header * qfits_zimage_header(
+        qfits_header    *   fh,
+        int                 lx,
+        int                 ly,
+        int                 np,
+        int                 bitpix) ;
+/* </dox> */
+
+#endif
+/* vim: set ts=4 et sw=4 tw=75 */
@@ -31,6 +31,7 @@
 #include "fits_h.h"
 #include "byteswap.h"
 #include "simple.h"
+#include "fits_zimage.h"
 #include "qerror.h"
 #include "xmemory.h"
 
@@ -47,6 +48,113 @@
                             Function codes
  -----------------------------------------------------------------------------*/
 
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Initialize a qfitsloader for a tile-compressed image.
+  @param    ql  qfitsloader object with the zxtnum field set.
+  @return   int 0 if Ok, -1 if error occurred.
+
+  BSCALE and BZERO are applied when decompressing tiles, the returned
+  bscale and bzero are therefore always 1 and 0.
+ */
+/*----------------------------------------------------------------------------*/
+static int qfitsloader_init_zimage(qfitsloader * ql)
+{
+    qfits_zimage    *   z ;
+
+    if (qfits_get_datinfo(ql->filename,
+                          ql->zxtnum,
+                          &(ql->seg_start),
+                          &(ql->seg_size))!=0) {
+        qfits_error("pixio: cannot get seginfo for %s extension %d",
+                    ql->filename,
+                    ql->zxtnum);
+        return -1 ;
+    }
+    z = qfits_zimage_open(ql->filename, ql->zxtnum);
+    if (z==NULL) {
+        return -1 ;
+    }
+    ql->lx = z->lx ;
+    ql->ly = z->ly ;
+    ql->np = z->np ;
+    ql->bitpix = z->bitpix ;
+    ql->bscale = 1.0 ;
+    ql->bzero  = 0.0 ;
+    qfits_zimage_close(z);
+
+    if (ql->pnum >= ql->np) {
+        qfits_error("pixio: requested plane %d but NAXIS3=%d",
+                    ql->pnum,
+                    ql->np);
+        return -1 ;
+    }
+    ql->_init = QFITSLOADERINIT_MAGIC ;
+    return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Load a window of a tile-compressed image.
+  @param    ql  Initialized qfitsloader object with zxtnum set.
+  @param    llx
+  @param    lly     Position of the window (start with (1,1))
+  @param    urx
+  @param    ury
+  @return   int 0 if Ok, -1 if error occurred.
+
+  Only the tiles covering the window are decompressed. The returned
+  buffer is always allocated, the 'map' field is ignored.
+ */
+/*----------------------------------------------------------------------------*/
+static int qfits_loadpix_zimage(
+        qfitsloader     *   ql,
+        int                 llx,
+        int                 lly,
+        int                 urx,
+        int                 ury)
+{
+    qfits_zimage    *   z ;
+    double          *   dbuf ;
+    int                 npix ;
+    int                 i ;
+
+    z = qfits_zimage_open(ql->filename, ql->zxtnum);
+    if (z==NULL) {
+        return -1 ;
+    }
+    npix = (urx-llx+1) * (ury-lly+1) ;
+    dbuf = malloc(npix * sizeof(double)) ;
+    if (qfits_zimage_read_window(z, ql->pnum, llx, lly, urx, ury, dbuf)!=0) {
+        qfits_error("pixio: cannot decompress ext %d in %s",
+                    ql->zxtnum,
+                    ql->filename);
+        qfits_zimage_close(z);
+        free(dbuf);
+        return -1 ;
+    }
+    qfits_zimage_close(z);
+
+    switch (ql->ptype) {
+        case PTYPE_FLOAT:
+        ql->fbuf = malloc(npix * sizeof(float)) ;
+        for (i=0 ; i<npix ; i++) ql->fbuf[i] = (float)dbuf[i] ;
+        free(dbuf);
+        break ;
+
+        case PTYPE_INT:
+        ql->ibuf = malloc(npix * sizeof(int)) ;
+        for (i=0 ; i<npix ; i++) ql->ibuf[i] = (int)dbuf[i] ;
+        free(dbuf);
+        break ;
+
+        case PTYPE_DOUBLE:
+        ql->dbuf = dbuf ;
+        break ;
+    }
+    return 0 ;
+}
+
 /*----------------------------------------------------------------------------*/
 /**
   @brief    Initialize a qfitsloader control object.
@@ -71,6 +179,14 @@
   This function is basically a probe sent on a FITS file to ask
   qfits if loading these data would be Ok or not. The actual loading
   is performed by qfits_loadpix() afterwards.
+
+  Tile-compressed images are recognized: if the requested extension is
+  a compressed image, or if xtnum is 0 and the main header has no data
+  but is followed by a compressed image in the first extension (as
+  written by fpack), the 'zxtnum' field is set to the number of the
+  extension holding the compressed image, and lx, ly, np and bitpix
+  describe the uncompressed image. The loading functions then
+  decompress the pixels transparently.
  */
 /*----------------------------------------------------------------------------*/
 int qfitsloader_init(qfitsloader * ql)
@@ -141,6 +257,23 @@ int qfitsloader_init(qfitsloader * ql)
         return -1 ;
     }
     ql->exts = n_ext ;
+
+    /* Check for a tile-compressed image */
+    ql->zxtnum = 0 ;
+    if (ql->xtnum>0) {
+        if (qfits_is_zimage(ql->filename, ql->xtnum)) {
+            ql->zxtnum = ql->xtnum ;
+        }
+    } else if (n_ext>0) {
+        sval = qfits_query_hdr(ql->filename, "NAXIS");
+        if (sval!=NULL && atoi(sval)==0 && qfits_is_zimage(ql->filename, 1)) {
+            ql->zxtnum = 1 ;
+        }
+    }
+    if (ql->zxtnum>0) {
+        return qfitsloader_init_zimage(ql) ;
+    }
+
     /* Get segment offset and size for the requested buffer */
     if (qfits_get_datinfo(ql->filename,
                           ql->xtnum,
@@ -371,6 +504,16 @@ int qfits_loadpix_window(
         return -1 ;
     }
 
+    /* Initialize buffer pointers */
+    ql->ibuf = NULL ;
+    ql->fbuf = NULL ;
+    ql->dbuf = NULL ;
+
+    /* Tile-compressed image */
+    if (ql->zxtnum>0) {
+        return qfits_loadpix_zimage(ql, llx, lly, urx, ury) ;
+    }
+
     /* No map if only a zone is specified */
     if (llx != 1 || lly != 1 || urx != ql->lx || ury != ql->ly) {
         if (ql->map == 1) {
@@ -449,11 +592,6 @@ int qfits_loadpix_window(
             }
         }
     }
-        
-    /* Initialize buffer pointers */
-    ql->ibuf = NULL ;
-    ql->fbuf = NULL ;
-    ql->dbuf = NULL ;
 
     /*
      * Special cases: mapped file is identical to requested format.
@@ -479,7 +617,7 @@ int qfits_loadpix_window(
     switch (ql->ptype) {
         case PTYPE_FLOAT:
         ql->fbuf = qfits_pixin_float(   fptr,
-                                        ql->lx * ql->ly,
+                                        nx * ny,
                                         ql->bitpix,
                                         ql->bscale,
                                         ql->bzero);
@@ -487,7 +625,7 @@ int qfits_loadpix_window(
 
         case PTYPE_INT:
         ql->ibuf = qfits_pixin_int( fptr,
-                                    ql->lx * ql->ly,
+                                    nx * ny,
                                     ql->bitpix,
                                     ql->bscale,
                                     ql->bzero);
@@ -495,7 +633,7 @@ int qfits_loadpix_window(
 
         case PTYPE_DOUBLE:
         ql->dbuf = qfits_pixin_double(  fptr,
-                                        ql->lx * ql->ly,
+                                        nx * ny,
                                         ql->bitpix,
                                         ql->bscale,
                                         ql->bzero);
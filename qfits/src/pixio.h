@@ -160,6 +160,8 @@ typedef struct qfitsloader {
 	double		bscale ;
 	/** output: BZERO found for this extension */
 	double		bzero ;
+	/** output: Extension holding a tile-compressed image, 0 if none */
+	int			zxtnum ;
 
 	/** output: Pointer to pixel buffer loaded as integer values */
 	int		*	ibuf ;
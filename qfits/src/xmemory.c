@@ -40,6 +40,12 @@
 #include <sys/mman.h>
 #include <sys/resource.h>
 
+#include "config.h"
+
+#ifdef HAS_PTHREADS
+#include <pthread.h>
+#endif
+
 /*-----------------------------------------------------------------------------
                                 Defines
  -----------------------------------------------------------------------------*/
@@ -111,6 +117,18 @@
 #define xmem_debug( code )
 #endif
 
+/**
+  @def      xmem_lock
+  @brief    Serialize access to the memory table when compiled with threads
+ */
+#ifdef HAS_PTHREADS
+#define xmem_lock()     pthread_mutex_lock(&xmemory_mutex)
+#define xmem_unlock()   pthread_mutex_unlock(&xmemory_mutex)
+#else
+#define xmem_lock()
+#define xmem_unlock()
+#endif
+
 /* A very simple hash */
 #define PTR_HASH(ptr) (((unsigned long int) ptr) % XMEMORY_MAXPTRS)
 
@@ -121,9 +139,17 @@
 /** Initialization flag */
 static int  xmemory_initialized=0 ;
 
+#ifdef HAS_PTHREADS
+/** Lock protecting the memory table against concurrent access */
+static pthread_mutex_t xmemory_mutex = PTHREAD_MUTEX_INITIALIZER ;
+#endif
+
 /** Path to temporary directory */
 static char xmemory_tmpdirname[TMPDIRNAMESZ] = "." ;
 
+/** Number of allocation requests received so far */
+static long xmemory_nrequests = 0 ;
+
 /*----------------------------------------------------------------------------*/
 /**
   @var      xmemory_table
@@ -203,6 +229,13 @@ static int xmemory_remcell(int) ;
 static void xmemory_dumpcell(int, FILE*) ;
 static char * xmemory_tmpfilename(int) ;
 static char * strdup_(const char * str) ;
+static void * xmem_malloc(size_t, const char *, int) ;
+static void * xmem_calloc(size_t, size_t, const char *, int) ;
+static void * xmem_realloc(void *, size_t, const char *, int) ;
+static void xmem_free(void *, const char *, int) ;
+static char * xmem_strdup(const char *, const char *, int) ;
+static char * xmem_falloc(char *, size_t, size_t *, const char *, int) ;
+static void xmem_fdealloc(void *, size_t, size_t, const char *, int) ;
 void xmemory_status_(const char *, int) ;
 
 /*-----------------------------------------------------------------------------
@@ -523,7 +556,7 @@ static char * xmemory_tmpfilename(int reg)
   @endcode
  */
 /*----------------------------------------------------------------------------*/
-void * xmemory_malloc(size_t size, const char * filename, int lineno)
+static void * xmem_malloc(size_t size, const char * filename, int lineno)
 {
     void    *   ptr ;
     char    *   fname ;
@@ -703,7 +736,7 @@ void * xmemory_malloc(size_t size, const char * filename, int lineno)
   @endcode
  */
 /*----------------------------------------------------------------------------*/
-void * xmemory_calloc(size_t nmemb, size_t size, const char * filename, int lineno)
+static void * xmem_calloc(size_t nmemb, size_t size, const char * filename, int lineno)
 {
     void    *   ptr ;
 
@@ -715,7 +748,7 @@ void * xmemory_calloc(size_t nmemb, size_t size, const char * filename, int line
         else return ptr ;
     }
     
-    ptr = xmemory_malloc(nmemb * size, filename, lineno) ;
+    ptr = xmem_malloc(nmemb * size, filename, lineno) ;
     return memset(ptr, 0, nmemb * size) ;
 }
 
@@ -741,7 +774,7 @@ void * xmemory_calloc(size_t nmemb, size_t size, const char * filename, int line
   The returned pointer ptr must be deallocated with xmemory_fdealloc(ptr)
  */
 /*----------------------------------------------------------------------------*/
-char * xmemory_falloc(
+static char * xmem_falloc(
         char    *   name,
         size_t      offs,
         size_t  *   size,
@@ -939,7 +972,7 @@ char * xmemory_falloc(
   @return   void
  */
 /*----------------------------------------------------------------------------*/
-void xmemory_fdealloc(
+static void xmem_fdealloc(
         void    *   ptr, 
         size_t      offs,
         size_t      size, 
@@ -1091,7 +1124,7 @@ void xmemory_fdealloc(
   table.
  */
 /*----------------------------------------------------------------------------*/
-void xmemory_free(void * ptr, const char * filename, int lineno)
+static void xmem_free(void * ptr, const char * filename, int lineno)
 {
     int     i ;
     int     pos ;
@@ -1242,7 +1275,7 @@ void xmemory_free(void * ptr, const char * filename, int lineno)
   @endcode
  */
 /*----------------------------------------------------------------------------*/
-void * xmemory_realloc(void * ptr, size_t size, const char * filename, int lineno)
+static void * xmem_realloc(void * ptr, size_t size, const char * filename, int lineno)
 {
     void    *   ptr2 ;
     size_t      small_sz ;
@@ -1258,7 +1291,7 @@ void * xmemory_realloc(void * ptr, size_t size, const char * filename, int linen
         else return ptr2 ;
     }
 
-    if (ptr == NULL) return xmemory_malloc(size, filename, lineno) ;
+    if (ptr == NULL) return xmem_malloc(size, filename, lineno) ;
 
     /* Get the pointer size */
     for (i=0 ; i<XMEMORY_MAXPTRS ; i++) {
@@ -1281,13 +1314,13 @@ void * xmemory_realloc(void * ptr, size_t size, const char * filename, int linen
     small_sz = size < ptr_sz ? size : ptr_sz ;
     
     /* Allocate the new pointer */
-    ptr2 = xmemory_malloc(size, filename, lineno) ;
+    ptr2 = xmem_malloc(size, filename, lineno) ;
     
     /* Copy the common data */
     memcpy(ptr2, ptr, small_sz) ;
 
     /* Free the passed ptr */
-    xmemory_free(ptr, filename, lineno) ;
+    xmem_free(ptr, filename, lineno) ;
     
     /* Return  */
     return ptr2 ;
@@ -1311,7 +1344,7 @@ void * xmemory_realloc(void * ptr, size_t size, const char * filename, int linen
   This function calls xmemory_malloc() to do the allocation.
  */
 /*----------------------------------------------------------------------------*/
-char * xmemory_strdup(const char * s, const char * filename, int lineno)
+static char * xmem_strdup(const char * s, const char * filename, int lineno)
 {
     char    *   t ;
     
@@ -1324,7 +1357,7 @@ char * xmemory_strdup(const char * s, const char * filename, int lineno)
     }
 
     if (s==NULL) return NULL ;
-    t = xmemory_malloc(1+strlen(s), filename, lineno);
+    t = xmem_malloc(1+strlen(s), filename, lineno);
     return strcpy(t, s);
 }
 
@@ -1354,6 +1387,114 @@ static char * strdup_(const char * str)
     return(p);
 }
 
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Public entry points to the memory allocators.
+
+  The functions below are the ones called through the malloc(), calloc(),
+  realloc(), free(), strdup(), falloc() and fdealloc() macros. They only
+  take the table lock (when compiled with HAS_PTHREADS) and hand over to
+  the private implementations above, which must never call back into the
+  public entry points.
+ */
+/*----------------------------------------------------------------------------*/
+void * xmemory_malloc(size_t size, const char * filename, int lineno)
+{
+    void    *   ptr ;
+
+    xmem_lock() ;
+    xmemory_nrequests++ ;
+    ptr = xmem_malloc(size, filename, lineno) ;
+    xmem_unlock() ;
+    return ptr ;
+}
+
+void * xmemory_calloc(size_t nmemb, size_t size, const char * filename, int lineno)
+{
+    void    *   ptr ;
+
+    xmem_lock() ;
+    xmemory_nrequests++ ;
+    ptr = xmem_calloc(nmemb, size, filename, lineno) ;
+    xmem_unlock() ;
+    return ptr ;
+}
+
+void * xmemory_realloc(void * ptr, size_t size, const char * filename, int lineno)
+{
+    void    *   ptr2 ;
+
+    xmem_lock() ;
+    xmemory_nrequests++ ;
+    ptr2 = xmem_realloc(ptr, size, filename, lineno) ;
+    xmem_unlock() ;
+    return ptr2 ;
+}
+
+void xmemory_free(void * ptr, const char * filename, int lineno)
+{
+    xmem_lock() ;
+    xmem_free(ptr, filename, lineno) ;
+    xmem_unlock() ;
+    return ;
+}
+
+char * xmemory_strdup(const char * s, const char * filename, int lineno)
+{
+    char    *   t ;
+
+    xmem_lock() ;
+    xmemory_nrequests++ ;
+    t = xmem_strdup(s, filename, lineno) ;
+    xmem_unlock() ;
+    return t ;
+}
+
+char * xmemory_falloc(
+        char    *   name,
+        size_t      offs,
+        size_t  *   size,
+        const char    *   srcname,
+        int         srclin)
+{
+    char    *   ptr ;
+
+    xmem_lock() ;
+    ptr = xmem_falloc(name, offs, size, srcname, srclin) ;
+    xmem_unlock() ;
+    return ptr ;
+}
+
+void xmemory_fdealloc(
+        void    *   ptr, 
+        size_t      offs,
+        size_t      size, 
+        const char    *   filename, 
+        int         lineno)
+{
+    xmem_lock() ;
+    xmem_fdealloc(ptr, offs, size, filename, lineno) ;
+    xmem_unlock() ;
+    return ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get the number of allocation requests received so far.
+  @return   long number of calls to malloc(), calloc(), realloc() and
+            strdup() since the program started.
+ */
+/*----------------------------------------------------------------------------*/
+long xmemory_nalloc(void)
+{
+    long    n ;
+
+    xmem_lock() ;
+    n = xmemory_nrequests ;
+    xmem_unlock() ;
+    return n ;
+}
+
 /*----------------------------------------------------------------------------*/
 /**
   @brief    Display memory status information.
@@ -0,0 +1,264 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    arith_expr.h
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Fused evaluation of pixel arithmetic expressions.
+
+   An arithmetic expression is recorded as a list of operands (cubes,
+   images or constants) and a program in reverse Polish notation. The
+   whole expression is then evaluated in a single pass over the pixels,
+   block by block, without allocating any intermediate image:
+
+   \begin{verbatim}
+   e = arith_expr_new() ;
+   arith_expr_add_cube(e, raw) ;
+   arith_expr_add_cube(e, dark) ;
+   arith_expr_add_image(e, flat) ;
+   arith_expr_add_const(e, gain) ;
+   arith_expr_parse(e, "($1 - $2) / $3 * $4 + 100") ;
+   arith_expr_eval_cube(e, raw) ;
+   arith_expr_del(e) ;
+   \end{verbatim}
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+#ifndef _ARITH_EXPR_H_
+#define _ARITH_EXPR_H_
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "comm.h"
+#include "xmemory.h"
+#include "local_types.h"
+#include "cube_defs.h"
+#include "cube_handling.h"
+#include "parallel.h"
+
+/*---------------------------------------------------------------------------
+   								Defines
+ ---------------------------------------------------------------------------*/
+
+/** Maximal depth of the evaluation stack */
+#define ARITH_EXPR_MAXDEPTH		32
+
+/*---------------------------------------------------------------------------
+   								New types
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Operand of an arithmetic expression.
+
+  Exactly one of cube and image is set for pixel operands, none of them
+  for constants. Operands are not copied: they must stay valid until
+  the expression has been evaluated.
+ */
+/*--------------------------------------------------------------------------*/
+typedef struct _arith_operand_ {
+	cube_t		*	cube ;
+	image_t		*	image ;
+	double			value ;
+} arith_operand ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Element of an expression program.
+
+  If op is zero, the element pushes operand number 'index' (starting
+  from 1) or, if index is zero, the constant 'value'. Otherwise it is an
+  operator: one of '+', '-', '*', '/', '^' (binary) or 'n' (negation).
+ */
+/*--------------------------------------------------------------------------*/
+typedef struct _arith_token_ {
+	int				op ;
+	int				index ;
+	double			value ;
+} arith_token ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    A recorded arithmetic expression.
+ */
+/*--------------------------------------------------------------------------*/
+typedef struct _arith_expr_ {
+	/* Operands, referred to as $1..$n_opd */
+	int					n_opd ;
+	arith_operand	*	opd ;
+	/* Program in reverse Polish notation */
+	int					n_tok ;
+	arith_token		*	tok ;
+	/* Stack depth after the last token */
+	int					depth ;
+} arith_expr ;
+
+/*---------------------------------------------------------------------------
+  							Function prototypes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create a new empty expression.
+  @return   1 newly allocated arith_expr.
+
+  The returned object must be deallocated with arith_expr_del().
+ */
+/*--------------------------------------------------------------------------*/
+/* <python> */
+arith_expr * arith_expr_new(void) ;
+/* </python> */
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate an expression.
+  @param    e   Expression to deallocate.
+  @return   void
+
+  Operands are not deallocated.
+ */
+/*--------------------------------------------------------------------------*/
+/* <python> */
+void arith_expr_del(arith_expr * e) ;
+/* </python> */
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Declare a cube operand.
+  @param    e   Expression.
+  @param    c   Cube.
+  @return   int operand number (starting from 1), -1 in case of error.
+
+  A cube with a single plane is applied to all planes of the result.
+ */
+/*--------------------------------------------------------------------------*/
+/* <python> */
+int arith_expr_add_cube(arith_expr * e, cube_t * c) ;
+/* </python> */
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Declare an image operand.
+  @param    e   Expression.
+  @param    im  Image.
+  @return   int operand number (starting from 1), -1 in case of error.
+
+  The image is applied to all planes of the result.
+ */
+/*--------------------------------------------------------------------------*/
+int arith_expr_add_image(arith_expr * e, image_t * im) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Declare a constant operand.
+  @param    e   Expression.
+  @param    d   Value.
+  @return   int operand number (starting from 1), -1 in case of error.
+ */
+/*--------------------------------------------------------------------------*/
+/* <python> */
+int arith_expr_add_const(arith_expr * e, double d) ;
+/* </python> */
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Push an operand on the program stack.
+  @param    e       Expression.
+  @param    index   Operand number (starting from 1).
+  @return   int 0 if Ok, -1 otherwise.
+ */
+/*--------------------------------------------------------------------------*/
+int arith_expr_push_operand(arith_expr * e, int index) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Push a constant on the program stack.
+  @param    e   Expression.
+  @param    d   Value.
+  @return   int 0 if Ok, -1 otherwise.
+ */
+/*--------------------------------------------------------------------------*/
+int arith_expr_push_const(arith_expr * e, double d) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Push an operator on the program stack.
+  @param    e   Expression.
+  @param    op  Operator.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Binary operators '+', '-', '*', '/' and '^' replace the two topmost
+  stack elements by the result of the operation, the unary operator 'n'
+  negates the topmost element. Divisions by zero yield zero, as in
+  image_div_local().
+ */
+/*--------------------------------------------------------------------------*/
+int arith_expr_push_op(arith_expr * e, int op) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Append an expression in standard notation to a program.
+  @param    e       Expression.
+  @param    s       Expression string.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The string may contain the operators + - * / ^ (power), unary minus,
+  brackets, numbers and operands referred to as $1, $2, ... in the
+  order in which they were declared. Usual priorities apply, ^ being
+  right-associative.
+ */
+/*--------------------------------------------------------------------------*/
+/* <python> */
+int arith_expr_parse(arith_expr * e, char * s) ;
+/* </python> */
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Evaluate an expression into a cube.
+  @param    e       Expression.
+  @param    out     Output cube, or NULL to allocate a new one.
+  @return   The output cube, or NULL in case of error.
+
+  The program must leave exactly one element on the stack. All pixel
+  operands must have the same size and either one plane or the same
+  number of planes as the result. The output cube may be one of the
+  cube operands, in which case the computation is done in place. It
+  must not otherwise share pixels with any operand.
+
+  Pixels are processed in blocks small enough to stay in cache, on
+  the workers started by eclipse_parallel_run().
+
+  Constants are folded in double precision. Pixels divided by a
+  constant are rounded as with image_cst_op().
+ */
+/*--------------------------------------------------------------------------*/
+/* <python> */
+cube_t * arith_expr_eval_cube(arith_expr * e, cube_t * out) ;
+/* </python> */
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Evaluate an expression into an image.
+  @param    e       Expression.
+  @param    out     Output image, or NULL to allocate a new one.
+  @return   The output image, or NULL in case of error.
+
+  Same as arith_expr_eval_cube() for expressions whose operands all have
+  a single plane.
+ */
+/*--------------------------------------------------------------------------*/
+image_t * arith_expr_eval_image(arith_expr * e, image_t * out) ;
+
+#endif
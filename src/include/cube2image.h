@@ -90,6 +90,28 @@ typedef enum _AVG_METHOD_ {
 } average_method ;
 
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	stack_reject object
+
+  Clipping applied to each time line by cube_stack():
+
+  \begin{itemize}
+  \item stack_none: no clipping, the output is a weighted average.
+  \item stack_ksigma: iterative kappa-sigma clipping around the median,
+  sigma being the standard deviation of the remaining values.
+  \item stack_mad: iterative clipping around the median, sigma being
+  estimated from the median absolute deviation.
+  \end{itemize}
+ */
+/*-------------------------------------------------------------------------*/
+typedef enum _STACK_REJECT_ {
+    stack_none,
+    stack_ksigma,
+    stack_mad
+} stack_reject ;
+
+
 /*---------------------------------------------------------------------------
  						Function ANSI C prototypes
  ---------------------------------------------------------------------------*/
@@ -157,6 +179,9 @@ int average_engine(
 
   Notice that all combinations are not yet implemented. Check out the
   source code to see if your specific average need is there.
+
+  Out-of-core cubes (see cube_tiles.h) are averaged by bands of lines,
+  so that only one band is in memory at a time besides the output.
  */
 /*--------------------------------------------------------------------------*/
 /* <python> */
@@ -195,7 +220,7 @@ image_t * cube_avg_linear(cube_t * incube) ;
   @return   Newly allocated image object.
 
   This median averaging applies to the whole cube. Every time line is
-  extracted, sorted out, then the lowest and highest values are
+  extracted, partially sorted, then the lowest and highest values are
   rejected, and the median of the rest is found to yield the output
   pixel.
 
@@ -241,7 +266,7 @@ pixelvalue cube_z_medreject(
   @return   Newly allocated image object.
 
   This averaging applies to the whole cube. Every time line is
-  extracted, sorted out, then the lowest and highest values are
+  extracted, partially sorted, then the lowest and highest values are
   rejected, and the rest is linearly averaged to yield the output
   pixel.
  */
@@ -476,4 +501,83 @@ cube_t * cube_avgrun_median(
 /* </python> */
 
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Weighted average of a cube with iterative clipping.
+  @param    incube      Cube to average.
+  @param    reject      Rejection method (see cube2image.h).
+  @param    kappa_lo    Low clipping threshold in sigmas.
+  @param    kappa_hi    High clipping threshold in sigmas.
+  @param    niter       Maximal number of clipping iterations.
+  @param    weights     Array of incube->np plane weights, or NULL.
+  @param    wmaps       Cube of per-pixel weight maps, or NULL.
+  @param    counts      Returned image of contributing frames, or NULL.
+  @param    wsum        Returned image of the sums of weights, or NULL.
+  @return   Newly allocated image object.
+
+  Every time line is clipped around its median: values further than
+  kappa_lo sigmas below or kappa_hi sigmas above the median are
+  rejected, and the clipping is repeated on the remaining values until
+  nothing more is rejected, fewer than 3 values are left, or niter
+  iterations have been done (niter<1 means no limit). Sigma is the
+  standard deviation of the values for stack_ksigma, and the median
+  absolute deviation scaled to a Gaussian sigma for stack_mad. No
+  clipping is done with stack_none.
+
+  The weight of a pixel is its plane weight times its value in the
+  weight map, both being 1 if not provided. Pixels with a weight lower
+  or equal to zero are ignored. A noise map should be given as an
+  inverse variance map. The output pixel is the weighted average of the
+  values left after clipping, or 0 if none.
+
+  If counts (resp. wsum) is not NULL, it is set to a newly allocated
+  image containing the number of values (resp. the sum of weights)
+  left in each time line.
+ */
+/*--------------------------------------------------------------------------*/
+image_t * cube_stack(
+        cube_t      *   incube,
+        stack_reject    reject,
+        double          kappa_lo,
+        double          kappa_hi,
+        int             niter,
+        double      *   weights,
+        cube_t      *   wmaps,
+        image_t     **  counts,
+        image_t     **  wsum) ;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Weighted and clipped average of a cube file to an image file.
+  @param    name_in     Name of the input cube.
+  @param    name_out    Name of the output image.
+  @param    reject      Rejection method (see cube2image.h).
+  @param    kappa_lo    Low clipping threshold in sigmas.
+  @param    kappa_hi    High clipping threshold in sigmas.
+  @param    niter       Maximal number of clipping iterations.
+  @param    weight_name Name of an ASCII file of plane weights, or NULL.
+  @param    wmap_name   Name of a cube of weight maps, or NULL.
+  @param    count_name  Name of the output count image, or NULL.
+  @param    wsum_name   Name of the output weight sum image, or NULL.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Loads the input cube and optional weights, then calls cube_stack()
+  and saves its results. The plane weights file contains one value per
+  plane of the input cube, separated by blanks or new lines.
+ */
+/*--------------------------------------------------------------------------*/
+int stack_engine(
+        char        *   name_in,
+        char        *   name_out,
+        stack_reject    reject,
+        double          kappa_lo,
+        double          kappa_hi,
+        int             niter,
+        char        *   weight_name,
+        char        *   wmap_name,
+        char        *   count_name,
+        char        *   wsum_name) ;
+
+
 #endif
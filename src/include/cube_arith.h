@@ -360,6 +360,9 @@ int cube_subdiv_im(
  
   The returned image is thus an image of standard deviations in the
   cube, it does not share the input cube pixel value units.
+
+  Time lines are processed in parallel by chunks of pixels, transposed
+  to z-major order (see cube_zlines.h).
  */
 /*--------------------------------------------------------------------------*/
 /* <python> */
@@ -249,6 +249,13 @@ int cube_filter_flat(
   to pixels in each plane. It is usually a good indicator of the
   average subtracted background value if you use this filter to subtract
   an infrared sky background.
+
+  Lines of sight are sorted and averaged in the pixelcalc type. As they
+  are taken relative to the plane medians, single precision keeps the
+  subtracted background accurate to about 1e-6 of its level.
+
+  Time lines are filtered in parallel by chunks of pixels in z-major
+  order (see cube_zlines.h) and the cube is modified in place.
  */
 /*--------------------------------------------------------------------------*/
 /* <python> */
@@ -285,6 +292,9 @@ int cube_3dfilt_runminmax(
   to pixels in each plane. It is usually a good indicator of the
   average subtracted background value if you use this filter to subtract
   an infrared sky background.
+
+  Time lines are filtered in parallel by chunks of pixels in z-major
+  order (see cube_zlines.h) and the cube is modified in place.
  */
 /*--------------------------------------------------------------------------*/
 /* <python> */
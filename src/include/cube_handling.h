@@ -31,6 +31,7 @@
 #include "file_handling.h"
 #include "cube_load.h"
 #include "cube_save.h"
+#include "cube_tiles.h"
 
 /*---------------------------------------------------------------------------
   						Function ANSI C prototypes
@@ -85,6 +85,9 @@ cube_t * cube_load_rtd(void) ;
   @param    filename    Name of the FITS file to load.
   @return   1 newly allocated cube object (NULL if error).
   Reads a cube in from a FITS file on disk.
+
+  If the cube exceeds the memory budget and the program allows it (see
+  cube_tiles.h), an out-of-core cube is returned instead.
  */
 /*--------------------------------------------------------------------------*/
 /* <python> */
@@ -115,6 +118,8 @@ cube_t * cube_load_fits(char * filename) ;
   Then the returned cube will have 22 planes (the first 2 plus the 20
   from the cube).
 
+  If the cube exceeds the memory budget and the program allows it (see
+  cube_tiles.h), an out-of-core cube is returned instead.
  */
 /*--------------------------------------------------------------------------*/
 /* <python> */
@@ -59,6 +59,14 @@
 int cube_set_fits_bpp(int bpp) ;
 /* </python> */
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get default pixel depth used for cube writes.
+  @return   int current default FITS pixel depth.
+ */
+/*--------------------------------------------------------------------------*/
+int cube_get_fits_bpp(void) ;
+
 
 /*-------------------------------------------------------------------------*/
 /**
@@ -122,10 +130,14 @@ int cube_save_fits(cube_t * to_save, char * filename) ;
   If the given file name is 'STDOUT' (without quotes), data will be
   dumped on the process standard out stream.
 
-  The provided FITS header will be dumped into the output file, after
-  having been modified to reflect the cube properties: NAXIS, BITPIX,
-  NAXIS1, NAXIS2 and NAXIS3 (if it exists) will have the values
+  A copy of the provided FITS header will be dumped into the output file,
+  after having been modified to reflect the cube properties: NAXIS,
+  BITPIX, NAXIS1, NAXIS2 and NAXIS3 (if it exists) will have the values
   corresponding the cube size.
+
+  Planes are written through a cube_ostream (see cube_stream.h), so that
+  pixel conversion overlaps with disk output. Out-of-core cubes (see
+  cube_tiles.h) are streamed one tile at a time.
  */
 /*--------------------------------------------------------------------------*/
 /* <python> */
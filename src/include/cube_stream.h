@@ -0,0 +1,150 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    cube_stream.h
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Streaming FITS output for cubes.
+
+   An output stream writes a FITS header once, then accepts pixels plane
+   by plane or by blocks of rows, as they are produced. Pixels are copied
+   into one of two buffers; full buffers are converted to the requested
+   BITPIX and written to disk by a background thread (if eclipse was
+   configured with --mt), while the caller fills the other buffer. The
+   whole cube is never held in memory:
+
+   \begin{verbatim}
+   s = cube_ostream_open("out.fits", fh, lx, ly, 0, 0) ;
+   for (i=0 ; i<n ; i++) {
+       im = compute_plane(i) ;
+       cube_ostream_put_plane(s, im) ;
+       image_del(im) ;
+   }
+   cube_ostream_close(s) ;
+   \end{verbatim}
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+#ifndef _CUBE_STREAM_H_
+#define _CUBE_STREAM_H_
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "comm.h"
+#include "xmemory.h"
+#include "local_types.h"
+#include "cube_defs.h"
+#include "qfits.h"
+
+/*---------------------------------------------------------------------------
+   								Defines
+ ---------------------------------------------------------------------------*/
+
+/** Size in bytes of each of the two pixel buffers of a stream */
+#define CUBE_OSTREAM_BUFSIZE	(4*1024*1024)
+
+/*---------------------------------------------------------------------------
+   								New types
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Opaque FITS output stream.
+ */
+/*--------------------------------------------------------------------------*/
+typedef struct _cube_ostream_ cube_ostream ;
+
+/*---------------------------------------------------------------------------
+  							Function prototypes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Open a FITS output stream.
+  @param    filename    Output file name, or "STDOUT".
+  @param    fh          FITS header to write, or NULL for a default one.
+  @param    lx          Plane size in x.
+  @param    ly          Plane size in y.
+  @param    np          Number of planes, 0 if not known in advance.
+  @param    bitpix      Output BITPIX, 0 for the current default.
+  @return   1 newly allocated cube_ostream, NULL in case of error.
+
+  The header is written immediately, after having been modified as in
+  cube_save_fits_hdrdump() to reflect the output size and pixel type.
+  The given header itself is not modified. If np is 0, the header is
+  written with NAXIS3 set to 0 and updated when the stream is closed;
+  this is not possible when writing to STDOUT.
+
+  The default BITPIX is the one set by cube_set_fits_bpp().
+
+  If the file name ends with ".fz", rows are Rice-compressed as they
+  arrive and the given header is written to the compressed image
+  extension. Compression needs an integer BITPIX and a known number of
+  planes: otherwise the file is written uncompressed.
+ */
+/*--------------------------------------------------------------------------*/
+cube_ostream * cube_ostream_open(
+		char			*	filename,
+		qfits_header	*	fh,
+		int					lx,
+		int					ly,
+		int					np,
+		int					bitpix) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Append a plane to a FITS output stream.
+  @param    s   Output stream.
+  @param    im  Image to append.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The image must have the size declared when opening the stream. It is
+  copied: it can be modified or deallocated as soon as this function
+  returns.
+ */
+/*--------------------------------------------------------------------------*/
+int cube_ostream_put_plane(cube_ostream * s, image_t * im) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Append rows of pixels to a FITS output stream.
+  @param    s       Output stream.
+  @param    rows    Pixel buffer holding nrows rows of lx pixels.
+  @param    nrows   Number of rows to append.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Rows are appended in FITS order: all rows of the first plane, then
+  all rows of the next plane, etc. A block of rows may span several
+  planes. The buffer is copied before this function returns.
+ */
+/*--------------------------------------------------------------------------*/
+int cube_ostream_put_rows(cube_ostream * s, pixelvalue * rows, int nrows) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Close a FITS output stream.
+  @param    s   Output stream.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Waits until all pixels have been written, pads the file to a FITS
+  block size, updates NAXIS3 if the number of planes was not declared
+  and writes the DATAMD5 signature of the data. Returns -1 if any write
+  failed or if the number of rows received does not match the declared
+  size. The stream is deallocated in all cases.
+ */
+/*--------------------------------------------------------------------------*/
+int cube_ostream_close(cube_ostream * s) ;
+
+#endif
@@ -0,0 +1,201 @@
+/*----------------------------------------------------------------------------*/
+/**
+   @file    cube_tiles.h
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Out-of-core cubes paged in by tiles within a memory budget
+
+   When a memory budget is set (see cube_set_membudget() or the
+   environment variable @c E_CUBEMEM), cubes larger than the budget are
+   not loaded in memory by cube_load(), cube_load_strings() and
+   cube_load_framelist(). The returned cube has no planes in memory:
+   its pixels are read from the source FITS files on demand, by tiles
+   of a few lines of a plane kept in a cache of least recently used
+   tiles. Modified planes are written to a scratch file.
+
+   Only a few functions know how to handle such cubes: cube_average(),
+   cube_filter() and the cube_save_* functions, plus the accessors
+   declared here. A program must thus declare that it only uses these
+   by calling cube_tiles_enable() before loading its cubes; otherwise
+   cubes are always fully loaded, whatever the budget.
+*/
+/*----------------------------------------------------------------------------*/
+
+/*
+    $Id$
+    $Author$
+    $Date$
+    $Revision$
+*/
+
+#ifndef _CUBE_TILES_H_
+#define _CUBE_TILES_H_
+
+/*-----------------------------------------------------------------------------
+                                Includes
+ -----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "comm.h"
+#include "xmemory.h"
+#include "local_types.h"
+
+/*-----------------------------------------------------------------------------
+                                New types
+ -----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Opaque out-of-core storage of a cube.
+ */
+/*----------------------------------------------------------------------------*/
+typedef struct _cube_tiles_ cube_tiles ;
+
+/*-----------------------------------------------------------------------------
+                                Function prototypes
+ -----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Set the memory budget for loaded cubes.
+  @param    mbytes  Budget in megabytes, 0 or less for no budget.
+  @return   void
+
+  This setting is also read from the environment variable @c E_CUBEMEM
+  by eclipse_init(). There is no budget by default.
+ */
+/*----------------------------------------------------------------------------*/
+void cube_set_membudget(double mbytes) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get the memory budget for loaded cubes.
+  @return   The budget in megabytes, 0 if there is none.
+ */
+/*----------------------------------------------------------------------------*/
+double cube_get_membudget(void) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Allow the cube loaders to return out-of-core cubes.
+  @param    flag    1 to allow, 0 to forbid.
+  @return   void
+
+  Out-of-core cubes have no planes in memory: a program may only allow
+  them if it accesses its cubes through the functions which support
+  them (see cube_tiles.h).
+ */
+/*----------------------------------------------------------------------------*/
+void cube_tiles_enable(int flag) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Find out if a cube of given size should be loaded by tiles.
+  @param    lx      Plane size in x.
+  @param    ly      Plane size in y.
+  @param    np      Number of planes.
+  @return   1 if out-of-core cubes are allowed and the cube exceeds the
+            memory budget, 0 otherwise.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_tiles_wanted(int lx, int ly, int np) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Open a list of FITS files as an out-of-core cube.
+  @param    filenames   Names of the FITS files.
+  @param    nfiles      Number of files.
+  @return   1 newly allocated cube, NULL in case of error.
+
+  The files may hold single images or cubes, which must all have the
+  same plane size. Their planes are stacked in order as in
+  cube_load_strings(). Tile-compressed files are not supported.
+
+  The returned cube has no planes in memory. Its tiles are as high as
+  possible for a band of lines across all planes to fit in a quarter
+  of the memory budget, and the tile cache holds at most half of it.
+  The cube must be deallocated using cube_del().
+ */
+/*----------------------------------------------------------------------------*/
+cube_t * cube_load_tiled(char ** filenames, int nfiles) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate the out-of-core storage of a cube.
+  @param    t   Out-of-core storage.
+  @return   void
+
+  Called by cube_del(), do not call it directly.
+ */
+/*----------------------------------------------------------------------------*/
+void cube_tiles_del(cube_tiles * t) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get the height of the tiles of an out-of-core cube.
+  @param    c   Out-of-core cube.
+  @return   The number of lines per tile, -1 if the cube is in memory.
+
+  Bands of lines across all planes are best accessed by multiples of
+  this height, aligned on it.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_tiles_rows(cube_t * c) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Read lines of a plane of an out-of-core cube.
+  @param    c       Out-of-core cube.
+  @param    p       Plane index, from 0.
+  @param    y0      First line to read, from 0.
+  @param    ny      Number of lines to read.
+  @param    dst     Buffer receiving ny*lx pixels.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The lines are copied from the tile cache, loading the missing tiles
+  from disk. When the tiles are requested in sequence, along a plane or
+  across planes, the next ones are announced to the system so that
+  they are read ahead. This function may be called from parallel tasks.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_tiles_read(cube_t * c, int p, int y0, int ny, pixelvalue * dst) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get a copy of a plane of an out-of-core cube.
+  @param    c   Out-of-core cube.
+  @param    p   Plane index, from 0.
+  @return   1 newly allocated image, NULL in case of error.
+ */
+/*----------------------------------------------------------------------------*/
+image_t * cube_tiles_getplane(cube_t * c, int p) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Replace a plane of an out-of-core cube.
+  @param    c   Out-of-core cube.
+  @param    p   Plane index, from 0.
+  @param    im  New plane contents.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The image is written to a scratch file which is deleted with the
+  cube. It is not modified and still belongs to the caller.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_tiles_putplane(cube_t * c, int p, image_t * im) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get a band of lines of an out-of-core cube.
+  @param    c   Out-of-core cube.
+  @param    y0  First line of the band, from 0.
+  @param    ny  Number of lines in the band.
+  @return   1 newly allocated cube of lx x ny x np pixels, in memory.
+ */
+/*----------------------------------------------------------------------------*/
+cube_t * cube_tiles_getband(cube_t * c, int y0, int ny) ;
+
+#endif
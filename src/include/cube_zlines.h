@@ -0,0 +1,211 @@
+/*----------------------------------------------------------------------------*/
+/**
+   @file    cube_zlines.h
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Z-major storage of cube time lines
+
+   A cube_t stores its pixels plane by plane, so that the time line of
+   a pixel (its values in all planes) is spread over as many separately
+   allocated buffers, with a stride of lx*ly pixels. Algorithms working
+   on time lines are better served by a z-major copy of the cube, in
+   which the np values of a pixel are contiguous and consecutive pixels
+   follow each other.
+
+   A cube_zlines object holds such a copy for a range of pixels of a
+   cube, cut into tiles which are transposed from and to the planes in
+   parallel. Time lines are accessed with cube_zlines_get() or walked
+   with an iterator:
+
+   \begin{verbatim}
+   cube_zlines  *   zl ;
+   zline_iter       it ;
+
+   zl = cube_zlines_new(cube, 0, cube->lx * cube->ly) ;
+   cube_zlines_iter_init(&it, zl) ;
+   while (cube_zlines_iter_next(&it)) {
+       process(it.line, cube->np, it.pos) ;
+   }
+   cube_zlines_put(zl, cube) ;  (only if time lines were modified)
+   cube_zlines_del(zl) ;
+   \end{verbatim}
+
+   Processing a whole cube through a single copy doubles its memory
+   footprint: large cubes are best processed by chunks of
+   cube_zlines_chunk() pixels, possibly in parallel. The lower-level
+   cube_zlines_gather() and cube_zlines_scatter() transpose a range of
+   pixels to and from a caller buffer.
+*/
+/*----------------------------------------------------------------------------*/
+
+/*
+    $Id$
+    $Author$
+    $Date$
+    $Revision$
+*/
+
+#ifndef _CUBE_ZLINES_H_
+#define _CUBE_ZLINES_H_
+
+/*-----------------------------------------------------------------------------
+                                Includes
+ -----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "local_types.h"
+
+/*-----------------------------------------------------------------------------
+                                New types
+ -----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Z-major copy of the time lines of a range of pixels of a cube.
+
+  Pixel positions are understood as i + j*lx in the cube planes. The
+  time line of pixel pos starts at
+  tile[(pos-pos0)/tilepix] + ((pos-pos0)%tilepix) * np.
+ */
+/*----------------------------------------------------------------------------*/
+typedef struct _cube_zlines_ {
+    int             lx, ly, np ;
+    int             pos0 ;      /* first pixel held */
+    int             npix ;      /* number of pixels held */
+    int             tilepix ;   /* pixels per tile */
+    int             ntiles ;
+    pixelvalue  **  tile ;
+} cube_zlines ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Iterator over the time lines of a cube_zlines object.
+ */
+/*----------------------------------------------------------------------------*/
+typedef struct _zline_iter_ {
+    cube_zlines *   zl ;
+    int             pos ;       /* current pixel position */
+    pixelvalue  *   line ;      /* its np values */
+    int             left ;      /* pixels left in the current tile */
+    int             t ;         /* current tile */
+} zline_iter ;
+
+/*-----------------------------------------------------------------------------
+                                Function prototypes
+ -----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get a good number of pixels to process time lines by chunks.
+  @param    np      Number of planes.
+  @return   Number of pixels whose time lines fill about one megabyte.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_zlines_chunk(int np) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Copy the time lines of a range of pixels to a buffer.
+  @param    c       Cube in plane layout.
+  @param    pos0    First pixel position.
+  @param    npix    Number of pixels.
+  @param    dst     Buffer receiving npix*np values.
+  @return   void
+
+  The np values of pixel pos0+i are stored in dst[i*np .. i*np+np-1].
+  Planes are read by blocks so that all accesses are sequential.
+ */
+/*----------------------------------------------------------------------------*/
+void cube_zlines_gather(cube_t * c, int pos0, int npix, pixelvalue * dst) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Copy time lines from a buffer back to a range of pixels.
+  @param    src     Buffer holding npix*np values, as cube_zlines_gather().
+  @param    pos0    First pixel position.
+  @param    npix    Number of pixels.
+  @param    c       Cube in plane layout, modified.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+void cube_zlines_scatter(pixelvalue * src, int pos0, int npix, cube_t * c) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Make a z-major copy of a range of pixels of a cube.
+  @param    c       Cube in plane layout.
+  @param    pos0    First pixel position.
+  @param    npix    Number of pixels.
+  @return   1 newly allocated cube_zlines object, NULL in case of error.
+
+  The pixels are cut into tiles of cube_zlines_chunk() pixels, which are
+  transposed in parallel. The returned object must be deallocated with
+  cube_zlines_del().
+ */
+/*----------------------------------------------------------------------------*/
+cube_zlines * cube_zlines_new(cube_t * c, int pos0, int npix) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Copy z-major time lines back to the planes of a cube.
+  @param    zl      Z-major time lines.
+  @param    c       Cube in plane layout, of the same size, modified.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Missing planes of the cube (e.g. right after cube_new()) are
+  allocated. Only the pixels held by zl are modified.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_zlines_put(cube_zlines * zl, cube_t * c) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate a cube_zlines object.
+  @param    zl      Object to deallocate.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+void cube_zlines_del(cube_zlines * zl) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get the time line of a pixel.
+  @param    zl      Z-major time lines.
+  @param    pos     Pixel position, within the range held by zl.
+  @return   Pointer to the np values of the pixel, NULL if out of range.
+
+  The returned pointer belongs to zl: the values may be modified in
+  place, but the pointer must not be freed.
+ */
+/*----------------------------------------------------------------------------*/
+pixelvalue * cube_zlines_get(cube_zlines * zl, int pos) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Start an iteration over all time lines of a cube_zlines.
+  @param    it      Iterator to initialize.
+  @param    zl      Z-major time lines.
+  @return   void
+
+  The iterator is positioned before the first pixel: call
+  cube_zlines_iter_next() to get to it.
+ */
+/*----------------------------------------------------------------------------*/
+void cube_zlines_iter_init(zline_iter * it, cube_zlines * zl) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Move an iterator to the next time line.
+  @param    it      Iterator.
+  @return   1 if it now points to a time line, 0 at the end.
+
+  On success, it->pos holds the pixel position and it->line the np
+  values of its time line, in increasing pixel order.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_zlines_iter_next(zline_iter * it) ;
+
+#endif
@@ -33,6 +33,20 @@
 #include "image_filters.h"
 #include "pixelmaps.h"
 
+/*---------------------------------------------------------------------------
+   								New types
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Opaque bad pixel index.
+
+  List of the bad pixels of a pixel map with the positions and weights
+  of the neighbors used to replace them, see deadpix_index_new().
+ */
+/*--------------------------------------------------------------------------*/
+typedef struct _deadpix_index_ deadpix_index ;
+
 /*---------------------------------------------------------------------------
   						Function ANSI C prototypes
  --------------------------------------------------------------------------*/
@@ -74,6 +88,91 @@ int cube_clean_deadpix(
         pixelmap    *   deadpixmap) ;
 
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Build a bad pixel index from a pixel map.
+  @param    deadpixmap  Dead pixel map.
+  @param    hsize       Half-size of the interpolation window.
+  @param    maxsize     Maximal half-size of the window for clusters.
+  @return   1 newly allocated deadpix_index, NULL in case of error.
+
+  The index lists the bad pixels of the map together with the positions
+  and weights of the good pixels used to replace them, so that it can
+  be applied to any number of images of the same size without looking
+  at the map again.
+
+  Each bad pixel is replaced by the weighted mean of the good pixels in
+  the (2*hsize+1)x(2*hsize+1) window centered on it. With hsize=1 all
+  weights are 1, which is the 3x3 average of image_clean_deadpix().
+  Larger windows weight the neighbors by the inverse of their squared
+  distance, so that the closest ones dominate.
+
+  If a bad pixel has no good neighbor in its window, as happens inside
+  clusters of bad pixels, the window is grown one pixel at a time up to
+  a half-size of maxsize. Pixels which still have no good neighbor are
+  set to zero.
+
+  The returned object must be deallocated using deadpix_index_del().
+ */
+/*--------------------------------------------------------------------------*/
+deadpix_index * deadpix_index_new(
+        pixelmap    *   deadpixmap,
+        int             hsize,
+        int             maxsize) ;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Delete a bad pixel index.
+  @param    idx     Bad pixel index to delete.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void deadpix_index_del(deadpix_index * idx) ;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the number of bad pixels in a bad pixel index.
+  @param    idx     Bad pixel index.
+  @return   int number of bad pixels, -1 in case of error.
+ */
+/*--------------------------------------------------------------------------*/
+int deadpix_index_nbad(deadpix_index * idx) ;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Clean an image of its dead pixels using a bad pixel index.
+  @param    img     Image to clean, modified in place.
+  @param    idx     Bad pixel index.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Only the bad pixels listed in the index are modified, see
+  deadpix_index_new() for the interpolation method.
+ */
+/*--------------------------------------------------------------------------*/
+int image_clean_deadpix_index(
+        image_t         *   img,
+        deadpix_index   *   idx) ;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Clean out a cube of its bad pixels using a bad pixel index.
+  @param    in      Cube to clean, modified in place.
+  @param    idx     Bad pixel index.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Same as image_clean_deadpix_index() for all planes of the cube. The
+  planes are processed in parallel.
+ */
+/*--------------------------------------------------------------------------*/
+int cube_clean_deadpix_index(
+        cube_t          *   in,
+        deadpix_index   *   idx) ;
+
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Detect bad pixels in a single image by median filtering.
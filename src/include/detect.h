@@ -115,6 +115,7 @@ typedef struct _detected_ {
 
 #include "detect_ks.h"
 #include "detect_sq.h"
+#include "detect_tile.h"
 
 /*-----------------------------------------------------------------------------
    							Function prototypes
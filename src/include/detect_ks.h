@@ -42,6 +42,10 @@
   @param    kappa       Kappa for kappa-sigma clipping.
   @param    smear_flag  Request image smearing before applying detection.
   @return   the detected object
+
+  The threshold is the median of the detection image plus kappa times
+  its mean absolute deviation to the median. The detection runs over
+  tiles in parallel, see detected_tile_engine().
  */
 /*----------------------------------------------------------------------------*/
 detected * detected_ks_engine(
@@ -0,0 +1,75 @@
+/*----------------------------------------------------------------------------*/
+/**
+   @file    detect_tile.h
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Object detection over image tiles
+*/
+/*----------------------------------------------------------------------------*/
+
+/*
+    $Id$
+    $Author$
+    $Date$
+    $Revision$
+*/
+
+#ifndef _DETECT_TILE_H_
+#define _DETECT_TILE_H_
+
+/*-----------------------------------------------------------------------------
+                                Includes
+ -----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "local_types.h"
+#include "doubles.h"
+#include "detect.h"
+
+/*-----------------------------------------------------------------------------
+                                Function codes
+ -----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Locate objects in an image over tiles, with a background mesh.
+  @param    ref         Reference image.
+  @param    kappa       Kappa for kappa-sigma clipping.
+  @param    smear_flag  Request image smearing before applying detection.
+  @param    mesh        Size of the background mesh in pixels, 0 for none.
+  @return   the detected object
+
+  The detection image (the reference image, smoothed by a 5x5 mean
+  filter if smear_flag is set) is cut into cells of mesh x mesh
+  pixels. The median and the mean absolute deviation to the median of
+  every cell are filtered by a 3x3 median over the mesh to get rid of
+  the cells covered by large objects, and interpolated bilinearly
+  between the cell centers to get the background and noise maps. All
+  pixels above the background plus kappa times the noise are object
+  pixels. If mesh is 0, a single background and noise value is
+  computed over the whole image, which gives the same result as
+  detected_ks_engine().
+
+  The image is then processed by tiles of 256x256 pixels in parallel:
+  every tile is thresholded, cleaned by the same 3x3 morphology as
+  pixelmap_morpho_closing() and labelled, and the statistics of its
+  objects are accumulated. Objects touching across tile boundaries are
+  then merged, and the objects are numbered in the order in which
+  intimage_labelize_pixelmap() would find them, so that the result
+  does not depend on the tiling nor on the number of threads. The
+  returned object holds the same fields as the one returned by
+  detected_compute_objstat().
+ */
+/*----------------------------------------------------------------------------*/
+detected * detected_tile_engine(
+        image_t *   ref,
+        double      kappa,
+        int         smear_flag,
+        int         mesh) ;
+
+#endif
@@ -42,6 +42,11 @@
   - @c E_DEBUG for the debug level (see comm.h).
   - @c E_TMPDIR for the tmpdirname parameter (see xmemory.h)
   - @c E_LOGFILE for the logfile parameter (see comm.h)
+  - @c E_NTHREADS for the number of worker threads (see parallel.h)
+  - @c E_TRACE to enable performance tracing (see trace.h)
+  - @c E_CACHE for the product cache directory (see prodcache.h)
+  - @c E_CUBEMEM for the memory budget of loaded cubes in megabytes
+    (see cube_tiles.h)
  
   Notice that @c E_LOGFILE is tested in other places (see comm.h) for
   logfile output.
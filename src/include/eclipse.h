@@ -21,13 +21,16 @@
 #include "iniparser.h"
 #include "manpage.h"
 #include "memstr.h"
+#include "parallel.h"
 #include "parse_tok.h"
 #include "pid_i.h"
+#include "prodcache.h"
 #include "rtd_i.h"
 #include "show.h"
 #include "strlib.h"
 #include "t_iso8601.h"
 #include "t_stamp.h"
+#include "trace.h"
 #include "userid.h"
 
 /* Local types and globals */
@@ -49,8 +52,10 @@
 #include "poly2d.h"
 #include "polygon.h"
 #include "random.h"
+#include "sky_index.h"
 
 /* Image processing routines */
+#include "arith_expr.h"
 #include "corner.h"
 #include "cube2image.h"
 #include "cube_arith.h"
@@ -59,6 +64,9 @@
 #include "cube_handling.h"
 #include "cube_load.h"
 #include "cube_save.h"
+#include "cube_stream.h"
+#include "cube_tiles.h"
+#include "cube_zlines.h"
 #include "dead_pixels.h"
 #include "detect.h"
 #include "detector.h"
@@ -78,6 +86,7 @@
 #include "intimage.h"
 #include "irstd.h"
 #include "matchpoint.h"
+#include "mosaic.h"
 #include "photometry.h"
 #include "pixel_handling.h"
 #include "pixelmaps.h"
@@ -86,6 +95,7 @@
 #include "slitposition.h"
 #include "star_analysis.h"
 #include "static_sz.h"
+#include "warp_map.h"
 #include "xcorrelation.h"
 
 /* Spectroscopy routines */
@@ -243,6 +243,11 @@ image_t * image_gen_otf(
   conditions, and applying a Fourier transform to it to bring it back to real 
   space. The returned PSF is normalized to unity flux, to help Strehl ratio 
   computations.
+
+  The last generated PSFs are kept in memory, and also on disk in the
+  product cache directory if it is set (see prodcache.h), so that the
+  PSF is computed only once for a given set of parameters. The returned
+  image is a copy, to deallocate with image_del().
  */
 /*----------------------------------------------------------------------------*/
 /* <python> */
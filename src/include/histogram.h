@@ -76,6 +76,11 @@ typedef struct _HISTOGRAM_
   only pixels between @c min and @c max, and sampling over @c nbin
   bins. It returns a newly allocated histogram object, which must
   be deallocated using histogram_del().
+
+  The image is read at most twice: once to find its min and max if
+  they are requested, once to fill the bins. Both passes are shared
+  among the worker threads, each of them filling private bins which
+  are summed at the end.
  */
 /*--------------------------------------------------------------------------*/
 
@@ -123,6 +128,46 @@ histogram * histogram_compute_cumulative(
 pixelvalue histogram_find_mode(histogram * histo) ;
 
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find a percentile of a histogram.
+  @param    histo       The histogram.
+  @param    fraction    Fraction of the samples below the percentile.
+  @return   1 pixelvalue
+
+  This function walks the cumulative counts of a histogram (as returned
+  by histogram_compute()) to find the value below which the requested
+  fraction of the sampled values lie, interpolating linearly inside the
+  bin where that fraction is reached. A fraction of 0.5 gives an
+  estimate of the median. The precision is limited by the bin size.
+ */
+/*--------------------------------------------------------------------------*/
+pixelvalue histogram_find_percentile(histogram * histo, double fraction) ;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find the kth smallest value of an array using histograms.
+  @param    data    Array of pixelvalues.
+  @param    npix    Number of values in the array.
+  @param    k       Rank of the value to find.
+  @return   1 pixelvalue
+
+  Returns the same value as kth_smallest(), i.e. the minimum for k=0
+  and the maximum for k=npix-1, but leaves the input array untouched.
+
+  Large arrays are not copied. The bin holding the requested rank is
+  found from a histogram of the values in a range guessed from a small
+  sample of the array (or over the full range of values if the guess
+  was wrong), then from a finer histogram of the values of that bin,
+  and so on until few enough values are left to be gathered and passed
+  to kth_smallest(). Histograms are computed in parallel. Small arrays
+  are copied and passed to kth_smallest() directly.
+ */
+/*--------------------------------------------------------------------------*/
+pixelvalue histogram_kth_smallest(pixelvalue * data, int npix, int k) ;
+
+
 
 /*-------------------------------------------------------------------------*/
 /**
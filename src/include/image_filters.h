@@ -80,6 +80,42 @@
 /*----------------------------------------------------------------------------*/
 double * image_filter_getkernel(char * name, int * nval, int * morpho);
 
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Filter an image in spatial domain with a kx x ky kernel.
+  @param    image_in    Image to filter.
+  @param    filter      Filter definition, kx*ky doubles.
+  @param    kx          Kernel size in x, odd.
+  @param    ky          Kernel size in y, odd.
+  @return   1 newly allocated image.
+
+  The kernel is given line by line from the bottom left corner, as for
+  image_filter3x3(): filter[k+l*kx] is applied to the pixel at
+  (i+k-kx/2, j+l-ky/2) to compute the pixel at (i,j). The result is
+  divided by the sum of the coefficients unless it is close to zero,
+  and the kx/2 columns and ky/2 lines on the image borders are set to 0.
+
+  The way the kernel is applied depends on its shape:
+  - if all coefficients are equal, it is applied with running sums, at
+    a cost which does not depend on the kernel size.
+  - if the kernel is separable, i.e. the product of a column by a line,
+    it is applied in two 1-D passes.
+  - other kernels are applied directly if small, or by FFT if they have
+    at least 225 coefficients.
+
+  Except for the FFT, the image is processed by bands of lines in
+  parallel.
+
+  The returned image is a newly allocated object, it must be freed using
+  image_del().
+ */
+/*----------------------------------------------------------------------------*/
+image_t * image_filter_kernel(
+        image_t *   image_in,
+        double  *   filter,
+        int         kx,
+        int         ky) ;
+
 /*----------------------------------------------------------------------------*/
 /**
   @brief    Filter an image in spatial domain with a 3x3 kernel.
@@ -234,9 +270,10 @@ image_t * image_filter_horizontal_median(image_t * in, int filtsize) ;
   odd-sized and square. The given parameter defines the half-size of the
   filter to apply.
 
-  The filter is applied in one pass to avoid memory overflows. Applying it
-  in two passes would be faster but requires twice the amount of memory.
-  This is an issue, especially with WFI frames.
+  Near the image borders, the average is taken over the pixels of the
+  kernel which fall inside the image. The filter is applied with running
+  sums over bands of lines processed in parallel, which only need a few
+  lines of memory per band and cost the same whatever the kernel size.
 
   Example: applying a 9x9 flat filter would be done by setting ksize to 4.
  */
@@ -98,6 +98,9 @@ typedef struct _strehl_parm_ {
   Compute various images statistics. Results are all stored into a returned
   structure, than must be deallocated using free(). See the structure details 
   in local_types.h.
+
+  Sums are computed in blocks of pixelcalc values: with --float32, flux,
+  mean and standard deviation keep a relative accuracy of about 1e-5.
  */
 /*----------------------------------------------------------------------------*/
 /* <python> */
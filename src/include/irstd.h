@@ -46,21 +46,67 @@
 typedef struct _IR_STD_ {
 	int				select ;
     const char    * name ;
-	const double	ra ;
-	const double	dec ;
+	double			ra ;
+	double			dec ;
     const char    *	sptype ;
-    const float  	mag_J ;
-    const float  	mag_H ;
-    const float  	mag_K ;
-    const float  	mag_Ks ;
-    const float  	mag_L ;
-    const float  	mag_M ;
-    const float  	mag_Lp ;
-    const float  	mag_Mp ;
-    const int       source ;
+    float  			mag_J ;
+    float  			mag_H ;
+    float  			mag_K ;
+    float  			mag_Ks ;
+    float  			mag_L ;
+    float  			mag_M ;
+    float  			mag_Lp ;
+    float  			mag_Mp ;
+    int       		source ;
 } irstd ;
 
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Binary star catalog file header
+
+  A binary star catalog file, as written by convert_tab -b, holds this
+  header, followed by ncat catalog names of IRSTD_BIN_NAMESZ characters,
+  followed by nstars irstd_bin_record structs. All strings are NULL
+  terminated. The file is written in the native byte order and
+  structure alignment, the byteorder field holds IRSTD_BIN_BYTEORDER
+  and is used to reject files written on another architecture.
+ */
+/*-------------------------------------------------------------------------*/
+#define IRSTD_BIN_MAGIC		"IRSTDBIN"
+#define IRSTD_BIN_VERSION	1
+#define IRSTD_BIN_BYTEORDER	0x01020304
+#define IRSTD_BIN_NAMESZ	32
+#define IRSTD_BIN_TYPESZ	16
+
+typedef struct _IRSTD_BIN_HEADER_ {
+	char	magic[8] ;
+	int		version ;
+	int		byteorder ;
+	int		ncat ;
+	int		nstars ;
+} irstd_bin_header ;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Binary star catalog file record
+
+  Magnitudes are stored in the order of the ir_waveband enum, 99 for an
+  unknown magnitude. source is the index of the star catalog in the
+  list of catalog names of the file.
+ */
+/*-------------------------------------------------------------------------*/
+typedef struct _IRSTD_BIN_RECORD_ {
+	double	ra ;
+	double	dec ;
+	float	mag[8] ;
+	int		source ;
+	char	name[IRSTD_BIN_NAMESZ] ;
+	char	sptype[IRSTD_BIN_TYPESZ] ;
+} irstd_bin_record ;
+
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief	sptype_temp object
@@ -96,6 +142,24 @@ typedef enum _WAVEBAND_ {
  ---------------------------------------------------------------------------*/
 
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Load a binary star catalog file
+  @param    filename    Name of the file to load, NULL for the default list.
+  @return   int Number of stars in the new star list, -1 on error.
+
+  Replaces the current star list and catalog names by the contents of
+  a binary catalog file written by convert_tab -b. The file is mapped
+  in memory and the star names point directly into it. All stars of the
+  new list are active. Pointers returned by previous searches become
+  invalid.
+
+  Pass NULL to get back to the star list compiled into the library. On
+  error, the current star list is left unchanged.
+ */
+/*--------------------------------------------------------------------------*/
+int irstd_load_catalog(char * filename) ;
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Sets the active catalogs for search
@@ -170,11 +234,12 @@ irstd ** irstd_get_star_by_name(
   @param    dec_d       Declination {\em in degrees}.
   @return   Pointer to one newly allocated standard star object.
 
-  Finds out the closest star to a given position and returns it as a
-  newly allocated star object. Provide RA and DEC in degrees!
+  Finds out the closest active star to a given position, within 2
+  arcminutes, and returns it. Provide RA and DEC in degrees! Distances
+  are great-circle distances on the sky.
 
   The returned star object is a pointer to the found star in the
-  internal irstd_list structure, thus must not be freed.
+  internal star list, thus must not be freed.
  */
 /*--------------------------------------------------------------------------*/
 irstd * irstd_get_closest_star(double ra_d, double dec_d) ;
@@ -210,19 +275,14 @@ irstd * irstd_get_star_magnitude(double, double, ir_waveband, double *) ;
   @brief    Find all stars within a given radius around a position.
   @param    ra_d    Right ascension of the center {\em in degrees}.
   @param    dec_d   Declination of the center {\em in degrees}.
-  @param    radius  Euclidean radius around the center.
+  @param    radius  Radius around the center {\em in degrees}.
   @param    nfound  Output number of found stars.
   @return   Newly allocated list of stars (or NULL if none found).
 
-  This functions locates all stars in a given disk. The disk is
+  This functions locates all active stars in a given disk. The disk is
   defined by a center which coordinates are given in degrees (RA and
-  Dec), and the radius is defined as a euclidean distance, i.e.:
-
-  A star at (r,d) is in the disk of center (r0,d0) and radius R if:
-
-  \[
-  (r-r_0)^2+(d-d_0)^2 < R^2
-  \]
+  Dec), and the radius is the great-circle distance on the sky. Stars
+  are returned in the order of the star list.
 
   The returned list of stars must be freed using free().
  */
@@ -88,6 +88,33 @@ typedef float	pixelvalue ;
 /* </python> */
 
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Type used for intermediate results in pixel kernels.
+
+  Interpolation, cross-correlation, filtering and statistics kernels
+  convert pixels to this type before doing any arithmetic. It is
+  'double' by default. If eclipse is configured with --float32
+  (FLOAT32_KERNELS defined in config.h) and pixels are floats, it is
+  'float' instead: kernels then work on pixels in their native format,
+  which halves the memory traffic and doubles the number of values per
+  vector register.
+
+  In single precision, the relative error on an interpolated pixel is
+  below 1e-6 of the local pixel dynamic range. Sums over many pixels
+  (fluxes, squared differences) are accumulated in blocks of at most a
+  few hundred pixels in single precision, then in double precision,
+  which bounds their relative error to about 1e-5.
+ */
+/*-------------------------------------------------------------------------*/
+#if defined(FLOAT32_KERNELS) && !defined(DOUBLEPIX)
+#define PIXELCALC_FLOAT	1
+typedef float	pixelcalc ;
+#else
+typedef double	pixelcalc ;
+#endif
+
+
 
 /*-------------------------------------------------------------------------*/
 /**
@@ -221,6 +248,8 @@ typedef struct _cube_
     int			np ;
 	/* Pointers to image zones     		*/
     image_t	**	plane ;
+	/* Out-of-core storage, NULL if all planes are in memory */
+	struct _cube_tiles_	*	tiles ;
 } cube_t ;
  
 #endif 
@@ -33,6 +33,33 @@
 #include "xmemory.h"
 #include "image_handling.h"
 
+/*---------------------------------------------------------------------------
+                                New types
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Rigid transform between two lists of points
+
+  A point (x,y) of the reference list is mapped to the other list as:
+
+  \begin{verbatim}
+  x' = dx + x cos(angle) - y sin(angle)
+  y' = dy + x sin(angle) + y cos(angle)
+  \end{verbatim}
+
+  nmatch is the number of points of the reference list matched by the
+  transform, 0 if no transform was found.
+ */
+/*--------------------------------------------------------------------------*/
+typedef struct _MATCH_TRANSFORM_ {
+    double      dx ;
+    double      dy ;
+    /* Rotation in degrees */
+    double      angle ;
+    int         nmatch ;
+} match_transform ;
+
 /*---------------------------------------------------------------------------
                             Function prototypes
  ---------------------------------------------------------------------------*/
@@ -46,6 +73,10 @@
   @param    offsety returned y offset
   @param    kappa   for detection
   @return   0 if ok, -1 otherwise   
+
+  Up to 100 bright stars are detected in both images (subsampled by 2),
+  and the offset is the translation matching most of them within 3
+  pixels (see match_pointslist_transform()).
  */
 /*--------------------------------------------------------------------------*/
 int offsets_estimates(
@@ -61,10 +92,93 @@ int offsets_estimates(
   @param    det1    first list of detected points
   @param    det2    second list of detected points
   @return   look up table
+
+  The translation between the lists is estimated with
+  match_pointslist_transform(), and every point of det1 is associated
+  to the closest point of det2 within 3 pixels after translation. The
+  returned table holds, for every point of det1, the index of the
+  associated point in det2 or -1 if there is none. It must be
+  deallocated using free(). NULL is returned if the lists cannot be
+  matched.
  */
 /*--------------------------------------------------------------------------*/
 int * match_pointslist(
         double3    *   det1,
         double3    *   det2) ;
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find the rigid transform between two lists of points
+  @param    ref         Reference list of points
+  @param    det         List of points to match
+  @param    tol         Matching tolerance in pixels
+  @param    max_angle   Maximal rotation in degrees, 0 for translation only
+  @param    tr          Returned transform
+  @return   0 if ok, -1 otherwise
+
+  The lists do not need to have the same number of points nor to be
+  complete. The z field of the points is their flux: candidate
+  transforms are built by associating the brightest points of both
+  lists (single points for a translation, pairs of points of equal
+  length for a rotation), and the transform matching the most points
+  of ref to a point of det within tol is kept. It is then refined by a
+  least-squares fit on the matched points. The cost is about
+  O(n log n) in the number of points.
+
+  At least 3 points must be matched for the transform to be valid, or
+  all points of the shorter list if it has less than 3 points.
+ */
+/*--------------------------------------------------------------------------*/
+int match_pointslist_transform(
+        double3         *   ref,
+        double3         *   det,
+        double              tol,
+        double              max_angle,
+        match_transform *   tr) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Match a reference list of points against many lists
+  @param    ref         Reference list of points
+  @param    det         Lists of points to match
+  @param    n           Number of lists in det
+  @param    tol         Matching tolerance in pixels
+  @param    max_angle   Maximal rotation in degrees, 0 for translation only
+  @return   Newly allocated array of n transforms, NULL on error
+
+  Calls match_pointslist_transform() for every list of det, in
+  parallel. The nmatch field of the transforms of the lists which could
+  not be matched is 0. The returned array must be deallocated using
+  free().
+ */
+/*--------------------------------------------------------------------------*/
+match_transform * match_pointslist_many(
+        double3         *   ref,
+        double3         **  det,
+        int                 n,
+        double              tol,
+        double              max_angle) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find offsets in an image sequence by matching stars
+  @param    in      Input cube
+  @param    ref     Index of the reference plane
+  @param    kappa   Kappa for the detection
+  @return   1 newly allocated double3 object containing offset estimates.
+
+  Up to 100 bright stars are detected in every plane, and matched to the
+  stars of the reference plane with match_pointslist_many(). The
+  returned offsets follow the convention of cube_blindoffsets(): the
+  x and y fields hold the offsets of every plane relative to the
+  reference plane, the z field the number of matched stars. NULL is
+  returned if a plane cannot be matched. The returned object must be
+  deallocated using double3_del().
+ */
+/*--------------------------------------------------------------------------*/
+double3 * cube_matchoffsets(
+        cube_t  *   in,
+        int         ref,
+        double      kappa) ;
+
 #endif
@@ -0,0 +1,236 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    mosaic.h
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Multi-extension (mosaic) FITS file handling.
+
+   A mosaic is a FITS file holding one image per extension, e.g. one
+   extension per CCD chip. This module indexes all extensions of such
+   a file once, then loads chips and writes output chips from several
+   worker threads without going through the qfits cache again.
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+#ifndef _MOSAIC_H_
+#define _MOSAIC_H_
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "xmemory.h"
+#include "comm.h"
+#include "local_types.h"
+#include "image_handling.h"
+#include "parallel.h"
+#include "qfits.h"
+
+/*---------------------------------------------------------------------------
+   								New types
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Description of one image extension in a mosaic file.
+
+  Offsets are given in bytes from the beginning of the file.
+ */
+/*--------------------------------------------------------------------------*/
+typedef struct _mosaic_chip_ {
+	/* Image size */
+	int			lx, ly ;
+	/* FITS pixel type and scaling */
+	int			bitpix ;
+	double		bscale ;
+	double		bzero ;
+	/* Offset to the header and to the data */
+	long		hdr_beg ;
+	long		data_beg ;
+} mosaic_chip ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    An indexed multi-extension FITS file.
+
+  Extension number i (starting from 1) is described by chip[i-1].
+ */
+/*--------------------------------------------------------------------------*/
+typedef struct _mosaic_ {
+	char		*	filename ;
+	int				n_ext ;
+	mosaic_chip	*	chip ;
+} mosaic_t ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    A multi-extension FITS file being written.
+
+  All headers are written when the object is created and space is
+  reserved for every data section, so that extensions can be filled
+  in any order and from several threads.
+ */
+/*--------------------------------------------------------------------------*/
+typedef struct _mosaic_out_ {
+	char		*	filename ;
+	int				n_ext ;
+	mosaic_chip	*	chip ;
+} mosaic_out ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Per-chip processing function.
+
+  Receives a loaded chip, its extension number and the opaque argument
+  given to mosaic_process(). Returns the image to save for this
+  extension: either the input image modified in place, or a newly
+  allocated image (the input is then deallocated by the caller). A NULL
+  return signals an error. This function is called from worker threads
+  and must not print messages.
+ */
+/*--------------------------------------------------------------------------*/
+typedef image_t * (*mosaic_chip_fn)(image_t * chip, int xtnum, void * arg) ;
+
+/*---------------------------------------------------------------------------
+  							Function prototypes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Open and index a multi-extension FITS file.
+  @param    filename    Name of the file to open.
+  @return   1 newly allocated mosaic_t, or NULL in case of error.
+
+  Reads all extension headers once and stores the size, pixel type and
+  data offset of every image extension. Extensions which are not
+  2-dimensional images get a zero size and cannot be loaded.
+  The returned object must be deallocated with mosaic_close().
+ */
+/*--------------------------------------------------------------------------*/
+mosaic_t * mosaic_open(char * filename) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate a mosaic_t object.
+  @param    m   Object to deallocate.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void mosaic_close(mosaic_t * m) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Load one chip from an indexed mosaic.
+  @param    m       Indexed mosaic.
+  @param    xtnum   Extension number (starting from 1).
+  @return   1 newly allocated image, or NULL in case of error.
+
+  Reads the data section with a private file descriptor, so that
+  this function can be called concurrently on different extensions.
+  It does not print any message.
+ */
+/*--------------------------------------------------------------------------*/
+image_t * mosaic_load_chip(mosaic_t * m, int xtnum) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create a multi-extension output file.
+  @param    filename    Name of the file to create.
+  @param    h_main      Main header.
+  @param    h_ext       Array of n_ext extension headers.
+  @param    n_ext       Number of extensions.
+  @return   1 newly allocated mosaic_out, or NULL in case of error.
+
+  Extension headers must contain valid BITPIX, NAXIS1 and NAXIS2
+  values: they determine the space reserved for every data section.
+  All headers are written to disk immediately, data sections are
+  zero-filled until mosaic_out_put() is called for them.
+  The returned object must be deallocated with mosaic_out_close().
+ */
+/*--------------------------------------------------------------------------*/
+mosaic_out * mosaic_out_create(
+		char			*	filename,
+		qfits_header	*	h_main,
+		qfits_header	**	h_ext,
+		int					n_ext) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create an output file with the same layout as an input mosaic.
+  @param    m           Indexed input mosaic.
+  @param    filename    Name of the file to create.
+  @param    h_main      Main header, or NULL to copy the input one.
+  @param    bitpix      Output BITPIX.
+  @param    lx          Output chip size in x, 0 to keep the input size.
+  @param    ly          Output chip size in y, 0 to keep the input size.
+  @return   1 newly allocated mosaic_out, or NULL in case of error.
+
+  Extension headers are copied from the input file, with BITPIX and
+  NAXIS keywords updated and BSCALE/BZERO removed.
+ */
+/*--------------------------------------------------------------------------*/
+mosaic_out * mosaic_out_create_like(
+		mosaic_t		*	m,
+		char			*	filename,
+		qfits_header	*	h_main,
+		int					bitpix,
+		int					lx,
+		int					ly) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Write one chip into an output mosaic.
+  @param    out     Output mosaic.
+  @param    xtnum   Extension number (starting from 1).
+  @param    chip    Image to write.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The image size must match the size declared for this extension.
+  This function can be called concurrently on different extensions.
+  It does not print any message.
+ */
+/*--------------------------------------------------------------------------*/
+int mosaic_out_put(mosaic_out * out, int xtnum, image_t * chip) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Close an output mosaic.
+  @param    out     Output mosaic.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void mosaic_out_close(mosaic_out * out) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Apply a function to all chips of a mosaic in parallel.
+  @param    m       Indexed input mosaic.
+  @param    out     Output mosaic, or NULL.
+  @param    fn      Per-chip function.
+  @param    arg     Opaque argument passed to fn.
+  @return   int number of chips that failed, -1 on error.
+
+  Every chip is loaded, passed to fn and written to the same
+  extension in the output mosaic (if out is not NULL), by one of the
+  workers started by eclipse_parallel_run(). Only a few chips are thus
+  in memory at any time.
+ */
+/*--------------------------------------------------------------------------*/
+int mosaic_process(
+		mosaic_t		*	m,
+		mosaic_out		*	out,
+		mosaic_chip_fn		fn,
+		void			*	arg) ;
+
+#endif
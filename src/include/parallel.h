@@ -0,0 +1,113 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    parallel.h
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Run independent tasks on a set of worker threads.
+
+   This module offers a minimal interface to distribute a number of
+   independent tasks (chips of a mosaic, planes of a cube, tiles of an
+   image...) on several threads. Threads are only used if eclipse was
+   configured with --mt (HAS_PTHREADS defined in config.h), otherwise
+   all tasks are run sequentially in the calling thread.
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+
+/*---------------------------------------------------------------------------
+   								Defines
+ ---------------------------------------------------------------------------*/
+
+/** Maximum number of worker threads ever started */
+#define PARALLEL_MAXTHREADS		64
+
+/*---------------------------------------------------------------------------
+   								New types
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Task function prototype.
+
+  A task function receives the opaque argument passed to
+  eclipse_parallel_run(), the index of the task to process in
+  [0..ntasks-1], and the index of the worker running it in
+  [0..nworkers-1]. The worker index can be used to address per-thread
+  scratch buffers. Tasks must not print messages or touch global
+  state: report errors through the opaque argument.
+ */
+/*--------------------------------------------------------------------------*/
+typedef void (*eclipse_task)(void * arg, int task, int worker) ;
+
+/*---------------------------------------------------------------------------
+  							Function prototypes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Set the number of worker threads.
+  @param    n   Requested number of threads (0 for automatic).
+  @return   void
+
+  Sets the number of threads used by eclipse_parallel_run(). A value of
+  0 or less selects the number of online processors. This setting is
+  also read from the environment variable @c E_NTHREADS by
+  eclipse_init(). It has no effect if eclipse was built without
+  thread support.
+ */
+/*--------------------------------------------------------------------------*/
+void eclipse_set_nthreads(int n) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the number of worker threads.
+  @return   int number of workers eclipse_parallel_run() will use.
+
+  Returns 1 if eclipse was built without thread support.
+ */
+/*--------------------------------------------------------------------------*/
+int eclipse_get_nthreads(void) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Run a set of independent tasks on worker threads.
+  @param    fn      Task function.
+  @param    arg     Opaque argument passed to every task.
+  @param    ntasks  Number of tasks to run.
+  @return   int number of workers used, -1 on error.
+
+  Calls fn(arg, i, w) once for every i in [0..ntasks-1], where w is
+  the index of the worker thread running task i. Tasks are handed out
+  dynamically, so their execution order is not defined. The function
+  returns when all tasks are done.
+
+  The calling thread takes part in the computation as worker 0. Calls
+  to eclipse_parallel_run() made from within a task are executed
+  sequentially in the calling worker, so that nested loops do not
+  oversubscribe the machine.
+
+  The memory allocators from xmemory are safe to call from tasks.
+ */
+/*--------------------------------------------------------------------------*/
+int eclipse_parallel_run(eclipse_task fn, void * arg, int ntasks) ;
+
+#endif
@@ -38,6 +38,31 @@
 #define BG_METHOD_MEDIAN		2
 #define BG_METHOD_AVER_REJ		3
 
+/*---------------------------------------------------------------------------
+   								New types
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Aperture photometry of a list of sources.
+
+  Result of image_get_apertures(). Values for source s and radius r are
+  stored at index s*nrad+r.
+ */
+/*-------------------------------------------------------------------------*/
+typedef struct _APERTURE_PHOT_ {
+    /** Number of sources */
+    int             nsrc ;
+    /** Number of aperture radii */
+    int             nrad ;
+    /** Background-subtracted flux in each aperture */
+    double      *   flux ;
+    /** Area of each aperture measured in the image, in pixels */
+    double      *   area ;
+    /** Background per pixel for each source */
+    double      *   background ;
+} aperture_phot ;
+
 /*---------------------------------------------------------------------------
   							Function prototypes
  ---------------------------------------------------------------------------*/
@@ -132,4 +157,61 @@ double image_estimate_background(
         double      stop_thr,
         int         max_it) ;
 
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Compute aperture photometry of many sources at once.
+  @param    in          Input image.
+  @param    x           x positions of the sources.
+  @param    y           y positions of the sources.
+  @param    nsrc        Number of sources.
+  @param    radii       Aperture radii.
+  @param    nrad        Number of radii.
+  @param    rad_int     Internal radius of the background annulus.
+  @param    rad_ext     External radius of the background annulus.
+  @param    method      Background computing method.
+  @return   1 newly allocated aperture_phot, NULL in case of error.
+
+  Positions are given in the C convention, as for image_get_disk_flux().
+  For each source, the flux in the disks of all given radii is computed
+  in a single pass over the pixels around the source. Pixels are
+  weighted by their exact area of overlap with each disk, so that the
+  flux varies smoothly with the position and the radius. The weights
+  depend only on the offset of the source from the nearest pixel
+  center: they are kept and reused for sources with identical offsets,
+  e.g. sources at integer positions. Sources are distributed among
+  the worker threads.
+
+  If rad_ext is larger than rad_int, the background per pixel is
+  measured in the annulus between these radii and subtracted from the
+  fluxes. With BG_METHOD_AVERAGE, it is the mean of the pixels weighted
+  by their exact overlap with the annulus. Other methods are passed to
+  image_get_disk_background(). Parts of the apertures falling out of
+  the image are ignored, the area field gives the area actually
+  measured for each aperture.
+
+  The returned object must be deallocated using aperture_phot_del().
+ */
+/*--------------------------------------------------------------------------*/
+aperture_phot * image_get_apertures(
+        image_t     *   in,
+        double      *   x,
+        double      *   y,
+        int             nsrc,
+        double      *   radii,
+        int             nrad,
+        double          rad_int,
+        double          rad_ext,
+        int             method) ;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Delete an aperture_phot object.
+  @param    ap      Object to delete.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void aperture_phot_del(aperture_phot * ap) ;
+
 #endif
@@ -121,6 +121,13 @@ double poly2d_compute(
   z[i] = p(x[i], y[i])
   \end{verbatim}
 
+  The coefficients are first gathered into a dense table indexed by
+  the powers of x and y, and every point is then computed with a
+  Horner scheme in x nested in a Horner scheme in y. This costs
+  (dx+1).(dy+1) multiply-adds per point, where dx and dy are the
+  highest powers of x and y, and no call to ipow(). Polynomials with
+  negative powers are computed term by term.
+
   If anything goes wrong during the computation, this function returns
   -1.
  */
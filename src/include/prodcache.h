@@ -0,0 +1,197 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    prodcache.h
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Persistent cache of reduction products.
+
+   This module avoids recomputing products which were already obtained
+   from the same inputs with the same parameters. A recipe describes a
+   computation by its name and version, the contents of its input files
+   and its parameters. If the products of a computation matching this
+   description are found in the cache directory, they are copied to
+   their output files. Otherwise the recipe computes them and stores
+   them in the cache.
+
+   The cache directory is given by the environment variable @c E_CACHE
+   (see e_config.h). When it is not set, all functions below are no-ops
+   and lookups always fail, so that recipes can call them without
+   testing whether the cache is enabled.
+
+   A cache entry is made of a plain text manifest, named after the MD5
+   hash of the computation description with the @c .man extension,
+   and of one file per product. Entries are never removed by eclipse:
+   the cache may be cleaned at any time by deleting files, e.g. the
+   least recently used manifests (a manifest is touched whenever its
+   entry is used). Products without a manifest are ignored.
+
+   \begin{verbatim}
+   prodcache * pc ;
+
+   pc = prodcache_new("isaac_dark", "1.24") ;
+   for (i=0 ; i<list->n ; i++) prodcache_add_file(pc, list->name[i]) ;
+   prodcache_add_param(pc, "output", "%s", outname) ;
+   if (prodcache_fetch(pc)!=0) {
+       ... compute and save outname ...
+       prodcache_add_product(pc, outname) ;
+       prodcache_save(pc) ;
+   }
+   prodcache_del(pc) ;
+   \end{verbatim}
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+#ifndef _PRODCACHE_H_
+#define _PRODCACHE_H_
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*---------------------------------------------------------------------------
+   								New types
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Opaque description of a computation.
+ */
+/*--------------------------------------------------------------------------*/
+typedef struct _prodcache_ prodcache ;
+
+/*---------------------------------------------------------------------------
+  							Function prototypes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Set the cache directory.
+  @param    dirname Name of the cache directory, or NULL to disable.
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function is called by eclipse_init() with the value of
+  @c E_CACHE. The directory is created if it does not exist. If it
+  cannot be written to, the cache is disabled.
+ */
+/*--------------------------------------------------------------------------*/
+int prodcache_set_dir(char * dirname) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the cache directory.
+  @return   Name of the cache directory, or NULL if the cache is disabled.
+
+  The returned string must not be modified or freed.
+ */
+/*--------------------------------------------------------------------------*/
+char * prodcache_get_dir(void) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Start the description of a computation.
+  @param    recipe  Recipe name.
+  @param    version Recipe version.
+  @return   1 newly allocated prodcache, or NULL if the cache is disabled.
+
+  The version should be changed whenever the algorithm changes, so
+  that products computed by older versions are not used anymore. The
+  eclipse version is part of the description as well. The returned
+  object must be deallocated using prodcache_del().
+ */
+/*--------------------------------------------------------------------------*/
+prodcache * prodcache_new(char * recipe, char * version) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate a computation description.
+  @param    pc      Description to deallocate, may be NULL.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void prodcache_del(prodcache * pc) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Declare an input file.
+  @param    pc          Computation description, may be NULL.
+  @param    filename    Name of the input file.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The complete file contents (headers included) are hashed, together
+  with the file base name, which products usually refer to in their
+  headers. Input files must be declared in the order in which the
+  recipe uses them. If the file cannot be read, the description is
+  invalidated: products will be neither fetched nor saved.
+ */
+/*--------------------------------------------------------------------------*/
+int prodcache_add_file(prodcache * pc, char * filename) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Declare a parameter.
+  @param    pc      Computation description, may be NULL.
+  @param    name    Parameter name.
+  @param    fmt     printf-like format of the parameter value.
+  @param    ...     Parameter value.
+  @return   int 0 if Ok, -1 otherwise.
+
+  All parameters having an influence on the products must be declared,
+  including their default values.
+ */
+/*--------------------------------------------------------------------------*/
+int prodcache_add_param(prodcache * pc, char * name, char * fmt, ...) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Retrieve the products of a computation from the cache.
+  @param    pc      Computation description, may be NULL.
+  @return   int 0 if the products were retrieved, -1 otherwise.
+
+  If an entry matching the description is found, all its products are
+  copied to the file names they were saved from. Since output names
+  usually depend on recipe parameters, they should be declared with
+  prodcache_add_param().
+ */
+/*--------------------------------------------------------------------------*/
+int prodcache_fetch(prodcache * pc) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Declare a product of a computation.
+  @param    pc          Computation description, may be NULL.
+  @param    filename    Name of the product file.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Products are only recorded here, they are copied to the cache by
+  prodcache_save(). If the file does not exist, the computation is
+  considered as failed and will not be saved.
+ */
+/*--------------------------------------------------------------------------*/
+int prodcache_add_product(prodcache * pc, char * filename) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Store the products of a computation in the cache.
+  @param    pc      Computation description, may be NULL.
+  @return   int 0 if Ok, -1 otherwise.
+
+  All declared products are copied to the cache, then the manifest is
+  written. Files are written under temporary names and renamed when
+  complete, so that concurrent processes sharing the cache never see
+  incomplete entries.
+ */
+/*--------------------------------------------------------------------------*/
+int prodcache_save(prodcache * pc) ;
+
+#endif
@@ -274,6 +274,9 @@ int cube_shift_slice(
   i.e. all pixels in the final image have been seen by all input
   frames.
 
+  Frames are interpolated in the pixelcalc type, the average of the
+  remaining contributions is always computed in double precision.
+
   The returned frame is a newly allocated object, to be deallocated
   using image_del().
  */
@@ -0,0 +1,150 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    sky_index.h
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Spatial index for positions on the sky.
+
+   A sky index is a kd-tree built on the unit vectors of a list of sky
+   positions. It finds the nearest position or all positions within a
+   radius of a given point in logarithmic time. Distances are true
+   great-circle distances: there is no discontinuity at RA=0 and no
+   distortion close to the poles.
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+#ifndef _SKY_INDEX_H_
+#define _SKY_INDEX_H_
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*---------------------------------------------------------------------------
+   								New types
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Opaque sky index.
+ */
+/*--------------------------------------------------------------------------*/
+typedef struct _sky_index_ sky_index ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Position filter.
+
+  A filter receives the index of a position in the list given to
+  sky_index_new() and the opaque argument given to the search
+  function. It returns 1 if the position may be returned by the
+  search, 0 otherwise.
+ */
+/*--------------------------------------------------------------------------*/
+typedef int (*sky_accept)(int i, void * arg) ;
+
+/*---------------------------------------------------------------------------
+  							Function prototypes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Great-circle distance between two sky positions.
+  @param    ra1     Right ascension of the first position in degrees.
+  @param    dec1    Declination of the first position in degrees.
+  @param    ra2     Right ascension of the second position in degrees.
+  @param    dec2    Declination of the second position in degrees.
+  @return   double distance in degrees.
+
+  The haversine formula is used, which is accurate for small distances.
+ */
+/*--------------------------------------------------------------------------*/
+double sky_distance(double ra1, double dec1, double ra2, double dec2) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Build a sky index.
+  @param    ra      Right ascensions in degrees.
+  @param    dec     Declinations in degrees.
+  @param    n       Number of positions.
+  @return   1 newly allocated sky_index, NULL in case of error.
+
+  Positions are identified in searches by their index in the input
+  arrays, which are not referenced by the index once it is built.
+  The returned index must be deallocated using sky_index_del().
+ */
+/*--------------------------------------------------------------------------*/
+sky_index * sky_index_new(const double * ra, const double * dec, int n) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate a sky index.
+  @param    idx     Index to deallocate.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void sky_index_del(sky_index * idx) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find the nearest position to a point.
+  @param    idx     Sky index.
+  @param    ra      Right ascension of the point in degrees.
+  @param    dec     Declination of the point in degrees.
+  @param    radius  Maximal distance in degrees.
+  @param    accept  Position filter, or NULL to accept all positions.
+  @param    arg     Opaque argument passed to the filter.
+  @param    dist    Returned distance in degrees, or NULL.
+  @return   int index of the nearest position, -1 if none was found.
+
+  Only positions accepted by the filter and not further than radius
+  from the point are considered. Among positions at the same distance,
+  the one with the lowest index is returned.
+ */
+/*--------------------------------------------------------------------------*/
+int sky_index_nearest(
+		sky_index	*	idx,
+		double			ra,
+		double			dec,
+		double			radius,
+		sky_accept		accept,
+		void		*	arg,
+		double		*	dist) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find all positions within a radius of a point.
+  @param    idx     Sky index.
+  @param    ra      Right ascension of the point in degrees.
+  @param    dec     Declination of the point in degrees.
+  @param    radius  Search radius in degrees.
+  @param    accept  Position filter, or NULL to accept all positions.
+  @param    arg     Opaque argument passed to the filter.
+  @param    nfound  Returned number of positions found.
+  @return   Newly allocated array of indices, NULL if none was found.
+
+  The returned indices are sorted in increasing order. The array must
+  be deallocated using free().
+ */
+/*--------------------------------------------------------------------------*/
+int * sky_index_search(
+		sky_index	*	idx,
+		double			ra,
+		double			dec,
+		double			radius,
+		sky_accept		accept,
+		void		*	arg,
+		int			*	nfound) ;
+
+#endif
@@ -90,6 +90,32 @@ typedef struct _SPECTRAL_TABLE_ {
 } spectral_table ;
 
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	a line model built from a spectral table
+
+  This struct holds the part of a synthetic spectrum which does not
+  depend on the dispersion relation: the lines with positive intensity,
+  their wavelength multiplied by the order and their normalized
+  intensity, and the Gaussian line profile. It is built once by
+  spectral_model_new() and can then be used to generate signals for
+  many candidate dispersion relations, possibly from several threads.
+ */
+/*-------------------------------------------------------------------------*/
+typedef struct _SPECTRAL_MODEL_ {
+    int                 nlines ;
+    /* Wavelength times order, increasing */
+    double          *   wavel ;
+    /* Intensity times the Gaussian normalization factor */
+    double          *   intens ;
+    /* Gaussian exponent factor, and exp(2*f2) */
+    double              f2 ;
+    double              ratio ;
+    /* Half-width of the profile in pixels */
+    int                 gwidth ;
+} spectral_model ;
+
+
 /*---------------------------------------------------------------------------
 						Function ANSI prototypes
  ---------------------------------------------------------------------------*/
@@ -249,6 +275,53 @@ double * spectral_table_build_signal(
         const int                 size,
         int                   *   found) ;
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Build a line model from a spectral table
+  @param    spt         Spectral table to use.
+  @param    order       Order used in the spectral table look-up
+  @param    slit_width  Width in pixels of the slit used
+  @return   1 newly allocated spectral_model, or NULL on error.
+
+  The returned object must be deallocated with spectral_model_del().
+ */
+/*--------------------------------------------------------------------------*/
+spectral_model * spectral_model_new(
+        const spectral_table  *   spt,
+        const int                 order,
+        const double              slit_width) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate a line model
+  @param    model   Line model to deallocate.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void spectral_model_del(spectral_model * model) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Build a 1d signal from a line model
+  @param    model       Line model.
+  @param    disprel     4 coeffs of the wavelength calibration polynomial
+  @param    size        Size of the signal to generate.
+  @param    smooth      Output signal of 'size' doubles.
+  @return   the number of non-zero samples in the signal.
+
+  Same as spectral_table_build_signal(), writing to a buffer provided
+  by the caller. The first line in range is found by bisection, and
+  the Gaussian profile of each line is evaluated incrementally, with
+  two calls to exp() per line. This function prints no message and can
+  be called from several threads at the same time.
+ */
+/*--------------------------------------------------------------------------*/
+int spectral_model_signal(
+        const spectral_model  *   model,
+        const double          *   disprel,
+        const int                 size,
+        double                *   smooth) ;
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Output a list of table lines as a signal to a file.
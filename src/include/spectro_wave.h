@@ -144,4 +144,25 @@ computed_disprel * spectro_compute_disprel(
         double  *   phdisprel) ;
 /* </python> */
 
+/*----------------------------------------------------------------------------*/
+/**
+  @brief  Set the coarse-to-fine pruning mode of the wavelength search
+  @param  flag  1 to prune, 0 for an exhaustive search (default)
+  @return void
+
+  The search for a dispersion relation evaluates a grid of candidate
+  polynomials, then refines the offset of every candidate whose
+  cross-correlation is close enough to the best refined solution found
+  before it in the grid. The result does not depend on the number of
+  threads.
+
+  In pruning mode, candidates are refined by decreasing cross-correlation
+  instead, so that a good solution is found early and most candidates
+  need not be refined. This gives the same solution whenever the best
+  candidates before and after refinement are the same ones, which is the
+  case for well-exposed arcs, but is not guaranteed.
+ */
+/*----------------------------------------------------------------------------*/
+void spectro_set_wavecal_pruning(int flag) ;
+
 #endif
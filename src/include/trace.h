@@ -0,0 +1,174 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    trace.h
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Performance tracing of processing stages.
+
+   This module measures where time goes in a program. Stages are
+   delimited by TRACE_BEGIN() and TRACE_END() and may be nested; they
+   are identified by name, and all runs of a stage with the same name
+   are accumulated. Counters (bytes read and written, pixels processed)
+   are attributed to the innermost stage running when they are
+   incremented. The number of memory allocations and the peak resident
+   size are also recorded for every stage.
+
+   Tracing is enabled by setting the environment variable @c E_TRACE
+   before running a program calling eclipse_init():
+
+   - @c E_TRACE=summary prints a table of all stages on stderr at exit.
+   - any other value is the name of a file receiving a trace in the
+     Chrome trace event format (JSON), which can be loaded into
+     chrome://tracing or Perfetto.
+
+   When tracing is disabled, the macros below only test a global flag.
+
+   \begin{verbatim}
+   TRACE_BEGIN("sky") ;
+   for (i=0 ; i<n ; i++) {
+       ...
+       TRACE_COUNT(TRACE_PIXELS, lx*ly) ;
+   }
+   TRACE_END("sky") ;
+   \end{verbatim}
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*---------------------------------------------------------------------------
+   								Defines
+ ---------------------------------------------------------------------------*/
+
+/** Maximal number of distinct stage names */
+#define TRACE_MAXSTAGES		256
+/** Maximal stage nesting depth */
+#define TRACE_MAXDEPTH		64
+
+/** Start a stage, if tracing is enabled */
+#define TRACE_BEGIN(name) \
+	do { if (eclipse_trace_active) eclipse_trace_begin(name) ; } while (0)
+
+/** End the current stage, if tracing is enabled */
+#define TRACE_END(name) \
+	do { if (eclipse_trace_active) eclipse_trace_end(name) ; } while (0)
+
+/** Increment a counter, if tracing is enabled */
+#define TRACE_COUNT(counter, n) \
+	do { if (eclipse_trace_active) \
+			eclipse_trace_count(counter, (double)(n)) ; } while (0)
+
+/*---------------------------------------------------------------------------
+   								New types
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Trace counters.
+ */
+/*--------------------------------------------------------------------------*/
+typedef enum _trace_counter_ {
+	/** Bytes read from FITS files */
+	TRACE_BYTES_READ = 0,
+	/** Bytes written to FITS files */
+	TRACE_BYTES_WRITTEN,
+	/** Pixels processed by a kernel */
+	TRACE_PIXELS,
+	/** Number of counters, not a counter */
+	TRACE_NCOUNTERS
+} trace_counter ;
+
+/*---------------------------------------------------------------------------
+   							Global variables
+ ---------------------------------------------------------------------------*/
+
+/** Non-zero if tracing is enabled. Read-only. */
+extern int eclipse_trace_active ;
+
+/*---------------------------------------------------------------------------
+  							Function prototypes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Enable tracing.
+  @param    spec    "summary", or name of the output trace file.
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function is called by eclipse_init() with the value of
+  @c E_TRACE. Results are output at exit, or when eclipse_trace_close()
+  is called. Only the first call has an effect.
+ */
+/*--------------------------------------------------------------------------*/
+int eclipse_trace_init(char * spec) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Start a stage.
+  @param    name    Stage name.
+  @return   void
+
+  Stages are only recorded from the thread which enabled tracing: calls
+  from worker threads are ignored. The name must be a string constant
+  without quotes or backslashes. Use the TRACE_BEGIN() macro rather than
+  calling this function directly.
+ */
+/*--------------------------------------------------------------------------*/
+void eclipse_trace_begin(const char * name) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    End the current stage.
+  @param    name    Stage name, for consistency checks.
+  @return   void
+
+  The innermost running stage is ended. A warning is issued once if its
+  name does not match the given one. Use the TRACE_END() macro rather
+  than calling this function directly.
+ */
+/*--------------------------------------------------------------------------*/
+void eclipse_trace_end(const char * name) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Increment a counter.
+  @param    counter Counter to increment.
+  @param    n       Increment.
+  @return   void
+
+  The increment is attributed to the innermost running stage. This
+  function may be called from worker threads. Use the TRACE_COUNT()
+  macro rather than calling this function directly.
+ */
+/*--------------------------------------------------------------------------*/
+void eclipse_trace_count(trace_counter counter, double n) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Output results and disable tracing.
+  @return   void
+
+  All running stages are ended, then the summary table is printed or
+  the trace file is closed. This function is registered with atexit()
+  by eclipse_trace_init(): there is normally no need to call it.
+ */
+/*--------------------------------------------------------------------------*/
+void eclipse_trace_close(void) ;
+
+#endif
@@ -0,0 +1,198 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    warp_map.h
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Precomputed polynomial distortion maps.
+
+   A distortion map holds, for every pixel of a warped image, the source
+   pixel and the interpolation kernel entries computed from a pair of
+   2d polynomials (see image_warp_generic()). Polynomials are evaluated
+   once when the map is built; applying the map to an image only reads
+   16 neighbours per pixel. This is the way to correct many frames
+   taken with the same geometry:
+
+   \begin{verbatim}
+   map = warp_map_new(lx, ly, "default", poly_u, poly_v) ;
+   for (i=0 ; i<n ; i++) {
+       out[i] = warp_map_apply(map, in[i]) ;
+   }
+   warp_map_del(map) ;
+   \end{verbatim}
+
+   Maps can be saved to disk and loaded back by warp_map_cached(), which
+   only reuses a file if it was built from the same polynomials, image
+   size and kernel.
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+#ifndef _WARP_MAP_H_
+#define _WARP_MAP_H_
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "local_types.h"
+#include "poly2d.h"
+
+/*---------------------------------------------------------------------------
+   								New types
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Precomputed distortion map.
+
+  For the output pixel i+j*lx, pos[i+j*lx] is the offset in the source
+  image of the closest integer neighbour of the source position, or -1
+  if the source position is too close to the border to be
+  interpolated. tab[2*(i+j*lx)] and tab[2*(i+j*lx)+1] are the kernel
+  table indices for the fractional part of the source position in x and
+  y. All fields are read-only.
+ */
+/*--------------------------------------------------------------------------*/
+typedef struct _warp_map_ {
+	/* Size of the images the map applies to */
+	int					lx, ly ;
+	/* Source offset of every output pixel, -1 if blank */
+	int				*	pos ;
+	/* Kernel table indices in x and y of every output pixel */
+	unsigned short	*	tab ;
+	/* Interpolation kernel and sum of its 4 taps per table index */
+	double			*	kernel ;
+	double			*	ksum ;
+	/* Key of the map: kernel name and polynomials */
+	char			*	kernel_type ;
+	poly2d			*	poly_u ;
+	poly2d			*	poly_v ;
+} warp_map ;
+
+/*---------------------------------------------------------------------------
+  							Function prototypes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Build a distortion map from a polynomial transform.
+  @param    lx          Image size in x.
+  @param    ly          Image size in y.
+  @param    kernel_type Interpolation kernel to use, NULL for default.
+  @param    poly_u      Polynomial transform in U.
+  @param    poly_v      Polynomial transform in V.
+  @return   1 newly allocated warp_map, NULL in case of error.
+
+  The polynomials define a reverse transform, as in image_warp_generic().
+  They are evaluated on the whole pixel grid with poly2d_compute(),
+  one row per task on the worker threads, so that warped images are
+  identical to those of the former image_warp_generic(). The
+  polynomials are copied into the map.
+
+  The returned map must be deallocated using warp_map_del().
+ */
+/*--------------------------------------------------------------------------*/
+warp_map * warp_map_new(
+		int				lx,
+		int				ly,
+		char		*	kernel_type,
+		poly2d		*	poly_u,
+		poly2d		*	poly_v) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate a distortion map.
+  @param    map     Map to deallocate.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void warp_map_del(warp_map * map) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Warp an image with a precomputed distortion map.
+  @param    map     Distortion map.
+  @param    in      Image to warp, of the size of the map.
+  @return   1 newly allocated image, NULL in case of error.
+
+  The result is the same as image_warp_generic() with the polynomials
+  and kernel of the map. Rows of the output image are interpolated in
+  parallel. Interpolation is done in the pixelcalc type.
+ */
+/*--------------------------------------------------------------------------*/
+image_t * warp_map_apply(warp_map * map, image_t * in) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Save a distortion map to a file.
+  @param    map         Map to save.
+  @param    filename    Output file name.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The file holds the key of the map (size, kernel name, polynomials)
+  followed by the map itself, in the native byte order. It is meant as
+  a local cache, not as an exchange format.
+ */
+/*--------------------------------------------------------------------------*/
+int warp_map_save(warp_map * map, char * filename) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Load a distortion map from a file.
+  @param    filename    Input file name.
+  @param    lx          Expected image size in x.
+  @param    ly          Expected image size in y.
+  @param    kernel_type Expected interpolation kernel, NULL for default.
+  @param    poly_u      Expected polynomial transform in U.
+  @param    poly_v      Expected polynomial transform in V.
+  @return   1 newly allocated warp_map, NULL if the file cannot be used.
+
+  NULL is returned without any message if the file does not exist, was
+  written on a machine with another byte order, or does not hold a map
+  built from exactly the same size, kernel and polynomials.
+ */
+/*--------------------------------------------------------------------------*/
+warp_map * warp_map_load(
+		char		*	filename,
+		int				lx,
+		int				ly,
+		char		*	kernel_type,
+		poly2d		*	poly_u,
+		poly2d		*	poly_v) ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get a distortion map from a cache file, or build it.
+  @param    filename    Cache file name.
+  @param    lx          Image size in x.
+  @param    ly          Image size in y.
+  @param    kernel_type Interpolation kernel to use, NULL for default.
+  @param    poly_u      Polynomial transform in U.
+  @param    poly_v      Polynomial transform in V.
+  @return   1 newly allocated warp_map, NULL in case of error.
+
+  The map is loaded from the file if it matches the requested geometry
+  (see warp_map_load()). Otherwise it is built with warp_map_new() and
+  saved to the file for the next call. Failing to save the map only
+  issues a warning.
+ */
+/*--------------------------------------------------------------------------*/
+warp_map * warp_map_cached(
+		char		*	filename,
+		int				lx,
+		int				ly,
+		char		*	kernel_type,
+		poly2d		*	poly_u,
+		poly2d		*	poly_v) ;
+
+#endif
@@ -311,4 +311,38 @@ double3 * load_offsets_from_txtfile(char * filename) ;
 /*--------------------------------------------------------------------------*/
 double3 * cube_blindoffsets(cube_t * cube_i, image_t * pattern);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find offsets in an image sequence by pyramid registration.
+  @param    cube_i      Input cube
+  @param    pattern     Pattern to compare all planes in the cube.
+  @param    search      Maximal offset in pixels, 0 for half the frame size.
+  @return   1 newly allocated double3 object containing offset estimates.
+
+  The pattern and every plane are reduced by factors 2, 4 and 8 with
+  image_subsample(), as long as the reduced images are at least 32
+  pixels large. The offsets are first found on the coarsest level over
+  the whole search range, with a cross-correlation computed by FFT on
+  zero-padded images. They are then refined on every finer level by
+  climbing, one pixel at a time from the position found on the previous
+  level, to the maximum of the correlation coefficient of the
+  overlapping parts of the images, and finally interpolated to
+  sub-pixel accuracy.
+
+  Contrary to cube_blindoffsets(), the whole frames are used, the frame
+  size does not need to be a power of 2 and the search range is not
+  limited to the central part of the frames. All planes are processed
+  in parallel.
+
+  The returned offsets follow the convention of cube_blindoffsets().
+  The z field holds the correlation coefficient of every plane with
+  the pattern at full resolution. The returned object must be
+  deallocated using double3_del().
+ */
+/*--------------------------------------------------------------------------*/
+double3 * cube_pyramidoffsets(
+        cube_t  *   cube_i,
+        image_t *   pattern,
+        int         search) ;
+
 #endif
@@ -0,0 +1,931 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    arith_expr.c
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Fused evaluation of pixel arithmetic expressions.
+
+   An arithmetic expression is recorded as a list of operands (cubes,
+   images or constants) and a program in reverse Polish notation. The
+   whole expression is then evaluated in a single pass over the pixels,
+   block by block, without allocating any intermediate image.
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "arith_expr.h"
+#include "image_handling.h"
+
+/*---------------------------------------------------------------------------
+   								Defines
+ ---------------------------------------------------------------------------*/
+
+/* Number of pixels processed by one instruction at a time */
+#define ARITH_BLOCK			1024
+/* Number of pixels handed to a worker at a time */
+#define ARITH_CHUNK			(64 * ARITH_BLOCK)
+
+/* Kinds of slots an instruction reads from or writes to */
+#define SLOT_CONST			0
+#define SLOT_PIXELS			1
+#define SLOT_REG			2
+#define SLOT_OUT			3
+
+/* Below this, a divisor is considered as zero */
+#define ARITH_TINY			1e-30
+
+/*---------------------------------------------------------------------------
+   								Private types
+ ---------------------------------------------------------------------------*/
+
+/* Constant, operand pixels, scratch register or output pixels */
+typedef struct _arith_slot_ {
+	int				kind ;
+	int				index ;
+	double			value ;
+} arith_slot ;
+
+/* dst = a op b, or dst = op a for unary operators */
+typedef struct _arith_insn_ {
+	int				op ;
+	arith_slot		dst ;
+	arith_slot		a ;
+	arith_slot		b ;
+} arith_insn ;
+
+/* Everything the workers need to evaluate a compiled expression */
+typedef struct _arith_run_ {
+	arith_insn	*	insn ;
+	int				n_insn ;
+	int				n_reg ;
+	int				npix ;
+	int				np ;
+	int				nchunk ;
+	/* Operand pixels: src[k*np+p] is plane p of operand k */
+	pixelvalue	**	src ;
+	/* Output pixels: dst[p] is plane p */
+	pixelvalue	**	dst ;
+	/* n_reg blocks of scratch per worker */
+	pixelvalue	*	scratch ;
+} arith_run ;
+
+/*---------------------------------------------------------------------------
+  							Private macros
+ ---------------------------------------------------------------------------*/
+
+/* Apply an element-wise binary expression of a and b to a block */
+#define ARITH_LOOP(expr) \
+	if (pa!=NULL && pb!=NULL) { \
+		for (i=0 ; i<n ; i++) { a = pa[i] ; b = pb[i] ; d[i] = (expr) ; } \
+	} else if (pa!=NULL) { \
+		b = sb ; \
+		for (i=0 ; i<n ; i++) { a = pa[i] ; d[i] = (expr) ; } \
+	} else { \
+		a = sa ; \
+		for (i=0 ; i<n ; i++) { b = pb[i] ; d[i] = (expr) ; } \
+	}
+
+/*---------------------------------------------------------------------------
+  							Function prototypes
+ ---------------------------------------------------------------------------*/
+
+static int arith_expr_grow(arith_expr * e) ;
+static double arith_scalar(int op, double a, double b) ;
+static int arith_expr_compile(arith_expr * e, arith_insn * insn, int * n_reg) ;
+static int arith_expr_geometry(arith_expr * e, int * lx, int * ly, int * np) ;
+static int arith_expr_run(
+		arith_expr	*	e,
+		int				npix,
+		int				np,
+		pixelvalue	**	dst) ;
+static void arith_block(
+		int				op,
+		pixelvalue	*	d,
+		pixelvalue	*	pa,
+		double			sa,
+		pixelvalue	*	pb,
+		double			sb,
+		int				n) ;
+static pixelvalue * arith_slot_pixels(
+		arith_run	*	run,
+		arith_slot	*	slot,
+		int				p,
+		int				off,
+		pixelvalue	*	regs) ;
+static void arith_expr_task(void * arg, int task, int worker) ;
+static void arith_skip_blanks(char ** s) ;
+static int arith_parse_sum(arith_expr * e, char ** s) ;
+static int arith_parse_product(arith_expr * e, char ** s) ;
+static int arith_parse_unary(arith_expr * e, char ** s) ;
+static int arith_parse_power(arith_expr * e, char ** s) ;
+static int arith_parse_primary(arith_expr * e, char ** s) ;
+
+/*---------------------------------------------------------------------------
+  							Function codes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create a new empty expression.
+  @return   1 newly allocated arith_expr.
+
+  The returned object must be deallocated with arith_expr_del().
+ */
+/*--------------------------------------------------------------------------*/
+arith_expr * arith_expr_new(void)
+{
+	arith_expr	*	e ;
+
+	e = calloc(1, sizeof(arith_expr)) ;
+	return e ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate an expression.
+  @param    e   Expression to deallocate.
+  @return   void
+
+  Operands are not deallocated.
+ */
+/*--------------------------------------------------------------------------*/
+void arith_expr_del(arith_expr * e)
+{
+	if (e==NULL) return ;
+	if (e->opd!=NULL) free(e->opd) ;
+	if (e->tok!=NULL) free(e->tok) ;
+	free(e) ;
+	return ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Declare a cube operand.
+  @param    e   Expression.
+  @param    c   Cube.
+  @return   int operand number (starting from 1), -1 in case of error.
+
+  A cube with a single plane is applied to all planes of the result.
+ */
+/*--------------------------------------------------------------------------*/
+int arith_expr_add_cube(arith_expr * e, cube_t * c)
+{
+	if (e==NULL || c==NULL) return -1 ;
+	if (arith_expr_grow(e)!=0) return -1 ;
+	e->opd[e->n_opd].cube  = c ;
+	e->opd[e->n_opd].image = NULL ;
+	e->opd[e->n_opd].value = 0.0 ;
+	e->n_opd ++ ;
+	return e->n_opd ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Declare an image operand.
+  @param    e   Expression.
+  @param    im  Image.
+  @return   int operand number (starting from 1), -1 in case of error.
+
+  The image is applied to all planes of the result.
+ */
+/*--------------------------------------------------------------------------*/
+int arith_expr_add_image(arith_expr * e, image_t * im)
+{
+	if (e==NULL || im==NULL) return -1 ;
+	if (arith_expr_grow(e)!=0) return -1 ;
+	e->opd[e->n_opd].cube  = NULL ;
+	e->opd[e->n_opd].image = im ;
+	e->opd[e->n_opd].value = 0.0 ;
+	e->n_opd ++ ;
+	return e->n_opd ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Declare a constant operand.
+  @param    e   Expression.
+  @param    d   Value.
+  @return   int operand number (starting from 1), -1 in case of error.
+ */
+/*--------------------------------------------------------------------------*/
+int arith_expr_add_const(arith_expr * e, double d)
+{
+	if (e==NULL) return -1 ;
+	if (arith_expr_grow(e)!=0) return -1 ;
+	e->opd[e->n_opd].cube  = NULL ;
+	e->opd[e->n_opd].image = NULL ;
+	e->opd[e->n_opd].value = d ;
+	e->n_opd ++ ;
+	return e->n_opd ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Push an operand on the program stack.
+  @param    e       Expression.
+  @param    index   Operand number (starting from 1).
+  @return   int 0 if Ok, -1 otherwise.
+ */
+/*--------------------------------------------------------------------------*/
+int arith_expr_push_operand(arith_expr * e, int index)
+{
+	if (e==NULL) return -1 ;
+	if (index<1 || index>e->n_opd) {
+		e_error("no such operand in expression: $%d", index) ;
+		return -1 ;
+	}
+	if (e->depth>=ARITH_EXPR_MAXDEPTH) {
+		e_error("expression too complex") ;
+		return -1 ;
+	}
+	if (arith_expr_grow(e)!=0) return -1 ;
+	e->tok[e->n_tok].op    = 0 ;
+	e->tok[e->n_tok].index = index ;
+	e->tok[e->n_tok].value = 0.0 ;
+	e->n_tok ++ ;
+	e->depth ++ ;
+	return 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Push a constant on the program stack.
+  @param    e   Expression.
+  @param    d   Value.
+  @return   int 0 if Ok, -1 otherwise.
+ */
+/*--------------------------------------------------------------------------*/
+int arith_expr_push_const(arith_expr * e, double d)
+{
+	if (e==NULL) return -1 ;
+	if (e->depth>=ARITH_EXPR_MAXDEPTH) {
+		e_error("expression too complex") ;
+		return -1 ;
+	}
+	if (arith_expr_grow(e)!=0) return -1 ;
+	e->tok[e->n_tok].op    = 0 ;
+	e->tok[e->n_tok].index = 0 ;
+	e->tok[e->n_tok].value = d ;
+	e->n_tok ++ ;
+	e->depth ++ ;
+	return 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Push an operator on the program stack.
+  @param    e   Expression.
+  @param    op  Operator.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Binary operators '+', '-', '*', '/' and '^' replace the two topmost
+  stack elements by the result of the operation, the unary operator 'n'
+  negates the topmost element. Divisions by zero yield zero, as in
+  image_div_local().
+ */
+/*--------------------------------------------------------------------------*/
+int arith_expr_push_op(arith_expr * e, int op)
+{
+	int		nargs ;
+
+	if (e==NULL) return -1 ;
+	switch (op) {
+		case '+':
+		case '-':
+		case '*':
+		case '/':
+		case '^':
+		nargs = 2 ;
+		break ;
+
+		case 'n':
+		nargs = 1 ;
+		break ;
+
+		default:
+		e_error("unsupported operator in expression: [%c]", op) ;
+		return -1 ;
+	}
+	if (e->depth<nargs) {
+		e_error("missing operand for operator [%c]", op) ;
+		return -1 ;
+	}
+	if (arith_expr_grow(e)!=0) return -1 ;
+	e->tok[e->n_tok].op    = op ;
+	e->tok[e->n_tok].index = 0 ;
+	e->tok[e->n_tok].value = 0.0 ;
+	e->n_tok ++ ;
+	e->depth -= nargs-1 ;
+	return 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Append an expression in standard notation to a program.
+  @param    e       Expression.
+  @param    s       Expression string.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The string may contain the operators + - * / ^ (power), unary minus,
+  brackets, numbers and operands referred to as $1, $2, ... in the
+  order in which they were declared. Usual priorities apply, ^ being
+  right-associative.
+ */
+/*--------------------------------------------------------------------------*/
+int arith_expr_parse(arith_expr * e, char * s)
+{
+	char	*	p ;
+	int			n_tok ;
+	int			depth ;
+
+	if (e==NULL || s==NULL) return -1 ;
+	n_tok = e->n_tok ;
+	depth = e->depth ;
+
+	p = s ;
+	if (arith_parse_sum(e, &p)==0) {
+		arith_skip_blanks(&p) ;
+		if (*p=='\0') return 0 ;
+		e_error("in expression [%s]: unexpected [%s]", s, p) ;
+	}
+	/* Leave the program as it was */
+	e->n_tok = n_tok ;
+	e->depth = depth ;
+	return -1 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Evaluate an expression into a cube.
+  @param    e       Expression.
+  @param    out     Output cube, or NULL to allocate a new one.
+  @return   The output cube, or NULL in case of error.
+
+  The program must leave exactly one element on the stack. All pixel
+  operands must have the same size and either one plane or the same
+  number of planes as the result. The output cube may be one of the
+  cube operands, in which case the computation is done in place. It
+  must not otherwise share pixels with any operand.
+
+  Pixels are processed in blocks small enough to stay in cache, on
+  the workers started by eclipse_parallel_run().
+
+  Constants are folded in double precision. Pixels divided by a
+  constant are rounded as with image_cst_op().
+ */
+/*--------------------------------------------------------------------------*/
+cube_t * arith_expr_eval_cube(arith_expr * e, cube_t * out)
+{
+	pixelvalue	**	dst ;
+	cube_t		*	res ;
+	int				lx, ly, np ;
+	int				p ;
+	int				status ;
+
+	if (e==NULL) return NULL ;
+	if (arith_expr_geometry(e, &lx, &ly, &np)!=0) return NULL ;
+	if (np==0) {
+		/* Constant expression: the output gives the size */
+		if (out==NULL) {
+			e_error("constant expression: output size unknown") ;
+			return NULL ;
+		}
+		lx = out->lx ;
+		ly = out->ly ;
+		np = out->np ;
+	}
+	if (out!=NULL) {
+		if (out->lx!=lx || out->ly!=ly || out->np!=np) {
+			e_error("output cube size does not match expression operands") ;
+			return NULL ;
+		}
+		res = out ;
+	} else {
+		res = cube_new(lx, ly, np) ;
+		if (res==NULL) return NULL ;
+		for (p=0 ; p<np ; p++) {
+			res->plane[p] = image_new(lx, ly) ;
+		}
+	}
+
+	dst = malloc(np * sizeof(pixelvalue*)) ;
+	for (p=0 ; p<np ; p++) {
+		dst[p] = res->plane[p]->data ;
+	}
+	status = arith_expr_run(e, lx*ly, np, dst) ;
+	free(dst) ;
+	if (status!=0) {
+		if (out==NULL) cube_del(res) ;
+		return NULL ;
+	}
+	return res ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Evaluate an expression into an image.
+  @param    e       Expression.
+  @param    out     Output image, or NULL to allocate a new one.
+  @return   The output image, or NULL in case of error.
+
+  Same as arith_expr_eval_cube() for expressions whose operands all have
+  a single plane.
+ */
+/*--------------------------------------------------------------------------*/
+image_t * arith_expr_eval_image(arith_expr * e, image_t * out)
+{
+	image_t		*	res ;
+	int				lx, ly, np ;
+
+	if (e==NULL) return NULL ;
+	if (arith_expr_geometry(e, &lx, &ly, &np)!=0) return NULL ;
+	if (np>1) {
+		e_error("expression operands have several planes") ;
+		return NULL ;
+	}
+	if (np==0) {
+		if (out==NULL) {
+			e_error("constant expression: output size unknown") ;
+			return NULL ;
+		}
+		lx = out->lx ;
+		ly = out->ly ;
+	}
+	if (out!=NULL) {
+		if (out->lx!=lx || out->ly!=ly) {
+			e_error("output image size does not match expression operands");
+			return NULL ;
+		}
+		res = out ;
+	} else {
+		res = image_new(lx, ly) ;
+		if (res==NULL) return NULL ;
+	}
+	if (arith_expr_run(e, lx*ly, 1, &(res->data))!=0) {
+		if (out==NULL) image_del(res) ;
+		return NULL ;
+	}
+	return res ;
+}
+
+/*---------------------------------------------------------------------------
+  							Private functions
+ ---------------------------------------------------------------------------*/
+
+/* Make room for one more operand and one more token */
+static int arith_expr_grow(arith_expr * e)
+{
+	int		sz ;
+
+	if ((e->n_opd & 7)==0) {
+		sz = (e->n_opd + 8) * sizeof(arith_operand) ;
+		e->opd = (e->opd==NULL) ? malloc(sz) : realloc(e->opd, sz) ;
+		if (e->opd==NULL) return -1 ;
+	}
+	if ((e->n_tok & 15)==0) {
+		sz = (e->n_tok + 16) * sizeof(arith_token) ;
+		e->tok = (e->tok==NULL) ? malloc(sz) : realloc(e->tok, sz) ;
+		if (e->tok==NULL) return -1 ;
+	}
+	return 0 ;
+}
+
+/* Apply a binary operator to two numbers */
+static double arith_scalar(int op, double a, double b)
+{
+	switch (op) {
+		case '+': return a+b ;
+		case '-': return a-b ;
+		case '*': return a*b ;
+		case '/': return (fabs(b)>ARITH_TINY) ? a/b : 0.0 ;
+		case '^': return pow(a, b) ;
+	}
+	return 0.0 ;
+}
+
+/*
+ * Translate the program into instructions working on blocks of pixels.
+ * The stack is simulated to find out which elements are constants
+ * (folded right away), operand pixels (read in place) or intermediate
+ * results, which are given scratch registers of one block each. The
+ * last instruction writes directly to the output. Returns the number
+ * of instructions, or -1 if the program is not complete.
+ */
+static int arith_expr_compile(arith_expr * e, arith_insn * insn, int * n_reg)
+{
+	arith_slot		stack[ARITH_EXPR_MAXDEPTH] ;
+	int				used[ARITH_EXPR_MAXDEPTH] ;
+	arith_slot		a, b ;
+	arith_token	*	tok ;
+	int				sp, n, r, i ;
+
+	if (e->n_tok<1 || e->depth!=1) {
+		e_error("incomplete expression") ;
+		return -1 ;
+	}
+	for (i=0 ; i<ARITH_EXPR_MAXDEPTH ; i++) used[i]=0 ;
+	*n_reg = 0 ;
+	sp = 0 ;
+	n = 0 ;
+	for (i=0 ; i<e->n_tok ; i++) {
+		tok = e->tok + i ;
+		if (tok->op==0) {
+			/* Operand or constant */
+			stack[sp].kind  = SLOT_CONST ;
+			stack[sp].index = 0 ;
+			stack[sp].value = tok->value ;
+			if (tok->index>0) {
+				if (e->opd[tok->index-1].cube==NULL &&
+					e->opd[tok->index-1].image==NULL) {
+					stack[sp].value = e->opd[tok->index-1].value ;
+				} else {
+					stack[sp].kind  = SLOT_PIXELS ;
+					stack[sp].index = tok->index-1 ;
+				}
+			}
+			sp++ ;
+			continue ;
+		}
+		if (tok->op=='n') {
+			a = stack[sp-1] ;
+			b.kind  = SLOT_CONST ;
+			b.index = 0 ;
+			b.value = 0.0 ;
+		} else {
+			b = stack[--sp] ;
+			a = stack[sp-1] ;
+		}
+		if (a.kind==SLOT_CONST && b.kind==SLOT_CONST) {
+			if (tok->op=='n') {
+				stack[sp-1].value = -a.value ;
+			} else {
+				stack[sp-1].value = arith_scalar(tok->op, a.value, b.value);
+			}
+			continue ;
+		}
+		/* Reuse the register of an operand, or take a free one */
+		if (a.kind==SLOT_REG) {
+			r = a.index ;
+			if (b.kind==SLOT_REG) used[b.index] = 0 ;
+		} else if (b.kind==SLOT_REG) {
+			r = b.index ;
+		} else {
+			for (r=0 ; used[r] ; r++) ;
+			used[r] = 1 ;
+			if (r>=*n_reg) *n_reg = r+1 ;
+		}
+		insn[n].op = tok->op ;
+		insn[n].dst.kind  = SLOT_REG ;
+		insn[n].dst.index = r ;
+		insn[n].dst.value = 0.0 ;
+		insn[n].a = a ;
+		insn[n].b = b ;
+		n++ ;
+		stack[sp-1] = insn[n-1].dst ;
+	}
+	/* The final result is written directly to the output */
+	if (stack[0].kind==SLOT_REG) {
+		insn[n-1].dst.kind = SLOT_OUT ;
+	} else {
+		insn[n].op = '=' ;
+		insn[n].dst.kind  = SLOT_OUT ;
+		insn[n].dst.index = 0 ;
+		insn[n].a = stack[0] ;
+		insn[n].b = stack[0] ;
+		n++ ;
+	}
+	return n ;
+}
+
+/*
+ * Find out the size of the result from the pixel operands, which must
+ * all have the same size and either 1 or np planes. np is set to 0 if
+ * there is no pixel operand at all.
+ */
+static int arith_expr_geometry(arith_expr * e, int * lx, int * ly, int * np)
+{
+	arith_operand	*	o ;
+	int					olx, oly, onp ;
+	int					i ;
+
+	*lx = *ly = *np = 0 ;
+	for (i=0 ; i<e->n_opd ; i++) {
+		o = e->opd + i ;
+		if (o->cube!=NULL) {
+			olx = o->cube->lx ;
+			oly = o->cube->ly ;
+			onp = o->cube->np ;
+		} else if (o->image!=NULL) {
+			olx = o->image->lx ;
+			oly = o->image->ly ;
+			onp = 1 ;
+		} else {
+			continue ;
+		}
+		if (*np==0) {
+			*lx = olx ;
+			*ly = oly ;
+			*np = onp ;
+		} else if (olx!=*lx || oly!=*ly) {
+			e_error("expression operands have different sizes") ;
+			return -1 ;
+		} else if (onp!=*np) {
+			if (*np==1) {
+				*np = onp ;
+			} else if (onp!=1) {
+				e_error("expression operands have different numbers of planes");
+				return -1 ;
+			}
+		}
+	}
+	return 0 ;
+}
+
+/* Compile and evaluate an expression into np planes of npix pixels */
+static int arith_expr_run(
+		arith_expr	*	e,
+		int				npix,
+		int				np,
+		pixelvalue	**	dst)
+{
+	arith_run			run ;
+	arith_operand	*	o ;
+	int					nw ;
+	int					k, p ;
+
+	run.insn = malloc((e->n_tok+1) * sizeof(arith_insn)) ;
+	run.n_insn = arith_expr_compile(e, run.insn, &run.n_reg) ;
+	if (run.n_insn<0) {
+		free(run.insn) ;
+		return -1 ;
+	}
+	run.npix   = npix ;
+	run.np     = np ;
+	run.nchunk = (npix + ARITH_CHUNK - 1) / ARITH_CHUNK ;
+	run.dst    = dst ;
+
+	/* Pixel buffers of all operands, for all output planes */
+	run.src = malloc((e->n_opd * np + 1) * sizeof(pixelvalue*)) ;
+	for (k=0 ; k<e->n_opd ; k++) {
+		o = e->opd + k ;
+		for (p=0 ; p<np ; p++) {
+			if (o->cube!=NULL) {
+				run.src[k*np+p] = (o->cube->np==1) ?
+					o->cube->plane[0]->data : o->cube->plane[p]->data ;
+			} else if (o->image!=NULL) {
+				run.src[k*np+p] = o->image->data ;
+			} else {
+				run.src[k*np+p] = NULL ;
+			}
+		}
+	}
+
+	nw = eclipse_get_nthreads() ;
+	run.scratch = malloc((nw * run.n_reg * ARITH_BLOCK + 1) *
+						 sizeof(pixelvalue)) ;
+
+	eclipse_parallel_run(arith_expr_task, &run, run.nchunk * np) ;
+
+	free(run.scratch) ;
+	free(run.src) ;
+	free(run.insn) ;
+	return 0 ;
+}
+
+/* Locate the pixels of a slot for the block starting at offset off */
+static pixelvalue * arith_slot_pixels(
+		arith_run	*	run,
+		arith_slot	*	slot,
+		int				p,
+		int				off,
+		pixelvalue	*	regs)
+{
+	switch (slot->kind) {
+		case SLOT_PIXELS:
+		return run->src[slot->index * run->np + p] + off ;
+
+		case SLOT_REG:
+		return regs + slot->index * ARITH_BLOCK ;
+
+		case SLOT_OUT:
+		return run->dst[p] + off ;
+	}
+	return NULL ;
+}
+
+/* Apply one instruction to a block of n pixels */
+static void arith_block(
+		int				op,
+		pixelvalue	*	d,
+		pixelvalue	*	pa,
+		double			sa,
+		pixelvalue	*	pb,
+		double			sb,
+		int				n)
+{
+	pixelvalue	a, b ;
+	int			i ;
+
+	switch (op) {
+		case '+':
+		ARITH_LOOP(a+b) ;
+		break ;
+
+		case '-':
+		ARITH_LOOP(a-b) ;
+		break ;
+
+		case '*':
+		ARITH_LOOP(a*b) ;
+		break ;
+
+		case '/':
+		if (pb==NULL) {
+			/* Constant divisor: same rounding as image_cst_op() and ccube */
+			if (fabs(sb)>ARITH_TINY) {
+				sb = 1.0 / sb ;
+				for (i=0 ; i<n ; i++) d[i] = (pixelvalue)((double)pa[i] * sb);
+			} else {
+				for (i=0 ; i<n ; i++) d[i] = (pixelvalue)0.0 ;
+			}
+		} else {
+			ARITH_LOOP((fabs(b)>ARITH_TINY) ? a/b : (pixelvalue)0.0) ;
+		}
+		break ;
+
+		case '^':
+		ARITH_LOOP((pixelvalue)pow((double)a, (double)b)) ;
+		break ;
+
+		case 'n':
+		for (i=0 ; i<n ; i++) d[i] = -pa[i] ;
+		break ;
+
+		case '=':
+		if (pa==NULL) {
+			for (i=0 ; i<n ; i++) d[i] = sa ;
+		} else if (pa!=d) {
+			memcpy(d, pa, n * sizeof(pixelvalue)) ;
+		}
+		break ;
+	}
+	return ;
+}
+
+/* Evaluate the expression over one chunk of one plane */
+static void arith_expr_task(void * arg, int task, int worker)
+{
+	arith_run	*	run ;
+	arith_insn	*	ins ;
+	pixelvalue	*	regs ;
+	int				p, beg, end, off, n, k ;
+
+	run  = (arith_run*)arg ;
+	p    = task / run->nchunk ;
+	beg  = (task % run->nchunk) * ARITH_CHUNK ;
+	end  = beg + ARITH_CHUNK ;
+	if (end>run->npix) end = run->npix ;
+	regs = run->scratch + worker * run->n_reg * ARITH_BLOCK ;
+
+	for (off=beg ; off<end ; off+=ARITH_BLOCK) {
+		n = end-off ;
+		if (n>ARITH_BLOCK) n = ARITH_BLOCK ;
+		for (k=0 ; k<run->n_insn ; k++) {
+			ins = run->insn + k ;
+			arith_block(ins->op,
+						arith_slot_pixels(run, &ins->dst, p, off, regs),
+						arith_slot_pixels(run, &ins->a, p, off, regs),
+						ins->a.value,
+						arith_slot_pixels(run, &ins->b, p, off, regs),
+						ins->b.value,
+						n) ;
+		}
+	}
+	return ;
+}
+
+/*
+ * Recursive descent parser for expressions in standard notation:
+ *
+ * sum      := product { ('+'|'-') product }
+ * product  := unary { ('*'|'/') unary }
+ * unary    := ('-'|'+') unary | power
+ * power    := primary [ '^' unary ]
+ * primary  := number | '$' integer | '(' sum ')'
+ */
+static void arith_skip_blanks(char ** s)
+{
+	while (isspace((int)(unsigned char)**s)) (*s)++ ;
+	return ;
+}
+
+static int arith_parse_sum(arith_expr * e, char ** s)
+{
+	int		op ;
+
+	if (arith_parse_product(e, s)!=0) return -1 ;
+	while (1) {
+		arith_skip_blanks(s) ;
+		op = **s ;
+		if (op!='+' && op!='-') break ;
+		(*s)++ ;
+		if (arith_parse_product(e, s)!=0) return -1 ;
+		if (arith_expr_push_op(e, op)!=0) return -1 ;
+	}
+	return 0 ;
+}
+
+static int arith_parse_product(arith_expr * e, char ** s)
+{
+	int		op ;
+
+	if (arith_parse_unary(e, s)!=0) return -1 ;
+	while (1) {
+		arith_skip_blanks(s) ;
+		op = **s ;
+		if (op!='*' && op!='/') break ;
+		(*s)++ ;
+		if (arith_parse_unary(e, s)!=0) return -1 ;
+		if (arith_expr_push_op(e, op)!=0) return -1 ;
+	}
+	return 0 ;
+}
+
+static int arith_parse_unary(arith_expr * e, char ** s)
+{
+	arith_skip_blanks(s) ;
+	if (**s=='-') {
+		(*s)++ ;
+		if (arith_parse_unary(e, s)!=0) return -1 ;
+		return arith_expr_push_op(e, 'n') ;
+	}
+	if (**s=='+') {
+		(*s)++ ;
+		return arith_parse_unary(e, s) ;
+	}
+	return arith_parse_power(e, s) ;
+}
+
+static int arith_parse_power(arith_expr * e, char ** s)
+{
+	if (arith_parse_primary(e, s)!=0) return -1 ;
+	arith_skip_blanks(s) ;
+	if (**s=='^') {
+		(*s)++ ;
+		if (arith_parse_unary(e, s)!=0) return -1 ;
+		return arith_expr_push_op(e, '^') ;
+	}
+	return 0 ;
+}
+
+static int arith_parse_primary(arith_expr * e, char ** s)
+{
+	char	*	end ;
+	double		d ;
+	long		index ;
+
+	arith_skip_blanks(s) ;
+	if (**s=='(') {
+		(*s)++ ;
+		if (arith_parse_sum(e, s)!=0) return -1 ;
+		arith_skip_blanks(s) ;
+		if (**s!=')') {
+			e_error("in expression: missing closing bracket at [%s]", *s) ;
+			return -1 ;
+		}
+		(*s)++ ;
+		return 0 ;
+	}
+	if (**s=='$') {
+		index = strtol(*s+1, &end, 10) ;
+		if (end==*s+1) {
+			e_error("in expression: invalid operand at [%s]", *s) ;
+			return -1 ;
+		}
+		*s = end ;
+		return arith_expr_push_operand(e, (int)index) ;
+	}
+	d = strtod(*s, &end) ;
+	if (end==*s) {
+		e_error("in expression: unexpected [%s]", *s) ;
+		return -1 ;
+	}
+	*s = end ;
+	return arith_expr_push_const(e, d) ;
+}
+/* vim: set ts=4 et sw=4 tw=75 */
@@ -19,8 +19,244 @@
    								Includes
  ---------------------------------------------------------------------------*/
 
+#include <math.h>
+#include <string.h>
+
 #include "cube2image.h"
 #include "median.h"
+#include "cube_zlines.h"
+#include "parallel.h"
+#include "trace.h"
+
+/*---------------------------------------------------------------------------
+   								Defines
+ ---------------------------------------------------------------------------*/
+
+/*
+ * Maximal number of pixels in the time line tile of a worker. Time lines
+ * of consecutive pixels in a row are gathered plane by plane into a tile,
+ * as many pixels at a time as fit.
+ */
+#define COLLAPSE_TILEPIX	262144
+
+/* Ratio between the standard deviation and the MAD of a Gaussian */
+#define STACK_MAD2SIGMA		1.4826
+
+/*---------------------------------------------------------------------------
+   								Private types
+ ---------------------------------------------------------------------------*/
+
+/* Shared state of the collapse tasks, one task per row */
+typedef struct _collapse_job_ {
+	cube_t		*	in ;
+	image_t		*	out ;
+	/* Pixels in a tile */
+	int				tile_lx ;
+	/* Rejection by counts */
+	int				lo_rej ;
+	int				hi_rej ;
+	/* cube_stack() parameters and outputs */
+	stack_reject	reject ;
+	double			kappa_lo ;
+	double			kappa_hi ;
+	int				niter ;
+	double		*	weights ;
+	cube_t		*	wmaps ;
+	image_t		*	counts ;
+	image_t		*	wsum ;
+	/* One tile of time lines per worker */
+	pixelvalue	*	tiles ;
+	/* cube_stack() only: one tile of weights and np values per worker */
+	double		*	wtiles ;
+	pixelvalue	*	scratch ;
+} collapse_job ;
+
+/*---------------------------------------------------------------------------
+   							Private functions
+ ---------------------------------------------------------------------------*/
+
+/* Number of pixels in a tile of time lines */
+static int collapse_tile_lx(cube_t * in)
+{
+	int		tile_lx ;
+
+	tile_lx = COLLAPSE_TILEPIX / in->np ;
+	if (tile_lx<1) tile_lx = 1 ;
+	if (tile_lx>in->lx) tile_lx = in->lx ;
+	return tile_lx ;
+}
+
+/*
+ * Partially order a time line so that t[lo_rej..n-hi_rej-1] holds the
+ * values left after rejection of the lo_rej lowest and hi_rej highest.
+ * Quickselect is used instead of a complete sort.
+ */
+static void collapse_select(pixelvalue * t, int n, int lo_rej, int hi_rej)
+{
+	if (hi_rej>0) kth_smallest(t, n, n - hi_rej - 1) ;
+	if (lo_rej>0) kth_smallest(t, n - hi_rej, lo_rej) ;
+}
+
+/* Average with rejection by counts, one row */
+static void collapse_reject_task(void * arg, int j, int worker)
+{
+	collapse_job	*	job = (collapse_job*)arg ;
+	pixelvalue		*	tile ;
+	pixelvalue		*	t ;
+	double				acc ;
+	int					np, x0, n ;
+	int					i, k ;
+
+	np = job->in->np ;
+	tile = job->tiles + worker * job->tile_lx * np ;
+	for (x0=0 ; x0<job->in->lx ; x0+=job->tile_lx) {
+		n = job->in->lx - x0 ;
+		if (n>job->tile_lx) n = job->tile_lx ;
+		cube_zlines_gather(job->in, j * job->in->lx + x0, n, tile) ;
+		for (i=0 ; i<n ; i++) {
+			t = tile + i * np ;
+			collapse_select(t, np, job->lo_rej, job->hi_rej) ;
+			acc = 0.0 ;
+			for (k=job->lo_rej ; k<np-job->hi_rej ; k++) acc += (double)t[k] ;
+			job->out->data[j * job->in->lx + x0 + i] =
+				(pixelvalue)(acc / (double)(np - job->lo_rej - job->hi_rej)) ;
+		}
+	}
+}
+
+/* Median with rejection by counts, one row */
+static void collapse_medreject_task(void * arg, int j, int worker)
+{
+	collapse_job	*	job = (collapse_job*)arg ;
+	pixelvalue		*	tile ;
+	pixelvalue		*	t ;
+	int					np, x0, n ;
+	int					i ;
+
+	np = job->in->np ;
+	tile = job->tiles + worker * job->tile_lx * np ;
+	for (x0=0 ; x0<job->in->lx ; x0+=job->tile_lx) {
+		n = job->in->lx - x0 ;
+		if (n>job->tile_lx) n = job->tile_lx ;
+		cube_zlines_gather(job->in, j * job->in->lx + x0, n, tile) ;
+		for (i=0 ; i<n ; i++) {
+			t = tile + i * np ;
+			collapse_select(t, np, job->lo_rej, job->hi_rej) ;
+			job->out->data[j * job->in->lx + x0 + i] =
+				median_pixelvalue(t + job->lo_rej,
+								  np - job->lo_rej - job->hi_rej) ;
+		}
+	}
+}
+
+/*
+ * Clip a time line of n values v with weights w around its median.
+ * Kept values are moved to the beginning of v and w, in their original
+ * order. Returns the number of kept values. s is a scratch buffer of n
+ * values.
+ */
+static int stack_clip(
+		collapse_job	*	job,
+		pixelvalue		*	v,
+		double			*	w,
+		int					n,
+		pixelvalue		*	s)
+{
+	double		med, sigma ;
+	double		mean, var ;
+	double		lo, hi ;
+	int			iter ;
+	int			i, m ;
+
+	for (iter=0 ; (job->niter<1) || (iter<job->niter) ; iter++) {
+		if (n<3) break ;
+		memcpy(s, v, n * sizeof(pixelvalue)) ;
+		med = (double)median_pixelvalue(s, n) ;
+		if (job->reject==stack_mad) {
+			for (i=0 ; i<n ; i++) s[i] = (pixelvalue)fabs((double)v[i] - med) ;
+			sigma = STACK_MAD2SIGMA * (double)median_pixelvalue(s, n) ;
+		} else {
+			mean = 0.0 ;
+			for (i=0 ; i<n ; i++) mean += (double)v[i] ;
+			mean /= (double)n ;
+			var = 0.0 ;
+			for (i=0 ; i<n ; i++) {
+				var += ((double)v[i] - mean) * ((double)v[i] - mean) ;
+			}
+			sigma = sqrt(var / (double)(n-1)) ;
+		}
+		if (sigma<=0.0) break ;
+		lo = med - job->kappa_lo * sigma ;
+		hi = med + job->kappa_hi * sigma ;
+		m = 0 ;
+		for (i=0 ; i<n ; i++) {
+			if (((double)v[i]>=lo) && ((double)v[i]<=hi)) {
+				v[m] = v[i] ;
+				w[m] = w[i] ;
+				m++ ;
+			}
+		}
+		if (m==n) break ;
+		n = m ;
+	}
+	return n ;
+}
+
+/* Weighted average with iterative clipping, one row */
+static void collapse_stack_task(void * arg, int j, int worker)
+{
+	collapse_job	*	job = (collapse_job*)arg ;
+	pixelvalue		*	tile ;
+	double			*	wtile ;
+	pixelvalue		*	v ;
+	double			*	w ;
+	double				wp, sw, swv ;
+	int					np, x0, n, pos ;
+	int					i, p, m ;
+
+	np = job->in->np ;
+	tile  = job->tiles  + worker * job->tile_lx * np ;
+	wtile = job->wtiles + worker * job->tile_lx * np ;
+	for (x0=0 ; x0<job->in->lx ; x0+=job->tile_lx) {
+		n = job->in->lx - x0 ;
+		if (n>job->tile_lx) n = job->tile_lx ;
+		cube_zlines_gather(job->in, j * job->in->lx + x0, n, tile) ;
+		/* Weights, plane by plane as well */
+		for (p=0 ; p<np ; p++) {
+			wp = (job->weights==NULL) ? 1.0 : job->weights[p] ;
+			for (i=0 ; i<n ; i++) {
+				wtile[i * np + p] = (job->wmaps==NULL) ? wp :
+					wp * (double)job->wmaps->plane[p]->data[j*job->in->lx+x0+i];
+			}
+		}
+		for (i=0 ; i<n ; i++) {
+			v = tile  + i * np ;
+			w = wtile + i * np ;
+			pos = j * job->in->lx + x0 + i ;
+			/* Values without weight are not part of the stack */
+			m = 0 ;
+			for (p=0 ; p<np ; p++) {
+				if (w[p]>0.0) {
+					v[m] = v[p] ;
+					w[m] = w[p] ;
+					m++ ;
+				}
+			}
+			if (job->reject!=stack_none) {
+				m = stack_clip(job, v, w, m,
+							   job->scratch + worker * np) ;
+			}
+			sw = swv = 0.0 ;
+			for (p=0 ; p<m ; p++) {
+				sw  += w[p] ;
+				swv += w[p] * (double)v[p] ;
+			}
+			job->out->data[pos] = (sw>0.0) ? (pixelvalue)(swv / sw) : 0.0 ;
+			if (job->counts!=NULL) job->counts->data[pos] = (pixelvalue)m ;
+			if (job->wsum!=NULL)   job->wsum->data[pos]   = (pixelvalue)sw ;
+		}
+	}
+}
 
 /*---------------------------------------------------------------------------
   							Function codes
@@ -89,6 +325,64 @@ int average_engine(
 }
 
 
+/*
+ * Average an out-of-core cube band by band: every average works on time
+ * lines, so a band of lines across all planes is averaged in memory and
+ * copied to the output. The input cube is deallocated.
+ */
+static cube_t * cube_average_tiled(
+		cube_t		*	cube_in,
+		cut_method		cmethod,
+		average_method	amethod,
+		int				cycle_step,
+		int				run_hw,
+		int				lo_rej,
+		int				hi_rej)
+{
+	cube_t		*	cube_out ;
+	cube_t		*	band ;
+	cube_t		*	band_out ;
+	int				y0, ny, p ;
+	int				verbose ;
+
+	cube_out = NULL ;
+	verbose = verbose_active() ;
+	ny = cube_tiles_rows(cube_in) ;
+	for (y0=0 ; y0<cube_in->ly ; y0+=ny) {
+		if (y0+ny>cube_in->ly) ny = cube_in->ly - y0 ;
+		band_out = NULL ;
+		band = cube_tiles_getband(cube_in, y0, ny) ;
+		if (band!=NULL) {
+			band_out = cube_average(band, cmethod, amethod, cycle_step,
+									run_hw, lo_rej, hi_rej) ;
+		}
+		/* Only report about the first band */
+		set_verbose(0) ;
+		if (band_out==NULL) {
+			set_verbose(verbose) ;
+			cube_del(cube_out) ;
+			cube_del(cube_in) ;
+			return NULL ;
+		}
+		if (cube_out==NULL) {
+			cube_out = cube_new(cube_in->lx, cube_in->ly, band_out->np) ;
+			for (p=0 ; p<band_out->np ; p++) {
+				cube_out->plane[p] = image_new(cube_in->lx, cube_in->ly) ;
+			}
+		}
+		for (p=0 ; p<band_out->np ; p++) {
+			memcpy(cube_out->plane[p]->data + y0 * cube_in->lx,
+				   band_out->plane[p]->data,
+				   ny * cube_in->lx * sizeof(pixelvalue)) ;
+		}
+		cube_del(band_out) ;
+	}
+	set_verbose(verbose) ;
+	cube_del(cube_in) ;
+	return cube_out ;
+}
+
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief	Average a cube
@@ -119,6 +413,9 @@ int average_engine(
 
   Notice that all combinations are not yet implemented. Check out the
   source code to see if your specific average need is there.
+
+  Out-of-core cubes (see cube_tiles.h) are averaged by bands of lines,
+  so that only one band is in memory at a time besides the output.
  */
 /*--------------------------------------------------------------------------*/
 cube_t * cube_average(
@@ -135,6 +432,10 @@ cube_t * cube_average(
 
 	/* Test inputs */
 	if (cube_in==NULL) return NULL ;
+	if (cube_in->tiles!=NULL) {
+		return cube_average_tiled(cube_in, cmethod, amethod, cycle_step,
+								  run_hw, lo_rej, hi_rej) ;
+	}
 	 
 	/* Case by case, apply one or another average method */
 	if ((cmethod == cut_whole) && (amethod == avg_linear)) {
@@ -243,6 +544,7 @@ image_t	* cube_avg_linear(cube_t * incube)
 	e_comment(1, "averaging cube to one image") ;
 	sum_image = image_new(incube->lx, incube->ly) ;
 	if (sum_image==NULL) return NULL ;
+	TRACE_BEGIN("collapse/linear") ;
 	/* Loop on all planes */
 	for (i=0 ; i<incube->np ; i++) {
 		compute_status("linear averaging", i, incube->np, 2) ;
@@ -253,6 +555,8 @@ image_t	* cube_avg_linear(cube_t * incube)
 	for (i=0 ; i<(sum_image->lx * sum_image->ly) ; i++) {
 		sum_image->data[i] *= inv ; 
 	}
+	TRACE_COUNT(TRACE_PIXELS, (double)incube->lx * incube->ly * incube->np) ;
+	TRACE_END("collapse/linear") ;
 	return(sum_image) ;
 }
 
@@ -266,7 +570,7 @@ image_t	* cube_avg_linear(cube_t * incube)
   @return	Newly allocated image object.
 
   This median averaging applies to the whole cube. Every time line is
-  extracted, sorted out, then the lowest and highest values are
+  extracted, partially sorted, then the lowest and highest values are
   rejected, and the median of the rest is found to yield the output
   pixel.
 
@@ -279,9 +583,7 @@ image_t * cube_avg_medreject(
 		int			hi_rej)
 {
 	image_t	*		avg ;
-	int				pos ;
-	int				i, j ;
-	pixelvalue		rejavg ;
+	collapse_job	job ;
 
 	/* Error handling: test entries	*/
 	if (incube==NULL) return NULL ;
@@ -295,14 +597,19 @@ image_t * cube_avg_medreject(
 	if (hi_rej<0) hi_rej=0 ;
 
 	avg = image_new(incube->lx, incube->ly) ;
-	for (j=0 ; j<incube->ly ; j++) {
-		compute_status("median averaging with rejection", j, incube->ly, 1) ;
-		for (i=0 ; i<incube->lx ; i++) {
-			pos = i + j * incube->lx ;
-			rejavg = cube_z_medreject(incube, pos, lo_rej, hi_rej) ;
-			avg->data[pos] = rejavg ;
-		}
-	}
+	TRACE_BEGIN("collapse/medreject") ;
+	memset(&job, 0, sizeof(job)) ;
+	job.in      = incube ;
+	job.out     = avg ;
+	job.lo_rej  = lo_rej ;
+	job.hi_rej  = hi_rej ;
+	job.tile_lx = collapse_tile_lx(incube) ;
+	job.tiles   = malloc(eclipse_get_nthreads() * job.tile_lx * incube->np *
+						 sizeof(pixelvalue)) ;
+	eclipse_parallel_run(collapse_medreject_task, &job, incube->ly) ;
+	free(job.tiles) ;
+	TRACE_COUNT(TRACE_PIXELS, (double)incube->lx * incube->ly * incube->np) ;
+	TRACE_END("collapse/medreject") ;
 	return avg ;
 }
 
@@ -344,8 +651,8 @@ pixelvalue cube_z_medreject(
 		timeline[plane] = in_cube->plane[plane]->data[pos] ;
 	}
 	
-	/* Now sort out the timeline for this pixel	*/
-	pixel_qsort(timeline, in_cube->np) ;
+	/* Now partially sort out the timeline for this pixel */
+	collapse_select(timeline, in_cube->np, lo_rej, hi_rej) ;
 	acc_val = 0.0 ;
 
 	/* Get the middle values, reject lower and upper pixel proportion */
@@ -364,7 +671,7 @@ pixelvalue cube_z_medreject(
   @return	Newly allocated image object.
 
   This averaging applies to the whole cube. Every time line is
-  extracted, sorted out, then the lowest and highest values are
+  extracted, partially sorted, then the lowest and highest values are
   rejected, and the rest is linearly averaged to yield the output
   pixel.
  */
@@ -375,9 +682,7 @@ image_t * cube_avg_reject(
 		int 		hi_rej)
 {
 	image_t		*	avg ;
-	int				pos ;
-	int				i, j ;
-	pixelvalue		rejavg ;
+	collapse_job	job ;
 
 	/* Error handling: test entries	*/
 	if (incube==NULL) return NULL ;
@@ -391,14 +696,19 @@ image_t * cube_avg_reject(
 	if (hi_rej<0) hi_rej=0 ;
 
 	avg = image_new(incube->lx, incube->ly) ;
-	for (j=0 ; j<incube->ly ; j++) {
-		compute_status("averaging with rejection", j, incube->ly, 1) ;
-		for (i=0 ; i<incube->lx ; i++) {
-			pos = i + j * incube->lx ;
-			rejavg = cube_z_reject(incube, pos, lo_rej, hi_rej) ;
-			avg->data[pos] = rejavg ;
-		}
-	}
+	TRACE_BEGIN("collapse/reject") ;
+	memset(&job, 0, sizeof(job)) ;
+	job.in      = incube ;
+	job.out     = avg ;
+	job.lo_rej  = lo_rej ;
+	job.hi_rej  = hi_rej ;
+	job.tile_lx = collapse_tile_lx(incube) ;
+	job.tiles   = malloc(eclipse_get_nthreads() * job.tile_lx * incube->np *
+						 sizeof(pixelvalue)) ;
+	eclipse_parallel_run(collapse_reject_task, &job, incube->ly) ;
+	free(job.tiles) ;
+	TRACE_COUNT(TRACE_PIXELS, (double)incube->lx * incube->ly * incube->np) ;
+	TRACE_END("collapse/reject") ;
 	return avg ;
 }
 
@@ -445,8 +755,8 @@ pixelvalue cube_z_reject(
 		timeline[plane] = in_cube->plane[plane]->data[pos] ;
 	}
 	
-	/* Now sort out the timeline for this pixel	*/
-	pixel_qsort(timeline, in_cube->np) ;
+	/* Now partially sort out the timeline for this pixel */
+	collapse_select(timeline, in_cube->np, lo_rej, hi_rej) ;
 	acc_val = 0.0 ;
 
 	/*
@@ -484,11 +794,14 @@ image_t	* cube_avg_sum(cube_t * incube)
 	e_comment(1, "averaging cube to one image") ;
 	sum_image = image_new(incube->lx, incube->ly) ;
 	if (sum_image == NULL) return NULL ;
+	TRACE_BEGIN("collapse/sum") ;
 	/* Loop on all planes */
 	for (i=0 ; i<incube->np ; i++) {
 		compute_status("sum averaging", i, incube->np, 2) ;
 		image_add_local(sum_image, incube->plane[i]) ;
 	}
+	TRACE_COUNT(TRACE_PIXELS, (double)incube->lx * incube->ly * incube->np) ;
+	TRACE_END("collapse/sum") ;
 	return(sum_image) ;
 }
 
@@ -521,6 +834,7 @@ image_t * cube_avg_median(cube_t * to_average)
 	avg = image_new(to_average->lx, to_average->ly) ;
 	nplanes = to_average->np;
 	timeline = calloc(nplanes, sizeof(pixelvalue)) ;
+	TRACE_BEGIN("collapse/median") ;
 
 	for (j=0 ; j<to_average->ly ; j++) {
 	     offset = j*to_average->lx ;
@@ -533,6 +847,9 @@ image_t * cube_avg_median(cube_t * to_average)
 	     }
 	}
 	free(timeline);
+	TRACE_COUNT(TRACE_PIXELS,
+				(double)to_average->lx * to_average->ly * to_average->np) ;
+	TRACE_END("collapse/median") ;
 	return avg ;
 }
 
@@ -931,3 +1248,217 @@ cube_t * cube_avgrun_median(
     }
 	return outcube ;
 }
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Weighted average of a cube with iterative clipping.
+  @param	incube		Cube to average.
+  @param	reject		Rejection method (see cube2image.h).
+  @param	kappa_lo	Low clipping threshold in sigmas.
+  @param	kappa_hi	High clipping threshold in sigmas.
+  @param	niter		Maximal number of clipping iterations.
+  @param	weights		Array of incube->np plane weights, or NULL.
+  @param	wmaps		Cube of per-pixel weight maps, or NULL.
+  @param	counts		Returned image of contributing frames, or NULL.
+  @param	wsum		Returned image of the sums of weights, or NULL.
+  @return	Newly allocated image object.
+
+  Every time line is clipped around its median: values further than
+  kappa_lo sigmas below or kappa_hi sigmas above the median are
+  rejected, and the clipping is repeated on the remaining values until
+  nothing more is rejected, fewer than 3 values are left, or niter
+  iterations have been done (niter<1 means no limit). Sigma is the
+  standard deviation of the values for stack_ksigma, and the median
+  absolute deviation scaled to a Gaussian sigma for stack_mad. No
+  clipping is done with stack_none.
+
+  The weight of a pixel is its plane weight times its value in the
+  weight map, both being 1 if not provided. Pixels with a weight lower
+  or equal to zero are ignored. A noise map should be given as an
+  inverse variance map. The output pixel is the weighted average of the
+  values left after clipping, or 0 if none.
+
+  If counts (resp. wsum) is not NULL, it is set to a newly allocated
+  image containing the number of values (resp. the sum of weights)
+  left in each time line.
+ */
+/*--------------------------------------------------------------------------*/
+image_t * cube_stack(
+		cube_t		*	incube,
+		stack_reject	reject,
+		double			kappa_lo,
+		double			kappa_hi,
+		int				niter,
+		double		*	weights,
+		cube_t		*	wmaps,
+		image_t		**	counts,
+		image_t		**	wsum)
+{
+	image_t		*	avg ;
+	collapse_job	job ;
+	int				nthreads ;
+
+	/* Error handling: test entries	*/
+	if (incube==NULL) return NULL ;
+	if (wmaps!=NULL) {
+		if ((wmaps->lx!=incube->lx) || (wmaps->ly!=incube->ly) ||
+			(wmaps->np!=incube->np)) {
+			e_error("weight maps and cube sizes do not match") ;
+			return NULL ;
+		}
+	}
+	if ((reject!=stack_none) && ((kappa_lo<=0.0) || (kappa_hi<=0.0))) {
+		e_error("clipping thresholds must be positive") ;
+		return NULL ;
+	}
+
+	avg = image_new(incube->lx, incube->ly) ;
+	TRACE_BEGIN("collapse/stack") ;
+	nthreads = eclipse_get_nthreads() ;
+	memset(&job, 0, sizeof(job)) ;
+	job.in       = incube ;
+	job.out      = avg ;
+	job.reject   = reject ;
+	job.kappa_lo = kappa_lo ;
+	job.kappa_hi = kappa_hi ;
+	job.niter    = niter ;
+	job.weights  = weights ;
+	job.wmaps    = wmaps ;
+	if (counts!=NULL) job.counts = image_new(incube->lx, incube->ly) ;
+	if (wsum!=NULL)   job.wsum   = image_new(incube->lx, incube->ly) ;
+	job.tile_lx  = collapse_tile_lx(incube) ;
+	job.tiles    = malloc(nthreads * job.tile_lx * incube->np *
+						  sizeof(pixelvalue)) ;
+	job.wtiles   = malloc(nthreads * job.tile_lx * incube->np *
+						  sizeof(double)) ;
+	job.scratch  = malloc(nthreads * incube->np * sizeof(pixelvalue)) ;
+	eclipse_parallel_run(collapse_stack_task, &job, incube->ly) ;
+	free(job.tiles) ;
+	free(job.wtiles) ;
+	free(job.scratch) ;
+	TRACE_COUNT(TRACE_PIXELS, (double)incube->lx * incube->ly * incube->np) ;
+	TRACE_END("collapse/stack") ;
+
+	if (counts!=NULL) *counts = job.counts ;
+	if (wsum!=NULL)   *wsum   = job.wsum ;
+	return avg ;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Weighted and clipped average of a cube file to an image file.
+  @param	name_in		Name of the input cube.
+  @param	name_out	Name of the output image.
+  @param	reject		Rejection method (see cube2image.h).
+  @param	kappa_lo	Low clipping threshold in sigmas.
+  @param	kappa_hi	High clipping threshold in sigmas.
+  @param	niter		Maximal number of clipping iterations.
+  @param	weight_name	Name of an ASCII file of plane weights, or NULL.
+  @param	wmap_name	Name of a cube of weight maps, or NULL.
+  @param	count_name	Name of the output count image, or NULL.
+  @param	wsum_name	Name of the output weight sum image, or NULL.
+  @return	int 0 if Ok, -1 otherwise.
+
+  Loads the input cube and optional weights, then calls cube_stack()
+  and saves its results. The plane weights file contains one value per
+  plane of the input cube, separated by blanks or new lines.
+ */
+/*--------------------------------------------------------------------------*/
+int stack_engine(
+		char		*	name_in,
+		char		*	name_out,
+		stack_reject	reject,
+		double			kappa_lo,
+		double			kappa_hi,
+		int				niter,
+		char		*	weight_name,
+		char		*	wmap_name,
+		char		*	count_name,
+		char		*	wsum_name)
+{
+	cube_t		*	cube_in ;
+	cube_t		*	wmaps ;
+	double		*	weights ;
+	image_t		*	image_out ;
+	image_t		*	counts ;
+	image_t		*	wsum ;
+	FILE		*	in ;
+	int				i ;
+
+	/* Test inputs */
+	if (name_in[0] == (char)0) {
+		e_error("no input name was specified: aborting stack") ;
+		return -1 ;
+	}
+	if (name_out[0] == (char)0) {
+		sprintf(name_out, "%s_avg.fits", get_rootname(name_in)) ;
+	}
+
+	/* Load input cube */
+	cube_in = cube_load(name_in) ;
+	if (cube_in == NULL) {
+		e_error("cannot load cube [%s]: aborting stack", name_in);
+		return -1 ;
+	}
+
+	/* Load plane weights */
+	weights = NULL ;
+	if (weight_name!=NULL) {
+		if ((in=fopen(weight_name, "r"))==NULL) {
+			e_error("cannot open weights file [%s]", weight_name) ;
+			cube_del(cube_in) ;
+			return -1 ;
+		}
+		weights = malloc(cube_in->np * sizeof(double)) ;
+		for (i=0 ; i<cube_in->np ; i++) {
+			if (fscanf(in, "%lg", weights+i)!=1) break ;
+		}
+		fclose(in) ;
+		if (i<cube_in->np) {
+			e_error("expected %d weights in [%s], got %d",
+					cube_in->np, weight_name, i) ;
+			free(weights) ;
+			cube_del(cube_in) ;
+			return -1 ;
+		}
+	}
+
+	/* Load weight maps */
+	wmaps = NULL ;
+	if (wmap_name!=NULL) {
+		if ((wmaps=cube_load(wmap_name))==NULL) {
+			e_error("cannot load weight maps [%s]", wmap_name) ;
+			if (weights!=NULL) free(weights) ;
+			cube_del(cube_in) ;
+			return -1 ;
+		}
+	}
+
+	/* Apply stacking */
+	image_out = cube_stack(cube_in, reject, kappa_lo, kappa_hi, niter,
+						   weights, wmaps,
+						   (count_name!=NULL) ? &counts : NULL,
+						   (wsum_name!=NULL) ? &wsum : NULL) ;
+	cube_del(cube_in) ;
+	if (wmaps!=NULL) cube_del(wmaps) ;
+	if (weights!=NULL) free(weights) ;
+	if (image_out==NULL) {
+		e_error("cannot stack the cube") ;
+		return -1 ;
+	}
+
+	/* Save results */
+	image_save_fits_hdrcopy(image_out, name_out, name_in, BPP_DEFAULT) ;
+	image_del(image_out) ;
+	if (count_name!=NULL) {
+		image_save_fits_hdrcopy(counts, count_name, name_in, BPP_DEFAULT) ;
+		image_del(counts) ;
+	}
+	if (wsum_name!=NULL) {
+		image_save_fits_hdrcopy(wsum, wsum_name, name_in, BPP_DEFAULT) ;
+		image_del(wsum) ;
+	}
+	return 0 ;
+}
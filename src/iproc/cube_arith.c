@@ -21,7 +21,9 @@
 
 #include <math.h>
 #include "cube_arith.h"
+#include "cube_zlines.h"
 #include "image_stats.h"
+#include "parallel.h"
 
 /*-----------------------------------------------------------------------------
    								Define
@@ -41,6 +43,58 @@
 #define max(a,b) (((a)>=(b)) ? (a) : (b))
 #endif
 
+/*-----------------------------------------------------------------------------
+   								Private types
+ -----------------------------------------------------------------------------*/
+
+/* Shared state of the time standard deviation tasks, one task per chunk */
+typedef struct _stdev_z_job_ {
+	cube_t		*	in ;
+	image_t		*	out ;
+	int				chunk ;
+} stdev_z_job ;
+
+/*-----------------------------------------------------------------------------
+   							Private functions
+ -----------------------------------------------------------------------------*/
+
+/*
+ * Time variance of a chunk of pixels. The mean is accumulated in the
+ * same order and precision as cube_avg_linear() does plane by plane.
+ */
+static void cube_stdev_z_task(void * arg, int t, int worker)
+{
+	stdev_z_job		*	job ;
+	cube_zlines		*	zl ;
+	zline_iter			it ;
+	pixelvalue			mean, inv ;
+	double				diff, sq_sum, invsurface ;
+	int					np, pos0, npix, p ;
+
+	job = (stdev_z_job *)arg ;
+	np = job->in->np ;
+	pos0 = t * job->chunk ;
+	npix = job->in->lx * job->in->ly - pos0 ;
+	if (npix>job->chunk) npix = job->chunk ;
+	inv = (pixelvalue)(1.0 / (double)np) ;
+	invsurface = (double)1.0 / (double)np ;
+
+	zl = cube_zlines_new(job->in, pos0, npix) ;
+	cube_zlines_iter_init(&it, zl) ;
+	while (cube_zlines_iter_next(&it)) {
+		mean = 0 ;
+		for (p=0 ; p<np ; p++) mean += it.line[p] ;
+		mean *= inv ;
+		sq_sum = 0.0 ;
+		for (p=0 ; p<np ; p++) {
+			diff = (double)it.line[p] - (double)mean ;
+			sq_sum += diff * diff ;
+		}
+		job->out->data[it.pos] = (pixelvalue)(sq_sum * invsurface) ;
+	}
+	cube_zlines_del(zl) ;
+}
+
 /*-----------------------------------------------------------------------------
   							Function codes
  -----------------------------------------------------------------------------*/
@@ -668,54 +722,32 @@ int cube_subdiv_im(
  
   The returned image is thus an image of standard deviations in the
   cube, it does not share the input cube pixel value units.
+
+  Time lines are processed in parallel by chunks of pixels, transposed
+  to z-major order (see cube_zlines.h).
  */
 /*----------------------------------------------------------------------------*/
 image_t * cube_stdev_z(cube_t * cube1) 
 {     
-	image_t	*	result ;
-	image_t	*	abs_result ;
-	image_t	*	in_plane ;
-	image_t	*	m_img ;
-	int			i ;
-	int			n_plane ;
-	double	*	sq_sum ;
-	double		diff_pix ;
-	double		invsurface ;
+	image_t		*	result ;
+	stdev_z_job		job ;
+	int				npix ;
 
 	if (cube1==NULL) return NULL ;
-	result = image_new(cube1->lx, cube1->ly) ;
-
-	sq_sum = malloc(result->lx * result->ly * sizeof(double));
-	m_img = cube_avg_linear(cube1) ;
-	if (m_img == NULL) {
-		e_error("in averaging : aborting time stdev on cube") ;
-		image_del(result) ;
-		free(sq_sum) ;
+	if (cube1->tiles!=NULL) {
+		e_error("out-of-core cube: aborting time stdev on cube") ;
 		return NULL ;
 	}
-
-	invsurface = (double)1.0 / (double)cube1->np ;
-	for (i=0 ; i<(result->lx * result->ly) ; i++) {
-		sq_sum[i] = (double)0.0 ;
-	}
+	result = image_new(cube1->lx, cube1->ly) ;
 
 	e_comment(1, "extracting standard deviation on cube") ;
-	for (n_plane=0 ; n_plane<cube1->np ; n_plane++) {
-		compute_status("standard deviation", n_plane, cube1->np,2) ; 
-		in_plane = cube1->plane[n_plane] ;
-		for (i=0 ; i<(in_plane->lx * in_plane->ly) ; i++) {
-			diff_pix = (double)in_plane->data[i] - (double)m_img->data[i] ; 
-			sq_sum[i] += diff_pix * diff_pix ;
-		}
-	}
-	image_del(m_img) ;
-	for (i=0 ; i<(result->lx * result->ly) ; i++) {
-		result->data[i] = (pixelvalue)(sq_sum[i] * invsurface) ;
-	}
-	free(sq_sum) ;
-	abs_result = image_abs(result) ;
-	image_del(result) ;
-	return abs_result ;
+	npix = cube1->lx * cube1->ly ;
+	job.in = cube1 ;
+	job.out = result ;
+	job.chunk = cube_zlines_chunk(cube1->np) ;
+	eclipse_parallel_run(cube_stdev_z_task, &job,
+						 (npix + job.chunk - 1) / job.chunk) ;
+	return result ;
 }
 
 
@@ -61,6 +61,7 @@ cube_t * cube_new(int lx, int ly, int n_im)
     n->lx = lx ;
     n->ly = ly ;
     n->np = n_im ;
+    n->tiles = NULL ;
 
     return n;
 }
@@ -95,7 +96,8 @@ int cube_get_bytesize(cube_t * cu)
 	bs += sizeof(cube_t);
 	/* Add up individual image sizes */
 	for (i=0 ; i<cu->np ; i++) {
-		bs += image_get_bytesize(cu->plane[i]);
+		if (cu->plane[i]!=NULL)
+			bs += image_get_bytesize(cu->plane[i]);
 	}
 	return bs ;
 }
@@ -208,7 +210,10 @@ cube_t * cube_copy(cube_t *src_cube)
     
     /* Then copy data zones from one cube to the other  */
     for (i=0 ; i<src_cube->np ; i++) {
-		dest_cube->plane[i] = image_copy(src_cube->plane[i]) ;
+		if (src_cube->tiles!=NULL)
+			dest_cube->plane[i] = cube_tiles_getplane(src_cube, i) ;
+		else
+			dest_cube->plane[i] = image_copy(src_cube->plane[i]) ;
 	}
     return dest_cube ;
 }
@@ -261,6 +266,7 @@ void cube_del_shallow(cube_t * d)
 	if (d->plane != NULL)
 		free(d->plane) ;
 	d->plane = NULL ;
+	cube_tiles_del(d->tiles) ;
 
     /* free structure itself    */
     free(d) ;
@@ -300,6 +306,8 @@ void cube_del_contents(cube_t * d)
 		free(d->plane);
 	}
 	d->plane = NULL ;
+	cube_tiles_del(d->tiles) ;
+	d->tiles = NULL ;
 
 	/* Stop here: leave top structure allocated */
 	return ;
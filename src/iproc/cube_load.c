@@ -26,6 +26,100 @@
 #include "qfits.h"
 #include "cube_load.h"
 #include "image_rtd.h"
+#include "parallel.h"
+#include "trace.h"
+
+/*-----------------------------------------------------------------------------
+   								Private types
+ -----------------------------------------------------------------------------*/
+
+/* Shared state for parallel decompression of a tile-compressed cube */
+typedef struct _zload_job_ {
+	qfits_zimage	*	z ;
+	cube_t			*	cube ;
+	/* One tile buffer per worker */
+	double			**	buf ;
+	/* Status per tile */
+	int				*	status ;
+} zload_job ;
+
+/*-----------------------------------------------------------------------------
+   								Private functions
+ -----------------------------------------------------------------------------*/
+
+/* Decompress one tile and copy it to the cube planes */
+static void cube_load_zimage_task(void * arg, int task, int worker)
+{
+	zload_job	*	job ;
+	double		*	src ;
+	pixelvalue	*	dst ;
+	int				pos[3], size[3] ;
+	int				i, j, k ;
+
+	job = (zload_job*)arg ;
+	job->status[task] = qfits_zimage_read_tile(job->z, task, job->buf[worker]);
+	if (job->status[task]!=0) return ;
+	qfits_zimage_tile_box(job->z, task, pos, size);
+	src = job->buf[worker] ;
+	for (k=0 ; k<size[2] ; k++) {
+		for (j=0 ; j<size[1] ; j++) {
+			dst = job->cube->plane[pos[2]+k]->data +
+				  pos[0] + (pos[1]+j) * job->cube->lx ;
+			for (i=0 ; i<size[0] ; i++) {
+				dst[i] = (pixelvalue)*src++ ;
+			}
+		}
+	}
+	return ;
+}
+
+/* Load a tile-compressed cube, decompressing tiles in parallel */
+static cube_t * cube_load_zimage(char * filename, int xtnum)
+{
+	qfits_zimage	*	z ;
+	cube_t			*	loaded_cube ;
+	zload_job			job ;
+	int					nw ;
+	int					i, err ;
+
+	z = qfits_zimage_open(filename, xtnum);
+	if (z==NULL) {
+		e_error("cannot open compressed image in %s", filename);
+		return NULL ;
+	}
+	loaded_cube = cube_new(z->lx, z->ly, z->np);
+	for (i=0 ; i<z->np ; i++) {
+		loaded_cube->plane[i] = image_new(z->lx, z->ly);
+	}
+	nw = eclipse_get_nthreads() ;
+	job.z      = z ;
+	job.cube   = loaded_cube ;
+	job.buf    = malloc(nw * sizeof(double*));
+	job.status = malloc(z->ntiles * sizeof(int));
+	for (i=0 ; i<nw ; i++) {
+		job.buf[i] = malloc(z->tx * z->ty * z->tz * sizeof(double));
+	}
+	e_comment(1, "decompressing %d tiles with %d threads", z->ntiles, nw);
+	eclipse_parallel_run(cube_load_zimage_task, &job, z->ntiles);
+
+	err = 0 ;
+	for (i=0 ; i<z->ntiles ; i++) {
+		if (job.status[i]!=0) {
+			e_error("decompressing tile %d from file %s", i+1, filename);
+			err = 1 ;
+			break ;
+		}
+	}
+	for (i=0 ; i<nw ; i++) free(job.buf[i]);
+	free(job.buf);
+	free(job.status);
+	qfits_zimage_close(z);
+	if (err) {
+		cube_del(loaded_cube);
+		return NULL ;
+	}
+	return loaded_cube ;
+}
 
 /*-----------------------------------------------------------------------------
   							Function codes
@@ -105,6 +199,13 @@ cube_t * cube_load_rtd(void)
   @param	filename	Name of the FITS file to load.
   @return	1 newly allocated cube object (NULL if error).
   Reads a cube in from a FITS file on disk.
+
+  Tile-compressed images (e.g. produced by fpack) are recognized and
+  decompressed; tiles are decoded in parallel if eclipse was built
+  with thread support.
+
+  If the cube exceeds the memory budget and the program allows it (see
+  cube_tiles.h), an out-of-core cube is returned instead.
  */
 /*----------------------------------------------------------------------------*/
 cube_t * cube_load_fits(char * filename)
@@ -129,6 +230,16 @@ cube_t * cube_load_fits(char * filename)
 	if (qfitsloader_init(&ql)!=0) {
 		return NULL ;
 	}
+	TRACE_BEGIN("fits/load") ;
+	if (ql.zxtnum>0) {
+		loaded_cube = cube_load_zimage(filename, ql.zxtnum) ;
+		TRACE_END("fits/load") ;
+		return loaded_cube ;
+	}
+	if (cube_tiles_wanted(ql.lx, ql.ly, ql.np)) {
+		TRACE_END("fits/load") ;
+		return cube_load_tiled(&filename, 1) ;
+	}
 
     /* Create cube and fill up information fields */
     loaded_cube = cube_new(ql.lx, ql.ly, ql.np);
@@ -139,8 +250,11 @@ cube_t * cube_load_fits(char * filename)
 		if (qfits_loadpix(&ql)!=0) {
 			e_error("loading plane %d from file %s", ql.pnum+1, ql.filename);
 			cube_del(loaded_cube);
+			TRACE_END("fits/load") ;
 			return NULL ;
 		}
+		TRACE_COUNT(TRACE_BYTES_READ,
+					(double)ql.lx * ql.ly * BYTESPERPIXEL(ql.bitpix)) ;
 		one_plane = malloc(sizeof(image_t));
 		one_plane->lx = ql.lx ;
 		one_plane->ly = ql.ly ;
@@ -152,6 +266,7 @@ cube_t * cube_load_fits(char * filename)
 
 		loaded_cube->plane[i] = one_plane ;
 	}
+	TRACE_END("fits/load") ;
     return loaded_cube ;
 }
 
@@ -178,6 +293,8 @@ cube_t * cube_load_fits(char * filename)
   Then the returned cube will have 22 planes (the first 2 plus the 20
   from the cube).
 
+  If the cube exceeds the memory budget and the program allows it (see
+  cube_tiles.h), an out-of-core cube is returned instead.
  */
 /*----------------------------------------------------------------------------*/
 cube_t * cube_load_strings(char ** filenames, int nfiles)
@@ -226,9 +343,14 @@ cube_t * cube_load_strings(char ** filenames, int nfiles)
         }
         np += ql[i].np ;
     }
+    if (cube_tiles_wanted(ql[0].lx, ql[0].ly, np)) {
+        free(ql);
+        return cube_load_tiled(filenames, nfiles) ;
+    }
 
 	/* Create output cube */
 	loaded_cube = cube_new(ql[0].lx, ql[0].ly, np);
+	TRACE_BEGIN("fits/load") ;
 
 	/* Loop on all planes */
     np=0 ;
@@ -245,8 +367,11 @@ cube_t * cube_load_strings(char ** filenames, int nfiles)
             if (qfits_loadpix(&ql[i])!=0) {
                 cube_del(loaded_cube);
                 free(ql);
+                TRACE_END("fits/load") ;
                 return NULL ;
             }
+            TRACE_COUNT(TRACE_BYTES_READ,
+                (double)ql[i].lx * ql[i].ly * BYTESPERPIXEL(ql[i].bitpix)) ;
             one_plane = malloc(sizeof(image_t));
             one_plane->lx = ql[i].lx ;
             one_plane->ly = ql[i].ly ;
@@ -261,6 +386,7 @@ cube_t * cube_load_strings(char ** filenames, int nfiles)
         }
     }
     free(ql);
+    TRACE_END("fits/load") ;
     return loaded_cube ;
 }
 
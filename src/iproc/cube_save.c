@@ -21,7 +21,9 @@
 
 #include <string.h>
 #include "cube_save.h"
+#include "cube_stream.h"
 #include "qfits.h"
+#include "trace.h"
 
 /*---------------------------------------------------------------------------
 							Static variables
@@ -29,6 +31,34 @@
 
 static int fits_bpp_save = BPP_DEFAULT ;
 
+/*---------------------------------------------------------------------------
+							Private functions
+ ---------------------------------------------------------------------------*/
+
+/* Stream an out-of-core cube to disk, one tile of lines at a time */
+static int cube_save_tiled(cube_ostream * s, cube_t * to_save)
+{
+	pixelvalue	*	rows ;
+	int				p, y0, ny, th ;
+
+	th = cube_tiles_rows(to_save) ;
+	rows = malloc((size_t)th * to_save->lx * sizeof(pixelvalue)) ;
+	for (p=0 ; p<to_save->np ; p++) {
+		if (to_save->np>1)
+			compute_status("converting plane", p, to_save->np, 3) ;
+		for (y0=0 ; y0<to_save->ly ; y0+=th) {
+			ny = to_save->ly - y0 < th ? to_save->ly - y0 : th ;
+			if (cube_tiles_read(to_save, p, y0, ny, rows)!=0 ||
+				cube_ostream_put_rows(s, rows, ny)!=0) {
+				free(rows) ;
+				return -1 ;
+			}
+		}
+	}
+	free(rows) ;
+	return 0 ;
+}
+
 /*---------------------------------------------------------------------------
   							Function codes
  ---------------------------------------------------------------------------*/
@@ -67,6 +97,18 @@ int cube_set_fits_bpp(int bpp)
 }
 
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Get default pixel depth used for cube writes.
+  @return	int current default FITS pixel depth.
+ */
+/*--------------------------------------------------------------------------*/
+int cube_get_fits_bpp(void)
+{
+	return fits_bpp_save ;
+}
+
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief	Save a cube to disk in FITS format.
@@ -89,47 +131,13 @@ int cube_set_fits_bpp(int bpp)
 int cube_save_fits_wh(cube_t * to_save, char * filename, history * hs)
 {
 	qfits_header*	fh ;
-	FILE		*	out ;
-	char			cval[80];
-    int				i ;
-	char		*	md5hash ;
-	char			md5card[81];
+	int				status ;
 
 	/* Sanity checks */
     if ((to_save == NULL) || (filename==NULL)) return -1 ;
-    if ((to_save->lx > MAX_COLUMN_NUMBER) ||
-        (to_save->lx < 1) ||
-        (to_save->ly > MAX_LINE_NUMBER) ||
-        (to_save->ly < 1) ||
-        (to_save->np > MAX_IMAGE_NUMBER) ||
-        (to_save->np < 1)) {
-        e_error("invalid cube size [%dx%dx%d]: cannot save",
-				to_save->lx,
-				to_save->ly,
-				to_save->np);
-        return -1 ;
-    }
 
 	/* Make a default FITS header for this cube */
 	fh = qfits_header_default();
-	/* BITPIX */
-	sprintf(cval, "%d", fits_bpp_save);
-	qfits_header_add(fh, "BITPIX", cval, "Bits per pixel", NULL);
-	/* NAXIS */
-	if (to_save->np > 1) {
-		qfits_header_add(fh, "NAXIS", "3", "File dimension", NULL);
-	} else {
-		qfits_header_add(fh, "NAXIS", "2", "File dimension", NULL);
-	}
-	/* NAXIS1 NAXIS2 (NAXIS3) */
-	sprintf(cval, "%d", to_save->lx);
-	qfits_header_add(fh, "NAXIS1", cval, "Size in x", NULL);
-	sprintf(cval, "%d", to_save->ly);
-	qfits_header_add(fh, "NAXIS2", cval, "Size in y", NULL);
-	if (to_save->np>1) {
-		sprintf(cval, "%d", to_save->np);
-		qfits_header_add(fh, "NAXIS3", cval, "Number of planes", NULL);
-	}
     /* 
      * Adding BSCALE and BZERO keywords for Workcid compatibility
      * eclipse works internally without scaling and offset, so the
@@ -141,55 +149,13 @@ int cube_save_fits_wh(cube_t * to_save, char * filename, history * hs)
 	qfits_header_add(fh, "ECLIPSE", "1", "created by eclipse", NULL);
 	qfits_header_add(fh, "ORIGIN", "eclipse", "created by eclipse", NULL);
 
-	/* Add data MD5 signature placeholder*/
-	qfits_header_add(fh, "DATAMD5", "'0'",  "MD5 checksum", NULL);
-
     /* Write the history object into header */
 	if (hs!=NULL)
 		history_addfits(hs, fh);
 
-    /* Ouput header to file */
-	if (!strcmp(filename, "STDOUT")) {
-		out = stdout ;
-	} else {
-		out = fopen(filename, "w");
-	}
-	if (out==NULL) {
-		e_error("writing to file [%s]", filename);
-		qfits_header_destroy(fh);
-		return -1 ;
-	}
-	qfits_header_dump(fh, out);
-	if (out!=stdout)
-		fclose(out);
+	status = cube_save_fits_hdrdump(to_save, filename, fh);
 	qfits_header_destroy(fh);
-
-    /* Convert planes one by one and copy them into Fits structure  */
-    for (i=0 ; i<to_save->np ; i++) {
-		if (to_save->np>1)
-			compute_status("converting plane", i, to_save->np, 3) ;
-        if (cube_fits_appendimage( filename,
-											to_save->plane[i],
-											fits_bpp_save)!=0){
-            e_error("cannot append plane %d to file [%s]: aborting save",
-					i+1, filename) ;
-            return -1 ;
-        }
-    }
-	/* Zero-pad the FITS file */
-    qfits_zeropad(filename) ; 
-
-	/* Add MD5 signature (not for STDOUT) */
-	if (strcmp(filename, "STDOUT")) {
-		md5hash = qfits_datamd5(filename);
-		if (md5hash==NULL) {
-			e_error("computing MD5 signature for output file %s", filename);
-			return -1 ;
-		}
-		sprintf(md5card, "DATAMD5 = '%s' / MD5 checksum", md5hash);
-		qfits_replace_card(filename, "DATAMD5", md5card);
-	}
-	return 0 ;
+	return status ;
 }
 
 
@@ -232,10 +198,14 @@ int cube_save_fits(cube_t * to_save, char * filename)
   If the given file name is 'STDOUT' (without quotes), data will be
   dumped on the process standard out stream.
 
-  The provided FITS header will be dumped into the output file, after
-  having been modified to reflect the cube properties: NAXIS, BITPIX,
-  NAXIS1, NAXIS2 and NAXIS3 (if it exists) will have the values
+  A copy of the provided FITS header will be dumped into the output file,
+  after having been modified to reflect the cube properties: NAXIS,
+  BITPIX, NAXIS1, NAXIS2 and NAXIS3 (if it exists) will have the values
   corresponding the cube size.
+
+  Planes are written through a cube_ostream (see cube_stream.h), so that
+  pixel conversion overlaps with disk output. Out-of-core cubes (see
+  cube_tiles.h) are streamed one tile at a time.
  */
 /*--------------------------------------------------------------------------*/
 int cube_save_fits_hdrdump(  
@@ -243,22 +213,13 @@ int cube_save_fits_hdrdump(
 		char			*	filename,
 		qfits_header	*	fh)
 {
-    int			i ;
-	FILE	*	out ;
-	char		cval[80];
-	int			use_default_hdr ;
-	char	*	md5hash ;
-	char		md5card[81];
-
-    
+	cube_ostream	*	s ;
+    int					i ;
+	int					status ;
+
     /* Error handling : test entry  */
     if (to_save==NULL || filename==NULL) return -1 ;
-    if ((to_save->lx > MAX_COLUMN_NUMBER) ||
-        (to_save->lx < 1) ||
-        (to_save->ly > MAX_LINE_NUMBER) ||
-        (to_save->ly < 1) ||
-        (to_save->np > MAX_IMAGE_NUMBER) ||
-        (to_save->np < 1)) {
+    if (to_save->np < 1) {
         e_error("invalid cube size [%dx%dx%d]: cannot save",
 				to_save->lx,
 				to_save->ly,
@@ -266,87 +227,41 @@ int cube_save_fits_hdrdump(
         return -1 ;
     }
 
-	if (fh==NULL) {
-		fh = qfits_header_default();
-		use_default_hdr=1 ;
-	} else {
-		use_default_hdr=0 ;
-	}
-
-	/* Modify main entries to reflect this cube */
-	/* BITPIX */
-	qfits_header_del(fh, "BITPIX");
-	sprintf(cval, "%d", fits_bpp_save);
-	qfits_header_add(fh, "BITPIX", cval, "bits per pixel", NULL);
-
-	/* NAXIS, NAXIS1, NAXIS2, NAXIS3 */
-	qfits_header_del(fh, "NAXIS");
-	qfits_header_del(fh, "NAXIS1");
-	qfits_header_del(fh, "NAXIS2");
-	qfits_header_del(fh, "NAXIS3");
-	qfits_header_del(fh, "DATAMD5");
-
-	if (to_save->np > 1) {
-		qfits_header_add_after(fh, "BITPIX", "NAXIS", "3", "data cube", NULL);
-		sprintf(cval, "%d", to_save->lx);
-		qfits_header_add_after(fh, "NAXIS",  "NAXIS1", cval, "x size", NULL);
-		sprintf(cval, "%d", to_save->ly);
-		qfits_header_add_after(fh, "NAXIS1", "NAXIS2", cval, "y size", NULL);
-		sprintf(cval, "%d", to_save->np);
-		qfits_header_add_after(fh, "NAXIS2", "NAXIS3", cval, "z size", NULL);
-	} else {
-		qfits_header_add_after(fh, "BITPIX","NAXIS","2","single image",NULL);
-		sprintf(cval, "%d", to_save->lx);
-		qfits_header_add_after(fh, "NAXIS",  "NAXIS1", cval, "x size", NULL);
-		sprintf(cval, "%d", to_save->ly);
-		qfits_header_add_after(fh, "NAXIS1", "NAXIS2", cval, "y size", NULL);
-	}
-
-	qfits_header_mod(fh, "BSCALE", "1.0", "pixel scale factor");
-	qfits_header_mod(fh, "BZERO",  "0.0", "pixel value offset");
-
-	/* Add data MD5 signature placeholder*/
-	qfits_header_add(fh, "DATAMD5", "'0'",  "MD5 checksum", NULL);
-
-	if (!strcmp(filename, "STDOUT")) {
-		out = stdout;
-	} else {
-		out = fopen(filename, "w");
-	}
-	if (out==NULL) {
-		e_error("writing to file [%s]", filename);
+	TRACE_BEGIN("fits/save") ;
+	s = cube_ostream_open(filename, fh, to_save->lx, to_save->ly,
+						  to_save->np, fits_bpp_save);
+	if (s==NULL) {
+		TRACE_END("fits/save") ;
 		return -1 ;
 	}
-	qfits_header_dump(fh, out);
-	if (out!=stdout)
-		fclose(out);
 
-	if (use_default_hdr) {
-		qfits_header_destroy(fh);
+	if (to_save->tiles!=NULL) {
+		status = cube_save_tiled(s, to_save) ;
+		if (status!=0) {
+            e_error("cannot save out-of-core cube to file [%s]", filename) ;
+			cube_ostream_close(s);
+		} else {
+			status = cube_ostream_close(s) ;
+		}
+		TRACE_END("fits/save") ;
+		return status ;
 	}
 
-    /* Convert planes one by one and copy them into Fits structure  */
+    /* Stream planes one by one: conversion overlaps with writing */
     for (i=0 ; i<to_save->np ; i++) {
 		if (to_save->np>1)
 			compute_status("converting plane", i, to_save->np, 3) ;
-        if (cube_fits_appendimage( filename,
-											to_save->plane[i],
-											fits_bpp_save)!=0){
+        if (cube_ostream_put_plane(s, to_save->plane[i])!=0) {
             e_error("cannot append plane %d to file [%s]: aborting save",
 					i+1, filename) ;
+			cube_ostream_close(s);
+			TRACE_END("fits/save") ;
             return -1 ;
         }
     }
-    qfits_zeropad(filename) ; 
-	/* Add MD5 signature */
-	md5hash = qfits_datamd5(filename);
-	if (md5hash==NULL) {
-		e_error("computing MD5 signature for output file %s", filename);
-		return -1 ;
-	}
-	sprintf(md5card, "DATAMD5 = '%s' / MD5 checksum", md5hash);
-	qfits_replace_card(filename, "DATAMD5", md5card);
-	return 0 ;
+	status = cube_ostream_close(s) ;
+	TRACE_END("fits/save") ;
+	return status ;
 }
 
 
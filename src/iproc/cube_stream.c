@@ -0,0 +1,653 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    cube_stream.c
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Streaming FITS output for cubes.
+
+   An output stream writes a FITS header once, then accepts pixels plane
+   by plane or by blocks of rows, as they are produced. Pixels are copied
+   into one of two buffers; full buffers are converted to the requested
+   BITPIX and written to disk by a background thread (if eclipse was
+   configured with --mt), while the caller fills the other buffer.
+
+   Output files named with a ".fz" suffix are written as Rice
+   tile-compressed images, one tile per row, in the layout produced by
+   fpack: an empty main header followed by a binary table extension.
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "cube_stream.h"
+#include "cube_save.h"
+#include "static_sz.h"
+#include "trace.h"
+
+#ifdef HAS_PTHREADS
+#include <pthread.h>
+#endif
+
+/*---------------------------------------------------------------------------
+   								Private types
+ ---------------------------------------------------------------------------*/
+
+struct _cube_ostream_ {
+	/* Output file */
+	char			filename[FILENAMESZ] ;
+	FILE		*	out ;
+	/* Declared size, np is 0 if unknown */
+	int				lx, ly ;
+	int				np ;
+	int				bitpix ;
+	/* Rows received so far, data bytes written so far */
+	long			nrows ;
+	long			nbytes ;
+	/* Set by the writer if a write failed */
+	int				err ;
+	/* Tile compression: flag, tile sizes, tiles written, file offsets */
+	int				zcmp ;
+	int			*	ztile ;
+	int				nztiles ;
+	long			zdata ;
+	long			zpcount ;
+	/* Double buffer: rows per buffer, rows filled, full flags */
+	int				bufrows ;
+	pixelvalue	*	buf[2] ;
+	int				fill[2] ;
+	int				full[2] ;
+	/* Buffer currently filled by the caller */
+	int				cur ;
+#ifdef HAS_PTHREADS
+	/* Writer thread */
+	int				threaded ;
+	int				closing ;
+	pthread_t		tid ;
+	pthread_mutex_t	lock ;
+	pthread_cond_t	cond ;
+#endif
+} ;
+
+/*---------------------------------------------------------------------------
+   								Private functions
+ ---------------------------------------------------------------------------*/
+
+/* Convert a pixel to an integer, clipping like qfits_pixdump_*() */
+static int ostream_pixel_int(pixelvalue v, int bitpix)
+{
+	switch (bitpix) {
+		case BPP_8_UNSIGNED:
+		if (v>255.0) return 255 ;
+		if (v<0.0) return 0 ;
+		return (int)v ;
+
+		case BPP_16_SIGNED:
+		if (v>32767.0) return 32767 ;
+		if (v<-32768.0) return -32768 ;
+		return (int)(short)v ;
+
+		default:
+		if (v>2147483647.0) return 2147483647 ;
+		if (v<-2147483648.0) return (-2147483647-1) ;
+		return (int)v ;
+	}
+}
+
+/* Rice-compress the rows of buffer b and write them to the heap */
+static void ostream_write_zbuffer(cube_ostream * s, int b)
+{
+	unsigned char	*	zbuf ;
+	int				*	ibuf ;
+	pixelvalue		*	row ;
+	int					zsize, bytepix ;
+	int					i, j, n ;
+
+	bytepix = s->bitpix/8 ;
+	zsize = QFITS_RICE_MAXSIZE(s->lx, bytepix) ;
+	ibuf = malloc(s->lx * sizeof(int));
+	zbuf = malloc(zsize);
+	for (j=0 ; j<s->fill[b] && !s->err ; j++) {
+		row = s->buf[b] + (size_t)j * s->lx ;
+		for (i=0 ; i<s->lx ; i++) {
+			ibuf[i] = ostream_pixel_int(row[i], s->bitpix) ;
+		}
+		n = qfits_rice_compress(ibuf, s->lx, bytepix, QFITS_RICE_BLOCKSIZE,
+								zbuf, zsize);
+		if (n<0 || fwrite(zbuf, 1, n, s->out)!=(size_t)n) {
+			s->err = 1 ;
+			break ;
+		}
+		s->ztile[s->nztiles++] = n ;
+		s->nbytes += n ;
+	}
+	free(zbuf);
+	free(ibuf);
+	return ;
+}
+
+/* Write the tile descriptors and heap size of a compressed stream */
+static int ostream_write_ztable(cube_ostream * s)
+{
+	unsigned char	desc[8] ;
+	char			card[FITS_LINESZ+1] ;
+	long			offs ;
+	int				i ;
+
+	if (fseek(s->out, s->zdata, SEEK_SET)!=0) return -1 ;
+	offs = 0 ;
+	for (i=0 ; i<s->nztiles ; i++) {
+		/* 1PB descriptor: element count, heap offset, big-endian */
+		desc[0] = (unsigned char)((s->ztile[i] >> 24) & 0xff) ;
+		desc[1] = (unsigned char)((s->ztile[i] >> 16) & 0xff) ;
+		desc[2] = (unsigned char)((s->ztile[i] >> 8) & 0xff) ;
+		desc[3] = (unsigned char)(s->ztile[i] & 0xff) ;
+		desc[4] = (unsigned char)((offs >> 24) & 0xff) ;
+		desc[5] = (unsigned char)((offs >> 16) & 0xff) ;
+		desc[6] = (unsigned char)((offs >> 8) & 0xff) ;
+		desc[7] = (unsigned char)(offs & 0xff) ;
+		if (fwrite(desc, 1, 8, s->out)!=8) return -1 ;
+		offs += s->ztile[i] ;
+	}
+	/* Update heap size */
+	sprintf(card, "PCOUNT  = %20ld / heap size", offs);
+	memset(card+strlen(card), ' ', FITS_LINESZ-strlen(card));
+	if (fseek(s->out, s->zpcount, SEEK_SET)!=0) return -1 ;
+	if (fwrite(card, 1, FITS_LINESZ, s->out)!=FITS_LINESZ) return -1 ;
+	return 0 ;
+}
+
+/* Convert buffer b to the output pixel type and write it */
+static void ostream_write_buffer(cube_ostream * s, int b)
+{
+	byte	*	raw ;
+	int			npix ;
+	size_t		sz ;
+
+	npix = s->fill[b] * s->lx ;
+	if (npix<1 || s->err) return ;
+	if (s->zcmp) {
+		ostream_write_zbuffer(s, b);
+		return ;
+	}
+#ifdef DOUBLEPIX
+	raw = qfits_pixdump_double(s->buf[b], npix, s->bitpix);
+#else
+	raw = qfits_pixdump_float(s->buf[b], npix, s->bitpix);
+#endif
+	if (raw==NULL) {
+		s->err = 1 ;
+		return ;
+	}
+	sz = (size_t)npix * (size_t)(abs(s->bitpix)/8) ;
+	if (fwrite(raw, 1, sz, s->out)!=sz) {
+		s->err = 1 ;
+	}
+	s->nbytes += (long)sz ;
+	free(raw);
+	return ;
+}
+
+#ifdef HAS_PTHREADS
+static void * ostream_writer_main(void * p)
+{
+	cube_ostream	*	s ;
+	int					w ;
+
+	s = (cube_ostream*)p ;
+	w = 0 ;
+	pthread_mutex_lock(&s->lock);
+	while (1) {
+		while (!s->full[w] && !s->closing) {
+			pthread_cond_wait(&s->cond, &s->lock);
+		}
+		/* Buffers are handed out in turn: nothing left to write */
+		if (!s->full[w]) break ;
+		pthread_mutex_unlock(&s->lock);
+		ostream_write_buffer(s, w);
+		pthread_mutex_lock(&s->lock);
+		s->fill[w] = 0 ;
+		s->full[w] = 0 ;
+		pthread_cond_broadcast(&s->cond);
+		w = 1-w ;
+	}
+	pthread_mutex_unlock(&s->lock);
+	return NULL ;
+}
+#endif
+
+/* Hand the current buffer over to the writer, get an empty one */
+static void ostream_submit(cube_ostream * s)
+{
+	if (s->fill[s->cur]<1) return ;
+#ifdef HAS_PTHREADS
+	if (s->threaded) {
+		pthread_mutex_lock(&s->lock);
+		s->full[s->cur] = 1 ;
+		pthread_cond_broadcast(&s->cond);
+		s->cur = 1-s->cur ;
+		while (s->full[s->cur]) {
+			pthread_cond_wait(&s->cond, &s->lock);
+		}
+		pthread_mutex_unlock(&s->lock);
+		return ;
+	}
+#endif
+	ostream_write_buffer(s, s->cur);
+	s->fill[s->cur] = 0 ;
+	return ;
+}
+
+/* Modify a header to reflect the output size and pixel type */
+static void ostream_header_set(
+		qfits_header	*	fh,
+		int					lx,
+		int					ly,
+		int					np,
+		int					bitpix)
+{
+	char	cval[80];
+
+	qfits_header_del(fh, "BITPIX");
+	sprintf(cval, "%d", bitpix);
+	qfits_header_add(fh, "BITPIX", cval, "bits per pixel", NULL);
+
+	qfits_header_del(fh, "NAXIS");
+	qfits_header_del(fh, "NAXIS1");
+	qfits_header_del(fh, "NAXIS2");
+	qfits_header_del(fh, "NAXIS3");
+	qfits_header_del(fh, "DATAMD5");
+
+	if (np!=1) {
+		qfits_header_add_after(fh, "BITPIX", "NAXIS", "3", "data cube", NULL);
+		sprintf(cval, "%d", lx);
+		qfits_header_add_after(fh, "NAXIS",  "NAXIS1", cval, "x size", NULL);
+		sprintf(cval, "%d", ly);
+		qfits_header_add_after(fh, "NAXIS1", "NAXIS2", cval, "y size", NULL);
+		sprintf(cval, "%d", np);
+		qfits_header_add_after(fh, "NAXIS2", "NAXIS3", cval, "z size", NULL);
+	} else {
+		qfits_header_add_after(fh, "BITPIX","NAXIS","2","single image",NULL);
+		sprintf(cval, "%d", lx);
+		qfits_header_add_after(fh, "NAXIS",  "NAXIS1", cval, "x size", NULL);
+		sprintf(cval, "%d", ly);
+		qfits_header_add_after(fh, "NAXIS1", "NAXIS2", cval, "y size", NULL);
+	}
+
+	qfits_header_mod(fh, "BSCALE", "1.0", "pixel scale factor");
+	qfits_header_mod(fh, "BZERO",  "0.0", "pixel value offset");
+
+	/* Add data MD5 signature placeholder*/
+	qfits_header_add(fh, "DATAMD5", "'0'",  "MD5 checksum", NULL);
+	return ;
+}
+
+/*---------------------------------------------------------------------------
+  							Function codes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Open a FITS output stream.
+  @param    filename    Output file name, or "STDOUT".
+  @param    fh          FITS header to write, or NULL for a default one.
+  @param    lx          Plane size in x.
+  @param    ly          Plane size in y.
+  @param    np          Number of planes, 0 if not known in advance.
+  @param    bitpix      Output BITPIX, 0 for the current default.
+  @return   1 newly allocated cube_ostream, NULL in case of error.
+
+  The header is written immediately, after having been modified as in
+  cube_save_fits_hdrdump() to reflect the output size and pixel type.
+  The given header itself is not modified. If np is 0, the header is
+  written with NAXIS3 set to 0 and updated when the stream is closed;
+  this is not possible when writing to STDOUT.
+
+  The default BITPIX is the one set by cube_set_fits_bpp().
+
+  If the file name ends with ".fz", rows are Rice-compressed as they
+  arrive and the given header is written to the compressed image
+  extension. Compression needs an integer BITPIX and a known number of
+  planes: otherwise the file is written uncompressed.
+ */
+/*--------------------------------------------------------------------------*/
+cube_ostream * cube_ostream_open(
+		char			*	filename,
+		qfits_header	*	fh,
+		int					lx,
+		int					ly,
+		int					np,
+		int					bitpix)
+{
+	cube_ostream	*	s ;
+	qfits_header	*	hdr ;
+	qfits_header	*	zhdr ;
+	FILE			*	out ;
+	char			*	zero ;
+	long				zhdr_start ;
+	int					to_stdout ;
+	int					zcmp ;
+	int					i ;
+
+	if (filename==NULL) return NULL ;
+	if ((lx > MAX_COLUMN_NUMBER) ||
+		(lx < 1) ||
+		(ly > MAX_LINE_NUMBER) ||
+		(ly < 1) ||
+		(np > MAX_IMAGE_NUMBER) ||
+		(np < 0)) {
+		e_error("invalid cube size [%dx%dx%d]: cannot save", lx, ly, np);
+		return NULL ;
+	}
+	if (strlen(filename)>=FILENAMESZ) {
+		e_error("file name too long: [%s]", filename);
+		return NULL ;
+	}
+	if (bitpix==0) {
+		bitpix = cube_get_fits_bpp() ;
+	}
+	if ((bitpix!= BPP_8_UNSIGNED) &&
+		(bitpix!= BPP_16_SIGNED) &&
+		(bitpix!= BPP_32_SIGNED) &&
+		(bitpix!= BPP_IEEE_FLOAT) &&
+		(bitpix!= BPP_IEEE_DOUBLE)) {
+		e_error("invalid BITPIX requested: %d", bitpix);
+		return NULL ;
+	}
+	to_stdout = !strcmp(filename, "STDOUT") ;
+	if (to_stdout && np==0) {
+		e_error("cannot stream to STDOUT without knowing the cube size");
+		return NULL ;
+	}
+	zcmp = 0 ;
+	i = (int)strlen(filename) ;
+	if (i>3 && !strcmp(filename+i-3, ".fz")) {
+		if (bitpix<0 || np==0) {
+			e_warning("cannot compress [%s]: writing uncompressed", filename);
+		} else {
+			zcmp = 1 ;
+		}
+	}
+
+	/* Prepare and write header */
+	if (fh==NULL) {
+		hdr = qfits_header_default();
+	} else {
+		hdr = qfits_header_copy(fh);
+	}
+	if (hdr==NULL) {
+		e_error("cannot create output header for [%s]", filename);
+		return NULL ;
+	}
+	if (zcmp) {
+		/* Empty main header, user cards go to the compressed image */
+		qfits_header_mod(hdr, "BSCALE", "1.0", "pixel scale factor");
+		qfits_header_mod(hdr, "BZERO",  "0.0", "pixel value offset");
+		zhdr = qfits_zimage_header(hdr, lx, ly, np, bitpix);
+		qfits_header_destroy(hdr);
+		hdr = qfits_header_new();
+		qfits_header_append(hdr, "SIMPLE", "T", "Fits format", NULL);
+		qfits_header_append(hdr, "BITPIX", "8", "no data", NULL);
+		qfits_header_append(hdr, "NAXIS", "0", "no data", NULL);
+		qfits_header_append(hdr, "EXTEND", "T", "compressed image follows",
+							NULL);
+		qfits_header_append(hdr, "DATAMD5", "'0'", "MD5 checksum", NULL);
+		qfits_header_append(hdr, "END", NULL, NULL, NULL);
+	} else {
+		zhdr = NULL ;
+		ostream_header_set(hdr, lx, ly, np, bitpix);
+	}
+	if (to_stdout) {
+		out = stdout ;
+	} else {
+		out = fopen(filename, "w");
+	}
+	if (out==NULL) {
+		e_error("writing to file [%s]", filename);
+		qfits_header_destroy(hdr);
+		if (zhdr!=NULL) qfits_header_destroy(zhdr);
+		return NULL ;
+	}
+	qfits_header_dump(hdr, out);
+	if (to_stdout) {
+		/* qfits_header_dump() does not blank-pad headers sent to stdout */
+		for (i=hdr->n ; i%36 ; i++) {
+			fprintf(out, "%80s", "");
+		}
+	}
+	qfits_header_destroy(hdr);
+
+	/* Set up stream */
+	s = calloc(1, sizeof(cube_ostream));
+	strcpy(s->filename, filename);
+	if (zcmp) {
+		/* Extension header, then room for the tile descriptors */
+		zhdr_start = ftell(out) ;
+		qfits_header_dump(zhdr, out);
+		qfits_header_destroy(zhdr);
+		s->zcmp    = 1 ;
+		s->zdata   = ftell(out) ;
+		s->zpcount = zhdr_start + 5 * FITS_LINESZ ;
+		s->ztile   = malloc(ly * np * sizeof(int));
+		zero = calloc(ly * np, 8) ;
+		if (fwrite(zero, 8, ly * np, out)!=(size_t)(ly * np)) {
+			s->err = 1 ;
+		}
+		free(zero);
+		s->nbytes = 8 * (long)ly * np ;
+	}
+	s->out    = out ;
+	s->lx     = lx ;
+	s->ly     = ly ;
+	s->np     = np ;
+	s->bitpix = bitpix ;
+	s->bufrows = CUBE_OSTREAM_BUFSIZE / (lx * (int)sizeof(pixelvalue)) ;
+	if (s->bufrows<1) s->bufrows=1 ;
+	if (np>0 && s->bufrows > ly*np) s->bufrows = ly*np ;
+	s->buf[0] = malloc((size_t)s->bufrows * lx * sizeof(pixelvalue));
+	s->buf[1] = NULL ;
+	s->cur    = 0 ;
+#ifdef HAS_PTHREADS
+	/* Only overlap with a writer if there is more than one buffer-full */
+	s->threaded = (np==0 || ly*np > s->bufrows) ;
+	if (s->threaded) {
+		s->buf[1] = malloc((size_t)s->bufrows * lx * sizeof(pixelvalue));
+		pthread_mutex_init(&s->lock, NULL);
+		pthread_cond_init(&s->cond, NULL);
+		if (pthread_create(&s->tid, NULL, ostream_writer_main, s)!=0) {
+			e_warning("cannot start writer thread: writing synchronously");
+			pthread_mutex_destroy(&s->lock);
+			pthread_cond_destroy(&s->cond);
+			free(s->buf[1]);
+			s->buf[1] = NULL ;
+			s->threaded = 0 ;
+		}
+	}
+#endif
+	return s ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Append a plane to a FITS output stream.
+  @param    s   Output stream.
+  @param    im  Image to append.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The image must have the size declared when opening the stream. It is
+  copied: it can be modified or deallocated as soon as this function
+  returns.
+ */
+/*--------------------------------------------------------------------------*/
+int cube_ostream_put_plane(cube_ostream * s, image_t * im)
+{
+	if (s==NULL || im==NULL) return -1 ;
+	if (im->lx!=s->lx || im->ly!=s->ly) {
+		e_error("image size [%dx%d] does not match stream [%dx%d]",
+				im->lx, im->ly, s->lx, s->ly);
+		return -1 ;
+	}
+	return cube_ostream_put_rows(s, im->data, im->ly) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Append rows of pixels to a FITS output stream.
+  @param    s       Output stream.
+  @param    rows    Pixel buffer holding nrows rows of lx pixels.
+  @param    nrows   Number of rows to append.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Rows are appended in FITS order: all rows of the first plane, then
+  all rows of the next plane, etc. A block of rows may span several
+  planes. The buffer is copied before this function returns.
+ */
+/*--------------------------------------------------------------------------*/
+int cube_ostream_put_rows(cube_ostream * s, pixelvalue * rows, int nrows)
+{
+	int		n ;
+
+	if (s==NULL || rows==NULL || nrows<0) return -1 ;
+	if (s->err) return -1 ;
+	if (s->np>0 && s->nrows+nrows > (long)s->ly * s->np) {
+		e_error("too many rows for output stream [%s]", s->filename);
+		return -1 ;
+	}
+	while (nrows>0) {
+		n = s->bufrows - s->fill[s->cur] ;
+		if (n>nrows) n=nrows ;
+		memcpy(s->buf[s->cur] + (size_t)s->fill[s->cur] * s->lx,
+			   rows,
+			   (size_t)n * s->lx * sizeof(pixelvalue));
+		s->fill[s->cur] += n ;
+		s->nrows += n ;
+		rows  += (size_t)n * s->lx ;
+		nrows -= n ;
+		if (s->fill[s->cur]==s->bufrows) {
+			ostream_submit(s);
+		}
+	}
+	return s->err ? -1 : 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Close a FITS output stream.
+  @param    s   Output stream.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Waits until all pixels have been written, pads the file to a FITS
+  block size, updates NAXIS3 if the number of planes was not declared
+  and writes the DATAMD5 signature of the data. Returns -1 if any write
+  failed or if the number of rows received does not match the declared
+  size. The stream is deallocated in all cases.
+ */
+/*--------------------------------------------------------------------------*/
+int cube_ostream_close(cube_ostream * s)
+{
+	char	zero[FITS_BLOCK_SIZE] ;
+	char	card[81] ;
+	char *	md5hash ;
+	int		status ;
+	int		np ;
+	int		to_stdout ;
+
+	if (s==NULL) return -1 ;
+
+	/* Flush pending pixels and stop writer */
+	ostream_submit(s);
+#ifdef HAS_PTHREADS
+	if (s->threaded) {
+		pthread_mutex_lock(&s->lock);
+		s->closing = 1 ;
+		pthread_cond_broadcast(&s->cond);
+		pthread_mutex_unlock(&s->lock);
+		pthread_join(s->tid, NULL);
+		pthread_mutex_destroy(&s->lock);
+		pthread_cond_destroy(&s->cond);
+	}
+#endif
+	status = s->err ? -1 : 0 ;
+	if (status!=0) {
+		e_error("cannot write pixels to file [%s]", s->filename);
+	}
+
+	/* Fill in tile descriptors, then pad after the heap */
+	if (s->zcmp && status==0) {
+		if (ostream_write_ztable(s)!=0 || fseek(s->out, 0L, SEEK_END)!=0) {
+			e_error("cannot write tile table to file [%s]", s->filename);
+			status = -1 ;
+		}
+	}
+	TRACE_COUNT(TRACE_BYTES_WRITTEN, s->nbytes) ;
+	/* Zero-pad the data section */
+	if (s->nbytes % FITS_BLOCK_SIZE) {
+		memset(zero, 0, FITS_BLOCK_SIZE);
+		if (fwrite(zero, 1, FITS_BLOCK_SIZE - s->nbytes % FITS_BLOCK_SIZE,
+				   s->out) != (size_t)(FITS_BLOCK_SIZE-s->nbytes%FITS_BLOCK_SIZE)) {
+			status = -1 ;
+		}
+	}
+	to_stdout = (s->out==stdout) ;
+	if (to_stdout) {
+		fflush(stdout);
+	} else if (fclose(s->out)!=0) {
+		e_error("closing file [%s]", s->filename);
+		status = -1 ;
+	}
+
+	/* Check the number of rows received */
+	if (s->np>0) {
+		np = s->np ;
+		if (s->nrows != (long)s->ly * s->np) {
+			e_error("stream [%s]: got %ld rows, expected %ld",
+					s->filename, s->nrows, (long)s->ly * s->np);
+			status = -1 ;
+		}
+	} else {
+		np = (int)(s->nrows / s->ly) ;
+		if (s->nrows % s->ly) {
+			e_error("stream [%s]: incomplete last plane", s->filename);
+			status = -1 ;
+		}
+	}
+
+	if (!to_stdout && status==0) {
+		/* Update number of planes */
+		if (s->np==0) {
+			sprintf(card, "NAXIS3  = %20d / z size", np);
+			if (qfits_replace_card(s->filename, "NAXIS3", card)!=0) {
+				e_error("updating NAXIS3 in file [%s]", s->filename);
+				status = -1 ;
+			}
+		}
+		/* Add MD5 signature */
+		md5hash = qfits_datamd5(s->filename);
+		if (md5hash==NULL) {
+			e_error("computing MD5 signature for output file %s",
+					s->filename);
+			status = -1 ;
+		} else {
+			sprintf(card, "DATAMD5 = '%s' / MD5 checksum", md5hash);
+			qfits_replace_card(s->filename, "DATAMD5", card);
+		}
+	}
+
+	free(s->buf[0]);
+	if (s->buf[1]!=NULL) free(s->buf[1]);
+	if (s->ztile!=NULL) free(s->ztile);
+	free(s);
+	return status ;
+}
+/* vim: set ts=4 et sw=4 tw=75 */
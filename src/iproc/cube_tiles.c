@@ -0,0 +1,638 @@
+/*----------------------------------------------------------------------------*/
+/**
+   @file    cube_tiles.c
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Out-of-core cubes paged in by tiles within a memory budget
+*/
+/*----------------------------------------------------------------------------*/
+
+/*
+    $Id$
+    $Author$
+    $Date$
+    $Revision$
+*/
+
+/*-----------------------------------------------------------------------------
+                                Includes
+ -----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "qfits.h"
+#include "cube_handling.h"
+#include "cube_tiles.h"
+#include "parallel.h"
+#include "trace.h"
+
+#ifdef HAS_PTHREADS
+#include <pthread.h>
+#endif
+
+/*-----------------------------------------------------------------------------
+                                Defines
+ -----------------------------------------------------------------------------*/
+
+/* Number of tiles announced ahead of a sequential access */
+#define TILES_PREFETCH  4
+
+#ifdef HAS_PTHREADS
+#define tiles_lock(t)       pthread_mutex_lock(&((t)->lock))
+#define tiles_unlock(t)     pthread_mutex_unlock(&((t)->lock))
+#else
+#define tiles_lock(t)
+#define tiles_unlock(t)
+#endif
+
+/*-----------------------------------------------------------------------------
+                                Private types
+ -----------------------------------------------------------------------------*/
+
+/* Where the pixels of a plane are stored */
+typedef struct _tile_src_ {
+    int             file ;      /* index in the file list, -1 for scratch */
+    long            offset ;    /* position of the plane in the file */
+    int             bitpix ;
+    double          bscale ;
+    double          bzero ;
+} tile_src ;
+
+/* One tile in the cache */
+typedef struct _tile_slot_ {
+    int             key ;       /* p * nt + tile index, -1 if free */
+    unsigned long   used ;      /* cache clock at last access */
+    pixelvalue  *   data ;
+} tile_slot ;
+
+struct _cube_tiles_ {
+    int             lx, ly, np ;
+    int             th ;        /* lines per tile */
+    int             nt ;        /* tiles per plane */
+    char        **  files ;
+    int             nfiles ;
+    tile_src    *   src ;       /* one per plane */
+    FILE        *   in ;        /* last opened source file */
+    int             in_file ;
+    FILE        *   scratch ;   /* replaced planes, native pixels */
+    long            scratch_end ;
+    tile_slot   *   slot ;
+    int             nslots ;
+    int             maxslots ;
+    int         *   where ;     /* slot of each tile, -1 if not cached */
+    unsigned long   clock ;
+    int             last_miss ;
+    byte        *   raw ;       /* raw FITS pixels of one tile */
+#ifdef HAS_PTHREADS
+    pthread_mutex_t lock ;
+#endif
+} ;
+
+/*-----------------------------------------------------------------------------
+                                Static variables
+ -----------------------------------------------------------------------------*/
+
+/* Memory budget in bytes, 0 for none */
+static double   cube_membudget = 0.0 ;
+/* Set if the running program can handle out-of-core cubes */
+static int      cube_tiles_allowed = 0 ;
+
+/*-----------------------------------------------------------------------------
+                                Private functions
+ -----------------------------------------------------------------------------*/
+
+static FILE * tile_open(cube_tiles *, int) ;
+static int tile_load(cube_tiles *, int, tile_slot *) ;
+static tile_slot * tile_get(cube_tiles *, int) ;
+static void tile_prefetch(cube_tiles *, int) ;
+
+/*-----------------------------------------------------------------------------
+                                Function codes
+ -----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Set the memory budget for loaded cubes.
+  @param    mbytes  Budget in megabytes, 0 or less for no budget.
+  @return   void
+
+  This setting is also read from the environment variable @c E_CUBEMEM
+  by eclipse_init(). There is no budget by default.
+ */
+/*----------------------------------------------------------------------------*/
+void cube_set_membudget(double mbytes)
+{
+    cube_membudget = mbytes>0 ? mbytes * 1024.0 * 1024.0 : 0.0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get the memory budget for loaded cubes.
+  @return   The budget in megabytes, 0 if there is none.
+ */
+/*----------------------------------------------------------------------------*/
+double cube_get_membudget(void)
+{
+    return cube_membudget / (1024.0 * 1024.0) ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Allow the cube loaders to return out-of-core cubes.
+  @param    flag    1 to allow, 0 to forbid.
+  @return   void
+
+  Out-of-core cubes have no planes in memory: a program may only allow
+  them if it accesses its cubes through the functions which support
+  them (see cube_tiles.h).
+ */
+/*----------------------------------------------------------------------------*/
+void cube_tiles_enable(int flag)
+{
+    cube_tiles_allowed = flag ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Find out if a cube of given size should be loaded by tiles.
+  @param    lx      Plane size in x.
+  @param    ly      Plane size in y.
+  @param    np      Number of planes.
+  @return   1 if out-of-core cubes are allowed and the cube exceeds the
+            memory budget, 0 otherwise.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_tiles_wanted(int lx, int ly, int np)
+{
+    if (!cube_tiles_allowed || cube_membudget<=0.0) return 0 ;
+    return (double)lx * ly * np * sizeof(pixelvalue) > cube_membudget ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Open a list of FITS files as an out-of-core cube.
+  @param    filenames   Names of the FITS files.
+  @param    nfiles      Number of files.
+  @return   1 newly allocated cube, NULL in case of error.
+
+  The files may hold single images or cubes, which must all have the
+  same plane size. Their planes are stacked in order as in
+  cube_load_strings(). Tile-compressed files are not supported.
+
+  The returned cube has no planes in memory. Its tiles are as high as
+  possible for a band of lines across all planes to fit in a quarter
+  of the memory budget, and the tile cache holds at most half of it.
+  The cube must be deallocated using cube_del().
+ */
+/*----------------------------------------------------------------------------*/
+cube_t * cube_load_tiled(char ** filenames, int nfiles)
+{
+    cube_tiles  *   t ;
+    cube_t      *   c ;
+    qfitsloader     ql ;
+    double          budget, rowsz ;
+    long            plsz ;
+    int             i, p ;
+
+    if (filenames==NULL || nfiles<1) return NULL ;
+
+    /* Locate all planes in the input files */
+    t = calloc(1, sizeof(cube_tiles)) ;
+    t->files = calloc(nfiles, sizeof(char*)) ;
+    t->in_file = -1 ;
+    t->last_miss = -1 ;
+#ifdef HAS_PTHREADS
+    pthread_mutex_init(&(t->lock), NULL) ;
+#endif
+    for (i=0 ; i<nfiles ; i++) {
+        t->files[i] = strdup(filenames[i]) ;
+        t->nfiles++ ;
+        ql.filename = filenames[i] ;
+        ql.xtnum    = 0 ;
+        ql.pnum     = 0 ;
+        ql.map      = 0 ;
+        ql.ptype    = PTYPE_FLOAT ;
+        if (qfitsloader_init(&ql)!=0) {
+            e_error("cannot read pixels from file %s", filenames[i]) ;
+            cube_tiles_del(t) ;
+            return NULL ;
+        }
+        if (ql.zxtnum>0) {
+            e_error("cannot load compressed file %s by tiles", filenames[i]);
+            cube_tiles_del(t) ;
+            return NULL ;
+        }
+        if (i==0) {
+            t->lx = ql.lx ;
+            t->ly = ql.ly ;
+        } else if (ql.lx!=t->lx || ql.ly!=t->ly) {
+            e_error("incompatible plane sizes in list") ;
+            cube_tiles_del(t) ;
+            return NULL ;
+        }
+        t->src = realloc(t->src, (t->np + ql.np) * sizeof(tile_src)) ;
+        plsz = (long)ql.lx * ql.ly * BYTESPERPIXEL(ql.bitpix) ;
+        for (p=0 ; p<ql.np ; p++) {
+            t->src[t->np+p].file   = i ;
+            t->src[t->np+p].offset = (long)ql.seg_start + p * plsz ;
+            t->src[t->np+p].bitpix = ql.bitpix ;
+            t->src[t->np+p].bscale = ql.bscale ;
+            t->src[t->np+p].bzero  = ql.bzero ;
+        }
+        t->np += ql.np ;
+    }
+
+    /* Size the tiles and the cache from the budget */
+    rowsz = (double)t->lx * sizeof(pixelvalue) ;
+    budget = cube_membudget ;
+    if (budget<=0.0) budget = rowsz * t->ly * t->np ;
+    t->th = (int)(budget / (4.0 * rowsz * t->np)) ;
+    if (t->th<1) {
+        e_warning("memory budget too small for a line of %d planes", t->np);
+        t->th = 1 ;
+    }
+    if (t->th>t->ly) t->th = t->ly ;
+    t->nt = (t->ly + t->th - 1) / t->th ;
+    t->maxslots = (int)(budget / (2.0 * rowsz * t->th)) ;
+    if (t->maxslots<2) t->maxslots = 2 ;
+    if (t->maxslots>t->np * t->nt) t->maxslots = t->np * t->nt ;
+    t->slot  = malloc(t->maxslots * sizeof(tile_slot)) ;
+    t->where = malloc(t->np * t->nt * sizeof(int)) ;
+    for (i=0 ; i<t->np * t->nt ; i++) t->where[i] = -1 ;
+    t->raw = malloc((size_t)t->th * t->lx * 8) ;
+
+    c = cube_new(t->lx, t->ly, t->np) ;
+    if (c==NULL) {
+        cube_tiles_del(t) ;
+        return NULL ;
+    }
+    c->tiles = t ;
+    e_comment(1, "paging %d planes in by tiles of %d lines",
+              t->np, t->th) ;
+    return c ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate the out-of-core storage of a cube.
+  @param    t   Out-of-core storage.
+  @return   void
+
+  Called by cube_del(), do not call it directly.
+ */
+/*----------------------------------------------------------------------------*/
+void cube_tiles_del(cube_tiles * t)
+{
+    int     i ;
+
+    if (t==NULL) return ;
+    if (t->in!=NULL) fclose(t->in) ;
+    if (t->scratch!=NULL) fclose(t->scratch) ;
+    for (i=0 ; i<t->nfiles ; i++) free(t->files[i]) ;
+    free(t->files) ;
+    for (i=0 ; i<t->nslots ; i++) free(t->slot[i].data) ;
+    if (t->slot!=NULL) free(t->slot) ;
+    if (t->where!=NULL) free(t->where) ;
+    if (t->src!=NULL) free(t->src) ;
+    if (t->raw!=NULL) free(t->raw) ;
+#ifdef HAS_PTHREADS
+    pthread_mutex_destroy(&(t->lock)) ;
+#endif
+    free(t) ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get the height of the tiles of an out-of-core cube.
+  @param    c   Out-of-core cube.
+  @return   The number of lines per tile, -1 if the cube is in memory.
+
+  Bands of lines across all planes are best accessed by multiples of
+  this height, aligned on it.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_tiles_rows(cube_t * c)
+{
+    if (c==NULL || c->tiles==NULL) return -1 ;
+    return c->tiles->th ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Read lines of a plane of an out-of-core cube.
+  @param    c       Out-of-core cube.
+  @param    p       Plane index, from 0.
+  @param    y0      First line to read, from 0.
+  @param    ny      Number of lines to read.
+  @param    dst     Buffer receiving ny*lx pixels.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The lines are copied from the tile cache, loading the missing tiles
+  from disk. When the tiles are requested in sequence, along a plane or
+  across planes, the next ones are announced to the system so that
+  they are read ahead. This function may be called from parallel tasks.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_tiles_read(cube_t * c, int p, int y0, int ny, pixelvalue * dst)
+{
+    cube_tiles  *   t ;
+    tile_slot   *   s ;
+    int             tt, off, n ;
+
+    if (c==NULL || c->tiles==NULL || dst==NULL) return -1 ;
+    t = c->tiles ;
+    if (p<0 || p>=t->np || y0<0 || ny<1 || y0+ny>t->ly) return -1 ;
+
+    tiles_lock(t) ;
+    while (ny>0) {
+        tt  = y0 / t->th ;
+        off = y0 - tt * t->th ;
+        n   = t->th - off ;
+        if (n>ny) n = ny ;
+        s = tile_get(t, p * t->nt + tt) ;
+        if (s==NULL) {
+            tiles_unlock(t) ;
+            return -1 ;
+        }
+        memcpy(dst, s->data + off * t->lx, n * t->lx * sizeof(pixelvalue)) ;
+        dst += n * t->lx ;
+        y0  += n ;
+        ny  -= n ;
+    }
+    tiles_unlock(t) ;
+    return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get a copy of a plane of an out-of-core cube.
+  @param    c   Out-of-core cube.
+  @param    p   Plane index, from 0.
+  @return   1 newly allocated image, NULL in case of error.
+ */
+/*----------------------------------------------------------------------------*/
+image_t * cube_tiles_getplane(cube_t * c, int p)
+{
+    image_t     *   im ;
+
+    if (c==NULL || c->tiles==NULL) return NULL ;
+    im = image_new(c->lx, c->ly) ;
+    if (cube_tiles_read(c, p, 0, c->ly, im->data)!=0) {
+        e_error("reading plane %d of out-of-core cube", p+1) ;
+        image_del(im) ;
+        return NULL ;
+    }
+    return im ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Replace a plane of an out-of-core cube.
+  @param    c   Out-of-core cube.
+  @param    p   Plane index, from 0.
+  @param    im  New plane contents.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The image is written to a scratch file which is deleted with the
+  cube. It is not modified and still belongs to the caller.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_tiles_putplane(cube_t * c, int p, image_t * im)
+{
+    cube_tiles  *   t ;
+    tile_src    *   src ;
+    size_t          npix ;
+    int             tt, s ;
+
+    if (c==NULL || c->tiles==NULL || im==NULL) return -1 ;
+    t = c->tiles ;
+    if (p<0 || p>=t->np || im->lx!=t->lx || im->ly!=t->ly) return -1 ;
+
+    tiles_lock(t) ;
+    if (t->scratch==NULL) {
+        t->scratch = tmpfile() ;
+        if (t->scratch==NULL) {
+            tiles_unlock(t) ;
+            e_error("cannot create scratch file for out-of-core cube") ;
+            return -1 ;
+        }
+    }
+    /* A plane keeps its place in the scratch file once it has one */
+    src  = t->src + p ;
+    npix = (size_t)t->lx * t->ly ;
+    if (src->file>=0) {
+        src->file   = -1 ;
+        src->offset = t->scratch_end ;
+        t->scratch_end += (long)(npix * sizeof(pixelvalue)) ;
+    }
+    if (fseek(t->scratch, src->offset, SEEK_SET)!=0 ||
+        fwrite(im->data, sizeof(pixelvalue), npix, t->scratch)!=npix) {
+        tiles_unlock(t) ;
+        e_error("cannot write plane %d to scratch file", p+1) ;
+        return -1 ;
+    }
+
+    /* Drop the cached tiles of the former plane */
+    for (tt=0 ; tt<t->nt ; tt++) {
+        s = t->where[p * t->nt + tt] ;
+        if (s>=0) {
+            t->slot[s].key  = -1 ;
+            t->slot[s].used = 0 ;
+            t->where[p * t->nt + tt] = -1 ;
+        }
+    }
+    tiles_unlock(t) ;
+    return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get a band of lines of an out-of-core cube.
+  @param    c   Out-of-core cube.
+  @param    y0  First line of the band, from 0.
+  @param    ny  Number of lines in the band.
+  @return   1 newly allocated cube of lx x ny x np pixels, in memory.
+ */
+/*----------------------------------------------------------------------------*/
+cube_t * cube_tiles_getband(cube_t * c, int y0, int ny)
+{
+    cube_t      *   band ;
+    int             p ;
+
+    if (c==NULL || c->tiles==NULL) return NULL ;
+    band = cube_new(c->lx, ny, c->np) ;
+    if (band==NULL) return NULL ;
+    for (p=0 ; p<c->np ; p++) {
+        band->plane[p] = image_new(c->lx, ny) ;
+        if (cube_tiles_read(c, p, y0, ny, band->plane[p]->data)!=0) {
+            e_error("reading lines %d to %d of plane %d of out-of-core cube",
+                    y0+1, y0+ny, p+1) ;
+            cube_del(band) ;
+            return NULL ;
+        }
+    }
+    return band ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get the source file of a plane, opened for reading.
+  @param    t       Out-of-core storage.
+  @param    file    Index of the file in the list.
+  @return   The opened file, NULL if it cannot be opened.
+
+  The last opened file stays open for the next tiles.
+ */
+/*----------------------------------------------------------------------------*/
+static FILE * tile_open(cube_tiles * t, int file)
+{
+    if (t->in_file==file) return t->in ;
+    if (t->in!=NULL) fclose(t->in) ;
+    t->in = fopen(t->files[file], "r") ;
+    t->in_file = t->in==NULL ? -1 : file ;
+    return t->in ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Load a tile from its source.
+  @param    t       Out-of-core storage.
+  @param    key     Tile to load.
+  @param    s       Slot receiving the pixels.
+  @return   int 0 if Ok, -1 otherwise.
+ */
+/*----------------------------------------------------------------------------*/
+static int tile_load(cube_tiles * t, int key, tile_slot * s)
+{
+    tile_src    *   src ;
+    pixelvalue  *   pix ;
+    FILE        *   in ;
+    size_t          npix ;
+    int             y0, ny, bpp ;
+
+    src = t->src + key / t->nt ;
+    y0  = (key % t->nt) * t->th ;
+    ny  = t->ly - y0 < t->th ? t->ly - y0 : t->th ;
+    npix = (size_t)ny * t->lx ;
+
+    /* Replaced planes are stored as native pixels */
+    if (src->file<0) {
+        if (fseek(t->scratch, src->offset +
+                  (long)y0 * t->lx * sizeof(pixelvalue), SEEK_SET)!=0)
+            return -1 ;
+        if (fread(s->data, sizeof(pixelvalue), npix, t->scratch)!=npix)
+            return -1 ;
+        return 0 ;
+    }
+
+    in = tile_open(t, src->file) ;
+    if (in==NULL) return -1 ;
+    bpp = BYTESPERPIXEL(src->bitpix) ;
+    if (fseek(in, src->offset + (long)y0 * t->lx * bpp, SEEK_SET)!=0)
+        return -1 ;
+    if (fread(t->raw, bpp, npix, in)!=npix) return -1 ;
+    TRACE_COUNT(TRACE_BYTES_READ, (double)npix * bpp) ;
+#ifdef DOUBLEPIX
+    pix = (pixelvalue*)qfits_pixin_double(t->raw, (int)npix, src->bitpix,
+                                          src->bscale, src->bzero) ;
+#else
+    pix = (pixelvalue*)qfits_pixin_float(t->raw, (int)npix, src->bitpix,
+                                         src->bscale, src->bzero) ;
+#endif
+    if (pix==NULL) return -1 ;
+    memcpy(s->data, pix, npix * sizeof(pixelvalue)) ;
+    free(pix) ;
+    return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get a tile from the cache, loading it if needed.
+  @param    t       Out-of-core storage.
+  @param    key     Requested tile.
+  @return   The cache slot holding the tile, NULL in case of error.
+
+  A missing tile replaces the least recently used one once the cache is
+  full. Must be called with the storage locked.
+ */
+/*----------------------------------------------------------------------------*/
+static tile_slot * tile_get(cube_tiles * t, int key)
+{
+    int     s, i ;
+
+    s = t->where[key] ;
+    if (s>=0) {
+        t->slot[s].used = ++t->clock ;
+        return t->slot + s ;
+    }
+
+    if (t->nslots<t->maxslots) {
+        s = t->nslots++ ;
+        t->slot[s].data = malloc((size_t)t->th * t->lx * sizeof(pixelvalue));
+    } else {
+        s = 0 ;
+        for (i=1 ; i<t->nslots ; i++) {
+            if (t->slot[i].used<t->slot[s].used) s = i ;
+        }
+        if (t->slot[s].key>=0) t->where[t->slot[s].key] = -1 ;
+    }
+    t->slot[s].key  = -1 ;
+    t->slot[s].used = 0 ;
+    if (tile_load(t, key, t->slot + s)!=0) return NULL ;
+    t->slot[s].key  = key ;
+    t->slot[s].used = ++t->clock ;
+    t->where[key] = s ;
+
+    tile_prefetch(t, key) ;
+    t->last_miss = key ;
+    return t->slot + s ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Announce the next tiles of a sequential access.
+  @param    t       Out-of-core storage.
+  @param    key     Tile which has just been loaded.
+  @return   void
+
+  If the tile follows the previously loaded one along a plane or
+  across planes, the next tiles in the same direction are announced to
+  the system, which reads them ahead while the current one is used.
+ */
+/*----------------------------------------------------------------------------*/
+static void tile_prefetch(cube_tiles * t, int key)
+{
+#ifdef POSIX_FADV_WILLNEED
+    tile_src    *   src ;
+    int             step, next, k, fd ;
+    long            len ;
+
+    step = key - t->last_miss ;
+    if (t->last_miss<0 || (step!=1 && step!=t->nt)) return ;
+    for (k=1 ; k<=TILES_PREFETCH ; k++) {
+        next = key + k * step ;
+        if (next>=t->np * t->nt) break ;
+        if (t->where[next]>=0) continue ;
+        src = t->src + next / t->nt ;
+        if (src->file<0) continue ;
+        len = (long)t->th * t->lx * BYTESPERPIXEL(src->bitpix) ;
+        if (src->file==t->in_file) {
+            posix_fadvise(fileno(t->in), src->offset + (next % t->nt) * len,
+                          len, POSIX_FADV_WILLNEED) ;
+        } else {
+            fd = open(t->files[src->file], O_RDONLY) ;
+            if (fd<0) continue ;
+            posix_fadvise(fd, src->offset + (next % t->nt) * len, len,
+                          POSIX_FADV_WILLNEED) ;
+            close(fd) ;
+        }
+    }
+#endif
+    return ;
+}
+/* vim: set ts=4 et sw=4 tw=75 */
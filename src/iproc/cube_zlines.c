@@ -0,0 +1,349 @@
+/*----------------------------------------------------------------------------*/
+/**
+   @file    cube_zlines.c
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Z-major storage of cube time lines
+*/
+/*----------------------------------------------------------------------------*/
+
+/*
+    $Id$
+    $Author$
+    $Date$
+    $Revision$
+*/
+
+/*-----------------------------------------------------------------------------
+                                Includes
+ -----------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "cube_zlines.h"
+#include "image_handling.h"
+#include "comm.h"
+#include "xmemory.h"
+#include "parallel.h"
+
+/*-----------------------------------------------------------------------------
+                                Defines
+ -----------------------------------------------------------------------------*/
+
+/* Number of values in a tile of time lines */
+#define ZLINES_TILEVAL  262144
+
+/* Number of planes transposed together */
+#define ZLINES_BLOCK    16
+
+/*-----------------------------------------------------------------------------
+                                Private types
+ -----------------------------------------------------------------------------*/
+
+/* Shared state of the transposition tasks, one task per tile */
+typedef struct _zlines_job_ {
+    cube_zlines *   zl ;
+    cube_t      *   c ;
+} zlines_job ;
+
+/*-----------------------------------------------------------------------------
+                                Private functions
+ -----------------------------------------------------------------------------*/
+
+static void zlines_gather_task(void *, int, int) ;
+static void zlines_scatter_task(void *, int, int) ;
+
+/*-----------------------------------------------------------------------------
+                                Function codes
+ -----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get a good number of pixels to process time lines by chunks.
+  @param    np      Number of planes.
+  @return   Number of pixels whose time lines fill about one megabyte.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_zlines_chunk(int np)
+{
+    int     n ;
+
+    n = ZLINES_TILEVAL / (np>0 ? np : 1) ;
+    return n>0 ? n : 1 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Copy the time lines of a range of pixels to a buffer.
+  @param    c       Cube in plane layout.
+  @param    pos0    First pixel position.
+  @param    npix    Number of pixels.
+  @param    dst     Buffer receiving npix*np values.
+  @return   void
+
+  The np values of pixel pos0+i are stored in dst[i*np .. i*np+np-1].
+  Planes are read by blocks so that all accesses are sequential.
+ */
+/*----------------------------------------------------------------------------*/
+void cube_zlines_gather(cube_t * c, int pos0, int npix, pixelvalue * dst)
+{
+    pixelvalue  *   src[ZLINES_BLOCK] ;
+    pixelvalue  *   d ;
+    int             np, p0, nb ;
+    int             p, i ;
+
+    np = c->np ;
+    for (p0=0 ; p0<np ; p0+=ZLINES_BLOCK) {
+        nb = np - p0 < ZLINES_BLOCK ? np - p0 : ZLINES_BLOCK ;
+        for (p=0 ; p<nb ; p++) src[p] = c->plane[p0+p]->data + pos0 ;
+        d = dst + p0 ;
+        for (i=0 ; i<npix ; i++) {
+            for (p=0 ; p<nb ; p++) d[p] = src[p][i] ;
+            d += np ;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Copy time lines from a buffer back to a range of pixels.
+  @param    src     Buffer holding npix*np values, as cube_zlines_gather().
+  @param    pos0    First pixel position.
+  @param    npix    Number of pixels.
+  @param    c       Cube in plane layout, modified.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+void cube_zlines_scatter(pixelvalue * src, int pos0, int npix, cube_t * c)
+{
+    pixelvalue  *   dst[ZLINES_BLOCK] ;
+    pixelvalue  *   s ;
+    int             np, p0, nb ;
+    int             p, i ;
+
+    np = c->np ;
+    for (p0=0 ; p0<np ; p0+=ZLINES_BLOCK) {
+        nb = np - p0 < ZLINES_BLOCK ? np - p0 : ZLINES_BLOCK ;
+        for (p=0 ; p<nb ; p++) dst[p] = c->plane[p0+p]->data + pos0 ;
+        s = src + p0 ;
+        for (i=0 ; i<npix ; i++) {
+            for (p=0 ; p<nb ; p++) dst[p][i] = s[p] ;
+            s += np ;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Make a z-major copy of a range of pixels of a cube.
+  @param    c       Cube in plane layout.
+  @param    pos0    First pixel position.
+  @param    npix    Number of pixels.
+  @return   1 newly allocated cube_zlines object, NULL in case of error.
+
+  The pixels are cut into tiles of cube_zlines_chunk() pixels, which are
+  transposed in parallel. The returned object must be deallocated with
+  cube_zlines_del().
+ */
+/*----------------------------------------------------------------------------*/
+cube_zlines * cube_zlines_new(cube_t * c, int pos0, int npix)
+{
+    cube_zlines *   zl ;
+    zlines_job      job ;
+    int             p, t, n ;
+
+    if (c==NULL || npix<1 || pos0<0 || pos0+npix>c->lx * c->ly) return NULL ;
+    for (p=0 ; p<c->np ; p++) {
+        if (c->plane[p]==NULL) {
+            e_error("plane %d is not in memory: cannot get time lines", p+1);
+            return NULL ;
+        }
+    }
+
+    zl = malloc(sizeof(cube_zlines)) ;
+    zl->lx      = c->lx ;
+    zl->ly      = c->ly ;
+    zl->np      = c->np ;
+    zl->pos0    = pos0 ;
+    zl->npix    = npix ;
+    zl->tilepix = cube_zlines_chunk(c->np) ;
+    zl->ntiles  = (npix + zl->tilepix - 1) / zl->tilepix ;
+    zl->tile    = malloc(zl->ntiles * sizeof(pixelvalue*)) ;
+    for (t=0 ; t<zl->ntiles ; t++) {
+        n = npix - t * zl->tilepix ;
+        if (n>zl->tilepix) n = zl->tilepix ;
+        zl->tile[t] = malloc((size_t)n * c->np * sizeof(pixelvalue)) ;
+    }
+
+    job.zl = zl ;
+    job.c  = c ;
+    eclipse_parallel_run(zlines_gather_task, &job, zl->ntiles) ;
+    return zl ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Copy z-major time lines back to the planes of a cube.
+  @param    zl      Z-major time lines.
+  @param    c       Cube in plane layout, of the same size, modified.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Missing planes of the cube (e.g. right after cube_new()) are
+  allocated. Only the pixels held by zl are modified.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_zlines_put(cube_zlines * zl, cube_t * c)
+{
+    zlines_job      job ;
+    int             p ;
+
+    if (zl==NULL || c==NULL) return -1 ;
+    if (c->lx!=zl->lx || c->ly!=zl->ly || c->np!=zl->np) {
+        e_error("time lines do not match cube size") ;
+        return -1 ;
+    }
+    if (c->tiles!=NULL) {
+        e_error("cannot put time lines into an out-of-core cube") ;
+        return -1 ;
+    }
+    for (p=0 ; p<c->np ; p++) {
+        if (c->plane[p]==NULL) c->plane[p] = image_new(c->lx, c->ly) ;
+    }
+    job.zl = zl ;
+    job.c  = c ;
+    eclipse_parallel_run(zlines_scatter_task, &job, zl->ntiles) ;
+    return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate a cube_zlines object.
+  @param    zl      Object to deallocate.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+void cube_zlines_del(cube_zlines * zl)
+{
+    int     t ;
+
+    if (zl==NULL) return ;
+    for (t=0 ; t<zl->ntiles ; t++) free(zl->tile[t]) ;
+    free(zl->tile) ;
+    free(zl) ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Get the time line of a pixel.
+  @param    zl      Z-major time lines.
+  @param    pos     Pixel position, within the range held by zl.
+  @return   Pointer to the np values of the pixel, NULL if out of range.
+
+  The returned pointer belongs to zl: the values may be modified in
+  place, but the pointer must not be freed.
+ */
+/*----------------------------------------------------------------------------*/
+pixelvalue * cube_zlines_get(cube_zlines * zl, int pos)
+{
+    if (zl==NULL) return NULL ;
+    pos -= zl->pos0 ;
+    if (pos<0 || pos>=zl->npix) return NULL ;
+    return zl->tile[pos / zl->tilepix] + (size_t)(pos % zl->tilepix) * zl->np ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Start an iteration over all time lines of a cube_zlines.
+  @param    it      Iterator to initialize.
+  @param    zl      Z-major time lines.
+  @return   void
+
+  The iterator is positioned before the first pixel: call
+  cube_zlines_iter_next() to get to it.
+ */
+/*----------------------------------------------------------------------------*/
+void cube_zlines_iter_init(zline_iter * it, cube_zlines * zl)
+{
+    if (it==NULL) return ;
+    it->zl   = zl ;
+    it->pos  = zl==NULL ? 0 : zl->pos0 - 1 ;
+    it->line = NULL ;
+    it->left = 0 ;
+    it->t    = -1 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Move an iterator to the next time line.
+  @param    it      Iterator.
+  @return   1 if it now points to a time line, 0 at the end.
+
+  On success, it->pos holds the pixel position and it->line the np
+  values of its time line, in increasing pixel order.
+ */
+/*----------------------------------------------------------------------------*/
+int cube_zlines_iter_next(zline_iter * it)
+{
+    cube_zlines *   zl ;
+
+    if (it==NULL || it->zl==NULL) return 0 ;
+    zl = it->zl ;
+    if (it->left>0) {
+        it->line += zl->np ;
+        it->left-- ;
+        it->pos++ ;
+        return 1 ;
+    }
+    if (it->t+1>=zl->ntiles) return 0 ;
+    it->t++ ;
+    it->line = zl->tile[it->t] ;
+    it->left = zl->npix - it->t * zl->tilepix ;
+    if (it->left>zl->tilepix) it->left = zl->tilepix ;
+    it->left-- ;
+    it->pos++ ;
+    return 1 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Transpose one tile of pixels from the cube planes.
+  @param    arg     Transposition job.
+  @param    t       Tile index.
+  @param    worker  Unused.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+static void zlines_gather_task(void * arg, int t, int worker)
+{
+    zlines_job  *   job ;
+    int             pos, n ;
+
+    job = (zlines_job *)arg ;
+    pos = t * job->zl->tilepix ;
+    n   = job->zl->npix - pos ;
+    if (n>job->zl->tilepix) n = job->zl->tilepix ;
+    cube_zlines_gather(job->c, job->zl->pos0 + pos, n, job->zl->tile[t]) ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Transpose one tile of pixels back to the cube planes.
+  @param    arg     Transposition job.
+  @param    t       Tile index.
+  @param    worker  Unused.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+static void zlines_scatter_task(void * arg, int t, int worker)
+{
+    zlines_job  *   job ;
+    int             pos, n ;
+
+    job = (zlines_job *)arg ;
+    pos = t * job->zl->tilepix ;
+    n   = job->zl->npix - pos ;
+    if (n>job->zl->tilepix) n = job->zl->tilepix ;
+    cube_zlines_scatter(job->zl->tile[t], job->zl->pos0 + pos, n, job->c) ;
+}
+/* vim: set ts=4 et sw=4 tw=75 */
@@ -21,6 +21,7 @@
 
 #include "dead_pixels.h"
 #include "image_stats.h"
+#include "parallel.h"
 
 /*---------------------------------------------------------------------------
   								Defines
@@ -28,6 +29,29 @@
 
 #define MAX_DEVIATION               500
 
+/* Number of bad pixels replaced by one parallel task */
+#define DEADPIX_CHUNK				4096
+
+/*---------------------------------------------------------------------------
+  								Private types
+ ---------------------------------------------------------------------------*/
+
+struct _deadpix_index_ {
+	int				lx, ly ;
+	int				nbad ;		/* Number of bad pixels */
+	int			*	pos ;		/* Bad pixel positions */
+	int			*	first ;		/* First neighbor of each bad pixel, nbad+1 */
+	double		*	norm ;		/* Sum of the neighbor weights */
+	int			*	nbpos ;		/* Neighbor positions */
+	double		*	nbw ;		/* Neighbor weights */
+} ;
+
+typedef struct _deadpix_job_ {
+	deadpix_index	*	idx ;
+	image_t			**	planes ;
+	int					nchunks ;
+} deadpix_job ;
+
 /*---------------------------------------------------------------------------
  							Function codes
  ---------------------------------------------------------------------------*/
@@ -49,58 +73,20 @@
 /*--------------------------------------------------------------------------*/
 image_t * image_clean_deadpix(image_t * dirty, pixelmap * deadpixmap)
 {
-    image_t     *   cleaned ;
-    int             i, j, k, l ;
-    int             nx, ny ;
-    double          replace ;
-    int             pixelpos ;
-    int             good_neighbors ;
-
-    if (dirty==NULL || deadpixmap==NULL) return NULL ;
-    cleaned = image_new(dirty->lx, dirty->ly) ;
-
-    /* Replace bad pixels by interpolated value */
-    for (j=0 ; j < dirty->ly ; j++) {
-        for (i=0 ; i<dirty->lx ; i++) {
-            pixelpos = i + j*dirty->lx ;
-            if (deadpixmap->data[pixelpos] == PIXELMAP_1) {
-                cleaned->data[pixelpos] = dirty->data[pixelpos] ;
-            } else {
-                good_neighbors=0 ;
-                replace = 0 ;
-                for (l=-1 ; l<=1 ; l++) {
-                    ny = j+l ;
-                    for (k=-1 ; k<=1 ; k++) {
-                        nx = i+k ;
-                        /*
-                         * Check neighbor is inside image
-                         * and pixel is valid in pixelmap.
-                         */
-                        if ((nx>=0) &&
-                            (nx<dirty->lx) &&
-                            (ny>=0) &&
-                            (ny<dirty->ly) &&
-                            (deadpixmap->data[nx+ny*deadpixmap->lx]
-                             ==PIXELMAP_1)) {
-                            good_neighbors++ ;
-                            replace += (double)dirty->data[nx+ny*dirty->lx];
-                        }
-                    }
-                }
-                /* Take the mean value over neighbors   */
-                if (good_neighbors == 0) {
-                    cleaned->data[pixelpos] = (pixelvalue)0;
-                } else {
-                    cleaned->data[pixelpos] =
-                        (pixelvalue)(replace/(double)good_neighbors) ;
-                }
-            }
-        } /* end loop on row    */
-    } /* end loop on columns    */
-    return cleaned ;
-}
-
+	image_t			*	cleaned ;
+	deadpix_index	*	idx ;
 
+	if (dirty==NULL || deadpixmap==NULL) return NULL ;
+	if ((dirty->lx!=deadpixmap->lx) || (dirty->ly!=deadpixmap->ly)) {
+		e_error("image and pixel map have different sizes") ;
+		return NULL ;
+	}
+	if ((idx=deadpix_index_new(deadpixmap, 1, 1))==NULL) return NULL ;
+	cleaned = image_copy(dirty) ;
+	image_clean_deadpix_index(cleaned, idx) ;
+	deadpix_index_del(idx) ;
+	return cleaned ;
+}
 
 
 /*-------------------------------------------------------------------------*/
@@ -119,19 +105,250 @@ int cube_clean_deadpix(
 		cube_t		*	in,
 		pixelmap	*	deadpixmap)
 {
-	int				p ;
-	image_t	*	cleaned ;
+	deadpix_index	*	idx ;
+	int					status ;
 
 	if (in==NULL || deadpixmap==NULL) return -1 ;
-	for (p=0 ; p<in->np ; p++) {
-		cleaned = image_clean_deadpix(in->plane[p], deadpixmap) ;
-		image_del(in->plane[p]) ;
-		in->plane[p] = cleaned ;
+	if ((in->lx!=deadpixmap->lx) || (in->ly!=deadpixmap->ly)) {
+		e_error("cube and pixel map have different sizes") ;
+		return -1 ;
 	}
+	if ((idx=deadpix_index_new(deadpixmap, 1, 1))==NULL) return -1 ;
+	status = cube_clean_deadpix_index(in, idx) ;
+	deadpix_index_del(idx) ;
+	return status ;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Build a bad pixel index from a pixel map.
+  @param	deadpixmap	Dead pixel map.
+  @param	hsize		Half-size of the interpolation window.
+  @param	maxsize		Maximal half-size of the window for clusters.
+  @return	1 newly allocated deadpix_index, NULL in case of error.
+
+  The index lists the bad pixels of the map together with the positions
+  and weights of the good pixels used to replace them, so that it can
+  be applied to any number of images of the same size without looking
+  at the map again.
+
+  Each bad pixel is replaced by the weighted mean of the good pixels in
+  the (2*hsize+1)x(2*hsize+1) window centered on it. With hsize=1 all
+  weights are 1, which is the 3x3 average of image_clean_deadpix().
+  Larger windows weight the neighbors by the inverse of their squared
+  distance, so that the closest ones dominate.
+
+  If a bad pixel has no good neighbor in its window, as happens inside
+  clusters of bad pixels, the window is grown one pixel at a time up to
+  a half-size of maxsize. Pixels which still have no good neighbor are
+  set to zero.
+
+  The returned object must be deallocated using deadpix_index_del().
+ */
+/*--------------------------------------------------------------------------*/
+deadpix_index * deadpix_index_new(
+		pixelmap	*	deadpixmap,
+		int				hsize,
+		int				maxsize)
+{
+	deadpix_index	*	idx ;
+	binpix			*	map ;
+	int					lx, ly ;
+	int					i, j, k, l, r ;
+	int					pos, nbad, nnb, cap ;
+	double				w ;
+
+	if (deadpixmap==NULL) return NULL ;
+	if (hsize<1) {
+		e_error("invalid interpolation window half-size: %d", hsize) ;
+		return NULL ;
+	}
+	if (maxsize<hsize) maxsize = hsize ;
+
+	lx = deadpixmap->lx ;
+	ly = deadpixmap->ly ;
+	map = deadpixmap->data ;
+	nbad = 0 ;
+	for (pos=0 ; pos<lx*ly ; pos++) {
+		if (map[pos]!=PIXELMAP_1) nbad++ ;
+	}
+
+	idx = malloc(sizeof(deadpix_index)) ;
+	idx->lx = lx ;
+	idx->ly = ly ;
+	idx->nbad = nbad ;
+	idx->pos = malloc((nbad+1) * sizeof(int)) ;
+	idx->first = malloc((nbad+1) * sizeof(int)) ;
+	idx->norm = malloc((nbad+1) * sizeof(double)) ;
+	/* Enough for all windows if no cluster needs to grow */
+	cap = nbad * (2*hsize+1) * (2*hsize+1) + 1 ;
+	idx->nbpos = malloc(cap * sizeof(int)) ;
+	idx->nbw = malloc(cap * sizeof(double)) ;
+
+	nbad = 0 ;
+	nnb = 0 ;
+	for (j=0 ; j<ly ; j++) {
+		for (i=0 ; i<lx ; i++) {
+			if (map[i+j*lx]==PIXELMAP_1) continue ;
+			idx->pos[nbad] = i+j*lx ;
+			idx->first[nbad] = nnb ;
+			idx->norm[nbad] = 0.0 ;
+			for (r=hsize ; r<=maxsize && idx->norm[nbad]==0.0 ; r++) {
+				if (nnb + (2*r+1)*(2*r+1) > cap) {
+					cap = 2*cap + (2*r+1)*(2*r+1) ;
+					idx->nbpos = realloc(idx->nbpos, cap * sizeof(int)) ;
+					idx->nbw = realloc(idx->nbw, cap * sizeof(double)) ;
+				}
+				for (l=-r ; l<=r ; l++) {
+					if ((j+l<0) || (j+l>=ly)) continue ;
+					for (k=-r ; k<=r ; k++) {
+						if ((i+k<0) || (i+k>=lx)) continue ;
+						if (map[(i+k)+(j+l)*lx]!=PIXELMAP_1) continue ;
+						w = (r==1) ? 1.0 : 1.0 / (double)(k*k + l*l) ;
+						idx->nbpos[nnb] = (i+k)+(j+l)*lx ;
+						idx->nbw[nnb] = w ;
+						idx->norm[nbad] += w ;
+						nnb++ ;
+					}
+				}
+			}
+			nbad++ ;
+		}
+	}
+	idx->first[nbad] = nnb ;
+	return idx ;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Delete a bad pixel index.
+  @param	idx		Bad pixel index to delete.
+  @return	void
+ */
+/*--------------------------------------------------------------------------*/
+void deadpix_index_del(deadpix_index * idx)
+{
+	if (idx==NULL) return ;
+	free(idx->pos) ;
+	free(idx->first) ;
+	free(idx->norm) ;
+	free(idx->nbpos) ;
+	free(idx->nbw) ;
+	free(idx) ;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Get the number of bad pixels in a bad pixel index.
+  @param	idx		Bad pixel index.
+  @return	int number of bad pixels, -1 in case of error.
+ */
+/*--------------------------------------------------------------------------*/
+int deadpix_index_nbad(deadpix_index * idx)
+{
+	if (idx==NULL) return -1 ;
+	return idx->nbad ;
+}
+
+
+/*
+ * Replace the bad pixels of one chunk of the index in one plane. Only
+ * good pixels are read, so the replacement can be done in place.
+ */
+static void deadpix_clean_task(void * arg, int task, int worker)
+{
+	deadpix_job		*	job ;
+	deadpix_index	*	idx ;
+	pixelvalue		*	data ;
+	double				replace ;
+	int					b, b_end, n ;
+
+	job = (deadpix_job*)arg ;
+	idx = job->idx ;
+	data = job->planes[task / job->nchunks]->data ;
+	b = (task % job->nchunks) * DEADPIX_CHUNK ;
+	b_end = b + DEADPIX_CHUNK ;
+	if (b_end>idx->nbad) b_end = idx->nbad ;
+
+	for ( ; b<b_end ; b++) {
+		if (idx->norm[b]==0.0) {
+			data[idx->pos[b]] = (pixelvalue)0 ;
+			continue ;
+		}
+		replace = 0.0 ;
+		for (n=idx->first[b] ; n<idx->first[b+1] ; n++) {
+			replace += idx->nbw[n] * (double)data[idx->nbpos[n]] ;
+		}
+		data[idx->pos[b]] = (pixelvalue)(replace/idx->norm[b]) ;
+	}
+}
+
+static int deadpix_clean_planes(
+		image_t			**	planes,
+		int					np,
+		deadpix_index	*	idx)
+{
+	deadpix_job			job ;
+	int					p ;
+
+	for (p=0 ; p<np ; p++) {
+		if ((planes[p]->lx!=idx->lx) || (planes[p]->ly!=idx->ly)) {
+			e_error("image and bad pixel index have different sizes") ;
+			return -1 ;
+		}
+	}
+	if (idx->nbad==0) return 0 ;
+	job.idx = idx ;
+	job.planes = planes ;
+	job.nchunks = (idx->nbad + DEADPIX_CHUNK - 1) / DEADPIX_CHUNK ;
+	eclipse_parallel_run(deadpix_clean_task, &job, np * job.nchunks) ;
 	return 0 ;
 }
 
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Clean an image of its dead pixels using a bad pixel index.
+  @param	img		Image to clean, modified in place.
+  @param	idx		Bad pixel index.
+  @return	int 0 if Ok, -1 otherwise.
+
+  Only the bad pixels listed in the index are modified, see
+  deadpix_index_new() for the interpolation method.
+ */
+/*--------------------------------------------------------------------------*/
+int image_clean_deadpix_index(
+		image_t			*	img,
+		deadpix_index	*	idx)
+{
+	if (img==NULL || idx==NULL) return -1 ;
+	return deadpix_clean_planes(&img, 1, idx) ;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Clean out a cube of its bad pixels using a bad pixel index.
+  @param	in		Cube to clean, modified in place.
+  @param	idx		Bad pixel index.
+  @return	int 0 if Ok, -1 otherwise.
+
+  Same as image_clean_deadpix_index() for all planes of the cube. The
+  planes are processed in parallel.
+ */
+/*--------------------------------------------------------------------------*/
+int cube_clean_deadpix_index(
+		cube_t			*	in,
+		deadpix_index	*	idx)
+{
+	if (in==NULL || idx==NULL) return -1 ;
+	return deadpix_clean_planes(in->plane, in->np, idx) ;
+}
+
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief	Detect bad pixels in a single image by median filtering.
@@ -31,12 +31,26 @@
 #include "dstats.h"
 #include "image_handling.h"
 #include "photometry.h"
+#include "parallel.h"
+
+/*-----------------------------------------------------------------------------
+  							Private types
+ -----------------------------------------------------------------------------*/
+
+typedef struct _detected_phot_job_ {
+	detected	*	det ;
+	image_t		*	ref ;
+	double			phot_star ;
+	double			phot_int ;
+	double			phot_ext ;
+} detected_phot_job ;
 
 /*-----------------------------------------------------------------------------
   							Function prototypes
  -----------------------------------------------------------------------------*/
 
 static double3 * detected_finepos_engine(image_t *, int, int, int, double) ;
+static void detected_phot_task(void *, int, int) ;
 
 /*-----------------------------------------------------------------------------
   							Function codes
@@ -859,8 +873,8 @@ int detected_compute_phot(
 		double			phot_int,
 		double			phot_ext)
 {
-	double xpos, ypos ;
-    int    k ;
+	detected_phot_job	job ;
+	int					k ;
 
 	if (det==NULL || ref==NULL) return -1 ;
 	if (det->nbobj<1) return -1 ;
@@ -877,33 +891,55 @@ int detected_compute_phot(
 	/* Allocate storage */
 	det->obj_flux 		= calloc(det->nbobj, sizeof(double));
 	det->obj_background = calloc(det->nbobj, sizeof(double));
-    for (k=0 ; k<det->nbobj ; k++) {
-		if ((det->fine_x != NULL) && (det->fine_y != NULL)) {
-			xpos = det->fine_x[k] ;
-			ypos = det->fine_y[k] ;
-		} else {
-			xpos = det->x[k] ;
-			ypos = det->y[k] ;
-		}
-		det->obj_background[k] =
-			image_get_disk_background(ref,
-									  xpos,
-									  ypos,
-									  phot_int,
-									  phot_ext,
-									  BG_METHOD_MEDIAN) ;
-		if (det->obj_background[k] < 0.0)
-			det->obj_background[k] = 0.0;
-
-        det->obj_flux[k] = image_get_disk_flux(ref,
-                                xpos,
-                                ypos,
-                                phot_star,
-                                det->obj_background[k]) ;
-    }
+	job.det = det ;
+	job.ref = ref ;
+	job.phot_star = phot_star ;
+	job.phot_int = phot_int ;
+	job.phot_ext = phot_ext ;
+	if ((phot_star > 0.0) && (phot_int > 0.0) && (phot_ext > 0.0) &&
+		(phot_ext - phot_int >= 1e-10)) {
+		/* Objects are independent */
+		eclipse_parallel_run(detected_phot_task, &job, det->nbobj) ;
+	} else {
+		/* Let the photometry functions complain */
+    	for (k=0 ; k<det->nbobj ; k++) detected_phot_task(&job, k, 0) ;
+	}
     return 0 ;
 }
 
+/* Photometry of object k */
+static void detected_phot_task(void * arg, int k, int worker)
+{
+	detected_phot_job	*	job ;
+	detected			*	det ;
+	double 					xpos, ypos ;
+
+	job = (detected_phot_job*)arg ;
+	det = job->det ;
+	if ((det->fine_x != NULL) && (det->fine_y != NULL)) {
+		xpos = det->fine_x[k] ;
+		ypos = det->fine_y[k] ;
+	} else {
+		xpos = det->x[k] ;
+		ypos = det->y[k] ;
+	}
+	det->obj_background[k] =
+		image_get_disk_background(job->ref,
+								  xpos,
+								  ypos,
+								  job->phot_int,
+								  job->phot_ext,
+								  BG_METHOD_MEDIAN) ;
+	if (det->obj_background[k] < 0.0)
+		det->obj_background[k] = 0.0;
+
+	det->obj_flux[k] = image_get_disk_flux(job->ref,
+							xpos,
+							ypos,
+							job->phot_star,
+							det->obj_background[k]) ;
+}
+
 /*----------------------------------------------------------------------------*/
 /**
   @brief	Convert a detected object in a double3 object
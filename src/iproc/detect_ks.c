@@ -28,6 +28,7 @@
 #include "image_filters.h"
 #include "pixelmaps.h"
 #include "detect_ks.h"
+#include "detect_tile.h"
 
 /*-----------------------------------------------------------------------------
   							Function codes
@@ -40,6 +41,10 @@
   @param    kappa       Kappa for kappa-sigma clipping.
   @param    smear_flag  Request image smearing before applying detection.
   @return   the detected object
+
+  The threshold is the median of the detection image plus kappa times
+  its mean absolute deviation to the median. The detection runs over
+  tiles in parallel, see detected_tile_engine().
  */
 /*----------------------------------------------------------------------------*/
 detected * detected_ks_engine(
@@ -47,71 +52,8 @@ detected * detected_ks_engine(
 	    double     kappa,
 	    int        smear_flag)
 {
-	detected	*	det ;
-    image_t  	*	detect_image ;
-    double   	 	medval, abs_med ;
-    int      	   	k ;
-    int      	   	npix ;
-    pixelmap 	*  	thresh ;
-    intimage 	*  	lab ;
-    int      	   	nobj ;
-
-    /* Review input parameters */
-    if (ref == NULL) return NULL ;
-
-    /* Smear input image if requested */
-    if (smear_flag) {
-        detect_image = image_filter5x5(ref,
-                       image_filter_getkernel("mean5", NULL, NULL));
-        if (detect_image==NULL) {
-            e_error("smearing image: aborting object detection");
-            return NULL ;
-        }
-    } else {
-        detect_image = ref ;
-    }
-	
-    /* Assign default kappa if needed */
-    kappa = (kappa<0) ? DETECTED_KAPPA : kappa ;
-	
-    /* Median estimation and threshold */
-    medval = image_getmedian(detect_image);
-    npix = detect_image->lx * detect_image->ly ;
-    abs_med = 0 ;
-    for (k=0 ; k<npix ; k++) {
-        abs_med += fabs((double)detect_image->data[k] - medval);
-    }
-    abs_med /= (double)npix ;
-
-    /* Threshold to binary map */
-    thresh = image_threshold2pixelmap(detect_image,
-                                      medval + kappa * abs_med,
-                                      MAX_PIX_VALUE);
-    if (detect_image != ref) image_del(detect_image);
-
-    if (thresh == NULL) {
-        e_error("thresholding image: aborting detection");
-        return NULL ;
-    }
-
-    /* Morphology */
-    if (pixelmap_morpho_closing(thresh) == -1) {
-        e_error("closing binary map: aborting detection");
-        return NULL ;
-    }
-
-    /* Labelize pixel map into intimage */
-    lab = intimage_labelize_pixelmap(thresh, &nobj);
-    pixelmap_del(thresh);
-    if (lab == NULL) {
-        e_error("assigning labels to binary map: aborting detection");
-        return NULL ;
-    }
-
-	/* Create detected object */
-	det = detected_compute_objstat(ref, lab, nobj);
-    intimage_del(lab);
-    return det ;
+    /* A single background over the whole image */
+    return detected_tile_engine(ref, kappa, smear_flag, 0) ;
 }
 
 /*----------------------------------------------------------------------------*/
@@ -169,7 +111,7 @@ double3 * detected_ks_brightest_stars(
     double3_sort(pos_tmp, -1) ;
 
     /* Set the number of objects to return */
-    if (det->nbobj <= nbobjs) nb_objects = det->nbobj ;
+    if (pos_tmp->n <= nbobjs) nb_objects = pos_tmp->n ;
     else nb_objects = nbobjs ;
 
     /* Find brigthest stars among detected ones */
@@ -0,0 +1,886 @@
+/*----------------------------------------------------------------------------*/
+/**
+   @file    detect_tile.c
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Object detection over image tiles
+*/
+/*----------------------------------------------------------------------------*/
+
+/*
+    $Id$
+    $Author$
+    $Date$
+    $Revision$
+*/
+
+/*-----------------------------------------------------------------------------
+                                Includes
+ -----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "comm.h"
+#include "xmemory.h"
+#include "dstats.h"
+#include "median.h"
+#include "image_handling.h"
+#include "image_filters.h"
+#include "image_stats.h"
+#include "parallel.h"
+#include "detect_tile.h"
+
+/*-----------------------------------------------------------------------------
+                                Defines
+ -----------------------------------------------------------------------------*/
+
+/* Size of the tiles processed in parallel */
+#define TILE_SIZE       256
+/* Smallest size of the background mesh */
+#define TILE_MESH_MIN   16
+
+/*-----------------------------------------------------------------------------
+                                Private types
+ -----------------------------------------------------------------------------*/
+
+/* Statistics of an object, or of the part of an object inside a tile */
+typedef struct _tile_obj_ {
+    int         npix ;
+    double      sx, sy ;
+    double      sum, sqsum ;
+    int         bottom_x, bottom_y ;
+    int         top_x, top_y ;
+    int         left_x, left_y ;
+    int         right_x, right_y ;
+    int         min_x, min_y ;
+    int         max_x, max_y ;
+    double      min_i, max_i ;
+} tile_obj ;
+
+/* One tile: position, labels and statistics of its objects */
+typedef struct _tile_ {
+    int         x0, y0 ;
+    int         lx, ly ;
+    int     *   lab ;
+    int         nobj ;
+    tile_obj *  obj ;
+    int         first ;
+} tile ;
+
+/* Object sort key: position of its first pixel */
+typedef struct _tile_key_ {
+    int         y, x ;
+    int         id ;
+} tile_key ;
+
+typedef struct _tile_job_ {
+    image_t     *   ref ;
+    image_t     *   det ;
+    /* Background mesh */
+    int             mesh ;
+    int             skip ;
+    int             nx, ny ;
+    double      *   bg ;
+    double      *   noise ;
+    /* Threshold mesh and its interpolation weights */
+    double      *   thr ;
+    int         *   ix0 ;
+    int         *   ix1 ;
+    double      *   wx ;
+    int         *   iy0 ;
+    int         *   iy1 ;
+    double      *   wy ;
+    /* Tiles */
+    int             ntx, nty ;
+    tile        *   tiles ;
+    /* Merged objects */
+    int         *   fin ;
+    tile_obj    *   obj ;
+    detected    *   out ;
+} tile_job ;
+
+/*-----------------------------------------------------------------------------
+                            Private functions
+ -----------------------------------------------------------------------------*/
+
+static void tile_mesh_task(void *, int, int) ;
+static void tile_mesh_filter(double *, int, int) ;
+static void tile_interp(int, int, int, int *, int *, double *) ;
+static void tile_task(void *, int, int) ;
+static int tile_label(binpix *, int, int, int *) ;
+static void tile_merge(tile_obj *, tile_obj *) ;
+static int tile_find(int *, int) ;
+static void tile_union(int *, int, int) ;
+static int tile_key_cmp(const void *, const void *) ;
+static void tile_median_task(void *, int, int) ;
+
+/*-----------------------------------------------------------------------------
+                                Function codes
+ -----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Locate objects in an image over tiles, with a background mesh.
+  @param    ref         Reference image.
+  @param    kappa       Kappa for kappa-sigma clipping.
+  @param    smear_flag  Request image smearing before applying detection.
+  @param    mesh        Size of the background mesh in pixels, 0 for none.
+  @return   the detected object
+
+  The detection image (the reference image, smoothed by a 5x5 mean
+  filter if smear_flag is set) is cut into cells of mesh x mesh
+  pixels. The median and the mean absolute deviation to the median of
+  every cell are filtered by a 3x3 median over the mesh to get rid of
+  the cells covered by large objects, and interpolated bilinearly
+  between the cell centers to get the background and noise maps. All
+  pixels above the background plus kappa times the noise are object
+  pixels. If mesh is 0, a single background and noise value is
+  computed over the whole image, which gives the same result as
+  detected_ks_engine().
+
+  The image is then processed by tiles of 256x256 pixels in parallel:
+  every tile is thresholded, cleaned by the same 3x3 morphology as
+  pixelmap_morpho_closing() and labelled, and the statistics of its
+  objects are accumulated. Objects touching across tile boundaries are
+  then merged, and the objects are numbered in the order in which
+  intimage_labelize_pixelmap() would find them, so that the result
+  does not depend on the tiling nor on the number of threads. The
+  returned object holds the same fields as the one returned by
+  detected_compute_objstat().
+ */
+/*----------------------------------------------------------------------------*/
+detected * detected_tile_engine(
+        image_t *   ref,
+        double      kappa,
+        int         smear_flag,
+        int         mesh)
+{
+    tile_job        job ;
+    tile        *   t ;
+    tile        *   n ;
+    tile_key    *   key ;
+    detected    *   det ;
+    int         *   parent ;
+    double          medval, abs_med ;
+    int             npix, total ;
+    int             i, j, k, r ;
+
+    /* Review input parameters */
+    if (ref == NULL) return NULL ;
+    kappa = (kappa<0) ? DETECTED_KAPPA : kappa ;
+    if (mesh<0) mesh = 0 ;
+    if (mesh>0 && mesh<TILE_MESH_MIN) {
+        e_warning("background mesh too small, using %d", TILE_MESH_MIN) ;
+        mesh = TILE_MESH_MIN ;
+    }
+
+    /* Smear input image if requested */
+    job.ref = ref ;
+    if (smear_flag) {
+        job.det = image_filter5x5(ref,
+                  image_filter_getkernel("mean5", NULL, NULL));
+        if (job.det==NULL) {
+            e_error("smearing image: aborting object detection");
+            return NULL ;
+        }
+    } else {
+        job.det = ref ;
+    }
+
+    /* Background and noise mesh */
+    job.mesh = mesh ;
+    if (mesh==0) {
+        job.nx = job.ny = 1 ;
+    } else {
+        job.nx = ref->lx / mesh ;
+        job.ny = ref->ly / mesh ;
+        if (job.nx<1) job.nx = 1 ;
+        if (job.ny<1) job.ny = 1 ;
+    }
+    job.bg    = malloc(job.nx * job.ny * sizeof(double)) ;
+    job.noise = malloc(job.nx * job.ny * sizeof(double)) ;
+    job.thr   = malloc(job.nx * job.ny * sizeof(double)) ;
+    if (mesh==0) {
+        /* Median estimation and threshold */
+        medval = image_getmedian(job.det);
+        npix = job.det->lx * job.det->ly ;
+        abs_med = 0 ;
+        for (k=0 ; k<npix ; k++) {
+            abs_med += fabs((double)job.det->data[k] - medval);
+        }
+        abs_med /= (double)npix ;
+        job.bg[0] = medval ;
+        job.noise[0] = abs_med ;
+    } else {
+        /* The borders of a smeared image are not filtered */
+        job.skip = smear_flag ? 2 : 0 ;
+        eclipse_parallel_run(tile_mesh_task, &job, job.nx * job.ny) ;
+        tile_mesh_filter(job.bg, job.nx, job.ny) ;
+        tile_mesh_filter(job.noise, job.nx, job.ny) ;
+    }
+    for (k=0 ; k<job.nx*job.ny ; k++) {
+        job.thr[k] = job.bg[k] + kappa * job.noise[k] ;
+    }
+    job.ix0 = malloc(ref->lx * sizeof(int)) ;
+    job.ix1 = malloc(ref->lx * sizeof(int)) ;
+    job.wx  = malloc(ref->lx * sizeof(double)) ;
+    job.iy0 = malloc(ref->ly * sizeof(int)) ;
+    job.iy1 = malloc(ref->ly * sizeof(int)) ;
+    job.wy  = malloc(ref->ly * sizeof(double)) ;
+    tile_interp(job.nx, mesh, ref->lx, job.ix0, job.ix1, job.wx) ;
+    tile_interp(job.ny, mesh, ref->ly, job.iy0, job.iy1, job.wy) ;
+
+    /* Threshold, clean, label and measure all tiles */
+    job.ntx = (ref->lx + TILE_SIZE - 1) / TILE_SIZE ;
+    job.nty = (ref->ly + TILE_SIZE - 1) / TILE_SIZE ;
+    job.tiles = calloc(job.ntx * job.nty, sizeof(tile)) ;
+    eclipse_parallel_run(tile_task, &job, job.ntx * job.nty) ;
+    if (job.det != ref) image_del(job.det) ;
+    free(job.bg) ;
+    free(job.noise) ;
+    free(job.thr) ;
+    free(job.ix0) ;
+    free(job.ix1) ;
+    free(job.wx) ;
+    free(job.iy0) ;
+    free(job.iy1) ;
+    free(job.wy) ;
+
+    /* Number the objects of all tiles */
+    total = 0 ;
+    for (k=0 ; k<job.ntx*job.nty ; k++) {
+        job.tiles[k].first = total ;
+        total += job.tiles[k].nobj ;
+    }
+
+    /* Merge the objects touching across tile boundaries */
+    parent = malloc((total+1) * sizeof(int)) ;
+    for (k=0 ; k<total ; k++) parent[k] = k ;
+    for (j=0 ; j<job.nty ; j++) {
+        for (i=0 ; i<job.ntx ; i++) {
+            t = job.tiles + i + j*job.ntx ;
+            if (i<job.ntx-1) {
+                n = t + 1 ;
+                for (k=0 ; k<t->ly ; k++) {
+                    if (t->lab[t->lx-1 + k*t->lx] && n->lab[k*n->lx]) {
+                        tile_union(parent,
+                                   t->first + t->lab[t->lx-1 + k*t->lx] - 1,
+                                   n->first + n->lab[k*n->lx] - 1) ;
+                    }
+                }
+            }
+            if (j<job.nty-1) {
+                n = t + job.ntx ;
+                for (k=0 ; k<t->lx ; k++) {
+                    if (t->lab[k + (t->ly-1)*t->lx] && n->lab[k]) {
+                        tile_union(parent,
+                                   t->first + t->lab[k + (t->ly-1)*t->lx] - 1,
+                                   n->first + n->lab[k] - 1) ;
+                    }
+                }
+            }
+        }
+    }
+    job.obj = malloc((total+1) * sizeof(tile_obj)) ;
+    for (k=0 ; k<job.ntx*job.nty ; k++) {
+        t = job.tiles + k ;
+        for (i=0 ; i<t->nobj ; i++) {
+            r = tile_find(parent, t->first + i) ;
+            if (r == t->first + i) {
+                job.obj[r] = t->obj[i] ;
+            } else {
+                tile_merge(job.obj + r, t->obj + i) ;
+            }
+        }
+        free(t->obj) ;
+        t->obj = NULL ;
+    }
+
+    /* Sort objects by first pixel, as a labelling of the whole image */
+    key = malloc((total+1) * sizeof(tile_key)) ;
+    npix = 0 ;
+    for (k=0 ; k<total ; k++) {
+        if (parent[k]==k) {
+            key[npix].y = job.obj[k].bottom_y ;
+            key[npix].x = job.obj[k].bottom_x ;
+            key[npix].id = k ;
+            npix++ ;
+        }
+    }
+    qsort(key, npix, sizeof(tile_key), tile_key_cmp) ;
+    job.fin = malloc((total+1) * sizeof(int)) ;
+    for (k=0 ; k<npix ; k++) job.fin[key[k].id] = k ;
+    for (k=0 ; k<total ; k++) job.fin[k] = job.fin[tile_find(parent, k)] ;
+    free(parent) ;
+
+    /* Create detected object */
+    det = detected_new() ;
+    det->nbobj = npix ;
+    if (npix>0) {
+        det->x          = calloc(npix, sizeof(double));
+        det->y          = calloc(npix, sizeof(double));
+        det->obj_nbpix  = calloc(npix, sizeof(int));
+        det->bottom_x   = calloc(npix, sizeof(int));
+        det->bottom_y   = calloc(npix, sizeof(int));
+        det->top_x      = calloc(npix, sizeof(int));
+        det->top_y      = calloc(npix, sizeof(int));
+        det->left_x     = calloc(npix, sizeof(int));
+        det->left_y     = calloc(npix, sizeof(int));
+        det->right_x    = calloc(npix, sizeof(int));
+        det->right_y    = calloc(npix, sizeof(int));
+        det->min_x      = calloc(npix, sizeof(int));
+        det->min_y      = calloc(npix, sizeof(int));
+        det->max_x      = calloc(npix, sizeof(int));
+        det->max_y      = calloc(npix, sizeof(int));
+        det->min_i      = calloc(npix, sizeof(double));
+        det->max_i      = calloc(npix, sizeof(double));
+        det->obj_mean   = calloc(npix, sizeof(double));
+        det->obj_stdev  = calloc(npix, sizeof(double));
+        det->obj_median = calloc(npix, sizeof(double));
+    }
+    for (k=0 ; k<npix ; k++) {
+        tile_obj * o = job.obj + key[k].id ;
+        det->obj_nbpix[k] = o->npix ;
+        det->bottom_x[k] = o->bottom_x ;
+        det->bottom_y[k] = o->bottom_y ;
+        det->top_x[k] = o->top_x ;
+        det->top_y[k] = o->top_y ;
+        det->left_x[k] = o->left_x ;
+        det->left_y[k] = o->left_y ;
+        det->right_x[k] = o->right_x ;
+        det->right_y[k] = o->right_y ;
+        det->min_x[k] = o->min_x ;
+        det->min_y[k] = o->min_y ;
+        det->max_x[k] = o->max_x ;
+        det->max_y[k] = o->max_y ;
+        det->min_i[k] = o->min_i ;
+        det->max_i[k] = o->max_i ;
+        det->obj_mean[k] = o->sum / (double)o->npix ;
+        if (o->npix>1) {
+            /* Rounding errors can cause the variance to be negative */
+            det->obj_stdev[k] = (o->sqsum - ((o->sum*o->sum)/(double)o->npix))
+                              / ((double)o->npix-1.0);
+            det->obj_stdev[k] = det->obj_stdev[k] > 0
+                              ? sqrt(det->obj_stdev[k]) : 0;
+        } else {
+            det->obj_stdev[k] = 0.0 ;
+        }
+        det->x[k] = o->sx / (double)o->npix ;
+        det->y[k] = o->sy / (double)o->npix ;
+    }
+    free(key) ;
+    free(job.obj) ;
+
+    /* Compute median for each object */
+    job.out = det ;
+    eclipse_parallel_run(tile_median_task, &job, npix) ;
+
+    for (k=0 ; k<job.ntx*job.nty ; k++) free(job.tiles[k].lab) ;
+    free(job.tiles) ;
+    free(job.fin) ;
+    return det ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Compute the background and noise of one mesh cell.
+  @param    arg     Tile job.
+  @param    cell    Index of the cell.
+  @param    worker  Unused.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+static void tile_mesh_task(void * arg, int cell, int worker)
+{
+    tile_job    *   job ;
+    pixelvalue  *   buf ;
+    double          med, dev ;
+    int             x0, x1, y0, y1 ;
+    int             i, j, n ;
+
+    job = (tile_job *)arg ;
+    x0 = (cell % job->nx) * job->mesh ;
+    y0 = (cell / job->nx) * job->mesh ;
+    x1 = (cell % job->nx == job->nx-1) ? job->det->lx : x0 + job->mesh ;
+    y1 = (cell / job->nx == job->ny-1) ? job->det->ly : y0 + job->mesh ;
+    if (x0 < job->skip) x0 = job->skip ;
+    if (y0 < job->skip) y0 = job->skip ;
+    if (x1 > job->det->lx - job->skip) x1 = job->det->lx - job->skip ;
+    if (y1 > job->det->ly - job->skip) y1 = job->det->ly - job->skip ;
+    if (x0>=x1 || y0>=y1) {
+        job->bg[cell] = 0.0 ;
+        job->noise[cell] = 0.0 ;
+        return ;
+    }
+
+    buf = malloc((x1-x0) * (y1-y0) * sizeof(pixelvalue)) ;
+    n = 0 ;
+    for (j=y0 ; j<y1 ; j++) {
+        for (i=x0 ; i<x1 ; i++) {
+            buf[n++] = job->det->data[i + j*job->det->lx] ;
+        }
+    }
+    med = (double)median_pixelvalue(buf, n) ;
+    free(buf) ;
+    dev = 0.0 ;
+    for (j=y0 ; j<y1 ; j++) {
+        for (i=x0 ; i<x1 ; i++) {
+            dev += fabs((double)job->det->data[i + j*job->det->lx] - med) ;
+        }
+    }
+    job->bg[cell] = med ;
+    job->noise[cell] = dev / (double)n ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Apply a 3x3 median filter to a mesh.
+  @param    m       Mesh values, modified.
+  @param    nx      Mesh size in x.
+  @param    ny      Mesh size in y.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+static void tile_mesh_filter(double * m, int nx, int ny)
+{
+    double  *   out ;
+    double      v[9] ;
+    int         i, j, di, dj, n ;
+
+    if (nx*ny<2) return ;
+    out = malloc(nx * ny * sizeof(double)) ;
+    for (j=0 ; j<ny ; j++) {
+        for (i=0 ; i<nx ; i++) {
+            n = 0 ;
+            for (dj=-1 ; dj<=1 ; dj++) {
+                for (di=-1 ; di<=1 ; di++) {
+                    if (i+di>=0 && i+di<nx && j+dj>=0 && j+dj<ny) {
+                        v[n++] = m[i+di + (j+dj)*nx] ;
+                    }
+                }
+            }
+            out[i+j*nx] = double_median(v, n) ;
+        }
+    }
+    memcpy(m, out, nx * ny * sizeof(double)) ;
+    free(out) ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Bilinear interpolation weights between mesh cell centers.
+  @param    n       Number of cells.
+  @param    mesh    Cell size, the last cell extends to the image border.
+  @param    size    Image size.
+  @param    i0      Returned index of the cell before every pixel.
+  @param    i1      Returned index of the cell after every pixel.
+  @param    w       Returned weight of cell i1 for every pixel.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+static void tile_interp(
+        int         n,
+        int         mesh,
+        int         size,
+        int     *   i0,
+        int     *   i1,
+        double  *   w)
+{
+    double      c0, c1 ;
+    int         i, k ;
+
+    k = 0 ;
+    for (i=0 ; i<size ; i++) {
+        i0[i] = i1[i] = 0 ;
+        w[i] = 0.0 ;
+        if (n<2) continue ;
+        /* Move to the cells around pixel i */
+        while (k<n-2 && i >= (k+1)*mesh + (mesh-1)/2.0) k++ ;
+        c0 = k*mesh + (mesh-1)/2.0 ;
+        c1 = (k+1==n-1) ? ((k+1)*mesh + size-1)/2.0 : c0 + mesh ;
+        if (i<=c0) {
+            i0[i] = i1[i] = k ;
+        } else if (i>=c1) {
+            i0[i] = i1[i] = k+1 ;
+        } else {
+            i0[i] = k ;
+            i1[i] = k+1 ;
+            w[i] = (i-c0) / (c1-c0) ;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Threshold, clean, label and measure one tile.
+  @param    arg     Tile job.
+  @param    k       Index of the tile.
+  @param    worker  Unused.
+  @return   void
+
+  The 3x3 erosion and dilation of pixelmap_morpho_closing() are applied
+  on the tile extended by 2 pixels on every side, so that the result on
+  the tile is the same as on the whole image.
+ */
+/*----------------------------------------------------------------------------*/
+static void tile_task(void * arg, int k, int worker)
+{
+    tile_job    *   job ;
+    tile        *   t ;
+    tile_obj    *   o ;
+    binpix      *   b2 ;
+    binpix      *   b1 ;
+    binpix      *   b0 ;
+    pixelvalue      pix ;
+    double      *   thr ;
+    double          t0, t1, v ;
+    int             lx, ly ;
+    int             ex0, ex1, ey0, ey1, ew ;
+    int             i, j, gi, gj, l, pos ;
+
+    job = (tile_job *)arg ;
+    t = job->tiles + k ;
+    lx = job->det->lx ;
+    ly = job->det->ly ;
+    thr = job->thr ;
+    t->x0 = (k % job->ntx) * TILE_SIZE ;
+    t->y0 = (k / job->ntx) * TILE_SIZE ;
+    t->lx = (t->x0 + TILE_SIZE > lx) ? lx - t->x0 : TILE_SIZE ;
+    t->ly = (t->y0 + TILE_SIZE > ly) ? ly - t->y0 : TILE_SIZE ;
+
+    /* Threshold the tile and 2 pixels around it */
+    ex0 = t->x0 - 2 ; if (ex0<0) ex0 = 0 ;
+    ey0 = t->y0 - 2 ; if (ey0<0) ey0 = 0 ;
+    ex1 = t->x0 + t->lx + 2 ; if (ex1>lx) ex1 = lx ;
+    ey1 = t->y0 + t->ly + 2 ; if (ey1>ly) ey1 = ly ;
+    ew = ex1 - ex0 ;
+    b2 = malloc(ew * (ey1-ey0) * sizeof(binpix)) ;
+    b1 = calloc(ew * (ey1-ey0), sizeof(binpix)) ;
+    for (gj=ey0 ; gj<ey1 ; gj++) {
+        for (gi=ex0 ; gi<ex1 ; gi++) {
+            t0 = (1.0 - job->wx[gi]) * thr[job->ix0[gi] + job->iy0[gj]*job->nx]
+               + job->wx[gi] * thr[job->ix1[gi] + job->iy0[gj]*job->nx] ;
+            t1 = (1.0 - job->wx[gi]) * thr[job->ix0[gi] + job->iy1[gj]*job->nx]
+               + job->wx[gi] * thr[job->ix1[gi] + job->iy1[gj]*job->nx] ;
+            v = (1.0 - job->wy[gj]) * t0 + job->wy[gj] * t1 ;
+            pix = job->det->data[gi + gj*lx] ;
+            b2[gi-ex0 + (gj-ey0)*ew] =
+                ((pix>v) && (pix<MAX_PIX_VALUE)) ? PIXELMAP_1 : PIXELMAP_0 ;
+        }
+    }
+
+    /* Erosion on the tile and 1 pixel around it, image edges are 0 */
+    for (gj=ey0 ; gj<ey1 ; gj++) {
+        if (gj<t->y0-1 || gj>t->y0+t->ly || gj==0 || gj==ly-1) continue ;
+        for (gi=ex0 ; gi<ex1 ; gi++) {
+            if (gi<t->x0-1 || gi>t->x0+t->lx || gi==0 || gi==lx-1) continue ;
+            pos = gi-ex0 + (gj-ey0)*ew ;
+            if (b2[pos-ew-1]==PIXELMAP_1 && b2[pos-ew]==PIXELMAP_1 &&
+                b2[pos-ew+1]==PIXELMAP_1 && b2[pos-1]==PIXELMAP_1 &&
+                b2[pos]==PIXELMAP_1 && b2[pos+1]==PIXELMAP_1 &&
+                b2[pos+ew-1]==PIXELMAP_1 && b2[pos+ew]==PIXELMAP_1 &&
+                b2[pos+ew+1]==PIXELMAP_1) {
+                b1[pos] = PIXELMAP_1 ;
+            }
+        }
+    }
+    free(b2) ;
+
+    /* Dilation on the tile, image edges are 0 */
+    b0 = calloc(t->lx * t->ly, sizeof(binpix)) ;
+    for (j=0 ; j<t->ly ; j++) {
+        gj = t->y0 + j ;
+        if (gj==0 || gj==ly-1) continue ;
+        for (i=0 ; i<t->lx ; i++) {
+            gi = t->x0 + i ;
+            if (gi==0 || gi==lx-1) continue ;
+            pos = gi-ex0 + (gj-ey0)*ew ;
+            if (b1[pos-ew-1]==PIXELMAP_1 || b1[pos-ew]==PIXELMAP_1 ||
+                b1[pos-ew+1]==PIXELMAP_1 || b1[pos-1]==PIXELMAP_1 ||
+                b1[pos]==PIXELMAP_1 || b1[pos+1]==PIXELMAP_1 ||
+                b1[pos+ew-1]==PIXELMAP_1 || b1[pos+ew]==PIXELMAP_1 ||
+                b1[pos+ew+1]==PIXELMAP_1) {
+                b0[i + j*t->lx] = PIXELMAP_1 ;
+            }
+        }
+    }
+    free(b1) ;
+
+    /* Label */
+    t->lab = malloc(t->lx * t->ly * sizeof(int)) ;
+    t->nobj = tile_label(b0, t->lx, t->ly, t->lab) ;
+    free(b0) ;
+
+    /* Measure, as detected_compute_objstat() */
+    t->obj = malloc((t->nobj+1) * sizeof(tile_obj)) ;
+    for (l=0 ; l<t->nobj ; l++) {
+        o = t->obj + l ;
+        o->npix = 0 ;
+        o->sx = o->sy = o->sum = o->sqsum = 0.0 ;
+        o->min_x = o->max_x = -1 ;
+        o->min_y = o->max_y = -1 ;
+        o->min_i = o->max_i = 0.0 ;
+        o->top_y = -1 ;
+        o->right_x = -1 ;
+        o->left_x = lx ;
+        o->bottom_y = ly ;
+    }
+    for (j=0 ; j<t->ly ; j++) {
+        gj = t->y0 + j ;
+        for (i=0 ; i<t->lx ; i++) {
+            l = t->lab[i + j*t->lx] - 1 ;
+            if (l==-1) continue ;
+            gi = t->x0 + i ;
+            o = t->obj + l ;
+            o->sx += (double)gi ;
+            o->sy += (double)gj ;
+            o->npix ++ ;
+            if (gj<o->bottom_y) {
+                o->bottom_x = gi ;
+                o->bottom_y = gj ;
+            }
+            if (gj>o->top_y) {
+                o->top_x = gi ;
+                o->top_y = gj ;
+            }
+            if (gi>o->right_x) {
+                o->right_x = gi ;
+                o->right_y = gj ;
+            }
+            if (gi<o->left_x) {
+                o->left_x = gi ;
+                o->left_y = gj ;
+            }
+            pix = job->ref->data[gi + gj*lx] ;
+            o->sum += pix ;
+            o->sqsum += (pix*pix) ;
+            if (((double)pix<o->min_i) || (o->min_x==-1)) {
+                o->min_i = (double)pix ;
+                o->min_x = gi ;
+                o->min_y = gj ;
+            }
+            if (((double)pix>o->max_i) || (o->max_x==-1)) {
+                o->max_i = (double)pix ;
+                o->max_x = gi ;
+                o->max_y = gj ;
+            }
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Label the 4-connected objects of a binary map.
+  @param    map     Binary map.
+  @param    lx      Map size in x.
+  @param    ly      Map size in y.
+  @param    lab     Returned labels, 0 for the background.
+  @return   Number of objects.
+
+  Labels are given in the order of the first pixel of every object, as
+  intimage_labelize_pixelmap() does.
+ */
+/*----------------------------------------------------------------------------*/
+static int tile_label(binpix * map, int lx, int ly, int * lab)
+{
+    int     *   parent ;
+    int     *   num ;
+    int         nlab, nobj ;
+    int         i, j, pos, up, left ;
+
+    /* First pass: provisional labels, equivalences */
+    parent = malloc((lx*ly/2 + lx + 2) * sizeof(int)) ;
+    nlab = 0 ;
+    for (j=0 ; j<ly ; j++) {
+        for (i=0 ; i<lx ; i++) {
+            pos = i + j*lx ;
+            if (map[pos]!=PIXELMAP_1) {
+                lab[pos] = 0 ;
+                continue ;
+            }
+            up   = (j>0) ? lab[pos-lx] : 0 ;
+            left = (i>0) ? lab[pos-1] : 0 ;
+            if (up==0 && left==0) {
+                nlab++ ;
+                parent[nlab] = nlab ;
+                lab[pos] = nlab ;
+            } else if (up==0) {
+                lab[pos] = left ;
+            } else if (left==0) {
+                lab[pos] = up ;
+            } else {
+                tile_union(parent, up, left) ;
+                lab[pos] = left ;
+            }
+        }
+    }
+
+    /* Second pass: final labels in order of first pixel */
+    num = calloc(nlab+1, sizeof(int)) ;
+    nobj = 0 ;
+    for (pos=0 ; pos<lx*ly ; pos++) {
+        if (lab[pos]==0) continue ;
+        up = tile_find(parent, lab[pos]) ;
+        if (num[up]==0) num[up] = ++nobj ;
+        lab[pos] = num[up] ;
+    }
+    free(num) ;
+    free(parent) ;
+    return nobj ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Add the statistics of an object part to another.
+  @param    a       Object to update.
+  @param    b       Object part to add.
+  @return   void
+
+  Ties on extremities are resolved as in a scan of the whole image.
+ */
+/*----------------------------------------------------------------------------*/
+static void tile_merge(tile_obj * a, tile_obj * b)
+{
+    a->npix += b->npix ;
+    a->sx += b->sx ;
+    a->sy += b->sy ;
+    a->sum += b->sum ;
+    a->sqsum += b->sqsum ;
+    if (b->bottom_y<a->bottom_y ||
+        (b->bottom_y==a->bottom_y && b->bottom_x<a->bottom_x)) {
+        a->bottom_x = b->bottom_x ;
+        a->bottom_y = b->bottom_y ;
+    }
+    if (b->top_y>a->top_y ||
+        (b->top_y==a->top_y && b->top_x<a->top_x)) {
+        a->top_x = b->top_x ;
+        a->top_y = b->top_y ;
+    }
+    if (b->right_x>a->right_x ||
+        (b->right_x==a->right_x && b->right_y<a->right_y)) {
+        a->right_x = b->right_x ;
+        a->right_y = b->right_y ;
+    }
+    if (b->left_x<a->left_x ||
+        (b->left_x==a->left_x && b->left_y<a->left_y)) {
+        a->left_x = b->left_x ;
+        a->left_y = b->left_y ;
+    }
+    if (b->min_i<a->min_i ||
+        (b->min_i==a->min_i && (b->min_y<a->min_y ||
+                                (b->min_y==a->min_y && b->min_x<a->min_x)))) {
+        a->min_i = b->min_i ;
+        a->min_x = b->min_x ;
+        a->min_y = b->min_y ;
+    }
+    if (b->max_i>a->max_i ||
+        (b->max_i==a->max_i && (b->max_y<a->max_y ||
+                                (b->max_y==a->max_y && b->max_x<a->max_x)))) {
+        a->max_i = b->max_i ;
+        a->max_x = b->max_x ;
+        a->max_y = b->max_y ;
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Find the root of a label in a union-find forest.
+  @param    parent  Forest.
+  @param    k       Label.
+  @return   Root label, the smallest label of its set.
+ */
+/*----------------------------------------------------------------------------*/
+static int tile_find(int * parent, int k)
+{
+    while (parent[k]!=k) {
+        parent[k] = parent[parent[k]] ;
+        k = parent[k] ;
+    }
+    return k ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Merge the sets of two labels in a union-find forest.
+  @param    parent  Forest.
+  @param    a       First label.
+  @param    b       Second label.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+static void tile_union(int * parent, int a, int b)
+{
+    a = tile_find(parent, a) ;
+    b = tile_find(parent, b) ;
+    if (a<b) parent[b] = a ;
+    else if (b<a) parent[a] = b ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Compare two objects by position of their first pixel.
+  @param    a   First tile_key.
+  @param    b   Second tile_key.
+  @return   Negative, 0 or positive as for qsort().
+ */
+/*----------------------------------------------------------------------------*/
+static int tile_key_cmp(const void * a, const void * b)
+{
+    const tile_key * ka = (const tile_key *)a ;
+    const tile_key * kb = (const tile_key *)b ;
+
+    if (ka->y != kb->y) return (ka->y < kb->y) ? -1 : 1 ;
+    if (ka->x != kb->x) return (ka->x < kb->x) ? -1 : 1 ;
+    return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Compute the median of one object.
+  @param    arg     Tile job.
+  @param    k       Index of the object.
+  @param    worker  Unused.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+static void tile_median_task(void * arg, int k, int worker)
+{
+    tile_job    *   job ;
+    detected    *   det ;
+    tile        *   t ;
+    pixelvalue  *   buf ;
+    int             tx, ty, i, j, l ;
+    int             x0, x1, y0, y1 ;
+    int             count ;
+
+    job = (tile_job *)arg ;
+    det = job->out ;
+    buf = malloc(det->obj_nbpix[k] * sizeof(pixelvalue)) ;
+    count = 0 ;
+    for (ty=det->bottom_y[k]/TILE_SIZE ; ty<=det->top_y[k]/TILE_SIZE ; ty++) {
+        for (tx=det->left_x[k]/TILE_SIZE ;
+             tx<=det->right_x[k]/TILE_SIZE ; tx++) {
+            t = job->tiles + tx + ty*job->ntx ;
+            x0 = det->left_x[k] > t->x0 ? det->left_x[k] : t->x0 ;
+            y0 = det->bottom_y[k] > t->y0 ? det->bottom_y[k] : t->y0 ;
+            x1 = det->right_x[k] < t->x0+t->lx-1 ?
+                 det->right_x[k] : t->x0+t->lx-1 ;
+            y1 = det->top_y[k] < t->y0+t->ly-1 ?
+                 det->top_y[k] : t->y0+t->ly-1 ;
+            for (j=y0 ; j<=y1 ; j++) {
+                for (i=x0 ; i<=x1 ; i++) {
+                    l = t->lab[i-t->x0 + (j-t->y0)*t->lx] ;
+                    if (l && job->fin[t->first + l - 1]==k) {
+                        buf[count++] = job->ref->data[i + j*job->ref->lx] ;
+                    }
+                }
+            }
+        }
+    }
+    det->obj_median[k] = median_pixelvalue(buf, count) ;
+    free(buf) ;
+}
+/* vim: set ts=4 et sw=4 tw=75 */
@@ -20,6 +20,7 @@
  -----------------------------------------------------------------------------*/
 
 #include "detector.h"
+#include "cube_zlines.h"
 #include "doubles.h"
 #include "dstats.h"
 #include "random.h"
@@ -489,15 +490,17 @@ cube_t * detector_linearity_fit(
         int         deg)
 {
     cube_t      *   fitres ;
-    image_t     *   timeline ;
-    int             pos ;
-    int             npix ;
+    cube_zlines *   zl ;
+    zline_iter      it ;
+    pixelvalue  *   timeline ;
+    int             pos, pos0 ;
+    int             npix, chunk ;
     double          f, f_prod ;
     double          y, err, sq_err ;
     matrix      *   mx, 
 				*	ma, 
 				*	mb ;
-    int             i, j, k, l ;
+    int             k, l ;
 
     if (in==NULL || dit==NULL) return NULL ;
     if ((deg!=3) && (deg!=4)) return NULL ;
@@ -516,27 +519,28 @@ cube_t * detector_linearity_fit(
     mb = matrix_new(1, in->np);
 
     /*
-     * Sorry for the double loop, it is not truly needed.
-     * The only interest is to put a compute_status that
-     * does not print out too often, otherwise it slows down
-     * the already heavy computation.
+     * Time lines are transposed to z-major order by chunks of pixels,
+     * which also keeps compute_status from printing out too often.
      */
-    for (j=0 ; j<in->ly ; j++) {
-        compute_status("fitting polynomial...", j, in->ly, 1);
-        for (i=0 ; i<in->lx ; i++) {
-            pos = i + j * in->lx ;
-
-            /* Extract time line */
-            timeline = cube_get_z(in, pos);
-            if (timeline==NULL) {
-                e_error("extracting time line at pos %d: aborting", pos);
-                cube_del(fitres);
-                return NULL ;
-            }
+    chunk = cube_zlines_chunk(in->np) ;
+    for (pos0=0 ; pos0<npix ; pos0+=chunk) {
+        compute_status("fitting polynomial...", pos0, npix, 1);
+        zl = cube_zlines_new(in, pos0, npix-pos0<chunk ? npix-pos0 : chunk);
+        if (zl==NULL) {
+            e_error("extracting time lines at pos %d: aborting", pos0);
+            matrix_del(ma);
+            matrix_del(mb);
+            cube_del(fitres);
+            return NULL ;
+        }
+        cube_zlines_iter_init(&it, zl);
+        while (cube_zlines_iter_next(&it)) {
+            pos = it.pos ;
+            timeline = it.line ;
 
             /* Fill in matrices */
             for (k=0 ; k<in->np ; k++) {
-                f = (double)timeline->data[k] ;
+                f = (double)timeline[k] ;
                 f_prod = f ;
                 for (l=0 ; l<deg ; l++) {
                     ma->m[k+l*in->np] = f_prod ;
@@ -570,8 +574,8 @@ cube_t * detector_linearity_fit(
                 fitres->plane[deg]->data[pos] = (pixelvalue)sq_err ;
                 matrix_del(mx);
             }
-            image_del(timeline);
         }
+        cube_zlines_del(zl);
     }
 
     /* Delete matrices */
@@ -230,7 +230,9 @@ pixelvalue * image_getcol(
   as i + j*lx, where (i,j) is the position on the detector, in the C
   coordinate convention (i runs from 0 to lx-1, j runs from 0 to ly-1).
  
-  The returned image must be freed using image_del().
+  The returned image must be freed using image_del(). To process the
+  time lines of many pixels, use cube_zlines_new() instead, which
+  transposes them efficiently.
  */
 /*----------------------------------------------------------------------------*/
 image_t * cube_get_z(
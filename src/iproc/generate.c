@@ -20,6 +20,8 @@
  -----------------------------------------------------------------------------*/
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include "config.h"
 #include "generate.h"
@@ -27,6 +29,17 @@
 #include "random.h"
 #include "pi.h"
 #include "image_intops.h"
+#include "image_io.h"
+#include "file_handling.h"
+#include "parallel.h"
+#include "prodcache.h"
+#include "e_version.h"
+#include "filename.h"
+#include "qfits.h"
+
+#ifdef HAS_PTHREADS
+#include <pthread.h>
+#endif
 
 /*-----------------------------------------------------------------------------
    								Defines
@@ -40,6 +53,60 @@
 /* Seconds to radians conversion */
 #define SEC2RAD					(206265)
 
+/* Number of wavelengths sampled in the filter bandwidth for the OTF */
+#define OTF_NLAMBDA				9
+/* Number of squared radii computed by one OTF profile task */
+#define OTF_PROFILE_CHUNK		4096
+
+/* Number of PSFs kept in memory by image_gen_psf() */
+#define PSF_CACHE_SZ			8
+
+/*-----------------------------------------------------------------------------
+   								Private types
+ -----------------------------------------------------------------------------*/
+
+/* Shared state of the OTF generation tasks */
+typedef struct _otf_job_ {
+	/* Cut-off frequency in pixels for each wavelength */
+	double			fc[OTF_NLAMBDA] ;
+	double			obs_ratio ;
+	/* Radial profile of the OTF, indexed by the squared radius */
+	double		*	profile ;
+	int				nprofile ;
+	/* Detector pixel transfer function along one axis */
+	double		*	sinc ;
+	int				size ;
+	image_t		*	otf ;
+} otf_job ;
+
+/* A PSF kept in memory, with its generation parameters */
+typedef struct _psf_cache_entry_ {
+	double			m1 ;
+	double			m2 ;
+	double			lam ;
+	double			dlam ;
+	double			pscale ;
+	int				size ;
+	image_t		*	psf ;
+	unsigned long	used ;
+} psf_cache_entry ;
+
+/*-----------------------------------------------------------------------------
+   								Static variables
+ -----------------------------------------------------------------------------*/
+
+static psf_cache_entry	psf_cache[PSF_CACHE_SZ] ;
+static unsigned long	psf_cache_clock = 0 ;
+
+#ifdef HAS_PTHREADS
+static pthread_mutex_t	psf_cache_lock = PTHREAD_MUTEX_INITIALIZER ;
+#define psf_cache_mutex_lock()		pthread_mutex_lock(&psf_cache_lock)
+#define psf_cache_mutex_unlock()	pthread_mutex_unlock(&psf_cache_lock)
+#else
+#define psf_cache_mutex_lock()
+#define psf_cache_mutex_unlock()
+#endif
+
 /*-----------------------------------------------------------------------------
    							Function prototypes
  -----------------------------------------------------------------------------*/
@@ -51,6 +118,12 @@ static double PSF_G(double f, double u) ;
 static double PSF_sinc(double x) ;
 static double PSF_TelOTF(double f, double u) ;
 
+static void otf_profile_task(void * arg, int task, int worker) ;
+static void otf_map_task(void * arg, int task, int worker) ;
+static image_t * psf_compute(double, double, double, double, double, int) ;
+static char * psf_cache_filename(char *, double, double, double, double,
+                                 double, int) ;
+
 /*-----------------------------------------------------------------------------
   							Function codes
  -----------------------------------------------------------------------------*/
@@ -439,16 +512,12 @@ image_t * image_gen_otf(
     	int  	size,
     	double  pscale)
 {
-    image_t    *	otf_image ;
-    double   		obs_ratio ;  /* m1 / m2    */
+    otf_job			job ;
     double   		f_max ;      /* cut-off frequency        */
+    double			fc_max ;
     int     		pix0 ;      /* Pixel corresponding to the zero frequency */
-    int     		i, j, k ;
-    double  		a, x, y ;
-    double  		f, r, fc, invfc, lambda ;
-    double  		sincy ;
-    double  		invsize ;
-    register int	 pos ;
+    int     		i, k ;
+    double  		lambda ;
 
     /* No test is made at this point to see if the values are correctly */
     /* set, it is up to the calling function to check that. */
@@ -459,53 +528,101 @@ image_t * image_gen_otf(
     dlam /= (double)1.0e6 ;
 
     /* Obscuration ratio    */
-    obs_ratio = m2 / m1 ;
+    job.obs_ratio = m2 / m1 ;
     
     /* Pixel corresponding to the zero frequency    */
     pix0 = size/2 ;
-    invsize = (double)1.0 / (double)size ;
 
     /* Cut-off frequency in pixels  */
     f_max = m1 * pscale * (double)size / lam ;
 
+    /* Intermediate cut-off frequencies, one per wavelength */
+    fc_max = 0.0 ;
+    for (k=1 ; k<=OTF_NLAMBDA ; k++) {
+        lambda = (double)(lam - dlam*(double)(k-5)/8.0) ;
+        job.fc[k-1] = (double)f_max * (double)lam / lambda ; 
+        if (job.fc[k-1]>fc_max) fc_max = job.fc[k-1] ;
+    }
+
     /* Allocate for output image    */
-    otf_image = image_new(size, size) ;
-	if (otf_image==NULL) return NULL ;
+    job.otf = image_new(size, size) ;
+	if (job.otf==NULL) return NULL ;
+	job.size = size ;
+
+    /*
+     * The telescope OTF only depends on the distance to the zero
+     * frequency, and the detector pixels convolution is separable.
+     * The radial profile is computed once for all squared radii up to
+     * the highest cut-off frequency, then mapped on the image.
+     */
+    job.nprofile = 2 * pix0 * pix0 + 1 ;
+    if (fc_max * fc_max + 1.0 < (double)job.nprofile) {
+        job.nprofile = (int)(fc_max * fc_max) + 1 ;
+    }
+    job.profile = malloc(job.nprofile * sizeof(double)) ;
+    job.sinc = malloc(size * sizeof(double)) ;
+    for (i=0 ; i<size ; i++) {
+        job.sinc[i] = PSF_sinc(PI_NUMB * (double)(i-pix0) / (double)size) ;
+    }
+    eclipse_parallel_run(otf_profile_task, &job,
+                         (job.nprofile + OTF_PROFILE_CHUNK - 1) /
+                         OTF_PROFILE_CHUNK) ;
+    eclipse_parallel_run(otf_map_task, &job, size) ;
+    free(job.profile) ;
+    free(job.sinc) ;
+    return job.otf ;
+}
 
-    /* Now compute the OTF  */
-    /* OPTIMIZED CODE !!! LIMITED READABILITY !!!   */
 
-    for (k=1 ; k<=9 ; k++) {    /* iteration on the wavelength  */
-        /* Compute intermediate cut-off frequency   */
-        lambda = (double)(lam - dlam*(double)(k-5)/8.0) ;
-        fc = (double)f_max * (double)lam / lambda ; 
-        invfc = 1.0 / fc ;
-    
-        /* Convolution with the detector pixels */
-        pos = 0 ;
-        for (j=0 ; j<size ; j++) {
-            y = (double)(j-pix0) ;
-            sincy = PSF_sinc(PI_NUMB * y * invsize) ;
-            pos = j * size ;
-            for (i=0 ; i<size ; i++) {
-                x = (double)(i-pix0) ;
-                r = sqrt(x*x + y*y) ;
-                f = r * invfc ;
-                if (f<1.0) {
-                    if (r<0.1)
-                        a = 1.0 ;
-                    else {
-                        a = PSF_TelOTF(f,obs_ratio) * 
-                            PSF_sinc(PI_NUMB * x * invsize) * sincy ;
-                    }
-                } else {
-                    a = 0.0 ;
-                }
-                otf_image->data[pos++] += (pixelvalue)(a * INV9) ;
+/*----------------------------------------------------------------------------*
+ * OTF radial profile for a range of squared radii
+ *----------------------------------------------------------------------------*/
+static void otf_profile_task(void * arg, int task, int worker)
+{
+    otf_job	*	job = (otf_job*)arg ;
+    int			r2, r2_end ;
+    int			k ;
+    double		r, f, a ;
+
+    r2_end = (task + 1) * OTF_PROFILE_CHUNK ;
+    if (r2_end > job->nprofile) r2_end = job->nprofile ;
+    for (r2=task * OTF_PROFILE_CHUNK ; r2<r2_end ; r2++) {
+        r = sqrt((double)r2) ;
+        a = 0.0 ;
+        /* iteration on the wavelength  */
+        for (k=0 ; k<OTF_NLAMBDA ; k++) {
+            f = r / job->fc[k] ;
+            if (f<1.0) {
+                if (r<0.1) a += 1.0 ;
+                else a += PSF_TelOTF(f, job->obs_ratio) ;
             }
         }
+        job->profile[r2] = a * INV9 ;
+    }
+}
+
+
+/*----------------------------------------------------------------------------*
+ * OTF image, one row
+ *----------------------------------------------------------------------------*/
+static void otf_map_task(void * arg, int j, int worker)
+{
+    otf_job		*	job = (otf_job*)arg ;
+    pixelvalue	*	row ;
+    int				pix0 ;
+    int				i, x, y2, r2 ;
+
+    pix0 = job->size / 2 ;
+    y2 = (j - pix0) * (j - pix0) ;
+    row = job->otf->data + j * job->size ;
+    for (i=0 ; i<job->size ; i++) {
+        x = i - pix0 ;
+        r2 = x * x + y2 ;
+        if (r2<job->nprofile) {
+            row[i] = (pixelvalue)(job->profile[r2] * job->sinc[i] *
+                                  job->sinc[j]) ;
+        }
     }
-    return otf_image ;
 }
 
 
@@ -596,6 +713,11 @@ static double PSF_TelOTF(
   conditions, and applying a Fourier transform to it to bring it back to real 
   space. The returned PSF is normalized to unity flux, to help Strehl ratio 
   computations.
+
+  The last generated PSFs are kept in memory, and also on disk in the
+  product cache directory if it is set (see prodcache.h), so that the
+  PSF is computed only once for a given set of parameters. The returned
+  image is a copy, to deallocate with image_del().
  */
 /*----------------------------------------------------------------------------*/
 image_t * image_gen_psf(
@@ -605,6 +727,112 @@ image_t * image_gen_psf(
     	double   dlam,
     	double   pscale,
     	int		 size)
+{
+    psf_cache_entry	*	e ;
+    image_t			*	psf ;
+    char			*	cachename ;
+    char				name[FILENAMESZ] ;
+    char				tmpname[FILENAMESZ] ;
+    int					len ;
+    int					i ;
+
+    /* Look for the PSF in memory */
+    psf = NULL ;
+    cachename = NULL ;
+    psf_cache_mutex_lock() ;
+    for (i=0 ; i<PSF_CACHE_SZ ; i++) {
+        e = psf_cache + i ;
+        if ((e->psf!=NULL) && (e->m1==m1) && (e->m2==m2) && (e->lam==lam) &&
+            (e->dlam==dlam) && (e->pscale==pscale) && (e->size==size)) {
+            e->used = ++psf_cache_clock ;
+            psf = image_copy(e->psf) ;
+            break ;
+        }
+    }
+    /* qfits_memmd5() is not reentrant */
+    if (psf==NULL) {
+        cachename = psf_cache_filename(name, m1, m2, lam, dlam, pscale, size);
+    }
+    psf_cache_mutex_unlock() ;
+    if (psf!=NULL) return psf ;
+
+    /* Look for it on disk, or compute it */
+    if ((cachename!=NULL) && (file_exists(cachename)==1)) {
+        psf = image_load(cachename) ;
+        if ((psf!=NULL) && ((psf->lx!=size) || (psf->ly!=size))) {
+            image_del(psf) ;
+            psf = NULL ;
+        }
+    }
+    if (psf==NULL) {
+        psf = psf_compute(m1, m2, lam, dlam, pscale, size) ;
+        if (psf==NULL) return NULL ;
+        if (cachename!=NULL) {
+            /* Write under a temporary name: other processes may read it */
+            len = snprintf(tmpname, FILENAMESZ, "%s.%ld", cachename,
+                           (long)getpid()) ;
+            if ((len>=0) && (len<FILENAMESZ)) {
+                image_save_fits(psf, tmpname, BPP_DEFAULT) ;
+                if (rename(tmpname, cachename)!=0) remove(tmpname) ;
+            }
+        }
+    }
+
+    /* Keep it in memory, replacing the least recently used PSF */
+    psf_cache_mutex_lock() ;
+    e = psf_cache ;
+    for (i=1 ; i<PSF_CACHE_SZ ; i++) {
+        if (psf_cache[i].used < e->used) e = psf_cache + i ;
+    }
+    if (e->psf!=NULL) image_del(e->psf) ;
+    e->m1 = m1 ;
+    e->m2 = m2 ;
+    e->lam = lam ;
+    e->dlam = dlam ;
+    e->pscale = pscale ;
+    e->size = size ;
+    e->psf = image_copy(psf) ;
+    e->used = ++psf_cache_clock ;
+    psf_cache_mutex_unlock() ;
+    return psf ;
+}
+
+
+/*----------------------------------------------------------------------------*
+ * Name of the PSF file in the product cache, NULL if there is no cache.
+ *----------------------------------------------------------------------------*/
+static char * psf_cache_filename(
+    	char *   name,
+    	double   m1,
+    	double   m2,
+    	double   lam,
+    	double   dlam,
+    	double   pscale,
+    	int		 size)
+{
+    char			key[512] ;
+    char		*	dir ;
+    int				len ;
+
+    if ((dir=prodcache_get_dir())==NULL) return NULL ;
+    sprintf(key, "image_gen_psf %s %.17g %.17g %.17g %.17g %.17g %d",
+            get_eclipse_version(), m1, m2, lam, dlam, pscale, size) ;
+    len = snprintf(name, FILENAMESZ, "%s/psf_%s.fits", dir,
+                   qfits_memmd5(key, (int)strlen(key))) ;
+    if ((len<0) || (len>=FILENAMESZ)) return NULL ;
+    return name ;
+}
+
+/*----------------------------------------------------------------------------*
+ * PSF computation for image_gen_psf()
+ *----------------------------------------------------------------------------*/
+static image_t * psf_compute(
+    	double   m1,
+    	double   m2,
+    	double   lam,
+    	double   dlam,
+    	double   pscale,
+    	int		 size)
 {
     image_t    *	otf_image ;
     cube_t     *	complex_psf ;
@@ -23,6 +23,230 @@
 #include <stdlib.h>
 
 #include "histogram.h"
+#include "median.h"
+#include "parallel.h"
+
+/*----------------------------------------------------------------------------
+   								Defines
+ ---------------------------------------------------------------------------*/
+
+/* Number of pixels handled by one parallel task */
+#define HISTO_CHUNK			65536
+/* Number of bins used by histogram_kth_smallest() at each level */
+#define HISTO_SELECT_NBIN	4096
+/* Maximal number of levels of histogram_kth_smallest() */
+#define HISTO_MAXLEVEL		4
+/* Below this number of pixels, selection is done by kth_smallest() */
+#define HISTO_SELECT_MIN	65536
+/* Bins holding less than npix/HISTO_GATHER_DIV values are not refined */
+#define HISTO_GATHER_DIV	8
+/* Sample size and rank margin used to guess the first level range */
+#define HISTO_SAMPLE		4096
+#define HISTO_MARGIN		128
+
+/* Binning modes */
+#define HISTO_DROP			0	/* Out of range values are dropped */
+#define HISTO_UNDER			1	/* Values out of range go to extra slots */
+#define HISTO_CLAMP			2	/* Values go to the first or last bin */
+
+/*----------------------------------------------------------------------------
+   								Private types
+ ---------------------------------------------------------------------------*/
+
+/*
+ * One binning of the pixel values. HISTO_DROP is the binning of
+ * histogram_compute(). The selection levels only need slot indices to
+ * increase with the values: they are computed without branches from a
+ * clamped scaled value. In HISTO_UNDER mode, slot 0 gets the values
+ * below the range, slots 1 to nbin the bins and slot nbin+1 the values
+ * above the range. Refinement levels only see the values which fell in
+ * the target slot of all previous levels, they use HISTO_CLAMP mode to
+ * catch rounding errors on the range of that slot.
+ */
+typedef struct _histo_level_ {
+	pixelvalue		min ;
+	pixelvalue		max ;
+	double			binsize ;
+	double			scale ;
+	double			dmin ;
+	double			dmax ;
+	int				nbin ;
+	int				mode ;
+	int				target ;
+} histo_level ;
+
+typedef struct _histo_job_ {
+	pixelvalue	*	data ;
+	int				npix ;
+	/* Binning levels, the last one is being computed */
+	histo_level		level[HISTO_MAXLEVEL] ;
+	int				nlevel ;
+	/* Private slots, nbin+2 per worker */
+	int			*	bins ;
+	/* Min and max of each task */
+	pixelvalue	*	tmin ;
+	pixelvalue	*	tmax ;
+} histo_job ;
+
+/*----------------------------------------------------------------------------
+   								Private functions
+ ---------------------------------------------------------------------------*/
+
+/* Slot of a value in a selection level */
+static int histo_slot(histo_level * l, pixelvalue x)
+{
+	double	d ;
+
+	d = ((double)x - (double)l->min) * l->scale ;
+	/* NaN values end up in the last slot */
+	d = (d <= l->dmax) ? d : l->dmax ;
+	d = (d >= l->dmin) ? d : l->dmin ;
+	return (int)(d + 1.0) ;
+}
+
+/* Slot of a value in the last level, -1 if out of a previous target */
+static int histo_slot_levels(histo_job * job, pixelvalue x)
+{
+	int		l ;
+
+	for (l=0 ; l<job->nlevel-1 ; l++) {
+		if (histo_slot(job->level+l, x) != job->level[l].target) return -1 ;
+	}
+	return histo_slot(job->level+l, x) ;
+}
+
+/* Is a value in the target slot of all levels? */
+static int histo_in_target(histo_job * job, pixelvalue x)
+{
+	int		l ;
+
+	for (l=0 ; l<job->nlevel ; l++) {
+		if (histo_slot(job->level+l, x) != job->level[l].target) return 0 ;
+	}
+	return 1 ;
+}
+
+static void histo_minmax_task(void * arg, int task, int worker)
+{
+	histo_job	*	job ;
+	pixelvalue	*	pt ;
+	pixelvalue		min, max ;
+	int				i, n ;
+
+	job = (histo_job*)arg ;
+	pt = job->data + task * HISTO_CHUNK ;
+	n = job->npix - task * HISTO_CHUNK ;
+	if (n>HISTO_CHUNK) n = HISTO_CHUNK ;
+	min = max = pt[0] ;
+	for (i=1 ; i<n ; i++) {
+		if (pt[i] < min) min = pt[i] ;
+		if (pt[i] > max) max = pt[i] ;
+	}
+	job->tmin[task] = min ;
+	job->tmax[task] = max ;
+}
+
+static void histo_bin_task(void * arg, int task, int worker)
+{
+	histo_job	*	job ;
+	histo_level	*	l ;
+	pixelvalue	*	pt ;
+	pixelvalue		min, max ;
+	int			*	bins ;
+	int				i, n, b, nbin ;
+
+	job = (histo_job*)arg ;
+	l = job->level + job->nlevel - 1 ;
+	nbin = l->nbin ;
+	bins = job->bins + worker * (nbin+2) ;
+	pt = job->data + task * HISTO_CHUNK ;
+	n = job->npix - task * HISTO_CHUNK ;
+	if (n>HISTO_CHUNK) n = HISTO_CHUNK ;
+
+	if (l->mode==HISTO_DROP) {
+		min = l->min ;
+		max = l->max ;
+		for (i=0 ; i<n ; i++) {
+			if ((pt[i] <= max) && (pt[i] >= min)) {
+				b = (int)((pt[i] - min) / l->binsize) ;
+				if (b == nbin) b-- ;
+				bins[b]++ ;
+			}
+		}
+	} else if (job->nlevel==1) {
+		for (i=0 ; i<n ; i++) bins[histo_slot(l, pt[i])]++ ;
+	} else {
+		for (i=0 ; i<n ; i++) {
+			if ((b=histo_slot_levels(job, pt[i]))>=0) bins[b]++ ;
+		}
+	}
+}
+
+/* Min and max of the job pixels, in one pass */
+static void histo_minmax(histo_job * job, pixelvalue * min, pixelvalue * max)
+{
+	int		ntasks ;
+	int		t ;
+
+	ntasks = (job->npix + HISTO_CHUNK - 1) / HISTO_CHUNK ;
+	job->tmin = malloc(ntasks * sizeof(pixelvalue)) ;
+	job->tmax = malloc(ntasks * sizeof(pixelvalue)) ;
+	eclipse_parallel_run(histo_minmax_task, job, ntasks) ;
+	*min = job->tmin[0] ;
+	*max = job->tmax[0] ;
+	for (t=1 ; t<ntasks ; t++) {
+		if (job->tmin[t] < *min) *min = job->tmin[t] ;
+		if (job->tmax[t] > *max) *max = job->tmax[t] ;
+	}
+	free(job->tmin) ;
+	free(job->tmax) ;
+}
+
+/* Histogram of the last job level into the nout first provided slots */
+static void histo_fill(histo_job * job, int * array, int nout)
+{
+	int		nslot, nworkers ;
+	int		i, w ;
+
+	nslot = job->level[job->nlevel-1].nbin + 2 ;
+	nworkers = eclipse_get_nthreads() ;
+	job->bins = calloc(nworkers * nslot, sizeof(int)) ;
+	eclipse_parallel_run(histo_bin_task, job,
+			(job->npix + HISTO_CHUNK - 1) / HISTO_CHUNK) ;
+	for (i=0 ; i<nout ; i++) array[i] = job->bins[i] ;
+	for (w=1 ; w<nworkers ; w++) {
+		for (i=0 ; i<nout ; i++) array[i] += job->bins[w*nslot+i] ;
+	}
+	free(job->bins) ;
+}
+
+/* Set the range of a selection level */
+static void histo_set_range(
+		histo_level	*	l,
+		pixelvalue		min,
+		pixelvalue		max,
+		int				mode)
+{
+	l->min = min ;
+	l->max = max ;
+	l->nbin = HISTO_SELECT_NBIN ;
+	l->mode = mode ;
+	l->binsize = ((double)max - (double)min) / (double)l->nbin ;
+	if (max > min) {
+		/* Slightly shrunk, so that max falls in the last bin */
+		l->scale = (1.0 - 1e-12) / l->binsize ;
+	} else {
+		/* Null range: only values equal to min fall in bin 1 */
+		l->scale = 1e300 ;
+	}
+	if (mode==HISTO_UNDER) {
+		l->dmin = -1.0 ;
+		l->dmax = (double)l->nbin ;
+	} else {
+		l->dmin = 0.0 ;
+		l->dmax = (double)l->nbin - 0.5 ;
+	}
+}
 
 /*----------------------------------------------------------------------------
   							Function codes
@@ -42,6 +266,11 @@
   only pixels between @c min and @c max, and sampling over @c nbin
   bins. It returns a newly allocated histogram object, which must
   be deallocated using histogram_del().
+
+  The image is read at most twice: once to find its min and max if
+  they are requested, once to fill the bins. Both passes are shared
+  among the worker threads, each of them filling private bins which
+  are summed at the end.
  */
 /*--------------------------------------------------------------------------*/
 histogram * histogram_compute(
@@ -51,8 +280,8 @@ histogram * histogram_compute(
 		pixelvalue		max)
 {
 	histogram	*	h ;
-	int				bin_id ;
-	int				i ;
+	histo_job		job ;
+	pixelvalue		dmin, dmax ;
 
 	/* Test min # of bins */
 	if (nbin < 1) {
@@ -64,21 +293,27 @@ histogram * histogram_compute(
 		return NULL ;
 	}
 
+	job.data = in->data ;
+	job.npix = in->lx * in->ly ;
+
 	/* Use or not the image min and max	 */
-	if (min <= (MIN_PIX_VALUE+1)) min = image_getmin(in) ;
-	if (max >= (MAX_PIX_VALUE-1)) max = image_getmax(in) ;
+	if ((min <= (MIN_PIX_VALUE+1)) || (max >= (MAX_PIX_VALUE-1))) {
+		histo_minmax(&job, &dmin, &dmax) ;
+		if (min <= (MIN_PIX_VALUE+1)) min = dmin ;
+		if (max >= (MAX_PIX_VALUE-1)) max = dmax ;
+	}
 
 	/* Create the histogram */
 	h = histogram_new(nbin, min, max) ;
 
 	/* Compute the histogram */
-	for (i=0 ; i<(in->lx * in->ly) ; i++) {
-		if ((in->data[i] <= max) && (in->data[i] >= min)) {
-			bin_id = (int)((in->data[i] - min) / h->binsize) ;
-			if (bin_id == nbin) bin_id-- ;
-			(h->array[bin_id]) ++ ;
-		}
-	}
+	job.nlevel = 1 ;
+	job.level[0].min = min ;
+	job.level[0].max = max ;
+	job.level[0].binsize = h->binsize ;
+	job.level[0].nbin = nbin ;
+	job.level[0].mode = HISTO_DROP ;
+	histo_fill(&job, h->array, nbin) ;
 
 	/* Return */
 	return h ;
@@ -169,6 +404,180 @@ pixelvalue histogram_find_mode(histogram * histo)
 }
 
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find a percentile of a histogram.
+  @param    histo       The histogram.
+  @param    fraction    Fraction of the samples below the percentile.
+  @return   1 pixelvalue
+
+  This function walks the cumulative counts of a histogram (as returned
+  by histogram_compute()) to find the value below which the requested
+  fraction of the sampled values lie, interpolating linearly inside the
+  bin where that fraction is reached. A fraction of 0.5 gives an
+  estimate of the median. The precision is limited by the bin size.
+ */
+/*--------------------------------------------------------------------------*/
+pixelvalue histogram_find_percentile(histogram * histo, double fraction)
+{
+	double			total ;
+	double			target ;
+	double			accu ;
+	int				i ;
+
+	if (histo==NULL) return 0 ;
+	if (fraction<0.0) fraction = 0.0 ;
+	if (fraction>1.0) fraction = 1.0 ;
+
+	total = 0.0 ;
+	for (i=0 ; i<histo->nbin ; i++) total += (double)histo->array[i] ;
+	target = fraction * total ;
+
+	accu = 0.0 ;
+	for (i=0 ; i<histo->nbin-1 ; i++) {
+		if ((histo->array[i]>0) &&
+			(accu + (double)histo->array[i] >= target)) break ;
+		accu += (double)histo->array[i] ;
+	}
+	if (histo->array[i]>0) {
+		return (pixelvalue)((double)histo->min + histo->binsize *
+				((double)i + (target-accu) / (double)histo->array[i])) ;
+	}
+	return (pixelvalue)((double)histo->min + histo->binsize * (double)i) ;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find the kth smallest value of an array using histograms.
+  @param    data    Array of pixelvalues.
+  @param    npix    Number of values in the array.
+  @param    k       Rank of the value to find.
+  @return   1 pixelvalue
+
+  Returns the same value as kth_smallest(), i.e. the minimum for k=0
+  and the maximum for k=npix-1, but leaves the input array untouched.
+
+  Large arrays are not copied. The bin holding the requested rank is
+  found from a histogram of the values in a range guessed from a small
+  sample of the array (or over the full range of values if the guess
+  was wrong), then from a finer histogram of the values of that bin,
+  and so on until few enough values are left to be gathered and passed
+  to kth_smallest(). Histograms are computed in parallel. Small arrays
+  are copied and passed to kth_smallest() directly.
+ */
+/*--------------------------------------------------------------------------*/
+pixelvalue histogram_kth_smallest(pixelvalue * data, int npix, int k)
+{
+	histo_job		job ;
+	histo_level	*	l ;
+	pixelvalue	*	buf ;
+	pixelvalue		kth, min, max ;
+	int			*	counts ;
+	int				total, prev, window ;
+	int				i, n, lo, hi ;
+
+	if (data==NULL || npix<1) return 0 ;
+	if (k<0) k = 0 ;
+	if (k>=npix) k = npix-1 ;
+
+	n = 0 ;
+	job.data = data ;
+	job.npix = npix ;
+	job.nlevel = 0 ;
+	if (npix >= HISTO_SELECT_MIN) {
+		/* Guess a first level range around rank k from a sample */
+		buf = malloc(HISTO_SAMPLE * sizeof(pixelvalue)) ;
+		for (i=0 ; i<HISTO_SAMPLE ; i++) {
+			buf[i] = data[(int)(((double)i+0.5)*(double)npix/HISTO_SAMPLE)] ;
+		}
+		i = (int)((double)k * (double)HISTO_SAMPLE / (double)npix) ;
+		lo = (i-HISTO_MARGIN<0) ? 0 : i-HISTO_MARGIN ;
+		hi = (i+HISTO_MARGIN>=HISTO_SAMPLE) ? HISTO_SAMPLE-1 : i+HISTO_MARGIN ;
+		min = kth_smallest(buf, HISTO_SAMPLE, lo) ;
+		max = kth_smallest(buf, HISTO_SAMPLE, hi) ;
+		free(buf) ;
+		histo_set_range(job.level, min, max, HISTO_UNDER) ;
+		window = 1 ;
+
+		counts = malloc((HISTO_SELECT_NBIN+2) * sizeof(int)) ;
+		prev = npix ;
+		while (1) {
+			l = job.level + job.nlevel ;
+			job.nlevel++ ;
+			histo_fill(&job, counts, l->nbin+2) ;
+			/* Find the slot where rank k falls */
+			total = counts[0] ;
+			for (i=1 ; i<=l->nbin && total<=k ; i++) {
+				if (total + counts[i] > k) break ;
+				total += counts[i] ;
+			}
+			if ((total>k) || (i>l->nbin)) {
+				/* Rank k is out of the first level range */
+				job.nlevel = 0 ;
+				if (!window) break ;
+				/* Use the full range, if this fails there are NaNs */
+				histo_minmax(&job, &min, &max) ;
+				if (min == max) {
+					free(counts) ;
+					return min ;
+				}
+				histo_set_range(job.level, min, max, HISTO_UNDER) ;
+				window = 0 ;
+				continue ;
+			}
+			l->target = i ;
+			k -= total ;
+			n = counts[i] ;
+			if (l->max == l->min) {
+				/* All values in the slot are equal */
+				free(counts) ;
+				return l->min ;
+			}
+			if ((n <= HISTO_SELECT_MIN) || (n <= npix/HISTO_GATHER_DIV) ||
+				(n == prev) || (job.nlevel == HISTO_MAXLEVEL)) {
+				break ;
+			}
+			prev = n ;
+			/* Refine the target bin */
+			min = (pixelvalue)((double)l->min + l->binsize * (double)(i-1)) ;
+			max = (pixelvalue)((double)min + l->binsize) ;
+			if (max <= min) break ;
+			histo_set_range(l+1, min, max, HISTO_CLAMP) ;
+		}
+		free(counts) ;
+	}
+
+	if (job.nlevel==0) {
+		/* Small array or NaN values: plain selection on a copy */
+		buf = malloc(npix * sizeof(pixelvalue)) ;
+		memcpy(buf, data, npix * sizeof(pixelvalue)) ;
+		kth = kth_smallest(buf, npix, k) ;
+		free(buf) ;
+		return kth ;
+	}
+
+	/* Gather the values of the target slot, one extra for the last write */
+	buf = malloc((n+1) * sizeof(pixelvalue)) ;
+	n = 0 ;
+	if (job.nlevel==1) {
+		l = job.level ;
+		for (i=0 ; i<npix ; i++) {
+			buf[n] = data[i] ;
+			n += (histo_slot(l, data[i]) == l->target) ;
+		}
+	} else {
+		for (i=0 ; i<npix ; i++) {
+			buf[n] = data[i] ;
+			n += histo_in_target(&job, data[i]) ;
+		}
+	}
+	kth = kth_smallest(buf, n, k) ;
+	free(buf) ;
+	return kth ;
+}
+
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Histogram constructor.
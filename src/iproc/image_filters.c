@@ -32,7 +32,52 @@
 #include "function_1d.h"
 #include "extraction.h"
 #include "fourier.h"
+#include "trace.h"
 #include "xmemory.h"
+#include "parallel.h"
+
+/*---------------------------------------------------------------------------
+   								Defines
+ ---------------------------------------------------------------------------*/
+
+/* Number of lines filtered by a task */
+#define FILTER_BAND     64
+
+/* Non-separable kernels of at least this many pixels are applied by FFT */
+#define FILTER_FFT_MIN  225
+
+/* Relative tolerance on the coefficients of a separable kernel */
+#define FILTER_SEP_TOL  1e-12
+
+/* Ways of applying a convolution kernel */
+#define FILTER_DIRECT       0
+#define FILTER_SEPARABLE    1
+#define FILTER_BOX          2
+
+/* Compare and swap two pixels */
+#define PIX_SORT(a,b) { if ((a)>(b)) { pixelvalue t=(a) ; (a)=(b) ; (b)=t ; } }
+
+/*---------------------------------------------------------------------------
+   								Private types
+ ---------------------------------------------------------------------------*/
+
+typedef struct _filter_job_ {
+    image_t     *   in ;
+    image_t     *   out ;
+    double      *   filter ;    /* kernel, or sort coefficients */
+    double      *   row ;       /* horizontal factor if separable */
+    double      *   col ;       /* vertical factor if separable */
+    int             method ;
+    int             hx, hy ;    /* half-sizes of the kernel */
+    int             band ;      /* number of lines per task */
+    double          norm ;
+} filter_job ;
+
+static void filter_kernel_task(void *, int, int) ;
+static void filter_kernel_fft(filter_job *) ;
+static void filter3x1_task(void *, int, int) ;
+static void filter_morpho_task(void *, int, int) ;
+static void filter_flat_task(void *, int, int) ;
 
 /*---------------------------------------------------------------------------
                         Static pre-defined filters
@@ -145,6 +190,336 @@ double * image_filter_getkernel(char * name, int * nval, int * morpho)
     return ker ;
 }
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Filter an image in spatial domain with a kx x ky kernel.
+  @param	image_in	Image to filter.
+  @param	filter		Filter definition, kx*ky doubles.
+  @param	kx			Kernel size in x, odd.
+  @param	ky			Kernel size in y, odd.
+  @return	1 newly allocated image.
+
+  The kernel is given line by line from the bottom left corner, as for
+  image_filter3x3(): filter[k+l*kx] is applied to the pixel at
+  (i+k-kx/2, j+l-ky/2) to compute the pixel at (i,j). The result is
+  divided by the sum of the coefficients unless it is close to zero,
+  and the kx/2 columns and ky/2 lines on the image borders are set to 0.
+
+  The way the kernel is applied depends on its shape:
+  - if all coefficients are equal, it is applied with running sums, at
+    a cost which does not depend on the kernel size.
+  - if the kernel is separable, i.e. the product of a column by a line,
+    it is applied in two 1-D passes.
+  - other kernels are applied directly if small, or by FFT if they have
+    at least 225 coefficients.
+
+  Except for the FFT, the image is processed by bands of lines in
+  parallel.
+
+  The returned image is a newly allocated object, it must be freed using
+  image_del().
+ */
+/*--------------------------------------------------------------------------*/
+image_t * image_filter_kernel(
+        image_t     *   image_in,
+        double      *   filter,
+        int             kx,
+        int             ky)
+{
+    filter_job      job ;
+    image_t     *   image_out ;
+    double          kmax, piv ;
+    int             i, j, p, q ;
+
+	if ((image_in==NULL) || (filter==NULL)) return NULL ;
+    if (kx<1 || ky<1 || !(kx&1) || !(ky&1)) {
+        e_error("filter kernel size must be odd: %dx%d", kx, ky) ;
+        return NULL ;
+    }
+    image_out = image_new(image_in->lx, image_in->ly) ;
+    job.hx = kx/2 ;
+    job.hy = ky/2 ;
+    if (image_in->lx<=2*job.hx || image_in->ly<=2*job.hy) return image_out ;
+
+    /* precompute inverse sum of filters coeffs */
+    job.norm = 0.0 ;
+    for (i=0 ; i<kx*ky ; i++)
+        job.norm += filter[i] ;
+    if (fabs(job.norm) < 1e-6) {
+        job.norm = 1.0 ;
+    } else {
+        job.norm = 1.0 / job.norm ;
+    }
+
+    /* Find out how to apply the kernel, pivot on its largest coefficient */
+    job.in = image_in ;
+    job.out = image_out ;
+    job.filter = filter ;
+    job.row = job.col = NULL ;
+    job.method = FILTER_DIRECT ;
+    kmax = 0.0 ;
+    p = q = 0 ;
+    for (j=0 ; j<ky ; j++) {
+        for (i=0 ; i<kx ; i++) {
+            if (fabs(filter[i+j*kx])>kmax) {
+                kmax = fabs(filter[i+j*kx]) ;
+                p = i ;
+                q = j ;
+            }
+        }
+    }
+    if (kmax>0.0 && kx*ky>1) {
+        job.method = FILTER_BOX ;
+        for (i=1 ; i<kx*ky ; i++) {
+            if (filter[i]!=filter[0]) {
+                job.method = FILTER_DIRECT ;
+                break ;
+            }
+        }
+    }
+    if (job.method==FILTER_DIRECT && kmax>0.0 && kx>1 && ky>1) {
+        /* Separable if every coefficient is col[j]*row[i] */
+        job.row = malloc(kx * sizeof(double)) ;
+        job.col = malloc(ky * sizeof(double)) ;
+        piv = filter[p+q*kx] ;
+        for (i=0 ; i<kx ; i++) job.row[i] = filter[i+q*kx] ;
+        for (j=0 ; j<ky ; j++) job.col[j] = filter[p+j*kx] / piv ;
+        job.method = FILTER_SEPARABLE ;
+        for (j=0 ; j<ky && job.method==FILTER_SEPARABLE ; j++) {
+            for (i=0 ; i<kx ; i++) {
+                if (fabs(filter[i+j*kx] - job.col[j]*job.row[i]) >
+                    FILTER_SEP_TOL * kmax) {
+                    job.method = FILTER_DIRECT ;
+                    break ;
+                }
+            }
+        }
+    }
+
+    if (job.method==FILTER_DIRECT && kx*ky>=FILTER_FFT_MIN) {
+        filter_kernel_fft(&job) ;
+    } else {
+        /* Bands must be large enough to amortize their aprons */
+        job.band = FILTER_BAND ;
+        if (job.method!=FILTER_DIRECT && job.band<4*job.hy)
+            job.band = 4*job.hy ;
+        eclipse_parallel_run(filter_kernel_task, &job,
+                (image_in->ly - 2*job.hy + job.band - 1) / job.band) ;
+    }
+    if (job.row!=NULL) free(job.row) ;
+    if (job.col!=NULL) free(job.col) ;
+    return image_out ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Apply a convolution kernel on a band of lines.
+  @param	arg		Filter job.
+  @param	band	Index of the band of lines.
+  @param	worker	Unused.
+  @return	void
+
+  Box and separable kernels are first applied along the lines of the
+  band and of its aprons into a buffer, then along the columns of the
+  buffer.
+ */
+/*--------------------------------------------------------------------------*/
+static void filter_kernel_task(void * arg, int band, int worker)
+{
+    filter_job      *   job ;
+    pixelvalue      *   src ;
+    pixelvalue      *   dst ;
+    double          *   filter ;
+    double          *   hsum ;
+    double          *   acc ;
+    double          *   h ;
+    double              sum_pix, c, c1, c2 ;
+    int                 lx, hx, hy, kx, ky ;
+    int                 i, j, k, l, j0, j1 ;
+
+    job = (filter_job *)arg ;
+    filter = job->filter ;
+    lx = job->in->lx ;
+    hx = job->hx ;
+    hy = job->hy ;
+    kx = 2*hx+1 ;
+    ky = 2*hy+1 ;
+    j0 = hy + band * job->band ;
+    j1 = j0 + job->band ;
+    if (j1 > job->in->ly-hy) j1 = job->in->ly-hy ;
+
+    acc = malloc(lx * sizeof(double)) ;
+    if (job->method==FILTER_DIRECT) {
+        /* Accumulate the kernel terms in the same order for all pixels */
+        for (j=j0 ; j<j1 ; j++) {
+            for (i=hx ; i<lx-hx ; i++) acc[i] = 0.0 ;
+            for (l=0 ; l<ky ; l++) {
+                src = job->in->data + (j-hy+l)*lx - hx ;
+                /* Three terms at a time to spare loads of acc */
+                for (k=0 ; k+2<kx ; k+=3) {
+                    c = filter[k+l*kx] ;
+                    c1 = filter[k+1+l*kx] ;
+                    c2 = filter[k+2+l*kx] ;
+                    for (i=hx ; i<lx-hx ; i++) {
+                        acc[i] = acc[i] + c * (double)src[i+k]
+                                        + c1 * (double)src[i+k+1]
+                                        + c2 * (double)src[i+k+2] ;
+                    }
+                }
+                for ( ; k<kx ; k++) {
+                    c = filter[k+l*kx] ;
+                    for (i=hx ; i<lx-hx ; i++) {
+                        acc[i] += c * (double)src[i+k] ;
+                    }
+                }
+            }
+            dst = job->out->data + j*lx ;
+            for (i=hx ; i<lx-hx ; i++) {
+                dst[i] = (pixelvalue)(acc[i] * job->norm) ;
+            }
+        }
+        free(acc) ;
+        return ;
+    }
+
+    /* Filter the lines of the band and its aprons */
+    hsum = malloc((j1-j0+2*hy) * lx * sizeof(double)) ;
+    for (l=0 ; l<j1-j0+2*hy ; l++) {
+        src = job->in->data + (j0-hy+l)*lx ;
+        h = hsum + l*lx ;
+        if (job->method==FILTER_BOX) {
+            sum_pix = 0.0 ;
+            for (k=0 ; k<kx ; k++) sum_pix += (double)src[k] ;
+            h[hx] = sum_pix ;
+            for (i=hx+1 ; i<lx-hx ; i++) {
+                sum_pix += (double)src[i+hx] - (double)src[i-hx-1] ;
+                h[i] = sum_pix ;
+            }
+        } else {
+            for (i=hx ; i<lx-hx ; i++) h[i] = 0.0 ;
+            for (k=0 ; k<kx ; k++) {
+                c = job->row[k] ;
+                for (i=hx ; i<lx-hx ; i++) {
+                    h[i] += c * (double)src[i+k-hx] ;
+                }
+            }
+        }
+    }
+
+    /* Filter the columns */
+    if (job->method==FILTER_BOX) {
+        c = filter[0] * job->norm ;
+        for (i=hx ; i<lx-hx ; i++) acc[i] = 0.0 ;
+        for (l=0 ; l<ky ; l++) {
+            h = hsum + l*lx ;
+            for (i=hx ; i<lx-hx ; i++) acc[i] += h[i] ;
+        }
+        for (j=j0 ; j<j1 ; j++) {
+            if (j>j0) {
+                h = hsum + (j-j0+2*hy)*lx ;
+                for (i=hx ; i<lx-hx ; i++) acc[i] += h[i] - h[i-ky*lx] ;
+            }
+            dst = job->out->data + j*lx ;
+            for (i=hx ; i<lx-hx ; i++) {
+                dst[i] = (pixelvalue)(acc[i] * c) ;
+            }
+        }
+    } else {
+        for (j=j0 ; j<j1 ; j++) {
+            for (i=hx ; i<lx-hx ; i++) acc[i] = 0.0 ;
+            for (l=0 ; l<ky ; l++) {
+                c = job->col[l] ;
+                h = hsum + (j-j0+l)*lx ;
+                for (i=hx ; i<lx-hx ; i++) acc[i] += c * h[i] ;
+            }
+            dst = job->out->data + j*lx ;
+            for (i=hx ; i<lx-hx ; i++) {
+                dst[i] = (pixelvalue)(acc[i] * job->norm) ;
+            }
+        }
+    }
+    free(hsum) ;
+    free(acc) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Apply a convolution kernel by FFT.
+  @param	job		Filter job.
+  @return	void
+
+  The image and the kernel, centered on the origin, are zero-padded to
+  the same power of 2 large enough to avoid any wrap-around in the
+  filtered zone, and transformed at once as the real and imaginary
+  parts of a single complex array. The product of the image transform
+  by the conjugate kernel transform is transformed back to get the
+  correlation of the image with the kernel.
+ */
+/*--------------------------------------------------------------------------*/
+static void filter_kernel_fft(filter_job * job)
+{
+    dcomplex    *   buf ;
+    dcomplex        a, b, f, g ;
+    unsigned        nn[2] ;
+    double          scale ;
+    int             lx, ly, kx, ky, n ;
+    int             i, j, k, l, m ;
+
+    lx = job->in->lx ;
+    ly = job->in->ly ;
+    kx = 2*job->hx+1 ;
+    ky = 2*job->hy+1 ;
+    n = 1 ;
+    while (n<lx+job->hx || n<ly+job->hy) n *= 2 ;
+
+    buf = calloc((size_t)n*n, sizeof(dcomplex)) ;
+    for (j=0 ; j<ly ; j++) {
+        for (i=0 ; i<lx ; i++) {
+            buf[i+j*n].x = (double)job->in->data[i+j*lx] ;
+        }
+    }
+    for (l=0 ; l<ky ; l++) {
+        for (k=0 ; k<kx ; k++) {
+            buf[((k-job->hx+n)%n) + ((l-job->hy+n)%n)*n].y =
+                job->filter[k+l*kx] ;
+        }
+    }
+    nn[0] = nn[1] = (unsigned)n ;
+    fftn(buf, nn, 2, FFT_FORWARD) ;
+
+    /*
+     * With Z the transform at f and W the one at -f, the image
+     * transform is F = (Z + W*)/2 and the kernel one is G = (Z - W*)/2i.
+     * The product at -f is the conjugate of the product at f.
+     */
+    for (j=0 ; j<n ; j++) {
+        for (i=0 ; i<n ; i++) {
+            k = i + j*n ;
+            m = ((n-i)&(n-1)) + ((n-j)&(n-1))*n ;
+            if (m<k) continue ;
+            a = buf[k] ;
+            b = buf[m] ;
+            f.x = 0.5 * (a.x + b.x) ;
+            f.y = 0.5 * (a.y - b.y) ;
+            g.x = 0.5 * (a.y + b.y) ;
+            g.y = 0.5 * (b.x - a.x) ;
+            buf[k].x = f.x * g.x + f.y * g.y ;
+            buf[k].y = f.y * g.x - f.x * g.y ;
+            buf[m].x = buf[k].x ;
+            buf[m].y = -buf[k].y ;
+        }
+    }
+    fftn(buf, nn, 2, FFT_INVERSE) ;
+
+    scale = job->norm / ((double)n * (double)n) ;
+    for (j=job->hy ; j<ly-job->hy ; j++) {
+        for (i=job->hx ; i<lx-job->hx ; i++) {
+            job->out->data[i+j*lx] = (pixelvalue)(buf[i+j*n].x * scale) ;
+        }
+    }
+    free(buf) ;
+}
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief	Filter an image in spatial domain with a 3x3 kernel.
@@ -172,53 +547,13 @@ image_t * image_filter3x3(
 		double	*	filter) 
 {
 	image_t		*	image_out ;
-	int				i, j ;
-	double			sum_pix ;
-	double			filter_norm ;
-	int				curr_pos ;
-	int				im_width ;
 
 	if ((image_in==NULL) || (filter==NULL)) return NULL ;
 
-	image_out = image_new(image_in->lx, image_in->ly) ;
-	/* precompute inverse sum of filters coeffs	*/
-	filter_norm = 0.0 ;
-	for (i=0 ; i<9 ; i++)
-		filter_norm += filter[i] ;
-	
-	if (fabs(filter_norm)<1e-6) {
-		filter_norm = 1.0 ;
-	} else {
-		filter_norm = 1.0 / filter_norm ;
-	}
-
-	/* Main filter loop	*/
-	im_width = image_in->lx ;
-	for (j=1 ; j<image_in->ly-1 ; j++) {
-		for (i=1 ; i<image_in->lx-1 ; i++) {
-			/* Go into upper left corner of current pixel	*/
-			curr_pos = i + j*image_in->lx ;
-
-			sum_pix = 0.0 ;
-			/* Compute filter combination on first line	*/
-			sum_pix += filter[0] * (double)image_in->data[curr_pos-1-im_width] ; 
-			sum_pix += filter[1] * (double)image_in->data[curr_pos-im_width] ; 
-			sum_pix += filter[2] * (double)image_in->data[curr_pos+1-im_width] ; 
-			/* Go on central line, compute filter		*/
-			sum_pix += filter[3] * (double)image_in->data[curr_pos-1] ; 
-			sum_pix += filter[4] * (double)image_in->data[curr_pos] ; 
-			sum_pix += filter[5] * (double)image_in->data[curr_pos+1] ; 
-			/* Go on last line, compute filter			*/
-			sum_pix += filter[6] * (double)image_in->data[curr_pos-1+im_width] ; 
-			sum_pix += filter[7] * (double)image_in->data[curr_pos+im_width] ; 
-			sum_pix += filter[8] * (double)image_in->data[curr_pos+1+im_width] ; 
-
-			/* Normalize output	*/
-			sum_pix *= filter_norm ; 
-			/* Assign value to image_out	*/
-			image_out->data[curr_pos] = (pixelvalue)sum_pix ;
-		}
-	}
+	TRACE_BEGIN("filter/3x3") ;
+	image_out = image_filter_kernel(image_in, filter, 3, 3) ;
+	TRACE_COUNT(TRACE_PIXELS, (double)image_in->lx * image_in->ly) ;
+	TRACE_END("filter/3x3") ;
 	return image_out ;
 }
 
@@ -241,18 +576,46 @@ image_t * image_filter3x1(
 		image_t	*	image_in, 
 		double	*	filter) 
 {
+	filter_job		job ;
 	image_t	*	image_out ;
+
+	if ((image_in==NULL) || (filter==NULL)) return NULL ;
+
+	image_out = image_new(image_in->lx, image_in->ly) ;
+	job.in = image_in ;
+	job.out = image_out ;
+	job.filter = filter ;
+	eclipse_parallel_run(filter3x1_task, &job,
+			(image_in->ly + FILTER_BAND - 1) / FILTER_BAND) ;
+	return image_out ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Apply a 3x1 filter on a band of lines.
+  @param	arg		Filter job.
+  @param	band	Index of the band of lines.
+  @param	worker	Unused.
+  @return	void
+ */
+/*--------------------------------------------------------------------------*/
+static void filter3x1_task(void * arg, int band, int worker)
+{
+	filter_job	*	job ;
 	pixelvalue	*	line_i ;
 	pixelvalue	*	line_o ;
-	int				i, j ;
+	double		*	filter ;
+	int				i, j, jmax ;
 	double			sumpix ;
 	double			norm[3] ;
 	int				lx ;
 
-	if ((image_in==NULL) || (filter==NULL)) return NULL ;
-
-	image_out = image_new(image_in->lx, image_in->ly) ;
-	lx = image_in->lx ;
+	job = (filter_job *)arg ;
+	filter = job->filter ;
+	lx = job->in->lx ;
+	j = band * FILTER_BAND ;
+	jmax = j + FILTER_BAND ;
+	if (jmax > job->in->ly) jmax = job->in->ly ;
 
 	/* Precompute normalization factors */
 
@@ -279,9 +642,9 @@ image_t * image_filter3x1(
 	}
 
 	/* Main filter loop	*/
-	line_i = image_in->data ;
-	line_o = image_out->data ;
-	for (j=0 ; j<image_in->ly ; j++) {
+	line_i = job->in->data + j*lx ;
+	line_o = job->out->data + j*lx ;
+	for ( ; j<jmax ; j++) {
 
 		/* Compute first pixel */
 		sumpix = norm[0] *
@@ -290,7 +653,7 @@ image_t * image_filter3x1(
 		line_o[0] = (pixelvalue)sumpix ;
 
 		/* Compute central pixels */
-		for (i=1 ; i<image_in->lx-1 ; i++) {
+		for (i=1 ; i<lx-1 ; i++) {
 			sumpix = norm[1] *
 					 (filter[0] * (double)line_i[i-1] +
 					  filter[1] * (double)line_i[i]   +
@@ -309,7 +672,6 @@ image_t * image_filter3x1(
 		line_i += lx ;
 		line_o += lx ;
 	}
-	return image_out ;
 }
 
 
@@ -342,73 +704,12 @@ image_t * image_filter5x5(
 		double      *	filter) 
 {
     image_t     *	image_out ;
-    int				i, j ;
-    double          sum_pix ;
-    pixelvalue   *	cur_pix ;
-    double          filter_norm ;
- 
 
 	if ((image_in==NULL) || (filter==NULL)) return NULL ;
-    image_out = image_new(image_in->lx, image_in->ly) ;
-    /* precompute inverse sum of filters coeffs */  
-    filter_norm = 0.0 ;   
-    for (i=0 ; i<25 ; i++) 
-        filter_norm += filter[i] ; 
-         
-    if (fabs(filter_norm) < 1e-6) {
-        filter_norm = 1.0 ;
-	} else {
-		filter_norm = 1.0 / filter_norm ;
-	}
-    
-    /* Main filter loop */ 
-    for (j=2 ; j<image_in->ly-2 ; j++)   {
-        for (i=2 ; i<image_in->lx-2 ; i++) { 
-            /* Go into upper left corner of current pixel   */ 
-            cur_pix = image_in->data + (i-2) + (j-2) * image_in->lx ; 
-             
-            sum_pix = 0.0 ;  
-            /* Compute filter combination on first line */ 
-            sum_pix += filter[0] * (double)cur_pix[0] ; 
-            sum_pix += filter[1] * (double)cur_pix[1] ;
-            sum_pix += filter[2] * (double)cur_pix[2] ;
-            sum_pix += filter[3] * (double)cur_pix[3] ;
-            sum_pix += filter[4] * (double)cur_pix[4] ;
-            /* Go on second line, compute filter       */
-            cur_pix += image_in->lx ;    
-            sum_pix += filter[5] * (double)cur_pix[0] ;  
-            sum_pix += filter[6] * (double)cur_pix[1] ;
-            sum_pix += filter[7] * (double)cur_pix[2] ;
-            sum_pix += filter[8] * (double)cur_pix[3] ;
-            sum_pix += filter[9] * (double)cur_pix[4] ;
-            /* Go on third line, compute filter       */
-            cur_pix += image_in->lx ;    
-            sum_pix += filter[10] * (double)cur_pix[0] ;  
-            sum_pix += filter[11] * (double)cur_pix[1] ;
-            sum_pix += filter[12] * (double)cur_pix[2] ;
-            sum_pix += filter[13] * (double)cur_pix[3] ;
-            sum_pix += filter[14] * (double)cur_pix[4] ;
-            /* Go on fourth line, compute filter       */
-            cur_pix += image_in->lx ;    
-            sum_pix += filter[15] * (double)cur_pix[0] ;  
-            sum_pix += filter[16] * (double)cur_pix[1] ;
-            sum_pix += filter[17] * (double)cur_pix[2] ;
-            sum_pix += filter[18] * (double)cur_pix[3] ;
-            sum_pix += filter[19] * (double)cur_pix[4] ;
-            /* Go on last line, compute filter          */
-            cur_pix += image_in->lx ;    
-            sum_pix += filter[20] * (double)cur_pix[0] ;  
-            sum_pix += filter[21] * (double)cur_pix[1] ;
-            sum_pix += filter[22] * (double)cur_pix[2] ;
-            sum_pix += filter[23] * (double)cur_pix[3] ;
-            sum_pix += filter[24] * (double)cur_pix[4] ;
-            
-            /* Normalize output */
-            sum_pix *= filter_norm ; 
-            /* Assign value to image_out */
-            image_out->data[i+j*image_out->lx] = (pixelvalue)sum_pix ;             
-        }            
-    }         
+    TRACE_BEGIN("filter/5x5") ;
+    image_out = image_filter_kernel(image_in, filter, 5, 5) ;
+    TRACE_COUNT(TRACE_PIXELS, (double)image_in->lx * image_in->ly) ;
+    TRACE_END("filter/5x5") ;
     return image_out ; 
 }    
 
@@ -433,15 +734,14 @@ image_t * image_filter_morpho(
 		image_t 	*	image_in,   
 		double       *	filter)
 {
+    filter_job      job ;
     image_t     *	image_out ;
-    int	         	i, j, k ;
-    double          sum_pix ;
-    pixelvalue      curr_3x3[9] ;
+    int	         	i ;
     double          filter_norm ;
-	int				curr_pos, im_width ;
 
 	if ((image_in==NULL) || (filter==NULL)) return NULL ;
     image_out = image_new(image_in->lx, image_in->ly) ;
+    TRACE_BEGIN("filter/morpho") ;
 
     /* precompute inverse sum of filters coeffs */
     filter_norm = 0.0 ;
@@ -454,37 +754,91 @@ image_t * image_filter_morpho(
 		filter_norm = 1.0 / filter_norm ;
 	}
 
-    /* Main filter loop */
+    /* Main filter loop, by bands of lines */
+    job.in = image_in ;
+    job.out = image_out ;
+    job.filter = filter ;
+    job.norm = filter_norm ;
+    if (image_in->ly > 2) {
+        eclipse_parallel_run(filter_morpho_task, &job,
+                (image_in->ly - 2 + FILTER_BAND - 1) / FILTER_BAND) ;
+    }
+    TRACE_COUNT(TRACE_PIXELS, (double)image_in->lx * image_in->ly) ;
+    TRACE_END("filter/morpho") ;
+    return image_out ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Apply a 3x3 morpho filter on a band of lines.
+  @param	arg		Filter job.
+  @param	band	Index of the band of lines.
+  @param	worker	Unused.
+  @return	void
+
+  The 9 pixels around each pixel are sorted by a 25-comparison sorting
+  network.
+ */
+/*--------------------------------------------------------------------------*/
+static void filter_morpho_task(void * arg, int band, int worker)
+{
+    filter_job      *   job ;
+    image_t         *   image_in ;
+    double          *   filter ;
+    int	         	    i, j, k, jmax ;
+    double              sum_pix ;
+    pixelvalue          p[9] ;
+	int				    curr_pos, im_width ;
+
+    job = (filter_job *)arg ;
+    image_in = job->in ;
+    filter = job->filter ;
 	im_width = image_in->lx ;
-    for (j=1 ; j<image_in->ly-1 ; j++) {
+    j = 1 + band * FILTER_BAND ;
+    jmax = j + FILTER_BAND ;
+    if (jmax > image_in->ly-1) jmax = image_in->ly-1 ;
+
+    for ( ; j<jmax ; j++) {
         for (i=1 ; i<image_in->lx-1 ; i++) {
 			curr_pos = i + j*im_width ;
 			/* Store all relevant pixels in an array for sorting	*/
-            curr_3x3[0] = image_in->data[curr_pos - 1 - im_width] ;
-            curr_3x3[1] = image_in->data[curr_pos - im_width] ;
-            curr_3x3[2] = image_in->data[curr_pos + 1 - im_width] ;
-
-            curr_3x3[3] = image_in->data[curr_pos - 1] ;
-            curr_3x3[4] = image_in->data[curr_pos] ;
-            curr_3x3[5] = image_in->data[curr_pos + 1] ;
-
-            curr_3x3[6] = image_in->data[curr_pos - 1 + im_width] ;
-            curr_3x3[7] = image_in->data[curr_pos + im_width] ;
-            curr_3x3[8] = image_in->data[curr_pos + 1 + im_width] ;
-
-			/* Sort array with standard sorting routine	*/
-			pixel_qsort(curr_3x3, 9) ;
+            p[0] = image_in->data[curr_pos - 1 - im_width] ;
+            p[1] = image_in->data[curr_pos - im_width] ;
+            p[2] = image_in->data[curr_pos + 1 - im_width] ;
+
+            p[3] = image_in->data[curr_pos - 1] ;
+            p[4] = image_in->data[curr_pos] ;
+            p[5] = image_in->data[curr_pos + 1] ;
+
+            p[6] = image_in->data[curr_pos - 1 + im_width] ;
+            p[7] = image_in->data[curr_pos + im_width] ;
+            p[8] = image_in->data[curr_pos + 1 + im_width] ;
+
+            /* Sort array */
+            PIX_SORT(p[0], p[3]) ; PIX_SORT(p[1], p[7]) ;
+            PIX_SORT(p[2], p[5]) ; PIX_SORT(p[4], p[8]) ;
+            PIX_SORT(p[0], p[7]) ; PIX_SORT(p[2], p[4]) ;
+            PIX_SORT(p[3], p[8]) ; PIX_SORT(p[5], p[6]) ;
+            PIX_SORT(p[0], p[2]) ; PIX_SORT(p[1], p[3]) ;
+            PIX_SORT(p[4], p[5]) ; PIX_SORT(p[7], p[8]) ;
+            PIX_SORT(p[1], p[4]) ; PIX_SORT(p[3], p[6]) ;
+            PIX_SORT(p[5], p[7]) ;
+            PIX_SORT(p[0], p[1]) ; PIX_SORT(p[2], p[4]) ;
+            PIX_SORT(p[3], p[5]) ; PIX_SORT(p[6], p[8]) ;
+            PIX_SORT(p[2], p[3]) ; PIX_SORT(p[4], p[5]) ;
+            PIX_SORT(p[6], p[7]) ;
+            PIX_SORT(p[1], p[2]) ; PIX_SORT(p[3], p[4]) ;
+            PIX_SORT(p[5], p[6]) ;
             sum_pix = 0.0 ;
 			for (k=0 ; k<9 ; k++)
-				sum_pix += filter[k] * (double)curr_3x3[k] ; 
+				sum_pix += filter[k] * (double)p[k] ; 
 
             /* Normalize output */
-            sum_pix *= filter_norm ;
+            sum_pix *= job->norm ;
             /* Assign value to image_out */
-            image_out->data[curr_pos] = (pixelvalue)sum_pix ;
+            job->out->data[curr_pos] = (pixelvalue)sum_pix ;
         }
     }    
-    return image_out ;
 }
 
 
@@ -509,6 +863,7 @@ image_t * image_filter_median(image_t * in)
 
 	if (in==NULL) return NULL ;
     out = image_new(in->lx, in->ly) ;
+    TRACE_BEGIN("filter/median") ;
 
 	/* Main filter loop	*/
 	width = in->lx ;
@@ -533,6 +888,8 @@ image_t * image_filter_median(image_t * in)
 			out->data[i+j*width] = opt_med9(current3x3) ;
 		}
 	}
+	TRACE_COUNT(TRACE_PIXELS, (double)in->lx * in->ly) ;
+	TRACE_END("filter/median") ;
 	return out ;
 }
 
@@ -628,6 +985,7 @@ image_t * image_filter_large_median(image_t * in, int filtsizex, int filtsizey)
 	f2x = filtsizex/2;
 	f2y = filtsizey/2;
 	filt_img = image_new( in->lx, in->ly);
+	TRACE_BEGIN("filter/large_median") ;
     buf = malloc(filtsizex*filtsizey*sizeof(pixelvalue)); 
 	for (row=0;row<in->ly;row++){
 		rowdif= f2y-row;
@@ -671,6 +1029,8 @@ image_t * image_filter_large_median(image_t * in, int filtsizex, int filtsizey)
 		}
 	}
 	free(buf);
+	TRACE_COUNT(TRACE_PIXELS, (double)in->lx * in->ly) ;
+	TRACE_END("filter/large_median") ;
 	return filt_img;
 }
 
@@ -734,57 +1094,36 @@ image_t * image_filter_horizontal_median(image_t * in, int filtsize)
   odd-sized and square. The given parameter defines the half-size of the
   filter to apply.
 
-  The filter is applied in one pass to avoid memory overflows. Applying it
-  in two passes would be faster but requires twice the amount of memory.
-  This is an issue, especially with WFI frames.
+  Near the image borders, the average is taken over the pixels of the
+  kernel which fall inside the image. The filter is applied with running
+  sums over bands of lines processed in parallel, which only need a few
+  lines of memory per band and cost the same whatever the kernel size.
 
   Example: applying a 9x9 flat filter would be done by setting ksize to 4.
  */
 /*--------------------------------------------------------------------------*/
 image_t * image_filter_flat(image_t * im, int ksize)
 {
+	filter_job		job ;
 	image_t	    *	filt ;
-	int				i, j, k, l ;
-	double			acc ;
-	int				nacc ;
-	register
-	pixelvalue	*	out_p ;
 
 	if (im==NULL || ksize<1) return NULL ;
 	if (ksize>im->lx || ksize>im->ly) return NULL ;
 
 	filt = image_new(im->lx, im->ly);
-
-	/*
-	 * Following is an optimized quadruple loop.
-	 * Not the most efficient way of implementing a flat filter, but
-	 * fast enough for most purposes.
-	 */
-
-	/* Loop over all image pixels */
-	out_p = filt->data ;
-	for (j=0 ; j<filt->ly ; j++) {
-		for (i=0 ; i<filt->lx ; i++) {
-			/* Loop over convolution matrix */
-			acc  = 0 ;
-			nacc = 0 ;
-			for (l=-ksize ; l<=ksize ; l++) {
-				if (((j+l)>=0) && ((j+l)<im->ly)) {
-					for (k=-ksize ; k<=ksize ; k++) {
-						/* Test how many pixels are visible from here */
-						if (((i+k)>=0) && ((i+k)<im->lx)) {
-							nacc ++ ;
-							acc += (double)im->data[(i+k)+(j+l)*im->lx];
-						}
-					}
-				}
-			}
-
-			/* Average accumulator */
-			acc /= (double)nacc ;
-			*out_p++ = (pixelvalue)acc ;
-		}
-	}
+	TRACE_BEGIN("filter/flat") ;
+
+	/* Running sums by bands of lines, normalized by the visible pixels */
+	job.in = im ;
+	job.out = filt ;
+	job.method = FILTER_DIRECT ;
+	job.hx = job.hy = ksize ;
+	job.band = FILTER_BAND ;
+	if (job.band<4*ksize) job.band = 4*ksize ;
+	eclipse_parallel_run(filter_flat_task, &job,
+			(im->ly + job.band - 1) / job.band) ;
+	TRACE_COUNT(TRACE_PIXELS, (double)im->lx * im->ly) ;
+	TRACE_END("filter/flat") ;
 	return filt ;
 }
 
@@ -800,33 +1139,127 @@ image_t * image_filter_flat(image_t * im, int ksize)
 /*--------------------------------------------------------------------------*/
 image_t * image_rectangle_filter_flat(image_t * in, int hx, int hy)
 {
+    filter_job      job ;
     image_t    *   filtered ;
-    pixelvalue      curr_flux ;
-    int             xmin, xmax, ymin, ymax ;
-    int             i, j, k, l ;
 
     if (in==NULL || hx<1 || hy<1) return NULL ;
     filtered = image_new(in->lx, in->ly) ;
 
-    /* Define the analysis zone */
-    xmin = hx ;
-    xmax = in->lx - hx - 1 ;
-    ymin = hy ;
-    ymax = in->ly - hy - 1 ;
-
-    for (i=xmin ; i<xmax ; i++) {
-        for (j=ymin ; j<ymax ; j++) {
-            curr_flux = 0.0 ;
-            for (k=i-hx ; k<i+hx+1 ; k++) {
-                for (l=j-hy ; l<j+hy+1 ; l++) {
-                    curr_flux += in->data[k+l*in->lx] ;
-                }
+    /* The analysis zone stops one pixel before the last full kernel */
+    if (in->lx-2*hx-1<1 || in->ly-2*hy-1<1) return filtered ;
+    job.in = in ;
+    job.out = filtered ;
+    job.method = FILTER_BOX ;
+    job.hx = hx ;
+    job.hy = hy ;
+    job.band = FILTER_BAND ;
+    if (job.band<4*hy) job.band = 4*hy ;
+    job.norm = 1.0 / (double)((2*hx+1)*(2*hy+1)) ;
+    eclipse_parallel_run(filter_flat_task, &job,
+            (in->ly - 2*hy - 1 + job.band - 1) / job.band) ;
+    return filtered ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Apply a flat filter on a band of lines.
+  @param	arg		Filter job.
+  @param	band	Index of the band of lines.
+  @param	worker	Unused.
+  @return	void
+
+  The lines of the band and of its aprons are summed over the kernel
+  width with a running sum, then the columns of these sums over the
+  kernel height the same way. With the FILTER_BOX method, only the
+  analysis zone of image_rectangle_filter_flat() is filtered and the
+  sums are multiplied by the job norm. Otherwise the whole image is
+  filtered and every sum is divided by the number of pixels in the
+  kernel which fall inside the image.
+ */
+/*--------------------------------------------------------------------------*/
+static void filter_flat_task(void * arg, int band, int worker)
+{
+    filter_job      *   job ;
+    pixelvalue      *   src ;
+    pixelvalue      *   dst ;
+    double          *   hsum ;
+    double          *   acc ;
+    double          *   h ;
+    double              sum ;
+    int                 lx, ly, hx, hy, box ;
+    int                 i, j, l, j0, j1, r0, r1, imin, imax ;
+
+    job = (filter_job *)arg ;
+    lx = job->in->lx ;
+    ly = job->in->ly ;
+    hx = job->hx ;
+    hy = job->hy ;
+    box = (job->method==FILTER_BOX) ;
+    if (box) {
+        imin = hx ;
+        imax = lx-hx-1 ;
+        j0 = hy + band * job->band ;
+        j1 = j0 + job->band ;
+        if (j1 > ly-hy-1) j1 = ly-hy-1 ;
+    } else {
+        imin = 0 ;
+        imax = lx ;
+        j0 = band * job->band ;
+        j1 = j0 + job->band ;
+        if (j1 > ly) j1 = ly ;
+    }
+    /* Lines needed by the band */
+    r0 = j0-hy < 0 ? 0 : j0-hy ;
+    r1 = j1+hy > ly ? ly : j1+hy ;
+
+    /* Sum the lines over the kernel width */
+    hsum = malloc((r1-r0) * lx * sizeof(double)) ;
+    acc = malloc(lx * sizeof(double)) ;
+    for (l=r0 ; l<r1 ; l++) {
+        src = job->in->data + l*lx ;
+        h = hsum + (l-r0)*lx ;
+        sum = 0.0 ;
+        for (i=imin-hx ; i<imin+hx && i<lx ; i++) {
+            if (i>=0) sum += (double)src[i] ;
+        }
+        for (i=imin ; i<imax ; i++) {
+            if (i+hx<lx) sum += (double)src[i+hx] ;
+            if (i-hx>0) sum -= (double)src[i-hx-1] ;
+            h[i] = sum ;
+        }
+    }
+
+    /* Sum the columns over the kernel height */
+    for (i=imin ; i<imax ; i++) acc[i] = 0.0 ;
+    for (l=j0-hy ; l<j0+hy ; l++) {
+        if (l<0 || l>=ly) continue ;
+        h = hsum + (l-r0)*lx ;
+        for (i=imin ; i<imax ; i++) acc[i] += h[i] ;
+    }
+    for (j=j0 ; j<j1 ; j++) {
+        if (j+hy<ly) {
+            h = hsum + (j+hy-r0)*lx ;
+            for (i=imin ; i<imax ; i++) acc[i] += h[i] ;
+        }
+        dst = job->out->data + j*lx ;
+        if (box) {
+            for (i=imin ; i<imax ; i++) {
+                dst[i] = (pixelvalue)(acc[i] * job->norm) ;
+            }
+        } else {
+            l = (j+hy<ly ? j+hy : ly-1) - (j-hy>0 ? j-hy : 0) + 1 ;
+            for (i=imin ; i<imax ; i++) {
+                dst[i] = (pixelvalue)(acc[i] / (double)(l *
+                    ((i+hx<lx ? i+hx : lx-1) - (i-hx>0 ? i-hx : 0) + 1))) ;
             }
-            filtered->data[i+j*in->lx] =
-                (pixelvalue) (curr_flux / ((2*hx+1)*(2*hy+1)));
+        }
+        if (j-hy>=0) {
+            h = hsum + (j-hy-r0)*lx ;
+            for (i=imin ; i<imax ; i++) acc[i] -= h[i] ;
         }
     }
-    return filtered ;
+    free(hsum) ;
+    free(acc) ;
 }
 
 
@@ -23,6 +23,7 @@
 #include "cube_handling.h"
 #include "image_rtd.h"
 #include "qfits.h"
+#include "trace.h"
 
 /*---------------------------------------------------------------------------
   							Function codes
@@ -83,9 +84,14 @@ image_t * image_loadext(char *filename, int xtnum, int pnum, int map)
 		if (qfitsloader_init(&ql)!=0) {
 			return NULL ;
 		}
+		TRACE_BEGIN("fits/load") ;
 		if (qfits_loadpix(&ql)!=0) {
+			TRACE_END("fits/load") ;
 			return NULL ;
 		}
+		TRACE_COUNT(TRACE_BYTES_READ,
+					(double)ql.lx * ql.ly * BYTESPERPIXEL(ql.bitpix)) ;
+		TRACE_END("fits/load") ;
 		loaded = malloc(sizeof(image_t));
 		loaded->lx = ql.lx ;
 		loaded->ly = ql.ly ;
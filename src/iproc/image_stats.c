@@ -38,6 +38,9 @@
 /* Determined empiracally by C. Lidman for Strehl error computation */
 #define STREHL_ERROR_COEFFICIENT    M_PI * 0.007 / 0.0271 
 
+/* Number of pixels summed in pixelcalc before accumulating in double */
+#define STATS_BLOCK					128
+
 /*-----------------------------------------------------------------------------
   							Function codes
  -----------------------------------------------------------------------------*/
@@ -51,6 +54,9 @@
   Compute various images statistics. Results are all stored into a returned
   structure, than must be deallocated using free(). See the structure details 
   in local_types.h.
+
+  Sums are computed in blocks of pixelcalc values: with --float32, flux,
+  mean and standard deviation keep a relative accuracy of about 1e-5.
  */
 /*----------------------------------------------------------------------------*/
 image_stats * image_getstats(image_t *image_in)
@@ -63,10 +69,16 @@ image_stats * image_getstats(image_t *image_in)
     double      	pix_sum,
 					sqr_sum,
     				abs_sum ;
+    pixelcalc		blk_sum,
+					blk_sqr,
+					blk_abs,
+					shift,
+					val ;
     int		     	min_pos,
 					max_pos ;
     image_stats *	ret_stats ;
 	int				npix ;
+	int				j, nblk ;
 
 	if (image_in==NULL) return NULL ;
     ret_stats = malloc(sizeof(image_stats)) ;
@@ -75,29 +87,44 @@ image_stats * image_getstats(image_t *image_in)
     max_pix = (pixelvalue)image_in->data[0];
     min_pos = max_pos = 0L ;
 
+    /*
+     * Sums are accumulated per block in pixelcalc, then in double.
+     * Values are shifted by the first pixel to limit rounding errors in
+     * the sum of squares, which would spoil the standard deviation.
+     */
+    shift = (pixelcalc)image_in->data[0] ;
     pix_sum = sqr_sum = abs_sum = 0.0 ;
     curr_pix = image_in->data ;
 	npix = image_in->lx * image_in->ly ;
-    for (i=0 ; i<npix ; i++) {
-        if (*curr_pix < min_pix) {
-            min_pix = *curr_pix ;
-            min_pos = i ;
-        } else {
-            if (*curr_pix > max_pix) {
-                max_pix = *curr_pix ;
-                max_pos = i ;
+    for (i=0 ; i<npix ; i+=STATS_BLOCK) {
+        nblk = (npix-i < STATS_BLOCK) ? npix-i : STATS_BLOCK ;
+        blk_sum = blk_sqr = blk_abs = 0 ;
+        for (j=0 ; j<nblk ; j++) {
+            if (curr_pix[j] < min_pix) {
+                min_pix = curr_pix[j] ;
+                min_pos = i+j ;
+            } else {
+                if (curr_pix[j] > max_pix) {
+                    max_pix = curr_pix[j] ;
+                    max_pos = i+j ;
+                }
             }
+            val = (pixelcalc)curr_pix[j] ;
+            blk_abs += (val<0) ? -val : val ;
+            val -= shift ;
+            blk_sum += val ;
+            blk_sqr += val * val ;
         }
-
-        pix_sum += (double)*curr_pix ;
-        abs_sum += (double)fabs(*curr_pix) ;
-        sqr_sum += ((double)*curr_pix) * ((double)*curr_pix) ; 
-        curr_pix++ ;
+        pix_sum += (double)blk_sum ;
+        abs_sum += (double)blk_abs ;
+        sqr_sum += (double)blk_sqr ;
+        curr_pix += nblk ;
     }
 
-    ret_stats->flux = pix_sum ;
+    ret_stats->flux = pix_sum + (double)npix * (double)shift ;
     ret_stats->absflux = abs_sum ;
-    ret_stats->energy = sqr_sum ;
+    ret_stats->energy = sqr_sum + (double)shift *
+                        (2.0 * pix_sum + (double)npix * (double)shift) ;
 
     ret_stats->min_pix = min_pix ;
     ret_stats->min_x = (int)(min_pos % (int)image_in->lx) ;
@@ -107,7 +134,7 @@ image_stats * image_getstats(image_t *image_in)
     ret_stats->max_x = (int)(max_pos % (int)image_in->lx) ;
     ret_stats->max_y = (int)(max_pos / (int)image_in->lx) ;
     
-    ret_stats->avg_pix = pix_sum/(double)npix ;
+    ret_stats->avg_pix = ret_stats->flux/(double)npix ;
     /* Rounding errors can cause the variance to be negative */
     ret_stats->stdev = (sqr_sum-((pix_sum*pix_sum)/(double)npix))
                      / ((double)npix-1.0);
@@ -570,6 +597,11 @@ pixelvalue image_getmedian(image_t * in)
 	if (in==NULL) return 0 ;
 
 	npix = in->lx * in->ly ;
+	if (npix > 25) {
+		/* Same rank as median_pixelvalue(), without copying the image */
+		return histogram_kth_smallest(in->data, npix,
+				(npix&1) ? (npix/2) : ((npix/2)-1)) ;
+	}
 	copybuf = malloc(npix * sizeof(pixelvalue));
 	memcpy(copybuf, in->data, npix * sizeof(pixelvalue));
 	median = median_pixelvalue(copybuf, npix);
@@ -753,16 +785,10 @@ pixelvalue image_getpercentile(
 		image_t 	*	in, 
 		int 			k)
 {
-	image_t	*	clone ;
-	pixelvalue		kth ;
-
-	clone = image_copy(in) ;
-	if (clone == NULL) {
+	if (in == NULL) {
 		return 0.00 ;
 	}
-	kth = kth_smallest(clone->data, clone->lx * clone->ly, k);
-	image_del(clone) ;
-	return kth ;
+	return histogram_kth_smallest(in->data, in->lx * in->ly, k) ;
 }
 
 
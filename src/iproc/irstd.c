@@ -29,16 +29,315 @@
 #include "eclipse.h"
 #else
 #include "e_error.h"
+#include "sky_index.h"
+#include "xmemory.h"
 #endif
 
 #include "irstd.h"
 #include "irlist.h"
 #include "irtemp.h"
 
+/*---------------------------------------------------------------------------
+   								Defines
+ ---------------------------------------------------------------------------*/
+
+#define IRSTD_MAXRADIUS		(2.0/60.0)		/* 2 arcminutes in degrees */
+#define IRSTD_NBANDS		((int)WAVEBAND_UNKNOWN)
+
+/*---------------------------------------------------------------------------
+   								Private types
+ ---------------------------------------------------------------------------*/
+
+/* Star magnitude and index, for sorting */
+typedef struct _IRSTD_MAGSORT_ {
+	double	mag ;
+	int		i ;
+} irstd_magsort ;
+
+/*---------------------------------------------------------------------------
+   							Private variables
+ ---------------------------------------------------------------------------*/
+
+/* Current star list and catalog names */
+static irstd		*	irstd_cur_list = irstd_list ;
+static const char	**	irstd_cur_catalogs = irstd_catalogs ;
+/* Number of stars in the current list, -1 if not counted yet */
+static int				irstd_cur_nstars = -1 ;
+/* Position index and star indices sorted by magnitude in each band,
+   built on first use */
+static sky_index	*	irstd_cur_index = NULL ;
+static int			*	irstd_cur_bymag[IRSTD_NBANDS] ;
+/* Mapped catalog file, NULL for the default list */
+static char			*	irstd_cur_map = NULL ;
+static size_t			irstd_cur_mapsize = 0 ;
+
+/*---------------------------------------------------------------------------
+   							Private functions
+ ---------------------------------------------------------------------------*/
+
+/* Number of stars in the current list */
+static int irstd_nstars(void)
+{
+	if (irstd_cur_nstars<0) {
+		irstd_cur_nstars=0 ;
+		while (irstd_cur_list[irstd_cur_nstars].name!=NULL)
+			irstd_cur_nstars++ ;
+	}
+	return irstd_cur_nstars ;
+}
+
+/* Go back to the default list, releasing the indices and loaded file */
+static void irstd_unload(void)
+{
+	int	b ;
+
+	sky_index_del(irstd_cur_index) ;
+	irstd_cur_index = NULL ;
+	for (b=0 ; b<IRSTD_NBANDS ; b++) {
+		if (irstd_cur_bymag[b]!=NULL) {
+			free(irstd_cur_bymag[b]) ;
+			irstd_cur_bymag[b] = NULL ;
+		}
+	}
+	irstd_cur_nstars = -1 ;
+
+	if (irstd_cur_map==NULL) return ;
+	free(irstd_cur_list) ;
+	free(irstd_cur_catalogs) ;
+	fdealloc(irstd_cur_map, 0, irstd_cur_mapsize) ;
+	irstd_cur_list = irstd_list ;
+	irstd_cur_catalogs = irstd_catalogs ;
+	irstd_cur_map = NULL ;
+	irstd_cur_mapsize = 0 ;
+	return ;
+}
+
+/* Position index of the current list */
+static sky_index * irstd_index(void)
+{
+	double	*	ra ;
+	double	*	dec ;
+	int			n, i ;
+
+	if (irstd_cur_index!=NULL) return irstd_cur_index ;
+	n = irstd_nstars() ;
+	ra  = malloc((n+1) * sizeof(double)) ;
+	dec = malloc((n+1) * sizeof(double)) ;
+	for (i=0 ; i<n ; i++) {
+		ra[i]  = irstd_cur_list[i].ra ;
+		dec[i] = irstd_cur_list[i].dec ;
+	}
+	irstd_cur_index = sky_index_new(ra, dec, n) ;
+	free(ra) ;
+	free(dec) ;
+	return irstd_cur_index ;
+}
+
+/* Magnitude of a star in a band, 99 if the band is unknown */
+static double irstd_mag(const irstd * star, ir_waveband band)
+{
+	switch (band) {
+		case WAVEBAND_J:		return (double)star->mag_J ;
+		case WAVEBAND_H:		return (double)star->mag_H ;
+		case WAVEBAND_K:		return (double)star->mag_K ;
+		case WAVEBAND_KS:		return (double)star->mag_Ks ;
+		case WAVEBAND_L:		return (double)star->mag_L ;
+		case WAVEBAND_M:		return (double)star->mag_M ;
+		case WAVEBAND_Lprime:	return (double)star->mag_Lp ;
+		case WAVEBAND_Mprime:	return (double)star->mag_Mp ;
+		default:				return 99.0 ;
+	}
+}
+
+/* Compare two irstd_magsort for qsort() */
+static int irstd_cmp_mag(const void * a, const void * b)
+{
+	const irstd_magsort	*	sa = a ;
+	const irstd_magsort	*	sb = b ;
+
+	if (sa->mag < sb->mag) return -1 ;
+	if (sa->mag > sb->mag) return  1 ;
+	return sa->i - sb->i ;
+}
+
+/* Compare two ints for qsort() */
+static int irstd_cmp_int(const void * a, const void * b)
+{
+	return *(const int*)a - *(const int*)b ;
+}
+
+/* Indices of the stars of the current list sorted by magnitude */
+static int * irstd_bymag(ir_waveband band)
+{
+	irstd_magsort	*	sorted ;
+	int					n, i ;
+
+	if (irstd_cur_bymag[band]!=NULL) return irstd_cur_bymag[band] ;
+	n = irstd_nstars() ;
+	sorted = malloc((n+1) * sizeof(irstd_magsort)) ;
+	for (i=0 ; i<n ; i++) {
+		sorted[i].mag = irstd_mag(irstd_cur_list+i, band) ;
+		sorted[i].i   = i ;
+	}
+	qsort(sorted, n, sizeof(irstd_magsort), irstd_cmp_mag) ;
+	irstd_cur_bymag[band] = malloc((n+1) * sizeof(int)) ;
+	for (i=0 ; i<n ; i++) {
+		irstd_cur_bymag[band][i] = sorted[i].i ;
+	}
+	free(sorted) ;
+	return irstd_cur_bymag[band] ;
+}
+
+/* Index of a catalog name in the current catalogs, -1 if not found */
+static int irstd_catalog_id(const char * catalog)
+{
+	int	i ;
+
+	for (i=0 ; irstd_cur_catalogs[i]!=NULL ; i++) {
+		if (!strcmp(catalog, irstd_cur_catalogs[i])) return i ;
+	}
+	return -1 ;
+}
+
+/* Search filter: active stars */
+static int irstd_accept_active(int i, void * arg)
+{
+	return irstd_cur_list[i].select ;
+}
+
+/* Search filter: stars from one catalog */
+static int irstd_accept_catalog(int i, void * arg)
+{
+	return irstd_cur_list[i].source == *(int*)arg ;
+}
+
+/* Closest star to a position, within IRSTD_MAXRADIUS */
+static irstd * irstd_closest(
+		double			ra_d,
+		double			dec_d,
+		sky_accept		accept,
+		void		*	arg)
+{
+	int		i ;
+
+	i = sky_index_nearest(irstd_index(), ra_d, dec_d, IRSTD_MAXRADIUS,
+			accept, arg, NULL) ;
+	return (i<0) ? NULL : irstd_cur_list+i ;
+}
+
 /*---------------------------------------------------------------------------
    							Function codes
  ---------------------------------------------------------------------------*/
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Load a binary star catalog file
+  @param	filename	Name of the file to load, NULL for the default list.
+  @return	int Number of stars in the new star list, -1 on error.
+
+  Replaces the current star list and catalog names by the contents of
+  a binary catalog file written by convert_tab -b. The file is mapped
+  in memory and the star names point directly into it. All stars of the
+  new list are active. Pointers returned by previous searches become
+  invalid.
+
+  Pass NULL to get back to the star list compiled into the library. On
+  error, the current star list is left unchanged.
+ */
+/*--------------------------------------------------------------------------*/
+int irstd_load_catalog(char * filename)
+{
+	irstd_bin_header	*	head ;
+	irstd_bin_record	*	rec ;
+	irstd				*	list ;
+	const char			**	catalogs ;
+	char				*	map ;
+	char				*	names ;
+	size_t					size ;
+	int						ncat, nstars ;
+	int						i ;
+
+	/* NULL: back to the default list */
+	if (filename==NULL) {
+		irstd_unload() ;
+		return irstd_setactive("all") ;
+	}
+
+	if ((map=falloc(filename, 0, &size))==NULL) {
+		e_error("cannot map star catalog [%s]", filename) ;
+		return -1 ;
+	}
+
+	/* Check the header and the file size */
+	head = (irstd_bin_header*)map ;
+	if ((size < sizeof(irstd_bin_header)) ||
+		strncmp(head->magic, IRSTD_BIN_MAGIC, 8) ||
+		(head->version != IRSTD_BIN_VERSION) ||
+		(head->byteorder != IRSTD_BIN_BYTEORDER) ||
+		(head->ncat < 1) ||
+		(head->nstars < 0) ||
+		(size < sizeof(irstd_bin_header) +
+				(size_t)head->ncat * IRSTD_BIN_NAMESZ +
+				(size_t)head->nstars * sizeof(irstd_bin_record))) {
+		e_error("not a binary star catalog for this machine [%s]", filename);
+		fdealloc(map, 0, size) ;
+		return -1 ;
+	}
+	ncat   = head->ncat ;
+	nstars = head->nstars ;
+	names  = map + sizeof(irstd_bin_header) ;
+	rec    = (irstd_bin_record*)(names + ncat * IRSTD_BIN_NAMESZ) ;
+
+	/* Check the strings are terminated and the catalogs exist */
+	for (i=0 ; i<ncat ; i++) {
+		if (names[(i+1)*IRSTD_BIN_NAMESZ-1]!=0) break ;
+	}
+	if (i==ncat) {
+		for (i=0 ; i<nstars ; i++) {
+			if ((rec[i].name[IRSTD_BIN_NAMESZ-1]!=0) ||
+				(rec[i].sptype[IRSTD_BIN_TYPESZ-1]!=0) ||
+				(rec[i].source<0) ||
+				(rec[i].source>=ncat)) break ;
+		}
+		i = (i==nstars) ? ncat : -1 ;
+	}
+	if (i!=ncat) {
+		e_error("corrupted star catalog [%s]", filename) ;
+		fdealloc(map, 0, size) ;
+		return -1 ;
+	}
+
+	/* Build the star list on top of the mapped file */
+	catalogs = malloc((ncat+1) * sizeof(char*)) ;
+	for (i=0 ; i<ncat ; i++) {
+		catalogs[i] = names + i * IRSTD_BIN_NAMESZ ;
+	}
+	catalogs[ncat] = NULL ;
+	list = calloc(nstars+1, sizeof(irstd)) ;
+	for (i=0 ; i<nstars ; i++) {
+		list[i].select	= 1 ;
+		list[i].name	= rec[i].name ;
+		list[i].ra		= rec[i].ra ;
+		list[i].dec		= rec[i].dec ;
+		list[i].sptype	= rec[i].sptype ;
+		list[i].mag_J	= rec[i].mag[WAVEBAND_J] ;
+		list[i].mag_H	= rec[i].mag[WAVEBAND_H] ;
+		list[i].mag_K	= rec[i].mag[WAVEBAND_K] ;
+		list[i].mag_Ks	= rec[i].mag[WAVEBAND_KS] ;
+		list[i].mag_L	= rec[i].mag[WAVEBAND_L] ;
+		list[i].mag_M	= rec[i].mag[WAVEBAND_M] ;
+		list[i].mag_Lp	= rec[i].mag[WAVEBAND_Lprime] ;
+		list[i].mag_Mp	= rec[i].mag[WAVEBAND_Mprime] ;
+		list[i].source	= rec[i].source ;
+	}
+
+	irstd_unload() ;
+	irstd_cur_list = list ;
+	irstd_cur_catalogs = catalogs ;
+	irstd_cur_map = map ;
+	irstd_cur_mapsize = size ;
+	return nstars ;
+}
 
 /*-------------------------------------------------------------------------*/
 /**
@@ -59,54 +358,51 @@
 int irstd_setactive(char * catalog)
 {
 	int	i;
+	int	n ;
+	int	cat_id ;
 	int	found ;
 	int	active ;
 
+	n = irstd_nstars() ;
+
 	/* NULL: Compute number of active stars in list */
 	if (catalog==NULL) {
 		found=0 ;
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if (irstd_list[i].select)
+		for (i=0 ; i<n ; i++) {
+			if (irstd_cur_list[i].select)
 				found++;
-			i++ ;
 		}
 		return found ;
 	}
 
 	/* "none": disable all stars */
 	if (!strcmp(catalog, "none")) {
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			irstd_list[i].select=0 ;
-			i++;
+		for (i=0 ; i<n ; i++) {
+			irstd_cur_list[i].select=0 ;
 		}
 		return 0 ;
 	}
 
 	/* "all": enable all stars */
 	if (!strcmp(catalog, "all")) {
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			irstd_list[i].select=1 ;
-			i++;
+		for (i=0 ; i<n ; i++) {
+			irstd_cur_list[i].select=1 ;
 		}
-		return i ;
+		return n ;
 	}
 
 	/* General case: activate only required catalog */
-	i=0 ;
+	cat_id = irstd_catalog_id(catalog) ;
 	active=0 ;
 	found=0 ;
-	while (irstd_list[i].name!=NULL) {
-		if (!strcmp(catalog, irstd_catalogs[irstd_list[i].source])) {
+	for (i=0 ; i<n ; i++) {
+		if (irstd_cur_list[i].source==cat_id) {
 			found=1 ;
-			irstd_list[i].select=1 ;
+			irstd_cur_list[i].select=1 ;
 		}
-		if (irstd_list[i].select) {
+		if (irstd_cur_list[i].select) {
 			active++ ;
 		}
-		i++ ;
 	}
 	if (found<1) {
 		e_error("invalid catalog name: %s", catalog);
@@ -128,7 +424,7 @@ int irstd_setactive(char * catalog)
 /*--------------------------------------------------------------------------*/
 char * irstd_catalog_name(int cat_id)
 {
-	return (char*)irstd_catalogs[cat_id] ;
+	return (char*)irstd_cur_catalogs[cat_id] ;
 }
 
 
@@ -145,7 +441,7 @@ char * irstd_catalog_name(int cat_id)
 /*--------------------------------------------------------------------------*/
 char ** irstd_catalog_names(void)
 {
-	return (char**)irstd_catalogs;
+	return (char**)irstd_cur_catalogs;
 }
 
 
@@ -185,10 +481,10 @@ irstd ** irstd_get_star_by_name(
 	starlist = NULL ;
 	found = 0 ;
 	i=0 ;
-	while (irstd_list[i].name!=NULL) {
+	while (irstd_cur_list[i].name!=NULL) {
 		/* matching using a regexp */
-		if ((irstd_list[i].select==1) &&
-			(regexec(&re_name, irstd_list[i].name, 0, NULL, 0)==0)) {
+		if ((irstd_cur_list[i].select==1) &&
+			(regexec(&re_name, irstd_cur_list[i].name, 0, NULL, 0)==0)) {
 			found++ ;
 		}
 		i++ ;
@@ -201,10 +497,10 @@ irstd ** irstd_get_star_by_name(
 	*nstars = found ;
 	found = 0 ;
 	i=0 ;
-	while (irstd_list[i].name!=NULL) {
-		if ((irstd_list[i].select==1) &&
-			(regexec(&re_name, irstd_list[i].name, 0, NULL, 0)==0)) {
-			starlist[found] = &(irstd_list[i]);
+	while (irstd_cur_list[i].name!=NULL) {
+		if ((irstd_cur_list[i].select==1) &&
+			(regexec(&re_name, irstd_cur_list[i].name, 0, NULL, 0)==0)) {
+			starlist[found] = &(irstd_cur_list[i]);
 			found++ ;
 		}
 		i++ ;
@@ -220,62 +516,19 @@ irstd ** irstd_get_star_by_name(
   @param	dec_d		Declination {\em in degrees}.
   @return	Pointer to a standard star object.
 
-  Finds out the closest star to a given position and returns it as a
-  newly allocated star object. Provide RA and DEC in degrees!
+  Finds out the closest active star to a given position, within 2
+  arcminutes, and returns it. Provide RA and DEC in degrees! Distances
+  are great-circle distances on the sky.
 
   The returned star object is a pointer to the found star in the
-  internal irstd_list structure, thus must not be freed.
+  internal star list, thus must not be freed.
  */
 /*--------------------------------------------------------------------------*/
-#define IRSTD_MAXRADIUS		(2.0/60.0)		/* 2 arcminutes in degrees */
-#define IRSTD_SQMAXRADIUS	(IRSTD_MAXRADIUS*IRSTD_MAXRADIUS)
 irstd * irstd_get_closest_star(
 		double	ra_d, 
 		double	dec_d)
 {
-	irstd *	starlist ;
-	double	ra, dec ;
-	double	cur_dist ;
-	double	min_dist ;
-	int		min_index ;
-	int		i ;
-
-	starlist = NULL ;
-
-	/* Find first valid star to initialize minimum distance */
-	i=0 ;
-	while (irstd_list[i].select==0 && irstd_list[i].name!=NULL)
-		i++ ;
-	if (irstd_list[i].name==NULL) {
-		return NULL ;
-	}
-	ra  = irstd_list[i].ra ;
-	dec = irstd_list[i].dec ;
-	min_dist = (ra_d-ra)*(ra_d-ra)+(dec_d-dec)*(dec_d-dec) ;
-	min_index = i ;
-
-	/* Look for minimum distance star */
-	i=0 ;
-	while (irstd_list[i].name!=NULL) {
-		if (irstd_list[i].select) {
-			ra  = irstd_list[i].ra ;
-			dec = irstd_list[i].dec ;
-			cur_dist = (ra_d-ra)*(ra_d-ra)+(dec_d-dec)*(dec_d-dec) ;
-			if (cur_dist<min_dist) {
-				min_dist = cur_dist ;
-				min_index = i ;
-			}
-		}
-		i++ ;
-	}
-
-	if (min_dist>IRSTD_SQMAXRADIUS) {
-		/* The closest star is more than 2 arcminutes away */
-		starlist = NULL ;
-	} else {
-		starlist = &(irstd_list[min_index]);
-	}
-	return starlist ;
+	return irstd_closest(ra_d, dec_d, irstd_accept_active, NULL) ;
 }
 
 /*----------------------------------------------------------------------------*/
@@ -297,67 +550,23 @@ irstd * irstd_get_star_magnitude_one_cat(
         double      *   mag)
 {
     irstd       *   refstar ;
+    int             cat_id ;
     
     /* Test entries */
     if (cat == NULL) return NULL ;
     if (!strcmp(cat, "all")) return NULL ;
+    if ((cat_id = irstd_catalog_id(cat)) < 0) {
+        e_error("invalid catalog name: %s", cat);
+        return NULL ;
+    }
     
     /* Search closest star */
-    irstd_setactive("none");
-    irstd_setactive(cat) ;
-    refstar = irstd_get_closest_star(ra, dec) ;
+    refstar = irstd_closest(ra, dec, irstd_accept_catalog, &cat_id) ;
 
-    /* Star not found */
-    if (refstar == NULL) return NULL ;
-    
     /* Keep the star if magnitude is known */
-    switch (band) {
-        case WAVEBAND_J:
-            if (refstar->mag_J < 98.0) {
-                *mag = (double)(refstar->mag_J) ;
-                return refstar ;
-            } else return NULL ;
-        case WAVEBAND_H:
-            if (refstar->mag_H < 98.0) {
-                *mag = (double)(refstar->mag_H) ;
-                return refstar ;
-            } else return NULL ;
-        case WAVEBAND_K:
-            if (refstar->mag_K < 98.0) {
-                *mag = (double)(refstar->mag_K) ;
-                return refstar ;
-            } else return NULL ;
-        case WAVEBAND_KS:
-            if (refstar->mag_Ks < 98.0) {
-                *mag = (double)(refstar->mag_Ks) ;
-                return refstar ;
-            } else return NULL ;
-        case WAVEBAND_L:
-            if (refstar->mag_L < 98.0) {
-                *mag = (double)(refstar->mag_L) ;
-                return refstar ;
-            } else return NULL ;
-        case WAVEBAND_M:
-            if (refstar->mag_M < 98.0) {
-                *mag = (double)(refstar->mag_M) ;
-                return refstar ;
-            } else return NULL ;
-        case WAVEBAND_Lprime:
-            if (refstar->mag_Lp < 98.0) {
-                *mag = (double)(refstar->mag_Lp) ;
-                return refstar ;
-            } else return NULL ;
-        case WAVEBAND_Mprime:
-            if (refstar->mag_Mp < 98.0) {
-                *mag = (double)(refstar->mag_Mp) ;
-                return refstar ;
-            } else return NULL ;
-        default:
-            return NULL ;
-    }
-    
-    /* Free and return */
-    return NULL ;
+    if ((refstar == NULL) || (irstd_mag(refstar, band) >= 98.0)) return NULL ;
+    *mag = irstd_mag(refstar, band) ;
+    return refstar ;
 }
 
 
@@ -377,117 +586,18 @@ irstd * irstd_get_star_magnitude(
         ir_waveband     band, 
         double      *   mag)
 {
-    char        **  catalog_names ;
     irstd       *   refstar ;
-    int             nfound ;
-    irstd       **  refstars ;
-    int             i, j ;
-    
-    /* Initialise */
-    catalog_names = irstd_catalog_names() ;
-    nfound = 0 ;
+    int             i ;
     
-    /* Loop on the catalogs and get the closest stars */
-    for (i=0 ; catalog_names[i] ; i++) {
-        irstd_setactive("none");
-        irstd_setactive(catalog_names[i]) ;
-        refstar = irstd_get_closest_star(ra, dec) ;
-        if (refstar != NULL) nfound ++ ;
-    }
-    refstars = malloc(nfound*sizeof(irstd*)) ;
-    j = 0 ;
-    for (i=0 ; catalog_names[i] ; i++) {
-        irstd_setactive("none");
-        irstd_setactive(catalog_names[i]) ;
-        refstar = irstd_get_closest_star(ra, dec) ;
-        if (refstar != NULL) {
-            refstars[j] = refstar ;
-            j++ ;
+    /* Keep the closest star of the first catalog whose magnitude is known */
+    for (i=0 ; irstd_cur_catalogs[i] ; i++) {
+        refstar = irstd_closest(ra, dec, irstd_accept_catalog, &i) ;
+        if ((refstar != NULL) && (irstd_mag(refstar, band) < 98.0)) {
+            *mag = irstd_mag(refstar, band) ;
+            return refstar ;
         }
     }
-    
-    /* Keep the first one whose magnitude is known */
-    refstar = NULL ;
-    switch (band) {
-        case WAVEBAND_J:
-            for (i=0 ; i<nfound ; i++) {
-                if (refstars[i]->mag_J < 98.0) {
-                    refstar = refstars[i] ;
-                    *mag = (double)(refstar->mag_J) ;
-                    break ;
-                }
-            }
-            break ;
-        case WAVEBAND_H:
-            for (i=0 ; i<nfound ; i++) {
-                if (refstars[i]->mag_H < 98.0) {
-                    refstar = refstars[i] ;
-                    *mag = (double)(refstar->mag_H) ;
-                    break ;
-                }
-            }
-            break ;
-        case WAVEBAND_K:
-            for (i=0 ; i<nfound ; i++) {
-                if (refstars[i]->mag_K < 98.0) {
-                    refstar = refstars[i] ;
-                    *mag = (double)(refstar->mag_K) ;
-                    break ;
-                }
-            }
-            break ;
-        case WAVEBAND_KS:
-            for (i=0 ; i<nfound ; i++) {
-                if (refstars[i]->mag_Ks < 98.0) {
-                    refstar = refstars[i] ;
-                    *mag = (double)(refstar->mag_Ks) ;
-                    break ;
-                }
-            }
-            break ;
-        case WAVEBAND_L:
-            for (i=0 ; i<nfound ; i++) {
-                if (refstars[i]->mag_L < 98.0) {
-                    refstar = refstars[i] ;
-                    *mag = (double)(refstar->mag_L) ;
-                    break ;
-                }
-            }
-            break ;
-        case WAVEBAND_M:
-            for (i=0 ; i<nfound ; i++) {
-                if (refstars[i]->mag_M < 98.0) {
-                    refstar = refstars[i] ;
-                    *mag = (double)(refstar->mag_M) ;
-                    break ;
-                }
-            }
-            break ;
-        case WAVEBAND_Lprime:
-            for (i=0 ; i<nfound ; i++) {
-                if (refstars[i]->mag_Lp < 98.0) {
-                    refstar = refstars[i] ;
-                    *mag = (double)(refstar->mag_Lp) ;
-                    break ;
-                }
-            }
-            break ;
-        case WAVEBAND_Mprime:
-            for (i=0 ; i<nfound ; i++) {
-                if (refstars[i]->mag_Mp < 98.0) {
-                    refstar = refstars[i] ;
-                    *mag = (double)(refstar->mag_Mp) ;
-                    break ;
-                }
-            }
-            break ;
-        default:
-            break ;
-    }
-    
-    /* Free and return */
-    free(refstars) ;
-    return refstar ;
+    return NULL ;
 }
 
 /*-------------------------------------------------------------------------*/
@@ -495,19 +605,14 @@ irstd * irstd_get_star_magnitude(
   @brief	Find all stars within a given radius around a position.
   @param	ra_d	Right ascension of the center {\em in degrees}.
   @param	dec_d	Declination of the center {\em in degrees}.
-  @param	radius	Euclidean radius around the center.
+  @param	radius	Radius around the center {\em in degrees}.
   @param	nfound	Output number of found stars.
   @return	Newly allocated list of stars (or NULL if none found).
 
-  This functions locates all stars in a given disk. The disk is
+  This functions locates all active stars in a given disk. The disk is
   defined by a center which coordinates are given in degrees (RA and
-  Dec), and the radius is defined as a euclidean distance, i.e.:
-
-  A star at (r,d) is in the disk of center (r0,d0) and radius R if:
-
-  \[
-  (r-r_0)^2+(d-d_0)^2 < R^2
-  \]
+  Dec), and the radius is the great-circle distance on the sky. Stars
+  are returned in the order of the star list.
 
   The returned list of stars must be freed using free().
  */
@@ -519,43 +624,19 @@ irstd ** irstd_get_star_by_position(
     	int   	* 	nfound)
 {
 	irstd **	starlist ;
-	double		ra, dec ;
-	double		cur_dist ;
+	int		*	idx ;
 	int			i ;
 	int			found ;
 
-	starlist = NULL ;
-	found = 0 ;
-	i=0 ;
-	while (irstd_list[i].name!=NULL) {
-		if (irstd_list[i].select) {
-			ra  = irstd_list[i].ra ;
-			dec = irstd_list[i].dec ;
-			cur_dist = (ra_d-ra)*(ra_d-ra)+(dec_d-dec)*(dec_d-dec) ;
-			if (cur_dist <= (radius * radius)) {
-				found++ ;
-			}
-		}
-		i++ ;
-	}
+	idx = sky_index_search(irstd_index(), ra_d, dec_d, radius,
+			irstd_accept_active, NULL, &found) ;
+	if (idx==NULL) return NULL ;
 
-	if (found<1) return NULL ;
 	starlist = malloc(found * sizeof(irstd*)) ;
-
-	found = 0 ;
-	i=0 ;
-	while (irstd_list[i].name!=NULL) {
-		if (irstd_list[i].select) {
-			ra  = irstd_list[i].ra ;
-			dec = irstd_list[i].dec ;
-			cur_dist = (ra_d-ra)*(ra_d-ra)+(dec_d-dec)*(dec_d-dec) ;
-			if (cur_dist <= (radius * radius)) {
-				starlist[found] = &(irstd_list[i]);
-				found ++ ;
-			}
-		}
-		i++ ;
+	for (i=0 ; i<found ; i++) {
+		starlist[i] = &(irstd_cur_list[idx[i]]);
 	}
+	free(idx) ;
 	*nfound = found ;
 	return starlist ;
 }
@@ -583,220 +664,53 @@ irstd ** irstd_get_star_by_magnitude(
     int			*	nstars)
 {
 	irstd **	starlist ;
+	int		*	sorted ;
+	int		*	idx ;
+	int			lo, hi, mid ;
 	int			i ;
 	int			found ;
 
-	starlist = NULL ;
-	found = 0 ;
-
-	/*
-	 * Find out how many stars are within this magnitude range
-	 */
-	switch(band) {
-		case WAVEBAND_J:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-				((double)irstd_list[i].mag_J > mag_min) &&
-				((double)irstd_list[i].mag_J < mag_max)) found ++ ;
-			i++ ;
-		}
-		break ;
-
-		case WAVEBAND_H:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-				((double)irstd_list[i].mag_H > mag_min) &&
-				((double)irstd_list[i].mag_H < mag_max)) found ++ ;
-			i++ ;
-		}
-		break ;
-
-		case WAVEBAND_K:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_K > mag_min) &&
-				((double)irstd_list[i].mag_K < mag_max)) found ++ ;
-			i++ ;
-		}
-		break ;
-
-		case WAVEBAND_KS:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_Ks > mag_min) &&
-				((double)irstd_list[i].mag_Ks < mag_max)) found ++ ;
-			i++ ;
-		}
-		break ;
-
-		case WAVEBAND_L:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_L > mag_min) &&
-				((double)irstd_list[i].mag_L < mag_max)) found ++ ;
-			i++ ;
-		}
-		break ;
-
-		case WAVEBAND_M:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_M > mag_min) &&
-				((double)irstd_list[i].mag_M < mag_max)) found ++ ;
-			i++ ;
-		}
-		break ;
+	if ((band<WAVEBAND_J) || (band>=WAVEBAND_UNKNOWN)) {
+		e_error("unsupported wave band requested") ;
+		return NULL ;
+	}
 
-		case WAVEBAND_Lprime:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_Lp > mag_min) &&
-				((double)irstd_list[i].mag_Lp < mag_max)) found ++ ;
-			i++ ;
+	/* First star brighter than mag_min in the sorted list */
+	sorted = irstd_bymag(band) ;
+	lo = 0 ;
+	hi = irstd_nstars() ;
+	while (lo<hi) {
+		mid = (lo+hi)/2 ;
+		if (irstd_mag(irstd_cur_list+sorted[mid], band) > mag_min) {
+			hi = mid ;
+		} else {
+			lo = mid+1 ;
 		}
-		break ;
+	}
 
-		case WAVEBAND_Mprime:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_Mp > mag_min) &&
-				((double)irstd_list[i].mag_Mp < mag_max)) found ++ ;
-			i++ ;
+	/* Active stars up to mag_max, back in the list order */
+	found = 0 ;
+	hi = irstd_nstars() ;
+	idx = malloc((hi-lo+1) * sizeof(int)) ;
+	for (i=lo ; i<hi ; i++) {
+		if (irstd_mag(irstd_cur_list+sorted[i], band) >= mag_max) break ;
+		if (irstd_cur_list[sorted[i]].select) {
+			idx[found++] = sorted[i] ;
 		}
-		break ;
-
-		case WAVEBAND_UNKNOWN:
-		default:
-		e_error("unsupported wave band requested") ;
-		return NULL ;
 	}
-
 	if (found<1) {
+		free(idx) ;
 		*nstars=0;
 		return NULL ;
 	}
+	qsort(idx, found, sizeof(int), irstd_cmp_int) ;
 
-
-	/* Now build up the list of matching stars */
 	starlist = malloc(found * sizeof(irstd*)) ;
-	*nstars = found ;
-	found = 0 ;
-	switch(band) {
-		case WAVEBAND_J:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_J > mag_min) &&
-				((double)irstd_list[i].mag_J < mag_max)) {
-				starlist[found] = &(irstd_list[i]);
-				found ++ ;
-			}
-			i++ ;
-		}
-		break ;
-
-		case WAVEBAND_H:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_H > mag_min) &&
-				((double)irstd_list[i].mag_H < mag_max)) {
-				starlist[found] = &(irstd_list[i]);
-				found ++ ;
-			}
-			i++ ;
-		}
-		break ;
-
-		case WAVEBAND_K:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_K > mag_min) &&
-				((double)irstd_list[i].mag_K < mag_max)) {
-				starlist[found] = &(irstd_list[i]);
-				found ++ ;
-			}
-			i++ ;
-		}
-		break ;
-
-		case WAVEBAND_KS:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_Ks > mag_min) &&
-				((double)irstd_list[i].mag_Ks < mag_max)) {
-				starlist[found] = &(irstd_list[i]);
-				found ++ ;
-			}
-			i++ ;
-		}
-		break ;
-
-		case WAVEBAND_L:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_L > mag_min) &&
-				((double)irstd_list[i].mag_L < mag_max)) {
-				starlist[found] = &(irstd_list[i]);
-				found ++ ;
-			}
-			i++ ;
-		}
-		break ;
-
-		case WAVEBAND_M:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_M > mag_min) &&
-				((double)irstd_list[i].mag_M < mag_max)) {
-				starlist[found] = &(irstd_list[i]);
-				found ++ ;
-			}
-			i++ ;
-		}
-		break ;
-
-		case WAVEBAND_Lprime:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_Lp > mag_min) &&
-				((double)irstd_list[i].mag_Lp < mag_max)) {
-				starlist[found] = &(irstd_list[i]);
-				found ++ ;
-			}
-			i++ ;
-		}
-		break ;
-
-		case WAVEBAND_Mprime:
-		i=0 ;
-		while (irstd_list[i].name!=NULL) {
-			if ((irstd_list[i].select) &&
-			    ((double)irstd_list[i].mag_Mp > mag_min) &&
-				((double)irstd_list[i].mag_Mp < mag_max)) {
-				starlist[found] = &(irstd_list[i]);
-				found ++ ;
-			}
-			i++ ;
-		}
-		break ;
-
-		default:
-		break ;
+	for (i=0 ; i<found ; i++) {
+		starlist[i] = &(irstd_cur_list[idx[i]]);
 	}
+	free(idx) ;
+	*nstars = found ;
 	return starlist ;
 }
 
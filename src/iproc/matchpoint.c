@@ -24,27 +24,76 @@
 #include "resampling.h"
 #include "detect.h"
 #include "dstats.h"
+#include "parallel.h"
 #include "pi.h"
 
 /*----------------------------------------------------------------------------
                                 Define
  ---------------------------------------------------------------------------*/
 
-#define MIN_NB_OF_POINTS    5
-#define	NB_SAMPLES			36
 #define SQR(x) ((x)*(x))
 
+/* Number of brightest points used to build candidate transforms */
+#define MATCH_NBRIGHT_SHIFT		40
+#define MATCH_NBRIGHT_ROTATE	25
+/* Minimal number of matched points for a valid transform */
+#define MATCH_MINMATCH			3
+/* Number of least-squares refinement passes */
+#define MATCH_NREFINE			3
+
 /*---------------------------------------------------------------------------
                             Prototypes
  ---------------------------------------------------------------------------*/
 
-#define	MATCHPOINT_NBOBJECTS	5
+#define	MATCHPOINT_NBOBJECTS	100
+#define MATCHPOINT_TOL			3.0
+
+/*---------------------------------------------------------------------------
+                            Private types
+ ---------------------------------------------------------------------------*/
+
+/* Bucket grid on a list of points, for searches within a tolerance */
+typedef struct _MATCH_GRID_ {
+    double3     *   pts ;
+    double          x0, y0 ;
+    double          cell ;
+    int             nx, ny ;
+    /* Points of cell c are idx[start[c]..start[c+1]-1] */
+    int         *   start ;
+    int         *   idx ;
+} match_grid ;
+
+/* Pair of points in a list */
+typedef struct _MATCH_PAIR_ {
+    double      len ;
+    int         a, b ;
+} match_pair ;
+
+/* Point index sorted by flux */
+typedef struct _MATCH_FLUX_ {
+    double      z ;
+    int         i ;
+} match_flux ;
+
+/* Matching of one list against many, on the worker threads */
+typedef struct _MATCH_JOB_ {
+    double3         *   ref ;
+    double3         **  det ;
+    double              tol ;
+    double              max_angle ;
+    match_transform *   tr ;
+} match_job ;
 
 /*---------------------------------------------------------------------------
                             Prototypes
  ---------------------------------------------------------------------------*/
 
-static double * match_computewv(double3	*, int) ;
+static match_grid * match_grid_new(double3 *, double) ;
+static void match_grid_del(match_grid *) ;
+static int match_grid_find(match_grid *, double, double, double) ;
+static int * match_brightest(double3 *, int) ;
+static int match_estimate(double3 *, double3 *, double, double,
+        match_transform *) ;
 
 /*---------------------------------------------------------------------------
                             Function codes
@@ -59,6 +108,10 @@ static double * match_computewv(double3	*, int) ;
   @param	offsety	returned y offset
   @param	kappa	for detection
   @return 	0 if ok, -1 otherwise	
+
+  Up to 100 bright stars are detected in both images (subsampled by 2),
+  and the offset is the translation matching most of them within 3
+  pixels (see match_pointslist_transform()).
  */
 /*--------------------------------------------------------------------------*/
 int offsets_estimates(
@@ -72,10 +125,7 @@ int offsets_estimates(
 	image_t		*	sub_im2 ;
 	double3     *   points1 ;
     double3     *   points2 ;
-    int         *   array ;
-    double      *   offsetsx ;
-    double      *   offsetsy ;
-
+    match_transform tr ;
     int             i ;
 
     /* Points detection on sub-sampled first image */
@@ -89,7 +139,7 @@ int offsets_estimates(
     }
     image_del(sub_im1) ;
 
-	/* Points detection on sub-sampled first image */
+	/* Points detection on sub-sampled second image */
     sub_im2 = image_subsample(im2) ;
     if ((points2 = detected_ks_brightest_stars(sub_im2, 
 					MATCHPOINT_NBOBJECTS, 
@@ -111,33 +161,19 @@ int offsets_estimates(
          points2->y[i] *= 2 ;
     }
 
-    /* Associate points */
-    if ((array = match_pointslist(points1, points2)) == NULL) {
+    /* Find the translation between the lists */
+    if (match_pointslist_transform(points1, points2, MATCHPOINT_TOL, 0.0,
+                &tr) != 0) {
         e_error("cannot match points") ;
         double3_del(points1) ;
         double3_del(points2) ;
         return -1 ;
     }
-
-    /* Compute offsets candidates */
-    offsetsx = malloc(points1->n * sizeof(double)) ;
-    offsetsy = malloc(points1->n * sizeof(double)) ;
-
-    for (i=0 ; i<points1->n ; i++) {
-        offsetsx[i] = points2->x[array[i]] - points1->x[i] ;
-        offsetsy[i] = points2->y[array[i]] - points1->y[i] ;
-    }
     double3_del(points1) ;
     double3_del(points2) ;
-    free(array) ;
-
-    /* Compute offsets */
-    *offsetx = double_median(offsetsx, points1->n) ;
-    *offsety = double_median(offsetsy, points1->n) ;
 
-    /* Free and return */
-    free(offsetsx) ;
-    free(offsetsy) ;
+    *offsetx = tr.dx ;
+    *offsety = tr.dy ;
     return 0 ;
 }
 
@@ -148,122 +184,614 @@ int offsets_estimates(
   @param    det1	first list of detected points
   @param    det2	second list of detected points
   @return 	look up table
+
+  The translation between the lists is estimated with
+  match_pointslist_transform(), and every point of det1 is associated
+  to the closest point of det2 within 3 pixels after translation. The
+  returned table holds, for every point of det1, the index of the
+  associated point in det2 or -1 if there is none. It must be
+  deallocated using free(). NULL is returned if the lists cannot be
+  matched.
  */
 /*--------------------------------------------------------------------------*/
 int * match_pointslist(
         double3    *   det1,
         double3    *   det2)
 {
-    double      **  wv1 ;
-    double      **  wv2 ;
-	double		**	lkh ;
-	double			lkh_var ;
-	
-	int			*	corres ;	
-    int             i, j, k ;
+    match_transform     tr ;
+    match_grid      *   grid ;
+	int			    *	corres ;	
+    int                 i ;
 
     /* Test input data */
-    if ((det1->n < MIN_NB_OF_POINTS) || (det2->n < MIN_NB_OF_POINTS)) {
-        e_warning("not enough points for this method") ;
+    if ((det1 == NULL) || (det2 == NULL)) return NULL ;
+    if (match_estimate(det1, det2, MATCHPOINT_TOL, 0.0, &tr) != 0) {
+        e_warning("cannot match the lists of points") ;
         return NULL ;
     }
 
-    /* Allocate wv1 */
-    wv1 = malloc(det1->n * sizeof(double *)) ;
-
-    /* For each point in the first list, compute its world view */
-    for (i=0 ; i<det1->n ; i++) wv1[i] = match_computewv(det1, i) ;
-
-    /* Allocate wv2 */
-    wv2 = malloc(det2->n * sizeof(double *)) ;
-
-    /* For each point in the second list, compute its world view */
-    for (i=0 ; i<det2->n ; i++) wv2[i] = match_computewv(det2, i) ; 
-
-    /* For each point of the first list, compute the likelyhoods */
-	lkh = malloc(det1->n * sizeof(double*)) ;
-	for (i=0 ; i<det1->n ; i++) lkh[i] = malloc(det2->n * sizeof(double)) ;
-	for (i=0 ; i<det1->n ; i++) {
-		for (j=0 ; j<det2->n ; j++) {
-			lkh_var = 0.0 ;
-			for (k=0 ; k<NB_SAMPLES ; k++) lkh_var += SQR(wv1[i][k]-wv2[j][k]) ;
-			lkh[i][j] = sqrt(lkh_var) ;
-		}
-	}
-	for (i=0 ; i<det1->n ; i++) free(wv1[i]) ;
-	for (i=0 ; i<det2->n ; i++) free(wv2[i]) ;
-	free(wv1) ;
-	free(wv2) ;
-
 	/* Associate the stars */
+    grid = match_grid_new(det2, MATCHPOINT_TOL) ;
     corres = malloc(det1->n * sizeof(int)) ;
-
     for (i=0 ; i<det1->n ; i++) {
-        lkh_var = lkh[i][0] ;
-        corres[i] = 0 ;
-        for (j=1 ; j<det2->n ; j++) {
-           if (lkh[i][j] < lkh_var) {
-               lkh_var = lkh[i][j] ;
-               corres[i] = j ;
-           }
+        corres[i] = match_grid_find(grid, det1->x[i] + tr.dx,
+                det1->y[i] + tr.dy, MATCHPOINT_TOL) ;
+    }
+    match_grid_del(grid) ;
+	return corres ;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Find the rigid transform between two lists of points
+  @param    ref         Reference list of points
+  @param    det         List of points to match
+  @param    tol         Matching tolerance in pixels
+  @param    max_angle   Maximal rotation in degrees, 0 for translation only
+  @param    tr          Returned transform
+  @return 	0 if ok, -1 otherwise
+
+  The lists do not need to have the same number of points nor to be
+  complete. The z field of the points is their flux: candidate
+  transforms are built by associating the brightest points of both
+  lists (single points for a translation, pairs of points of equal
+  length for a rotation), and the transform matching the most points
+  of ref to a point of det within tol is kept. It is then refined by a
+  least-squares fit on the matched points. The cost is about
+  O(n log n) in the number of points.
+
+  At least 3 points must be matched for the transform to be valid, or
+  all points of the shorter list if it has less than 3 points.
+ */
+/*--------------------------------------------------------------------------*/
+int match_pointslist_transform(
+        double3         *   ref,
+        double3         *   det,
+        double              tol,
+        double              max_angle,
+        match_transform *   tr)
+{
+    if ((ref == NULL) || (det == NULL) || (tr == NULL) || (tol <= 0.0)) {
+        e_error("invalid input to point matching") ;
+        return -1 ;
+    }
+    return match_estimate(ref, det, tol, max_angle, tr) ;
+}
+
+
+/* Task of match_pointslist_many(): match one list */
+static void match_task(void * arg, int task, int worker)
+{
+    match_job   *   job = arg ;
+
+    match_estimate(job->ref, job->det[task], job->tol, job->max_angle,
+            job->tr + task) ;
+    return ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Match a reference list of points against many lists
+  @param    ref         Reference list of points
+  @param    det         Lists of points to match
+  @param    n           Number of lists in det
+  @param    tol         Matching tolerance in pixels
+  @param    max_angle   Maximal rotation in degrees, 0 for translation only
+  @return 	Newly allocated array of n transforms, NULL on error
+
+  Calls match_pointslist_transform() for every list of det, in
+  parallel. The nmatch field of the transforms of the lists which could
+  not be matched is 0. The returned array must be deallocated using
+  free().
+ */
+/*--------------------------------------------------------------------------*/
+match_transform * match_pointslist_many(
+        double3         *   ref,
+        double3         **  det,
+        int                 n,
+        double              tol,
+        double              max_angle)
+{
+    match_job       job ;
+
+    if ((ref == NULL) || (det == NULL) || (n < 1) || (tol <= 0.0)) {
+        e_error("invalid input to point matching") ;
+        return NULL ;
+    }
+    job.ref       = ref ;
+    job.det       = det ;
+    job.tol       = tol ;
+    job.max_angle = max_angle ;
+    job.tr        = calloc(n, sizeof(match_transform)) ;
+    eclipse_parallel_run(match_task, &job, n) ;
+    return job.tr ;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Find offsets in an image sequence by matching stars
+  @param    in      Input cube
+  @param    ref     Index of the reference plane
+  @param    kappa   Kappa for the detection
+  @return 	1 newly allocated double3 object containing offset estimates.
+
+  Up to 100 bright stars are detected in every plane, and matched to the
+  stars of the reference plane with match_pointslist_many(). The
+  returned offsets follow the convention of cube_blindoffsets(): the
+  x and y fields hold the offsets of every plane relative to the
+  reference plane, the z field the number of matched stars. NULL is
+  returned if a plane cannot be matched. The returned object must be
+  deallocated using double3_del().
+ */
+/*--------------------------------------------------------------------------*/
+double3 * cube_matchoffsets(
+        cube_t  *   in,
+        int         ref,
+        double      kappa)
+{
+    double3         **  pts ;
+    double3         *   offs ;
+    match_transform *   tr ;
+    int                 p ;
+
+    if ((in == NULL) || (ref < 0) || (ref >= in->np)) return NULL ;
+
+    /* Detect stars in all planes */
+    pts = calloc(in->np, sizeof(double3*)) ;
+    offs = NULL ;
+    for (p=0 ; p<in->np ; p++) {
+        compute_status("detecting stars...", p, in->np, 2) ;
+        pts[p] = detected_ks_brightest_stars(in->plane[p],
+                MATCHPOINT_NBOBJECTS, kappa) ;
+        if (pts[p] == NULL) {
+            e_error("cannot detect stars in plane %d", p+1) ;
+            break ;
         }
     }
 
-	/* Free and return */
-	for (i=0 ; i<det1->n ; i++) free(lkh[i]) ;
-	free(lkh) ;
-	return corres ;
+    /* Match all planes against the reference one */
+    if (p == in->np) {
+        tr = match_pointslist_many(pts[ref], pts, in->np, MATCHPOINT_TOL,
+                0.0) ;
+        offs = double3_new(in->np) ;
+        for (p=0 ; p<in->np ; p++) {
+            if (tr[p].nmatch < 1) {
+                e_error("cannot match stars in plane %d", p+1) ;
+                double3_del(offs) ;
+                offs = NULL ;
+                break ;
+            }
+            offs->x[p] = tr[p].dx ;
+            offs->y[p] = tr[p].dy ;
+            offs->z[p] = (double)tr[p].nmatch ;
+        }
+        free(tr) ;
+    }
+
+    for (p=0 ; p<in->np ; p++) {
+        if (pts[p] != NULL) double3_del(pts[p]) ;
+    }
+    free(pts) ;
+    return offs ;
 }
 
 
 /*-------------------------------------------------------------------------*/
 /**
-  @brief	Compute the worlview of a point in a list of points
-  @param   	points	List of points 
-  @param   	ind		Reference point 
-  @return 	the world view	
+  @brief	Build a bucket grid on a list of points
+  @param   	pts     List of points
+  @param   	tol     Search tolerance
+  @return 	1 newly allocated grid
+
+  Cells are at least tol wide, so that the points within tol of any
+  position are in the 3x3 cells around it, and hold about one point
+  each.
  */
 /*--------------------------------------------------------------------------*/
-static double * match_computewv(
-		double3	*	points,
-		int			ind)
+static match_grid * match_grid_new(
+        double3     *   pts,
+        double          tol)
 {
-	double	*	wv ;
-	double		r0 ;	
-	double		dist ;
-	double		angle ;
-	double		X, Y ;
-	int			i ;
-		
-	wv = calloc(NB_SAMPLES, sizeof(double)) ;
-	/* Compute the reference distance r0 */
-	r0 = 0.0 ;
-	for (i=0 ; i<points->n ; i++) {
-		dist = sqrt(SQR(points->x[ind]-points->x[i])+
-				SQR(points->y[ind]-points->y[i])) ;
-		if (dist > r0) r0 = dist ;
-	}
-	/* Compute wv2 */
-	for (i=0 ; i<points->n ; i++) {
-		if (i==ind) continue ;
-		
-		/* Compute current angle */
-		X = points->x[i]-points->x[ind] ;
-		Y = points->y[i]-points->y[ind] ;
-        
-		angle = (double)(atan(Y/X)) ;
-		if (X<0) angle += PI_NUMB ;
-		angle *= 180.0 / PI_NUMB ;
-		if (angle<0) angle += 360 ;
-        
-		/* Compute current distance */
-		dist = sqrt(SQR(points->x[ind]-points->x[i])+
-				SQR(points->y[ind]-points->y[i])) ;
-        
-		/* Update wv */
-		wv[(int)(angle/(360/NB_SAMPLES))] += dist ;
-	}
-	return wv ;	
+    match_grid  *   grid ;
+    double          x1, y1 ;
+    int             ncell ;
+    int             i, c ;
+
+    grid = malloc(sizeof(match_grid)) ;
+    grid->pts = pts ;
+    grid->x0 = x1 = pts->x[0] ;
+    grid->y0 = y1 = pts->y[0] ;
+    for (i=1 ; i<pts->n ; i++) {
+        if (pts->x[i] < grid->x0) grid->x0 = pts->x[i] ;
+        if (pts->x[i] > x1) x1 = pts->x[i] ;
+        if (pts->y[i] < grid->y0) grid->y0 = pts->y[i] ;
+        if (pts->y[i] > y1) y1 = pts->y[i] ;
+    }
+    grid->cell = sqrt((x1-grid->x0+tol) * (y1-grid->y0+tol) / pts->n) ;
+    if (grid->cell < tol) grid->cell = tol ;
+    do {
+        grid->nx = (int)((x1-grid->x0) / grid->cell) + 1 ;
+        grid->ny = (int)((y1-grid->y0) / grid->cell) + 1 ;
+        grid->cell *= 2.0 ;
+    } while ((double)grid->nx * grid->ny > 4.0 * pts->n + 16.0) ;
+    grid->cell /= 2.0 ;
+    ncell = grid->nx * grid->ny ;
+
+    /* Counting sort of the points on their cell */
+    grid->start = calloc(ncell+1, sizeof(int)) ;
+    grid->idx = malloc(pts->n * sizeof(int)) ;
+    for (i=0 ; i<pts->n ; i++) {
+        c = (int)((pts->x[i]-grid->x0) / grid->cell) +
+            (int)((pts->y[i]-grid->y0) / grid->cell) * grid->nx ;
+        grid->start[c+1] ++ ;
+    }
+    for (c=0 ; c<ncell ; c++) grid->start[c+1] += grid->start[c] ;
+    for (i=0 ; i<pts->n ; i++) {
+        c = (int)((pts->x[i]-grid->x0) / grid->cell) +
+            (int)((pts->y[i]-grid->y0) / grid->cell) * grid->nx ;
+        grid->idx[grid->start[c]++] = i ;
+    }
+    for (c=ncell ; c>0 ; c--) grid->start[c] = grid->start[c-1] ;
+    grid->start[0] = 0 ;
+    return grid ;
 }
 
+static void match_grid_del(match_grid * grid)
+{
+    if (grid == NULL) return ;
+    free(grid->start) ;
+    free(grid->idx) ;
+    free(grid) ;
+    return ;
+}
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Find the closest point of a grid within a tolerance
+  @param   	grid    Bucket grid
+  @param   	x       Position in x
+  @param   	y       Position in y
+  @param   	tol     Search tolerance, at most the one of the grid
+  @return 	index of the closest point, -1 if none is within tol
+ */
+/*--------------------------------------------------------------------------*/
+static int match_grid_find(
+        match_grid  *   grid,
+        double          x,
+        double          y,
+        double          tol)
+{
+    double          fx, fy ;
+    double          d2, best_d2 ;
+    int             cx, cy, cx0, cy0, cx1, cy1 ;
+    int             best ;
+    int             i, k ;
+
+    fx = (x - grid->x0) / grid->cell ;
+    fy = (y - grid->y0) / grid->cell ;
+    if ((fx < -1.0) || (fy < -1.0) ||
+        (fx > grid->nx + 1.0) || (fy > grid->ny + 1.0)) return -1 ;
+    cx = (int)floor(fx) ;
+    cy = (int)floor(fy) ;
+    cx0 = (cx > 0) ? cx-1 : 0 ;
+    cy0 = (cy > 0) ? cy-1 : 0 ;
+    cx1 = (cx+1 < grid->nx) ? cx+1 : grid->nx-1 ;
+    cy1 = (cy+1 < grid->ny) ? cy+1 : grid->ny-1 ;
+
+    best = -1 ;
+    best_d2 = tol * tol ;
+    for (cy=cy0 ; cy<=cy1 ; cy++) {
+        for (cx=cx0 ; cx<=cx1 ; cx++) {
+            for (k=grid->start[cx+cy*grid->nx] ;
+                 k<grid->start[cx+cy*grid->nx+1] ; k++) {
+                i = grid->idx[k] ;
+                d2 = SQR(grid->pts->x[i]-x) + SQR(grid->pts->y[i]-y) ;
+                if ((d2 < best_d2) || ((best < 0) && (d2 <= best_d2))) {
+                    best_d2 = d2 ;
+                    best = i ;
+                }
+            }
+        }
+    }
+    return best ;
+}
+
+/* Sort by decreasing flux, then increasing index */
+static int match_cmp_flux(const void * a, const void * b)
+{
+    const match_flux    *   fa = a ;
+    const match_flux    *   fb = b ;
+
+    if (fa->z > fb->z) return -1 ;
+    if (fa->z < fb->z) return  1 ;
+    return fa->i - fb->i ;
+}
+
+/* Sort by increasing length */
+static int match_cmp_pair(const void * a, const void * b)
+{
+    const match_pair    *   pa = a ;
+    const match_pair    *   pb = b ;
+
+    if (pa->len < pb->len) return -1 ;
+    if (pa->len > pb->len) return  1 ;
+    return 0 ;
+}
+
+/* Indices of the n brightest points of a list */
+static int * match_brightest(double3 * pts, int n)
+{
+    match_flux  *   flux ;
+    int         *   idx ;
+    int             i ;
+
+    flux = malloc(pts->n * sizeof(match_flux)) ;
+    for (i=0 ; i<pts->n ; i++) {
+        flux[i].z = pts->z[i] ;
+        flux[i].i = i ;
+    }
+    qsort(flux, pts->n, sizeof(match_flux), match_cmp_flux) ;
+    idx = malloc(n * sizeof(int)) ;
+    for (i=0 ; i<n ; i++) idx[i] = flux[i].i ;
+    free(flux) ;
+    return idx ;
+}
+
+/* All pairs of a set of points, sorted by length */
+static match_pair * match_pairs(double3 * pts, int * idx, int n, int * np)
+{
+    match_pair  *   pairs ;
+    int             i, j, k ;
+
+    *np = n*(n-1)/2 ;
+    pairs = malloc((*np+1) * sizeof(match_pair)) ;
+    k = 0 ;
+    for (i=0 ; i<n ; i++) {
+        for (j=i+1 ; j<n ; j++) {
+            pairs[k].a = idx[i] ;
+            pairs[k].b = idx[j] ;
+            pairs[k].len = sqrt(SQR(pts->x[idx[j]]-pts->x[idx[i]]) +
+                                SQR(pts->y[idx[j]]-pts->y[idx[i]])) ;
+            k++ ;
+        }
+    }
+    qsort(pairs, *np, sizeof(match_pair), match_cmp_pair) ;
+    return pairs ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Count the points of a list matched by a transform
+  @param   	ref     Reference list of points
+  @param   	sel     Indices of the points to test
+  @param   	nsel    Number of points to test
+  @param   	grid    Grid on the list to match
+  @param   	tol     Matching tolerance
+  @param   	tr      Transform to test
+  @param   	res     Returned sum of squared residuals
+  @return 	number of matched points
+ */
+/*--------------------------------------------------------------------------*/
+static int match_score(
+        double3         *   ref,
+        int             *   sel,
+        int                 nsel,
+        match_grid      *   grid,
+        double              tol,
+        match_transform *   tr,
+        double          *   res)
+{
+    double      c, s ;
+    double      u, v ;
+    int         i, j, k ;
+    int         n ;
+
+    c = cos(tr->angle * PI_NUMB / 180.0) ;
+    s = sin(tr->angle * PI_NUMB / 180.0) ;
+    n = 0 ;
+    *res = 0.0 ;
+    for (k=0 ; k<nsel ; k++) {
+        i = sel[k] ;
+        u = tr->dx + c * ref->x[i] - s * ref->y[i] ;
+        v = tr->dy + s * ref->x[i] + c * ref->y[i] ;
+        if ((j = match_grid_find(grid, u, v, tol)) >= 0) {
+            n++ ;
+            *res += SQR(grid->pts->x[j]-u) + SQR(grid->pts->y[j]-v) ;
+        }
+    }
+    return n ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Refine a transform by least squares on all matched points
+  @param   	ref         Reference list of points
+  @param   	grid        Grid on the list to match
+  @param   	tol         Matching tolerance
+  @param   	max_angle   Maximal rotation in degrees
+  @param   	tr          Transform to refine (modified)
+  @return 	void
+
+  The rotation is the one minimizing the squared residuals between the
+  centered lists of matched points, the translation brings their
+  centers together. nmatch is set to the number of points of ref
+  matched by the final transform.
+ */
+/*--------------------------------------------------------------------------*/
+static void match_refine(
+        double3         *   ref,
+        match_grid      *   grid,
+        double              tol,
+        double              max_angle,
+        match_transform *   tr)
+{
+    double      c, s ;
+    double      u, v ;
+    double      spx, spy, sqx, sqy, sdot, scross ;
+    double      angle ;
+    int         pass ;
+    int         i, j, n ;
+
+    for (pass=0 ; pass<=MATCH_NREFINE ; pass++) {
+        c = cos(tr->angle * PI_NUMB / 180.0) ;
+        s = sin(tr->angle * PI_NUMB / 180.0) ;
+        n = 0 ;
+        spx = spy = sqx = sqy = sdot = scross = 0.0 ;
+        for (i=0 ; i<ref->n ; i++) {
+            u = tr->dx + c * ref->x[i] - s * ref->y[i] ;
+            v = tr->dy + s * ref->x[i] + c * ref->y[i] ;
+            if ((j = match_grid_find(grid, u, v, tol)) < 0) continue ;
+            n++ ;
+            spx += ref->x[i] ;
+            spy += ref->y[i] ;
+            sqx += grid->pts->x[j] ;
+            sqy += grid->pts->y[j] ;
+            sdot   += ref->x[i] * grid->pts->x[j] +
+                      ref->y[i] * grid->pts->y[j] ;
+            scross += ref->x[i] * grid->pts->y[j] -
+                      ref->y[i] * grid->pts->x[j] ;
+        }
+        tr->nmatch = n ;
+        if ((n < 1) || (pass == MATCH_NREFINE)) break ;
+
+        /* Rotation of the centered lists */
+        if ((max_angle > 0.0) && (n > 1)) {
+            sdot   -= (spx * sqx + spy * sqy) / n ;
+            scross -= (spx * sqy - spy * sqx) / n ;
+            angle = atan2(scross, sdot) * 180.0 / PI_NUMB ;
+            if (fabs(angle) <= max_angle) tr->angle = angle ;
+            c = cos(tr->angle * PI_NUMB / 180.0) ;
+            s = sin(tr->angle * PI_NUMB / 180.0) ;
+        }
+        tr->dx = (sqx - c * spx + s * spy) / n ;
+        tr->dy = (sqy - s * spx - c * spy) / n ;
+    }
+    return ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Find the rigid transform between two lists of points
+  @param    ref         Reference list of points
+  @param    det         List of points to match
+  @param    tol         Matching tolerance in pixels
+  @param    max_angle   Maximal rotation in degrees, 0 for translation only
+  @param    tr          Returned transform
+  @return 	0 if ok, -1 otherwise
+
+  See match_pointslist_transform(). This function prints no message and
+  can be called from several threads at the same time.
+ */
+/*--------------------------------------------------------------------------*/
+static int match_estimate(
+        double3         *   ref,
+        double3         *   det,
+        double              tol,
+        double              max_angle,
+        match_transform *   tr)
+{
+    match_grid      *   grid ;
+    match_pair      *   rpairs ;
+    match_pair      *   dpairs ;
+    match_transform     cand ;
+    int             *   bref ;
+    int             *   bdet ;
+    double              res, best_res ;
+    double              ang, c, s ;
+    int                 nref, ndet, nrp, ndp ;
+    int                 n, best_n ;
+    int                 rotate ;
+    int                 a, b, o ;
+    int                 i, j, lo, hi, mid ;
+
+    memset(tr, 0, sizeof(match_transform)) ;
+    if ((ref == NULL) || (det == NULL) || (tol <= 0.0)) return -1 ;
+    if ((ref->n < 1) || (det->n < 1)) return -1 ;
+
+    rotate = (max_angle > 0.0) && (ref->n > 1) && (det->n > 1) ;
+    n = rotate ? MATCH_NBRIGHT_ROTATE : MATCH_NBRIGHT_SHIFT ;
+    nref = (ref->n < n) ? ref->n : n ;
+    ndet = (det->n < n) ? det->n : n ;
+    bref = match_brightest(ref, nref) ;
+    bdet = match_brightest(det, ndet) ;
+    grid = match_grid_new(det, tol) ;
+
+    best_n = 0 ;
+    best_res = 0.0 ;
+    cand.nmatch = 0 ;
+    if (!rotate) {
+        /* Translations associating two bright points */
+        cand.angle = 0.0 ;
+        for (i=0 ; i<nref ; i++) {
+            for (j=0 ; j<ndet ; j++) {
+                cand.dx = det->x[bdet[j]] - ref->x[bref[i]] ;
+                cand.dy = det->y[bdet[j]] - ref->y[bref[i]] ;
+                n = match_score(ref, bref, nref, grid, tol, &cand, &res) ;
+                if ((n > best_n) || ((n == best_n) && (res < best_res))) {
+                    best_n = n ;
+                    best_res = res ;
+                    *tr = cand ;
+                }
+            }
+        }
+    } else {
+        /* Rigid transforms associating two bright pairs of same length */
+        rpairs = match_pairs(ref, bref, nref, &nrp) ;
+        dpairs = match_pairs(det, bdet, ndet, &ndp) ;
+        for (i=0 ; i<nrp ; i++) {
+            /* Short pairs give a poor angle */
+            if (rpairs[i].len < 2.0 * tol) continue ;
+            lo = 0 ;
+            hi = ndp ;
+            while (lo < hi) {
+                mid = (lo+hi)/2 ;
+                if (dpairs[mid].len < rpairs[i].len - tol) lo = mid+1 ;
+                else hi = mid ;
+            }
+            for (j=lo ; (j<ndp) && (dpairs[j].len<=rpairs[i].len+tol) ; j++) {
+                for (o=0 ; o<2 ; o++) {
+                    a = o ? dpairs[j].b : dpairs[j].a ;
+                    b = o ? dpairs[j].a : dpairs[j].b ;
+                    ang = atan2(det->y[b]-det->y[a], det->x[b]-det->x[a]) -
+                          atan2(ref->y[rpairs[i].b]-ref->y[rpairs[i].a],
+                                ref->x[rpairs[i].b]-ref->x[rpairs[i].a]) ;
+                    if (ang > PI_NUMB) ang -= 2.0 * PI_NUMB ;
+                    if (ang <= -PI_NUMB) ang += 2.0 * PI_NUMB ;
+                    cand.angle = ang * 180.0 / PI_NUMB ;
+                    if (fabs(cand.angle) > max_angle) continue ;
+                    c = cos(ang) ;
+                    s = sin(ang) ;
+                    cand.dx = det->x[a] - c * ref->x[rpairs[i].a]
+                                        + s * ref->y[rpairs[i].a] ;
+                    cand.dy = det->y[a] - s * ref->x[rpairs[i].a]
+                                        - c * ref->y[rpairs[i].a] ;
+                    n = match_score(ref, bref, nref, grid, tol, &cand, &res) ;
+                    if ((n > best_n) || ((n == best_n) && (res < best_res))) {
+                        best_n = n ;
+                        best_res = res ;
+                        *tr = cand ;
+                    }
+                }
+            }
+        }
+        free(rpairs) ;
+        free(dpairs) ;
+    }
+
+    /* Refine the best candidate on all points */
+    n = MATCH_MINMATCH ;
+    if (nref < n) n = nref ;
+    if (ndet < n) n = ndet ;
+    if ((best_n > 0) && (best_n >= n)) {
+        match_refine(ref, grid, tol, max_angle, tr) ;
+        if (tr->nmatch < n) tr->nmatch = 0 ;
+    }
+    if (tr->nmatch < 1) memset(tr, 0, sizeof(match_transform)) ;
+
+    match_grid_del(grid) ;
+    free(bref) ;
+    free(bdet) ;
+    return (tr->nmatch > 0) ? 0 : -1 ;
+}
@@ -0,0 +1,527 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    mosaic.c
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Multi-extension (mosaic) FITS file handling.
+
+   A mosaic is a FITS file holding one image per extension, e.g. one
+   extension per CCD chip. This module indexes all extensions of such
+   a file once, then loads chips and writes output chips from several
+   worker threads without going through the qfits cache again.
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include "mosaic.h"
+
+/*---------------------------------------------------------------------------
+   								Defines
+ ---------------------------------------------------------------------------*/
+
+/* Size of a FITS block in bytes */
+#define MOSAIC_BLOCKSZ		2880
+
+/*---------------------------------------------------------------------------
+   								Private types
+ ---------------------------------------------------------------------------*/
+
+/* Shared state for mosaic_process() workers */
+typedef struct _mosaic_job_ {
+	mosaic_t		*	m ;
+	mosaic_out		*	out ;
+	mosaic_chip_fn		fn ;
+	void			*	arg ;
+	int				*	status ;
+} mosaic_job ;
+
+/*---------------------------------------------------------------------------
+   								Private functions
+ ---------------------------------------------------------------------------*/
+
+/* Number of bytes in the data section of a chip, without padding */
+static long mosaic_chip_datasize(mosaic_chip * c)
+{
+	return (long)c->lx * (long)c->ly * (long)BYTESPERPIXEL(c->bitpix) ;
+}
+
+/* Fill a chip description from an extension header */
+static int mosaic_chip_fromheader(mosaic_chip * c, qfits_header * h)
+{
+	c->lx = c->ly = 0 ;
+	c->bitpix = qfits_header_getint(h, "BITPIX", 0);
+	c->bscale = qfits_header_getdouble(h, "BSCALE", 1.0);
+	c->bzero  = qfits_header_getdouble(h, "BZERO", 0.0);
+	if (qfits_header_getint(h, "NAXIS", 0)!=2) return -1 ;
+	c->lx = qfits_header_getint(h, "NAXIS1", 0);
+	c->ly = qfits_header_getint(h, "NAXIS2", 0);
+	if (c->lx<1 || c->ly<1 || BYTESPERPIXEL(c->bitpix)<1) {
+		c->lx = c->ly = 0 ;
+		return -1 ;
+	}
+	return 0 ;
+}
+
+/* Read exactly nbytes at a given offset, using a private descriptor */
+static int mosaic_pread(char * filename, long offs, char * buf, long nbytes)
+{
+	int		fd ;
+	long	done ;
+	long	r ;
+
+	if ((fd=open(filename, O_RDONLY))==-1) return -1 ;
+	if (lseek(fd, (off_t)offs, SEEK_SET)!=(off_t)offs) {
+		close(fd);
+		return -1 ;
+	}
+	done = 0 ;
+	while (done<nbytes) {
+		r = (long)read(fd, buf+done, (size_t)(nbytes-done));
+		if (r<=0) break ;
+		done += r ;
+	}
+	close(fd);
+	return (done==nbytes) ? 0 : -1 ;
+}
+
+/* Write exactly nbytes at a given offset, using a private descriptor */
+static int mosaic_pwrite(char * filename, long offs, char * buf, long nbytes)
+{
+	int		fd ;
+	long	done ;
+	long	w ;
+
+	if ((fd=open(filename, O_WRONLY))==-1) return -1 ;
+	if (lseek(fd, (off_t)offs, SEEK_SET)!=(off_t)offs) {
+		close(fd);
+		return -1 ;
+	}
+	done = 0 ;
+	while (done<nbytes) {
+		w = (long)write(fd, buf+done, (size_t)(nbytes-done));
+		if (w<=0) break ;
+		done += w ;
+	}
+	if (close(fd)!=0) return -1 ;
+	return (done==nbytes) ? 0 : -1 ;
+}
+
+/* Worker for mosaic_process() */
+static void mosaic_process_task(void * p, int task, int worker)
+{
+	mosaic_job	*	job ;
+	image_t		*	chip ;
+	image_t		*	res ;
+	int				xtnum ;
+
+	job   = (mosaic_job*)p ;
+	xtnum = task+1 ;
+	job->status[task] = -1 ;
+
+	if ((chip = mosaic_load_chip(job->m, xtnum))==NULL) return ;
+	res = chip ;
+	if (job->fn!=NULL) {
+		res = job->fn(chip, xtnum, job->arg);
+		if (res!=chip) image_del(chip);
+		if (res==NULL) return ;
+	}
+	if (job->out!=NULL) {
+		if (mosaic_out_put(job->out, xtnum, res)!=0) {
+			image_del(res);
+			return ;
+		}
+	}
+	image_del(res);
+	job->status[task] = 0 ;
+	return ;
+}
+
+/*---------------------------------------------------------------------------
+  							Function codes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Open and index a multi-extension FITS file.
+  @param    filename    Name of the file to open.
+  @return   1 newly allocated mosaic_t, or NULL in case of error.
+
+  Reads all extension headers once and stores the size, pixel type and
+  data offset of every image extension. Extensions which are not
+  2-dimensional images get a zero size and cannot be loaded.
+  The returned object must be deallocated with mosaic_close().
+ */
+/*--------------------------------------------------------------------------*/
+mosaic_t * mosaic_open(char * filename)
+{
+	mosaic_t		*	m ;
+	qfits_header	*	h ;
+	int					n_ext ;
+	int					i ;
+	int					hdr_beg, data_beg ;
+
+	if (filename==NULL) return NULL ;
+	if (is_fits_file(filename)!=1) {
+		e_error("not a FITS file: [%s]", filename);
+		return NULL ;
+	}
+	n_ext = qfits_query_n_ext(filename);
+	if (n_ext<1) {
+		e_error("no extension found in [%s]", filename);
+		return NULL ;
+	}
+
+	m = malloc(sizeof(mosaic_t));
+	m->filename = strdup(filename);
+	m->n_ext    = n_ext ;
+	m->chip     = calloc(n_ext, sizeof(mosaic_chip));
+
+	for (i=0 ; i<n_ext ; i++) {
+		h = qfits_header_readext(filename, i+1);
+		if (h==NULL) {
+			e_error("reading header of extension %d in [%s]", i+1, filename);
+			mosaic_close(m);
+			return NULL ;
+		}
+		if (mosaic_chip_fromheader(m->chip+i, h)!=0) {
+			e_warning("extension %d in [%s] is not an image", i+1, filename);
+		}
+		qfits_header_destroy(h);
+		if (qfits_get_hdrinfo(filename, i+1, &hdr_beg, NULL)!=0 ||
+			qfits_get_datinfo(filename, i+1, &data_beg, NULL)!=0) {
+			e_error("getting offsets to extension %d in [%s]", i+1, filename);
+			mosaic_close(m);
+			return NULL ;
+		}
+		m->chip[i].hdr_beg  = (long)hdr_beg ;
+		m->chip[i].data_beg = (long)data_beg ;
+	}
+	return m ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate a mosaic_t object.
+  @param    m   Object to deallocate.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void mosaic_close(mosaic_t * m)
+{
+	if (m==NULL) return ;
+	if (m->filename!=NULL) free(m->filename);
+	if (m->chip!=NULL) free(m->chip);
+	free(m);
+	return ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Load one chip from an indexed mosaic.
+  @param    m       Indexed mosaic.
+  @param    xtnum   Extension number (starting from 1).
+  @return   1 newly allocated image, or NULL in case of error.
+
+  Reads the data section with a private file descriptor, so that
+  this function can be called concurrently on different extensions.
+  It does not print any message.
+ */
+/*--------------------------------------------------------------------------*/
+image_t * mosaic_load_chip(mosaic_t * m, int xtnum)
+{
+	mosaic_chip	*	c ;
+	image_t		*	chip ;
+	char		*	raw ;
+	long			nbytes ;
+	int				npix ;
+
+	if (m==NULL || xtnum<1 || xtnum>m->n_ext) return NULL ;
+	c = m->chip + xtnum - 1 ;
+	if (c->lx<1 || c->ly<1) return NULL ;
+
+	npix   = c->lx * c->ly ;
+	nbytes = mosaic_chip_datasize(c);
+	raw    = malloc((size_t)nbytes);
+	if (mosaic_pread(m->filename, c->data_beg, raw, nbytes)!=0) {
+		free(raw);
+		return NULL ;
+	}
+	chip = malloc(sizeof(image_t));
+	chip->lx = c->lx ;
+	chip->ly = c->ly ;
+#ifdef DOUBLEPIX
+	chip->data = (pixelvalue*)qfits_pixin_double((byte*)raw, npix, c->bitpix,
+												 c->bscale, c->bzero);
+#else
+	chip->data = (pixelvalue*)qfits_pixin_float((byte*)raw, npix, c->bitpix,
+												c->bscale, c->bzero);
+#endif
+	free(raw);
+	if (chip->data==NULL) {
+		free(chip);
+		return NULL ;
+	}
+	return chip ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create a multi-extension output file.
+  @param    filename    Name of the file to create.
+  @param    h_main      Main header.
+  @param    h_ext       Array of n_ext extension headers.
+  @param    n_ext       Number of extensions.
+  @return   1 newly allocated mosaic_out, or NULL in case of error.
+
+  Extension headers must contain valid BITPIX, NAXIS1 and NAXIS2
+  values: they determine the space reserved for every data section.
+  All headers are written to disk immediately, data sections are
+  zero-filled until mosaic_out_put() is called for them.
+  The returned object must be deallocated with mosaic_out_close().
+ */
+/*--------------------------------------------------------------------------*/
+mosaic_out * mosaic_out_create(
+		char			*	filename,
+		qfits_header	*	h_main,
+		qfits_header	**	h_ext,
+		int					n_ext)
+{
+	mosaic_out	*	out ;
+	FILE		*	f ;
+	long			pos ;
+	long			padded ;
+	int				i ;
+
+	if (filename==NULL || h_main==NULL || h_ext==NULL || n_ext<1)
+		return NULL ;
+
+	out = malloc(sizeof(mosaic_out));
+	out->filename = strdup(filename);
+	out->n_ext    = n_ext ;
+	out->chip     = calloc(n_ext, sizeof(mosaic_chip));
+	for (i=0 ; i<n_ext ; i++) {
+		if (mosaic_chip_fromheader(out->chip+i, h_ext[i])!=0) {
+			e_error("invalid image header for output extension %d", i+1);
+			mosaic_out_close(out);
+			return NULL ;
+		}
+	}
+
+	if ((f=fopen(filename, "w"))==NULL) {
+		e_error("cannot create output file [%s]", filename);
+		mosaic_out_close(out);
+		return NULL ;
+	}
+	qfits_header_dump(h_main, f);
+	for (i=0 ; i<n_ext ; i++) {
+		out->chip[i].hdr_beg = ftell(f);
+		qfits_header_dump(h_ext[i], f);
+		out->chip[i].data_beg = ftell(f);
+		/* Reserve the padded data section */
+		padded = mosaic_chip_datasize(out->chip+i) ;
+		padded = MOSAIC_BLOCKSZ * ((padded + MOSAIC_BLOCKSZ - 1)/MOSAIC_BLOCKSZ);
+		pos = out->chip[i].data_beg + padded ;
+		if (fseek(f, pos, SEEK_SET)!=0) {
+			e_error("cannot reserve space in [%s]", filename);
+			fclose(f);
+			mosaic_out_close(out);
+			return NULL ;
+		}
+	}
+	/* Extend the file to its final size: the hole reads as zeros */
+	fseek(f, pos-1, SEEK_SET);
+	fputc(0, f);
+	if (fclose(f)!=0) {
+		e_error("cannot write to [%s]", filename);
+		mosaic_out_close(out);
+		return NULL ;
+	}
+	return out ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create an output file with the same layout as an input mosaic.
+  @param    m           Indexed input mosaic.
+  @param    filename    Name of the file to create.
+  @param    h_main      Main header, or NULL to copy the input one.
+  @param    bitpix      Output BITPIX.
+  @param    lx          Output chip size in x, 0 to keep the input size.
+  @param    ly          Output chip size in y, 0 to keep the input size.
+  @return   1 newly allocated mosaic_out, or NULL in case of error.
+
+  Extension headers are copied from the input file, with BITPIX and
+  NAXIS keywords updated and BSCALE/BZERO removed.
+ */
+/*--------------------------------------------------------------------------*/
+mosaic_out * mosaic_out_create_like(
+		mosaic_t		*	m,
+		char			*	filename,
+		qfits_header	*	h_main,
+		int					bitpix,
+		int					lx,
+		int					ly)
+{
+	mosaic_out		*	out ;
+	qfits_header	*	h_copy ;
+	qfits_header	**	h_ext ;
+	char				cval[80] ;
+	int					i ;
+
+	if (m==NULL || filename==NULL) return NULL ;
+
+	h_copy = NULL ;
+	if (h_main==NULL) {
+		if ((h_copy = qfits_header_read(m->filename))==NULL) {
+			e_error("reading main header from [%s]", m->filename);
+			return NULL ;
+		}
+		h_main = h_copy ;
+	}
+	h_ext = calloc(m->n_ext, sizeof(qfits_header*));
+	out = NULL ;
+	for (i=0 ; i<m->n_ext ; i++) {
+		h_ext[i] = qfits_header_readext(m->filename, i+1);
+		if (h_ext[i]==NULL) {
+			e_error("reading header of extension %d in [%s]",
+					i+1, m->filename);
+			break ;
+		}
+		sprintf(cval, "%d", bitpix);
+		qfits_header_mod(h_ext[i], "BITPIX", cval, "Bits per pixel");
+		sprintf(cval, "%d", lx>0 ? lx : m->chip[i].lx);
+		qfits_header_mod(h_ext[i], "NAXIS1", cval, "Size in x");
+		sprintf(cval, "%d", ly>0 ? ly : m->chip[i].ly);
+		qfits_header_mod(h_ext[i], "NAXIS2", cval, "Size in y");
+		qfits_header_del(h_ext[i], "BSCALE");
+		qfits_header_del(h_ext[i], "BZERO");
+	}
+	if (i==m->n_ext) {
+		out = mosaic_out_create(filename, h_main, h_ext, m->n_ext);
+	}
+	for (i=0 ; i<m->n_ext ; i++) {
+		if (h_ext[i]!=NULL) qfits_header_destroy(h_ext[i]);
+	}
+	free(h_ext);
+	if (h_copy!=NULL) qfits_header_destroy(h_copy);
+	return out ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Write one chip into an output mosaic.
+  @param    out     Output mosaic.
+  @param    xtnum   Extension number (starting from 1).
+  @param    chip    Image to write.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The image size must match the size declared for this extension.
+  This function can be called concurrently on different extensions.
+  It does not print any message.
+ */
+/*--------------------------------------------------------------------------*/
+int mosaic_out_put(mosaic_out * out, int xtnum, image_t * chip)
+{
+	mosaic_chip	*	c ;
+	byte		*	raw ;
+	int				status ;
+
+	if (out==NULL || chip==NULL || xtnum<1 || xtnum>out->n_ext) return -1 ;
+	c = out->chip + xtnum - 1 ;
+	if (chip->lx!=c->lx || chip->ly!=c->ly) return -1 ;
+
+#ifdef DOUBLEPIX
+	raw = qfits_pixdump_double(chip->data, c->lx * c->ly, c->bitpix);
+#else
+	raw = qfits_pixdump_float(chip->data, c->lx * c->ly, c->bitpix);
+#endif
+	if (raw==NULL) return -1 ;
+	status = mosaic_pwrite(out->filename, c->data_beg, (char*)raw,
+						   mosaic_chip_datasize(c));
+	free(raw);
+	return status ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Close an output mosaic.
+  @param    out     Output mosaic.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void mosaic_out_close(mosaic_out * out)
+{
+	if (out==NULL) return ;
+	if (out->filename!=NULL) free(out->filename);
+	if (out->chip!=NULL) free(out->chip);
+	free(out);
+	return ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Apply a function to all chips of a mosaic in parallel.
+  @param    m       Indexed input mosaic.
+  @param    out     Output mosaic, or NULL.
+  @param    fn      Per-chip function.
+  @param    arg     Opaque argument passed to fn.
+  @return   int number of chips that failed, -1 on error.
+
+  Every chip is loaded, passed to fn and written to the same
+  extension in the output mosaic (if out is not NULL), by one of the
+  workers started by eclipse_parallel_run(). Only a few chips are thus
+  in memory at any time.
+ */
+/*--------------------------------------------------------------------------*/
+int mosaic_process(
+		mosaic_t		*	m,
+		mosaic_out		*	out,
+		mosaic_chip_fn		fn,
+		void			*	arg)
+{
+	mosaic_job		job ;
+	int				nfail ;
+	int				i ;
+
+	if (m==NULL) return -1 ;
+	if (out!=NULL && out->n_ext!=m->n_ext) {
+		e_error("input and output mosaics differ in number of extensions");
+		return -1 ;
+	}
+	job.m      = m ;
+	job.out    = out ;
+	job.fn     = fn ;
+	job.arg    = arg ;
+	job.status = malloc(m->n_ext * sizeof(int));
+
+	e_comment(1, "processing %d chips with %d threads",
+			  m->n_ext, eclipse_get_nthreads());
+	eclipse_parallel_run(mosaic_process_task, &job, m->n_ext);
+
+	nfail = 0 ;
+	for (i=0 ; i<m->n_ext ; i++) {
+		if (job.status[i]!=0) {
+			e_error("processing extension %d of [%s]", i+1, m->filename);
+			nfail++ ;
+		}
+	}
+	free(job.status);
+	return nfail ;
+}
+/* vim: set ts=4 et sw=4 tw=75 */
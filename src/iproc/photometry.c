@@ -23,6 +23,7 @@
 
 #include "photometry.h"
 #include "histogram.h"
+#include "parallel.h"
 
 /*---------------------------------------------------------------------------
   								Defines
@@ -32,6 +33,49 @@
 #define REJECT_LOW                      0.1
 #define REJECT_HIGH                     0.1
 
+/* Number of sources measured by one parallel task */
+#define APER_CHUNK						16
+/* Number of aperture masks kept by each worker */
+#define APER_NMASK						4
+
+/*---------------------------------------------------------------------------
+   								Private types
+ ---------------------------------------------------------------------------*/
+
+/*
+ * Aperture weights for all radii around a source at a given fractional
+ * offset from the nearest pixel center. For each pixel of the box of
+ * half-size hsize, nw weights are stored: one per radius, then the
+ * annulus weight if the background is measured with exact weights.
+ * xlo and xhi give for each box row the range of pixels with non-null
+ * weights.
+ */
+typedef struct _aper_mask_ {
+	double			fx, fy ;
+	int				valid ;
+	double		*	w ;
+	int			*	xlo ;
+	int			*	xhi ;
+	int				used ;
+} aper_mask ;
+
+typedef struct _aper_job_ {
+	image_t			*	in ;
+	double			*	x ;
+	double			*	y ;
+	double			*	radii ;
+	int					nrad ;
+	double				rad_int ;
+	double				rad_ext ;
+	int					method ;
+	int					hsize ;
+	int					nw ;
+	/* APER_NMASK masks per worker */
+	aper_mask		*	masks ;
+	int				*	clock ;
+	aperture_phot	*	out ;
+} aper_job ;
+
 
 /*---------------------------------------------------------------------------
  							Function codes
@@ -144,7 +188,10 @@ double image_get_disk_background(
 	int		        window[4] ;
     int             low_ind ;
     int             high_ind ;
+    int             n_le_low ;
+    int             n_lt_high ;
 	pixelvalue	*	pix_arr ;
+	pixelvalue		low_val, high_val ;
 
 	if (in == NULL) return 0.0 ;
 	if ((rad_int <= 0.0) || (rad_ext <= 0.0)) {
@@ -257,11 +304,28 @@ double image_get_disk_background(
 				}
 			}
 		}
-		/* Sort the array */
-        pixel_qsort(pix_arr, npix) ;
         low_ind = (int)(npix*REJECT_LOW) ;
         high_ind= (int)(npix*(1-REJECT_HIGH)) ;
-        for (i=low_ind ; i<high_ind ; i++) flux += pix_arr[i] ;
+        /*
+         * Sum the values of rank low_ind to high_ind-1: no need to sort,
+         * select the two extreme values and count their duplicates.
+         */
+        low_val = kth_smallest(pix_arr, npix, low_ind) ;
+        high_val = kth_smallest(pix_arr, npix, high_ind-1) ;
+        if (low_val == high_val) {
+            flux = (double)low_val * (double)(high_ind - low_ind) ;
+        } else {
+            n_le_low = 0 ;
+            n_lt_high = 0 ;
+            for (k=0 ; k<npix ; k++) {
+                if (pix_arr[k] <= low_val) n_le_low++ ;
+                if (pix_arr[k] < high_val) n_lt_high++ ;
+                if ((pix_arr[k] > low_val) && (pix_arr[k] < high_val))
+                    flux += pix_arr[k] ;
+            }
+            flux += (double)low_val * (double)(n_le_low - low_ind) ;
+            flux += (double)high_val * (double)(high_ind - n_lt_high) ;
+        }
         flux /= (high_ind - low_ind) ;
         free(pix_arr) ;
 		break ;
@@ -371,3 +435,346 @@ double image_estimate_background(
 }
 #undef ESTBG_REJ_THRESHOLD
 
+
+/*
+ * Area of the intersection of the disk of radius r centered on 0 with
+ * [0,x]x[0,y], for x and y positive.
+ */
+static double aper_quadrant(double x, double y, double r)
+{
+	double	xc ;
+	double	area ;
+
+	if (x>r) x = r ;
+	if (y>r) y = r ;
+	/* The circle crosses y at xc */
+	xc = sqrt(r*r - y*y) ;
+	if (x <= xc) return x * y ;
+	area = y * xc ;
+	/* Integral of sqrt(r^2-t^2) from xc to x */
+	area += 0.5 * (x * sqrt(r*r - x*x) + r*r * asin(x/r)) -
+			0.5 * (xc * sqrt(r*r - xc*xc) + r*r * asin(xc/r)) ;
+	return area ;
+}
+
+/*
+ * Area of the intersection of the disk of radius r centered on 0 with
+ * [x0,x1]x[y0,y1]. The rectangle is split along the axes and its parts
+ * folded into the first quadrant.
+ */
+static double aper_overlap(
+		double		x0,
+		double		x1,
+		double		y0,
+		double		y1,
+		double		r)
+{
+	double	xa[2], xb[2], ya[2], yb[2] ;
+	double	area ;
+	int		nx, ny, i, j ;
+
+	/* Whole pixel in or out of the disk */
+	xa[0] = (x0>0.0) ? x0 : ((x1<0.0) ? -x1 : 0.0) ;
+	ya[0] = (y0>0.0) ? y0 : ((y1<0.0) ? -y1 : 0.0) ;
+	if (xa[0]*xa[0] + ya[0]*ya[0] >= r*r) return 0.0 ;
+	xb[0] = (-x0 > x1) ? -x0 : x1 ;
+	yb[0] = (-y0 > y1) ? -y0 : y1 ;
+	if (xb[0]*xb[0] + yb[0]*yb[0] <= r*r) return (x1-x0) * (y1-y0) ;
+
+	nx = ny = 1 ;
+	if (x0>=0.0) {
+		xa[0] = x0 ; xb[0] = x1 ;
+	} else if (x1<=0.0) {
+		xa[0] = -x1 ; xb[0] = -x0 ;
+	} else {
+		xa[0] = 0.0 ; xb[0] = -x0 ;
+		xa[1] = 0.0 ; xb[1] = x1 ;
+		nx = 2 ;
+	}
+	if (y0>=0.0) {
+		ya[0] = y0 ; yb[0] = y1 ;
+	} else if (y1<=0.0) {
+		ya[0] = -y1 ; yb[0] = -y0 ;
+	} else {
+		ya[0] = 0.0 ; yb[0] = -y0 ;
+		ya[1] = 0.0 ; yb[1] = y1 ;
+		ny = 2 ;
+	}
+	area = 0.0 ;
+	for (i=0 ; i<nx ; i++) {
+		for (j=0 ; j<ny ; j++) {
+			area += aper_quadrant(xb[i], yb[j], r)
+				  - aper_quadrant(xa[i], yb[j], r)
+				  - aper_quadrant(xb[i], ya[j], r)
+				  + aper_quadrant(xa[i], ya[j], r) ;
+		}
+	}
+	return area ;
+}
+
+/* Compute the aperture weights for a fractional offset */
+static void aper_mask_fill(aper_job * job, aper_mask * m, double fx, double fy)
+{
+	double	*	w ;
+	double		x0, y0, wsum ;
+	int			size, dx, dy, k ;
+
+	size = 2*job->hsize+1 ;
+	for (dy=-job->hsize ; dy<=job->hsize ; dy++) {
+		m->xlo[dy+job->hsize] = size ;
+		m->xhi[dy+job->hsize] = -1 ;
+		y0 = (double)dy - fy - 0.5 ;
+		for (dx=-job->hsize ; dx<=job->hsize ; dx++) {
+			x0 = (double)dx - fx - 0.5 ;
+			w = m->w + ((dy+job->hsize)*size + dx+job->hsize) * job->nw ;
+			wsum = 0.0 ;
+			for (k=0 ; k<job->nrad ; k++) {
+				w[k] = aper_overlap(x0, x0+1.0, y0, y0+1.0, job->radii[k]) ;
+				wsum += w[k] ;
+			}
+			if (job->nw > job->nrad) {
+				w[k] = aper_overlap(x0, x0+1.0, y0, y0+1.0, job->rad_ext) -
+					   aper_overlap(x0, x0+1.0, y0, y0+1.0, job->rad_int) ;
+				wsum += w[k] ;
+			}
+			if (wsum > 0.0) {
+				if (m->xlo[dy+job->hsize] > dx+job->hsize)
+					m->xlo[dy+job->hsize] = dx+job->hsize ;
+				m->xhi[dy+job->hsize] = dx+job->hsize ;
+			}
+		}
+	}
+	m->fx = fx ;
+	m->fy = fy ;
+	m->valid = 1 ;
+}
+
+/* Find or compute the mask of a fractional offset in a worker cache */
+static aper_mask * aper_get_mask(
+		aper_job	*	job,
+		int				worker,
+		double			fx,
+		double			fy)
+{
+	aper_mask	*	m ;
+	aper_mask	*	lru ;
+	int				size, i ;
+
+	m = job->masks + worker * APER_NMASK ;
+	lru = m ;
+	for (i=0 ; i<APER_NMASK ; i++) {
+		if (m[i].valid && (m[i].fx == fx) && (m[i].fy == fy)) {
+			m[i].used = ++job->clock[worker] ;
+			return m+i ;
+		}
+		if (m[i].used < lru->used) lru = m+i ;
+	}
+	if (lru->w == NULL) {
+		size = 2*job->hsize+1 ;
+		lru->w = malloc(size * size * job->nw * sizeof(double)) ;
+		lru->xlo = malloc(size * sizeof(int)) ;
+		lru->xhi = malloc(size * sizeof(int)) ;
+	}
+	aper_mask_fill(job, lru, fx, fy) ;
+	lru->used = ++job->clock[worker] ;
+	return lru ;
+}
+
+static void aper_task(void * arg, int task, int worker)
+{
+	aper_job		*	job ;
+	aper_mask		*	m ;
+	pixelvalue		*	data ;
+	double			*	w ;
+	double			*	flux ;
+	double			*	area ;
+	double				sum[2], bg, fx, fy, v ;
+	int					s, s_end, ix, iy, size, i, j, k, lo, hi, pos ;
+
+	job = (aper_job*)arg ;
+	data = job->in->data ;
+	size = 2*job->hsize+1 ;
+	s = task * APER_CHUNK ;
+	s_end = s + APER_CHUNK ;
+	if (s_end > job->out->nsrc) s_end = job->out->nsrc ;
+
+	for ( ; s<s_end ; s++) {
+		flux = job->out->flux + s * job->nrad ;
+		area = job->out->area + s * job->nrad ;
+		ix = (int)floor(job->x[s] + 0.5) ;
+		iy = (int)floor(job->y[s] + 0.5) ;
+		fx = job->x[s] - (double)ix ;
+		fy = job->y[s] - (double)iy ;
+		m = aper_get_mask(job, worker, fx, fy) ;
+
+		/* All radii and the exact annulus in one pass */
+		sum[0] = sum[1] = 0.0 ;
+		for (j=0 ; j<size ; j++) {
+			if ((iy-job->hsize+j < 0) || (iy-job->hsize+j >= job->in->ly))
+				continue ;
+			/* Position of the first box pixel in this row */
+			pos = (iy-job->hsize+j) * job->in->lx + ix-job->hsize ;
+			lo = m->xlo[j] ;
+			hi = m->xhi[j] ;
+			if (ix-job->hsize+lo < 0) lo = job->hsize-ix ;
+			if (ix-job->hsize+hi >= job->in->lx) hi = job->in->lx-1-ix+job->hsize ;
+			for (i=lo ; i<=hi ; i++) {
+				v = (double)data[pos+i] ;
+				w = m->w + (j*size + i) * job->nw ;
+				for (k=0 ; k<job->nrad ; k++) {
+					flux[k] += w[k] * v ;
+					area[k] += w[k] ;
+				}
+				if (job->nw > job->nrad) {
+					sum[0] += w[k] * v ;
+					sum[1] += w[k] ;
+				}
+			}
+		}
+
+		/* Background */
+		bg = 0.0 ;
+		if (job->nw > job->nrad) {
+			if (sum[1] > 0.0) bg = sum[0] / sum[1] ;
+		} else if (job->rad_ext > job->rad_int) {
+			bg = image_get_disk_background(job->in, job->x[s], job->y[s],
+					job->rad_int, job->rad_ext, job->method) ;
+		}
+		job->out->background[s] = bg ;
+		for (k=0 ; k<job->nrad ; k++) flux[k] -= bg * area[k] ;
+	}
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Compute aperture photometry of many sources at once.
+  @param	in			Input image.
+  @param	x			x positions of the sources.
+  @param	y			y positions of the sources.
+  @param	nsrc		Number of sources.
+  @param	radii		Aperture radii.
+  @param	nrad		Number of radii.
+  @param	rad_int		Internal radius of the background annulus.
+  @param	rad_ext		External radius of the background annulus.
+  @param	method		Background computing method.
+  @return	1 newly allocated aperture_phot, NULL in case of error.
+
+  Positions are given in the C convention, as for image_get_disk_flux().
+  For each source, the flux in the disks of all given radii is computed
+  in a single pass over the pixels around the source. Pixels are
+  weighted by their exact area of overlap with each disk, so that the
+  flux varies smoothly with the position and the radius. The weights
+  depend only on the offset of the source from the nearest pixel
+  center: they are kept and reused for sources with identical offsets,
+  e.g. sources at integer positions. Sources are distributed among
+  the worker threads.
+
+  If rad_ext is larger than rad_int, the background per pixel is
+  measured in the annulus between these radii and subtracted from the
+  fluxes. With BG_METHOD_AVERAGE, it is the mean of the pixels weighted
+  by their exact overlap with the annulus. Other methods are passed to
+  image_get_disk_background(). Parts of the apertures falling out of
+  the image are ignored, the area field gives the area actually
+  measured for each aperture.
+
+  The returned object must be deallocated using aperture_phot_del().
+ */
+/*--------------------------------------------------------------------------*/
+aperture_phot * image_get_apertures(
+		image_t		*	in,
+		double		*	x,
+		double		*	y,
+		int				nsrc,
+		double		*	radii,
+		int				nrad,
+		double			rad_int,
+		double			rad_ext,
+		int				method)
+{
+	aper_job			job ;
+	aperture_phot	*	out ;
+	double				rmax ;
+	int					nworkers, i ;
+
+	if (in==NULL || x==NULL || y==NULL || radii==NULL) return NULL ;
+	if (nsrc<1 || nrad<1) return NULL ;
+	rmax = 0.0 ;
+	for (i=0 ; i<nrad ; i++) {
+		if (radii[i] <= 0.0) {
+			e_error("negative radius: %g cannot compute photometry",
+					radii[i]) ;
+			return NULL ;
+		}
+		if (radii[i] > rmax) rmax = radii[i] ;
+	}
+	if (rad_ext > rad_int) {
+		if ((rad_int < 0.0) || (rad_ext - rad_int < 1e-10) ||
+			((rad_int == 0.0) && (method != BG_METHOD_AVERAGE))) {
+			e_error("wrong radii: range [%g %g] is illegal", rad_int, rad_ext);
+			return NULL ;
+		}
+		if ((method != BG_METHOD_AVERAGE) && (method != BG_METHOD_MEDIAN) &&
+			(method != BG_METHOD_AVER_REJ)) {
+			e_error("unknown background estimation method requested") ;
+			return NULL ;
+		}
+	}
+
+	job.in = in ;
+	job.x = x ;
+	job.y = y ;
+	job.radii = radii ;
+	job.nrad = nrad ;
+	job.rad_int = rad_int ;
+	job.rad_ext = rad_ext ;
+	job.method = method ;
+	job.nw = nrad ;
+	if ((rad_ext > rad_int) && (method == BG_METHOD_AVERAGE)) {
+		job.nw++ ;
+		if (rad_ext > rmax) rmax = rad_ext ;
+	}
+	job.hsize = (int)ceil(rmax + 1.0) ;
+
+	nworkers = eclipse_get_nthreads() ;
+	job.masks = calloc(nworkers * APER_NMASK, sizeof(aper_mask)) ;
+	job.clock = calloc(nworkers, sizeof(int)) ;
+
+	out = malloc(sizeof(aperture_phot)) ;
+	out->nsrc = nsrc ;
+	out->nrad = nrad ;
+	out->flux = calloc(nsrc * nrad, sizeof(double)) ;
+	out->area = calloc(nsrc * nrad, sizeof(double)) ;
+	out->background = calloc(nsrc, sizeof(double)) ;
+	job.out = out ;
+
+	eclipse_parallel_run(aper_task, &job, (nsrc + APER_CHUNK - 1) / APER_CHUNK);
+
+	for (i=0 ; i<nworkers * APER_NMASK ; i++) {
+		if (job.masks[i].w != NULL) {
+			free(job.masks[i].w) ;
+			free(job.masks[i].xlo) ;
+			free(job.masks[i].xhi) ;
+		}
+	}
+	free(job.masks) ;
+	free(job.clock) ;
+	return out ;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Delete an aperture_phot object.
+  @param	ap		Object to delete.
+  @return	void
+ */
+/*--------------------------------------------------------------------------*/
+void aperture_phot_del(aperture_phot * ap)
+{
+	if (ap==NULL) return ;
+	free(ap->flux) ;
+	free(ap->area) ;
+	free(ap->background) ;
+	free(ap) ;
+}
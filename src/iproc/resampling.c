@@ -20,6 +20,7 @@
  ---------------------------------------------------------------------------*/
 
 #include "resampling.h"
+#include "warp_map.h"
 #include "pi.h"
 
 /*---------------------------------------------------------------------------
@@ -350,9 +351,13 @@ image_t * image_warp_linear(
   See the function generate_interpolation_kernel() for possible kernel
   types. If you want to use a default kernel, provide NULL for kernel type.
 
+  The polynomials are evaluated once per pixel through a distortion map
+  (see warp_map.h), which is then applied to the image. To warp several
+  images with the same polynomials, build the map once with
+  warp_map_new() and apply it with warp_map_apply().
+
   The returned image is a newly allocated objet, use image_del() to
   deallocate it.
-
  */
 /*--------------------------------------------------------------------------*/
 image_t * image_warp_generic(
@@ -362,124 +367,18 @@ image_t * image_warp_generic(
 		poly2d		*	poly_v)
 {
     image_t    *	image_out ;
-    int         	i, j, k ;
-    int         	lx_out, ly_out ;
-    double       	cur ;
-    double       	neighbors[16] ;
-    double       	rsc[8],
-					sumrs ;
-    double       	x, y ;
-    int     		px, py ;
-    int     		pos ;
-    int         	tabx, taby ;
-    double      *	kernel ;
-    int		      	leaps[16] ;
+    warp_map   *	map ;
 
     if (image_in == NULL) return NULL ;
 
-    /* Generate default interpolation kernel */
-    kernel = generate_interpolation_kernel(kernel_type) ;
-    if (kernel == NULL) {
-        e_error("cannot generate kernel: aborting resampling") ;
+    /* Evaluate the polynomials on the whole grid, then interpolate */
+    map = warp_map_new(image_in->lx, image_in->ly, kernel_type, poly_u, poly_v);
+    if (map == NULL) {
+        e_error("cannot compute distortion map: aborting resampling") ;
         return NULL ;
     }
-
-    /* Compute new image size   */
-    lx_out = (int)image_in->lx ;
-    ly_out = (int)image_in->ly ;
-
-    image_out = image_new(lx_out, ly_out) ;
-
-    /* Pre compute leaps for 16 closest neighbors positions */
-
-    leaps[0] = -1 - image_in->lx ;
-    leaps[1] =    - image_in->lx ;
-    leaps[2] =  1 - image_in->lx ;
-    leaps[3] =  2 - image_in->lx ;
-
-    leaps[4] = -1 ;
-    leaps[5] =  0 ;
-    leaps[6] =  1 ;
-    leaps[7] =  2 ;
-
-    leaps[8] = -1 + image_in->lx ;
-    leaps[9] =      image_in->lx ;
-    leaps[10]=  1 + image_in->lx ;
-    leaps[11]=  2 + image_in->lx ;
-
-    leaps[12]= -1 + 2*image_in->lx ;
-    leaps[13]=      2*image_in->lx ;
-    leaps[14]=  1 + 2*image_in->lx ;
-    leaps[15]=  2 + 2*image_in->lx ;
-
-    /* Double loop on the output image  */
-    for (j=0 ; j < ly_out ; j++) {
-        for (i=0 ; i< lx_out ; i++) {
-            /* Compute the original source for this pixel   */
-
-			x = poly2d_compute(poly_u, (double)i, (double)j);
-			y = poly2d_compute(poly_v, (double)i, (double)j);
-
-            /* Which is the closest integer positioned neighbor?    */
-            px = (int)x ;
-			py = (int)y ;
-
-            if ((px < 1) ||
-                (px > (image_in->lx-3)) ||
-                (py < 1) ||
-                (py > (image_in->ly-3)))
-                image_out->data[i+j*lx_out] = (pixelvalue)0.0 ;
-            else {
-                /* Now feed the positions for the closest 16 neighbors  */
-                pos = px + py * image_in->lx ;
-                for (k=0 ; k<16 ; k++)
-                    neighbors[k] = 
-					(double)(image_in->data[(int)(pos+leaps[k])]) ;
-
-                /* Which tabulated value index shall we use?    */
-                tabx = (int)((x - (double)px) * (double)(TABSPERPIX)) ;
-                taby = (int)((y - (double)py) * (double)(TABSPERPIX)) ;
-
-                /* Compute resampling coefficients  */
-                /* rsc[0..3] in x, rsc[4..7] in y   */
-
-                rsc[0] = kernel[TABSPERPIX + tabx] ;
-                rsc[1] = kernel[tabx] ;
-                rsc[2] = kernel[TABSPERPIX - tabx] ;
-                rsc[3] = kernel[2 * TABSPERPIX - tabx] ;
-                rsc[4] = kernel[TABSPERPIX + taby] ;
-                rsc[5] = kernel[taby] ;
-                rsc[6] = kernel[TABSPERPIX - taby] ;
-                rsc[7] = kernel[2 * TABSPERPIX - taby] ;
-
-                sumrs = (rsc[0]+rsc[1]+rsc[2]+rsc[3]) *
-                        (rsc[4]+rsc[5]+rsc[6]+rsc[7]) ;
-
-                /* Compute interpolated pixel now   */
-                cur =   rsc[4] * (  rsc[0]*neighbors[0] +
-                                    rsc[1]*neighbors[1] +
-                                    rsc[2]*neighbors[2] +
-                                    rsc[3]*neighbors[3] ) +
-                        rsc[5] * (  rsc[0]*neighbors[4] +
-                                    rsc[1]*neighbors[5] +
-                                    rsc[2]*neighbors[6] +
-                                    rsc[3]*neighbors[7] ) +
-                        rsc[6] * (  rsc[0]*neighbors[8] +
-                                    rsc[1]*neighbors[9] +
-                                    rsc[2]*neighbors[10] +
-                                    rsc[3]*neighbors[11] ) +
-                        rsc[7] * (  rsc[0]*neighbors[12] +
-                                    rsc[1]*neighbors[13] +
-                                    rsc[2]*neighbors[14] +
-                                    rsc[3]*neighbors[15] ) ; 
-
-                /* Affect the value to the output image */
-                image_out->data[i+j*lx_out] = (pixelvalue)(cur/sumrs) ;
-                /* done ! */
-            }       
-        }
-    }
-    free(kernel) ;
+    image_out = warp_map_apply(map, image_in) ;
+    warp_map_del(map) ;
     return image_out ;
 }
 
@@ -574,6 +473,10 @@ double * invert_linear_transform(double * trans)
 
   This function is strictly the same as image_warp_linear. Only difference
   is that the code should be hopefully faster, but not completely tested...
+
+  Interpolation is done in the pixelcalc type: with --float32, output
+  pixels differ from the double precision ones by less than 1e-6 of the
+  local pixel dynamic range.
  */
 /*--------------------------------------------------------------------------*/
 image_t * image_warp_linear_opt(
@@ -584,10 +487,10 @@ image_t * image_warp_linear_opt(
     image_t    *	image_out ;
     int         	i, j, k ;
     int         	lx_out, ly_out ;
-    double       	cur ;
+    pixelcalc    	cur ;
     double       *	i_trans ;
-    double       	neighbors[16] ;
-    double       	rsc[8], sumrs ;
+    pixelcalc    	neighbors[16] ;
+    pixelcalc    	rsc[8], sumrs ;
     double       	x, y ;
     int     		px, py ;
     int     		pos ;
@@ -658,7 +561,7 @@ image_t * image_warp_linear_opt(
                 pos = px + py * image_in->lx ;
                 for (k=0 ; k<16 ; k++)
                     neighbors[k] =
-					(double)(image_in->data[(int)(pos+leaps[k])]) ;
+					(pixelcalc)(image_in->data[(int)(pos+leaps[k])]) ;
 
                 /* Which tabulated value index shall we use?    */
                 tabx = (int)((x - (double)px) * (double)(TABSPERPIX)) ; 
@@ -667,14 +570,14 @@ image_t * image_warp_linear_opt(
                 /* Compute resampling coefficients  */
                 /* rsc[0..3] in x, rsc[4..7] in y   */
 
-                rsc[0] = kernel[TABSPERPIX + tabx] ;
-                rsc[1] = kernel[tabx] ;
-                rsc[2] = kernel[TABSPERPIX - tabx] ;
-                rsc[3] = kernel[2 * TABSPERPIX - tabx] ;
-                rsc[4] = kernel[TABSPERPIX + taby] ;
-                rsc[5] = kernel[taby] ;
-                rsc[6] = kernel[TABSPERPIX - taby] ;
-                rsc[7] = kernel[2 * TABSPERPIX - taby] ;
+                rsc[0] = (pixelcalc)kernel[TABSPERPIX + tabx] ;
+                rsc[1] = (pixelcalc)kernel[tabx] ;
+                rsc[2] = (pixelcalc)kernel[TABSPERPIX - tabx] ;
+                rsc[3] = (pixelcalc)kernel[2 * TABSPERPIX - tabx] ;
+                rsc[4] = (pixelcalc)kernel[TABSPERPIX + taby] ;
+                rsc[5] = (pixelcalc)kernel[taby] ;
+                rsc[6] = (pixelcalc)kernel[TABSPERPIX - taby] ;
+                rsc[7] = (pixelcalc)kernel[2 * TABSPERPIX - taby] ;
 
                 sumrs = (rsc[0]+rsc[1]+rsc[2]+rsc[3]) *
                         (rsc[4]+rsc[5]+rsc[6]+rsc[7]) ;
@@ -912,7 +815,7 @@ image_t * image_subsample(image_t * in)
 	/* First pass: apply a 1 2 1 filter in X */
 	pass1 = image_new(in->lx/2, in->ly) ;
 	for (j=0 ; j<pass1->ly ; j++) {
-		line_i = in->data + j*in->ly ;
+		line_i = in->data + j*in->lx ;
 		line_o = pass1->data + j*pass1->lx ;
 		for (i=0 ; i<pass1->lx ; i++) {
 			p0 = 0 ;
@@ -667,6 +667,9 @@ int cube_shift_slice(
   i.e. all pixels in the final image have been seen by all input
   frames.
 
+  Frames are interpolated in the pixelcalc type, the average of the
+  remaining contributions is always computed in double precision.
+
   The returned frame is a newly allocated object, to be deallocated
   using image_del().
  */
@@ -689,12 +692,12 @@ image_t	* cube_shiftandadd(
 	double			x, y ;
 	int				px, py ;
 	int				tabx, taby ;
-	double			rsc[8] ;
-	double			sumrs ;
+	pixelcalc		rsc[8] ;
+	pixelcalc		sumrs ;
 	double			finpix ;
 	double		*	interp_kernel ;
 	int				leaps[16] ;
-	double			neighbors[16] ;
+	pixelcalc		neighbors[16] ;
 	int				pos ;
 	int				rejtot ;
 
@@ -824,7 +827,7 @@ image_t	* cube_shiftandadd(
 					pos = px + py * in->lx ;
 					for (k=0 ; k<16 ; k++) {
 						neighbors[k] =
-							(double)in->plane[p]->data[(int)pos+leaps[k]] ;
+							(pixelcalc)in->plane[p]->data[(int)pos+leaps[k]] ;
 					}
 					/* Which tabulated value index shall be used? */
 					tabx = (int)(0.5+(x-(double)px)*(double)(TABSPERPIX)) ;
@@ -833,14 +836,14 @@ image_t	* cube_shiftandadd(
 					/* Compute resampling coefficients */
 					/* rsc[0..3] in x, rsc[4..7] in y  */
 
-					rsc[0] = interp_kernel[TABSPERPIX + tabx] ;
-					rsc[1] = interp_kernel[tabx] ;
-					rsc[2] = interp_kernel[TABSPERPIX - tabx] ;
-					rsc[3] = interp_kernel[2*TABSPERPIX - tabx] ;
-					rsc[4] = interp_kernel[TABSPERPIX + taby] ;
-					rsc[5] = interp_kernel[taby] ;
-					rsc[6] = interp_kernel[TABSPERPIX - taby] ;
-					rsc[7] = interp_kernel[2*TABSPERPIX - taby] ;
+					rsc[0] = (pixelcalc)interp_kernel[TABSPERPIX + tabx] ;
+					rsc[1] = (pixelcalc)interp_kernel[tabx] ;
+					rsc[2] = (pixelcalc)interp_kernel[TABSPERPIX - tabx] ;
+					rsc[3] = (pixelcalc)interp_kernel[2*TABSPERPIX - tabx] ;
+					rsc[4] = (pixelcalc)interp_kernel[TABSPERPIX + taby] ;
+					rsc[5] = (pixelcalc)interp_kernel[taby] ;
+					rsc[6] = (pixelcalc)interp_kernel[TABSPERPIX - taby] ;
+					rsc[7] = (pixelcalc)interp_kernel[2*TABSPERPIX - taby] ;
 
 					sumrs = (rsc[0]+rsc[1]+rsc[2]+rsc[3]) *
 							(rsc[4]+rsc[5]+rsc[6]+rsc[7]) ;
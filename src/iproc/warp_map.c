@@ -0,0 +1,544 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    warp_map.c
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Precomputed polynomial distortion maps.
+
+   A distortion map holds, for every pixel of a warped image, the source
+   pixel and the interpolation kernel entries computed from a pair of
+   2d polynomials. Polynomials are evaluated once when the map is built;
+   applying the map to an image only reads 16 neighbours per pixel.
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "warp_map.h"
+#include "resampling.h"
+#include "parallel.h"
+#include "comm.h"
+
+/*---------------------------------------------------------------------------
+   								Defines
+ ---------------------------------------------------------------------------*/
+
+/* Identification of map files */
+#define WARP_MAP_MAGIC		"EWARPMAP"
+#define WARP_MAP_VERSION	2
+#define WARP_MAP_BYTEORDER	0x01020304
+
+/* Number of rows interpolated by each task of warp_map_apply() */
+#define WARP_MAP_ROWS		16
+
+/*---------------------------------------------------------------------------
+   								Private types
+ ---------------------------------------------------------------------------*/
+
+/* Shared state of the worker tasks */
+typedef struct _warp_map_job_ {
+	warp_map	*	map ;
+	image_t		*	in ;
+	image_t		*	out ;
+} warp_map_job ;
+
+/*---------------------------------------------------------------------------
+   							Private functions
+ ---------------------------------------------------------------------------*/
+
+/* Copy a polynomial */
+static poly2d * warp_poly_copy(poly2d * p)
+{
+	poly2d	*	q ;
+
+	q = poly2d_allocate(p->nc) ;
+	memcpy(q->px, p->px, p->nc * sizeof(int)) ;
+	memcpy(q->py, p->py, p->nc * sizeof(int)) ;
+	memcpy(q->c,  p->c,  p->nc * sizeof(double)) ;
+	return q ;
+}
+
+/* Find out if two polynomials are strictly identical */
+static int warp_poly_equal(poly2d * p, poly2d * q)
+{
+	int		i ;
+
+	if (p->nc != q->nc) return 0 ;
+	for (i=0 ; i<p->nc ; i++) {
+		if ((p->px[i] != q->px[i]) ||
+			(p->py[i] != q->py[i]) ||
+			(p->c[i]  != q->c[i])) return 0 ;
+	}
+	return 1 ;
+}
+
+/* Allocate a map and its key, compute the kernel tables */
+static warp_map * warp_map_alloc(
+		int				lx,
+		int				ly,
+		char		*	kernel_type,
+		poly2d		*	poly_u,
+		poly2d		*	poly_v)
+{
+	warp_map	*	map ;
+	double		*	k ;
+	int				t ;
+
+	if ((k = generate_interpolation_kernel(kernel_type)) == NULL) {
+		e_error("cannot generate kernel: aborting distortion map") ;
+		return NULL ;
+	}
+	map = malloc(sizeof(warp_map)) ;
+	map->lx     = lx ;
+	map->ly     = ly ;
+	map->pos    = malloc(lx * ly * sizeof(int)) ;
+	map->tab    = malloc(2 * lx * ly * sizeof(unsigned short)) ;
+	map->kernel = k ;
+	/* Same summation order as the interpolation loops in resampling.c */
+	map->ksum   = malloc((TABSPERPIX+1) * sizeof(double)) ;
+	for (t=0 ; t<=TABSPERPIX ; t++) {
+		map->ksum[t] = k[TABSPERPIX + t] + k[t] +
+					   k[TABSPERPIX - t] + k[2 * TABSPERPIX - t] ;
+	}
+	map->kernel_type = strdup(kernel_type==NULL ? "default" : kernel_type);
+	map->poly_u = warp_poly_copy(poly_u) ;
+	map->poly_v = warp_poly_copy(poly_v) ;
+	return map ;
+}
+
+/* Compute the source positions of one row of a map */
+static void warp_map_row_task(void * p, int j, int worker)
+{
+	warp_map_job	*	job ;
+	warp_map		*	map ;
+	double				x, y ;
+	int					i, px, py, pos ;
+
+	job = (warp_map_job*)p ;
+	map = job->map ;
+
+	for (i=0 ; i<map->lx ; i++) {
+		pos = i + j * map->lx ;
+		/*
+		 * Compute the original source for this pixel term by term, as
+		 * image_warp_generic() always did: positions often fall exactly
+		 * on kernel table steps, where a different rounding of the
+		 * polynomial (e.g. Horner) would move them by one step.
+		 */
+		x = poly2d_compute(map->poly_u, (double)i, (double)j) ;
+		y = poly2d_compute(map->poly_v, (double)i, (double)j) ;
+		/* Which is the closest integer positioned neighbor? */
+		px = (int)x ;
+		py = (int)y ;
+		if ((px < 1) ||
+			(px > (map->lx-3)) ||
+			(py < 1) ||
+			(py > (map->ly-3))) {
+			map->pos[pos]       = -1 ;
+			map->tab[2*pos]     = 0 ;
+			map->tab[2*pos + 1] = 0 ;
+		} else {
+			map->pos[pos] = px + py * map->lx ;
+			/* Which tabulated value index shall we use? */
+			map->tab[2*pos] = (unsigned short)
+				(int)((x - (double)px) * (double)(TABSPERPIX)) ;
+			map->tab[2*pos + 1] = (unsigned short)
+				(int)((y - (double)py) * (double)(TABSPERPIX)) ;
+		}
+	}
+	return ;
+}
+
+/* Interpolate a block of rows of the output image */
+static void warp_map_apply_task(void * p, int task, int worker)
+{
+	warp_map_job	*	job ;
+	warp_map		*	map ;
+	pixelvalue		*	src ;
+	pixelvalue		*	s ;
+	double			*	kernel ;
+	pixelcalc			rsc[8], sumrs, cur ;
+	int					lx ;
+	int					pos, pmax ;
+	int					tabx, taby ;
+
+	job    = (warp_map_job*)p ;
+	map    = job->map ;
+	src    = job->in->data ;
+	kernel = map->kernel ;
+	lx     = map->lx ;
+
+	pos  = task * WARP_MAP_ROWS * lx ;
+	pmax = pos + WARP_MAP_ROWS * lx ;
+	if (pmax > lx * map->ly) pmax = lx * map->ly ;
+
+	for ( ; pos<pmax ; pos++) {
+		if (map->pos[pos] < 0) {
+			job->out->data[pos] = (pixelvalue)0.0 ;
+			continue ;
+		}
+		/* First of the 16 neighbours, at (-1,-1) from the closest one */
+		s = src + map->pos[pos] - 1 - lx ;
+
+		/* Compute resampling coefficients  */
+		/* rsc[0..3] in x, rsc[4..7] in y   */
+		tabx = map->tab[2*pos] ;
+		taby = map->tab[2*pos + 1] ;
+		rsc[0] = (pixelcalc)kernel[TABSPERPIX + tabx] ;
+		rsc[1] = (pixelcalc)kernel[tabx] ;
+		rsc[2] = (pixelcalc)kernel[TABSPERPIX - tabx] ;
+		rsc[3] = (pixelcalc)kernel[2 * TABSPERPIX - tabx] ;
+		rsc[4] = (pixelcalc)kernel[TABSPERPIX + taby] ;
+		rsc[5] = (pixelcalc)kernel[taby] ;
+		rsc[6] = (pixelcalc)kernel[TABSPERPIX - taby] ;
+		rsc[7] = (pixelcalc)kernel[2 * TABSPERPIX - taby] ;
+		sumrs  = (pixelcalc)(map->ksum[tabx] * map->ksum[taby]) ;
+
+		/* Compute interpolated pixel now   */
+		cur =	rsc[4] * (	rsc[0]*(pixelcalc)s[0] +
+							rsc[1]*(pixelcalc)s[1] +
+							rsc[2]*(pixelcalc)s[2] +
+							rsc[3]*(pixelcalc)s[3] ) +
+				rsc[5] * (	rsc[0]*(pixelcalc)s[lx] +
+							rsc[1]*(pixelcalc)s[lx+1] +
+							rsc[2]*(pixelcalc)s[lx+2] +
+							rsc[3]*(pixelcalc)s[lx+3] ) +
+				rsc[6] * (	rsc[0]*(pixelcalc)s[2*lx] +
+							rsc[1]*(pixelcalc)s[2*lx+1] +
+							rsc[2]*(pixelcalc)s[2*lx+2] +
+							rsc[3]*(pixelcalc)s[2*lx+3] ) +
+				rsc[7] * (	rsc[0]*(pixelcalc)s[3*lx] +
+							rsc[1]*(pixelcalc)s[3*lx+1] +
+							rsc[2]*(pixelcalc)s[3*lx+2] +
+							rsc[3]*(pixelcalc)s[3*lx+3] ) ;
+
+		job->out->data[pos] = (pixelvalue)(cur/sumrs) ;
+	}
+	return ;
+}
+
+/* Write a polynomial to a map file */
+static int warp_poly_write(FILE * f, poly2d * p)
+{
+	if (fwrite(&(p->nc), sizeof(int), 1, f)!=1) return -1 ;
+	if (fwrite(p->px, sizeof(int), p->nc, f)!=(size_t)p->nc) return -1 ;
+	if (fwrite(p->py, sizeof(int), p->nc, f)!=(size_t)p->nc) return -1 ;
+	if (fwrite(p->c, sizeof(double), p->nc, f)!=(size_t)p->nc) return -1 ;
+	return 0 ;
+}
+
+/* Read a polynomial from a map file, NULL if unreadable */
+static poly2d * warp_poly_read(FILE * f)
+{
+	poly2d	*	p ;
+	int			nc ;
+
+	if (fread(&nc, sizeof(int), 1, f)!=1) return NULL ;
+	if ((nc<1) || (nc>65536)) return NULL ;
+	p = poly2d_allocate(nc) ;
+	if ((fread(p->px, sizeof(int), nc, f)!=(size_t)nc) ||
+		(fread(p->py, sizeof(int), nc, f)!=(size_t)nc) ||
+		(fread(p->c, sizeof(double), nc, f)!=(size_t)nc)) {
+		poly2d_free(p) ;
+		return NULL ;
+	}
+	return p ;
+}
+
+/*---------------------------------------------------------------------------
+  							Function codes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Build a distortion map from a polynomial transform.
+  @param    lx          Image size in x.
+  @param    ly          Image size in y.
+  @param    kernel_type Interpolation kernel to use, NULL for default.
+  @param    poly_u      Polynomial transform in U.
+  @param    poly_v      Polynomial transform in V.
+  @return   1 newly allocated warp_map, NULL in case of error.
+
+  The polynomials define a reverse transform, as in image_warp_generic().
+  They are evaluated on the whole pixel grid with poly2d_compute(),
+  one row per task on the worker threads, so that warped images are
+  identical to those of the former image_warp_generic(). The
+  polynomials are copied into the map.
+
+  The returned map must be deallocated using warp_map_del().
+ */
+/*--------------------------------------------------------------------------*/
+warp_map * warp_map_new(
+		int				lx,
+		int				ly,
+		char		*	kernel_type,
+		poly2d		*	poly_u,
+		poly2d		*	poly_v)
+{
+	warp_map_job	job ;
+	warp_map	*	map ;
+
+	if ((poly_u==NULL) || (poly_v==NULL) || (lx<1) || (ly<1)) return NULL ;
+
+	if ((map = warp_map_alloc(lx, ly, kernel_type, poly_u, poly_v))==NULL)
+		return NULL ;
+
+	job.map = map ;
+	job.in  = NULL ;
+	job.out = NULL ;
+	eclipse_parallel_run(warp_map_row_task, &job, ly) ;
+	return map ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate a distortion map.
+  @param    map     Map to deallocate.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void warp_map_del(warp_map * map)
+{
+	if (map==NULL) return ;
+	free(map->pos) ;
+	free(map->tab) ;
+	free(map->kernel) ;
+	free(map->ksum) ;
+	free(map->kernel_type) ;
+	poly2d_free(map->poly_u) ;
+	poly2d_free(map->poly_v) ;
+	free(map) ;
+	return ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Warp an image with a precomputed distortion map.
+  @param    map     Distortion map.
+  @param    in      Image to warp, of the size of the map.
+  @return   1 newly allocated image, NULL in case of error.
+
+  The result is the same as image_warp_generic() with the polynomials
+  and kernel of the map. Rows of the output image are interpolated in
+  parallel. Interpolation is done in the pixelcalc type.
+ */
+/*--------------------------------------------------------------------------*/
+image_t * warp_map_apply(warp_map * map, image_t * in)
+{
+	warp_map_job	job ;
+
+	if ((map==NULL) || (in==NULL)) return NULL ;
+	if ((in->lx != map->lx) || (in->ly != map->ly)) {
+		e_error("image size [%dx%d] does not match distortion map [%dx%d]",
+				in->lx, in->ly, map->lx, map->ly) ;
+		return NULL ;
+	}
+
+	job.map = map ;
+	job.in  = in ;
+	job.out = image_new(map->lx, map->ly) ;
+	eclipse_parallel_run(warp_map_apply_task, &job,
+						 (map->ly + WARP_MAP_ROWS - 1) / WARP_MAP_ROWS) ;
+	return job.out ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Save a distortion map to a file.
+  @param    map         Map to save.
+  @param    filename    Output file name.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The file holds the key of the map (size, kernel name, polynomials)
+  followed by the map itself, in the native byte order. It is meant as
+  a local cache, not as an exchange format.
+ */
+/*--------------------------------------------------------------------------*/
+int warp_map_save(warp_map * map, char * filename)
+{
+	FILE	*	f ;
+	int			hdr[5] ;
+	int			npix ;
+	int			err ;
+
+	if ((map==NULL) || (filename==NULL)) return -1 ;
+	if ((f = fopen(filename, "wb"))==NULL) {
+		e_error("cannot create distortion map [%s]", filename) ;
+		return -1 ;
+	}
+	npix   = map->lx * map->ly ;
+	hdr[0] = WARP_MAP_VERSION ;
+	hdr[1] = WARP_MAP_BYTEORDER ;
+	hdr[2] = map->lx ;
+	hdr[3] = map->ly ;
+	hdr[4] = (int)strlen(map->kernel_type) ;
+
+	err = 0 ;
+	if (fwrite(WARP_MAP_MAGIC, 1, 8, f)!=8) err++ ;
+	if (fwrite(hdr, sizeof(int), 5, f)!=5) err++ ;
+	if (fwrite(map->kernel_type, 1, hdr[4], f)!=(size_t)hdr[4]) err++ ;
+	if (warp_poly_write(f, map->poly_u)!=0) err++ ;
+	if (warp_poly_write(f, map->poly_v)!=0) err++ ;
+	if (fwrite(map->pos, sizeof(int), npix, f)!=(size_t)npix) err++ ;
+	if (fwrite(map->tab, sizeof(unsigned short), 2*npix, f)!=(size_t)(2*npix))
+		err++ ;
+	if (fclose(f)!=0) err++ ;
+	if (err) {
+		e_error("cannot write distortion map [%s]", filename) ;
+		remove(filename) ;
+		return -1 ;
+	}
+	return 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Load a distortion map from a file.
+  @param    filename    Input file name.
+  @param    lx          Expected image size in x.
+  @param    ly          Expected image size in y.
+  @param    kernel_type Expected interpolation kernel, NULL for default.
+  @param    poly_u      Expected polynomial transform in U.
+  @param    poly_v      Expected polynomial transform in V.
+  @return   1 newly allocated warp_map, NULL if the file cannot be used.
+
+  NULL is returned without any message if the file does not exist, was
+  written on a machine with another byte order, or does not hold a map
+  built from exactly the same size, kernel and polynomials.
+ */
+/*--------------------------------------------------------------------------*/
+warp_map * warp_map_load(
+		char		*	filename,
+		int				lx,
+		int				ly,
+		char		*	kernel_type,
+		poly2d		*	poly_u,
+		poly2d		*	poly_v)
+{
+	FILE		*	f ;
+	warp_map	*	map ;
+	poly2d		*	pu ;
+	poly2d		*	pv ;
+	char			magic[8] ;
+	char		*	kname ;
+	int				hdr[5] ;
+	int				npix ;
+	int				i ;
+	int				ok ;
+
+	if ((filename==NULL) || (poly_u==NULL) || (poly_v==NULL)) return NULL ;
+	if (kernel_type==NULL) kernel_type = "default" ;
+	if ((f = fopen(filename, "rb"))==NULL) return NULL ;
+
+	/* Check the key */
+	ok = 0 ;
+	pu = pv = NULL ;
+	if ((fread(magic, 1, 8, f)==8) &&
+		(!memcmp(magic, WARP_MAP_MAGIC, 8)) &&
+		(fread(hdr, sizeof(int), 5, f)==5) &&
+		(hdr[0]==WARP_MAP_VERSION) &&
+		(hdr[1]==WARP_MAP_BYTEORDER) &&
+		(hdr[2]==lx) &&
+		(hdr[3]==ly) &&
+		(hdr[4]==(int)strlen(kernel_type))) {
+		kname = malloc(hdr[4]+1) ;
+		if ((fread(kname, 1, hdr[4], f)==(size_t)hdr[4])) {
+			kname[hdr[4]] = (char)0 ;
+			if (!strcmp(kname, kernel_type) &&
+				((pu = warp_poly_read(f))!=NULL) &&
+				((pv = warp_poly_read(f))!=NULL) &&
+				warp_poly_equal(pu, poly_u) &&
+				warp_poly_equal(pv, poly_v)) {
+				ok = 1 ;
+			}
+		}
+		free(kname) ;
+	}
+	poly2d_free(pu) ;
+	poly2d_free(pv) ;
+	if (!ok) {
+		fclose(f) ;
+		return NULL ;
+	}
+
+	/* Read the map */
+	if ((map = warp_map_alloc(lx, ly, kernel_type, poly_u, poly_v))==NULL) {
+		fclose(f) ;
+		return NULL ;
+	}
+	npix = lx * ly ;
+	if ((fread(map->pos, sizeof(int), npix, f)!=(size_t)npix) ||
+		(fread(map->tab, sizeof(unsigned short), 2*npix, f)!=(size_t)(2*npix))){
+		fclose(f) ;
+		warp_map_del(map) ;
+		return NULL ;
+	}
+	fclose(f) ;
+
+	/* Do not trust offsets read from disk */
+	for (i=0 ; i<npix ; i++) {
+		if ((map->pos[i] >= 0) &&
+			((map->pos[i] < lx+1) ||
+			 (map->pos[i] > lx*(ly-2)-3) ||
+			 (map->tab[2*i] > TABSPERPIX) ||
+			 (map->tab[2*i+1] > TABSPERPIX))) {
+			warp_map_del(map) ;
+			return NULL ;
+		}
+	}
+	return map ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get a distortion map from a cache file, or build it.
+  @param    filename    Cache file name.
+  @param    lx          Image size in x.
+  @param    ly          Image size in y.
+  @param    kernel_type Interpolation kernel to use, NULL for default.
+  @param    poly_u      Polynomial transform in U.
+  @param    poly_v      Polynomial transform in V.
+  @return   1 newly allocated warp_map, NULL in case of error.
+
+  The map is loaded from the file if it matches the requested geometry
+  (see warp_map_load()). Otherwise it is built with warp_map_new() and
+  saved to the file for the next call. Failing to save the map only
+  issues a warning.
+ */
+/*--------------------------------------------------------------------------*/
+warp_map * warp_map_cached(
+		char		*	filename,
+		int				lx,
+		int				ly,
+		char		*	kernel_type,
+		poly2d		*	poly_u,
+		poly2d		*	poly_v)
+{
+	warp_map	*	map ;
+
+	if (filename==NULL) return NULL ;
+	map = warp_map_load(filename, lx, ly, kernel_type, poly_u, poly_v) ;
+	if (map!=NULL) {
+		e_comment(1, "using distortion map [%s]", filename) ;
+		return map ;
+	}
+	if ((map = warp_map_new(lx, ly, kernel_type, poly_u, poly_v))==NULL)
+		return NULL ;
+	if (warp_map_save(map, filename)!=0) {
+		e_warning("distortion map not cached") ;
+	}
+	return map ;
+}
+/* vim: set ts=4 et sw=4 tw=75 */
@@ -31,6 +31,7 @@
 
 #include "fourier.h"
 #include "image_intops.h"
+#include "parallel.h"
 
 /*-----------------------------------------------------------------------------
    								Define
@@ -39,6 +40,30 @@
 #define XCORR_MAX_POINTS	100
 #define XCORR_MIN_POINTS	1
 
+/* Pyramid registration: number of levels (1, 2, 4 and 8 times smaller) */
+#define PYR_MAXLEVEL		4
+/* Smallest size of the coarsest level */
+#define PYR_MINSIZE			32
+/* Maximal number of refinement steps on every finer level */
+#define PYR_MAXSTEP			4
+
+/*-----------------------------------------------------------------------------
+                                Private types
+ -----------------------------------------------------------------------------*/
+
+/* Pyramid registration of all planes of a cube against a reference */
+typedef struct _pyr_job_ {
+    cube_t      *   cube ;
+    image_t     *   ref[PYR_MAXLEVEL] ;
+    double          ref_mean[PYR_MAXLEVEL] ;
+    cube_t      *   ref_fft ;
+    int             nlev ;
+    int             fftsize ;
+    int             range ;
+    double3     *   offs ;
+    int         *   status ;
+} pyr_job ;
+
 /*-----------------------------------------------------------------------------
                             Private functions
  -----------------------------------------------------------------------------*/
@@ -46,6 +71,9 @@
 static double xcorr_apodisation(double, double, double);
 static double xcorr_private(pixelvalue *, pixelvalue *, int, int, int,
         int, int, int, int, int, int, int, int, int, double * ,double *) ;
+static image_t * pyr_pad(image_t *, double, int) ;
+static double pyr_score(image_t *, double, image_t *, double, int, int) ;
+static void pyr_task(void *, int, int) ;
 
 /*-----------------------------------------------------------------------------
   							Function codes
@@ -615,6 +643,10 @@ double3 * xcorr_get_median_offset(
   This is the low-level function performing the 2d cross-correlation.
   It is very configurable and thus not easy to use! Users in need of a
   cross-correlation function should be using a higher-level function.
+
+  Squared differences are summed row by row in the pixelcalc type, so
+  that with --float32 the relative error on each distance stays below
+  (2*hx+1) times the float epsilon.
  
   Notice that the returned position is apodized to subpixel precision.
  
@@ -661,8 +693,9 @@ static double xcorr_private(
     double					somme_min ;
     register pixelvalue	*	reg1,
 						*	reg2 ;
-    register double			value,
-							somme ;
+    register pixelcalc		value,
+							rowsum ;
+    double					somme ;
     double					inc_x, 
 							inc_y ;
     int						pos_min ;
@@ -718,11 +751,13 @@ static double xcorr_private(
 			reg1 = buffer_in1+k-hx+(l-hy)*lx1;
 			reg2 = buffer_in2-hx-hy*lx2;
 			for (j=-hy;j<=hy;j++) {
+				/* Accumulate each row in pixelcalc, the total in double */
+				rowsum = 0 ;
                 for (i=-hx;i<=hx;i++) {
-					value = (double)(*reg1++)-(double)(*reg2++);
-					value *= value;
-                    somme += value;
+					value = (pixelcalc)(*reg1++)-(pixelcalc)(*reg2++);
+					rowsum += value*value;
                 }
+                somme += (double)rowsum;
                 reg1+=inc1;
                 reg2+=inc2;
             }
@@ -1036,3 +1071,305 @@ double3 * cube_blindoffsets(
     return offs ;
 }
 
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief	Find offsets in an image sequence by pyramid registration.
+  @param    cube_i      Input cube
+  @param    pattern     Pattern to compare all planes in the cube.
+  @param    search      Maximal offset in pixels, 0 for half the frame size.
+  @return   1 newly allocated double3 object containing offset estimates.
+
+  The pattern and every plane are reduced by factors 2, 4 and 8 with
+  image_subsample(), as long as the reduced images are at least 32
+  pixels large. The offsets are first found on the coarsest level over
+  the whole search range, with a cross-correlation computed by FFT on
+  zero-padded images. They are then refined on every finer level by
+  climbing, one pixel at a time from the position found on the previous
+  level, to the maximum of the correlation coefficient of the
+  overlapping parts of the images, and finally interpolated to
+  sub-pixel accuracy.
+
+  Contrary to cube_blindoffsets(), the whole frames are used, the frame
+  size does not need to be a power of 2 and the search range is not
+  limited to the central part of the frames. All planes are processed
+  in parallel.
+
+  The returned offsets follow the convention of cube_blindoffsets().
+  The z field holds the correlation coefficient of every plane with
+  the pattern at full resolution. The returned object must be
+  deallocated using double3_del().
+ */
+/*----------------------------------------------------------------------------*/
+double3 * cube_pyramidoffsets(
+        cube_t  *   cube_i,
+        image_t *   pattern,
+        int         search)
+{
+    pyr_job     job ;
+    image_t *   pad ;
+    int         l, p ;
+    int         nlev ;
+    int         lx, ly ;
+    int         err ;
+
+    /* Bulletproof */
+    if (cube_i==NULL || pattern==NULL) return NULL ;
+    if (cube_i->lx != pattern->lx || cube_i->ly != pattern->ly) return NULL ;
+    if (pattern->lx < PYR_MINSIZE || pattern->ly < PYR_MINSIZE) {
+        e_error("frames too small for pyramid registration: %dx%d",
+                pattern->lx, pattern->ly) ;
+        return NULL ;
+    }
+    lx = pattern->lx ;
+    ly = pattern->ly ;
+    if (search<1) search = (lx<ly ? lx : ly) / 2 ;
+
+    /* Number of levels */
+    nlev = 1 ;
+    while (nlev<PYR_MAXLEVEL &&
+           (lx>>nlev)>=PYR_MINSIZE && (ly>>nlev)>=PYR_MINSIZE) nlev++ ;
+
+    /* Reference pyramid */
+    e_comment(2, "building reference pyramid (%d levels)...", nlev) ;
+    job.cube = cube_i ;
+    job.nlev = nlev ;
+    job.ref[0] = pattern ;
+    job.ref_mean[0] = image_getmean(pattern) ;
+    for (l=1 ; l<nlev ; l++) {
+        job.ref[l] = image_subsample(job.ref[l-1]) ;
+        job.ref_mean[l] = image_getmean(job.ref[l]) ;
+    }
+
+    /* Search range on the coarsest level, FFT size to avoid wrapping */
+    l = nlev-1 ;
+    job.range = (search + (1<<l) - 1) >> l ;
+    if (job.range >= job.ref[l]->lx) job.range = job.ref[l]->lx - 1 ;
+    if (job.range >= job.ref[l]->ly) job.range = job.ref[l]->ly - 1 ;
+    job.fftsize = 1 ;
+    while (job.fftsize < job.ref[l]->lx + job.range ||
+           job.fftsize < job.ref[l]->ly + job.range) job.fftsize *= 2 ;
+
+    pad = pyr_pad(job.ref[l], job.ref_mean[l], job.fftsize) ;
+    job.ref_fft = image_fft(pad, NULL, FFT_FORWARD) ;
+    image_del(pad) ;
+    if (job.ref_fft==NULL) {
+        for (l=1 ; l<nlev ; l++) image_del(job.ref[l]) ;
+        return NULL ;
+    }
+
+    /* Register all planes */
+    e_comment(2, "registering %d planes...", cube_i->np) ;
+    job.offs = double3_new(cube_i->np) ;
+    job.status = malloc(cube_i->np * sizeof(int)) ;
+    eclipse_parallel_run(pyr_task, &job, cube_i->np) ;
+
+    err = 0 ;
+    for (p=0 ; p<cube_i->np ; p++) {
+        if (job.status[p]!=0) {
+            e_error("cannot register plane %d", p+1) ;
+            err++ ;
+        }
+    }
+    free(job.status) ;
+    cube_del(job.ref_fft) ;
+    for (l=1 ; l<nlev ; l++) image_del(job.ref[l]) ;
+    if (err) {
+        double3_del(job.offs) ;
+        return NULL ;
+    }
+    return job.offs ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief	Copy an image into a zero-padded square image.
+  @param    in      Input image.
+  @param    mean    Value to subtract from the input pixels.
+  @param    size    Size of the output image.
+  @return   1 newly allocated image.
+ */
+/*----------------------------------------------------------------------------*/
+static image_t * pyr_pad(image_t * in, double mean, int size)
+{
+    image_t *   pad ;
+    int         i, j ;
+
+    pad = image_new(size, size) ;
+    if (pad==NULL) return NULL ;
+    for (j=0 ; j<in->ly ; j++) {
+        for (i=0 ; i<in->lx ; i++) {
+            pad->data[i+j*size] = (pixelvalue)(in->data[i+j*in->lx] - mean) ;
+        }
+    }
+    return pad ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief	Correlation coefficient of two shifted images.
+  @param    ref     Reference image.
+  @param    mref    Mean of the reference image.
+  @param    im      Shifted image, same size as ref.
+  @param    mim     Mean of the shifted image.
+  @param    sx      Shift in x.
+  @param    sy      Shift in y.
+  @return   Correlation coefficient of ref(x,y) and im(x+sx,y+sy).
+
+  The coefficient is computed on the overlapping parts of the images,
+  -1 is returned if they do not overlap.
+ */
+/*----------------------------------------------------------------------------*/
+static double pyr_score(
+        image_t *   ref,
+        double      mref,
+        image_t *   im,
+        double      mim,
+        int         sx,
+        int         sy)
+{
+    pixelvalue  *   pr ;
+    pixelvalue  *   pi ;
+    double          a, b ;
+    double          sab, saa, sbb ;
+    int             i, j ;
+    int             imin, imax, jmin, jmax ;
+
+    imin = sx<0 ? -sx : 0 ;
+    imax = sx>0 ? ref->lx-sx : ref->lx ;
+    jmin = sy<0 ? -sy : 0 ;
+    jmax = sy>0 ? ref->ly-sy : ref->ly ;
+    if (imin>=imax || jmin>=jmax) return -1.0 ;
+
+    sab = saa = sbb = 0.0 ;
+    for (j=jmin ; j<jmax ; j++) {
+        pr = ref->data + j*ref->lx ;
+        pi = im->data + (j+sy)*im->lx + sx ;
+        for (i=imin ; i<imax ; i++) {
+            a = pr[i] - mref ;
+            b = pi[i] - mim ;
+            sab += a*b ;
+            saa += a*a ;
+            sbb += b*b ;
+        }
+    }
+    if (saa<=0.0 || sbb<=0.0) return -1.0 ;
+    return sab / sqrt(saa*sbb) ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief	Register one plane of a cube on the reference pyramid.
+  @param    arg     Pyramid registration job.
+  @param    task    Index of the plane.
+  @param    worker  Unused.
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+static void pyr_task(void * arg, int task, int worker)
+{
+    pyr_job     *   job ;
+    image_t     *   lev[PYR_MAXLEVEL] ;
+    double          mean[PYR_MAXLEVEL] ;
+    double          score[3][3] ;
+    image_t     *   pad ;
+    cube_t      *   fft ;
+    cube_t      *   xc ;
+    double          x1, y1, x2, y2 ;
+    double          best, s0, sm, sp, fx, fy ;
+    int             n, i, j, k, l ;
+    int             sx, sy, bx, by, dx, dy ;
+
+    job = (pyr_job *)arg ;
+    job->status[task] = -1 ;
+
+    /* Pyramid of this plane */
+    lev[0] = job->cube->plane[task] ;
+    mean[0] = image_getmean(lev[0]) ;
+    for (l=1 ; l<job->nlev ; l++) {
+        lev[l] = image_subsample(lev[l-1]) ;
+        mean[l] = image_getmean(lev[l]) ;
+    }
+    l = job->nlev-1 ;
+
+    /* Coarsest level: cross-correlation over the full search range */
+    n = job->fftsize ;
+    pad = pyr_pad(lev[l], mean[l], n) ;
+    fft = image_fft(pad, NULL, FFT_FORWARD) ;
+    image_del(pad) ;
+    xc = NULL ;
+    if (fft!=NULL) {
+        for (i=0 ; i<n*n ; i++) {
+            x1 =  (double)fft->plane[0]->data[i] ;
+            y1 =  (double)fft->plane[1]->data[i] ;
+            x2 =  (double)job->ref_fft->plane[0]->data[i] ;
+            y2 = -(double)job->ref_fft->plane[1]->data[i] ;
+            fft->plane[0]->data[i] = (pixelvalue)(x1*x2 - y1*y2) ;
+            fft->plane[1]->data[i] = (pixelvalue)(x1*y2 + x2*y1) ;
+        }
+        xc = image_fft(fft->plane[0], fft->plane[1], FFT_INVERSE) ;
+        cube_del(fft) ;
+    }
+    if (xc==NULL) {
+        for (l=1 ; l<job->nlev ; l++) image_del(lev[l]) ;
+        return ;
+    }
+    bx = by = 0 ;
+    best = xc->plane[0]->data[0] ;
+    for (sy=-job->range ; sy<=job->range ; sy++) {
+        for (sx=-job->range ; sx<=job->range ; sx++) {
+            x1 = xc->plane[0]->data[((sx+n)%n) + ((sy+n)%n)*n] ;
+            if (x1>best) {
+                best = x1 ;
+                bx = sx ;
+                by = sy ;
+            }
+        }
+    }
+    cube_del(xc) ;
+
+    /* Finer levels: climb to the best score from the previous guess */
+    dx = dy = 0 ;
+    for (l=job->nlev-2 ; l>=0 ; l--) {
+        bx *= 2 ;
+        by *= 2 ;
+        for (k=0 ; k<PYR_MAXSTEP ; k++) {
+            dx = dy = 0 ;
+            best = -2.0 ;
+            for (j=-1 ; j<=1 ; j++) {
+                for (i=-1 ; i<=1 ; i++) {
+                    score[j+1][i+1] = pyr_score(job->ref[l], job->ref_mean[l],
+                                                lev[l], mean[l], bx+i, by+j) ;
+                    if (score[j+1][i+1]>best) {
+                        best = score[j+1][i+1] ;
+                        dx = i ;
+                        dy = j ;
+                    }
+                }
+            }
+            bx += dx ;
+            by += dy ;
+            if (dx==0 && dy==0) break ;
+        }
+        image_del(lev[l+1]) ;
+    }
+
+    /* Sub-pixel position from a parabola through the best score */
+    fx = fy = 0.0 ;
+    if (job->nlev>1 && dx==0 && dy==0) {
+        s0 = score[1][1] ;
+        sm = score[1][0] ;
+        sp = score[1][2] ;
+        if (sm+sp-2.0*s0<0.0) fx = 0.5*(sm-sp)/(sm+sp-2.0*s0) ;
+        sm = score[0][1] ;
+        sp = score[2][1] ;
+        if (sm+sp-2.0*s0<0.0) fy = 0.5*(sm-sp)/(sm+sp-2.0*s0) ;
+    } else {
+        s0 = pyr_score(job->ref[0], job->ref_mean[0], lev[0], mean[0], bx, by) ;
+    }
+
+    job->offs->x[task] = (double)bx + fx ;
+    job->offs->y[task] = (double)by + fy ;
+    job->offs->z[task] = s0 ;
+    job->status[task] = 0 ;
+}
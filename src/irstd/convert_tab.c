@@ -19,6 +19,9 @@
  * col 10: M
  * col 11: L'
  * col 12: M'
+ *
+ * With -b <file>, a binary catalog file is written instead, which can be
+ * loaded at run-time with irstd_load_catalog() (see irstd.h).
  */
 
 
@@ -31,6 +34,8 @@
 #include <sys/types.h>
 #include <dirent.h>
 
+#include "../include/irstd.h"
+
 #define STRINGSZ	50
 #define LINESZ		512
 
@@ -209,6 +214,142 @@ void generate_header_file(char ** catalogs, int ncat)
 	return ;
 }
 
+void generate_binary_file(char ** catalogs, int ncat, char * filename)
+{
+	FILE *	bin_file ;
+	int		i ;
+	int		lineno ;
+	char	line[LINESZ+1] ;
+	FILE *	tab ;
+	char	star_name	[STRINGSZ],
+			star_ra_1	[STRINGSZ],
+			star_ra_2	[STRINGSZ],
+			star_ra_3	[STRINGSZ],
+			star_dec_1	[STRINGSZ],
+			star_dec_2	[STRINGSZ],
+			star_dec_3	[STRINGSZ],
+			star_sptype	[STRINGSZ],
+			star_J		[STRINGSZ],
+			star_H		[STRINGSZ],
+			star_K		[STRINGSZ],
+			star_Ks		[STRINGSZ],
+			star_L		[STRINGSZ],
+			star_M		[STRINGSZ],
+			star_Lp		[STRINGSZ],
+			star_Mp		[STRINGSZ] ;
+	char	cat_name[IRSTD_BIN_NAMESZ] ;
+	int		scanned ;
+	double	ra, dec ;
+	irstd_bin_header	head ;
+	irstd_bin_record	rec ;
+
+	bin_file = fopen(filename, "wb");
+	if (bin_file==NULL) {
+		printf("cannot create %s: aborting\n", filename);
+		return ;
+	}
+
+	/* Header: the number of stars is written again at the end */
+	memset(&head, 0, sizeof(head));
+	memcpy(head.magic, IRSTD_BIN_MAGIC, 8);
+	head.version	= IRSTD_BIN_VERSION ;
+	head.byteorder	= IRSTD_BIN_BYTEORDER ;
+	head.ncat		= ncat ;
+	head.nstars		= 0 ;
+	fwrite(&head, sizeof(head), 1, bin_file);
+
+	/* Catalog names */
+	for (i=0 ; i<ncat ; i++) {
+		memset(cat_name, 0, IRSTD_BIN_NAMESZ);
+		strncpy(cat_name, get_basename(catalogs[i]), IRSTD_BIN_NAMESZ-1);
+		fwrite(cat_name, IRSTD_BIN_NAMESZ, 1, bin_file);
+	}
+
+	for (i=0 ; i<ncat ; i++) {
+		if ((tab=fopen(catalogs[i], "r"))==NULL) {
+			printf("cannot open catalog %s\n", catalogs[i]);
+			continue ;
+		}
+		lineno = 0 ;
+		while (fgets(line, LINESZ, tab)!=NULL) {
+			if (line[0]=='#')
+				continue;
+			line[LINESZ] = (char)0;
+			lineno++ ;
+			scanned = 
+				sscanf(line,
+		"%s | %s %s %s | %s %s %s | %s | %s | %s | %s | %s | %s | %s | %s | %s",
+				star_name,
+				star_ra_1,
+				star_ra_2,
+				star_ra_3,
+				star_dec_1,
+				star_dec_2,
+				star_dec_3,
+				star_sptype,
+				star_J,
+				star_H,
+				star_K,
+				star_Ks,
+				star_L,
+				star_M,
+                star_Lp,
+                star_Mp);
+			if (scanned != 16) {
+				fprintf(stderr, "syntax error file %s line %d\n",
+						catalogs[i], lineno);
+				continue ;
+			}
+			if ((strlen(star_name)>=IRSTD_BIN_NAMESZ) ||
+				(strlen(star_sptype)>=IRSTD_BIN_TYPESZ)) {
+				fprintf(stderr, "name too long file %s line %d\n",
+						catalogs[i], lineno);
+				continue ;
+			}
+
+			ra = 15.0 *
+				((double)atof(star_ra_1)+
+				 (double)atof(star_ra_2)/60.0+
+				 (double)atof(star_ra_3)/3600.0) ;
+			if (star_ra_1[0]=='-') ra=-ra ;
+
+			dec = fabs((double)atof(star_dec_1))+
+				  fabs((double)atof(star_dec_2))/60.0+
+				  fabs((double)atof(star_dec_3))/3600.0 ;
+
+			if (star_dec_1[0]=='-') {
+				dec=-dec ;
+			}
+
+			/* Clear padding bytes too */
+			memset(&rec, 0, sizeof(rec));
+			rec.ra		= ra ;
+			rec.dec		= dec ;
+			rec.mag[0]	= (float)atof(star_J) ;
+			rec.mag[1]	= (float)atof(star_H) ;
+			rec.mag[2]	= (float)atof(star_K) ;
+			rec.mag[3]	= (float)atof(star_Ks) ;
+			rec.mag[4]	= (float)atof(star_L) ;
+			rec.mag[5]	= (float)atof(star_M) ;
+			rec.mag[6]	= (float)atof(star_Lp) ;
+			rec.mag[7]	= (float)atof(star_Mp) ;
+			rec.source	= i ;
+			strcpy(rec.name, star_name);
+			strcpy(rec.sptype, star_sptype);
+			fwrite(&rec, sizeof(rec), 1, bin_file);
+			head.nstars ++ ;
+		}
+		fclose(tab);
+	}
+
+	/* Rewrite the header with the number of stars */
+	fseek(bin_file, 0L, SEEK_SET);
+	fwrite(&head, sizeof(head), 1, bin_file);
+	fclose(bin_file);
+	printf("%d stars written to %s\n", head.nstars, filename);
+	return ;
+}
+
 void generate_web_page(char ** catalogs, int ncat)
 {
 	FILE *	wpage ;
@@ -421,20 +562,24 @@ int main(int argc, char *argv[])
 	int		nstars ;
 	int		i, j ;
 	int		web_page ;
+	char *	bin_name ;
 
 	if (argc<2) {
-		printf("usage: %s <list of table files>\n", argv[0]);
+		printf("usage: %s [-w | -b file] <list of table files>\n", argv[0]);
 		return 1 ;
 	}
 
 	/* Identify catalogs in command-line arguments */
 	web_page = 0 ;
+	bin_name = NULL ;
 	ncat = 0 ;
 	for (i=1 ; i<argc ; i++) {
 		if (is_catalog_file(argv[i])!=0)
 			ncat ++ ;
 		if (!strcmp(argv[i], "-w"))
 			web_page=1 ;
+		if (!strcmp(argv[i], "-b") && (i+1<argc))
+			bin_name=argv[++i] ;
 	}
 	if (ncat<1) {
 		printf("none of the command-line arguments is a catalog\n");
@@ -456,6 +601,8 @@ int main(int argc, char *argv[])
 
 	if (web_page) {
 		generate_web_page(catalogs, ncat);
+	} else if (bin_name!=NULL) {
+		generate_binary_file(catalogs, ncat, bin_name);
 	} else {
 		generate_header_file(catalogs, ncat);
 	}
@@ -300,6 +300,7 @@ void jitter_config_dump(jitter_config_t * jc, FILE * out)
     jc->saa_offsource == offsource_header ? "header" :
     jc->saa_offsource == offsource_file   ? "file" :
     jc->saa_offsource == offsource_blind  ? "blind" :
+    jc->saa_offsource == offsource_stars  ? "stars" :
     "XXX");
 
     fprintf(out,
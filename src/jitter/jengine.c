@@ -61,14 +61,18 @@ long jitter_engine(char * ininame)
 	time(&local_t) ;
 	e_comment(0, "%s", ctime(&local_t)) ;
 	e_comment(0, "pid is %ld", (long)getpid());
+	TRACE_BEGIN("jitter") ;
 
 	/*
 	 * Load data
 	 */
 	p++ ;
 	e_comment(0, "---> part %d of %d: loading data", p, NPARTS) ;
+    TRACE_BEGIN("jitter/load") ;
     jc = jitter_load(ininame);
+    TRACE_END("jitter/load") ;
     if (jc==NULL) {
+        TRACE_END("jitter") ;
         return -1 ;
     }
     total_pixin = jc->total_pixin ;
@@ -78,61 +82,82 @@ long jitter_engine(char * ininame)
 	 */
 	p++ ;
 	e_comment(0, "---> part %d of %d: calibrations", p, NPARTS) ;
+    TRACE_BEGIN("jitter/calibration") ;
     if (jitter_calibration(jc)!=0) {
         e_error("applying calibrations: aborting");
         jitter_config_del(jc);
+        TRACE_END("jitter/calibration") ;
+        TRACE_END("jitter") ;
         return -1 ;
     }
+    TRACE_END("jitter/calibration") ;
 	
 	/*
 	 * Apply sky background subtraction.
 	 */
 	p++ ;
 	e_comment(0, "---> part %d of %d: sky estimation/subtraction", p, NPARTS) ;
+    TRACE_BEGIN("jitter/sky") ;
     if (jitter_sky(jc)!=0) {
 		e_error("applying background subtraction: aborting") ;
 		jitter_config_del(jc);
+		TRACE_END("jitter/sky") ;
+		TRACE_END("jitter") ;
 		return -1 ;
 	}
+	TRACE_END("jitter/sky") ;
 
     /*
      * Apply shift-and-add
      */
 	p++ ;
 	e_comment(0, "---> part %d of %d: shift and add", p, NPARTS);
+    TRACE_BEGIN("jitter/saa") ;
     if (jitter_saa(jc)!=0) {
 		e_error("applying shift-and-add: aborting");
         jitter_config_del(jc);
+		TRACE_END("jitter/saa") ;
+		TRACE_END("jitter") ;
 		return -1 ;
 	}
+	TRACE_END("jitter/saa") ;
 	
 	/*
 	 * Optional post-processing features will be inserted here
 	 */
 	p++ ;
 	e_comment(0, "---> part %d of %d: post-processing", p, NPARTS) ;
+	TRACE_BEGIN("jitter/postproc") ;
 	if (jitter_postproc(jc)!=0) {
 		e_error("applying post-processing: aborting") ;
         jitter_config_del(jc);
+        TRACE_END("jitter/postproc") ;
+        TRACE_END("jitter") ;
         return -1 ;
 	}
+	TRACE_END("jitter/postproc") ;
 
 	/*
 	 * Save results
 	 */
 	p++ ;
 	e_comment(0, "---> part %d of %d: saving output data", p, NPARTS);
+    TRACE_BEGIN("jitter/save") ;
     if (jitter_save(jc)!=0) {
         e_error("saving results to disk: aborting");
         jitter_config_del(jc);
+        TRACE_END("jitter/save") ;
+        TRACE_END("jitter") ;
         return -1 ;
     }
+    TRACE_END("jitter/save") ;
 
     /* If requested: launch an image viewer on the result */
     jitter_viewer(jc);
 
     /* Free data */
     jitter_config_del(jc);
+    TRACE_END("jitter") ;
 
 	e_comment(0, "---> STOPPING JITTER ENGINE") ;
 	time(&local_t) ;
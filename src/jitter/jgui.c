@@ -764,6 +764,12 @@ static char tcl_code[] =
 "			greyOut $topc.saa.asaa.file\n"
 "		}\n"
 "pack $topc.saa.asaa.blind_rbut -side top -anchor nw\n"
+"radiobutton $topc.saa.asaa.stars_rbut -text \"Stars\" -variable input_offset -value stars -command {\n"
+"			findInArray ShiftAndAdd OffsetInput\n"
+"			set keyarray($found_pos) \"stars\"\n"
+"			greyOut $topc.saa.asaa.file\n"
+"		}\n"
+"pack $topc.saa.asaa.stars_rbut -side top -anchor nw\n"
 "label $topc.saa.asaa.emptylab2 -text \"\"\n"
 "pack $topc.saa.asaa.emptylab2 -side top\n"
 "findInArray ShiftAndAdd OffsetRefine\n"
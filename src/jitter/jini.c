@@ -361,7 +361,7 @@ int jitter_ini_generate(
 "ObjectFileName      = objects.in ;  name of the input object file\n"
 "\n"
 "# Identify source of offsets between frames\n"
-"OffsetInput         = %s ;          header/file/blind\n"
+"OffsetInput         = %s ;          header/file/blind/stars\n"
 "\n",
     jparams_defaults->offsets_in) ;
 
@@ -1050,6 +1050,8 @@ static int jitter_ini_parse_saa(dictionary * ini, jitter_config_t * jc)
         jc->saa_offsource = offsource_file ;
     } else if (!strcasecmp(sval, "blind")) {
         jc->saa_offsource = offsource_blind ;
+    } else if (!strcasecmp(sval, "stars")) {
+        jc->saa_offsource = offsource_stars ;
     } else {
         e_error("illegal [ShiftAndAdd]:OffsetInput: %s", sval);
         err++ ;
@@ -1071,6 +1073,7 @@ static int jitter_ini_parse_saa(dictionary * ini, jitter_config_t * jc)
         break ;
 
         case offsource_blind:
+        case offsource_stars:
         break ;
 
         case offsource_unknown:
@@ -648,6 +648,7 @@ static int jitter_loadoffsets(jitter_config_t * jc)
             break ;
 
         case offsource_blind:
+        case offsource_stars:
             /* Do nothing */
             break ;
 
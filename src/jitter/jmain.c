@@ -31,6 +31,7 @@ static char cvsId[]=
 #include "jini.h"
 #include "jengine.h"
 #include "jgui.h"
+#include "jql.h"
 
 /*-----------------------------------------------------------------------------
                                 Defines
@@ -46,6 +47,12 @@ static char cvsId[]=
 #define OPT_CALIB		2002
 #define OPT_ALGORITHM	2003
 
+#define OPT_QUICKLOOK	3000
+#define OPT_QL_FRAMES	3001
+#define OPT_QL_TIMEOUT	3002
+#define OPT_QL_LAG		3003
+#define OPT_QL_RTD		3004
+
  
 /* This function just gives the usage for the program   */
 static void usage(char *pname) ;
@@ -69,6 +76,12 @@ int main(int argc, char *argv[])
 	char		name_o[FILENAMESZ];
 	char		name_c[FILENAMESZ];
     char        algo  [FILENAMESZ] ;
+	char	*	spool       = NULL ;
+	char		name_ql[FILENAMESZ];
+	int			ql_frames   = 0 ;
+	int			ql_timeout  = 0 ;
+	int			ql_lag      = 0 ;
+	int			ql_rtd      = 0 ;
 
     /* Initialize */
 	strcpy(ini_name, "jitter.ini") ;
@@ -76,6 +89,7 @@ int main(int argc, char *argv[])
 	strcpy(name_i, "framelist.ascii");
 	strcpy(name_o, "jittered_result");
 	strcpy(name_c, "calib.ascii");
+	strcpy(name_ql, "quicklook.fits");
     algo[0] = 0 ;
 
     /* Command-line parsing */
@@ -97,6 +111,12 @@ int main(int argc, char *argv[])
 			{"calib",  	  1, 0, OPT_CALIB},
 			{"algorithm", 1, 0, OPT_ALGORITHM},
 
+			{"quicklook", 1, 0, OPT_QUICKLOOK},
+			{"ql-frames", 1, 0, OPT_QL_FRAMES},
+			{"ql-timeout",1, 0, OPT_QL_TIMEOUT},
+			{"ql-lag",    1, 0, OPT_QL_LAG},
+			{"ql-rtd",    0, 0, OPT_QL_RTD},
+
             {0, 0, 0, 0}
 
         } ;
@@ -164,6 +184,7 @@ int main(int argc, char *argv[])
 			case OPT_OUT:
 			case 'o':
 			strcpy(name_o, optarg);
+			strcpy(name_ql, optarg);
 			break ;
 
 			/* Calibration file list name */
@@ -178,6 +199,27 @@ int main(int argc, char *argv[])
 			strcpy(algo, optarg);
 			break ;
 
+			/* Quick-look mode on a spool directory */
+			case OPT_QUICKLOOK:
+			spool = optarg ;
+			break ;
+
+			case OPT_QL_FRAMES:
+			ql_frames = atoi(optarg) ;
+			break ;
+
+			case OPT_QL_TIMEOUT:
+			ql_timeout = atoi(optarg) ;
+			break ;
+
+			case OPT_QL_LAG:
+			ql_lag = atoi(optarg) ;
+			break ;
+
+			case OPT_QL_RTD:
+			ql_rtd = 1 ;
+			break ;
+
             default:
             usage(argv[0]) ;
             break ;
@@ -192,6 +234,11 @@ int main(int argc, char *argv[])
 
 	if (gui_flag) {
         sta = jitter_gui() ;
+	} else if (spool!=NULL) {
+		/* Incremental reduction of incoming frames */
+		sta = jitter_quicklook(ini_name, spool, name_ql, ql_frames,
+							   ql_timeout, ql_lag, ql_rtd) ;
+		if (sta>0) sta=0 ;
 	} else if (gen_flag) {
 		/* Generate a default ini file */
 		sta = jitter_ini_generate(ini_name, name_i, name_o, name_c, algo);
@@ -245,6 +292,15 @@ static void usage(char *pname)
 	printf("\n") ;
     printf("\t-w or --gui\n") ;
     printf("\tto launch the GUI\n") ;
+    printf("\n");
+    printf("\t--quicklook <dir>\n") ;
+    printf("\tto stack frames incrementally as they arrive in <dir>\n") ;
+    printf("\tthe running stack is saved to the -o name\n") ;
+    printf("\t(default: quicklook.fits), other quick-look options are:\n");
+    printf("\t--ql-frames <n>   stop after n frames\n") ;
+    printf("\t--ql-timeout <s>  stop after s seconds without new frame\n") ;
+    printf("\t--ql-lag <n>      skip frames if more than n are pending\n") ;
+    printf("\t--ql-rtd          display the running stack on RTD\n") ;
     printf("\n");
 
 	printf("following options are only valid with -g or --generate:\n");
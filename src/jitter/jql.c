@@ -0,0 +1,708 @@
+/*----------------------------------------------------------------------------*/
+/**
+   @file    jql.c
+   @author
+   @date    Oct 2026
+   @version	$Revision$
+   @brief   Jitter quick-look: incremental reduction of incoming frames
+*/
+/*----------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+/*-----------------------------------------------------------------------------
+   								Includes
+ -----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/time.h>
+
+#include "qfits.h"
+#include "pfits.h"
+#include "eclipse.h"
+#include "detect_ks.h"
+
+#include "jtypes.h"
+#include "jconfig.h"
+#include "jini.h"
+#include "jql.h"
+
+/*-----------------------------------------------------------------------------
+                                Defines
+ -----------------------------------------------------------------------------*/
+
+/* Delay between two scans of the spool directory, in microseconds */
+#define QL_POLL_USEC        100000
+
+/* Star matching settings, as in cube_matchoffsets() */
+#define QL_NBSTARS          100
+#define QL_MATCHTOL         3.0
+
+/*-----------------------------------------------------------------------------
+                                Private types
+ -----------------------------------------------------------------------------*/
+
+/* Quick-look state, kept from one frame to the next */
+typedef struct _jql_state_ {
+    jitter_config_t *   jc ;
+
+    /* Calibration data, loaded once */
+    image_t     *   dark ;
+    image_t     *   ff ;
+    pixelmap    *   badpix ;
+
+    /* Running sky: last median-subtracted frames, as a circular buffer */
+    image_t     **  ring ;
+    int             ring_sz ;
+    int             ring_n ;
+    int             ring_pos ;
+
+    /* Registration */
+    int             nframes ;
+    int             have_ref ;
+    double          ref_x ;
+    double          ref_y ;
+    double3     *   ref_stars ;
+    double3     *   file_offs ;
+
+    /* Running stack, on the footprint of the reference frame */
+    image_t     *   sum ;
+    image_t     *   cnt ;
+    int             nstacked ;
+    int             lx ;
+    int             ly ;
+
+    /* Name of the last processed frame */
+    char            last[FILENAMESZ] ;
+} jql_state ;
+
+/*-----------------------------------------------------------------------------
+                            Private functions
+ -----------------------------------------------------------------------------*/
+
+static int jql_init(jql_state *, char *) ;
+static void jql_cleanup(jql_state *) ;
+static image_t * jql_cutzone(jql_state *, image_t *) ;
+static char ** jql_scan(char *, char *, int *) ;
+static void jql_freenames(char **, int) ;
+static image_t * jql_calib(jql_state *, char *) ;
+static int jql_sky(jql_state *, image_t *) ;
+static int jql_register(jql_state *, char *, image_t *, double *, double *) ;
+static void jql_stack(jql_state *, image_t *, double, double) ;
+static int jql_publish(jql_state *, char *, int) ;
+static double jql_elapsed(struct timeval *) ;
+
+/*-----------------------------------------------------------------------------
+                            Functions code
+ -----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Run the jitter quick-look loop on a spool directory
+  @param    ininame     Name of the jitter ini file.
+  @param    spool       Name of the directory receiving the frames.
+  @param    outname     Name of the published running stack.
+  @param    maxframes   Stop after this many frames, 0 for no limit.
+  @param    timeout     Stop after this many idle seconds, 0 for never.
+  @param    maxlag      Maximal number of pending frames, 0 for no limit.
+  @param    rtd_flag    Also display the running stack on RTD if non-zero.
+  @return   Number of frames added to the stack, or -1 if error occurred.
+
+  Frames are FITS files dropped into the spool directory by the
+  producer, which must create them under another name (e.g. without the
+  .fits extension) and rename them once complete. They are processed in
+  alphabetical order of their names, which must thus increase with time
+  (e.g. time stamps or sequence numbers). Files named before the last
+  processed one are ignored.
+
+  Each frame is calibrated, sky-subtracted with a running sky computed
+  from the previous frames, registered on the first frame and added to
+  the running stack, which is then saved to outname. The settings are
+  taken from the calibration, sky and shift-and-add sections of the
+  jitter ini file.
+
+  If more than maxlag frames are pending, the oldest ones are skipped
+  to bound the latency of the published stack.
+ */
+/*----------------------------------------------------------------------------*/
+int jitter_quicklook(
+        char    *   ininame,
+        char    *   spool,
+        char    *   outname,
+        int         maxframes,
+        int         timeout,
+        int         maxlag,
+        int         rtd_flag)
+{
+    jql_state           qs ;
+    char            **  names ;
+    char                path[FILENAMESZ] ;
+    image_t         *   im ;
+    struct timeval      t0, idle ;
+    double              dx, dy ;
+    int                 nnames ;
+    int                 first ;
+    int                 i ;
+
+    if (ininame==NULL || spool==NULL || outname==NULL) return -1 ;
+    if (jql_init(&qs, ininame)!=0) return -1 ;
+
+    e_comment(0, "---> quick-look on [%s], publishing [%s]", spool, outname) ;
+    gettimeofday(&idle, NULL) ;
+    while ((maxframes<1) || (qs.nframes<maxframes)) {
+        names = jql_scan(spool, qs.last, &nnames) ;
+        if (nnames<1) {
+            jql_freenames(names, nnames) ;
+            if ((timeout>0) && (jql_elapsed(&idle)>(double)timeout)) {
+                e_comment(0, "no new frame for %d s: stopping", timeout) ;
+                break ;
+            }
+            usleep(QL_POLL_USEC) ;
+            continue ;
+        }
+        /* Skip the oldest pending frames if lagging behind */
+        first = 0 ;
+        if ((maxlag>0) && (nnames>maxlag)) {
+            first = nnames - maxlag ;
+            e_warning("%d frames pending: skipping %d", nnames, first) ;
+            strcpy(qs.last, names[first-1]) ;
+        }
+        for (i=first ; i<nnames ; i++) {
+            if ((maxframes>0) && (qs.nframes>=maxframes)) break ;
+            gettimeofday(&t0, NULL) ;
+            strcpy(qs.last, names[i]) ;
+            sprintf(path, "%s/%s", spool, names[i]) ;
+            TRACE_BEGIN("quicklook/frame") ;
+            im = jql_calib(&qs, path) ;
+            if (im==NULL) {
+                e_warning("cannot load [%s]: frame skipped", path) ;
+                TRACE_END("quicklook/frame") ;
+                continue ;
+            }
+            qs.nframes++ ;
+            if (jql_sky(&qs, im)!=0) {
+                image_del(im) ;
+                TRACE_END("quicklook/frame") ;
+                continue ;
+            }
+            if (jql_register(&qs, path, im, &dx, &dy)!=0) {
+                e_warning("cannot register [%s]: frame skipped", path) ;
+                image_del(im) ;
+                TRACE_END("quicklook/frame") ;
+                continue ;
+            }
+            jql_stack(&qs, im, dx, dy) ;
+            image_del(im) ;
+            jql_publish(&qs, outname, rtd_flag) ;
+            TRACE_END("quicklook/frame") ;
+            e_comment(1, "frame %04d [%s] offset %8.2f %8.2f stack %d (%.3f s)",
+                      qs.nframes, names[i], dx, dy, qs.nstacked,
+                      jql_elapsed(&t0)) ;
+        }
+        jql_freenames(names, nnames) ;
+        gettimeofday(&idle, NULL) ;
+    }
+    e_comment(0, "---> quick-look: %d frames received, %d stacked",
+              qs.nframes, qs.nstacked) ;
+    i = qs.nstacked ;
+    jql_cleanup(&qs) ;
+    return i ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Initialize the quick-look state
+  @param    qs      Quick-look state
+  @param    ininame Name of the jitter ini file
+  @return   0 if ok, -1 otherwise
+  The ini file is parsed and the calibration data are loaded once.
+ */
+/*----------------------------------------------------------------------------*/
+static int jql_init(jql_state * qs, char * ininame)
+{
+    image_t     *   tmp_im ;
+    pixelmap    *   tmp_pm ;
+    reject_zone_t * z ;
+
+    memset(qs, 0, sizeof(jql_state)) ;
+    if (!file_exists(ininame)) {
+        e_error("cannot find %s", ininame) ;
+        return -1 ;
+    }
+    qs->jc = jitter_config_new() ;
+    /* The frame list is not used here: errors are only warnings */
+    if (jitter_ini_parse(ininame, qs->jc)!=0) {
+        e_warning("ini file [%s] incomplete: continuing", ininame) ;
+    }
+    z = &(qs->jc->zone) ;
+
+    /* Calibrations */
+    if (qs->jc->dark_sub) {
+        if ((qs->dark = image_load(qs->jc->dark_name))==NULL) {
+            e_error("cannot load dark [%s]", qs->jc->dark_name) ;
+            jql_cleanup(qs) ;
+            return -1 ;
+        }
+        if ((tmp_im = jql_cutzone(qs, qs->dark))!=NULL) {
+            image_del(qs->dark) ;
+            qs->dark = tmp_im ;
+        }
+    }
+    if (qs->jc->ff_div) {
+        if ((qs->ff = image_load(qs->jc->ff_name))==NULL) {
+            e_error("cannot load flat-field [%s]", qs->jc->ff_name) ;
+            jql_cleanup(qs) ;
+            return -1 ;
+        }
+        if ((tmp_im = jql_cutzone(qs, qs->ff))!=NULL) {
+            image_del(qs->ff) ;
+            qs->ff = tmp_im ;
+        }
+    }
+    if (qs->jc->badpix_rep) {
+        if ((qs->badpix = pixelmap_load(qs->jc->badpixmap))==NULL) {
+            e_error("cannot load bad pixel map [%s]", qs->jc->badpixmap) ;
+            jql_cleanup(qs) ;
+            return -1 ;
+        }
+        if (z->left || z->right || z->bottom || z->top) {
+            if ((tmp_pm = pixelmap_getvig(qs->badpix,
+                                z->left + 1,
+                                z->bottom + 1,
+                                qs->badpix->lx - z->right,
+                                qs->badpix->ly - z->top)) != NULL) {
+                pixelmap_del(qs->badpix) ;
+                qs->badpix = tmp_pm ;
+            }
+        }
+    }
+
+    /* Running sky over the previous frames of the filter window */
+    if (qs->jc->sky_active) {
+        qs->ring_sz = 2 * qs->jc->skyfilter_rejhw ;
+        if (qs->ring_sz<1) qs->ring_sz = 1 ;
+        qs->ring = calloc(qs->ring_sz, sizeof(image_t*)) ;
+        if (qs->jc->sky_method == skymethod_medianframe) {
+            e_warning("median frame sky: using a running sky instead") ;
+        }
+    }
+
+    /* Offsets in a file are given in the order the frames arrive */
+    if (qs->jc->saa_active && (qs->jc->saa_offsource == offsource_file)) {
+        qs->file_offs = load_offsets_from_txtfile(qs->jc->saa_offfilename) ;
+        if (qs->file_offs==NULL) {
+            e_error("cannot load offsets from [%s]",
+                    qs->jc->saa_offfilename) ;
+            jql_cleanup(qs) ;
+            return -1 ;
+        }
+    }
+    return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Free the quick-look state
+  @param    qs      Quick-look state
+  @return   void
+ */
+/*----------------------------------------------------------------------------*/
+static void jql_cleanup(jql_state * qs)
+{
+    int     i ;
+
+    if (qs->dark!=NULL)      image_del(qs->dark) ;
+    if (qs->ff!=NULL)        image_del(qs->ff) ;
+    if (qs->badpix!=NULL)    pixelmap_del(qs->badpix) ;
+    if (qs->ring!=NULL) {
+        for (i=0 ; i<qs->ring_sz ; i++) {
+            if (qs->ring[i]!=NULL) image_del(qs->ring[i]) ;
+        }
+        free(qs->ring) ;
+    }
+    if (qs->ref_stars!=NULL) double3_del(qs->ref_stars) ;
+    if (qs->file_offs!=NULL) double3_del(qs->file_offs) ;
+    if (qs->sum!=NULL)       image_del(qs->sum) ;
+    if (qs->cnt!=NULL)       image_del(qs->cnt) ;
+    jitter_config_del(qs->jc) ;
+    return ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Remove the rejected borders from an image
+  @param    qs      Quick-look state
+  @param    im      Image to cut
+  @return   1 newly allocated image, NULL if there is nothing to cut
+ */
+/*----------------------------------------------------------------------------*/
+static image_t * jql_cutzone(jql_state * qs, image_t * im)
+{
+    reject_zone_t * z ;
+
+    z = &(qs->jc->zone) ;
+    if (!(z->left || z->right || z->bottom || z->top)) return NULL ;
+    return image_getvig(im,
+                        z->left + 1,
+                        z->bottom + 1,
+                        im->lx - z->right,
+                        im->ly - z->top) ;
+}
+
+/* Comparison of file names for qsort() */
+static int jql_namecmp(const void * a, const void * b)
+{
+    return strcmp(*(char**)a, *(char**)b) ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    List the new frames in the spool directory
+  @param    spool   Name of the spool directory
+  @param    last    Name of the last processed frame
+  @param    n       Returned number of new frames
+  @return   Newly allocated sorted array of file names
+
+  Only the .fits files named after last are returned. The list must be
+  deallocated with jql_freenames().
+ */
+/*----------------------------------------------------------------------------*/
+static char ** jql_scan(char * spool, char * last, int * n)
+{
+    DIR             *   dir ;
+    struct dirent   *   ent ;
+    char            **  names ;
+    int                 alloc ;
+    int                 len ;
+
+    *n = 0 ;
+    if ((dir=opendir(spool))==NULL) return NULL ;
+    names = NULL ;
+    alloc = 0 ;
+    while ((ent=readdir(dir))!=NULL) {
+        len = (int)strlen(ent->d_name) ;
+        if ((len<6) || strcmp(ent->d_name+len-5, ".fits")) continue ;
+        if (len>=FILENAMESZ) continue ;
+        if (strcmp(ent->d_name, last)<=0) continue ;
+        if (*n>=alloc) {
+            alloc = (alloc==0) ? 16 : 2*alloc ;
+            names = realloc(names, alloc * sizeof(char*)) ;
+        }
+        names[*n] = malloc(len+1) ;
+        strcpy(names[*n], ent->d_name) ;
+        (*n)++ ;
+    }
+    closedir(dir) ;
+    if (*n>1) qsort(names, *n, sizeof(char*), jql_namecmp) ;
+    return names ;
+}
+
+/* Free a list of names returned by jql_scan() */
+static void jql_freenames(char ** names, int n)
+{
+    int     i ;
+
+    if (names==NULL) return ;
+    for (i=0 ; i<n ; i++) free(names[i]) ;
+    free(names) ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Load and calibrate a frame
+  @param    qs      Quick-look state
+  @param    name    Name of the frame
+  @return   1 newly allocated image, NULL if error occurred
+ */
+/*----------------------------------------------------------------------------*/
+static image_t * jql_calib(jql_state * qs, char * name)
+{
+    image_t     *   im ;
+    image_t     *   tmp_im ;
+    cube_t      *   one ;
+
+    if ((im = image_load(name))==NULL) return NULL ;
+    if ((tmp_im = jql_cutzone(qs, im))!=NULL) {
+        image_del(im) ;
+        im = tmp_im ;
+    }
+    /* The first frame fixes the frame size and the instrument */
+    if (qs->lx==0) {
+        qs->lx = im->lx ;
+        qs->ly = im->ly ;
+        qs->jc->data_type = pfits_identify_ins(name) ;
+    } else if ((im->lx!=qs->lx) || (im->ly!=qs->ly)) {
+        e_error("frame size %dx%d differs from %dx%d",
+                im->lx, im->ly, qs->lx, qs->ly) ;
+        image_del(im) ;
+        return NULL ;
+    }
+
+    if (qs->jc->preproc_active && qs->jc->preproc_oddeven) {
+        if ((tmp_im = image_de_oddeven_byquad(im))==NULL) {
+            image_del(im) ;
+            return NULL ;
+        }
+        image_del(im) ;
+        im = tmp_im ;
+    }
+    if ((qs->dark!=NULL) || (qs->ff!=NULL) || (qs->badpix!=NULL)) {
+        one = cube_new(im->lx, im->ly, 1) ;
+        one->plane[0] = im ;
+        cube_correct_ff_dark_badpix(one, qs->ff, qs->dark, qs->badpix) ;
+        cube_del_shallow(one) ;
+    }
+    return im ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Subtract the running sky from a frame
+  @param    qs      Quick-look state
+  @param    im      Calibrated frame, modified in place
+  @return   0 if ok, -1 otherwise
+
+  As in the jitter sky combination without central value, the sky of a
+  frame is its median plus the filtered average of the median-subtracted
+  previous frames of the window. Until enough frames have been received
+  for the rejection, their median is used, and only the median of the
+  frame is subtracted from the first three frames: objects would not be
+  filtered out of a sky made of fewer frames. The median-subtracted
+  frame then replaces the oldest one in the window.
+ */
+/*----------------------------------------------------------------------------*/
+static int jql_sky(jql_state * qs, image_t * im)
+{
+    cube_t      *   win ;
+    image_t     *   sky ;
+    image_t     *   back ;
+    double          med ;
+    int             rejmin, rejmax ;
+    int             i ;
+
+    if (!qs->jc->sky_active) return 0 ;
+
+    TRACE_BEGIN("quicklook/sky") ;
+    med = (double)image_getmedian(im) ;
+    back = image_cst_op(im, med, '-') ;
+
+    sky = NULL ;
+    if (qs->ring_n>=3) {
+        win = cube_new(im->lx, im->ly, qs->ring_n) ;
+        for (i=0 ; i<qs->ring_n ; i++) win->plane[i] = qs->ring[i] ;
+        rejmin = qs->jc->skyfilter_rejmin ;
+        rejmax = qs->jc->skyfilter_rejmax ;
+        if (qs->ring_n-rejmin-rejmax>=3) {
+            sky = cube_avg_reject(win, rejmin, rejmax) ;
+        } else {
+            sky = cube_avg_median(win) ;
+        }
+        cube_del_shallow(win) ;
+        if (sky==NULL) {
+            e_error("computing running sky") ;
+            image_del(back) ;
+            TRACE_END("quicklook/sky") ;
+            return -1 ;
+        }
+    }
+
+    /* Subtract the median of the frame and the residual sky */
+    image_cst_op_local(im, med, '-') ;
+    if (sky!=NULL) {
+        image_sub_local(im, sky) ;
+        image_del(sky) ;
+    }
+
+    /* Update the window */
+    if (qs->ring[qs->ring_pos]!=NULL) image_del(qs->ring[qs->ring_pos]) ;
+    qs->ring[qs->ring_pos] = back ;
+    qs->ring_pos = (qs->ring_pos + 1) % qs->ring_sz ;
+    if (qs->ring_n<qs->ring_sz) qs->ring_n++ ;
+    TRACE_END("quicklook/sky") ;
+    return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Find the offset of a frame relative to the reference frame
+  @param    qs      Quick-look state
+  @param    name    Name of the frame
+  @param    im      Sky-subtracted frame
+  @param    dx      Returned offset in x
+  @param    dy      Returned offset in y
+  @return   0 if ok, -1 otherwise
+
+  The first registered frame is the reference. Offsets follow the jitter
+  convention: an object at (x,y) in the reference frame is found at
+  (x+dx,y+dy) in the frame. Blind offset search needs the whole set of
+  frames and is replaced by star matching.
+ */
+/*----------------------------------------------------------------------------*/
+static int jql_register(
+        jql_state   *   qs,
+        char        *   name,
+        image_t     *   im,
+        double      *   dx,
+        double      *   dy)
+{
+    match_transform     tr ;
+    double3         *   stars ;
+    char            *   xval ;
+    char            *   yval ;
+    double              x, y ;
+
+    *dx = *dy = 0.0 ;
+    if (!qs->jc->saa_active) return 0 ;
+
+    switch (qs->jc->saa_offsource) {
+        case offsource_header:
+        xval = pfits_get(qs->jc->data_type, name, "cumoffsetx") ;
+        if (xval==NULL) return -1 ;
+        x = atof(xval) ;
+        yval = pfits_get(qs->jc->data_type, name, "cumoffsety") ;
+        if (yval==NULL) return -1 ;
+        y = atof(yval) ;
+        break ;
+
+        case offsource_file:
+        if (qs->nframes>qs->file_offs->n) {
+            e_error("no more offsets in [%s]", qs->jc->saa_offfilename) ;
+            return -1 ;
+        }
+        x = qs->file_offs->x[qs->nframes-1] ;
+        y = qs->file_offs->y[qs->nframes-1] ;
+        break ;
+
+        case offsource_blind:
+        case offsource_stars:
+        stars = detected_ks_brightest_stars(im, QL_NBSTARS,
+                                            qs->jc->saa_detectk) ;
+        if (stars==NULL) return -1 ;
+        if (qs->ref_stars==NULL) {
+            qs->ref_stars = stars ;
+            x = y = 0.0 ;
+        } else {
+            if (match_pointslist_transform(qs->ref_stars, stars,
+                                           QL_MATCHTOL, 0.0, &tr)!=0) {
+                double3_del(stars) ;
+                return -1 ;
+            }
+            double3_del(stars) ;
+            x = tr.dx ;
+            y = tr.dy ;
+        }
+        break ;
+
+        default:
+        e_error("unsupported offset source for quick-look") ;
+        return -1 ;
+    }
+    if (!qs->have_ref) {
+        qs->have_ref = 1 ;
+        qs->ref_x = x ;
+        qs->ref_y = y ;
+    }
+    *dx = x - qs->ref_x ;
+    *dy = y - qs->ref_y ;
+    return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Add a frame to the running stack
+  @param    qs      Quick-look state
+  @param    im      Sky-subtracted frame
+  @param    dx      Offset of the frame in x
+  @param    dy      Offset of the frame in y
+  @return   void
+
+  For speed the frame is shifted by the nearest integer offsets, without
+  interpolation. The stack covers the reference frame only.
+ */
+/*----------------------------------------------------------------------------*/
+static void jql_stack(jql_state * qs, image_t * im, double dx, double dy)
+{
+    int     ix, iy ;
+    int     i, j ;
+    int     x0, x1, y0, y1 ;
+
+    if (qs->sum==NULL) {
+        qs->sum = image_new(qs->lx, qs->ly) ;
+        qs->cnt = image_new(qs->lx, qs->ly) ;
+    }
+    ix = (int)(dx<0 ? dx-0.5 : dx+0.5) ;
+    iy = (int)(dy<0 ? dy-0.5 : dy+0.5) ;
+    /* Stack pixels (i,j) fed by frame pixels (i+ix,j+iy) */
+    x0 = (ix<0) ? -ix : 0 ;
+    x1 = (ix>0) ? qs->lx - ix : qs->lx ;
+    y0 = (iy<0) ? -iy : 0 ;
+    y1 = (iy>0) ? qs->ly - iy : qs->ly ;
+    for (j=y0 ; j<y1 ; j++) {
+        for (i=x0 ; i<x1 ; i++) {
+            qs->sum->data[i+j*qs->lx] += im->data[(i+ix)+(j+iy)*qs->lx] ;
+            qs->cnt->data[i+j*qs->lx] += 1.0 ;
+        }
+    }
+    qs->nstacked++ ;
+    return ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Publish the running stack
+  @param    qs          Quick-look state
+  @param    outname     Name of the output file
+  @param    rtd_flag    Also display it on RTD if non-zero
+  @return   0 if ok, -1 otherwise
+
+  The stack is written to a temporary file which is then renamed, so
+  that readers never see a partially written file.
+ */
+/*----------------------------------------------------------------------------*/
+static int jql_publish(jql_state * qs, char * outname, int rtd_flag)
+{
+    image_t *   out ;
+    char        tmpname[FILENAMESZ] ;
+    int         i ;
+
+    if (qs->sum==NULL) return -1 ;
+    TRACE_BEGIN("quicklook/publish") ;
+    out = image_new(qs->lx, qs->ly) ;
+    for (i=0 ; i<qs->lx*qs->ly ; i++) {
+        if (qs->cnt->data[i]>0.0) {
+            out->data[i] = qs->sum->data[i] / qs->cnt->data[i] ;
+        }
+    }
+    sprintf(tmpname, "%s.tmp", outname) ;
+    image_save_fits(out, tmpname, BPP_IEEE_FLOAT) ;
+    if (rename(tmpname, outname)!=0) {
+        e_error("cannot rename [%s] to [%s]", tmpname, outname) ;
+        image_del(out) ;
+        TRACE_END("quicklook/publish") ;
+        return -1 ;
+    }
+    if (rtd_flag) rtd_image_put(out) ;
+    image_del(out) ;
+    TRACE_END("quicklook/publish") ;
+    return 0 ;
+}
+
+/* Seconds elapsed since t0 */
+static double jql_elapsed(struct timeval * t0)
+{
+    struct timeval  t1 ;
+
+    gettimeofday(&t1, NULL) ;
+    return (double)(t1.tv_sec - t0->tv_sec) +
+           1e-6 * (double)(t1.tv_usec - t0->tv_usec) ;
+}
+/* vim: set ts=4 et sw=4 tw=75 */
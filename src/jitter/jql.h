@@ -0,0 +1,63 @@
+/*----------------------------------------------------------------------------*/
+/**
+   @file    jql.h
+   @author
+   @date    Oct 2026
+   @version	$Revision$
+   @brief   Jitter quick-look: incremental reduction of incoming frames
+*/
+/*----------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+#ifndef _JQL_H_
+#define _JQL_H_
+
+/*-----------------------------------------------------------------------------
+                                Functions prototype
+ -----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief    Run the jitter quick-look loop on a spool directory
+  @param    ininame     Name of the jitter ini file.
+  @param    spool       Name of the directory receiving the frames.
+  @param    outname     Name of the published running stack.
+  @param    maxframes   Stop after this many frames, 0 for no limit.
+  @param    timeout     Stop after this many idle seconds, 0 for never.
+  @param    maxlag      Maximal number of pending frames, 0 for no limit.
+  @param    rtd_flag    Also display the running stack on RTD if non-zero.
+  @return   Number of frames added to the stack, or -1 if error occurred.
+
+  Frames are FITS files dropped into the spool directory by the
+  producer, which must create them under another name (e.g. without the
+  .fits extension) and rename them once complete. They are processed in
+  alphabetical order of their names, which must thus increase with time
+  (e.g. time stamps or sequence numbers). Files named before the last
+  processed one are ignored.
+
+  Each frame is calibrated, sky-subtracted with a running sky computed
+  from the previous frames, registered on the first frame and added to
+  the running stack, which is then saved to outname. The settings are
+  taken from the calibration, sky and shift-and-add sections of the
+  jitter ini file.
+
+  If more than maxlag frames are pending, the oldest ones are skipped
+  to bound the latency of the published stack.
+ */
+/*----------------------------------------------------------------------------*/
+int jitter_quicklook(
+        char    *   ininame,
+        char    *   spool,
+        char    *   outname,
+        int         maxframes,
+        int         timeout,
+        int         maxlag,
+        int         rtd_flag) ;
+
+#endif
@@ -29,6 +29,7 @@
  -----------------------------------------------------------------------------*/
 
 static int jitter_saa_blind(jitter_config_t * jc);
+static int jitter_saa_stars(jitter_config_t * jc);
 static int jitter_saa_xcorr(jitter_config_t * jc);
 static int jitter_saa_findxcorrp(jitter_config_t * jc);
 static int jitter_saa_stack(jitter_config_t * jc);
@@ -44,7 +45,8 @@ static int jitter_saa_stack(jitter_config_t * jc);
   @return   int 0 if Ok, -1 if error occured.
 
   This part includes:
-  - offsets search (either from header, or with a provided file or blindly)
+  - offsets search (either from header, or with a provided file, blindly
+    or by star matching)
   - X-correlation:
     - xcorr object detection
     - xcorrelation to refine offsets
@@ -85,6 +87,14 @@ int jitter_saa(jitter_config_t * jc)
             jc->status_saa = ALGO_FAILED ;
             return -1 ;
         }
+    } else if (jc->saa_offsource == offsource_stars) {
+        /* Match stars between frames */
+        e_comment(1, "matching stars between frames");
+        if (jitter_saa_stars(jc)!=0) {
+            e_error("matching stars between frames");
+            jc->status_saa = ALGO_FAILED ;
+            return -1 ;
+        }
     }
 
     /* Subtract the first offsets from all others Only for type_obj */
@@ -139,7 +149,10 @@ int jitter_saa(jitter_config_t * jc)
   @param    jc  Current jitter config
   @return   int 0 if Ok, -1 otherwise.
   This function is applying a blind offset search to identify a first,
-  rough estimate of the offsets between all frames.
+  rough estimate of the offsets between all frames. The offsets are
+  found by pyramid registration of all frames on the first one (see
+  cube_pyramidoffsets()), which handles large offsets and any frame
+  size.
  */
 /*----------------------------------------------------------------------------*/
 static int jitter_saa_blind(jitter_config_t * jc)
@@ -152,7 +165,7 @@ static int jitter_saa_blind(jitter_config_t * jc)
     sel = jitter_cubeselect(jc, type_obj);
     obj = jitter_cubeget(jc, sel);
     free(sel);
-    offs = cube_blindoffsets(obj, obj->plane[0]);
+    offs = cube_pyramidoffsets(obj, obj->plane[0], 0);
     cube_del_shallow(obj);
     if (offs==NULL) {
         e_error("blind offsets failed");
@@ -160,13 +173,59 @@ static int jitter_saa_blind(jitter_config_t * jc)
     }
 
     /* Put offsets back into config */
-    e_comment(1, "plane  #:       dx       dy         dist");
+    e_comment(1, "plane  #:       dx       dy     corr");
+    j=0 ;
+    for (i=0 ; i<jc->nframes ; i++) {
+        if (jc->frame[i].type == type_obj) {
+            jc->frame[i].off_x = offs->x[j] ;
+            jc->frame[i].off_y = offs->y[j] ;
+            e_comment(1, "plane %02d: %8.2f %8.2f %8.3f", j+1,
+                      offs->x[j], offs->y[j], offs->z[j]);
+            j++ ;
+        }
+    }
+    double3_del(offs);
+    return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief	Offset search by star matching
+  @param    jc  Current jitter config
+  @return   int 0 if Ok, -1 otherwise.
+  This function detects the brightest stars in all frames with the
+  detection kappa, and matches them to the stars of the first frame to
+  get the offsets between all frames. Unlike the blind search, it does
+  not depend on the frame size and is not disturbed by a varying
+  background.
+ */
+/*----------------------------------------------------------------------------*/
+static int jitter_saa_stars(jitter_config_t * jc)
+{
+    int         i, j ;
+    cube_t  *   obj ;
+    int     *   sel ;
+    double3 *   offs ;
+
+    sel = jitter_cubeselect(jc, type_obj);
+    obj = jitter_cubeget(jc, sel);
+    free(sel);
+    offs = cube_matchoffsets(obj, 0, jc->saa_detectk);
+    cube_del_shallow(obj);
+    if (offs==NULL) {
+        e_error("star matching failed");
+        return -1 ;
+    }
+
+    /* Put offsets back into config */
+    e_comment(1, "plane  #:       dx       dy    stars");
     j=0 ;
     for (i=0 ; i<jc->nframes ; i++) {
         if (jc->frame[i].type == type_obj) {
             jc->frame[i].off_x = offs->x[j] ;
             jc->frame[i].off_y = offs->y[j] ;
-            e_comment(1, "plane %02d: %8.2f %8.2f", j+1,offs->x[j], offs->y[j]);
+            e_comment(1, "plane %02d: %8.2f %8.2f %8d", j+1,
+                      offs->x[j], offs->y[j], (int)offs->z[j]);
             j++ ;
         }
     }
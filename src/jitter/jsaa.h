@@ -29,12 +29,13 @@
   @return   int 0 if Ok, -1 if error occured.
 
   This part includes:
-  - Blind offset search 
+  - Blind offset search or star matching
   - X-correlation:
     - xcorr object detection
     - xcorrelation to refine offsets
   - Shifting and adding frames
-  Blind offset search, cross-correlation are only carried out if required.
+  Blind offset search, star matching and cross-correlation are only
+  carried out if required.
  */
 /*----------------------------------------------------------------------------*/
 int jitter_saa(jitter_config_t * jc) ;
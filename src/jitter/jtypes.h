@@ -179,7 +179,8 @@ typedef struct jitter_config_t {
         offsource_unknown=0,
         offsource_header,
         offsource_file,
-        offsource_blind
+        offsource_blind,
+        offsource_stars
     } saa_offsource ;
 
     /* Shift and add: file offsets */
@@ -36,6 +36,14 @@
 #define OPT_CYCLE_STEP		2003
 #define OPT_RUN_HW			2004
 
+#define OPT_KAPPA_LOW		3001
+#define OPT_KAPPA_HIGH		3002
+#define OPT_ITER			3003
+#define OPT_WEIGHTS			3004
+#define OPT_WMAPS			3005
+#define OPT_COUNTS			3006
+#define OPT_WSUM			3007
+
 /*-----------------------------------------------------------------------------
    						    Function prototypes
  -----------------------------------------------------------------------------*/
@@ -55,6 +63,14 @@ int main(int argc, char *argv[])
 	int				lo_rej, hi_rej ;
 	int				cycle_step ;
 	int				run_hw ;
+	int				stacking ;
+	stack_reject	sreject ;
+	double			kappa_lo, kappa_hi ;
+	int				niter ;
+	char		*	weight_name ;
+	char		*	wmap_name ;
+	char		*	count_name ;
+	char		*	wsum_name ;
 	char			inputname[FILENAMESZ+1] ;
 	char			outputname[FILENAMESZ+1] ;
 	int				ret ;
@@ -71,6 +87,15 @@ int main(int argc, char *argv[])
 	hi_rej = -1.0 ;
 	cycle_step = -1 ;
 	run_hw     = -1 ;
+	stacking   = 0 ;
+	sreject    = stack_none ;
+	kappa_lo   = 3.0 ;
+	kappa_hi   = 3.0 ;
+	niter      = 0 ;
+	weight_name = NULL ;
+	wmap_name   = NULL ;
+	count_name  = NULL ;
+	wsum_name   = NULL ;
 
     while (1) {
         int     option_index = 0 ;
@@ -88,6 +113,14 @@ int main(int argc, char *argv[])
             {"step",  	  1, 0, OPT_CYCLE_STEP},
             {"halfwidth", 1, 0, OPT_RUN_HW},
 
+            {"kappa-low",  1, 0, OPT_KAPPA_LOW},
+            {"kappa-high", 1, 0, OPT_KAPPA_HIGH},
+            {"iter",       1, 0, OPT_ITER},
+            {"weights",    1, 0, OPT_WEIGHTS},
+            {"wmaps",      1, 0, OPT_WMAPS},
+            {"counts",     1, 0, OPT_COUNTS},
+            {"wsum",       1, 0, OPT_WSUM},
+
             {"in",  	1, 0, OPT_INPUT},
             {"out", 	1, 0, OPT_OUTPUT},
 
@@ -154,6 +187,15 @@ int main(int argc, char *argv[])
 				amethod = avg_sum ;
 			} else if (!strcmp(optarg, "filtered")) {
 				amethod = avg_filtered ;
+			} else if (!strcmp(optarg, "weighted")) {
+				stacking = 1 ;
+				sreject = stack_none ;
+			} else if (!strcmp(optarg, "ksigma")) {
+				stacking = 1 ;
+				sreject = stack_ksigma ;
+			} else if (!strcmp(optarg, "mad")) {
+				stacking = 1 ;
+				sreject = stack_mad ;
 			} else {
 				e_error("unsupported average method: [%s]", optarg) ;
 			}
@@ -175,6 +217,34 @@ int main(int argc, char *argv[])
 			run_hw = (int)atoi(optarg) ;
             break ;
 
+            case OPT_KAPPA_LOW:
+			kappa_lo = atof(optarg) ;
+            break ;
+
+            case OPT_KAPPA_HIGH:
+			kappa_hi = atof(optarg) ;
+            break ;
+
+            case OPT_ITER:
+			niter = (int)atoi(optarg) ;
+            break ;
+
+            case OPT_WEIGHTS:
+			weight_name = optarg ;
+            break ;
+
+            case OPT_WMAPS:
+			wmap_name = optarg ;
+            break ;
+
+            case OPT_COUNTS:
+			count_name = optarg ;
+            break ;
+
+            case OPT_WSUM:
+			wsum_name = optarg ;
+            break ;
+
             default:
             usage(argv[0]) ;
             break ;
@@ -185,7 +255,25 @@ int main(int argc, char *argv[])
 	eclipse_init();
 
 	/* Real processing starts here */
-	ret = average_engine(inputname, 
+	if (stacking) {
+		if (cmethod!=cut_whole) {
+			e_error("weighted and clipped averages only support cut whole") ;
+			return -1 ;
+		}
+		ret = stack_engine(inputname,
+						   outputname,
+						   sreject,
+						   kappa_lo,
+						   kappa_hi,
+						   niter,
+						   weight_name,
+						   wmap_name,
+						   count_name,
+						   wsum_name) ;
+	} else {
+		/* Averages work on time lines: deep cubes may stay on disk */
+		cube_tiles_enable(1) ;
+		ret = average_engine(inputname, 
                             outputname, 
                             cmethod, 
                             amethod, 
@@ -193,6 +281,7 @@ int main(int argc, char *argv[])
 					        run_hw, 
                             lo_rej, 
                             hi_rej) ;
+	}
 
 	if (debug_active()) xmemory_status() ;
 
@@ -222,6 +311,20 @@ static void usage(char *pname)
 		"\t--method filtered to do a filtered average, with parameters:\n"
 		"\t\t--filt-low <n>  where <n> is a number of low pixels\n"
 		"\t\t--filt-high <n> where <n> is a number of high pixels\n"
+		"\n");
+	printf(
+		"\t--method weighted to do a weighted average\n"
+		"\t--method ksigma to do a kappa-sigma clipped weighted average\n"
+		"\t--method mad to do a MAD clipped weighted average\n"
+		"\tthese methods (with cut whole only) have parameters:\n");
+	printf(
+		"\t\t--kappa-low <k>  low threshold in sigmas (default 3)\n"
+		"\t\t--kappa-high <k> high threshold in sigmas (default 3)\n"
+		"\t\t--iter <n>  max clipping iterations (default: converge)\n"
+		"\t\t--weights <file> ASCII file of plane weights\n"
+		"\t\t--wmaps <cube>   cube of weight maps (inverse variances)\n"
+		"\t\t--counts <image> to save contributing frame counts\n"
+		"\t\t--wsum <image>   to save sums of weights\n"
 		"\n\n");
 	exit(0) ;
 }
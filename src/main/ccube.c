@@ -42,6 +42,14 @@
 #define OPT_STANDARD		1001
 #define OPT_POLISH			1002
 
+/* Number of pixels per operand loaded at once */
+#define BLOCKPIX			(1024*1024)
+
+/* Instruction kinds */
+#define INSTR_CUBE_CUBE		0
+#define INSTR_CUBE_NUMBER	1
+#define INSTR_NUMBER_CUBE	2
+
 /*-----------------------------------------------------------------------------
    								New types
  -----------------------------------------------------------------------------*/
@@ -55,7 +63,7 @@
  */
 
 typedef union _ITEM_VALUE_ {
-	cube_t *	cubept ;
+	int			reg ;
 	double		f ;
 	char	op ;
 } itemValue ;
@@ -99,6 +107,41 @@ typedef struct _STACK_ {
 	struct _STACK_ *	next ;
 } stack ;
 
+/*
+ * Cubes are never loaded as a whole. Solving the expression produces a
+ * program working on registers, one per cube named in the expression.
+ * Each register holds the current block of rows of its cube: the
+ * program is run on every block, and the result is streamed to disk
+ * before the next block is read. Instructions work in place on their
+ * first cube operand, as cube_op() and cube_cst_op() do.
+ */
+typedef struct _OPERAND_ {
+	qfitsloader		ql ;
+	/* Cube loaded in memory if the operand is no FITS file */
+	cube_t		*	cube ;
+	int				lx, ly, np ;
+	/* Current block of rows */
+	pixelvalue	*	buf ;
+	int				status ;
+} operand ;
+
+typedef struct _INSTRUCTION_ {
+	int			kind ;
+	char		op ;
+	/* Modified register, second cube operand (or -1) and constant */
+	int			dst ;
+	int			src ;
+	double		f ;
+} instruction ;
+
+/* Block of rows processed by one run of the program */
+typedef struct _BLOCK_ {
+	int			plane ;
+	int			y0 ;
+	int			nrows ;
+	int			lx ;
+} block ;
+
 
 /*-----------------------------------------------------------------------------
    							Global variables	
@@ -107,6 +150,12 @@ typedef struct _STACK_ {
 /* First file name found to preserve FITS header information in the output. */
 char firstName[FILENAMESZ+1] ;
 
+/* Registers and program produced by solving the expression */
+static operand		operands[MAX_OP] ;
+static int			noperands = 0 ;
+static instruction	program[MAX_OP] ;
+static int			ninstructions = 0 ;
+
 /*-----------------------------------------------------------------------------
   							Function prototypes
  -----------------------------------------------------------------------------*/
@@ -120,6 +169,363 @@ static item * 	topstack(stack *sp) ;
 static int		priority(char op) ;
 static char *   tokenizeExpression(char *arexp) ; 
 static void 	strip_blanks(char *exp) ;
+static int		open_operand(char *filename) ;
+static void		load_block(void *arg, int task, int worker) ;
+static void		run_program(void *arg, int task, int worker) ;
+static int		stream_result(int reg, char *outname, char *exp) ;
+static void		close_operands(void) ;
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief	Register a cube named in the expression.
+  @param	filename	Name of the cube.
+  @return	int register number, -1 in case of error.
+
+  FITS files are only opened: their pixels are read block by block when
+  the program is run. Other inputs (lists of frames) are loaded in
+  memory.
+ */
+/*----------------------------------------------------------------------------*/
+static int open_operand(char * filename)
+{
+	operand	*	o ;
+
+	if (noperands >= MAX_OP) {
+		e_error("too many cubes in expression") ;
+		return -1 ;
+	}
+	o = operands + noperands ;
+	o->cube = NULL ;
+	o->buf = NULL ;
+	if (is_fits_file(filename)==1) {
+		o->ql.filename = filename ;
+		o->ql.xtnum    = 0 ;
+		o->ql.pnum     = 0 ;
+		o->ql.map      = 0 ;
+#ifdef DOUBLEPIX
+		o->ql.ptype    = PTYPE_DOUBLE ;
+#else
+		o->ql.ptype    = PTYPE_FLOAT ;
+#endif
+		if (qfitsloader_init(&(o->ql))!=0) {
+			return -1 ;
+		}
+		/* The loader keeps a pointer to the file name */
+		o->ql.filename = strdup(filename) ;
+		o->lx = o->ql.lx ;
+		o->ly = o->ql.ly ;
+		o->np = o->ql.np ;
+	} else {
+		o->cube = cube_load(filename) ;
+		if (o->cube == NULL) {
+			return -1 ;
+		}
+		o->lx = o->cube->lx ;
+		o->ly = o->cube->ly ;
+		o->np = o->cube->np ;
+	}
+	noperands++ ;
+	return noperands-1 ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief	Deallocate all registers.
+  @return	void
+ */
+/*----------------------------------------------------------------------------*/
+static void close_operands(void)
+{
+	int	i ;
+
+	for (i=0 ; i<noperands ; i++) {
+		if (operands[i].cube != NULL) {
+			cube_del(operands[i].cube) ;
+		} else {
+			free(operands[i].ql.filename) ;
+		}
+		if (operands[i].buf != NULL) {
+			free(operands[i].buf) ;
+			operands[i].buf = NULL ;
+		}
+	}
+	noperands = 0 ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief	Load the current block of rows of one register.
+  @param	arg		Block to load.
+  @param	task	Register number.
+  @param	worker	Worker number (unused).
+  @return	void
+
+  Single-plane cubes are broadcast: their only plane is read for every
+  plane of the result. The status of the register is set to -1 if the
+  block could not be read.
+ */
+/*----------------------------------------------------------------------------*/
+static void load_block(void * arg, int task, int worker)
+{
+	block		*	b ;
+	operand		*	o ;
+	qfitsloader		ql ;
+	int				plane ;
+
+	b = (block*)arg ;
+	o = operands + task ;
+	plane = (o->np == 1) ? 0 : b->plane ;
+	o->buf = NULL ;
+	o->status = -1 ;
+
+	if (o->cube != NULL) {
+		o->buf = malloc(b->nrows * b->lx * sizeof(pixelvalue)) ;
+		memcpy(o->buf,
+			   o->cube->plane[plane]->data + b->y0 * b->lx,
+			   b->nrows * b->lx * sizeof(pixelvalue)) ;
+		o->status = 0 ;
+		return ;
+	}
+	ql = o->ql ;
+	ql.pnum = plane ;
+	if (qfits_loadpix_window(&ql, 1, b->y0+1, b->lx, b->y0+b->nrows)!=0) {
+		return ;
+	}
+#ifdef DOUBLEPIX
+	o->buf = (pixelvalue*)ql.dbuf ;
+#else
+	o->buf = (pixelvalue*)ql.fbuf ;
+#endif
+	TRACE_COUNT(TRACE_BYTES_READ,
+				(double)b->lx * b->nrows * BYTESPERPIXEL(ql.bitpix)) ;
+	o->status = 0 ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief	Run the program on one row of the current block.
+  @param	arg		Current block.
+  @param	task	Row number in the block.
+  @param	worker	Worker number (unused).
+  @return	void
+
+  All instructions are applied to the row before moving to the next
+  one, so that the row stays in cache for the whole expression. Results
+  are identical to the ones of cube_op() and cube_cst_op().
+ */
+/*----------------------------------------------------------------------------*/
+static void run_program(void * arg, int task, int worker)
+{
+	block		*	b ;
+	instruction	*	ins ;
+	pixelvalue	*	d ;
+	pixelvalue	*	s ;
+	pixelvalue		inv ;
+	double			f ;
+	double			invlog ;
+	int				i, k ;
+
+	b = (block*)arg ;
+	for (k=0 ; k<ninstructions ; k++) {
+		ins = program + k ;
+		d = operands[ins->dst].buf + task * b->lx ;
+		f = ins->f ;
+		switch (ins->kind) {
+			case INSTR_CUBE_CUBE:
+			s = operands[ins->src].buf + task * b->lx ;
+			switch (ins->op) {
+				case '+':
+				for (i=0 ; i<b->lx ; i++) d[i] += s[i] ;
+				break ;
+				case '-':
+				for (i=0 ; i<b->lx ; i++) d[i] -= s[i] ;
+				break ;
+				case '*':
+				for (i=0 ; i<b->lx ; i++) d[i] *= s[i] ;
+				break ;
+				case '/':
+				for (i=0 ; i<b->lx ; i++) {
+					if (fabs((double)s[i]) < 1e-10) d[i] = 0.0 ;
+					else d[i] /= s[i] ;
+				}
+				break ;
+			}
+			break ;
+
+			case INSTR_CUBE_NUMBER:
+			switch (ins->op) {
+				case '+':
+				for (i=0 ; i<b->lx ; i++)
+					d[i] = (pixelvalue)((double)d[i] + f) ;
+				break ;
+				case '-':
+				for (i=0 ; i<b->lx ; i++)
+					d[i] = (pixelvalue)((double)d[i] - f) ;
+				break ;
+				case '*':
+				for (i=0 ; i<b->lx ; i++)
+					d[i] = (pixelvalue)((double)d[i] * f) ;
+				break ;
+				case '/':
+				f = 1.0 / f ;
+				for (i=0 ; i<b->lx ; i++)
+					d[i] = (pixelvalue)((double)d[i] * f) ;
+				break ;
+				case 'l':
+				invlog = 1.0 / log(f) ;
+				for (i=0 ; i<b->lx ; i++)
+					d[i] = (pixelvalue)log((double)d[i]) * invlog ;
+				break ;
+				case '^':
+				for (i=0 ; i<b->lx ; i++)
+					d[i] = (pixelvalue)pow((double)d[i], f) ;
+				break ;
+			}
+			break ;
+
+			case INSTR_NUMBER_CUBE:
+			switch (ins->op) {
+				case '+':
+				for (i=0 ; i<b->lx ; i++)
+					d[i] = (pixelvalue)((double)d[i] + f) ;
+				break ;
+				case '-':
+				for (i=0 ; i<b->lx ; i++)
+					d[i] = (pixelvalue)(f - (double)d[i]) ;
+				break ;
+				case '*':
+				for (i=0 ; i<b->lx ; i++)
+					d[i] = (pixelvalue)((double)d[i] * f) ;
+				break ;
+				case '/':
+				/* Reciprocal first, as cube_cst_op() would do */
+				for (i=0 ; i<b->lx ; i++) {
+					inv = (pixelvalue)pow((double)d[i], -1.0) ;
+					d[i] = (pixelvalue)((double)inv * f) ;
+				}
+				break ;
+				case '^':
+				for (i=0 ; i<b->lx ; i++)
+					d[i] = (pixelvalue)pow(f, (double)d[i]) ;
+				break ;
+			}
+			break ;
+		}
+	}
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief	Run the program and stream its result to a FITS file.
+  @param	reg		Register holding the result of the program.
+  @param	outname	Output file name.
+  @param	exp		Arithmetic expression, added to the header history.
+  @return	int 0 if Ok, -1 otherwise.
+
+  The output cube is produced by blocks of rows, each block holding
+  about BLOCKPIX pixels of a single plane. For each block, all
+  registers are read in parallel, then the program is run on the rows
+  of the block in parallel, and the result is handed to a FITS output
+  stream. Memory use only depends on the block size and the number of
+  cubes in the expression, not on the size of the cubes.
+
+  The header of the first file named in the expression is copied to the
+  output if it is a FITS file, otherwise a default header is used.
+ */
+/*----------------------------------------------------------------------------*/
+static int stream_result(int reg, char * outname, char * exp)
+{
+	qfits_header	*	fh ;
+	history			*	hs ;
+	cube_ostream	*	out ;
+	block				b ;
+	int					lx, ly, np ;
+	int					rows ;
+	int					nblocks, iblock ;
+	int					status ;
+	int					i ;
+
+	lx = operands[reg].lx ;
+	ly = operands[reg].ly ;
+	np = operands[reg].np ;
+
+	/* Output header */
+	fh = NULL ;
+	if (is_fits_file(firstName)==1) {
+		fh = qfits_header_read(firstName) ;
+		if (fh==NULL) {
+			e_error("reading header from [%s]", firstName) ;
+		}
+	}
+	if (fh==NULL) {
+		e_warning("saving cube with default (empty) header") ;
+		fh = qfits_header_default() ;
+		qfits_header_add(fh, "BSCALE", "1.0", "pixel scale factor", NULL) ;
+		qfits_header_add(fh, "BZERO",  "0.0", "pixel offset", NULL) ;
+		qfits_header_add(fh, "ECLIPSE", "1", "created by eclipse", NULL) ;
+		qfits_header_add(fh, "ORIGIN", "eclipse", "created by eclipse", NULL) ;
+	}
+	hs = history_new() ;
+	history_add(hs, "--- eclipse ccube") ;
+	history_add(hs, exp) ;
+	history_addfits(hs, fh) ;
+	history_del(hs) ;
+
+	out = cube_ostream_open(outname, fh, lx, ly, np, 0) ;
+	qfits_header_destroy(fh) ;
+	if (out==NULL) {
+		e_error("cannot create output file [%s]", outname) ;
+		return -1 ;
+	}
+
+	rows = BLOCKPIX / lx ;
+	if (rows<1) rows=1 ;
+	if (rows>ly) rows=ly ;
+	nblocks = np * ((ly + rows - 1) / rows) ;
+	e_comment(1, "computing %d block(s) of %d row(s)", nblocks, rows) ;
+
+	b.lx = lx ;
+	status = 0 ;
+	iblock = 0 ;
+	for (b.plane=0 ; b.plane<np && status==0 ; b.plane++) {
+		for (b.y0=0 ; b.y0<ly && status==0 ; b.y0+=rows) {
+			compute_status("computing", iblock, nblocks, 1) ;
+			iblock++ ;
+			b.nrows = (b.y0+rows > ly) ? ly-b.y0 : rows ;
+
+			eclipse_parallel_run(load_block, &b, noperands) ;
+			for (i=0 ; i<noperands ; i++) {
+				if (operands[i].status!=0) {
+					e_error("reading plane %d of register %d", b.plane+1, i+1) ;
+					status = -1 ;
+				}
+			}
+			if (status==0) {
+				TRACE_BEGIN("ccube/compute") ;
+				eclipse_parallel_run(run_program, &b, b.nrows) ;
+				TRACE_COUNT(TRACE_PIXELS, (double)lx * b.nrows) ;
+				TRACE_END("ccube/compute") ;
+				status = cube_ostream_put_rows(out, operands[reg].buf, b.nrows) ;
+			}
+			for (i=0 ; i<noperands ; i++) {
+				if (operands[i].buf!=NULL) {
+					free(operands[i].buf) ;
+					operands[i].buf = NULL ;
+				}
+			}
+		}
+	}
+	if (cube_ostream_close(out)!=0) status = -1 ;
+	if (status!=0) {
+		e_error("computing [%s]", outname) ;
+	}
+	return status ;
+}
+
 
 static void usage(char *pname) ;
 static char prog_desc[] = "cube computer" ;
@@ -135,7 +541,7 @@ int main(int argc, char *argv[])
 	char    *	tokenizedExp ;
 	item    *	result ;
 	int		    arithm ; 
-	history *   hs ;
+	int		    status ;
 	int		    c ;
 
     /* Initialize */
@@ -240,21 +646,16 @@ int main(int argc, char *argv[])
 		return -1 ;
 	}
 
+	status = 0 ;
 	if (result->t == number) printf("%g\n", result->v.f) ;
-	else {
-		hs = history_new();
-		history_add(hs, "--- eclipse ccube");
-		history_add(hs, saved_exp);
-		cube_save_fits_hdrcopy_wh(result->v.cubept, outname, firstName, hs) ;
-		history_del(hs);
-		cube_del(result->v.cubept) ;
-	}
+	else status = stream_result(result->v.reg, outname, saved_exp) ;
 
     /* Free and return */
+	close_operands() ;
 	free(saved_exp) ;
 	free(result) ;
 	if (debug_active()) xmemory_status() ;
-	return 0 ;
+	return status ;
 }
 
 
@@ -474,6 +875,9 @@ static itemType gettokentype(char * token)
   @return	1 pointer to a newly allocated item.
   Performs the requested operation between the two provided operands and
   returns a pointer to a newly allocated item containing the result.
+  Operations between numbers are computed immediately. Operations
+  involving cubes are checked and appended to the program; the result
+  is the register modified by the instruction.
  */
 /*----------------------------------------------------------------------------*/
 static item * applyOperator(
@@ -481,8 +885,10 @@ static item * applyOperator(
         item    *   second,
         char 	    op)
 {
-	item    *   out ;
-	int			status ;
+	item    	*   out ;
+	instruction	*	ins ;
+	operand		*	c1 ;
+	operand		*	c2 ;
 
 	if (first==NULL || second==NULL) return NULL ;
 
@@ -519,71 +925,81 @@ static item * applyOperator(
 			    free(out) ;
 			    return NULL ;
         }
-	} else if ((first->t == image) && (second->t == image)) {
+		return out ;
+	}
+
+	if (ninstructions >= MAX_OP) {
+		e_error("too many operations in expression: aborting") ;
+		free(out) ;
+		return NULL ;
+	}
+	ins = program + ninstructions ;
+	ins->op  = op ;
+	ins->src = -1 ;
+	ins->f   = 0.0 ;
+
+	if ((first->t == image) && (second->t == image)) {
         /* Two CUBES */
-		out->t = image ;
 		if (op!='+' && op!='-' && op!='*' && op!='/') {
 			e_error("operation %c is invalid between cubes", op);
 			free(out) ;
 			return NULL ;
 		}
-		/* Modify the first cube in the stack */
-		if (cube_op(&(first->v.cubept), second->v.cubept, op)!=0) {
-			e_error("error during cube arithmetic: aborting") ;
-			free(out);
+		c1 = operands + first->v.reg ;
+		c2 = operands + second->v.reg ;
+		if ((c1->lx != c2->lx) || (c1->ly != c2->ly)) {
+			e_error("incompatible size: cannot compute") ;
+			free(out) ;
 			return NULL ;
 		}
-		out->v.cubept = first->v.cubept ;
-		/* No need for the second one anymore: deallocate it */
-		cube_del(second->v.cubept) ;
+		if ((c2->np != c1->np) && (c2->np != 1)) {
+			e_error("cannot compute with these number of planes") ;
+			free(out) ;
+			return NULL ;
+		}
+		/* Modify the first cube */
+		ins->kind = INSTR_CUBE_CUBE ;
+		ins->dst  = first->v.reg ;
+		ins->src  = second->v.reg ;
 	} else if ((first->t == image) && (second->t == number)) {
 		/* A CUBE and a NUMBER */
-		out->t = image ;
-		if (op!='+' && op!='-' && op!='*' && op!='/' && op!='^') {
+		if (op!='+' && op!='-' && op!='*' && op!='/' && op!='^' &&
+			op!='l') {
 			e_error("unrecognized operation: %c", op) ;
 			free(out) ;
 			return NULL ;
 		}
-		if (cube_cst_op(first->v.cubept, second->v.f, op)!=0) {
-			e_error("error during cube arithmetic: aborting") ;
+		if ((op=='/') && (fabs(second->v.f) < 1e-10)) {
+			e_error("division by zero requested in cube/constant operation");
 			free(out) ;
 			return NULL ;
 		}
-		out->v.cubept = first->v.cubept ;
+		if ((op=='l') && ((second->v.f <= 1e-40) || (second->v.f == 1.0))) {
+			e_error("invalid logarithm base: %g", second->v.f) ;
+			free(out) ;
+			return NULL ;
+		}
+		ins->kind = INSTR_CUBE_NUMBER ;
+		ins->dst  = first->v.reg ;
+		ins->f    = second->v.f ;
 	} else if ((first->t == number) && (second->t == image)) {
 		/* a NUMBER and a CUBE */
-		out->t = image ;
-		switch(op) {
-			case '+':
-			case '*':
-			case '^':
-			status = cube_cst_op(second->v.cubept, first->v.f, op) ;
-			out->v.cubept = second->v.cubept ;
-			break ;
-
-			/* Subtraction and division need two passes */
-			case '-':
-			status =  cube_cst_op(second->v.cubept, -1, '*') ;
-			status += cube_cst_op(second->v.cubept, first->v.f, '+') ;
-			out->v.cubept = second->v.cubept ;
-			break ;
-
-			case '/':
-			status =  cube_cst_op(second->v.cubept, -1, '^') ;
-			status += cube_cst_op(second->v.cubept, first->v.f, '*') ;
-			out->v.cubept = second->v.cubept ;
-			break ;
-
-			default:
+		if (op!='+' && op!='-' && op!='*' && op!='/' && op!='^') {
 			e_error("unrecognized operation: %c", op) ;
 			free(out) ;
 			return NULL ;
 		}
+		ins->kind = INSTR_NUMBER_CUBE ;
+		ins->dst  = second->v.reg ;
+		ins->f    = first->v.f ;
 	} else {
 		e_error("type identification error: aborting") ;
 		free(out) ;
 		return NULL ;
 	}
+	ninstructions++ ;
+	out->t = image ;
+	out->v.reg = ins->dst ;
 	return out ;
 }
 
@@ -596,7 +1012,9 @@ static item * applyOperator(
   @return	1 pointer to a newly allocated item, result of the expression.
   This is the main processing function. It takes in input a character
   string containing an arithmetic expression and resolves it down to a
-  single result (if the expression is valid).
+  single result (if the expression is valid). If the result is a cube,
+  it is the register holding the result of the program (see
+  stream_result()).
   Pass a flag indicating if the give expression is in standard arithmetic
   format, in which case it will be converted to polish before resolving.
  */
@@ -661,8 +1079,8 @@ static item * ParseExpression(
 				/* Simple operands are just pushed on the polish stack */
 				pushvalue = malloc(sizeof(item)) ;
 				pushvalue->t = image ;
-				pushvalue->v.cubept = cube_load(token) ;
-				if (pushvalue->v.cubept == NULL) {
+				pushvalue->v.reg = open_operand(token) ;
+				if (pushvalue->v.reg < 0) {
 					e_error("cannot load %s: aborting", token) ;
 					return NULL ;
 				}
@@ -771,8 +1189,8 @@ static item * ParseExpression(
 				/* Simple operands are just pushed on the polish stack */
 				pushvalue = malloc(sizeof(item)) ;
 				pushvalue->t = image ;
-				pushvalue->v.cubept = cube_load(token) ;
-				if (pushvalue->v.cubept == NULL) {
+				pushvalue->v.reg = open_operand(token) ;
+				if (pushvalue->v.reg < 0) {
 					e_error("cannot load %s: aborting", token) ;
 					return NULL ;
 				}
@@ -53,6 +53,9 @@
 #define OPT_IN						5001
 #define OPT_OUT						5002
 
+#define OPT_KERNEL					6001
+#define OPT_GROW					6002
+
 /*-----------------------------------------------------------------------------
    							Private declarations	
  -----------------------------------------------------------------------------*/
@@ -78,6 +81,9 @@ int main(int argc, char *argv[])
 	char			name_out[FILENAMESZ+1] ;
 	cube_t		*	cube_in ;
 	int				status ;
+	int				kernel, grow ;
+	deadpix_index	*	idx ;
+	char			line[80] ;
 	history		*	hs ;
 
     /* Initialize */
@@ -89,6 +95,8 @@ int main(int argc, char *argv[])
 	deadpix_job		 = DEADPIX_JOB_NOJOB ;
 	name_in			 = NULL ;
 	name_out[0]		 = 0 ;
+	kernel			 = 1 ;
+	grow			 = 1 ;
 
     if (argc<2) usage(argv[0]);
 
@@ -118,6 +126,10 @@ int main(int argc, char *argv[])
 			{"in",      1, 0, OPT_IN},
 			{"out",     1, 0, OPT_OUT},
 
+			/* For 'clean' only */
+			{"kernel",  1, 0, OPT_KERNEL},
+			{"grow",    1, 0, OPT_GROW},
+
             {0, 0, 0, 0}
         } ;
         c = getopt_long(argc,
@@ -204,6 +216,12 @@ int main(int argc, char *argv[])
 			case 'o':
 			    strncpy(name_out, optarg, FILENAMESZ) ;
 			    break ;
+			case OPT_KERNEL:
+			    kernel = atoi(optarg) ;
+			    break ;
+			case OPT_GROW:
+			    grow = atoi(optarg) ;
+			    break ;
 			default:
 			    usage(argv[0]) ;
 		    	break ;
@@ -287,9 +305,16 @@ int main(int argc, char *argv[])
 			return -1 ;
 		}
 
-		e_comment(0, "replacing bad pixels...") ;
-		status = cube_clean_deadpix(cube_in, bad_pixelmap) ;
+		idx = deadpix_index_new(bad_pixelmap, kernel, grow) ;
 		pixelmap_del(bad_pixelmap) ;
+		if (idx == NULL) {
+			e_error("cannot index bad pixels: aborting") ;
+			cube_del(cube_in) ;
+			return -1 ;
+		}
+		e_comment(0, "replacing %d bad pixels...", deadpix_index_nbad(idx)) ;
+		status = cube_clean_deadpix_index(cube_in, idx) ;
+		deadpix_index_del(idx) ;
 		if (status != 0) {
 			e_error("during cleaning: aborting") ;
 			cube_del(cube_in);
@@ -302,6 +327,8 @@ int main(int argc, char *argv[])
 		history_add(hs, name_in) ;
 		history_add(hs, "bad pixel map:") ;
 		history_add(hs, pixmapname) ;
+		sprintf(line, "window half-size: %d, grown up to %d", kernel, grow) ;
+		history_add(hs, line) ;
 		cube_save_fits_hdrcopy_wh(cube_in, name_out, name_in, hs) ;
 		history_del(hs);
 		cube_del(cube_in) ;
@@ -376,6 +403,8 @@ static void usage(char *pname)
 	"\t\t--in <file> or -i <file> to specify input file name\n"
 	"\t\t--out <file> or -o <file> to specify output file name\n"
 	"\t\t(default output name for *.fits is *.cln.fits)\n"
+	"\t\t--kernel <h> half-size of the interpolation window (1)\n"
+	"\t\t--grow <m> grow the window up to <m> for clusters (1)\n"
 	"\n\n");
 	printf(
 	"-> common to both modes:\n"
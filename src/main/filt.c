@@ -128,6 +128,8 @@ int main(int argc, char *argv[])
 
 	/* Initialize eclipse environment */
 	eclipse_init();
+	/* Planes are filtered one by one: deep cubes may stay on disk */
+	cube_tiles_enable(1) ;
 
     /* Get arguments    */
     if ((argc - optind) < 1) usage(argv[0]);
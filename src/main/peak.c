@@ -22,6 +22,7 @@
 #define OPT_METHOD		            1000
 #define OPT_KAPPA		            1010
 #define OPT_SMEAR		            1011
+#define OPT_MESH		            1012
 #define OPT_SQHSZ		            1020
 
 #define OPT_FINEPOS		            1030
@@ -63,6 +64,7 @@ int main(int argc, char *argv[])
 	int		        sq_hx, sq_hy ;
 	double	        kappa ;
 	int		        smear_flag ;
+	int		        mesh ;
 	int		        fwhm_flag ;
 	int		        phot_flag ;
 	double	        phot_star, phot_int, phot_ext ;
@@ -81,6 +83,7 @@ int main(int argc, char *argv[])
 	hx 			= -1 ;
 	hy			= -1 ;
 	smear_flag	= 0 ;
+	mesh		= 0 ;
 	fwhm_flag	= 0 ;
 	fpos_flag 	= 0 ;
 	fpos_star	= DETECTED_FPOS_STAR ;
@@ -107,6 +110,7 @@ int main(int argc, char *argv[])
 			{"method",	1, 0, OPT_METHOD},
 			{"kappa",	1, 0, OPT_KAPPA},
 			{"smear",	0, 0, OPT_SMEAR},
+			{"mesh",	1, 0, OPT_MESH},
 			{"sqhsize",	1, 0, OPT_SQHSZ},
 
 			{"fpos",	1, 0, OPT_FINEPOS},
@@ -120,7 +124,7 @@ int main(int argc, char *argv[])
         } ;
         c = getopt_long(argc,
                         argv,
-                        "df:Fhk:m:P:sS:L",
+                        "df:Fhk:m:M:P:sS:L",
                         long_options,
                         &option_index) ;
         if (c==-1) break ;
@@ -167,6 +171,14 @@ int main(int argc, char *argv[])
 			case OPT_SMEAR:
 			case 's':
                 smear_flag=1 ;
+                break ;
+			case OPT_MESH:
+			case 'M':
+                ret = sscanf(optarg, "%d", &mesh);
+                if (ret!=1 || mesh<0) {
+                    e_error("-M/--mesh expects 1 positive argument");
+                    return -1 ;
+                }
                 break ;
 			case OPT_SQHSZ:
 			case 'S':
@@ -232,7 +244,8 @@ int main(int argc, char *argv[])
             det = NULL ;
 			switch(detect_method) {
 				case DETECT_WITH_KAPPASIGMA:
-                    det = detected_ks_engine(c_in->plane[p], kappa, smear_flag);
+                    det = detected_tile_engine(c_in->plane[p], kappa,
+                                               smear_flag, mesh);
                     break ;
 				case DETECT_WITH_SQUARES:
                     det = detected_sq_engine(c_in->plane[p], hx, hy) ;
@@ -305,6 +318,7 @@ static void usage(char * pname)
 	"\n"
 	"\t-m (--method) clip        Use kappa-sigma clipping\n"
 	"\t-k (--kappa) value        Set value for kappa-sigma clipping\n"
+	"\t-M (--mesh) size          Set background mesh size (0: none)\n"
 	"\n"
 	"\t-m (--method) squares     Use squares method (experimental)\n"
 	"\t-S (--sqhsize) size       Set square size\n"
@@ -42,6 +42,7 @@
 #define OPT_MAGNITUDE		1003
 #define OPT_RADIUS			1004
 #define OPT_CATALOGS		1005
+#define OPT_FILE			1006
 
 #define OPT_KEYS			2001
 
@@ -126,6 +127,7 @@ int main(int argc, char *argv[])
             {"mag", 	1, 0, OPT_MAGNITUDE},
             {"radius", 	1, 0, OPT_RADIUS},
             {"cat", 	1, 0, OPT_CATALOGS},
+            {"file", 	1, 0, OPT_FILE},
 			{"key",     0, 0, OPT_KEYS}, 
 
             {0, 0, 0, 0}
@@ -133,7 +135,7 @@ int main(int argc, char *argv[])
         } ;
         c = getopt_long(argc,
                         argv,
-                        "c:km:n:p:r:",
+                        "c:f:km:n:p:r:",
                         long_options,
                         &option_index) ;
         if (c==-1) break ;
@@ -197,6 +199,16 @@ int main(int argc, char *argv[])
 			case 'c':
                 if (irstd_setactive(optarg)==-1) return -1 ;
                 catalog_sel=1 ;
+                break ;
+			case OPT_FILE:
+			case 'f':
+                if (catalog_sel) {
+                    e_error("-f/--file must be given before -c/--cat") ;
+                    return -1 ;
+                }
+                if (irstd_load_catalog(optarg)==-1) return -1 ;
+                irstd_setactive("none");
+                catalog_names = irstd_catalog_names();
                 break ;
             default:
                 usage(argv[0]) ;
@@ -304,6 +316,9 @@ static void usage(char * pname)
 	"Catalogs to be searched (default is all catalogs)\n"
 	"\t-c <name1> -c <name2> ... -c <namei>\n"
 	"\n"
+	"Binary catalog file to search (default is internal database)\n"
+	"\t-f or --file <filename> given before any -c option\n"
+	"\n"
 	);
 
 	printf("Supported catalogs are:\n\n");
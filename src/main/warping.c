@@ -39,6 +39,7 @@
 
 #define OPT_POLY_U			2010
 #define OPT_POLY_V			2020
+#define OPT_WARP_MAP		2030
 
 #define OPT_KERNEL_SET		3000
 #define OPT_KERNEL_WRITE	3010
@@ -74,6 +75,8 @@ int main(int argc, char *argv[])
 	/* Following are for polynomial transforms */
 	poly2d	*	poly_u;			/* polynomial definition */
 	poly2d	*	poly_v;			/* polynomial definition */
+	char	*	map_name ;		/* distortion map cache file */
+	warp_map *	map ;
 	
 	/* Following are for the interpolation kernel settings */
 	char		kernel_name[32] ;
@@ -108,6 +111,7 @@ int main(int argc, char *argv[])
 
 	poly_u = NULL ;
 	poly_v = NULL ;
+	map_name = NULL ;
 	
     while (1) {
         int     option_index = 0 ;
@@ -124,6 +128,7 @@ int main(int argc, char *argv[])
 
             {"polyu",		1, 0, OPT_POLY_U},
             {"polyv",		1, 0, OPT_POLY_V},
+            {"map",			1, 0, OPT_WARP_MAP},
 
 			{"arcfile",		1, 0, OPT_CORRECTARC},
 			{"sttrfile", 	1, 0, OPT_CORRECTSTTR},
@@ -250,6 +255,9 @@ int main(int argc, char *argv[])
                     poly_u = poly2d_build_from_string("1 0 1.0") ;
                 }
                 tr_polynomial = 1 ;
+                break ;
+			case OPT_WARP_MAP:
+                map_name = optarg ;
                 break ;
             /* Kernel set/write */
 			case OPT_KERNEL_SET:
@@ -406,7 +414,15 @@ int main(int argc, char *argv[])
 		}
 	} else {
 		/* Polynomial transformation */
-		warped = image_warp_generic(in, kernel_name, poly_u, poly_v);
+		if (map_name!=NULL) {
+			/* Reuse the distortion map computed by a previous run */
+			map = warp_map_cached(map_name, in->lx, in->ly, kernel_name,
+								  poly_u, poly_v);
+			warped = warp_map_apply(map, in);
+			warp_map_del(map);
+		} else {
+			warped = image_warp_generic(in, kernel_name, poly_u, poly_v);
+		}
 	}
 
 	if (poly_u!=NULL) poly2d_free(poly_u);
@@ -461,6 +477,8 @@ static void usage(char * pname)
 		"\twhere file.tfits contains the startrace deformation\n"
 		"\t-A / --arcfile file.tfits\n"
 		"\twhere file.tfits contains the arc deformation\n"
+		"\t--map file\n"
+		"\twhere file caches the distortion map between runs\n"
 		"\n");
 	printf(
 		"---------- kernel\n"
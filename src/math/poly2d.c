@@ -74,6 +74,13 @@ double poly2d_compute(
   z[i] = p(x[i], y[i])
   \end{verbatim}
 
+  The coefficients are first gathered into a dense table indexed by
+  the powers of x and y, and every point is then computed with a
+  Horner scheme in x nested in a Horner scheme in y. This costs
+  (dx+1).(dy+1) multiply-adds per point, where dx and dy are the
+  highest powers of x and y, and no call to ipow(). Polynomials with
+  negative powers are computed term by term.
+
   If anything goes wrong during the computation, this function returns
   -1.
  */
@@ -85,20 +92,56 @@ int poly2d_compute_array(
 		double	*	z,
 		int			n)
 {
-	register int	i, j ;
-	register double	x0, y0, z0;
+	double	*	a ;
+	double	*	ay ;
+	double		x0, y0, z0, zx ;
+	int			dx, dy ;
+	int			i, j, k ;
+
+	if ((p==NULL) || (x==NULL) || (y==NULL) || (z==NULL) || (n<1)) return -1 ;
 
-	if ((x==NULL) || (y==NULL) || (z==NULL) || (n<1)) return -1 ;
+	/* Find out the highest powers */
+	dx = dy = 0 ;
+	for (i=0 ; i<p->nc ; i++) {
+		if ((p->px[i]<0) || (p->py[i]<0)) break ;
+		if (p->px[i]>dx) dx = p->px[i] ;
+		if (p->py[i]>dy) dy = p->py[i] ;
+	}
+	if (i<p->nc) {
+		/* Negative powers: compute term by term */
+		for (j=0 ; j<n ; j++) {
+			x0 = x[j] ;
+			y0 = y[j] ;
+			z0 = 0.00 ;
+			for (i=0 ; i<p->nc ; i++) {
+				z0 += p->c[i] * ipow(x0, p->px[i]) * ipow(y0, p->py[i]) ;
+			}
+			z[j] = z0 ;
+		}
+		return 0 ;
+	}
+
+	/* Dense coefficient table: a[px + py*(dx+1)] */
+	a = calloc((dx+1)*(dy+1), sizeof(double)) ;
+	for (i=0 ; i<p->nc ; i++) {
+		a[p->px[i] + p->py[i]*(dx+1)] += p->c[i] ;
+	}
 
 	for (j=0 ; j<n ; j++) {
 		x0 = x[j] ;
 		y0 = y[j] ;
 		z0 = 0.00 ;
-		for (i=0 ; i<p->nc ; i++) {
-			z0 += p->c[i] * ipow(x0, p->px[i]) * ipow(y0, p->py[i]) ;
+		for (k=dy ; k>=0 ; k--) {
+			ay = a + k*(dx+1) ;
+			zx = ay[dx] ;
+			for (i=dx-1 ; i>=0 ; i--) {
+				zx = zx * x0 + ay[i] ;
+			}
+			z0 = z0 * y0 + zx ;
 		}
-		z[i] = z0 ;
+		z[j] = z0 ;
 	}
+	free(a) ;
 	return 0 ;
 }
 
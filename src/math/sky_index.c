@@ -0,0 +1,442 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    sky_index.c
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Spatial index for positions on the sky.
+
+   Positions are converted to unit vectors and stored in an implicit
+   kd-tree: the elements of the range [lo..hi[ are split around the
+   median element mid=(lo+hi)/2 along the axis of largest spread, and
+   both halves are split again recursively until they hold at most
+   SKY_LEAF elements. The squared chord between two unit vectors is a
+   monotonic function of their angular distance, so searches compare
+   chords and only convert the final result to degrees.
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <math.h>
+#include <string.h>
+
+#include "sky_index.h"
+#include "pi.h"
+#include "xmemory.h"
+
+/*---------------------------------------------------------------------------
+   								Defines
+ ---------------------------------------------------------------------------*/
+
+/* Maximal number of elements in a leaf of the tree */
+#define SKY_LEAF		8
+
+#define SKY_DEG2RAD		(PI_NUMB/180.0)
+
+/*---------------------------------------------------------------------------
+   								Private types
+ ---------------------------------------------------------------------------*/
+
+struct _sky_index_ {
+	/* Number of positions */
+	int					n ;
+	/* Unit vectors, 3 per position, in tree order */
+	double			*	xyz ;
+	/* Input index of every position, in tree order */
+	int				*	id ;
+	/* Split axis of the node centred on every position */
+	unsigned char	*	axis ;
+} ;
+
+/* State of a search */
+typedef struct _sky_query_ {
+	double			q[3] ;		/* Unit vector of the searched point */
+	double			r2 ;		/* Squared chord of the search radius */
+	sky_accept		accept ;
+	void		*	arg ;
+	/* Nearest search: best squared chord and index */
+	double			best2 ;
+	int				best ;
+	/* Radius search: found indices */
+	int			*	found ;
+	int				nfound ;
+	int				size ;
+} sky_query ;
+
+/*---------------------------------------------------------------------------
+   							Private functions
+ ---------------------------------------------------------------------------*/
+
+/* Unit vector of a sky position given in degrees */
+static void sky_vector(double ra, double dec, double * v)
+{
+	ra  *= SKY_DEG2RAD ;
+	dec *= SKY_DEG2RAD ;
+	v[0] = cos(dec) * cos(ra) ;
+	v[1] = cos(dec) * sin(ra) ;
+	v[2] = sin(dec) ;
+	return ;
+}
+
+/* Squared chord between unit vectors separated by an angle in degrees */
+static double sky_chord2(double angle)
+{
+	double	s ;
+
+	if (angle < 0.0) return -1.0 ;
+	if (angle >= 180.0) return 4.0 ;
+	s = sin(0.5 * angle * SKY_DEG2RAD) ;
+	return 4.0 * s * s ;
+}
+
+/* Angle in degrees between unit vectors separated by a squared chord */
+static double sky_angle(double c2)
+{
+	double	s ;
+
+	s = 0.5 * sqrt(c2) ;
+	if (s > 1.0) s = 1.0 ;
+	return 2.0 * asin(s) / SKY_DEG2RAD ;
+}
+
+/* Squared chord between a point and the k-th position of the tree */
+static double sky_dist2(sky_index * idx, int k, double * q)
+{
+	double	*	p ;
+	double		dx, dy, dz ;
+
+	p  = idx->xyz + 3*k ;
+	dx = q[0] - p[0] ;
+	dy = q[1] - p[1] ;
+	dz = q[2] - p[2] ;
+	return dx*dx + dy*dy + dz*dz ;
+}
+
+/* Exchange two positions of the tree */
+static void sky_swap(sky_index * idx, int a, int b)
+{
+	double	t[3] ;
+	int		i ;
+
+	memcpy(t, idx->xyz + 3*a, 3*sizeof(double)) ;
+	memcpy(idx->xyz + 3*a, idx->xyz + 3*b, 3*sizeof(double)) ;
+	memcpy(idx->xyz + 3*b, t, 3*sizeof(double)) ;
+	i = idx->id[a] ;
+	idx->id[a] = idx->id[b] ;
+	idx->id[b] = i ;
+	return ;
+}
+
+/* Partition [lo..hi[ around its k-th element along one axis (Wirth) */
+static void sky_select(sky_index * idx, int lo, int hi, int k, int ax)
+{
+	double	x ;
+	int		l, m, i, j ;
+
+	l = lo ;
+	m = hi-1 ;
+	while (l<m) {
+		x = idx->xyz[3*k + ax] ;
+		i = l ;
+		j = m ;
+		do {
+			while (idx->xyz[3*i + ax] < x) i++ ;
+			while (x < idx->xyz[3*j + ax]) j-- ;
+			if (i<=j) {
+				sky_swap(idx, i, j) ;
+				i++ ; j-- ;
+			}
+		} while (i<=j) ;
+		if (j<k) l=i ;
+		if (k<i) m=j ;
+	}
+	return ;
+}
+
+/* Build the tree on [lo..hi[ */
+static void sky_build(sky_index * idx, int lo, int hi)
+{
+	double	vmin[3], vmax[3] ;
+	double	*	p ;
+	int		mid, ax ;
+	int		i, a ;
+
+	if (hi-lo <= SKY_LEAF) return ;
+
+	/* Axis of largest spread */
+	for (a=0 ; a<3 ; a++) vmin[a] = vmax[a] = idx->xyz[3*lo + a] ;
+	for (i=lo+1 ; i<hi ; i++) {
+		p = idx->xyz + 3*i ;
+		for (a=0 ; a<3 ; a++) {
+			if (p[a] < vmin[a]) vmin[a] = p[a] ;
+			if (p[a] > vmax[a]) vmax[a] = p[a] ;
+		}
+	}
+	ax = 0 ;
+	for (a=1 ; a<3 ; a++) {
+		if (vmax[a]-vmin[a] > vmax[ax]-vmin[ax]) ax = a ;
+	}
+
+	mid = (lo+hi)/2 ;
+	sky_select(idx, lo, hi, mid, ax) ;
+	idx->axis[mid] = (unsigned char)ax ;
+	sky_build(idx, lo, mid) ;
+	sky_build(idx, mid+1, hi) ;
+	return ;
+}
+
+/* Nearest search: consider the k-th position of the tree */
+static void sky_nearest_check(sky_index * idx, int k, sky_query * s)
+{
+	double	d2 ;
+	int		id ;
+
+	d2 = sky_dist2(idx, k, s->q) ;
+	if (d2 > s->best2) return ;
+	id = idx->id[k] ;
+	if ((d2 == s->best2) && (s->best >= 0) && (id > s->best)) return ;
+	if ((s->accept != NULL) && !s->accept(id, s->arg)) return ;
+	s->best2 = d2 ;
+	s->best  = id ;
+	return ;
+}
+
+/* Nearest search in [lo..hi[ */
+static void sky_nearest_node(sky_index * idx, int lo, int hi, sky_query * s)
+{
+	double	d ;
+	int		mid, i ;
+
+	if (hi-lo <= SKY_LEAF) {
+		for (i=lo ; i<hi ; i++) sky_nearest_check(idx, i, s) ;
+		return ;
+	}
+	mid = (lo+hi)/2 ;
+	sky_nearest_check(idx, mid, s) ;
+	d = s->q[idx->axis[mid]] - idx->xyz[3*mid + idx->axis[mid]] ;
+	if (d < 0) {
+		sky_nearest_node(idx, lo, mid, s) ;
+		if (d*d <= s->best2) sky_nearest_node(idx, mid+1, hi, s) ;
+	} else {
+		sky_nearest_node(idx, mid+1, hi, s) ;
+		if (d*d <= s->best2) sky_nearest_node(idx, lo, mid, s) ;
+	}
+	return ;
+}
+
+/* Radius search: consider the k-th position of the tree */
+static void sky_search_check(sky_index * idx, int k, sky_query * s)
+{
+	int		id ;
+
+	if (sky_dist2(idx, k, s->q) > s->r2) return ;
+	id = idx->id[k] ;
+	if ((s->accept != NULL) && !s->accept(id, s->arg)) return ;
+	if (s->nfound == s->size) {
+		s->size  = (s->size < 16) ? 16 : 2*s->size ;
+		s->found = realloc(s->found, s->size * sizeof(int)) ;
+	}
+	s->found[s->nfound++] = id ;
+	return ;
+}
+
+/* Radius search in [lo..hi[ */
+static void sky_search_node(sky_index * idx, int lo, int hi, sky_query * s)
+{
+	double	d ;
+	int		mid, i ;
+
+	if (hi-lo <= SKY_LEAF) {
+		for (i=lo ; i<hi ; i++) sky_search_check(idx, i, s) ;
+		return ;
+	}
+	mid = (lo+hi)/2 ;
+	sky_search_check(idx, mid, s) ;
+	d = s->q[idx->axis[mid]] - idx->xyz[3*mid + idx->axis[mid]] ;
+	if ((d < 0) || (d*d <= s->r2)) sky_search_node(idx, lo, mid, s) ;
+	if ((d >= 0) || (d*d <= s->r2)) sky_search_node(idx, mid+1, hi, s) ;
+	return ;
+}
+
+/* Compare two ints for qsort() */
+static int sky_cmp_int(const void * a, const void * b)
+{
+	return *(const int*)a - *(const int*)b ;
+}
+
+/*---------------------------------------------------------------------------
+  							Function codes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Great-circle distance between two sky positions.
+  @param    ra1     Right ascension of the first position in degrees.
+  @param    dec1    Declination of the first position in degrees.
+  @param    ra2     Right ascension of the second position in degrees.
+  @param    dec2    Declination of the second position in degrees.
+  @return   double distance in degrees.
+
+  The haversine formula is used, which is accurate for small distances.
+ */
+/*--------------------------------------------------------------------------*/
+double sky_distance(double ra1, double dec1, double ra2, double dec2)
+{
+	double	sd, sr, a ;
+
+	sd = sin(0.5 * (dec2-dec1) * SKY_DEG2RAD) ;
+	sr = sin(0.5 * (ra2-ra1) * SKY_DEG2RAD) ;
+	a  = sd*sd + cos(dec1*SKY_DEG2RAD) * cos(dec2*SKY_DEG2RAD) * sr*sr ;
+	if (a > 1.0) a = 1.0 ;
+	return 2.0 * asin(sqrt(a)) / SKY_DEG2RAD ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Build a sky index.
+  @param    ra      Right ascensions in degrees.
+  @param    dec     Declinations in degrees.
+  @param    n       Number of positions.
+  @return   1 newly allocated sky_index, NULL in case of error.
+
+  Positions are identified in searches by their index in the input
+  arrays, which are not referenced by the index once it is built.
+  The returned index must be deallocated using sky_index_del().
+ */
+/*--------------------------------------------------------------------------*/
+sky_index * sky_index_new(const double * ra, const double * dec, int n)
+{
+	sky_index	*	idx ;
+	int				i ;
+
+	if ((ra==NULL) || (dec==NULL) || (n<0)) return NULL ;
+
+	idx = malloc(sizeof(sky_index)) ;
+	idx->n    = n ;
+	idx->xyz  = malloc((3*n+1) * sizeof(double)) ;
+	idx->id   = malloc((n+1) * sizeof(int)) ;
+	idx->axis = calloc(n+1, 1) ;
+	for (i=0 ; i<n ; i++) {
+		sky_vector(ra[i], dec[i], idx->xyz + 3*i) ;
+		idx->id[i] = i ;
+	}
+	sky_build(idx, 0, n) ;
+	return idx ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate a sky index.
+  @param    idx     Index to deallocate.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void sky_index_del(sky_index * idx)
+{
+	if (idx==NULL) return ;
+	free(idx->xyz) ;
+	free(idx->id) ;
+	free(idx->axis) ;
+	free(idx) ;
+	return ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find the nearest position to a point.
+  @param    idx     Sky index.
+  @param    ra      Right ascension of the point in degrees.
+  @param    dec     Declination of the point in degrees.
+  @param    radius  Maximal distance in degrees.
+  @param    accept  Position filter, or NULL to accept all positions.
+  @param    arg     Opaque argument passed to the filter.
+  @param    dist    Returned distance in degrees, or NULL.
+  @return   int index of the nearest position, -1 if none was found.
+
+  Only positions accepted by the filter and not further than radius
+  from the point are considered. Among positions at the same distance,
+  the one with the lowest index is returned.
+ */
+/*--------------------------------------------------------------------------*/
+int sky_index_nearest(
+		sky_index	*	idx,
+		double			ra,
+		double			dec,
+		double			radius,
+		sky_accept		accept,
+		void		*	arg,
+		double		*	dist)
+{
+	sky_query	s ;
+
+	if (idx==NULL) return -1 ;
+	sky_vector(ra, dec, s.q) ;
+	s.accept = accept ;
+	s.arg    = arg ;
+	s.best2  = sky_chord2(radius) ;
+	s.best   = -1 ;
+	if (s.best2 < 0) return -1 ;
+
+	sky_nearest_node(idx, 0, idx->n, &s) ;
+	if ((s.best >= 0) && (dist != NULL)) *dist = sky_angle(s.best2) ;
+	return s.best ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find all positions within a radius of a point.
+  @param    idx     Sky index.
+  @param    ra      Right ascension of the point in degrees.
+  @param    dec     Declination of the point in degrees.
+  @param    radius  Search radius in degrees.
+  @param    accept  Position filter, or NULL to accept all positions.
+  @param    arg     Opaque argument passed to the filter.
+  @param    nfound  Returned number of positions found.
+  @return   Newly allocated array of indices, NULL if none was found.
+
+  The returned indices are sorted in increasing order. The array must
+  be deallocated using free().
+ */
+/*--------------------------------------------------------------------------*/
+int * sky_index_search(
+		sky_index	*	idx,
+		double			ra,
+		double			dec,
+		double			radius,
+		sky_accept		accept,
+		void		*	arg,
+		int			*	nfound)
+{
+	sky_query	s ;
+
+	if (nfound!=NULL) *nfound = 0 ;
+	if ((idx==NULL) || (nfound==NULL)) return NULL ;
+	sky_vector(ra, dec, s.q) ;
+	s.accept = accept ;
+	s.arg    = arg ;
+	s.r2     = sky_chord2(radius) ;
+	s.found  = NULL ;
+	s.nfound = 0 ;
+	s.size   = 0 ;
+	if (s.r2 < 0) return NULL ;
+
+	sky_search_node(idx, 0, idx->n, &s) ;
+	if (s.nfound < 1) {
+		free(s.found) ;
+		return NULL ;
+	}
+	qsort(s.found, s.nfound, sizeof(int), sky_cmp_int) ;
+	*nfound = s.nfound ;
+	return s.found ;
+}
+/* vim: set ts=4 et sw=4 tw=75 */
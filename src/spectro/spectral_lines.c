@@ -373,20 +373,8 @@ double * spectral_table_build_signal(
         const int              size,
         int                  * found)
 {
-    double         wl_high;
-
-    /* Represent each line as a gaussian with sigma = slit_width/4 */
-    const double sigma  = slit_width * SLITWIDTH_TO_SIGMA;
-    double f1, f2;
-
-    double * smooth ;
-
-    const int gwidth = 6*sigma; /* cut-off below exp(-6*6/2) */
-    int i, ii;
-    int j       = 0;
-    int lines   = 0;
-    int ilines;
-
+    spectral_model * model ;
+    double         * smooth ;
 
     *found = 0;
 
@@ -395,18 +383,132 @@ double * spectral_table_build_signal(
         return NULL;
     }
 
+    model  = spectral_model_new(spt, order, slit_width);
+    smooth = malloc(size * sizeof(double));
+    *found = spectral_model_signal(model, disprel, size, smooth);
+    spectral_model_del(model);
+
+    if (*found < 1) {
+        e_warning("No emission lines with disprel [%g %g %g %g] (%d)",
+                disprel[0], disprel[1], disprel[2], disprel[3], spt->nlines);
+        free(smooth);
+        return NULL;
+    }
+
+    if (debug_active() > 2) e_comment(2,
+        "emission lines with disprel [%g %g %g %g] placed in %d samples",
+             disprel[0], disprel[1], disprel[2], disprel[3], *found);
+
+    return smooth ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Build a line model from a spectral table
+  @param    spt         Spectral table to use.
+  @param    order       Order used in the spectral table look-up
+  @param    slit_width  Width in pixels of the slit used
+  @return   1 newly allocated spectral_model, or NULL on error.
+
+  The returned object must be deallocated with spectral_model_del().
+ */
+/*--------------------------------------------------------------------------*/
+spectral_model * spectral_model_new(
+        const spectral_table  *   spt,
+        const int                 order,
+        const double              slit_width)
+{
+    spectral_model * model ;
+    /* Represent each line as a gaussian with sigma = slit_width/4 */
+    const double     sigma  = slit_width * SLITWIDTH_TO_SIGMA;
+    double           f1 ;
+    int              i ;
+
+    if (spt == NULL || slit_width <= 0) return NULL ;
+
+    model = malloc(sizeof(spectral_model));
+    model->wavel  = malloc((spt->nlines+1) * sizeof(double));
+    model->intens = malloc((spt->nlines+1) * sizeof(double));
+    model->gwidth = 6*sigma; /* cut-off below exp(-6*6/2) */
+
     /* Prepare the Gaussian smoothing */
     f1 = 1   /(sigma*sqrt(2*4*atan(1)));
-    f2 = -0.5/(sigma*sigma);
+    model->f2    = -0.5/(sigma*sigma);
+    model->ratio = exp(2*model->f2);
+
+    /* Keep only lines which contribute to the signal */
+    model->nlines = 0 ;
+    for (i=0 ; i<spt->nlines ; i++) {
+        if ((spt->lines[i]).intens > 0) {
+            model->wavel[model->nlines]  = order * (spt->lines[i]).wavel ;
+            model->intens[model->nlines] = f1 * (spt->lines[i]).intens ;
+            model->nlines++ ;
+        }
+    }
+    return model ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate a line model
+  @param    model   Line model to deallocate.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void spectral_model_del(spectral_model * model)
+{
+    if (model == NULL) return ;
+    free(model->wavel);
+    free(model->intens);
+    free(model);
+    return ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Build a 1d signal from a line model
+  @param    model       Line model.
+  @param    disprel     4 coeffs of the wavelength calibration polynomial
+  @param    size        Size of the signal to generate.
+  @param    smooth      Output signal of 'size' doubles.
+  @return   the number of non-zero samples in the signal.
+
+  Same as spectral_table_build_signal(), writing to a buffer provided
+  by the caller. The first line in range is found by bisection, and
+  the Gaussian profile of each line is evaluated incrementally, with
+  two calls to exp() per line. This function prints no message and can
+  be called from several threads at the same time.
+ */
+/*--------------------------------------------------------------------------*/
+int spectral_model_signal(
+        const spectral_model  *   model,
+        const double          *   disprel,
+        const int                 size,
+        double                *   smooth)
+{
+    const int      gwidth = model->gwidth ;
+    const double   f2     = model->f2 ;
+    double         wl_high;
+    double         g, r ;
+    int            i, ii;
+    int            j, jhi;
+    int            found   = 0;
+    int            ilines;
 
-    smooth = calloc(size, sizeof(double));
+    for (i=0 ; i<size ; i++) smooth[i] = 0.0 ;
 
     wl_high = WAVELEN(disprel, 0.5 - gwidth);
     /* At this point wl_high is the highest wavelength
        _not_ relevant for the first sample, namely WAVELEN(0.5 - gwidth) */
 
     /* Find first emission line in range */
-    while (j < spt->nlines && order * (spt->lines[j]).wavel < wl_high) j++ ;
+    j   = 0 ;
+    jhi = model->nlines ;
+    while (j < jhi) {
+        ii = (j + jhi) / 2 ;
+        if (model->wavel[ii] < wl_high) j = ii + 1 ;
+        else                            jhi = ii ;
+    }
 
     /* Build up a signal from the list of lines */
     for (i=0-gwidth ; i<size+gwidth ; i++) {
@@ -416,7 +518,7 @@ double * spectral_table_build_signal(
         const int istart = i - gwidth < 0     ? 0      : i - gwidth;
         const int istop  = i + gwidth >= size ? size-1 : i + gwidth;
 
-        if (j == spt->nlines) break;
+        if (j == model->nlines) break;
 
         wl_high = WAVELEN(disprel, i+1 + 0.5);
 
@@ -424,48 +526,46 @@ double * spectral_table_build_signal(
            from p(x-0.5) to p(x+0.5) */
 
         ilines = 0;
-        while (j < spt->nlines && order * (spt->lines[j]).wavel < wl_high) {
-          if ((spt->lines[j]).intens > 0) {
-            const double intens = f1 * (spt->lines[j]).intens;
+        while (j < model->nlines && model->wavel[j] < wl_high) {
+            const double intens = model->intens[j];
             /* Assume a first order dispersion relation between neighbouring
                pixel boundaries - the error is less than 1e-5 pixel ...
                isub == 0 means the line is in the center */
-            const double isub   = 0.5 - (order * (spt->lines[j]).wavel - wl_low)
+            const double isub   = 0.5 - (model->wavel[j] - wl_low)
                                       / (wl_high - wl_low);
             /* Evaluate the Gaussian at a location with sub-pixel precision */
             double xsub = istart - i + isub;
 
             ilines++;
 
-            /* Apply the gaussian filter */
-            for (ii=istart ; ii<=istop ; ii++) {
-                smooth[ii] += intens*exp(xsub*xsub*f2);
-                xsub++;
+            /* Apply the gaussian filter: exp((x+1)^2*f2) is obtained from
+               exp(x^2*f2) by a factor exp((2x+1)*f2), which itself
+               changes by exp(2*f2) from one sample to the next */
+            g = exp(xsub*xsub*f2);
+            if (g > 0) {
+                r = exp((2*xsub+1)*f2);
+                for (ii=istart ; ii<=istop ; ii++) {
+                    smooth[ii] += intens*g;
+                    g *= r;
+                    r *= model->ratio;
+                }
+            } else {
+                for (ii=istart ; ii<=istop ; ii++) {
+                    smooth[ii] += intens*exp(xsub*xsub*f2);
+                    xsub++;
+                }
             }
-          }
-          j++ ;
+            j++ ;
         }
-        lines += ilines;
-        if (ilines) (*found)++;
-    }
-
-    if (*found < 1) {
-        e_warning("No emission lines with disprel [%g %g %g %g] (%d)",
-                disprel[0], disprel[1], disprel[2], disprel[3], spt->nlines);
-        free(smooth);
-        return NULL;
+        if (ilines) found++;
     }
 
-    if (debug_active() > 2) e_comment(2,
-        "%d emission lines with disprel [%g %g %g %g] placed in %d samples",
-             lines, disprel[0], disprel[1], disprel[2], disprel[3], *found);
-
     /* Put less weight on the intensity by taking the logarithm 
        - add 1 to ensure continuity around zero */
     for (i=0 ; i<size ; i++) if (smooth[i] > 0)
         smooth[i] = log(1 + smooth[i]);
 
-    return smooth ;
+    return found ;
 }
 
 /*-------------------------------------------------------------------------*/
@@ -93,6 +93,61 @@ struct bound {
     int    steps; /* Number of steps in the search  */
 };
 
+/* Number of candidates refined together in pruning mode */
+#define WAVECAL_PRUNE_BATCH         16
+
+/* One step of the sub-pixel search around a candidate */
+typedef struct _wavecal_sub_ {
+    double c0;     /* The constant term of the polynomial */
+    double xcorr;  /* The cross-correlation */
+    double fdelta; /* The correlation delay */
+    int    ok;     /* Set if the signal contains lines */
+} wavecal_sub;
+
+/* One candidate of the search grid */
+typedef struct _wavecal_cand_ {
+    int    i1, i2, i3;  /* The position in the grid */
+    int    mwidth;      /* The biggest allowed correlation delay */
+    double pdelta;      /* The expected delay used for the candidate */
+    double cdelta_in;   /* The delay of the previous candidate */
+    double cdelta;      /* The delay found, or cdelta_in if no signal */
+    double xcorr;       /* The cross-correlation */
+    int    ok;          /* Set if the signal contains lines */
+    int    n_lines;     /* The number of non-zero samples in the signal */
+    double poly[CALIB_COEFFS]; /* The candidate shifted by pdelta */
+    double corr0;       /* The correction of the constant term */
+    double corr3;       /* The correction of the 3rd degree coefficient */
+    int    refined;     /* Set once the sub-pixel search is done */
+    double shifted[3];  /* Coefficients 1 to 3 after the sub-pixel search */
+    double delta_wl;    /* The offset due to the correlation delay */
+} wavecal_cand;
+
+/* A candidate ranked by its cross-correlation */
+typedef struct _wavecal_rank_ {
+    double xcorr;
+    int    k;
+} wavecal_rank;
+
+/* A search over the candidate grid, shared by the worker threads */
+typedef struct _wavecal_job_ {
+    spectral_model     * model;
+    const pixelvalue   * line_i;
+    const double       * pm;
+    const struct bound * bounds;
+    int                  npix, rpix, dpix, discard_le;
+    double               step[CALIB_COEFFS];
+    wavecal_cand       * cand;   /* The candidates in search order */
+    int                  ncand;
+    int                * row;    /* The first candidate of each i1 row */
+    wavecal_sub        * sub;    /* bounds[0].steps steps per candidate */
+    int                * batch;  /* The candidates to refine */
+    double            ** dbuf;   /* Per-worker scratch signals */
+    pixelvalue        ** pbuf;
+} wavecal_job;
+
+/* Coarse-to-fine pruning of the sub-pixel search */
+static int wavecal_prune = 0 ;
+
 /*-----------------------------------------------------------------------------
                                    Function prototypes
  -----------------------------------------------------------------------------*/
@@ -107,6 +162,13 @@ static double * wavecal_search(spectral_table *, pixelvalue *, int, int,
    const int, const int, const int, const double, const int,
    const double *, const double, struct bound *,double *);
 static void wave_shift(double *, const double);
+static int wavecal_signal(wavecal_job *, const double *, int, int *);
+static void wavecal_coarse(wavecal_job *, int, double, double, int);
+static void wavecal_row_task(void *, int, int);
+static void wavecal_refine_task(void *, int, int);
+static int wavecal_refine(wavecal_job *, int);
+static int wavecal_cmp_rank(const void *, const void *);
+static int wavecal_prune_refine(wavecal_job *, double, const double);
 
 /*-----------------------------------------------------------------------------
                                 Function codes
@@ -717,6 +779,306 @@ computed_disprel * spectro_compute_disprel(
     return solution ;
 }
 
+/*----------------------------------------------------------------------------*/
+/**
+  @brief  Set the coarse-to-fine pruning mode of the wavelength search
+  @param  flag  1 to prune, 0 for an exhaustive search (default)
+  @return void
+
+  The search for a dispersion relation evaluates a grid of candidate
+  polynomials, then refines the offset of every candidate whose
+  cross-correlation is close enough to the best refined solution found
+  before it in the grid. The result does not depend on the number of
+  threads.
+
+  In pruning mode, candidates are refined by decreasing cross-correlation
+  instead, so that a good solution is found early and most candidates
+  need not be refined. This gives the same solution whenever the best
+  candidates before and after refinement are the same ones, which is the
+  case for well-exposed arcs, but is not guaranteed.
+ */
+/*----------------------------------------------------------------------------*/
+void spectro_set_wavecal_pruning(int flag)
+{
+    wavecal_prune = flag ? 1 : 0 ;
+    return ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief  Build the signal of a candidate in the scratch buffers of a worker
+  @param  job      The search
+  @param  poly     Candidate polynomial
+  @param  worker   Worker index
+  @param  n_lines  Number of non-zero samples in the signal
+  @return 0 if the signal contains lines, -1 otherwise
+*/
+/*----------------------------------------------------------------------------*/
+static int wavecal_signal(
+        wavecal_job     *   job,
+        const double    *   poly,
+        int                 worker,
+        int             *   n_lines)
+{
+    double      *   d_t    = job->dbuf[worker] ;
+    pixelvalue  *   line_t = job->pbuf[worker] ;
+    int             i ;
+
+    *n_lines = spectral_model_signal(job->model, poly, job->rpix, d_t);
+    if (*n_lines < 1) return -1 ;
+    for (i=0 ; i<job->rpix ; i++) line_t[i] = (pixelvalue)d_t[i] ;
+    return 0 ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief  Evaluate one candidate of the search grid
+  @param  job      The search
+  @param  k        Candidate index
+  @param  pdelta   Expected delay before this candidate
+  @param  cdelta   Delay found for the previous candidate
+  @param  worker   Worker index
+
+  The candidate polynomial is shifted by the expected delay pdelta+cdelta
+  and cross-correlated with the observed spectrum. The result only
+  depends on the candidate and on the two delays.
+*/
+/*----------------------------------------------------------------------------*/
+static void wavecal_coarse(
+        wavecal_job     *   job,
+        int                 k,
+        double              pdelta,
+        double              cdelta,
+        int                 worker)
+{
+    wavecal_cand        *   c      = job->cand + k ;
+    const double        *   pm     = job->pm ;
+    const struct bound  *   bounds = job->bounds ;
+    const int               npix   = job->npix ;
+    double                  corr1, corr2 ;
+    double                  delta ;
+
+    /* The expected correlation delay caused by the difference
+       between the physical model and the candidate */
+    c->cdelta_in = cdelta ;
+    c->pdelta    = pdelta + cdelta ;
+
+    /* Remove some rounding errors */
+    corr1 = bounds[1].min + c->i1 * job->step[1];
+    if (fabs(corr1) < FLT_EPSILON * job->step[1]) corr1 = 0;
+
+    corr2 = bounds[2].min + c->i2 * job->step[2];
+    if (fabs(corr2) < FLT_EPSILON * job->step[2]) corr2 = 0;
+
+    c->corr3 = bounds[3].min + c->i3 * job->step[3];
+    if (fabs(c->corr3) < FLT_EPSILON * job->step[3]) c->corr3 = 0;
+
+    c->poly[3] = c->corr3 * pm[3];
+    c->poly[2] = corr2 * pm[2];
+    c->poly[1] = corr1 * pm[1];
+
+    /* The constant term of the candidate polynomial is shifted
+       so the central wavelength (at 0.5*(1+npix)) is unchanged
+       This shift should really be implemented as something like
+       WAVELEN(ddisprel, 0.5*(1+npix)) - ddisprel[0] */
+    c->corr0 = 0.5*(1+npix) * ( pm[1] - c->poly[1]
+             + 0.5*(1+npix) * ( pm[2] - c->poly[2]
+             + 0.5*(1+npix) * ( pm[3] - c->poly[3])));
+
+    c->corr0 += bounds[0].min; /* Add global offset */
+
+    c->poly[0] = pm[0] + c->corr0;
+
+    /* Transform the polynomial according to the delta-shift
+       - the subsequent delta should not not exceed +1 / -1 */
+    wave_shift(c->poly, c->pdelta);
+
+    /* Candidate polynomial now generated */
+    c->ok     = 0 ;
+    c->cdelta = cdelta ;
+    if (wavecal_signal(job, c->poly, worker, &(c->n_lines))) return ;
+
+    c->xcorr = function1d_xcorrelate(
+            &(job->pbuf[worker][job->discard_le]), job->dpix,
+            (pixelvalue*)&(job->line_i[job->discard_le]), job->dpix,
+            c->mwidth, &delta);
+    c->cdelta = delta ;
+    c->ok     = 1 ;
+    return ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief  Evaluate the candidates of one row of the search grid
+  @param  arg      The search
+  @param  row      Row index (i1)
+  @param  worker   Worker index
+
+  Rows are evaluated speculatively, as if no delay was carried over from
+  the previous row. wavecal_search() checks the guess afterwards.
+*/
+/*----------------------------------------------------------------------------*/
+static void wavecal_row_task(void * arg, int row, int worker)
+{
+    wavecal_job     *   job = (wavecal_job*)arg ;
+    double              pdelta = 0 ;
+    double              cdelta = 0 ;
+    int                 k ;
+
+    for (k=job->row[row] ; k<job->row[row+1] ; k++) {
+        wavecal_coarse(job, k, pdelta, cdelta, worker);
+        pdelta = job->cand[k].pdelta ;
+        cdelta = job->cand[k].cdelta ;
+    }
+    return ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief  Sub-pixel search around one candidate
+  @param  arg      The search
+  @param  b        Index in the current batch
+  @param  worker   Worker index
+*/
+/*----------------------------------------------------------------------------*/
+static void wavecal_refine_task(void * arg, int b, int worker)
+{
+    wavecal_job     *   job  = (wavecal_job*)arg ;
+    const int           k    = job->batch[b] ;
+    wavecal_cand    *   c    = job->cand + k ;
+    const int           nsub = job->bounds[0].steps ;
+    wavecal_sub     *   sub  = job->sub + k * nsub ;
+    double              cand[CALIB_COEFFS] ;
+    double              substep ;
+    int                 n_lines ;
+    int                 i0 ;
+
+    cand[0] = c->poly[0];
+    cand[1] = c->poly[1];
+    cand[2] = c->poly[2];
+    cand[3] = c->poly[3];
+
+    /* Transform the polynomial according to the delta-shift
+       - the subsequent delta should not not exceed +1 / -1 */
+    wave_shift(cand, c->cdelta);
+    c->shifted[0] = cand[1];
+    c->shifted[1] = cand[2];
+    c->shifted[2] = cand[3];
+
+    /* delta_wl is the offset due to the correlation delay */
+    c->delta_wl = cand[0] - (job->pm[0] + c->corr0);
+
+    /* The candidate polynomial is shifted
+       so the central wavelength (at 0.5*(1+npix)) is unchanged */
+    substep = WAVEDLT(cand, 0.5*(1+job->npix));
+    cand[0] -= 0.5 * substep;
+
+    substep *= job->step[0];
+
+    for (i0 = 0; i0 < nsub; i0++) {
+        cand[0] += substep;
+        sub[i0].c0 = cand[0] ;
+        sub[i0].ok = 0 ;
+        if (wavecal_signal(job, cand, worker, &n_lines)) continue ;
+        sub[i0].xcorr = function1d_xcorrelate(
+                &(job->pbuf[worker][job->discard_le]), job->dpix,
+                (pixelvalue*)&(job->line_i[job->discard_le]), job->dpix,
+                2, &(sub[i0].fdelta));
+        sub[i0].ok = 1 ;
+    }
+    c->refined = 1 ;
+    return ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief  Sub-pixel search around a batch of candidates, in parallel
+  @param  job      The search
+  @param  nbatch   Number of candidates in job->batch
+  @return int number of signals built
+*/
+/*----------------------------------------------------------------------------*/
+static int wavecal_refine(wavecal_job * job, int nbatch)
+{
+    if (nbatch < 1) return 0 ;
+    eclipse_parallel_run(wavecal_refine_task, job, nbatch);
+    return 5 * nbatch * job->bounds[0].steps ;
+}
+
+/* Order candidates by decreasing cross-correlation, then grid order */
+static int wavecal_cmp_rank(const void * a, const void * b)
+{
+    const wavecal_rank * ra = (const wavecal_rank *)a ;
+    const wavecal_rank * rb = (const wavecal_rank *)b ;
+
+    if (ra->xcorr > rb->xcorr) return -1 ;
+    if (ra->xcorr < rb->xcorr) return  1 ;
+    return ra->k - rb->k ;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+  @brief  Choose and refine candidates for the coarse-to-fine pruning mode
+  @param  job      The search
+  @param  xmax     Best cross-correlation before the search
+  @param  sublim   Fraction of the best cross-correlation to refine
+  @return int number of signals built
+
+  Candidates are refined by decreasing coarse cross-correlation. Once the
+  sub-pixel search has found a good solution, candidates whose coarse
+  cross-correlation is below sublim times its cross-correlation are not
+  refined at all.
+*/
+/*----------------------------------------------------------------------------*/
+static int wavecal_prune_refine(
+        wavecal_job     *   job,
+        double              xmax,
+        const double        sublim)
+{
+    wavecal_rank    *   rank ;
+    wavecal_sub     *   sub ;
+    const int           nsub = job->bounds[0].steps ;
+    int                 nrank, next, nbatch ;
+    int                 mcross = 0 ;
+    int                 b, k, i0 ;
+
+    rank  = malloc(job->ncand * sizeof(wavecal_rank));
+    nrank = 0 ;
+    for (k=0 ; k<job->ncand ; k++) {
+        if (job->cand[k].ok && job->cand[k].xcorr > xmax * sublim) {
+            rank[nrank].xcorr = job->cand[k].xcorr ;
+            rank[nrank].k     = k ;
+            nrank++ ;
+        }
+    }
+    qsort(rank, nrank, sizeof(wavecal_rank), wavecal_cmp_rank);
+
+    next = 0 ;
+    while (next < nrank) {
+        nbatch = 0 ;
+        while (next < nrank && nbatch < WAVECAL_PRUNE_BATCH) {
+            /* Candidates are sorted: none of the next ones can pass */
+            if (rank[next].xcorr <= xmax * sublim) {
+                next = nrank ;
+                break ;
+            }
+            job->batch[nbatch++] = rank[next++].k ;
+        }
+        mcross += wavecal_refine(job, nbatch);
+
+        /* Best solution so far */
+        for (b=0 ; b<nbatch ; b++) {
+            sub = job->sub + job->batch[b] * nsub ;
+            for (i0=0 ; i0<nsub ; i0++) {
+                if (sub[i0].ok && sub[i0].fdelta == 0 && sub[i0].xcorr > xmax)
+                    xmax = sub[i0].xcorr ;
+            }
+        }
+    }
+    free(rank);
+    return mcross ;
+}
+
 /*----------------------------------------------------------------------------*/
 /**
   @brief  Search for the polynomial that maximizes the Cross-correlation
@@ -746,13 +1108,12 @@ static double * wavecal_search(
         struct bound    *   bounds,
         double          *   pxcorr_max)
 {
-    double     * d_t ;
-    double       xcorr ;
-    pixelvalue * line_t ;
-    /* The delays found by cross-correlation */
-    double fdelta;
-    double pdelta;
-    double cdelta;
+    wavecal_job     job ;
+    wavecal_cand  * c ;
+    wavecal_sub   * sub ;
+    double          pdelta, cdelta ;
+    int             nworkers, nbatch, maxbatch ;
+    int             k, first, next ;
     /* The number of pixels to actually cross-correlate */
     const int    dpix      = npix - discard_le - discard_ri;
     /* The last pixel for which the spectrum should be computed - only for
@@ -770,11 +1131,9 @@ static double * wavecal_search(
     } * search;
 
     double  *   best ;
-    double  *   cand;
-    double      delta_wl;
     double      delta_wl_best = 0;
     double      delta_pix ;
-    int         n_lines ;
+    int         n_lines = 0 ;
     int         i0, i1, i2, i3 ;
     int         i2dir, i3dir;
 
@@ -804,9 +1163,6 @@ static double * wavecal_search(
     search[2].maxpos = -1;
     search[3].maxpos = -1;
 
-    /* Create the candidate array */
-    cand = malloc( CALIB_COEFFS * sizeof(double)) ;
-
     /* Create the array of maximizing polynomial coefficients */
     best = malloc( CALIB_COEFFS * sizeof(double)) ;
     best[0] = pm[0];
@@ -814,10 +1170,42 @@ static double * wavecal_search(
     best[2] = pm[2];
     best[3] = pm[3];
 
-    /* Iterate through the search space */
+    /* Set up the search */
+    job.model      = spectral_model_new(spt, order, slit_width);
+    job.line_i     = line_i ;
+    job.pm         = pm ;
+    job.bounds     = bounds ;
+    job.npix       = npix ;
+    job.rpix       = rpix ;
+    job.dpix       = dpix ;
+    job.discard_le = discard_le ;
+    for (k=0 ; k<CALIB_COEFFS ; k++) job.step[k] = search[k].step ;
+    job.ncand = bounds[1].steps * bounds[2].steps * bounds[3].steps ;
+    if (job.model == NULL || job.ncand < 1) {
+        spectral_model_del(job.model);
+        free(search);
+        free(best);
+        e_error("Empty wavelength calibration search");
+        return NULL ;
+    }
+    job.cand  = calloc(job.ncand, sizeof(wavecal_cand));
+    job.sub   = malloc(job.ncand * bounds[0].steps * sizeof(wavecal_sub));
+    job.row   = malloc((bounds[1].steps+1) * sizeof(int));
+    job.batch = malloc(job.ncand * sizeof(int));
+    nworkers  = eclipse_get_nthreads() ;
+    job.dbuf  = malloc(nworkers * sizeof(double*));
+    job.pbuf  = malloc(nworkers * sizeof(pixelvalue*));
+    for (k=0 ; k<nworkers ; k++) {
+        job.dbuf[k] = malloc(rpix * sizeof(double));
+        job.pbuf[k] = malloc(rpix * sizeof(pixelvalue));
+    }
+
+    /* List the candidates in search order: the grid is walked back and
+       forth so that only one candidate coefficient changes at a time,
+       and the delay found for a candidate can be reused for the next */
     i2dir = 1;
     i3dir = 1;
-    pdelta = cdelta = 0;
+    k = 0 ;
     for (i1=0 ; i1<bounds[1].steps ; i1++) {
       int i2start = i2dir < 0 ?  0 : bounds[2].steps-1;
       int i2stop  = i2dir > 0 ? -1 : bounds[2].steps;
@@ -825,132 +1213,106 @@ static double * wavecal_search(
       int mmwidth = niter ? XCORR_FINE : gmax_width;
 
       i2dir = - i2dir;
-
-      /* Cannot reuse a too large pdelta */
-      if (fabs(pdelta) > 2*gmax_width) pdelta = cdelta = 0;
+      job.row[i1] = k ;
 
       for (i2=i2start ; i2 != i2stop ; i2 += i2dir) {
-        /* Change only one candidate coefficient at a time so pdelta can be
-           reused */
         int i3start = i3dir < 0 ?  0 : bounds[3].steps-1;
         int i3stop  = i3dir > 0 ? -1 : bounds[3].steps;
 
         i3dir = - i3dir;
 
         for (i3=i3start ; i3 != i3stop ; i3 += i3dir) {
-            double substep;
-
             /* The biggest allowed correlation delay */
-            int mwidth = mmwidth;
-
+            job.cand[k].mwidth = mmwidth;
             mmwidth = XCORR_FINE;
 
-            /* The expected correlation delay caused by the difference
-               between the physical model and the candidate */
-            pdelta += cdelta;
-
-            /* Remove some rounding errors */
-            search[1].corr = bounds[1].min + i1 * search[1].step;
-            if (fabs(search[1].corr) < FLT_EPSILON * search[1].step)
-                search[1].corr = 0;
-
-            search[2].corr = bounds[2].min + i2 * search[2].step;
-            if (fabs(search[2].corr) < FLT_EPSILON * search[2].step)
-                search[2].corr = 0;
-
-            search[3].corr = bounds[3].min + i3 * search[3].step;
-            if (fabs(search[3].corr) < FLT_EPSILON * search[3].step)
-                search[3].corr = 0;
-
-            cand[3] = search[3].corr * pm[3];
-            cand[2] = search[2].corr * pm[2];
-            cand[1] = search[1].corr * pm[1];
-
-            /* The constant term of the candidate polynomial is shifted
-               so the central wavelength (at 0.5*(1+npix)) is unchanged
-               This shift should really be implemented as something like
-               WAVELEN(ddisprel, 0.5*(1+npix)) - ddisprel[0] */
-             
-            search[0].corr = 0.5*(1+npix) * ( pm[1] - cand[1]
-                           + 0.5*(1+npix) * ( pm[2] - cand[2]
-                           + 0.5*(1+npix) * ( pm[3] - cand[3])));
-
-            search[0].corr += bounds[0].min; /* Add global offset */
-
-            cand[0] = pm[0] + search[0].corr;
-
-            /* Transform the polynomial according to the delta-shift
-               - the subsequent delta should not not exceed +1 / -1 */
-            wave_shift(cand, pdelta);
+            job.cand[k].i1 = i1 ;
+            job.cand[k].i2 = i2 ;
+            job.cand[k].i3 = i3 ;
+            k++ ;
+        }
+      }
+    }
+    job.row[bounds[1].steps] = k ;
 
-            /* Candidate polynomial now generated */
+    /* Evaluate all rows in parallel, each one starting without delay */
+    eclipse_parallel_run(wavecal_row_task, &job, bounds[1].steps);
 
-            d_t = spectral_table_build_signal(spt, cand, order, slit_width,
-                                              rpix, &n_lines);
+    /* Carry the delays over from row to row. As soon as a candidate sees
+       the same delays as in the parallel pass, the rest of its row is
+       known to be identical. Otherwise it is evaluated again. */
+    pdelta = cdelta = 0;
+    for (i1=0 ; i1<bounds[1].steps ; i1++) {
+        /* Cannot reuse a too large pdelta */
+        if (fabs(pdelta) > 2*gmax_width) pdelta = cdelta = 0;
+
+        for (k=job.row[i1] ; k<job.row[i1+1] ; k++) {
+            c = job.cand + k ;
+            if (pdelta + cdelta != c->pdelta ||
+                (!c->ok && cdelta != c->cdelta_in)) {
+                wavecal_coarse(&job, k, pdelta, cdelta, 0);
+            }
+            pdelta = c->pdelta ;
+            cdelta = c->cdelta ;
+            if (c->ok) {
+                mcross += 2*c->mwidth+1;
+                n_lines = c->n_lines ;
+            }
+        }
+    }
 
-            if (d_t == NULL) continue;
-            line_t = double2pixel_array(d_t, rpix);
-            free(d_t);
-            if (line_t == NULL) continue;
+    /* Sub-pixel fine-tuning of the offset, for the candidates which
+       correlate well enough. Candidates are refined in batches in
+       parallel, then the results are examined in search order, exactly
+       as if the refinement had been done one candidate at a time: the
+       threshold only increases, so refining the candidates selected with
+       the threshold current at the start of a batch is always enough.
+       In pruning mode, the candidates to refine have been chosen
+       beforehand. */
+    maxbatch = nworkers > 1 ? 4*nworkers : 1 ;
+    if (wavecal_prune) {
+        mcross  += wavecal_prune_refine(&job, *pxcorr_max, sublim);
+        maxbatch = job.ncand ;
+    }
+    next = 0 ;
+    while (next < job.ncand) {
+        first  = next ;
+        nbatch = 0 ;
+        while (next < job.ncand && nbatch < maxbatch) {
+            c = job.cand + next ;
+            if (c->ok && c->xcorr > *pxcorr_max * sublim && !c->refined)
+                job.batch[nbatch++] = next ;
+            next++ ;
+        }
+        if (!wavecal_prune) mcross += wavecal_refine(&job, nbatch);
 
-            mcross += 2*mwidth+1;
-            xcorr = function1d_xcorrelate(&(line_t[discard_le]), dpix,
-                                          &(line_i[discard_le]), dpix,
-                                          mwidth, &cdelta);
-            free(line_t);
+        for (k=first ; k<next ; k++) {
+            c = job.cand + k ;
+            if (!c->refined) continue;
 
             /* Look for best correlation point - and set offset */
-            if (xcorr <= *pxcorr_max * sublim) continue;
-
-            /* sub-pixel fine-tuning of offset */
-
-            /* Transform the polynomial according to the delta-shift
-               - the subsequent delta should not not exceed +1 / -1 */
-            wave_shift(cand, cdelta);
-
-            /* delta_wl is the offset due to the correlation delay */
-            delta_wl = cand[0] - (pm[0] + search[0].corr);
-
-            /* The candidate polynomial is shifted
-               so the central wavelength (at 0.5*(1+npix)) is unchanged */
-            substep = WAVEDLT(cand, 0.5*(1+npix));
-            cand[0] -= 0.5 * substep;
+            if (c->xcorr <= *pxcorr_max * sublim) continue;
 
-            substep *= search[0].step;
-            
             for (i0 = 0; i0 < bounds[0].steps; i0++) {
-
-                cand[0] += substep;
-
-                d_t = spectral_table_build_signal(spt, cand, order, slit_width,
-                                                  rpix, &n_lines);
-
-                if (d_t == NULL) continue;
-                line_t = double2pixel_array(d_t, rpix);
-                free(d_t);
-                if (line_t == NULL) continue;
-                mcross += 5;
-                xcorr = function1d_xcorrelate(&(line_t[discard_le]), dpix,
-                                              &(line_i[discard_le]), dpix,
-                                              2, &fdelta);
-                free(line_t);
+                sub = job.sub + k*bounds[0].steps + i0 ;
 
                 /* Look for best correlation point - and set offset.
                    Will only accept non-delay solutions (but why ?) */
-                if (xcorr <= *pxcorr_max || fdelta != 0) continue;
+                if (!sub->ok) continue;
+                if (sub->xcorr <= *pxcorr_max || sub->fdelta != 0) continue;
 
-                p_delta = pdelta;
-                c_delta = cdelta ;
+                p_delta = c->pdelta;
+                c_delta = c->cdelta ;
 
-                delta_wl_best = delta_wl;
+                delta_wl_best = c->delta_wl;
 
-                best[0] = cand[0];
-                best[1] = cand[1];
-                best[2] = cand[2];
-                best[3] = cand[3];
+                best[0] = sub->c0;
+                best[1] = c->shifted[0];
+                best[2] = c->shifted[1];
+                best[3] = c->shifted[2];
 
                  /* The offset correction changes in the sub-pixel search */
-                search[0].best = cand[0] - pm[0];
+                search[0].best = best[0] - pm[0];
 
                 /* Due to the correlation correction */
                 search[1].best = best[1]*FLT_EPSILON < pm[1]
@@ -958,20 +1320,28 @@ static double * wavecal_search(
                 search[2].best = fabs(best[2])*FLT_EPSILON < fabs(pm[2])
                                ? best[2]/pm[2] : 0;
 
-                search[3].best = search[3].corr;
+                search[3].best = c->corr3;
 
-                *pxcorr_max  = xcorr ;
+                *pxcorr_max  = sub->xcorr ;
                 search[0].maxpos = i0;
-                search[1].maxpos = i1;
-                search[2].maxpos = i2;
-                search[3].maxpos = i3;
-
+                search[1].maxpos = c->i1;
+                search[2].maxpos = c->i2;
+                search[3].maxpos = c->i3;
             }
         }
-      }
     }
 
-    free(cand);
+    for (k=0 ; k<nworkers ; k++) {
+        free(job.dbuf[k]);
+        free(job.pbuf[k]);
+    }
+    free(job.dbuf);
+    free(job.pbuf);
+    free(job.batch);
+    free(job.row);
+    free(job.sub);
+    free(job.cand);
+    spectral_model_del(job.model);
 
     /* Test if no candidate produced signals with enough lines */
     if (search[1].maxpos < 0) {
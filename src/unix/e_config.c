@@ -25,6 +25,10 @@
 #include "e_config.h" 
 #include "xmemory.h"
 #include "comm.h"
+#include "parallel.h"
+#include "trace.h"
+#include "prodcache.h"
+#include "cube_tiles.h"
 
 /*---------------------------------------------------------------------------
 							Function codes
@@ -41,6 +45,11 @@
   - @c E_DEBUG for the debug level (see comm.h).
   - @c E_TMPDIR for the tmpdirname parameter (see xmemory.h)
   - @c E_LOGFILE for the logfile parameter (see comm.h)
+  - @c E_NTHREADS for the number of worker threads (see parallel.h)
+  - @c E_TRACE to enable performance tracing (see trace.h)
+  - @c E_CACHE for the product cache directory (see prodcache.h)
+  - @c E_CUBEMEM for the memory budget of loaded cubes in megabytes
+    (see cube_tiles.h)
  
   Notice that @c E_LOGFILE is tested in other places (see comm.h) for
   logfile output.
@@ -71,6 +80,23 @@ void eclipse_init(void)
 		set_logfile(1);
 		set_logfilename(env_var);
 	}
+	env_var = getenv("E_NTHREADS");
+	if (env_var != NULL) {
+		val = atoi(env_var);
+		eclipse_set_nthreads(val);
+	}
+	env_var = getenv("E_TRACE");
+	if (env_var != NULL) {
+		eclipse_trace_init(env_var);
+	}
+	env_var = getenv("E_CACHE");
+	if (env_var != NULL) {
+		prodcache_set_dir(env_var);
+	}
+	env_var = getenv("E_CUBEMEM");
+	if (env_var != NULL) {
+		cube_set_membudget(atof(env_var));
+	}
 
 	if (debug_active()>1) {
 		log = logfile_active();
@@ -79,9 +105,17 @@ void eclipse_init(void)
 				"----- eclipse run-time configuration\n"
 				"\n"
 				"      verbose  : [%d]\n"
-				"      debug    : [%d]\n",
+				"      debug    : [%d]\n"
+				"      threads  : [%d]\n"
+				"      trace    : [%s]\n"
+				"      cache    : [%s]\n"
+				"      cubemem  : [%g MB]\n",
 				verbose_active(),
-				debug_active());
+				debug_active(),
+				eclipse_get_nthreads(),
+				eclipse_trace_active ? getenv("E_TRACE") : "off",
+				prodcache_get_dir() ? prodcache_get_dir() : "off",
+				cube_get_membudget());
 		if (log)
 			fprintf(stderr,
 				"      logfile  : [%s]\n",
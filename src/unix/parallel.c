@@ -0,0 +1,226 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    parallel.c
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Run independent tasks on a set of worker threads.
+
+   This module offers a minimal interface to distribute a number of
+   independent tasks (chips of a mosaic, planes of a cube, tiles of an
+   image...) on several threads. Threads are only used if eclipse was
+   configured with --mt (HAS_PTHREADS defined in config.h), otherwise
+   all tasks are run sequentially in the calling thread.
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <unistd.h>
+
+#include "parallel.h"
+
+#ifdef HAS_PTHREADS
+#include <pthread.h>
+#endif
+
+/*---------------------------------------------------------------------------
+   								Private types
+ ---------------------------------------------------------------------------*/
+
+#ifdef HAS_PTHREADS
+/* Shared state for one call to eclipse_parallel_run() */
+typedef struct _parallel_job_ {
+	eclipse_task		fn ;
+	void			*	arg ;
+	int					ntasks ;
+	int					next ;
+	pthread_mutex_t		lock ;
+} parallel_job ;
+
+/* What a worker thread gets */
+typedef struct _parallel_worker_ {
+	parallel_job	*	job ;
+	int					id ;
+} parallel_worker ;
+#endif
+
+/*---------------------------------------------------------------------------
+   								Static variables
+ ---------------------------------------------------------------------------*/
+
+/* Requested number of threads, 0 means one per online processor */
+static int parallel_nthreads = 0 ;
+
+#ifdef HAS_PTHREADS
+/* Thread-specific flag set while a worker runs tasks */
+static pthread_key_t	parallel_inside_key ;
+static pthread_once_t	parallel_key_once = PTHREAD_ONCE_INIT ;
+#endif
+
+/*---------------------------------------------------------------------------
+   								Private functions
+ ---------------------------------------------------------------------------*/
+
+#ifdef HAS_PTHREADS
+static void parallel_make_key(void)
+{
+	pthread_key_create(&parallel_inside_key, NULL);
+	return ;
+}
+
+static void * parallel_worker_main(void * p)
+{
+	parallel_worker	*	w ;
+	parallel_job	*	job ;
+	int					task ;
+
+	w   = (parallel_worker*)p ;
+	job = w->job ;
+	pthread_setspecific(parallel_inside_key, (void*)job);
+	while (1) {
+		pthread_mutex_lock(&job->lock);
+		task = job->next++ ;
+		pthread_mutex_unlock(&job->lock);
+		if (task>=job->ntasks) break ;
+		job->fn(job->arg, task, w->id);
+	}
+	pthread_setspecific(parallel_inside_key, NULL);
+	return NULL ;
+}
+#endif
+
+/*---------------------------------------------------------------------------
+  							Function codes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Set the number of worker threads.
+  @param    n   Requested number of threads (0 for automatic).
+  @return   void
+
+  Sets the number of threads used by eclipse_parallel_run(). A value of
+  0 or less selects the number of online processors. This setting is
+  also read from the environment variable @c E_NTHREADS by
+  eclipse_init(). It has no effect if eclipse was built without
+  thread support.
+ */
+/*--------------------------------------------------------------------------*/
+void eclipse_set_nthreads(int n)
+{
+	if (n<0) n=0 ;
+	if (n>PARALLEL_MAXTHREADS) n=PARALLEL_MAXTHREADS ;
+	parallel_nthreads = n ;
+	return ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the number of worker threads.
+  @return   int number of workers eclipse_parallel_run() will use.
+
+  Returns 1 if eclipse was built without thread support.
+ */
+/*--------------------------------------------------------------------------*/
+int eclipse_get_nthreads(void)
+{
+#ifdef HAS_PTHREADS
+	long	ncpu ;
+
+	if (parallel_nthreads>0) return parallel_nthreads ;
+	ncpu = 1 ;
+#ifdef _SC_NPROCESSORS_ONLN
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (ncpu<1) ncpu=1 ;
+	if (ncpu>PARALLEL_MAXTHREADS) ncpu=PARALLEL_MAXTHREADS ;
+	return (int)ncpu ;
+#else
+	return 1 ;
+#endif
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Run a set of independent tasks on worker threads.
+  @param    fn      Task function.
+  @param    arg     Opaque argument passed to every task.
+  @param    ntasks  Number of tasks to run.
+  @return   int number of workers used, -1 on error.
+
+  Calls fn(arg, i, w) once for every i in [0..ntasks-1], where w is
+  the index of the worker thread running task i. Tasks are handed out
+  dynamically, so their execution order is not defined. The function
+  returns when all tasks are done.
+
+  The calling thread takes part in the computation as worker 0. Calls
+  to eclipse_parallel_run() made from within a task are executed
+  sequentially in the calling worker, so that nested loops do not
+  oversubscribe the machine.
+
+  The memory allocators from xmemory are safe to call from tasks.
+ */
+/*--------------------------------------------------------------------------*/
+int eclipse_parallel_run(eclipse_task fn, void * arg, int ntasks)
+{
+	int					i ;
+#ifdef HAS_PTHREADS
+	parallel_job		job ;
+	parallel_worker		workers[PARALLEL_MAXTHREADS] ;
+	pthread_t			tid[PARALLEL_MAXTHREADS] ;
+	int					nw ;
+	int					started ;
+#endif
+
+	if (fn==NULL || ntasks<0) return -1 ;
+	if (ntasks==0) return 0 ;
+
+#ifdef HAS_PTHREADS
+	pthread_once(&parallel_key_once, parallel_make_key);
+	nw = eclipse_get_nthreads() ;
+	if (nw>ntasks) nw=ntasks ;
+	/* Nested call or single worker: run here */
+	if (nw>1 && pthread_getspecific(parallel_inside_key)==NULL) {
+		job.fn     = fn ;
+		job.arg    = arg ;
+		job.ntasks = ntasks ;
+		job.next   = 0 ;
+		pthread_mutex_init(&job.lock, NULL);
+
+		started = 1 ;
+		for (i=1 ; i<nw ; i++) {
+			workers[i].job = &job ;
+			workers[i].id  = i ;
+			if (pthread_create(&tid[i], NULL, parallel_worker_main,
+							   &workers[i])!=0) {
+				break ;
+			}
+			started++ ;
+		}
+		/* The calling thread is worker 0 */
+		workers[0].job = &job ;
+		workers[0].id  = 0 ;
+		parallel_worker_main(&workers[0]);
+		for (i=1 ; i<started ; i++) {
+			pthread_join(tid[i], NULL);
+		}
+		pthread_mutex_destroy(&job.lock);
+		return started ;
+	}
+#endif
+	for (i=0 ; i<ntasks ; i++) {
+		fn(arg, i, 0);
+	}
+	return 1 ;
+}
+/* vim: set ts=4 et sw=4 tw=75 */
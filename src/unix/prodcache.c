@@ -0,0 +1,506 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    prodcache.c
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Persistent cache of reduction products.
+
+   A computation is described by a text listing the recipe, the hashes
+   of its input files and its parameters, one item per line. The key of
+   a cache entry is the MD5 hash of this text. The manifest of an entry
+   is the description followed by one line per product, giving the
+   product number and its output file name; product number i is stored
+   in the file named after the key with the extension .i.
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "prodcache.h"
+#include "static_sz.h"
+#include "filename.h"
+#include "comm.h"
+#include "e_version.h"
+#include "qfits.h"
+
+/*---------------------------------------------------------------------------
+   								Defines
+ ---------------------------------------------------------------------------*/
+
+/* Size of the copy buffer */
+#define PRODCACHE_BUFSZ		(1<<16)
+
+/*---------------------------------------------------------------------------
+   								New types
+ ---------------------------------------------------------------------------*/
+
+struct _prodcache_ {
+	char	*	desc ;		/* Description text */
+	int			size ;		/* Description length */
+	int			alloc ;		/* Allocated size of desc */
+	char	**	prod ;		/* Product file names */
+	int			nprod ;		/* Number of products */
+	int			valid ;		/* 0 if the computation cannot be cached */
+} ;
+
+/*---------------------------------------------------------------------------
+   							Private variables
+ ---------------------------------------------------------------------------*/
+
+/* Cache directory, empty if the cache is disabled */
+static char prodcache_dir[FILENAMESZ] = "" ;
+
+/*---------------------------------------------------------------------------
+							Private functions
+ ---------------------------------------------------------------------------*/
+
+/* Append a line to a description */
+static int prodcache_append(prodcache * pc, char * line)
+{
+	int		len ;
+	char *	desc ;
+
+	len = (int)strlen(line) ;
+	if (pc->size+len+2 > pc->alloc) {
+		desc = realloc(pc->desc, 2*pc->alloc+len+2) ;
+		if (desc==NULL) {
+			pc->valid = 0 ;
+			return -1 ;
+		}
+		pc->desc = desc ;
+		pc->alloc = 2*pc->alloc+len+2 ;
+	}
+	strcpy(pc->desc+pc->size, line) ;
+	pc->size += len ;
+	pc->desc[pc->size++] = '\n' ;
+	pc->desc[pc->size] = (char)0 ;
+	return 0 ;
+}
+
+/* Compute the common prefix of all file names of a cache entry */
+static int prodcache_key(prodcache * pc, char * path)
+{
+	char *	key ;
+	int		len ;
+
+	if ((key=qfits_memmd5(pc->desc, pc->size))==NULL) return -1 ;
+	len = snprintf(path, FILENAMESZ, "%s/%s", prodcache_dir, key) ;
+	if (len<0 || len>=FILENAMESZ) return -1 ;
+	return 0 ;
+}
+
+/* Copy a file, destination is removed in case of error */
+static int prodcache_copy(char * src, char * dst)
+{
+	FILE	*	in ;
+	FILE	*	out ;
+	char	*	buf ;
+	size_t		nr ;
+	int			err ;
+
+	if ((in=fopen(src, "r"))==NULL) return -1 ;
+	if ((out=fopen(dst, "w"))==NULL) {
+		fclose(in) ;
+		return -1 ;
+	}
+	if ((buf=malloc(PRODCACHE_BUFSZ))==NULL) {
+		fclose(in) ;
+		fclose(out) ;
+		remove(dst) ;
+		return -1 ;
+	}
+	err = 0 ;
+	while ((nr=fread(buf, 1, PRODCACHE_BUFSZ, in))>0) {
+		if (fwrite(buf, 1, nr, out)!=nr) {
+			err = 1 ;
+			break ;
+		}
+	}
+	if (ferror(in)) err = 1 ;
+	fclose(in) ;
+	if (fclose(out)!=0) err = 1 ;
+	free(buf) ;
+	if (err) {
+		remove(dst) ;
+		return -1 ;
+	}
+	return 0 ;
+}
+
+/* Copy a file to a temporary name, then rename it */
+static int prodcache_copy_atomic(char * src, char * dst)
+{
+	char	tmp[FILENAMESZ] ;
+	int		len ;
+
+	len = snprintf(tmp, FILENAMESZ, "%s.%ld.tmp", dst, (long)getpid()) ;
+	if (len<0 || len>=FILENAMESZ) return -1 ;
+	if (prodcache_copy(src, tmp)!=0) return -1 ;
+	if (rename(tmp, dst)!=0) {
+		remove(tmp) ;
+		return -1 ;
+	}
+	return 0 ;
+}
+
+/*---------------------------------------------------------------------------
+  							Function codes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Set the cache directory.
+  @param    dirname Name of the cache directory, or NULL to disable.
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function is called by eclipse_init() with the value of
+  @c E_CACHE. The directory is created if it does not exist. If it
+  cannot be written to, the cache is disabled.
+ */
+/*--------------------------------------------------------------------------*/
+int prodcache_set_dir(char * dirname)
+{
+	prodcache_dir[0] = (char)0 ;
+	if (dirname==NULL || dirname[0]==(char)0) return 0 ;
+	/* Leave room for the hash and the temporary suffixes */
+	if (strlen(dirname) > FILENAMESZ-64) {
+		e_warning("cache directory name too long: cache disabled") ;
+		return -1 ;
+	}
+	if (mkdir(dirname, 0777)!=0 && errno!=EEXIST) {
+		e_warning("cannot create cache directory [%s]: cache disabled",
+				dirname) ;
+		return -1 ;
+	}
+	if (access(dirname, W_OK)!=0) {
+		e_warning("cannot write to cache directory [%s]: cache disabled",
+				dirname) ;
+		return -1 ;
+	}
+	strcpy(prodcache_dir, dirname) ;
+	return 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the cache directory.
+  @return   Name of the cache directory, or NULL if the cache is disabled.
+
+  The returned string must not be modified or freed.
+ */
+/*--------------------------------------------------------------------------*/
+char * prodcache_get_dir(void)
+{
+	if (prodcache_dir[0]==(char)0) return NULL ;
+	return prodcache_dir ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Start the description of a computation.
+  @param    recipe  Recipe name.
+  @param    version Recipe version.
+  @return   1 newly allocated prodcache, or NULL if the cache is disabled.
+
+  The version should be changed whenever the algorithm changes, so
+  that products computed by older versions are not used anymore. The
+  eclipse version is part of the description as well. The returned
+  object must be deallocated using prodcache_del().
+ */
+/*--------------------------------------------------------------------------*/
+prodcache * prodcache_new(char * recipe, char * version)
+{
+	prodcache	*	pc ;
+	char			line[ASCIILINESZ] ;
+
+	if (prodcache_dir[0]==(char)0 || recipe==NULL) return NULL ;
+	if (version==NULL) version = "" ;
+	if (strlen(recipe)+strlen(version)+16 > ASCIILINESZ) return NULL ;
+
+	pc = malloc(sizeof(prodcache)) ;
+	pc->alloc = ASCIILINESZ ;
+	pc->desc = malloc(pc->alloc) ;
+	pc->size = 0 ;
+	pc->desc[0] = (char)0 ;
+	pc->prod = NULL ;
+	pc->nprod = 0 ;
+	pc->valid = 1 ;
+	sprintf(line, "recipe %s %s", recipe, version) ;
+	prodcache_append(pc, line) ;
+	sprintf(line, "eclipse %s", get_eclipse_version()) ;
+	prodcache_append(pc, line) ;
+	return pc ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Deallocate a computation description.
+  @param    pc      Description to deallocate, may be NULL.
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void prodcache_del(prodcache * pc)
+{
+	int		i ;
+
+	if (pc==NULL) return ;
+	for (i=0 ; i<pc->nprod ; i++) free(pc->prod[i]) ;
+	if (pc->prod!=NULL) free(pc->prod) ;
+	free(pc->desc) ;
+	free(pc) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Declare an input file.
+  @param    pc          Computation description, may be NULL.
+  @param    filename    Name of the input file.
+  @return   int 0 if Ok, -1 otherwise.
+
+  The complete file contents (headers included) are hashed, together
+  with the file base name, which products usually refer to in their
+  headers. Input files must be declared in the order in which the
+  recipe uses them. If the file cannot be read, the description is
+  invalidated: products will be neither fetched nor saved.
+ */
+/*--------------------------------------------------------------------------*/
+int prodcache_add_file(prodcache * pc, char * filename)
+{
+	char	line[ASCIILINESZ] ;
+	char *	md5 ;
+
+	if (pc==NULL) return 0 ;
+	if (filename==NULL) {
+		pc->valid = 0 ;
+		return -1 ;
+	}
+	if ((md5=qfits_filemd5(filename))==NULL) {
+		e_warning("cannot hash [%s]: product cache not used", filename) ;
+		pc->valid = 0 ;
+		return -1 ;
+	}
+	if (strlen(get_basename(filename))+48 > ASCIILINESZ) {
+		pc->valid = 0 ;
+		return -1 ;
+	}
+	sprintf(line, "input %s %s", md5, get_basename(filename)) ;
+	return prodcache_append(pc, line) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Declare a parameter.
+  @param    pc      Computation description, may be NULL.
+  @param    name    Parameter name.
+  @param    fmt     printf-like format of the parameter value.
+  @param    ...     Parameter value.
+  @return   int 0 if Ok, -1 otherwise.
+
+  All parameters having an influence on the products must be declared,
+  including their default values.
+ */
+/*--------------------------------------------------------------------------*/
+int prodcache_add_param(prodcache * pc, char * name, char * fmt, ...)
+{
+	char	line[ASCIILINESZ] ;
+	char	value[ASCIILINESZ] ;
+	va_list	ap ;
+	int		len ;
+
+	if (pc==NULL) return 0 ;
+	va_start(ap, fmt) ;
+	len = vsnprintf(value, ASCIILINESZ, fmt, ap) ;
+	va_end(ap) ;
+	if (len<0 || len>=ASCIILINESZ) {
+		pc->valid = 0 ;
+		return -1 ;
+	}
+	len = snprintf(line, ASCIILINESZ, "param %s = %s", name, value) ;
+	if (len<0 || len>=ASCIILINESZ) {
+		pc->valid = 0 ;
+		return -1 ;
+	}
+	return prodcache_append(pc, line) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Retrieve the products of a computation from the cache.
+  @param    pc      Computation description, may be NULL.
+  @return   int 0 if the products were retrieved, -1 otherwise.
+
+  If an entry matching the description is found, all its products are
+  copied to the file names they were saved from. Since output names
+  usually depend on recipe parameters, they should be declared with
+  prodcache_add_param().
+ */
+/*--------------------------------------------------------------------------*/
+int prodcache_fetch(prodcache * pc)
+{
+	char	base[FILENAMESZ] ;
+	char	path[FILENAMESZ] ;
+	char	line[ASCIILINESZ] ;
+	char	name[ASCIILINESZ] ;
+	char *	desc ;
+	FILE *	man ;
+	int		size ;
+	int		num ;
+	int		nprod ;
+	int		err ;
+	int		len ;
+
+	if (pc==NULL || !pc->valid) return -1 ;
+	if (prodcache_key(pc, base)!=0) return -1 ;
+	len = snprintf(path, FILENAMESZ, "%s.man", base) ;
+	if (len<0 || len>=FILENAMESZ) return -1 ;
+	if ((man=fopen(path, "r"))==NULL) return -1 ;
+
+	/* The manifest starts with the description */
+	desc = malloc(pc->size+1) ;
+	size = (int)fread(desc, 1, pc->size, man) ;
+	err = (size!=pc->size || memcmp(desc, pc->desc, pc->size)) ;
+	free(desc) ;
+	if (err) {
+		fclose(man) ;
+		e_warning("invalid cache manifest [%s]: ignored", path) ;
+		return -1 ;
+	}
+
+	/* Then come the products */
+	e_comment(0, "retrieving products from cache") ;
+	nprod = 0 ;
+	while (fgets(line, ASCIILINESZ, man)!=NULL) {
+		if (sscanf(line, "product %d %[^\n]", &num, name)!=2) {
+			err = 1 ;
+			break ;
+		}
+		len = snprintf(path, FILENAMESZ, "%s.%d", base, num) ;
+		if (len<0 || len>=FILENAMESZ) {
+			err = 1 ;
+			break ;
+		}
+		if (prodcache_copy(path, name)!=0) {
+			e_warning("cannot copy cached product to [%s]", name) ;
+			err = 1 ;
+			break ;
+		}
+		e_comment(1, "%s", name) ;
+		nprod++ ;
+	}
+	fclose(man) ;
+	if (err || nprod<1) return -1 ;
+
+	/* Mark the entry as recently used */
+	snprintf(path, FILENAMESZ, "%s.man", base) ;
+	utime(path, NULL) ;
+	return 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Declare a product of a computation.
+  @param    pc          Computation description, may be NULL.
+  @param    filename    Name of the product file.
+  @return   int 0 if Ok, -1 otherwise.
+
+  Products are only recorded here, they are copied to the cache by
+  prodcache_save(). If the file does not exist, the computation is
+  considered as failed and will not be saved.
+ */
+/*--------------------------------------------------------------------------*/
+int prodcache_add_product(prodcache * pc, char * filename)
+{
+	char **	prod ;
+
+	if (pc==NULL) return 0 ;
+	if (filename==NULL || access(filename, R_OK)!=0 ||
+		strlen(filename)+32 > ASCIILINESZ) {
+		pc->valid = 0 ;
+		return -1 ;
+	}
+	prod = realloc(pc->prod, (pc->nprod+1)*sizeof(char*)) ;
+	if (prod==NULL) {
+		pc->valid = 0 ;
+		return -1 ;
+	}
+	pc->prod = prod ;
+	pc->prod[pc->nprod++] = strdup(filename) ;
+	return 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Store the products of a computation in the cache.
+  @param    pc      Computation description, may be NULL.
+  @return   int 0 if Ok, -1 otherwise.
+
+  All declared products are copied to the cache, then the manifest is
+  written. Files are written under temporary names and renamed when
+  complete, so that concurrent processes sharing the cache never see
+  incomplete entries.
+ */
+/*--------------------------------------------------------------------------*/
+int prodcache_save(prodcache * pc)
+{
+	char	base[FILENAMESZ] ;
+	char	path[FILENAMESZ] ;
+	char	tmp[FILENAMESZ] ;
+	FILE *	man ;
+	int		err ;
+	int		len ;
+	int		i ;
+
+	if (pc==NULL) return 0 ;
+	if (!pc->valid || pc->nprod<1) return -1 ;
+	if (prodcache_key(pc, base)!=0) return -1 ;
+
+	/* Products first: a manifest never refers to missing products */
+	for (i=0 ; i<pc->nprod ; i++) {
+		len = snprintf(path, FILENAMESZ, "%s.%d", base, i+1) ;
+		if (len<0 || len>=FILENAMESZ ||
+			prodcache_copy_atomic(pc->prod[i], path)!=0) {
+			e_warning("cannot store [%s] in cache", pc->prod[i]) ;
+			return -1 ;
+		}
+	}
+	/* Then the manifest */
+	len = snprintf(path, FILENAMESZ, "%s.man", base) ;
+	if (len<0 || len>=FILENAMESZ) return -1 ;
+	len = snprintf(tmp, FILENAMESZ, "%s.%ld.tmp", path, (long)getpid()) ;
+	if (len<0 || len>=FILENAMESZ) return -1 ;
+	if ((man=fopen(tmp, "w"))==NULL) {
+		e_warning("cannot write to cache directory [%s]", prodcache_dir) ;
+		return -1 ;
+	}
+	err = fputs(pc->desc, man)==EOF ;
+	for (i=0 ; i<pc->nprod ; i++) {
+		if (fprintf(man, "product %d %s\n", i+1, pc->prod[i])<0) err = 1 ;
+	}
+	if (fclose(man)!=0) err = 1 ;
+	if (err || rename(tmp, path)!=0) {
+		remove(tmp) ;
+		e_warning("cannot write to cache directory [%s]", prodcache_dir) ;
+		return -1 ;
+	}
+	e_comment(1, "products stored in cache") ;
+	return 0 ;
+}
+/* vim: set ts=4 et sw=4 tw=75 */
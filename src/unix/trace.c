@@ -0,0 +1,419 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    trace.c
+   @author
+   @date    Oct 2026
+   @version $Revision$
+   @brief   Performance tracing of processing stages.
+
+   Stages are accumulated by name in a small table. The running stages
+   form a stack: when a stage ends, its duration is added to its own
+   entry and to the child time of its parent, so that the time spent in
+   a stage itself (self time) can be told from the time spent in the
+   stages it called. Allocations are handled the same way.
+*/
+/*--------------------------------------------------------------------------*/
+
+/*
+	$Id$
+	$Author$
+	$Date$
+	$Revision$
+*/
+
+/*---------------------------------------------------------------------------
+   								Includes
+ ---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "config.h"
+#include "trace.h"
+#include "comm.h"
+#include "xmemory.h"
+
+#ifdef HAS_PTHREADS
+#include <pthread.h>
+#endif
+
+/*---------------------------------------------------------------------------
+   								Private types
+ ---------------------------------------------------------------------------*/
+
+/* Accumulated results for one stage name */
+typedef struct _trace_stage_ {
+	const char	*	key ;
+	char			name[64] ;
+	long			calls ;
+	double			total ;
+	double			self ;
+	double			count[TRACE_NCOUNTERS] ;
+	long			nalloc ;
+	long			maxrss ;
+} trace_stage ;
+
+/* A running stage */
+typedef struct _trace_frame_ {
+	int				stage ;
+	double			start ;
+	double			child ;
+	long			nalloc ;
+	long			child_nalloc ;
+} trace_frame ;
+
+/*---------------------------------------------------------------------------
+   								Static variables
+ ---------------------------------------------------------------------------*/
+
+int eclipse_trace_active = 0 ;
+
+static trace_stage	trace_stages[TRACE_MAXSTAGES] ;
+static int			trace_nstages = 0 ;
+static trace_frame	trace_stack[TRACE_MAXDEPTH] ;
+static int			trace_depth = 0 ;
+/* Stages started beyond TRACE_MAXDEPTH or TRACE_MAXSTAGES */
+static int			trace_ignored = 0 ;
+/* Counters incremented outside of any stage */
+static double		trace_outside[TRACE_NCOUNTERS] ;
+
+static double		trace_t0 ;
+static FILE		*	trace_json = NULL ;
+static int			trace_nevents = 0 ;
+static int			trace_pid = 0 ;
+static int			trace_warned = 0 ;
+
+#ifdef HAS_PTHREADS
+static pthread_t		trace_thread ;
+static pthread_mutex_t	trace_lock = PTHREAD_MUTEX_INITIALIZER ;
+#define trace_mutex_lock()		pthread_mutex_lock(&trace_lock)
+#define trace_mutex_unlock()	pthread_mutex_unlock(&trace_lock)
+#define trace_main_thread()		pthread_equal(pthread_self(), trace_thread)
+#else
+#define trace_mutex_lock()
+#define trace_mutex_unlock()
+#define trace_main_thread()		1
+#endif
+
+/*---------------------------------------------------------------------------
+   								Private functions
+ ---------------------------------------------------------------------------*/
+
+/* Wall-clock time in seconds */
+static double trace_now(void)
+{
+	struct timeval	tv ;
+
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + 1e-6 * (double)tv.tv_usec ;
+}
+
+/* Peak resident size in Kbytes */
+static long trace_maxrss(void)
+{
+	struct rusage	ru ;
+
+	if (getrusage(RUSAGE_SELF, &ru)!=0) return 0 ;
+	return (long)ru.ru_maxrss ;
+}
+
+/* Find or create the entry for a stage name, -1 if the table is full */
+static int trace_find(const char * name)
+{
+	int	i ;
+
+	for (i=0 ; i<trace_nstages ; i++) {
+		if (trace_stages[i].key==name) return i ;
+	}
+	for (i=0 ; i<trace_nstages ; i++) {
+		if (!strcmp(trace_stages[i].name, name)) return i ;
+	}
+	if (trace_nstages>=TRACE_MAXSTAGES) return -1 ;
+	memset(trace_stages+trace_nstages, 0, sizeof(trace_stage));
+	trace_stages[trace_nstages].key = name ;
+	strncpy(trace_stages[trace_nstages].name, name, 63);
+	return trace_nstages++ ;
+}
+
+/* Append one event to the JSON trace */
+static void trace_event(char ph, trace_stage * st, double t, trace_frame * f)
+{
+	if (trace_json==NULL) return ;
+	fprintf(trace_json,
+			"%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.0f,\"pid\":%d,\"tid\":1",
+			trace_nevents ? ",\n" : "",
+			st->name,
+			ph,
+			1e6 * (t - trace_t0),
+			trace_pid);
+	if (f!=NULL) {
+		fprintf(trace_json,
+			",\"args\":{\"bytes_read\":%.0f,\"bytes_written\":%.0f,"
+			"\"pixels\":%.0f,\"allocs\":%ld,\"maxrss_kb\":%ld}",
+			st->count[TRACE_BYTES_READ],
+			st->count[TRACE_BYTES_WRITTEN],
+			st->count[TRACE_PIXELS],
+			xmemory_nalloc() - f->nalloc,
+			trace_maxrss());
+	}
+	fprintf(trace_json, "}");
+	trace_nevents++ ;
+}
+
+/* End the innermost stage, with the lock held */
+static void trace_pop(double t)
+{
+	trace_frame	*	f ;
+	trace_stage	*	st ;
+	double			elapsed ;
+	long			nalloc ;
+	long			rss ;
+
+	f  = trace_stack + trace_depth - 1 ;
+	st = trace_stages + f->stage ;
+	elapsed = t - f->start ;
+	nalloc  = xmemory_nalloc() - f->nalloc ;
+	rss     = trace_maxrss() ;
+
+	st->calls ++ ;
+	st->total += elapsed ;
+	st->self  += elapsed - f->child ;
+	st->nalloc += nalloc - f->child_nalloc ;
+	if (rss > st->maxrss) st->maxrss = rss ;
+	trace_event('E', st, t, f);
+
+	trace_depth-- ;
+	if (trace_depth>0) {
+		trace_stack[trace_depth-1].child += elapsed ;
+		trace_stack[trace_depth-1].child_nalloc += nalloc ;
+	}
+}
+
+/* Print accumulated results on stderr */
+static void trace_summary(void)
+{
+	trace_stage	*	st ;
+	int				i ;
+
+	fprintf(stderr,
+		"\n"
+		"----- eclipse trace summary\n"
+		"\n"
+		"%-24s %7s %10s %10s %9s %9s %9s %9s %8s\n",
+		"stage", "calls", "total[s]", "self[s]", "read[MB]", "write[MB]",
+		"Mpix", "allocs", "rss[MB]");
+	for (i=0 ; i<trace_nstages ; i++) {
+		st = trace_stages + i ;
+		fprintf(stderr,
+			"%-24s %7ld %10.3f %10.3f %9.1f %9.1f %9.1f %9ld %8.1f\n",
+			st->name,
+			st->calls,
+			st->total,
+			st->self,
+			st->count[TRACE_BYTES_READ] / (1024.0*1024.0),
+			st->count[TRACE_BYTES_WRITTEN] / (1024.0*1024.0),
+			st->count[TRACE_PIXELS] / 1e6,
+			st->nalloc,
+			(double)st->maxrss / 1024.0);
+	}
+	fprintf(stderr,
+		"%-24s %7s %10.3f %10s %9.1f %9.1f %9.1f %9ld %8.1f\n",
+		"(outside stages)",
+		"",
+		trace_now() - trace_t0,
+		"",
+		trace_outside[TRACE_BYTES_READ] / (1024.0*1024.0),
+		trace_outside[TRACE_BYTES_WRITTEN] / (1024.0*1024.0),
+		trace_outside[TRACE_PIXELS] / 1e6,
+		xmemory_nalloc(),
+		(double)trace_maxrss() / 1024.0);
+	if (trace_ignored>0) {
+		fprintf(stderr, "(%d stage(s) not recorded: too many or too deep)\n",
+				trace_ignored);
+	}
+	fprintf(stderr, "\n");
+}
+
+/*---------------------------------------------------------------------------
+  							Function codes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Enable tracing.
+  @param    spec    "summary", or name of the output trace file.
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function is called by eclipse_init() with the value of
+  @c E_TRACE. Results are output at exit, or when eclipse_trace_close()
+  is called. Only the first call has an effect.
+ */
+/*--------------------------------------------------------------------------*/
+int eclipse_trace_init(char * spec)
+{
+	static int	registered = 0 ;
+
+	if (spec==NULL || spec[0]==(char)0) return -1 ;
+	if (eclipse_trace_active) return 0 ;
+
+	if (strcmp(spec, "summary")) {
+		trace_json = fopen(spec, "w");
+		if (trace_json==NULL) {
+			e_error("cannot create trace file [%s]", spec);
+			return -1 ;
+		}
+		fprintf(trace_json, "[\n");
+	}
+	trace_nstages = 0 ;
+	trace_depth   = 0 ;
+	trace_ignored = 0 ;
+	trace_nevents = 0 ;
+	memset(trace_outside, 0, sizeof(trace_outside));
+	trace_pid = (int)getpid() ;
+	trace_t0  = trace_now() ;
+#ifdef HAS_PTHREADS
+	trace_thread = pthread_self() ;
+#endif
+	if (!registered) {
+		atexit(eclipse_trace_close);
+		registered = 1 ;
+	}
+	eclipse_trace_active = 1 ;
+	return 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Start a stage.
+  @param    name    Stage name.
+  @return   void
+
+  Stages are only recorded from the thread which enabled tracing: calls
+  from worker threads are ignored. The name must be a string constant
+  without quotes or backslashes. Use the TRACE_BEGIN() macro rather than
+  calling this function directly.
+ */
+/*--------------------------------------------------------------------------*/
+void eclipse_trace_begin(const char * name)
+{
+	trace_frame	*	f ;
+	int				stage ;
+
+	if (!eclipse_trace_active || name==NULL || !trace_main_thread()) return ;
+
+	trace_mutex_lock();
+	stage = -1 ;
+	if (trace_ignored==0 && trace_depth<TRACE_MAXDEPTH) {
+		stage = trace_find(name) ;
+	}
+	if (stage<0) {
+		trace_ignored++ ;
+	} else {
+		f = trace_stack + trace_depth ;
+		f->stage  = stage ;
+		f->child  = 0.0 ;
+		f->nalloc = xmemory_nalloc() ;
+		f->child_nalloc = 0 ;
+		f->start  = trace_now() ;
+		trace_event('B', trace_stages + stage, f->start, NULL);
+		trace_depth++ ;
+	}
+	trace_mutex_unlock();
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    End the current stage.
+  @param    name    Stage name, for consistency checks.
+  @return   void
+
+  The innermost running stage is ended. A warning is issued once if its
+  name does not match the given one. Use the TRACE_END() macro rather
+  than calling this function directly.
+ */
+/*--------------------------------------------------------------------------*/
+void eclipse_trace_end(const char * name)
+{
+	trace_stage	*	st ;
+	int				warn ;
+
+	if (!eclipse_trace_active || !trace_main_thread()) return ;
+
+	trace_mutex_lock();
+	warn = 0 ;
+	if (trace_ignored>0) {
+		/* End of a stage which was not recorded */
+		trace_ignored-- ;
+	} else if (trace_depth>0) {
+		st = trace_stages + trace_stack[trace_depth-1].stage ;
+		if (name!=NULL && st->key!=name && strcmp(st->name, name)) {
+			warn = !trace_warned ;
+			trace_warned = 1 ;
+		}
+		trace_pop(trace_now());
+	}
+	trace_mutex_unlock();
+	if (warn) {
+		e_warning("trace: stage [%s] ended as [%s]", st->name, name);
+	}
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Increment a counter.
+  @param    counter Counter to increment.
+  @param    n       Increment.
+  @return   void
+
+  The increment is attributed to the innermost running stage. This
+  function may be called from worker threads. Use the TRACE_COUNT()
+  macro rather than calling this function directly.
+ */
+/*--------------------------------------------------------------------------*/
+void eclipse_trace_count(trace_counter counter, double n)
+{
+	if (!eclipse_trace_active) return ;
+	if (counter<0 || counter>=TRACE_NCOUNTERS) return ;
+
+	trace_mutex_lock();
+	if (trace_depth>0) {
+		trace_stages[trace_stack[trace_depth-1].stage].count[counter] += n ;
+	} else {
+		trace_outside[counter] += n ;
+	}
+	trace_mutex_unlock();
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Output results and disable tracing.
+  @return   void
+
+  All running stages are ended, then the summary table is printed or
+  the trace file is closed. This function is registered with atexit()
+  by eclipse_trace_init(): there is normally no need to call it.
+ */
+/*--------------------------------------------------------------------------*/
+void eclipse_trace_close(void)
+{
+	double	t ;
+
+	if (!eclipse_trace_active) return ;
+
+	trace_mutex_lock();
+	t = trace_now() ;
+	while (trace_depth>0) trace_pop(t);
+	eclipse_trace_active = 0 ;
+	trace_mutex_unlock();
+
+	if (trace_json!=NULL) {
+		fprintf(trace_json, "\n]\n");
+		fclose(trace_json);
+		trace_json = NULL ;
+	} else {
+		trace_summary();
+	}
+}
+/* vim: set ts=4 et sw=4 tw=75 */
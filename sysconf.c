@@ -73,6 +73,8 @@ static struct {
     int		with_trace ;
     /* Compile with threads */
     int		with_threads ;
+    /* Compute pixel kernels in single precision */
+    int		with_float32 ;
     /* Prefix for qfits install */
     char	qfits_path[MAXSTRSZ] ;
 
@@ -654,6 +656,9 @@ void make_config_h()
 	if (config.with_threads) {
 		fprintf(out, "#define HAS_PTHREADS 1\n\n");
 	}
+	if (config.with_float32) {
+		fprintf(out, "#define FLOAT32_KERNELS 1\n\n");
+	}
 	switch (config.local_os) {
 		case os_hp08:
 		case os_hp09:
@@ -724,6 +729,7 @@ void help()
             "\n"
             "\t--prefix=PATH    Install in PATH (must be absolute)\n"
             "\t--mt             Compile with multithreading support\n"
+            "\t--float32        Compute pixel kernels in single precision\n"
             "\n"
             "Options specific to compilation with gcc (for developpers):\n"
 			"\t--lint           Compile with -Wall option\n"
@@ -761,6 +767,7 @@ int main(argc, argv)
 	config.lint_compile  = 0 ;
 	config.compiler      = COMPILER_AUTO ;
 	config.with_threads  = 0 ;
+	config.with_float32  = 0 ;
 	config.with_trace 	 = 0 ;
     config.qfits_path[0] = 0 ;
 
@@ -781,6 +788,8 @@ int main(argc, argv)
 			config.lint_compile = 1 ;
 		} else if (!strcmp(argv[i], "--mt")) {
 			config.with_threads=1 ;
+		} else if (!strcmp(argv[i], "--float32")) {
+			config.with_float32=1 ;
 		} else if (!strcmp(argv[i], "--trace")) {
 			config.with_trace = 1 ;
         } else if (!strncmp(argv[i], "--qfits=", 8)) {